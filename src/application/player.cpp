@@ -8,10 +8,35 @@
 #include <utilities/math.hpp>
 using std::clamp;
 
+namespace {
+    struct PlayerSettings {
+        SettingHandle<settings::InputFloat> movement_speed;
+        SettingHandle<settings::InputFloat> sprint_multiplier;
+        SettingHandle<settings::InputFloat> crouch_multiplier;
+        SettingHandle<settings::Checkbox> wrap_position;
+        SettingHandle<settings::InputFloat> jump_strength;
+        SettingHandle<settings::InputFloat> height;
+        SettingHandle<settings::InputFloat> crouch_height;
+        SettingHandle<settings::InputFloat> fly_speed_multiplier;
+    };
+    PlayerSettings player_settings;
+} // namespace
+
+void player_add_settings() {
+    player_settings.movement_speed = AppSettings::add<settings::InputFloat>({"Player", "Movement Speed", {.value = 1.5f}});
+    player_settings.sprint_multiplier = AppSettings::add<settings::InputFloat>({"Player", "Sprint Multiplier", {.value = 3.0f}});
+    player_settings.crouch_multiplier = AppSettings::add<settings::InputFloat>({"Player", "Crouch Multiplier", {.value = 0.5f}});
+    player_settings.wrap_position = AppSettings::add<settings::Checkbox>({"Player", "Wrap Position", {.value = true}});
+    player_settings.jump_strength = AppSettings::add<settings::InputFloat>({"Player", "Jump Strength (meters on Earth)", {.value = 1.0f}});
+    player_settings.height = AppSettings::add<settings::InputFloat>({"Player", "Height", {.value = 1.75f}});
+    player_settings.crouch_height = AppSettings::add<settings::InputFloat>({"Player", "Crouch Height", {.value = 1.0f}});
+    player_settings.fly_speed_multiplier = AppSettings::add<settings::InputFloat>({"Player", "Fly Speed Multiplier", {.value = 10.0f}});
+}
+
 void player_fix_chunk_offset(Player &PLAYER) {
     PLAYER.prev_unit_offset = PLAYER.player_unit_offset;
 #if ENABLE_CHUNK_WRAPPING
-    const bool wrap_position = AppSettings::get<settings::Checkbox>("Player", "Wrap Position").value;
+    const bool wrap_position = AppSettings::get(player_settings.wrap_position).value;
     if (wrap_position) {
         PLAYER.player_unit_offset = PLAYER.player_unit_offset + daxa_i32vec3(floor(PLAYER.pos.x), floor(PLAYER.pos.y), floor(PLAYER.pos.z));
         PLAYER.pos = {PLAYER.pos.x - floor(PLAYER.pos.x), PLAYER.pos.y - floor(PLAYER.pos.y), PLAYER.pos.z - floor(PLAYER.pos.z)};
@@ -24,20 +49,12 @@ void player_fix_chunk_offset(Player &PLAYER) {
 }
 
 void player_startup(Player &PLAYER) {
+    player_add_settings();
     if (((PLAYER.flags >> 0) & 0x1) != 0) {
         return;
     }
     PLAYER.flags = 1 | (1 << 6);
 
-    AppSettings::add<settings::InputFloat>({"Player", "Movement Speed", {.value = 1.5f}});
-    AppSettings::add<settings::InputFloat>({"Player", "Sprint Multiplier", {.value = 3.0f}});
-    AppSettings::add<settings::InputFloat>({"Player", "Crouch Multiplier", {.value = 0.5f}});
-    AppSettings::add<settings::Checkbox>({"Player", "Wrap Position", {.value = true}});
-    AppSettings::add<settings::InputFloat>({"Player", "Jump Strength (meters on Earth)", {.value = 1.0f}});
-    AppSettings::add<settings::InputFloat>({"Player", "Height", {.value = 1.75f}});
-    AppSettings::add<settings::InputFloat>({"Player", "Crouch Height", {.value = 1.0f}});
-    AppSettings::add<settings::InputFloat>({"Player", "Fly Speed Multiplier", {.value = 10.0f}});
-
     // float ground_level = AppSettings::get<settings::InputFloat>("Atmosphere", "atmosphere_bottom").value * 1000.0f + 2000.0f;
     float ground_level = 0.0f;
 
@@ -124,13 +141,13 @@ void player_perframe(PlayerInput &INPUT, Player &PLAYER, VoxelWorld &voxel_world
     const bool is_on_ground = ((PLAYER.flags >> 1) & 0x1) == 1;
     const bool is_crouched = ((PLAYER.flags >> 2) & 0x1) == 1;
 
-    const float speed = AppSettings::get<settings::InputFloat>("Player", "Movement Speed").value;
-    const float sprint_speed = AppSettings::get<settings::InputFloat>("Player", "Sprint Multiplier").value;
-    const float crouch_speed = AppSettings::get<settings::InputFloat>("Player", "Crouch Multiplier").value;
-    const float jump_strength = AppSettings::get<settings::InputFloat>("Player", "Jump Strength (meters on Earth)").value;
-    const float player_height = AppSettings::get<settings::InputFloat>("Player", "Height").value;
-    const float crouch_height = AppSettings::get<settings::InputFloat>("Player", "Crouch Height").value;
-    const float fly_speed_mult = AppSettings::get<settings::InputFloat>("Player", "Fly Speed Multiplier").value;
+    const float speed = AppSettings::get(player_settings.movement_speed).value;
+    const float sprint_speed = AppSettings::get(player_settings.sprint_multiplier).value;
+    const float crouch_speed = AppSettings::get(player_settings.crouch_multiplier).value;
+    const float jump_strength = AppSettings::get(player_settings.jump_strength).value;
+    const float player_height = AppSettings::get(player_settings.height).value;
+    const float crouch_height = AppSettings::get(player_settings.crouch_height).value;
+    const float fly_speed_mult = AppSettings::get(player_settings.fly_speed_multiplier).value;
     float height = player_height;
 
     if (INPUT.actions[GAME_ACTION_MOVE_FORWARD] != 0)
@@ -187,40 +204,21 @@ void player_perframe(PlayerInput &INPUT, Player &PLAYER, VoxelWorld &voxel_world
     PLAYER.pos = PLAYER.pos + offset;
 
     PLAYER.flags &= ~(1u << 0x1);
-    bool inside_terrain = false;
     int32_t voxel_height = height * VOXEL_SCL + 1;
 
-    for (int32_t xi = -2; xi <= 2; ++xi) {
-        for (int32_t yi = -2; yi <= 2; ++yi) {
-            for (int32_t zi = 0; zi <= voxel_height; ++zi) {
-                auto in_voxel = voxel_world.sample(PLAYER.pos - vec3(0, 0, height) + vec3(xi * VOXEL_SIZE, yi * VOXEL_SIZE, zi * VOXEL_SIZE), PLAYER.player_unit_offset);
-                if (in_voxel) {
-                    inside_terrain = true;
-                    break;
-                }
-            }
-        }
-    }
+    // The player is a column of 5x5 voxels, with their feet at the bottom.
+    auto const &occupancy = voxel_world.occupancy;
+    auto feet_voxel_i = glm::ivec3(glm::floor(VoxelOccupancy::world_to_voxel(PLAYER.pos - vec3(0, 0, height), PLAYER.player_unit_offset)));
+    auto column_min = feet_voxel_i + glm::ivec3(-2, -2, 0);
+    auto column_max = feet_voxel_i + glm::ivec3(+2, +2, 0);
+    bool inside_terrain = occupancy.overlaps(column_min, column_max + glm::ivec3(0, 0, voxel_height), PLAYER.player_unit_offset);
 
     if (inside_terrain) {
         bool space_above = false;
         int32_t first_height = -1;
         for (int32_t zi = 0; zi < voxel_height + voxel_height / 2; ++zi) {
-            bool found_voxel = false;
-            for (int32_t xi = -2; xi <= 2; ++xi) {
-                if (found_voxel) {
-                    break;
-                }
-                for (int32_t yi = -2; yi <= 2; ++yi) {
-                    if (found_voxel) {
-                        break;
-                    }
-                    auto solid = voxel_world.sample(PLAYER.pos - vec3(0, 0, height) + vec3(xi * VOXEL_SIZE, yi * VOXEL_SIZE, zi * VOXEL_SIZE), PLAYER.player_unit_offset);
-                    if (solid) {
-                        found_voxel = true;
-                    }
-                }
-            }
+            auto layer_offset = glm::ivec3(0, 0, zi);
+            bool found_voxel = occupancy.overlaps(column_min + layer_offset, column_max + layer_offset, PLAYER.player_unit_offset);
             if (zi - first_height >= voxel_height) {
                 break;
             }
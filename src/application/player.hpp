@@ -18,5 +18,8 @@ using vec3 = daxa_f32vec3;
 
 void apply_friction(PlayerInput &INPUT, vec3 &vel, vec3 &friction_vec, float friction_coeff);
 void player_fix_chunk_offset(Player &PLAYER);
+// Registers the player's settings. Also done by player_startup, even for a player that has already
+// been started.
+void player_add_settings();
 void player_startup(Player &PLAYER);
 void player_perframe(PlayerInput &INPUT, Player &PLAYER, VoxelWorld &voxel_world);
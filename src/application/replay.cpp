@@ -0,0 +1,358 @@
+#include "replay.hpp"
+
+#include <application/settings.hpp>
+#include <utilities/debug.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+namespace {
+    constexpr uint32_t REPLAY_MAGIC = 0x50525647; // "GVRP"
+    // Bump when the frame layout changes. The struct sizes are checked separately, so shader-side
+    // changes to GpuInput or ChunkUpdate are caught without touching this.
+    constexpr uint32_t REPLAY_VERSION = 1;
+
+    struct ReplayFileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t gpu_input_size;
+        uint32_t player_input_size;
+        uint32_t chunk_update_size;
+        float fixed_delta_time;
+    };
+
+    struct ReplayFrameHeader {
+        uint32_t flags;
+        uint32_t chunk_update_n;
+        uint32_t heap_size;
+    };
+
+    template <typename T>
+    void write_pod(std::ofstream &file, T const &value) {
+        file.write(reinterpret_cast<char const *>(&value), sizeof(T));
+    }
+    template <typename T>
+    void write_pod_span(std::ofstream &file, std::span<T const> values) {
+        file.write(reinterpret_cast<char const *>(values.data()), static_cast<std::streamsize>(values.size_bytes()));
+    }
+    template <typename T>
+    auto read_pod(std::ifstream &file, T &value) -> bool {
+        file.read(reinterpret_cast<char *>(&value), sizeof(T));
+        return file.good();
+    }
+    template <typename T>
+    auto read_pod_vector(std::ifstream &file, std::vector<T> &values, size_t count) -> bool {
+        values.resize(count);
+        file.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+        return file.good();
+    }
+
+    struct ReplayFrameTimings {
+        uint32_t frame_index;
+        uint32_t chunk_update_n;
+        uint32_t dirty_chunk_n;
+        bool diverged;
+        double startup_ms;
+        double player_ms;
+        double chunk_updates_ms;
+        double chunk_bricks_ms;
+        double total_ms;
+    };
+
+    struct StageSummary {
+        double mean_ms;
+        double min_ms;
+        double max_ms;
+        double p99_ms;
+    };
+
+    auto summarize(std::vector<ReplayFrameTimings> const &timings, double ReplayFrameTimings::*stage) -> StageSummary {
+        if (timings.empty()) {
+            return {};
+        }
+        auto values = std::vector<double>{};
+        values.reserve(timings.size());
+        for (auto const &frame : timings) {
+            values.push_back(frame.*stage);
+        }
+        std::sort(values.begin(), values.end());
+        auto sum = 0.0;
+        for (auto value : values) {
+            sum += value;
+        }
+        auto const p99_index = std::min(values.size() - 1, values.size() * 99 / 100);
+        return {
+            .mean_ms = sum / static_cast<double>(values.size()),
+            .min_ms = values.front(),
+            .max_ms = values.back(),
+            .p99_ms = values[p99_index],
+        };
+    }
+
+    constexpr auto STAGES = std::array{
+        std::pair{"startup", &ReplayFrameTimings::startup_ms},
+        std::pair{"player", &ReplayFrameTimings::player_ms},
+        std::pair{"chunk_updates", &ReplayFrameTimings::chunk_updates_ms},
+        std::pair{"chunk_bricks", &ReplayFrameTimings::chunk_bricks_ms},
+        std::pair{"total", &ReplayFrameTimings::total_ms},
+    };
+
+    void write_timings_csv(std::filesystem::path const &path, std::vector<ReplayFrameTimings> const &timings) {
+        auto f = std::ofstream(path);
+        f << "frame,chunk_updates,dirty_chunks,diverged";
+        for (auto const &[name, stage] : STAGES) {
+            f << ',' << name << "_ms";
+        }
+        f << '\n';
+        for (auto const &frame : timings) {
+            f << fmt::format("{},{},{},{}", frame.frame_index, frame.chunk_update_n, frame.dirty_chunk_n, frame.diverged ? 1 : 0);
+            for (auto const &[name, stage] : STAGES) {
+                f << fmt::format(",{:.4f}", frame.*stage);
+            }
+            f << '\n';
+        }
+    }
+
+    void write_timings_json(std::filesystem::path const &path, std::vector<ReplayFrameTimings> const &timings) {
+        auto json = nlohmann::json{};
+        auto &summary_json = json["summary"];
+        for (auto const &[name, stage] : STAGES) {
+            auto const summary = summarize(timings, stage);
+            summary_json[name] = {
+                {"mean_ms", summary.mean_ms},
+                {"min_ms", summary.min_ms},
+                {"max_ms", summary.max_ms},
+                {"p99_ms", summary.p99_ms},
+            };
+        }
+        auto &frames_json = json["frames"];
+        frames_json = nlohmann::json::array();
+        for (auto const &frame : timings) {
+            auto frame_json = nlohmann::json{
+                {"frame", frame.frame_index},
+                {"chunk_updates", frame.chunk_update_n},
+                {"dirty_chunks", frame.dirty_chunk_n},
+                {"diverged", frame.diverged},
+            };
+            for (auto const &[name, stage] : STAGES) {
+                frame_json[std::string{name} + "_ms"] = frame.*stage;
+            }
+            frames_json.push_back(std::move(frame_json));
+        }
+        auto f = std::ofstream(path);
+        f << std::setw(4) << json;
+    }
+
+    auto player_matches(Player const &a, Player const &b) -> bool {
+        return std::memcmp(&a.pos, &b.pos, sizeof(a.pos)) == 0 &&
+               std::memcmp(&a.player_unit_offset, &b.player_unit_offset, sizeof(a.player_unit_offset)) == 0 &&
+               a.pitch == b.pitch && a.yaw == b.yaw && a.roll == b.roll;
+    }
+} // namespace
+
+auto replay_settings_path(std::filesystem::path const &replay_path) -> std::filesystem::path {
+    return std::filesystem::path{replay_path}.replace_extension(".settings.json");
+}
+
+ReplayRecorder::ReplayRecorder(std::filesystem::path a_path, float a_fixed_delta_time)
+    : path{std::move(a_path)}, file{path, std::ios::binary} {
+    if (!file.good()) {
+        debug_utils::Console::add_log(fmt::format("[error] Failed to open '{}' for recording", path.string()));
+        return;
+    }
+    write_pod(file, ReplayFileHeader{
+                        .magic = REPLAY_MAGIC,
+                        .version = REPLAY_VERSION,
+                        .gpu_input_size = sizeof(GpuInput),
+                        .player_input_size = sizeof(PlayerInput),
+                        .chunk_update_size = sizeof(ChunkUpdate),
+                        .fixed_delta_time = a_fixed_delta_time,
+                    });
+}
+
+ReplayRecorder::~ReplayRecorder() {
+    if (is_open()) {
+        debug_utils::Console::add_log(fmt::format("Recorded {} frames to '{}'", frame_n, path.string()));
+    }
+}
+
+void ReplayRecorder::begin_frame(GpuInput const &gpu_input, PlayerInput const &player_input, bool ran_startup) {
+    if (frame_n == 0 && AppSettings::s_instance != nullptr) {
+        // Taken on the first frame rather than on construction, so it includes the user's settings.
+        AppSettings::s_instance->save(replay_settings_path(path));
+    }
+    frame.ran_startup = ran_startup;
+    frame.gpu_input = gpu_input;
+    frame.player_input = player_input;
+    frame.chunk_updates.clear();
+    frame.heap.clear();
+    in_frame = true;
+}
+
+void ReplayRecorder::record_chunk_updates(std::span<ChunkUpdate const> chunk_updates, uint32_t const *output_heap) {
+    if (!in_frame) {
+        return;
+    }
+    // Compacts the heap down to the blobs that are actually referenced, which is usually a tiny
+    // fraction of the MAX_CHUNK_UPDATES_PER_FRAME_VOXEL_COUNT words that the GPU reserves.
+    for (auto const &chunk_update : chunk_updates) {
+        if (chunk_update.info.flags != 1) {
+            continue;
+        }
+        auto &recorded = frame.chunk_updates.emplace_back(chunk_update);
+        for (auto &palette_header : recorded.palette_headers) {
+            auto const compressed_size = PaletteBlobAllocator::blob_size(palette_header.variant_n);
+            if (compressed_size == 0) {
+                continue;
+            }
+            auto const *blob = output_heap + palette_header.blob_ptr;
+            palette_header.blob_ptr = static_cast<uint32_t>(frame.heap.size());
+            frame.heap.insert(frame.heap.end(), blob, blob + compressed_size);
+        }
+    }
+}
+
+void ReplayRecorder::end_frame(Player const &player_result) {
+    if (!in_frame || !is_open()) {
+        return;
+    }
+    frame.player_result = player_result;
+    write_pod(file, ReplayFrameHeader{
+                        .flags = frame.ran_startup ? 1u : 0u,
+                        .chunk_update_n = static_cast<uint32_t>(frame.chunk_updates.size()),
+                        .heap_size = static_cast<uint32_t>(frame.heap.size()),
+                    });
+    write_pod(file, frame.gpu_input);
+    write_pod(file, frame.player_input);
+    write_pod(file, frame.player_result);
+    write_pod_span(file, std::span<ChunkUpdate const>{frame.chunk_updates});
+    write_pod_span(file, std::span<uint32_t const>{frame.heap});
+    in_frame = false;
+    ++frame_n;
+}
+
+ReplayReader::ReplayReader(std::filesystem::path const &path) : file{path, std::ios::binary} {
+    auto header = ReplayFileHeader{};
+    if (!file.good() || !read_pod(file, header)) {
+        debug_utils::Console::add_log(fmt::format("[error] Failed to open replay '{}'", path.string()));
+        return;
+    }
+    if (header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+        debug_utils::Console::add_log(fmt::format("[error] '{}' is not a replay, or was made by an incompatible version", path.string()));
+        return;
+    }
+    if (header.gpu_input_size != sizeof(GpuInput) || header.player_input_size != sizeof(PlayerInput) || header.chunk_update_size != sizeof(ChunkUpdate)) {
+        debug_utils::Console::add_log(fmt::format("[error] Replay '{}' was recorded with different shader structs", path.string()));
+        return;
+    }
+    fixed_delta_time = header.fixed_delta_time;
+    is_valid = true;
+}
+
+auto ReplayReader::read_frame(ReplayFrame &frame) -> bool {
+    if (!is_valid) {
+        return false;
+    }
+    auto header = ReplayFrameHeader{};
+    if (!read_pod(file, header)) {
+        return false;
+    }
+    auto ok = read_pod(file, frame.gpu_input) &&
+              read_pod(file, frame.player_input) &&
+              read_pod(file, frame.player_result) &&
+              read_pod_vector(file, frame.chunk_updates, header.chunk_update_n) &&
+              read_pod_vector(file, frame.heap, header.heap_size);
+    if (!ok) {
+        // A recording that was cut off mid-frame (e.g. the app crashed). Keep what came before.
+        is_valid = false;
+        return false;
+    }
+    frame.ran_startup = (header.flags & 1) != 0;
+    return true;
+}
+
+auto run_replay_benchmark(ReplayBenchmarkInfo const &info) -> bool {
+    using Clock = std::chrono::steady_clock;
+    auto elapsed_ms = [](Clock::time_point t0, Clock::time_point t1) {
+        return std::chrono::duration<double, std::milli>(t1 - t0).count();
+    };
+
+    auto reader = ReplayReader{info.replay_path};
+    if (!reader.is_open()) {
+        return false;
+    }
+    auto const settings_path = replay_settings_path(info.replay_path);
+    if (std::filesystem::exists(settings_path)) {
+        AppSettings::s_instance->load(settings_path);
+    }
+    // The recording may have begun mid-session, so player_startup might never run.
+    player_add_settings();
+
+    auto const fixed_delta_time = info.fixed_delta_time > 0.0f ? info.fixed_delta_time : reader.fixed_delta_time;
+
+    auto voxel_world = VoxelWorld{};
+    voxel_world.init_cpu_chunks();
+
+    auto timings = std::vector<ReplayFrameTimings>{};
+    auto frame = ReplayFrame{};
+    auto player = Player{};
+    auto diverged_n = 0u;
+
+    while (reader.read_frame(frame)) {
+        if (timings.empty()) {
+            player = frame.gpu_input.player;
+        }
+        auto frame_timings = ReplayFrameTimings{
+            .frame_index = static_cast<uint32_t>(timings.size()),
+            .chunk_update_n = static_cast<uint32_t>(frame.chunk_updates.size()),
+        };
+        auto const delta_time = fixed_delta_time > 0.0f ? fixed_delta_time : frame.gpu_input.delta_time;
+        frame.player_input.delta_time = delta_time;
+
+        auto const t0 = Clock::now();
+        if (frame.ran_startup) {
+            player_startup(player);
+        }
+        auto const t1 = Clock::now();
+        player_perframe(frame.player_input, player, voxel_world);
+        auto const t2 = Clock::now();
+        voxel_world.apply_chunk_updates(frame.chunk_updates, frame.heap.data(), player.player_unit_offset);
+        frame_timings.dirty_chunk_n = static_cast<uint32_t>(voxel_world.dirty_chunk_indices.size());
+        auto const t3 = Clock::now();
+        voxel_world.build_dirty_chunk_bricks(player.player_unit_offset, ThreadPool::s_instance);
+        voxel_world.clear_dirty_chunks();
+        auto const t4 = Clock::now();
+
+        frame_timings.startup_ms = elapsed_ms(t0, t1);
+        frame_timings.player_ms = elapsed_ms(t1, t2);
+        frame_timings.chunk_updates_ms = elapsed_ms(t2, t3);
+        frame_timings.chunk_bricks_ms = elapsed_ms(t3, t4);
+        frame_timings.total_ms = elapsed_ms(t0, t4);
+        // Only meaningful when replaying at the timestep that was recorded.
+        frame_timings.diverged = !player_matches(player, frame.player_result);
+        diverged_n += frame_timings.diverged ? 1 : 0;
+        timings.push_back(frame_timings);
+    }
+
+    debug_utils::Console::add_log(fmt::format("Replayed {} frames from '{}' ({} diverged from the recording)", timings.size(), info.replay_path.string(), diverged_n));
+    for (auto const &[name, stage] : STAGES) {
+        auto const summary = summarize(timings, stage);
+        debug_utils::Console::add_log(fmt::format("  {:<14} mean {:8.4f} ms, min {:8.4f} ms, max {:8.4f} ms, p99 {:8.4f} ms", name, summary.mean_ms, summary.min_ms, summary.max_ms, summary.p99_ms));
+    }
+
+    if (!info.output_path.empty()) {
+        if (info.output_path.extension() == ".json") {
+            write_timings_json(info.output_path, timings);
+        } else {
+            write_timings_csv(info.output_path, timings);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <application/player.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+// Records everything the CPU side of a frame consumes (the GpuInput, the PlayerInput that was fed to
+// player_perframe and the chunk updates read back from the GPU), so that it can be replayed without
+// a window or a device, at a fixed timestep, to measure and compare the CPU frame stages.
+
+struct ReplayFrame {
+    bool ran_startup;
+    // Captured before player_perframe ran, so the player state is the input to the frame.
+    GpuInput gpu_input;
+    PlayerInput player_input;
+    // The player after player_perframe, used to tell when a replay diverges from the recording.
+    Player player_result;
+    // Only the updates with `info.flags == 1`. Their blob pointers are offsets into `heap`.
+    std::vector<ChunkUpdate> chunk_updates;
+    std::vector<uint32_t> heap;
+};
+
+struct ReplayRecorder {
+    explicit ReplayRecorder(std::filesystem::path a_path, float a_fixed_delta_time = 0.0f);
+    ~ReplayRecorder();
+
+    ReplayRecorder(ReplayRecorder const &) = delete;
+    ReplayRecorder(ReplayRecorder &&) noexcept = delete;
+    ReplayRecorder &operator=(ReplayRecorder const &) = delete;
+    ReplayRecorder &operator=(ReplayRecorder &&) noexcept = delete;
+
+    auto is_open() const -> bool { return file.good(); }
+
+    void begin_frame(GpuInput const &gpu_input, PlayerInput const &player_input, bool ran_startup);
+    // `output_heap` is the same pointer that is handed to VoxelWorld::apply_chunk_updates.
+    void record_chunk_updates(std::span<ChunkUpdate const> chunk_updates, uint32_t const *output_heap);
+    void end_frame(Player const &player_result);
+
+    std::filesystem::path path;
+    uint32_t frame_n = 0;
+
+  private:
+    std::ofstream file;
+    ReplayFrame frame{};
+    bool in_frame = false;
+};
+
+struct ReplayReader {
+    explicit ReplayReader(std::filesystem::path const &path);
+
+    auto is_open() const -> bool { return is_valid; }
+    auto read_frame(ReplayFrame &frame) -> bool;
+
+    float fixed_delta_time = 0.0f;
+
+  private:
+    std::ifstream file;
+    bool is_valid = false;
+};
+
+struct ReplayBenchmarkInfo {
+    std::filesystem::path replay_path;
+    // Timings are written as JSON if this ends in ".json", and as CSV otherwise. Empty skips writing.
+    std::filesystem::path output_path;
+    // Overrides the timestep stored in the recording. Recordings made without a fixed timestep
+    // replay their measured frame times when neither is set.
+    float fixed_delta_time = 0.0f;
+};
+
+// Replays a recording without a window or a GPU. Needs AppSettings and the ThreadPool to exist.
+auto run_replay_benchmark(ReplayBenchmarkInfo const &info) -> bool;
+
+// Sidecar holding the settings the recording was made with.
+auto replay_settings_path(std::filesystem::path const &replay_path) -> std::filesystem::path;
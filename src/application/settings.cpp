@@ -1,6 +1,9 @@
 #include "ui.hpp"
+#include <utilities/debug.hpp>
 #include <nlohmann/json.hpp>
 #include <fmt/format.h>
+#include <algorithm>
+#include <array>
 #include <fstream>
 #include <numbers>
 
@@ -14,38 +17,60 @@ AppSettings::~AppSettings() {
     s_instance = nullptr;
 }
 
-void AppSettings::add(SettingCategoryId const &category_id, SettingId const &id, SettingEntry const &entry) {
+auto AppSettings::find_entry(SettingCategoryId const &category_id, SettingId const &id) -> SettingEntry * {
+    auto &self = *s_instance;
+    auto category_iter = self.categories.find(category_id);
+    if (category_iter == self.categories.end()) {
+        return nullptr;
+    }
+    auto entry_iter = category_iter->second.find(id);
+    if (entry_iter == category_iter->second.end()) {
+        return nullptr;
+    }
+    return &entry_iter->second;
+}
+
+auto AppSettings::add(SettingCategoryId const &category_id, SettingId const &id, SettingEntry const &entry) -> uint32_t {
     // TODO: make threadsafe
     auto &self = *s_instance;
     auto &category = self.categories[category_id];
     auto entry_iter = category.find(id);
     if (entry_iter == category.end()) {
-        category.insert({id, entry});
+        entry_iter = category.insert({id, entry}).first;
+        entry_iter->second.index = static_cast<uint32_t>(self.entries.size());
+        entry_iter->second.changed_epoch = ++self.epoch;
+        self.entries.push_back(&entry_iter->second);
     } else {
-        entry_iter->second.factory_default = entry.factory_default;
-        entry_iter->second.config = entry.config;
+        auto &existing = entry_iter->second;
+        // Values loaded for a setting whose type has changed since can't be used.
+        if (existing.data.index() != entry.factory_default.index()) {
+            existing.data = entry.factory_default;
+            existing.user_default = entry.factory_default;
+            mark_changed(existing);
+        }
+        existing.factory_default = entry.factory_default;
+        existing.config = entry.config;
     }
+    return entry_iter->second.index;
+}
+
+void AppSettings::mark_changed(SettingEntry &entry) {
+    entry.changed_epoch = ++s_instance->epoch;
 }
 
 auto AppSettings::get(SettingCategoryId const &category_id, SettingId const &id) -> SettingEntry {
     // TODO: make threadsafe
-    // TODO: make lookup faster
-    auto &self = *s_instance;
-    auto &category = self.categories[category_id];
-    auto entry_iter = category.find(id);
-    if (entry_iter != category.end()) {
-        return entry_iter->second;
+    if (auto const *entry = find_entry(category_id, id)) {
+        return *entry;
     }
     return {};
 }
 
 void AppSettings::set(SettingCategoryId const &category_id, SettingId const &id, SettingValue const &value) {
     // TODO: make threadsafe
-    auto &self = *s_instance;
-    auto &category = self.categories[category_id];
-    auto entry_iter = category.find(id);
-    if (entry_iter != category.end()) {
-        entry_iter->second.data = value;
+    if (auto *entry = find_entry(category_id, id)) {
+        entry->data = value;
+        mark_changed(*entry);
     }
 }
 
@@ -90,30 +115,72 @@ namespace settings {
     }
 } // namespace settings
 
-#include <typeinfo>
-
 void to_json(nlohmann::json &j, SettingValue const &x) {
     j = nlohmann::json{};
     std::visit(
         [&](auto &&entry_data) {
-            j["type"] = typeid(entry_data).name();
+            j["type"] = std::decay_t<decltype(entry_data)>::type_name;
             j["setting"] = entry_data;
         },
         x);
 }
 
+auto setting_value_to_string(SettingValue const &value) -> std::string {
+    auto json = nlohmann::json{};
+    to_json(json, value);
+    return json["setting"].dump();
+}
+
 namespace {
+    // Bump when the file layout changes, and add a migration from the previous version below.
+    constexpr uint32_t SETTINGS_VERSION = 2;
+
     template <typename... Ts>
     auto make_type_name_table(std::variant<Ts...> const &) {
-        return std::map<std::string, std::variant<Ts...>>{
-            {std::string{typeid(Ts).name()}, Ts{}}...};
+        return std::map<std::string, std::variant<Ts...>, std::less<>>{
+            {std::string{Ts::type_name}, Ts{}}...};
+    }
+
+    // Version 1 named the setting types with typeid(T).name(), which differs between compilers (e.g.
+    // "N8settings10InputFloatE" or "struct settings::InputFloat"). All of them contain the plain
+    // type name though, so the longest plain name found in there is the one.
+    void migrate_settings_v1_to_v2(nlohmann::json &json) {
+        auto const type_names = make_type_name_table(SettingValue{});
+        auto migrate_value = [&](nlohmann::json &value_json) {
+            if (!value_json.contains("type") || !value_json["type"].is_string()) {
+                return;
+            }
+            auto const old_name = value_json["type"].get<std::string>();
+            auto new_name = std::string_view{};
+            for (auto const &[name, value] : type_names) {
+                if (old_name.find(name) != std::string::npos && name.size() > new_name.size()) {
+                    new_name = name;
+                }
+            }
+            value_json["type"] = new_name;
+        };
+        if (!json.contains("categories")) {
+            return;
+        }
+        for (auto &[category_id, category_json] : json["categories"].items()) {
+            for (auto &[entry_id, entry_json] : category_json.items()) {
+                migrate_value(entry_json["data"]);
+                migrate_value(entry_json["user_default"]);
+            }
+        }
     }
+
+    // Index i upgrades a file from version i + 1 to version i + 2.
+    using SettingsMigration = void (*)(nlohmann::json &json);
+    constexpr std::array<SettingsMigration, SETTINGS_VERSION - 1> settings_migrations = {
+        migrate_settings_v1_to_v2,
+    };
 } // namespace
 
-static const std::map<std::string, SettingValue> setting_type_name_table = make_type_name_table(SettingValue{});
+static const auto setting_type_name_table = make_type_name_table(SettingValue{});
 
 void from_json(const nlohmann::json &j, SettingValue &x) {
-    x = setting_type_name_table.at(j["type"]);
+    x = setting_type_name_table.at(j["type"].get<std::string>());
     std::visit([&](auto &entry_data) { j["setting"].get_to(entry_data); }, x);
 }
 
@@ -127,39 +194,84 @@ void from_json(const nlohmann::json &j, SettingEntry &x) {
     from_json(j["user_default"], x.user_default);
 }
 
-void AppSettings::save(std::filesystem::path const &filepath) {
+auto write_settings_file(SettingsSnapshot const &snapshot, std::filesystem::path const &filepath) -> bool {
     auto json = nlohmann::json{};
 
-    json["_version"] = 1;
+    json["_version"] = SETTINGS_VERSION;
 
     auto &categories_json = json["categories"];
-    for (auto const &[cat_id, category] : categories) {
+    for (auto const &[cat_id, category] : snapshot.categories) {
         auto &category_json = categories_json[cat_id];
         for (auto const &[entry_key, entry] : category) {
             category_json[entry_key] = entry;
         }
     }
 
-    json["mouse_sensitivity"] = mouse_sensitivity;
-    json["world_seed_str"] = world_seed_str;
+    json["mouse_sensitivity"] = snapshot.mouse_sensitivity;
+    json["world_seed_str"] = snapshot.world_seed_str;
 
-    for (auto [key_i, action_i] : keybinds) {
+    for (auto [key_i, action_i] : snapshot.keybinds) {
         auto str = fmt::format("key_{}", key_i);
         json[str] = action_i;
     }
-    for (auto [mouse_button_i, action_i] : mouse_button_binds) {
+    for (auto [mouse_button_i, action_i] : snapshot.mouse_button_binds) {
         auto str = fmt::format("mouse_button_{}", mouse_button_i);
         json[str] = action_i;
     }
 
-    auto f = std::ofstream(filepath);
-    f << std::setw(4) << json;
+    auto temp_path = filepath;
+    temp_path += ".tmp";
+    {
+        auto f = std::ofstream(temp_path, std::ios::trunc);
+        f << std::setw(4) << json;
+        f.flush();
+        if (!f.good()) {
+            f.close();
+            auto ec = std::error_code{};
+            std::filesystem::remove(temp_path, ec);
+            debug_utils::Console::add_log(fmt::format("[error] Failed to write {}", filepath.string()));
+            return false;
+        }
+    }
+    auto ec = std::error_code{};
+    std::filesystem::rename(temp_path, filepath, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        debug_utils::Console::add_log(fmt::format("[error] Failed to replace {}: {}", filepath.string(), ec.message()));
+        return false;
+    }
+    return true;
+}
+
+auto AppSettings::snapshot() const -> SettingsSnapshot {
+    return SettingsSnapshot{
+        .categories = categories,
+        .keybinds = keybinds,
+        .mouse_button_binds = mouse_button_binds,
+        .mouse_sensitivity = mouse_sensitivity,
+        .world_seed_str = world_seed_str,
+    };
+}
+
+void AppSettings::save(std::filesystem::path const &filepath) {
+    write_settings_file(snapshot(), filepath);
 }
 
 void AppSettings::load(std::filesystem::path const &filepath) {
     clear();
 
-    auto json = nlohmann::json::parse(std::ifstream(filepath));
+    auto json = nlohmann::json::parse(std::ifstream(filepath), nullptr, false);
+    if (json.is_discarded() || !json.is_object()) {
+        debug_utils::Console::add_log(fmt::format("[error] Failed to parse {}", filepath.string()));
+        return;
+    }
+    auto version = std::max(json.value("_version", 1u), 1u);
+    if (version > SETTINGS_VERSION) {
+        debug_utils::Console::add_log(fmt::format("[error] {} is from a newer version ({}), loading what can be read", filepath.string(), version));
+    }
+    for (; version < SETTINGS_VERSION; ++version) {
+        settings_migrations[version - 1](json);
+    }
 
     auto grab_value = [&json](auto str, auto &val) {
         if (json.contains(str)) {
@@ -173,8 +285,24 @@ void AppSettings::load(std::filesystem::path const &filepath) {
             auto &category = categories[category_id];
             for (auto &[entry_id, entry_json] : category_json.items()) {
                 SettingEntry entry;
-                from_json(entry_json, entry);
-                category.insert({entry_id, entry});
+                try {
+                    from_json(entry_json, entry);
+                } catch (nlohmann::json::exception const &) {
+                    continue;
+                } catch (std::out_of_range const &) {
+                    continue;
+                }
+                auto entry_iter = category.find(entry_id);
+                if (entry_iter == category.end()) {
+                    // Not added yet, which keeps the values around for when it is.
+                    entry_iter = category.insert({entry_id, entry}).first;
+                    entry_iter->second.index = static_cast<uint32_t>(entries.size());
+                    entries.push_back(&entry_iter->second);
+                } else if (entry_iter->second.data.index() == entry.data.index()) {
+                    entry_iter->second.data = entry.data;
+                    entry_iter->second.user_default = entry.user_default;
+                }
+                entry_iter->second.changed_epoch = ++epoch;
             }
         }
     }
@@ -232,3 +360,39 @@ void AppSettings::reset_default() {
     mouse_button_binds[GLFW_MOUSE_BUTTON_2] = GAME_ACTION_BRUSH_B;
     // clang-format on
 }
+
+void SettingsSaver::mark_dirty() {
+    is_dirty = true;
+    last_change_time = Clock::now();
+}
+
+void SettingsSaver::mark_dirty_now() {
+    is_dirty = true;
+    last_change_time = {};
+}
+
+void SettingsSaver::update(AppSettings const &settings) {
+    if (!is_dirty || !write_job.done() || Clock::now() - last_change_time < debounce) {
+        return;
+    }
+    is_dirty = false;
+    auto snapshot = std::make_shared<SettingsSnapshot>(settings.snapshot());
+    if (ThreadPool::s_instance == nullptr) {
+        write_settings_file(*snapshot, path);
+        return;
+    }
+    write_job = ThreadPool::s_instance->enqueue([snapshot, filepath = path]() {
+        write_settings_file(*snapshot, filepath);
+    });
+}
+
+void SettingsSaver::flush(AppSettings const &settings) {
+    if (!write_job.done() && ThreadPool::s_instance != nullptr) {
+        ThreadPool::s_instance->wait(write_job);
+    }
+    write_job = {};
+    if (is_dirty) {
+        is_dirty = false;
+        write_settings_file(settings.snapshot(), path);
+    }
+}
@@ -1,31 +1,40 @@
 #pragma once
 
+#include <chrono>
 #include <map>
 #include <filesystem>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 #include <GLFW/glfw3.h>
 #include "settings.inl"
+#include <utilities/thread_pool.hpp>
 
 using SettingCategoryId = std::string;
 using SettingId = std::string;
 
 namespace settings {
     struct InputFloat {
+        static constexpr std::string_view type_name = "InputFloat";
         float value;
     };
     struct InputFloat3 {
+        static constexpr std::string_view type_name = "InputFloat3";
         daxa_f32vec3 value;
     };
     struct SliderFloat {
+        static constexpr std::string_view type_name = "SliderFloat";
         float value;
         float min;
         float max;
     };
     struct Checkbox {
+        static constexpr std::string_view type_name = "Checkbox";
         bool value;
     };
     struct ComboBox {
+        static constexpr std::string_view type_name = "ComboBox";
         int32_t value;
     };
 } // namespace settings
@@ -48,6 +57,19 @@ struct SettingEntry {
     SettingValue factory_default;
     SettingValue user_default;
     SettingConfig config;
+    // Position in AppSettings::entries, which is what handles refer to.
+    uint32_t index = ~0u;
+    // Value of AppSettings::epoch when `data` last changed.
+    uint64_t changed_epoch = 0;
+};
+
+// Stable reference to a registered setting. Resolved once (usually when the setting is added), after
+// which reading it is an array index instead of two string lookups.
+template <typename T>
+struct SettingHandle {
+    uint32_t index = ~0u;
+
+    auto valid() const -> bool { return index != ~0u; }
 };
 
 template <typename T>
@@ -58,6 +80,22 @@ struct SettingInfo {
     SettingConfig config = {};
 };
 
+// The value as it is written to the settings file, for printing.
+auto setting_value_to_string(SettingValue const &value) -> std::string;
+
+// Everything AppSettings writes to disk, copied out so that it can be written on another thread.
+struct SettingsSnapshot {
+    std::map<SettingCategoryId, std::map<SettingId, SettingEntry>> categories;
+    std::map<daxa_i32, daxa_i32> keybinds;
+    std::map<daxa_i32, daxa_i32> mouse_button_binds;
+    daxa_f32 mouse_sensitivity;
+    std::string world_seed_str;
+};
+
+// Writes `snapshot` to a temporary file next to `filepath`, and only then renames it over
+// `filepath`, so that a crash mid-write leaves the previous file intact.
+auto write_settings_file(SettingsSnapshot const &snapshot, std::filesystem::path const &filepath) -> bool;
+
 struct AppSettings {
     // TODO: remove these explicit settings in favor of settings registry
     std::map<daxa_i32, daxa_i32> keybinds;
@@ -68,34 +106,116 @@ struct AppSettings {
 
     static inline AppSettings *s_instance = nullptr;
 
+    // Map nodes never move, so entries can point into this.
     std::map<SettingCategoryId, std::map<SettingId, SettingEntry>> categories;
+    std::vector<SettingEntry *> entries;
+    // Bumped on every change to any setting's value.
+    uint64_t epoch = 1;
 
     AppSettings();
     ~AppSettings();
 
-    static void add(SettingCategoryId const &category_id, SettingId const &id, SettingEntry const &entry);
+    static auto add(SettingCategoryId const &category_id, SettingId const &id, SettingEntry const &entry) -> uint32_t;
+    template <typename T>
+    static auto add(SettingInfo<T> const &info) -> SettingHandle<T> {
+        return {add(info.category_id,
+                    info.id,
+                    SettingEntry{
+                        .data = info.factory_default,
+                        .factory_default = info.factory_default,
+                        .user_default = info.factory_default,
+                        .config = info.config,
+                    })};
+    }
+    // Returns an invalid handle if there's no such setting, or if it isn't a T.
     template <typename T>
-    static void add(SettingInfo<T> const &info) {
-        add(info.category_id,
-            info.id,
-            SettingEntry{
-                .data = info.factory_default,
-                .factory_default = info.factory_default,
-                .user_default = info.factory_default,
-                .config = info.config,
-            });
+    static auto find(SettingCategoryId const &category_id, SettingId const &id) -> SettingHandle<T> {
+        auto const *entry = find_entry(category_id, id);
+        if (entry == nullptr || !std::holds_alternative<T>(entry->data)) {
+            return {};
+        }
+        return {entry->index};
     }
 
+    // Must be called after writing to a SettingEntry directly, so that watchers see the change.
+    static void mark_changed(SettingEntry &entry);
+
     static void set(SettingCategoryId const &category_id, SettingId const &id, SettingValue const &value);
+    template <typename T>
+    static void set(SettingHandle<T> handle, T const &value) {
+        auto &entry = *s_instance->entries[handle.index];
+        entry.data = value;
+        mark_changed(entry);
+    }
 
     static auto get(SettingCategoryId const &category_id, SettingId const &id) -> SettingEntry;
     template <typename T>
     static auto get(SettingCategoryId const &category_id, SettingId const &id) -> T {
         return std::get<T>(get(category_id, id).data);
     }
+    // Doesn't copy, look anything up, or lock. Invalid handles read as a default constructed T.
+    template <typename T>
+    static auto get(SettingHandle<T> handle) -> T const & {
+        static auto const fallback = T{};
+        if (!handle.valid()) {
+            return fallback;
+        }
+        auto const *result = std::get_if<T>(&s_instance->entries[handle.index]->data);
+        return result != nullptr ? *result : fallback;
+    }
+
+    static auto current_epoch() -> uint64_t { return s_instance->epoch; }
+    template <typename T>
+    static auto changed_since(SettingHandle<T> handle, uint64_t since_epoch) -> bool {
+        return handle.valid() && s_instance->entries[handle.index]->changed_epoch > since_epoch;
+    }
 
+    auto snapshot() const -> SettingsSnapshot;
+    // Blocks on the file I/O. SettingsSaver does the same off the main thread.
     void save(std::filesystem::path const &filepath);
+    // Files written by older versions are migrated first. Unreadable files leave the settings as
+    // they were after clear().
     void load(std::filesystem::path const &filepath);
     void clear();
     void reset_default();
+
+  private:
+    static auto find_entry(SettingCategoryId const &category_id, SettingId const &id) -> SettingEntry *;
+};
+
+// Tells a consumer that derives state from settings when any setting changed since it last looked,
+// so it can skip re-deriving on every frame.
+struct SettingsWatcher {
+    uint64_t seen_epoch = 0;
+
+    auto poll() -> bool {
+        auto const epoch = AppSettings::current_epoch();
+        if (epoch == seen_epoch) {
+            return false;
+        }
+        seen_epoch = epoch;
+        return true;
+    }
+};
+
+// Saves settings on the thread pool, coalescing changes. mark_dirty() only notes the time of the
+// change. Once nothing changed for `debounce`, update() copies a snapshot and hands it to a job,
+// so the frame never waits on file I/O. At most one write is in flight, and changes made while it
+// runs go into the next one.
+struct SettingsSaver {
+    using Clock = std::chrono::steady_clock;
+
+    std::filesystem::path path;
+    Clock::duration debounce = std::chrono::milliseconds{500};
+
+    bool is_dirty = false;
+    Clock::time_point last_change_time{};
+    JobHandle write_job{};
+
+    void mark_dirty();
+    // Skips the debounce, for explicit saves.
+    void mark_dirty_now();
+    void update(AppSettings const &settings);
+    // Waits for the write in flight, and writes any remaining changes on the calling thread.
+    void flush(AppSettings const &settings);
 };
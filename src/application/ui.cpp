@@ -175,16 +175,24 @@ AppUi::AppUi(GLFWwindow *glfw_window_ptr)
         settings.save(data_directory / "user_settings.json");
     }
 
+    ui_scale_setting = AppSettings::add<settings::InputFloat>({"UI", "Scale", {.value = 1.0f}});
+    show_debug_info_setting = AppSettings::add<settings::Checkbox>({"UI", "show_debug_info", {.value = false}});
+    show_console_setting = AppSettings::add<settings::Checkbox>({"UI", "show_console", {.value = false}});
+    autosave_setting = AppSettings::add<settings::Checkbox>({"UI", "autosave", {.value = true}});
+
+    settings_saver.path = data_directory / "user_settings.json";
+
     rescale_ui();
 
     ImGui_ImplGlfw_InitForVulkan(glfw_window_ptr, true);
 }
 
 AppUi::~AppUi() {
-    auto autosave = AppSettings::get<settings::Checkbox>("UI", "autosave").value;
+    auto autosave = AppSettings::get(autosave_setting).value;
     if ((autosave || autosave_override) && needs_saving) {
-        settings.save(data_directory / "user_settings.json");
+        settings_saver.mark_dirty_now();
     }
+    settings_saver.flush(settings);
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 }
@@ -287,9 +295,9 @@ namespace {
 void AppUi::settings_ui() {
     ImGui::Begin("Settings");
 
-    auto autosave_0 = AppSettings::get<settings::Checkbox>("UI", "autosave").value;
+    auto autosave_0 = AppSettings::get(autosave_setting).value;
 
-    auto new_ui_scale = std::clamp(AppSettings::get<settings::InputFloat>("UI", "Scale").value, 0.5f, 2.0f);
+    auto new_ui_scale = std::clamp(AppSettings::get(ui_scale_setting).value, 0.5f, 2.0f);
     if (new_ui_scale != ui_scale) {
         ui_scale = new_ui_scale;
         rescale_ui();
@@ -314,6 +322,7 @@ void AppUi::settings_ui() {
                     if (ImGui::Button("Reset")) {
                         for (auto &[id, entry] : category) {
                             entry.data = entry.user_default;
+                            AppSettings::mark_changed(entry);
                             needs_saving = true;
                             if (entry.config.task_graph_depends) {
                                 should_record_task_graph = true;
@@ -324,6 +333,7 @@ void AppUi::settings_ui() {
                     if (ImGui::Button("Factory Reset")) {
                         for (auto &[id, entry] : category) {
                             entry.data = entry.factory_default;
+                            AppSettings::mark_changed(entry);
                             needs_saving = true;
                             if (entry.config.task_graph_depends) {
                                 should_record_task_graph = true;
@@ -335,6 +345,7 @@ void AppUi::settings_ui() {
                 if (category_open) {
                     for (auto &[id, entry] : category) {
                         if (settings_entry_ui(id, entry)) {
+                            AppSettings::mark_changed(entry);
                             needs_saving = true;
                             if (entry.config.task_graph_depends) {
                                 should_record_task_graph = true;
@@ -386,7 +397,7 @@ void AppUi::settings_ui() {
     ImGui::Text("Settings");
     ImGui::SameLine();
 
-    auto autosave = AppSettings::get<settings::Checkbox>("UI", "autosave").value;
+    auto autosave = AppSettings::get(autosave_setting).value;
 
     if (autosave_0 != autosave) {
         autosave_override = true;
@@ -394,7 +405,7 @@ void AppUi::settings_ui() {
     if (!autosave) {
         ImGui::SameLine();
         if (ImGui::Button("Save")) {
-            settings.save(data_directory / "user_settings.json");
+            settings_saver.mark_dirty_now();
         }
         ImGui::SameLine();
         if (ImGui::Button("Load")) {
@@ -408,6 +419,7 @@ void AppUi::settings_ui() {
         for (auto &[cat_id, category] : settings.categories) {
             for (auto &[id, entry] : category) {
                 entry.data = entry.user_default;
+                AppSettings::mark_changed(entry);
                 if (entry.config.task_graph_depends) {
                     should_record_task_graph = true;
                 }
@@ -639,12 +651,12 @@ void AppUi::update(daxa_f32 delta_time, daxa_f32 cpu_delta_time) {
             ImGui::ShowDemoWindow(&show_imgui_demo_window);
         }
 
-        auto show_console = AppSettings::get<settings::Checkbox>("UI", "show_console").value;
+        auto show_console = AppSettings::get(show_console_setting).value;
         if (show_console) {
             auto temp_show_console = show_console;
             debug_utils::Console::draw("Console", &show_console);
             if (temp_show_console != show_console) {
-                AppSettings::set("UI", "show_console", settings::Checkbox{.value = show_console});
+                AppSettings::set(show_console_setting, settings::Checkbox{.value = show_console});
             }
         }
 
@@ -653,7 +665,7 @@ void AppUi::update(daxa_f32 delta_time, daxa_f32 cpu_delta_time) {
         }
     }
 
-    auto show_debug_info = AppSettings::get<settings::Checkbox>("UI", "show_debug_info").value;
+    auto show_debug_info = AppSettings::get(show_debug_info_setting).value;
 
     if (show_debug_info) {
         ImGui::PushFont(mono_font);
@@ -750,15 +762,15 @@ void AppUi::update(daxa_f32 delta_time, daxa_f32 cpu_delta_time) {
     ImGui::PopFont();
     ImGui::Render();
 
-    // Auto-save
-    auto now = Clock::now();
-    using namespace std::chrono_literals;
-    auto autosave = AppSettings::get<settings::Checkbox>("UI", "autosave").value;
-    if ((autosave || autosave_override) && needs_saving && now - last_save_time > 0.1s) {
-        settings.save(data_directory / "user_settings.json");
+    // Auto-save. Edits only restart the saver's debounce timer, so that dragging a slider doesn't
+    // write the file every frame, and the write itself happens off the main thread.
+    auto autosave = AppSettings::get(autosave_setting).value;
+    if ((autosave || autosave_override) && needs_saving) {
+        settings_saver.mark_dirty();
         needs_saving = false;
         autosave_override = false;
     }
+    settings_saver.update(settings);
 }
 
 void AppUi::toggle_pause() {
@@ -770,13 +782,13 @@ void AppUi::toggle_pause() {
 }
 
 void AppUi::toggle_debug() {
-    auto show_debug_info = AppSettings::get<settings::Checkbox>("UI", "show_debug_info").value;
-    AppSettings::set("UI", "show_debug_info", settings::Checkbox{.value = !show_debug_info});
+    auto show_debug_info = AppSettings::get(show_debug_info_setting).value;
+    AppSettings::set(show_debug_info_setting, settings::Checkbox{.value = !show_debug_info});
     needs_saving = true;
 }
 
 void AppUi::toggle_console() {
-    auto show_console = AppSettings::get<settings::Checkbox>("UI", "show_console").value;
-    AppSettings::set("UI", "show_console", settings::Checkbox{.value = !show_console});
+    auto show_console = AppSettings::get(show_console_setting).value;
+    AppSettings::set(show_console_setting, settings::Checkbox{.value = !show_console});
     needs_saving = true;
 }
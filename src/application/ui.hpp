@@ -20,6 +20,10 @@ struct AppUi {
     ~AppUi();
 
     AppSettings settings;
+    SettingHandle<settings::InputFloat> ui_scale_setting;
+    SettingHandle<settings::Checkbox> show_debug_info_setting;
+    SettingHandle<settings::Checkbox> show_console_setting;
+    SettingHandle<settings::Checkbox> autosave_setting;
 
     GLFWwindow *glfw_window_ptr;
     ImFont *mono_font = nullptr;
@@ -32,7 +36,7 @@ struct AppUi {
     daxa_f32 debug_menu_size{};
 
     bool needs_saving = false;
-    Clock::time_point last_save_time{};
+    SettingsSaver settings_saver;
 
     daxa_u32 conflict_resolution_mode = 0;
     daxa_i32 new_key_id{};
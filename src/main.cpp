@@ -1,7 +1,15 @@
 #include "voxel_app.hpp"
+#include <cstdlib>
 #include <filesystem>
+#include <optional>
+#include <string_view>
+
+#include <fmt/format.h>
 
 #include <utilities/debug.hpp>
+#include <utilities/log.hpp>
+#include <utilities/profiler.hpp>
+#include <utilities/thread_pool.hpp>
 
 void search_for_path_to_fix_working_directory(std::span<std::filesystem::path const> test_paths) {
     auto current_path = std::filesystem::current_path();
@@ -19,21 +27,97 @@ void search_for_path_to_fix_working_directory(std::span<std::filesystem::path co
     }
 }
 
-auto main() -> int {
+struct CommandLineOptions {
+    std::filesystem::path record_path;
+    std::filesystem::path replay_path;
+    std::filesystem::path benchmark_out_path;
+    float fixed_delta_time = 0.0f;
+};
+
+auto parse_command_line(std::span<char const *const> args, CommandLineOptions &options) -> bool {
+    for (size_t arg_i = 1; arg_i < args.size(); ++arg_i) {
+        auto const arg = std::string_view{args[arg_i]};
+        if (arg_i + 1 >= args.size()) {
+            debug_utils::Console::add_log(fmt::format("[error] Missing value for '{}'", arg));
+            return false;
+        }
+        auto const value = args[++arg_i];
+        if (arg == "--record") {
+            options.record_path = value;
+        } else if (arg == "--replay") {
+            options.replay_path = value;
+        } else if (arg == "--benchmark-out") {
+            options.benchmark_out_path = value;
+        } else if (arg == "--fixed-dt") {
+            options.fixed_delta_time = std::strtof(value, nullptr);
+        } else {
+            debug_utils::Console::add_log(fmt::format("[error] Unknown option '{}'", arg));
+            return false;
+        }
+    }
+    return true;
+}
+
+auto main(int argc, char const *argv[]) -> int {
+    auto global_console = debug_utils::Console{};
+
+    auto options = CommandLineOptions{};
+    if (!parse_command_line(std::span{argv, static_cast<size_t>(argc)}, options)) {
+        debug_utils::Console::add_log("Usage: gvox_engine [--record <file>] [--replay <file> [--benchmark-out <file.csv|file.json>]] [--fixed-dt <seconds>]");
+        return 1;
+    }
+    // Paths on the command line are relative to where the app was launched from.
+    for (auto *path : {&options.record_path, &options.replay_path, &options.benchmark_out_path}) {
+        if (!path->empty()) {
+            *path = std::filesystem::absolute(*path);
+        }
+    }
+
     search_for_path_to_fix_working_directory(std::array{
         std::filesystem::path{".out"},
         std::filesystem::path{"assets"},
     });
 
-    auto global_console = debug_utils::Console{};
+    auto logger = Logger{{
+        debug_utils::Console::log_sink(),
+        make_stdout_log_sink(),
+        make_rotating_file_log_sink(".out/logs", "gvox_engine", uintmax_t{4} << 20, 3),
+    }};
+
+    auto profiler = CpuProfiler{};
+    profiler.set_thread_name("main");
+
     auto global_debug_display = debug_utils::DebugDisplay{};
 
     auto settings = AppSettings{};
 
+    auto thread_pool = ThreadPool{};
+    thread_pool.start();
+
+    if (!options.replay_path.empty()) {
+        // Headless, so no window, device or UI.
+        auto const replayed = run_replay_benchmark({
+            .replay_path = options.replay_path,
+            .output_path = options.benchmark_out_path,
+            .fixed_delta_time = options.fixed_delta_time,
+        });
+        return replayed ? 0 : 1;
+    }
+
     FreeImage_Initialise();
 
-    auto app = VoxelApp{};
-    app.run();
+    {
+        auto recorder = std::optional<ReplayRecorder>{};
+        if (!options.record_path.empty()) {
+            recorder.emplace(options.record_path, options.fixed_delta_time);
+        }
+        auto app = VoxelApp{};
+        app.fixed_delta_time = options.fixed_delta_time;
+        if (recorder && recorder->is_open()) {
+            app.replay_recorder = &*recorder;
+        }
+        app.run();
+    }
 
     FreeImage_DeInitialise();
 }
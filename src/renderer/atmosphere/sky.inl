@@ -54,28 +54,59 @@ struct ConvolveCubeComputePush {
 #include <numbers>
 #include <cmath>
 
-inline void add_sky_settings() {
-    auto add_DensityProfileLayer = [](std::string_view name, DensityProfileLayer const &factory_default) {
-        AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_const_term", {.value = factory_default.const_term, .min = 0.0f, .max = 5.0f}});
-        AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_exp_term", {.value = factory_default.exp_term, .min = -1.0f, .max = 1.0f}});
-        AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_layer_width", {.value = factory_default.layer_width, .min = 0.1f, .max = 50.0f}});
-        AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_lin_term", {.value = factory_default.lin_term, .min = -0.5f, .max = 0.5f}});
+struct SkySettingHandles {
+    struct DensityProfileLayerHandles {
+        SettingHandle<settings::SliderFloat> const_term;
+        SettingHandle<settings::SliderFloat> exp_term;
+        SettingHandle<settings::SliderFloat> layer_width;
+        SettingHandle<settings::SliderFloat> lin_term;
     };
 
+    SettingHandle<settings::SliderFloat> sun_angle_x;
+    SettingHandle<settings::SliderFloat> sun_angle_y;
+    SettingHandle<settings::SliderFloat> sun_angular_radius;
+    SettingHandle<settings::Checkbox> sun_animate;
+    SettingHandle<settings::SliderFloat> sun_animate_speed;
+    SettingHandle<settings::InputFloat> atmosphere_bottom;
+    SettingHandle<settings::InputFloat> atmosphere_top;
+    SettingHandle<settings::InputFloat3> mie_scattering;
+    SettingHandle<settings::InputFloat3> mie_extinction;
+    SettingHandle<settings::SliderFloat> mie_scale_height;
+    SettingHandle<settings::SliderFloat> mie_phase_function_g;
+    std::array<DensityProfileLayerHandles, 2> mie_density;
+    SettingHandle<settings::InputFloat3> rayleigh_scattering;
+    SettingHandle<settings::SliderFloat> rayleigh_scale_height;
+    std::array<DensityProfileLayerHandles, 2> rayleigh_density;
+    SettingHandle<settings::InputFloat3> absorption_extinction;
+    std::array<DensityProfileLayerHandles, 2> absorption_density;
+};
+
+inline auto add_sky_settings() -> SkySettingHandles {
+    auto add_DensityProfileLayer = [](std::string_view name, DensityProfileLayer const &factory_default) -> SkySettingHandles::DensityProfileLayerHandles {
+        return {
+            .const_term = AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_const_term", {.value = factory_default.const_term, .min = 0.0f, .max = 5.0f}}),
+            .exp_term = AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_exp_term", {.value = factory_default.exp_term, .min = -1.0f, .max = 1.0f}}),
+            .layer_width = AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_layer_width", {.value = factory_default.layer_width, .min = 0.1f, .max = 50.0f}}),
+            .lin_term = AppSettings::add<settings::SliderFloat>({"Atmosphere Advanced", std::string{name} + "_lin_term", {.value = factory_default.lin_term, .min = -0.5f, .max = 0.5f}}),
+        };
+    };
+
+    auto result = SkySettingHandles{};
+
     auto mie_scale_height = 1.2000000476837158f;
     auto rayleigh_scale_height = 8.696f;
-    AppSettings::add<settings::SliderFloat>({"Sun", "Angle X", {.value = 210.0f, .min = 0.0f, .max = 360.0f}});
-    AppSettings::add<settings::SliderFloat>({"Sun", "Angle Y", {.value = 25.0f, .min = 0.0f, .max = 180.0f}});
-    AppSettings::add<settings::SliderFloat>({"Sun", "Angular Radius", {.value = 0.25f, .min = 0.25f, .max = 30.0f}});
-    AppSettings::add<settings::Checkbox>({"Sun", "Animate", {.value = false}});
-    AppSettings::add<settings::SliderFloat>({"Sun", "Animate Speed", {.value = 0.1f, .min = 0.001f, .max = 1.0f}});
-    AppSettings::add<settings::InputFloat>({"Atmosphere", "atmosphere_bottom", {.value = 6360.0f}});
-    AppSettings::add<settings::InputFloat>({"Atmosphere", "atmosphere_top", {.value = 6460.0f}});
-    AppSettings::add<settings::InputFloat3>({"Atmosphere", "mie_scattering", {.value = {0.003996000159531832f, 0.003996000159531832f, 0.003996000159531832f}}});
-    AppSettings::add<settings::InputFloat3>({"Atmosphere", "mie_extinction", {.value = {0.00443999981507659f, 0.00443999981507659f, 0.00443999981507659f}}});
-    AppSettings::add<settings::SliderFloat>({"Atmosphere", "mie_scale_height", {.value = mie_scale_height, .min = 0.0f, .max = 10.0f}});
-    AppSettings::add<settings::SliderFloat>({"Atmosphere", "mie_phase_function_g", {.value = 0.800000011920929f, .min = 0.0f, .max = 1.0f}});
-    add_DensityProfileLayer(
+    result.sun_angle_x = AppSettings::add<settings::SliderFloat>({"Sun", "Angle X", {.value = 210.0f, .min = 0.0f, .max = 360.0f}});
+    result.sun_angle_y = AppSettings::add<settings::SliderFloat>({"Sun", "Angle Y", {.value = 25.0f, .min = 0.0f, .max = 180.0f}});
+    result.sun_angular_radius = AppSettings::add<settings::SliderFloat>({"Sun", "Angular Radius", {.value = 0.25f, .min = 0.25f, .max = 30.0f}});
+    result.sun_animate = AppSettings::add<settings::Checkbox>({"Sun", "Animate", {.value = false}});
+    result.sun_animate_speed = AppSettings::add<settings::SliderFloat>({"Sun", "Animate Speed", {.value = 0.1f, .min = 0.001f, .max = 1.0f}});
+    result.atmosphere_bottom = AppSettings::add<settings::InputFloat>({"Atmosphere", "atmosphere_bottom", {.value = 6360.0f}});
+    result.atmosphere_top = AppSettings::add<settings::InputFloat>({"Atmosphere", "atmosphere_top", {.value = 6460.0f}});
+    result.mie_scattering = AppSettings::add<settings::InputFloat3>({"Atmosphere", "mie_scattering", {.value = {0.003996000159531832f, 0.003996000159531832f, 0.003996000159531832f}}});
+    result.mie_extinction = AppSettings::add<settings::InputFloat3>({"Atmosphere", "mie_extinction", {.value = {0.00443999981507659f, 0.00443999981507659f, 0.00443999981507659f}}});
+    result.mie_scale_height = AppSettings::add<settings::SliderFloat>({"Atmosphere", "mie_scale_height", {.value = mie_scale_height, .min = 0.0f, .max = 10.0f}});
+    result.mie_phase_function_g = AppSettings::add<settings::SliderFloat>({"Atmosphere", "mie_phase_function_g", {.value = 0.800000011920929f, .min = 0.0f, .max = 1.0f}});
+    result.mie_density[0] = add_DensityProfileLayer(
         "mie_density_0",
         DensityProfileLayer{
             .const_term = 0.0f,
@@ -84,7 +115,7 @@ inline void add_sky_settings() {
             .layer_width = 0.0f,
             .lin_term = 0.0f,
         });
-    add_DensityProfileLayer(
+    result.mie_density[1] = add_DensityProfileLayer(
         "mie_density_1",
         DensityProfileLayer{
             .const_term = 0.0f,
@@ -93,9 +124,9 @@ inline void add_sky_settings() {
             .layer_width = 0.0f,
             .lin_term = 0.0f,
         });
-    AppSettings::add<settings::InputFloat3>({"Atmosphere", "rayleigh_scattering", {.value = {0.006604931f, 0.013344918f, 0.029412623f}}});
-    AppSettings::add<settings::SliderFloat>({"Atmosphere", "rayleigh_scale_height", {.value = rayleigh_scale_height, .min = 0.0f, .max = 10.0f}});
-    add_DensityProfileLayer(
+    result.rayleigh_scattering = AppSettings::add<settings::InputFloat3>({"Atmosphere", "rayleigh_scattering", {.value = {0.006604931f, 0.013344918f, 0.029412623f}}});
+    result.rayleigh_scale_height = AppSettings::add<settings::SliderFloat>({"Atmosphere", "rayleigh_scale_height", {.value = rayleigh_scale_height, .min = 0.0f, .max = 10.0f}});
+    result.rayleigh_density[0] = add_DensityProfileLayer(
         "rayleigh_density_0",
         DensityProfileLayer{
             .const_term = 0.0f,
@@ -104,7 +135,7 @@ inline void add_sky_settings() {
             .layer_width = 0.0f,
             .lin_term = 0.0f,
         });
-    add_DensityProfileLayer(
+    result.rayleigh_density[1] = add_DensityProfileLayer(
         "rayleigh_density_1",
         DensityProfileLayer{
             .const_term = 0.0f,
@@ -113,8 +144,8 @@ inline void add_sky_settings() {
             .layer_width = 0.0f,
             .lin_term = 0.0f,
         });
-    AppSettings::add<settings::InputFloat3>({"Atmosphere", "absorption_extinction", {.value = {0.00229072f, 0.00214036f, 0.0f}}});
-    add_DensityProfileLayer(
+    result.absorption_extinction = AppSettings::add<settings::InputFloat3>({"Atmosphere", "absorption_extinction", {.value = {0.00229072f, 0.00214036f, 0.0f}}});
+    result.absorption_density[0] = add_DensityProfileLayer(
         "absorption_density_0",
         DensityProfileLayer{
             .const_term = -0.6666600108146667f,
@@ -123,7 +154,7 @@ inline void add_sky_settings() {
             .layer_width = 25.0f,
             .lin_term = 0.06666599959135056f,
         });
-    add_DensityProfileLayer(
+    result.absorption_density[1] = add_DensityProfileLayer(
         "absorption_density_1",
         DensityProfileLayer{
             .const_term = 2.6666600704193115f,
@@ -132,46 +163,47 @@ inline void add_sky_settings() {
             .layer_width = 0.0f,
             .lin_term = -0.06666599959135056f,
         });
+    return result;
 }
-inline auto get_sky_settings(float time) -> SkySettings {
-    add_sky_settings();
+
+inline auto get_sky_settings(SkySettingHandles const &handles, float time) -> SkySettings {
     auto radians = [](float x) -> float {
         return x * std::numbers::pi_v<float> / 180.0f;
     };
-    auto get_DensityProfileLayer = [](std::string_view name) -> DensityProfileLayer {
+    auto get_DensityProfileLayer = [](SkySettingHandles::DensityProfileLayerHandles const &layer) -> DensityProfileLayer {
         return DensityProfileLayer{
-            .const_term = AppSettings::get<settings::SliderFloat>("Atmosphere Advanced", std::string{name} + "_const_term").value,
-            .exp_term = AppSettings::get<settings::SliderFloat>("Atmosphere Advanced", std::string{name} + "_exp_term").value,
-            .layer_width = AppSettings::get<settings::SliderFloat>("Atmosphere Advanced", std::string{name} + "_layer_width").value,
-            .lin_term = AppSettings::get<settings::SliderFloat>("Atmosphere Advanced", std::string{name} + "_lin_term").value,
+            .const_term = AppSettings::get(layer.const_term).value,
+            .exp_term = AppSettings::get(layer.exp_term).value,
+            .layer_width = AppSettings::get(layer.layer_width).value,
+            .lin_term = AppSettings::get(layer.lin_term).value,
         };
     };
 
     auto result = SkySettings{};
-    auto sun_angle_x = AppSettings::get<settings::SliderFloat>("Sun", "Angle X").value;
-    auto sun_angle_y = AppSettings::get<settings::SliderFloat>("Sun", "Angle Y").value;
-    result.sun_angular_radius_cos = std::cos(radians(AppSettings::get<settings::SliderFloat>("Sun", "Angular Radius").value));
-    result.atmosphere_bottom = AppSettings::get<settings::InputFloat>("Atmosphere", "atmosphere_bottom").value;
-    result.atmosphere_top = AppSettings::get<settings::InputFloat>("Atmosphere", "atmosphere_top").value;
-    result.mie_scattering = AppSettings::get<settings::InputFloat3>("Atmosphere", "mie_scattering").value;
-    result.mie_extinction = AppSettings::get<settings::InputFloat3>("Atmosphere", "mie_extinction").value;
-    result.mie_scale_height = AppSettings::get<settings::SliderFloat>("Atmosphere", "mie_scale_height").value;
-    result.mie_phase_function_g = AppSettings::get<settings::SliderFloat>("Atmosphere", "mie_phase_function_g").value;
-    result.mie_density[0] = get_DensityProfileLayer("mie_density_0");
-    result.mie_density[1] = get_DensityProfileLayer("mie_density_1");
+    auto sun_angle_x = AppSettings::get(handles.sun_angle_x).value;
+    auto sun_angle_y = AppSettings::get(handles.sun_angle_y).value;
+    result.sun_angular_radius_cos = std::cos(radians(AppSettings::get(handles.sun_angular_radius).value));
+    result.atmosphere_bottom = AppSettings::get(handles.atmosphere_bottom).value;
+    result.atmosphere_top = AppSettings::get(handles.atmosphere_top).value;
+    result.mie_scattering = AppSettings::get(handles.mie_scattering).value;
+    result.mie_extinction = AppSettings::get(handles.mie_extinction).value;
+    result.mie_scale_height = AppSettings::get(handles.mie_scale_height).value;
+    result.mie_phase_function_g = AppSettings::get(handles.mie_phase_function_g).value;
+    result.mie_density[0] = get_DensityProfileLayer(handles.mie_density[0]);
+    result.mie_density[1] = get_DensityProfileLayer(handles.mie_density[1]);
     result.mie_density[1].exp_scale = -1.0f / result.mie_scale_height;
-    result.rayleigh_scattering = AppSettings::get<settings::InputFloat3>("Atmosphere", "rayleigh_scattering").value;
-    result.rayleigh_scale_height = AppSettings::get<settings::SliderFloat>("Atmosphere", "rayleigh_scale_height").value;
-    result.rayleigh_density[0] = get_DensityProfileLayer("rayleigh_density_0");
-    result.rayleigh_density[1] = get_DensityProfileLayer("rayleigh_density_1");
+    result.rayleigh_scattering = AppSettings::get(handles.rayleigh_scattering).value;
+    result.rayleigh_scale_height = AppSettings::get(handles.rayleigh_scale_height).value;
+    result.rayleigh_density[0] = get_DensityProfileLayer(handles.rayleigh_density[0]);
+    result.rayleigh_density[1] = get_DensityProfileLayer(handles.rayleigh_density[1]);
     result.rayleigh_density[1].exp_scale = -1.0f / result.rayleigh_scale_height;
-    result.absorption_extinction = AppSettings::get<settings::InputFloat3>("Atmosphere", "absorption_extinction").value;
-    result.absorption_density[0] = get_DensityProfileLayer("absorption_density_0");
-    result.absorption_density[1] = get_DensityProfileLayer("absorption_density_1");
+    result.absorption_extinction = AppSettings::get(handles.absorption_extinction).value;
+    result.absorption_density[0] = get_DensityProfileLayer(handles.absorption_density[0]);
+    result.absorption_density[1] = get_DensityProfileLayer(handles.absorption_density[1]);
 
     sun_angle_y = radians(sun_angle_y);
-    if (AppSettings::get<settings::Checkbox>("Sun", "Animate").value) {
-        sun_angle_y += time * AppSettings::get<settings::SliderFloat>("Sun", "Animate Speed").value;
+    if (AppSettings::get(handles.sun_animate).value) {
+        sun_angle_y += time * AppSettings::get(handles.sun_animate_speed).value;
     }
 
     result.sun_direction = {
@@ -190,6 +222,18 @@ struct SkyRenderer {
 
     daxa::TaskGraph sky_render_task_graph;
 
+    SkySettingHandles setting_handles;
+    SettingHandle<settings::Checkbox> global_illumination_setting;
+    // Polled once per frame, so that the LUTs are rendered again when the settings change, even
+    // if they aren't updated every frame.
+    SettingsWatcher settings_watcher;
+
+    // Needs the "global_illumination" setting to be added already.
+    void add_settings() {
+        setting_handles = add_sky_settings();
+        global_illumination_setting = AppSettings::find<settings::Checkbox>("Graphics", "global_illumination");
+    }
+
     void generate_procedural_sky(GpuContext &gpu_context) {
         auto multiscattering_lut = sky_render_task_graph.create_transient_image({
             .format = daxa::Format::R16G16B16A16_SFLOAT,
@@ -264,7 +308,15 @@ struct SkyRenderer {
     void convolve_cube(GpuContext &gpu_context) {
         auto ibl_cube_view = ibl_cube.task_resource.view().view({.layer_count = 6});
 
-        gpu_context.add(ComputeTask<ConvolveCubeCompute::Task, ConvolveCubeComputePush, NoTaskInfo>{
+        struct ConvolveCubeComputeTaskInfo {
+            daxa_u32 flags = 0;
+        };
+        auto task_info = ConvolveCubeComputeTaskInfo{};
+        if (AppSettings::get(global_illumination_setting).value) {
+            task_info.flags |= 1;
+        }
+
+        gpu_context.add(ComputeTask<ConvolveCubeCompute::Task, ConvolveCubeComputePush, ConvolveCubeComputeTaskInfo>{
             .source = daxa::ShaderFile{"atmosphere/convolve_cube.comp.glsl"},
             .views = std::array{
                 daxa::TaskViewVariant{std::pair{ConvolveCubeCompute::AT.gpu_input, gpu_context.task_input_buffer}},
@@ -272,20 +324,18 @@ struct SkyRenderer {
                 daxa::TaskViewVariant{std::pair{ConvolveCubeCompute::AT.transmittance_lut, transmittance_lut.task_resource}},
                 daxa::TaskViewVariant{std::pair{ConvolveCubeCompute::AT.ibl_cube, ibl_cube_view}},
             },
-            .callback_ = [](daxa::TaskInterface const &ti, daxa::ComputePipeline &pipeline, ConvolveCubeComputePush &push, NoTaskInfo const &) {
+            .callback_ = [](daxa::TaskInterface const &ti, daxa::ComputePipeline &pipeline, ConvolveCubeComputePush &push, ConvolveCubeComputeTaskInfo const &info) {
                 ti.recorder.set_pipeline(pipeline);
-                auto do_global_illumination = AppSettings::get<settings::Checkbox>("Graphics", "global_illumination").value;
-                push.flags |= do_global_illumination ? 1 : 0;
+                push.flags |= info.flags;
                 set_push_constant(ti, push);
                 ti.recorder.dispatch({(IBL_CUBE_RES + 1) / 2, (IBL_CUBE_RES + 1) / 2, 6});
             },
+            .info = task_info,
             .task_graph_ptr = &sky_render_task_graph,
         });
     }
 
     void render(GpuContext &gpu_context) {
-        add_sky_settings();
-
         sky_render_task_graph = daxa::TaskGraph({
             .device = gpu_context.device,
             .name = "sky_render_task_graph",
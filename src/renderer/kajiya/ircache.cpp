@@ -300,6 +300,8 @@ void IrcacheRenderer::next_frame() {
 
 auto IrcacheRenderer::prepare(GpuContext &gpu_context) -> IrcacheRenderState {
     constexpr auto INDIRECTION_BUF_ELEM_COUNT = size_t{1024 * 1024};
+    // Sized by the entry count rather than the resolution, and kept across recordings.
+    auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, {.owner = "ircache", .category = GpuMemoryCategory::RENDERER_CACHES, .lifetime = GpuMemoryLifetime::PERSISTENT}};
 
     auto [ircache_grid_meta_buf_, ircache_grid_meta_buf2_] = ping_pong_ircache_grid_meta_buf.get(
         gpu_context,
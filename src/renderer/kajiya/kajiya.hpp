@@ -22,6 +22,17 @@ struct KajiyaRenderer {
     bool do_global_illumination = true;
     bool denoise_shadow_mask = false;
 
+    SettingHandle<settings::Checkbox> global_illumination_setting;
+    SettingHandle<settings::Checkbox> denoise_shadow_mask_setting;
+    SettingHandle<settings::ComboBox> taa_method_setting;
+
+    // Needs the "TAA Method" setting to be added already.
+    void add_settings() {
+        global_illumination_setting = AppSettings::add<settings::Checkbox>({"Graphics", "global_illumination", {.value = do_global_illumination}, {.task_graph_depends = true}});
+        denoise_shadow_mask_setting = AppSettings::add<settings::Checkbox>({"Graphics", "denoise_shadow_mask", {.value = denoise_shadow_mask}, {.task_graph_depends = true}});
+        taa_method_setting = AppSettings::find<settings::ComboBox>("Graphics", "TAA Method");
+    }
+
     void next_frame(daxa::Device &device, AutoExposureSettings const &auto_exposure_settings, float dt) {
         if (do_global_illumination) {
             ssao_renderer.next_frame();
@@ -30,7 +41,7 @@ struct KajiyaRenderer {
             ircache_renderer.next_frame();
         }
         post_processor.next_frame(device, auto_exposure_settings, dt);
-        const auto taa_method = AppSettings::get<settings::ComboBox>("Graphics", "TAA Method").value;
+        const auto taa_method = AppSettings::get(taa_method_setting).value;
         if (taa_method == 1) {
             taa_renderer.next_frame();
         }
@@ -49,11 +60,8 @@ struct KajiyaRenderer {
         daxa::TaskImageView transmittance_lut,
         daxa::TaskImageView ae_lut,
         VoxelWorldBuffers &voxel_buffers) -> std::pair<daxa::TaskImageView, daxa::TaskImageView> {
-        AppSettings::add<settings::Checkbox>({"Graphics", "global_illumination", {.value = do_global_illumination}, {.task_graph_depends = true}});
-        AppSettings::add<settings::Checkbox>({"Graphics", "denoise_shadow_mask", {.value = denoise_shadow_mask}, {.task_graph_depends = true}});
-
-        do_global_illumination = AppSettings::get<settings::Checkbox>("Graphics", "global_illumination").value;
-        denoise_shadow_mask = AppSettings::get<settings::Checkbox>("Graphics", "denoise_shadow_mask").value;
+        do_global_illumination = AppSettings::get(global_illumination_setting).value;
+        denoise_shadow_mask = AppSettings::get(denoise_shadow_mask_setting).value;
 
         auto reprojection_map = calculate_reprojection_map(gpu_context, gbuffer_depth, velocity_image);
         auto denoised_shadow_mask = [&]() {
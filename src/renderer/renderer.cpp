@@ -17,20 +17,30 @@ struct RendererImpl {
     SkyRenderer sky;
 
     std::array<daxa_f32vec2, 128> halton_offsets{};
+
+    SettingHandle<settings::SliderFloat> exposure_hist_clip_low_setting;
+    SettingHandle<settings::SliderFloat> exposure_hist_clip_high_setting;
+    SettingHandle<settings::SliderFloat> exposure_reaction_speed_setting;
+    SettingHandle<settings::SliderFloat> exposure_shift_setting;
+    SettingHandle<settings::ComboBox> taa_method_setting;
+    SettingHandle<settings::Checkbox> update_sky_setting;
 };
 
 Renderer::Renderer() : impl{std::make_unique<RendererImpl>()} {
     auto &self = *impl;
 
-    AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Hist Clip Low", {.value = 0.4f, .min = 0.0f, .max = 1.0f}});
-    AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Hist Clip High", {.value = 0.1f, .min = 0.0f, .max = 1.0f}});
-    AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Reaction Speed", {.value = 3.0f, .min = 0.0f, .max = 10.0f}});
-    AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Shift", {.value = 0.0f, .min = -15.0f, .max = 15.0f}});
+    self.exposure_hist_clip_low_setting = AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Hist Clip Low", {.value = 0.4f, .min = 0.0f, .max = 1.0f}});
+    self.exposure_hist_clip_high_setting = AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Hist Clip High", {.value = 0.1f, .min = 0.0f, .max = 1.0f}});
+    self.exposure_reaction_speed_setting = AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Reaction Speed", {.value = 3.0f, .min = 0.0f, .max = 10.0f}});
+    self.exposure_shift_setting = AppSettings::add<settings::SliderFloat>({"Camera", "Exposure Shift", {.value = 0.0f, .min = -15.0f, .max = 15.0f}});
 
-    AppSettings::add<settings::ComboBox>({"Graphics", "TAA Method", {.value = 1}, {.task_graph_depends = true, .options = {"None", "Kajiya TAA", "FSR 2.2"}}});
-    AppSettings::add<settings::Checkbox>({"Graphics", "Update Sky", {.value = true}, {.task_graph_depends = true}});
+    self.taa_method_setting = AppSettings::add<settings::ComboBox>({"Graphics", "TAA Method", {.value = 1}, {.task_graph_depends = true, .options = {"None", "Kajiya TAA", "FSR 2.2"}}});
+    self.update_sky_setting = AppSettings::add<settings::Checkbox>({"Graphics", "Update Sky", {.value = true}, {.task_graph_depends = true}});
     AppSettings::add<settings::Checkbox>({"Graphics", "Use HWRT", {.value = true}, {.task_graph_depends = true}});
 
+    self.kajiya_renderer.add_settings();
+    self.sky.add_settings();
+
     auto radical_inverse = [](daxa_u32 n, daxa_u32 base) -> daxa_f32 {
         auto val = 0.0f;
         auto inv_base = 1.0f / static_cast<daxa_f32>(base);
@@ -53,7 +63,7 @@ Renderer::~Renderer() = default;
 void Renderer::begin_frame(GpuInput &gpu_input) {
     auto &self = *impl;
 
-    gpu_input.sky_settings = get_sky_settings(gpu_input.time);
+    gpu_input.sky_settings = get_sky_settings(self.sky.setting_handles, gpu_input.time);
 
     gpu_input.pre_exposure = self.kajiya_renderer.post_processor.exposure_state.pre_mult;
     gpu_input.pre_exposure_prev = self.kajiya_renderer.post_processor.exposure_state.pre_mult_prev;
@@ -69,7 +79,7 @@ void Renderer::begin_frame(GpuInput &gpu_input) {
 
     self.kajiya_renderer.ircache_renderer.update_eye_position(gpu_input);
 
-    const auto taa_method = AppSettings::get<settings::ComboBox>("Graphics", "TAA Method").value;
+    const auto taa_method = AppSettings::get(self.taa_method_setting).value;
     switch (taa_method) {
     case 0: break;
     case 1:
@@ -84,8 +94,10 @@ void Renderer::begin_frame(GpuInput &gpu_input) {
         break;
     }
 
-    auto update_sky = AppSettings::get<settings::Checkbox>("Graphics", "Update Sky").value;
-    if (update_sky || gpu_input.frame_index == 0) {
+    auto update_sky = AppSettings::get(self.update_sky_setting).value;
+    // Not all of the settings that poll() reacts to affect the sky, but the rest are rarely changed.
+    auto sky_settings_changed = self.sky.settings_watcher.poll();
+    if (update_sky || sky_settings_changed || gpu_input.frame_index == 0) {
         self.sky.sky_render_task_graph.execute({});
     }
 }
@@ -94,10 +106,10 @@ void Renderer::end_frame(daxa::Device &device, float dt) {
     auto &self = *impl;
     self.gbuffer_renderer.next_frame();
     auto auto_exposure_settings = AutoExposureSettings{
-        .histogram_clip_low = AppSettings::get<settings::SliderFloat>("Camera", "Exposure Hist Clip Low").value,
-        .histogram_clip_high = AppSettings::get<settings::SliderFloat>("Camera", "Exposure Hist Clip High").value,
-        .speed = AppSettings::get<settings::SliderFloat>("Camera", "Exposure Reaction Speed").value,
-        .ev_shift = AppSettings::get<settings::SliderFloat>("Camera", "Exposure Shift").value,
+        .histogram_clip_low = AppSettings::get(self.exposure_hist_clip_low_setting).value,
+        .histogram_clip_high = AppSettings::get(self.exposure_hist_clip_high_setting).value,
+        .speed = AppSettings::get(self.exposure_reaction_speed_setting).value,
+        .ev_shift = AppSettings::get(self.exposure_shift_setting).value,
     };
     self.kajiya_renderer.next_frame(device, auto_exposure_settings, dt);
 }
@@ -138,7 +150,7 @@ auto Renderer::render(GpuContext &gpu_context, VoxelWorldBuffers &voxel_buffers,
         voxel_buffers);
 
     auto antialiased_image = [&]() {
-        const auto taa_method = AppSettings::get<settings::ComboBox>("Graphics", "TAA Method").value;
+        const auto taa_method = AppSettings::get(self.taa_method_setting).value;
         switch (taa_method) {
         default: [[fallthrough]];
         case 0: {
@@ -196,3 +208,7 @@ auto Renderer::render(GpuContext &gpu_context, VoxelWorldBuffers &voxel_buffers,
 
     return antialiased_image;
 }
+
+auto Renderer::needs_idle_to_record() const -> bool {
+    return impl->fsr2_renderer != nullptr;
+}
@@ -16,4 +16,7 @@ struct Renderer {
     void begin_frame(GpuInput &gpu_input);
     void end_frame(daxa::Device &device, float dt);
     auto render(GpuContext &gpu_context, VoxelWorldBuffers &voxel_buffers, VoxelParticles &particles, daxa::TaskImageView output_image, daxa::Format output_format) -> daxa::TaskImageView;
+    // Whether recording render() again destroys something the GPU may still be using (the FSR 2
+    // context), so that the device has to be idle first.
+    auto needs_idle_to_record() const -> bool;
 };
@@ -81,6 +81,8 @@
     }
 
 #if defined(__cplusplus)
+#include <utilities/log.hpp>
+
 template <typename T>
 struct AllocatorConstants {
     using AllocatorType = T;
@@ -121,8 +123,33 @@ struct AllocatorBufferState {
     daxa_u32 current_element_count = 0;
     daxa_u32 next_element_count = 0;
     daxa_u32 prev_element_count = 0;
+    // Growing asks the ledger for headroom in the category of `memory_tag` first, but goes past it
+    // when it has to.
+    GpuMemoryLedger *memory_ledger = nullptr;
+    GpuMemoryTag memory_tag{};
+    // So that growing past the budget is only logged once, until a growth fits again.
+    bool is_over_budget = false;
+    // The element buffer and the two stacks, for `element_count` elements.
+    static auto element_buffer_infos(daxa_u32 element_count) -> std::array<daxa::BufferInfo, 3> {
+        return {
+            daxa::BufferInfo{
+                .size = sizeof(typename AllocatorConstants<T>::ElementType) * AllocatorConstants<T>::ELEMENT_MULTIPLIER * element_count,
+                .name = AllocatorConstants<T>::element_buffer_name,
+            },
+            daxa::BufferInfo{
+                .size = sizeof(typename AllocatorConstants<T>::IndexType) * element_count,
+                .name = AllocatorConstants<T>::available_element_stack_buffer_name,
+            },
+            daxa::BufferInfo{
+                .size = sizeof(typename AllocatorConstants<T>::IndexType) * element_count,
+                .name = AllocatorConstants<T>::released_element_stack_buffer_name,
+            },
+        };
+    }
     void create(GpuContext &gpu_context) {
         device = gpu_context.device;
+        memory_ledger = &gpu_context.memory_ledger;
+        memory_tag = gpu_context.memory_tag;
         constexpr auto MAX_ELEMENT_ALLOCATIONS_PER_FRAME = AllocatorConstants<T>::MAX_ELEMENT_ALLOCATIONS_PER_FRAME;
         daxa_u32 element_count = (FRAMES_IN_FLIGHT + 1) * MAX_ELEMENT_ALLOCATIONS_PER_FRAME;
         current_element_count = element_count;
@@ -130,18 +157,13 @@ struct AllocatorBufferState {
             .size = sizeof(typename AllocatorConstants<T>::AllocatorType),
             .name = AllocatorConstants<T>::allocator_buffer_name,
         });
-        element_buffer = device.create_buffer({
-            .size = sizeof(typename AllocatorConstants<T>::ElementType) * AllocatorConstants<T>::ELEMENT_MULTIPLIER * current_element_count,
-            .name = AllocatorConstants<T>::element_buffer_name,
-        });
-        available_element_stack_buffer = device.create_buffer({
-            .size = sizeof(typename AllocatorConstants<T>::IndexType) * current_element_count,
-            .name = AllocatorConstants<T>::available_element_stack_buffer_name,
-        });
-        released_element_stack_buffer = device.create_buffer({
-            .size = sizeof(typename AllocatorConstants<T>::IndexType) * current_element_count,
-            .name = AllocatorConstants<T>::released_element_stack_buffer_name,
-        });
+        auto const buffer_infos = element_buffer_infos(current_element_count);
+        element_buffer = device.create_buffer(buffer_infos[0]);
+        available_element_stack_buffer = device.create_buffer(buffer_infos[1]);
+        released_element_stack_buffer = device.create_buffer(buffer_infos[2]);
+        for (auto buffer : {allocator_buffer, element_buffer, available_element_stack_buffer, released_element_stack_buffer}) {
+            track_gpu_buffer(*memory_ledger, device, buffer, memory_tag);
+        }
         task_allocator_buffer.set_buffers({.buffers = std::array{allocator_buffer}});
         task_element_buffer.set_buffers({
             .buffers = std::array{
@@ -159,6 +181,11 @@ struct AllocatorBufferState {
         });
     }
     ~AllocatorBufferState() {
+        if (memory_ledger != nullptr) {
+            for (auto buffer : {allocator_buffer, element_buffer, available_element_stack_buffer, released_element_stack_buffer}) {
+                untrack_gpu_buffer(*memory_ledger, buffer);
+            }
+        }
         if (!element_buffer.is_empty()) {
             device.destroy_buffer(element_buffer);
         }
@@ -234,6 +261,9 @@ struct AllocatorBufferState {
             .dst_offset = 0,
             .size = sizeof(typename AllocatorConstants<T>::IndexType) * prev_element_count,
         });
+        for (auto old_buffer : task_old_element_buffer.get_state().buffers) {
+            untrack_gpu_buffer(*memory_ledger, old_buffer);
+        }
         recorder.destroy_buffer_deferred(task_old_element_buffer.get_state().buffers[0]);
         recorder.destroy_buffer_deferred(task_old_element_buffer.get_state().buffers[1]);
         recorder.destroy_buffer_deferred(task_old_element_buffer.get_state().buffers[2]);
@@ -271,23 +301,34 @@ struct AllocatorBufferState {
         if (max_size_after_cpu_catch_up > current_size) {
             next_element_count = current_element_count + static_cast<daxa_u32>(MAX_ELEMENT_ALLOCATIONS_PER_FRAME * (FRAMES_IN_FLIGHT + 1));
             assert(next_element_count > current_element_count);
-            prev_element_count = current_element_count;
 
-            // Calculate new buffer size
-            current_element_count = std::max(next_element_count * 3 / 2, max_count_after_cpu_catch_up);
+            // Calculate new buffer size. The old buffers live until their contents are copied, so
+            // the new ones have to fit into the budget next to them. The GPU can't be refused an
+            // element, so within a tight budget, it still grows by what the GPU may allocate until
+            // the CPU catches up, and only warns about going over.
+            auto const bytes_per_element = static_cast<uint64_t>(ELEM_SIZE_BYTES) + 2 * sizeof(typename AllocatorConstants<T>::IndexType);
+            auto const new_element_count = static_cast<daxa_u32>(gpu_heap_growth_count(memory_ledger->headroom(memory_tag.category), bytes_per_element,
+                                                                                       max_count_after_cpu_catch_up, std::max(next_element_count * 3 / 2, max_count_after_cpu_catch_up)));
+            auto const buffer_infos = element_buffer_infos(new_element_count);
+            auto growth_bytes = uint64_t{0};
+            for (auto const &buffer_info : buffer_infos) {
+                growth_bytes += gpu_buffer_allocation_size(device, buffer_info);
+            }
+            auto const was_over_budget = is_over_budget;
+            is_over_budget = !memory_ledger->can_grow(memory_tag.category, growth_bytes);
+            if (is_over_budget && !was_over_budget) {
+                log_warning("{} of {} grows to {} elements ({:.2f} MB), past the GPU memory budget of {}", AllocatorConstants<T>::element_buffer_name, memory_tag.owner,
+                            new_element_count, static_cast<double>(growth_bytes) / 1'000'000.0, gpu_memory_category_name(memory_tag.category));
+            }
+            prev_element_count = current_element_count;
+            current_element_count = new_element_count;
 
-            auto new_element_buffer = device.create_buffer({
-                .size = ELEM_SIZE_BYTES * current_element_count,
-                .name = AllocatorConstants<T>::element_buffer_name,
-            });
-            auto new_available_element_stack_buffer = device.create_buffer({
-                .size = sizeof(typename AllocatorConstants<T>::IndexType) * current_element_count,
-                .name = AllocatorConstants<T>::available_element_stack_buffer_name,
-            });
-            auto new_released_element_stack_buffer = device.create_buffer({
-                .size = sizeof(typename AllocatorConstants<T>::IndexType) * current_element_count,
-                .name = AllocatorConstants<T>::released_element_stack_buffer_name,
-            });
+            auto new_element_buffer = device.create_buffer(buffer_infos[0]);
+            auto new_available_element_stack_buffer = device.create_buffer(buffer_infos[1]);
+            auto new_released_element_stack_buffer = device.create_buffer(buffer_infos[2]);
+            for (auto buffer : {new_element_buffer, new_available_element_stack_buffer, new_released_element_stack_buffer}) {
+                track_gpu_buffer(*memory_ledger, device, buffer, memory_tag);
+            }
             task_old_element_buffer.swap_buffers(task_element_buffer);
             element_buffer = new_element_buffer;
             available_element_stack_buffer = new_available_element_stack_buffer;
@@ -333,11 +374,6 @@ struct StaticAllocatorBufferState {
             .name = StaticAllocatorConstants<T>::released_element_stack_buffer_name,
         });
 
-        gpu_context.frame_task_graph.use_persistent_buffer(allocator_buffer.task_resource);
-        gpu_context.frame_task_graph.use_persistent_buffer(element_buffer.task_resource);
-        gpu_context.frame_task_graph.use_persistent_buffer(available_element_stack_buffer.task_resource);
-        gpu_context.frame_task_graph.use_persistent_buffer(released_element_stack_buffer.task_resource);
-
         gpu_context.startup_task_graph.use_persistent_buffer(allocator_buffer.task_resource);
         gpu_context.startup_task_graph.use_persistent_buffer(element_buffer.task_resource);
 
@@ -375,5 +411,11 @@ struct StaticAllocatorBufferState {
             .name = "Allocator State Init",
         });
     }
+    void for_each_task_buffer(auto const &functor) {
+        functor(allocator_buffer.task_resource);
+        functor(element_buffer.task_resource);
+        functor(available_element_stack_buffer.task_resource);
+        functor(released_element_stack_buffer.task_resource);
+    }
 };
 #endif
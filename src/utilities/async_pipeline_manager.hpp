@@ -2,27 +2,41 @@
 
 #include <memory>
 #include <array>
+#include <algorithm>
+#include <fstream>
 
 #include "debug.hpp"
 #include "thread_pool.hpp"
+#include "shader_cache.hpp"
 
 #include <daxa/daxa.hpp>
 #include <daxa/utils/pipeline_manager.hpp>
+#include <fmt/format.h>
+
+// Part of the shader cache key, so that updating the compiler invalidates everything.
+#define SHADER_COMPILER_STRINGIFY_IMPL(x) #x
+#define SHADER_COMPILER_STRINGIFY(x) SHADER_COMPILER_STRINGIFY_IMPL(x)
+#if __has_include(<glslang/build_info.h>)
+#include <glslang/build_info.h>
+#define SHADER_COMPILER_VERSION_STRING "glslang " SHADER_COMPILER_STRINGIFY(GLSLANG_VERSION_MAJOR) "." SHADER_COMPILER_STRINGIFY(GLSLANG_VERSION_MINOR) "." SHADER_COMPILER_STRINGIFY(GLSLANG_VERSION_PATCH) GLSLANG_VERSION_FLAVOR
+#else
+#define SHADER_COMPILER_VERSION_STRING "glslang unknown"
+#endif
 
 template<typename PipelineType>
 struct AsyncManagedPipeline {
     using PipelineT = PipelineType;
     std::shared_ptr<PipelineT> pipeline;
 #if ENABLE_THREAD_POOL
-    std::shared_ptr<std::promise<std::shared_ptr<PipelineT>>> pipeline_promise;
-    std::future<std::shared_ptr<PipelineT>> pipeline_future;
+    JobFuture<std::shared_ptr<PipelineT>> pipeline_future;
+    ThreadPool *thread_pool = nullptr;
 #endif
 
     auto is_valid() -> bool {
 #if ENABLE_THREAD_POOL
         if (pipeline_future.valid()) {
-            pipeline_future.wait();
-            pipeline = pipeline_future.get();
+            pipeline = pipeline_future.get(*thread_pool);
+            pipeline_future = {};
         }
 #endif
         return pipeline && pipeline->is_valid();
@@ -40,9 +54,32 @@ struct AsyncPipelineManager {
     std::array<daxa::PipelineManager, 8> pipeline_managers;
     std::array<std::mutex, 8> mutexes{};
     std::atomic_uint64_t current_index = 0;
-    ThreadPool thread_pool{};
+    // Shared with the rest of the app. Only owned here if nobody created a global pool.
+    std::unique_ptr<ThreadPool> owned_thread_pool;
+    ThreadPool *thread_pool = nullptr;
+    std::mutex compile_jobs_mtx;
+    std::vector<JobHandle> compile_jobs;
 
-    AsyncPipelineManager(daxa::PipelineManagerInfo info) {
+    // Compute pipelines whose SPIR-V came out of the shader cache. The pipeline managers have never
+    // seen them, so they're watched here and handed over to a pipeline manager once their sources
+    // change while hot-reloading.
+    struct CachedComputePipeline {
+        daxa::ComputePipelineCompileInfo info;
+        ShaderCacheKey key;
+        std::filesystem::file_time_type newest_write_time;
+        bool is_stale = false;
+        std::shared_ptr<daxa::ComputePipeline> pipeline;
+        std::shared_ptr<daxa::ComputePipeline> managed_pipeline;
+    };
+    daxa::Device device;
+    std::unique_ptr<ShaderCache> shader_cache;
+    // What every pipeline is compiled with, on top of its own options. Part of every cache key.
+    ShaderCacheCompileOptions manager_compile_options;
+    std::mutex cached_pipelines_mtx;
+    std::vector<CachedComputePipeline> cached_pipelines;
+
+    // An empty `shader_cache_folder` disables the shader cache.
+    AsyncPipelineManager(daxa::PipelineManagerInfo info, std::filesystem::path const &shader_cache_folder = {}) {
         pipeline_managers = {
             daxa::PipelineManager(info),
             daxa::PipelineManager(info),
@@ -63,11 +100,30 @@ struct AsyncPipelineManager {
             // daxa::PipelineManager(info),
         };
 
-        thread_pool.start();
+        device = info.device;
+        if (!shader_cache_folder.empty()) {
+            auto root_paths = std::vector<std::filesystem::path>{};
+            for (auto const &root_path : info.shader_compile_options.root_paths) {
+                root_paths.push_back(root_path);
+            }
+            manager_compile_options = to_shader_cache_compile_options(info.shader_compile_options);
+            shader_cache = std::make_unique<ShaderCache>(ShaderCacheInfo{
+                .folder = shader_cache_folder,
+                .compiler_version = SHADER_COMPILER_VERSION_STRING,
+                .root_paths = std::move(root_paths),
+            });
+        }
+
+        thread_pool = ThreadPool::s_instance;
+        if (thread_pool == nullptr) {
+            owned_thread_pool = std::make_unique<ThreadPool>();
+            thread_pool = owned_thread_pool.get();
+        }
+        thread_pool->start();
     }
 
     ~AsyncPipelineManager() {
-        thread_pool.stop();
+        wait();
     }
 
     AsyncPipelineManager(AsyncPipelineManager const &) = delete;
@@ -77,63 +133,38 @@ struct AsyncPipelineManager {
 
     auto add_compute_pipeline(daxa::ComputePipelineCompileInfo const &info) -> AsyncManagedComputePipeline {
 #if ENABLE_THREAD_POOL
-        auto pipeline_promise = std::make_shared<std::promise<std::shared_ptr<daxa::ComputePipeline>>>();
         auto result = AsyncManagedComputePipeline{};
-        result.pipeline_promise = pipeline_promise;
-        result.pipeline_future = pipeline_promise->get_future();
-        auto info_copy = info;
-
-        thread_pool.enqueue([this, pipeline_promise, info_copy]() {
-            auto [pipeline_manager, lock] = get_pipeline_manager();
-            auto compile_result = pipeline_manager.add_compute_pipeline(info_copy);
-            if (compile_result.is_err()) {
-                debug_utils::Console::add_log(compile_result.message());
-                return;
-            }
-            if (!compile_result.value()->is_valid()) {
-                debug_utils::Console::add_log(compile_result.message());
-                return;
-            }
-            pipeline_promise->set_value(compile_result.value());
+        result.thread_pool = thread_pool;
+        result.pipeline_future = thread_pool->enqueue_with_result([this, info_copy = info]() -> std::shared_ptr<daxa::ComputePipeline> {
+            return compile_compute_pipeline(info_copy);
         });
+        track_compile_job(result.pipeline_future.handle);
 
         return result;
 #else
-        auto [pipeline_manager, lock] = get_pipeline_manager();
-        auto compile_result = pipeline_manager.add_compute_pipeline(info);
-        if (compile_result.is_err()) {
-            debug_utils::Console::add_log(compile_result.message());
-            return {};
-        }
         auto result = AsyncManagedComputePipeline{};
-        result.pipeline = compile_result.value();
-        if (!compile_result.value()->is_valid()) {
-            debug_utils::Console::add_log(compile_result.message());
-        }
+        result.pipeline = compile_compute_pipeline(info);
         return result;
 #endif
     }
     auto add_ray_tracing_pipeline(daxa::RayTracingPipelineCompileInfo const &info) -> AsyncManagedRayTracingPipeline {
 #if ENABLE_THREAD_POOL
-        auto pipeline_promise = std::make_shared<std::promise<std::shared_ptr<daxa::RayTracingPipeline>>>();
         auto result = AsyncManagedRayTracingPipeline{};
-        result.pipeline_promise = pipeline_promise;
-        result.pipeline_future = pipeline_promise->get_future();
-        auto info_copy = info;
-
-        thread_pool.enqueue([this, pipeline_promise, info_copy]() {
+        result.thread_pool = thread_pool;
+        result.pipeline_future = thread_pool->enqueue_with_result([this, info_copy = info]() -> std::shared_ptr<daxa::RayTracingPipeline> {
             auto [pipeline_manager, lock] = get_pipeline_manager();
             auto compile_result = pipeline_manager.add_ray_tracing_pipeline(info_copy);
             if (compile_result.is_err()) {
                 debug_utils::Console::add_log(compile_result.message());
-                return;
+                return nullptr;
             }
             if (!compile_result.value()->is_valid()) {
                 debug_utils::Console::add_log(compile_result.message());
-                return;
+                return nullptr;
             }
-            pipeline_promise->set_value(compile_result.value());
+            return compile_result.value();
         });
+        track_compile_job(result.pipeline_future.handle);
 
         return result;
 #else
@@ -153,25 +184,22 @@ struct AsyncPipelineManager {
     }
     auto add_raster_pipeline(daxa::RasterPipelineCompileInfo const &info) -> AsyncManagedRasterPipeline {
 #if ENABLE_THREAD_POOL
-        auto pipeline_promise = std::make_shared<std::promise<std::shared_ptr<daxa::RasterPipeline>>>();
         auto result = AsyncManagedRasterPipeline{};
-        result.pipeline_promise = pipeline_promise;
-        result.pipeline_future = pipeline_promise->get_future();
-        auto info_copy = info;
-
-        thread_pool.enqueue([this, pipeline_promise, info_copy]() {
+        result.thread_pool = thread_pool;
+        result.pipeline_future = thread_pool->enqueue_with_result([this, info_copy = info]() -> std::shared_ptr<daxa::RasterPipeline> {
             auto [pipeline_manager, lock] = get_pipeline_manager();
             auto compile_result = pipeline_manager.add_raster_pipeline(info_copy);
             if (compile_result.is_err()) {
                 debug_utils::Console::add_log(compile_result.message());
-                return;
+                return nullptr;
             }
             if (!compile_result.value()->is_valid()) {
                 debug_utils::Console::add_log(compile_result.message());
-                return;
+                return nullptr;
             }
-            pipeline_promise->set_value(compile_result.value());
+            return compile_result.value();
         });
+        track_compile_job(result.pipeline_future.handle);
 
         return result;
 #else
@@ -201,32 +229,44 @@ struct AsyncPipelineManager {
         for (auto &pipeline_manager : pipeline_managers) {
             pipeline_manager.add_virtual_file(info);
         }
+        if (shader_cache != nullptr) {
+            shader_cache->add_virtual_file(info.name, info.contents);
+            auto lock = std::lock_guard{cached_pipelines_mtx};
+            for (auto &cached_pipeline : cached_pipelines) {
+                auto const &virtual_files = cached_pipeline.key.virtual_file_dependencies;
+                if (std::find(virtual_files.begin(), virtual_files.end(), info.name) != virtual_files.end()) {
+                    cached_pipeline.is_stale = true;
+                }
+            }
+        }
     }
     void wait() {
 #if ENABLE_THREAD_POOL
-        while (thread_pool.busy()) {
+        auto jobs = std::vector<JobHandle>{};
+        {
+            auto lock = std::lock_guard{compile_jobs_mtx};
+            jobs.swap(compile_jobs);
+        }
+        for (auto const &job : jobs) {
+            thread_pool->wait(job);
         }
 #endif
+        if (shader_cache != nullptr) {
+            auto stats = shader_cache->stats();
+            debug_utils::Console::add_log(fmt::format("shader cache: {} hits, {} misses", stats.hit_n, stats.miss_n));
+            shader_cache->write_manifest();
+        }
     }
     auto reload_all() -> daxa::PipelineReloadResult {
         std::array<daxa::PipelineReloadResult, 8> results;
-        for (daxa_u32 i = 0; i < pipeline_managers.size(); ++i) {
-            // #if ENABLE_THREAD_POOL
-            //             thread_pool.enqueue([this, i, &results]() {
-            //                 auto &pipeline_manager = this->pipeline_managers[i];
-            //                 auto lock = std::lock_guard{this->mutexes[i]};
-            //                 (results)[i] = pipeline_manager.reload_all();
-            //             });
-            // #else
-            auto &pipeline_manager = pipeline_managers[i];
-            auto lock = std::lock_guard{mutexes[i]};
-            results[i] = pipeline_manager.reload_all();
-            // #endif
-        }
-        // #if ENABLE_THREAD_POOL
-        //         while (thread_pool.busy()) {
-        //         }
-        // #endif
+        thread_pool->parallel_for(pipeline_managers.size(), 1, [this, &results](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                auto &pipeline_manager = pipeline_managers[i];
+                auto lock = std::lock_guard{mutexes[i]};
+                results[i] = pipeline_manager.reload_all();
+            }
+        });
+        reload_cached_pipelines();
         for (auto const &result : results) {
             if (daxa::holds_alternative<daxa::PipelineReloadError>(result)) {
                 return result;
@@ -236,6 +276,154 @@ struct AsyncPipelineManager {
     }
 
   private:
+    static auto newest_write_time(std::vector<std::filesystem::path> const &paths) -> std::filesystem::file_time_type {
+        auto result = std::filesystem::file_time_type::min();
+        for (auto const &path : paths) {
+            auto ec = std::error_code{};
+            auto write_time = std::filesystem::last_write_time(path, ec);
+            if (!ec) {
+                result = std::max(result, write_time);
+            }
+        }
+        return result;
+    }
+
+    static auto to_shader_cache_compile_options(daxa::ShaderCompileOptions const &options) -> ShaderCacheCompileOptions {
+        auto result = ShaderCacheCompileOptions{
+            .entry_point = options.entry_point,
+            .enable_debug_info = options.enable_debug_info,
+        };
+        if (options.language.has_value()) {
+            result.language = std::to_string(static_cast<int>(*options.language));
+        }
+        for (auto const &define : options.defines) {
+            result.defines.emplace_back(define.name, define.value);
+        }
+        return result;
+    }
+
+    auto make_cache_key_info(daxa::ComputePipelineCompileInfo const &info) -> ShaderCacheKeyInfo {
+        auto result = ShaderCacheKeyInfo{
+            .name = std::string{info.name},
+            .options = "compute",
+        };
+        if (auto const *shader_file = daxa::get_if<daxa::ShaderFile>(&info.shader_info.source)) {
+            result.source_path = shader_file->path;
+        } else if (auto const *shader_code = daxa::get_if<daxa::ShaderCode>(&info.shader_info.source)) {
+            result.source_code = shader_code->string;
+        }
+        add_shader_cache_compile_options(result, manager_compile_options, to_shader_cache_compile_options(info.shader_info.compile_options));
+        return result;
+    }
+
+    auto compile_compute_pipeline(daxa::ComputePipelineCompileInfo info) -> std::shared_ptr<daxa::ComputePipeline> {
+        auto cache_key = std::optional<ShaderCacheKey>{};
+        auto staging_folder = std::filesystem::path{};
+        if (shader_cache != nullptr) {
+            cache_key = shader_cache->compute_key(make_cache_key_info(info));
+            if (auto spirv = shader_cache->load(*cache_key)) {
+                auto pipeline = device.create_compute_pipeline({
+                    .shader_info = {
+                        .byte_code = spirv->data(),
+                        .byte_code_size = static_cast<uint32_t>(spirv->size()),
+                    },
+                    .push_constant_size = info.push_constant_size,
+                    .name = info.name,
+                });
+                if (pipeline.is_valid()) {
+                    auto result = std::make_shared<daxa::ComputePipeline>(std::move(pipeline));
+                    auto lock = std::lock_guard{cached_pipelines_mtx};
+                    cached_pipelines.push_back({
+                        .info = info,
+                        .key = *cache_key,
+                        .newest_write_time = newest_write_time(cache_key->file_dependencies),
+                        .pipeline = result,
+                    });
+                    return result;
+                }
+            }
+            // The pipeline manager doesn't hand out the SPIR-V it compiled, so have it write the
+            // binary somewhere we can pick it up from.
+            staging_folder = shader_cache->staging_folder(*cache_key);
+            info.shader_info.compile_options.write_out_shader_binary = staging_folder;
+        }
+
+        auto compile_result = [&]() {
+            auto [pipeline_manager, lock] = get_pipeline_manager();
+            return pipeline_manager.add_compute_pipeline(info);
+        }();
+        if (compile_result.is_err()) {
+            debug_utils::Console::add_log(compile_result.message());
+            return nullptr;
+        }
+        if (!compile_result.value()->is_valid()) {
+            debug_utils::Console::add_log(compile_result.message());
+            return nullptr;
+        }
+        if (cache_key.has_value()) {
+            store_staged_binary(*cache_key, std::string{info.name}, staging_folder);
+        }
+        return compile_result.value();
+    }
+
+    void store_staged_binary(ShaderCacheKey const &key, std::string const &name, std::filesystem::path const &staging_folder) {
+        auto ec = std::error_code{};
+        auto binary_path = std::filesystem::path{};
+        auto binary_n = 0u;
+        for (auto const &entry : std::filesystem::directory_iterator(staging_folder, ec)) {
+            if (entry.is_regular_file()) {
+                binary_path = entry.path();
+                ++binary_n;
+            }
+        }
+        // A compute pipeline has exactly one shader. Anything else means we don't know which file is
+        // which, so don't cache it.
+        if (binary_n == 1) {
+            auto file = std::ifstream(binary_path, std::ios::binary);
+            auto spirv = std::vector<uint32_t>(std::filesystem::file_size(binary_path, ec) / sizeof(uint32_t));
+            file.read(reinterpret_cast<char *>(spirv.data()), static_cast<std::streamsize>(spirv.size() * sizeof(uint32_t)));
+            if (file.good()) {
+                shader_cache->store(key, name, spirv);
+            }
+        }
+        std::filesystem::remove_all(staging_folder, ec);
+    }
+
+    void reload_cached_pipelines() {
+        auto lock = std::lock_guard{cached_pipelines_mtx};
+        for (auto &cached_pipeline : cached_pipelines) {
+            if (cached_pipeline.managed_pipeline != nullptr) {
+                // The pipeline manager now owns the real pipeline and swaps it on reload. Mirror that
+                // into the pipeline that was handed out from the cache.
+                *cached_pipeline.pipeline = *cached_pipeline.managed_pipeline;
+                continue;
+            }
+            auto write_time = newest_write_time(cached_pipeline.key.file_dependencies);
+            if (!cached_pipeline.is_stale && write_time <= cached_pipeline.newest_write_time) {
+                continue;
+            }
+            cached_pipeline.newest_write_time = write_time;
+            auto compile_result = [&]() {
+                auto [pipeline_manager, pipeline_manager_lock] = get_pipeline_manager();
+                return pipeline_manager.add_compute_pipeline(cached_pipeline.info);
+            }();
+            if (compile_result.is_err() || !compile_result.value()->is_valid()) {
+                // Keep the cached pipeline running, and try again when the files change again.
+                debug_utils::Console::add_log(compile_result.message());
+                continue;
+            }
+            cached_pipeline.is_stale = false;
+            cached_pipeline.managed_pipeline = compile_result.value();
+            *cached_pipeline.pipeline = *cached_pipeline.managed_pipeline;
+        }
+    }
+
+    void track_compile_job(JobHandle const &handle) {
+        auto lock = std::lock_guard{compile_jobs_mtx};
+        std::erase_if(compile_jobs, [](JobHandle const &job) { return job.done(); });
+        compile_jobs.push_back(handle);
+    }
+
     auto get_pipeline_manager() -> std::pair<daxa::PipelineManager &, std::unique_lock<std::mutex>> {
 #if ENABLE_THREAD_POOL
         auto index = current_index.fetch_add(1);
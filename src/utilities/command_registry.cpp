@@ -0,0 +1,191 @@
+#include "command_registry.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+
+namespace {
+    auto starts_with_ignoring_case(std::string_view str, std::string_view prefix) -> bool {
+        return str.size() >= prefix.size() &&
+               std::equal(prefix.begin(), prefix.end(), str.begin(), [](char a, char b) {
+                   return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+               });
+    }
+
+    auto arg_type_name(CommandArgType type) -> std::string_view {
+        switch (type) {
+        case CommandArgType::INT: return "int";
+        case CommandArgType::FLOAT: return "float";
+        case CommandArgType::BOOL: return "bool";
+        default: return "";
+        }
+    }
+} // namespace
+
+void CommandRegistry::add(ConsoleCommand command) {
+    auto name = command.name;
+    commands.insert_or_assign(std::move(name), std::move(command));
+}
+
+void CommandRegistry::remove(std::string_view name) {
+    if (auto iter = commands.find(name); iter != commands.end()) {
+        commands.erase(iter);
+    }
+}
+
+auto CommandRegistry::find(std::string_view name) const -> ConsoleCommand const * {
+    auto iter = commands.find(name);
+    return iter != commands.end() ? &iter->second : nullptr;
+}
+
+auto CommandRegistry::execute(std::string_view command_line) const -> CommandResult {
+    auto const tokens = tokenize_command_line(command_line);
+    if (tokens.empty()) {
+        return {.ok = true, .error = {}};
+    }
+    auto const *command = find(tokens[0]);
+    if (command == nullptr) {
+        return {.ok = false, .error = fmt::format("Unknown command: '{}'", tokens[0])};
+    }
+    auto args = CommandArgs{};
+    auto result = parse_command_args(*command, std::span{tokens}.subspan(1), args);
+    if (result.ok && command->run) {
+        command->run(args);
+    }
+    return result;
+}
+
+auto CommandRegistry::complete(std::string_view command_line) const -> std::vector<std::string> {
+    auto tokens = tokenize_command_line(command_line);
+    // A trailing space means a new, still empty word is being completed.
+    if (command_line.empty() || std::isspace(static_cast<unsigned char>(command_line.back())) != 0) {
+        tokens.emplace_back();
+    }
+    auto result = std::vector<std::string>{};
+    auto const &word = tokens.back();
+    if (tokens.size() == 1) {
+        for (auto const &[name, command] : commands) {
+            if (starts_with_ignoring_case(name, word)) {
+                result.push_back(name);
+            }
+        }
+        return result;
+    }
+    auto const *command = find(tokens[0]);
+    auto const arg_index = tokens.size() - 2;
+    if (command == nullptr || arg_index >= command->args.size()) {
+        return result;
+    }
+    auto const &arg = command->args[arg_index];
+    auto const bool_completions = std::vector<std::string>{"on", "off"};
+    auto const &completions = (arg.type == CommandArgType::BOOL && arg.completions.empty()) ? bool_completions : arg.completions;
+    for (auto const &completion : completions) {
+        if (starts_with_ignoring_case(completion, word)) {
+            result.push_back(completion);
+        }
+    }
+    return result;
+}
+
+auto tokenize_command_line(std::string_view command_line) -> std::vector<std::string> {
+    auto result = std::vector<std::string>{};
+    auto token = std::string{};
+    auto in_token = false;
+    auto in_quotes = false;
+    for (auto c : command_line) {
+        if (c == '"') {
+            in_quotes = !in_quotes;
+            in_token = true;
+        } else if (!in_quotes && std::isspace(static_cast<unsigned char>(c)) != 0) {
+            if (in_token) {
+                result.push_back(std::move(token));
+                token.clear();
+                in_token = false;
+            }
+        } else {
+            token.push_back(c);
+            in_token = true;
+        }
+    }
+    if (in_token) {
+        result.push_back(std::move(token));
+    }
+    return result;
+}
+
+auto parse_command_arg(CommandArgInfo const &info, std::string_view token, CommandArgValue &out) -> bool {
+    switch (info.type) {
+    case CommandArgType::INT: {
+        auto value = int64_t{};
+        auto const [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (ec != std::errc{} || end != token.data() + token.size()) {
+            return false;
+        }
+        out = value;
+        return true;
+    }
+    case CommandArgType::FLOAT: {
+        auto const str = std::string{token};
+        char *end = nullptr;
+        auto const value = std::strtod(str.c_str(), &end);
+        if (str.empty() || end != str.c_str() + str.size()) {
+            return false;
+        }
+        out = value;
+        return true;
+    }
+    case CommandArgType::BOOL: {
+        for (auto name : {"on", "true", "1", "yes"}) {
+            if (token.size() == std::string_view{name}.size() && starts_with_ignoring_case(token, name)) {
+                out = true;
+                return true;
+            }
+        }
+        for (auto name : {"off", "false", "0", "no"}) {
+            if (token.size() == std::string_view{name}.size() && starts_with_ignoring_case(token, name)) {
+                out = false;
+                return true;
+            }
+        }
+        return false;
+    }
+    default:
+        out = std::string{token};
+        return true;
+    }
+}
+
+auto parse_command_args(ConsoleCommand const &command, std::span<std::string const> tokens, CommandArgs &out) -> CommandResult {
+    out.values.clear();
+    if (tokens.size() > command.args.size()) {
+        return {.ok = false, .error = fmt::format("Too many arguments. Usage: {}", command_usage(command))};
+    }
+    for (size_t arg_i = 0; arg_i < command.args.size(); ++arg_i) {
+        auto const &arg = command.args[arg_i];
+        if (arg_i >= tokens.size()) {
+            if (!arg.is_optional) {
+                return {.ok = false, .error = fmt::format("Missing <{}>. Usage: {}", arg.name, command_usage(command))};
+            }
+            break;
+        }
+        auto value = CommandArgValue{};
+        if (!parse_command_arg(arg, tokens[arg_i], value)) {
+            return {.ok = false, .error = fmt::format("'{}' is not a valid {} for <{}>", tokens[arg_i], arg_type_name(arg.type), arg.name)};
+        }
+        out.values.push_back(std::move(value));
+    }
+    return {.ok = true, .error = {}};
+}
+
+auto command_usage(ConsoleCommand const &command) -> std::string {
+    auto result = command.name;
+    for (auto const &arg : command.args) {
+        auto const type_name = arg_type_name(arg.type);
+        auto const arg_str = type_name.empty() ? arg.name : fmt::format("{}:{}", arg.name, type_name);
+        result += arg.is_optional ? fmt::format(" [{}]", arg_str) : fmt::format(" <{}>", arg_str);
+    }
+    return result;
+}
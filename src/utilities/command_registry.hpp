@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+enum struct CommandArgType : uint8_t {
+    INT,
+    FLOAT,
+    BOOL,
+    STRING,
+};
+
+using CommandArgValue = std::variant<int64_t, double, bool, std::string>;
+
+struct CommandArgInfo {
+    std::string name;
+    CommandArgType type = CommandArgType::STRING;
+    // Optional arguments can only be followed by other optional arguments.
+    bool is_optional = false;
+    // Offered by tab completion. BOOL arguments offer "on" and "off" when this is empty.
+    std::vector<std::string> completions;
+};
+
+// The parsed arguments, in the order they were declared. Optional arguments that weren't given are
+// missing from the end.
+struct CommandArgs {
+    std::vector<CommandArgValue> values;
+
+    auto has(size_t index) const -> bool { return index < values.size(); }
+    auto get_int(size_t index) const -> int64_t { return std::get<int64_t>(values[index]); }
+    auto get_float(size_t index) const -> double { return std::get<double>(values[index]); }
+    auto get_bool(size_t index) const -> bool { return std::get<bool>(values[index]); }
+    auto get_string(size_t index) const -> std::string const & { return std::get<std::string>(values[index]); }
+};
+
+struct ConsoleCommand {
+    std::string name;
+    std::string help;
+    std::vector<CommandArgInfo> args;
+    // Only called with arguments that parsed. Output goes to the log.
+    std::function<void(CommandArgs const &args)> run;
+};
+
+struct CommandResult {
+    bool ok = false;
+    std::string error;
+};
+
+// Named console commands with typed arguments. Doesn't depend on ImGui or the device, so it can be
+// driven from anywhere a command line string is at hand.
+struct CommandRegistry {
+    std::map<std::string, ConsoleCommand, std::less<>> commands;
+
+    // Replaces any command of the same name.
+    void add(ConsoleCommand command);
+    void remove(std::string_view name);
+    auto find(std::string_view name) const -> ConsoleCommand const *;
+
+    // Parses `command_line` against the command named by its first word, and runs it if that
+    // worked.
+    auto execute(std::string_view command_line) const -> CommandResult;
+    // Candidates for the word at the end of `command_line`. These are command names for the first
+    // word, and the completions of the matching argument after that.
+    auto complete(std::string_view command_line) const -> std::vector<std::string>;
+};
+
+// Splits at whitespace, keeping text in double quotes together.
+auto tokenize_command_line(std::string_view command_line) -> std::vector<std::string>;
+auto parse_command_arg(CommandArgInfo const &info, std::string_view token, CommandArgValue &out) -> bool;
+auto parse_command_args(ConsoleCommand const &command, std::span<std::string const> tokens, CommandArgs &out) -> CommandResult;
+// Like "rebuild_chunk <index:int> [reason]".
+auto command_usage(ConsoleCommand const &command) -> std::string;
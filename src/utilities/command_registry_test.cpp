@@ -0,0 +1,186 @@
+#include <utilities/command_registry.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <array>
+#include <optional>
+
+namespace {
+    auto test_tokenize() -> std::string {
+        struct Case {
+            std::string_view command_line;
+            std::vector<std::string> tokens;
+        };
+        auto const cases = std::array{
+            Case{"", {}},
+            Case{"  \t ", {}},
+            Case{"set_seed 42", {"set_seed", "42"}},
+            Case{"  a\tb   c  ", {"a", "b", "c"}},
+            Case{"say \"hello  world\" twice", {"say", "hello  world", "twice"}},
+            Case{"say \"\"", {"say", ""}},
+            Case{"say pre\"fix suf\"fix", {"say", "prefix suffix"}},
+            // An unterminated quote runs to the end.
+            Case{"say \"open end ", {"say", "open end "}},
+        };
+        for (auto const &test_case : cases) {
+            auto const tokens = tokenize_command_line(test_case.command_line);
+            if (tokens != test_case.tokens) {
+                return fmt::format("'{}' split into {} tokens, instead of {}", test_case.command_line, tokens.size(), test_case.tokens.size());
+            }
+        }
+        return {};
+    }
+
+    auto test_parse_arg() -> std::string {
+        struct Case {
+            CommandArgType type;
+            std::string_view token;
+            std::optional<CommandArgValue> value;
+        };
+        auto const cases = std::array{
+            Case{CommandArgType::INT, "42", int64_t{42}},
+            Case{CommandArgType::INT, "-7", int64_t{-7}},
+            Case{CommandArgType::INT, "12x", std::nullopt},
+            Case{CommandArgType::INT, "1.5", std::nullopt},
+            Case{CommandArgType::INT, "", std::nullopt},
+            Case{CommandArgType::INT, "99999999999999999999", std::nullopt},
+            Case{CommandArgType::FLOAT, "1.5", 1.5},
+            Case{CommandArgType::FLOAT, "-2e3", -2000.0},
+            Case{CommandArgType::FLOAT, "3", 3.0},
+            Case{CommandArgType::FLOAT, "abc", std::nullopt},
+            Case{CommandArgType::FLOAT, "1.5.", std::nullopt},
+            Case{CommandArgType::FLOAT, "", std::nullopt},
+            Case{CommandArgType::BOOL, "on", true},
+            Case{CommandArgType::BOOL, "TRUE", true},
+            Case{CommandArgType::BOOL, "1", true},
+            Case{CommandArgType::BOOL, "Yes", true},
+            Case{CommandArgType::BOOL, "off", false},
+            Case{CommandArgType::BOOL, "No", false},
+            Case{CommandArgType::BOOL, "0", false},
+            Case{CommandArgType::BOOL, "2", std::nullopt},
+            Case{CommandArgType::BOOL, "onn", std::nullopt},
+            Case{CommandArgType::STRING, "anything at all", std::string{"anything at all"}},
+            Case{CommandArgType::STRING, "", std::string{}},
+        };
+        for (auto const &test_case : cases) {
+            auto value = CommandArgValue{};
+            auto const ok = parse_command_arg({.name = "x", .type = test_case.type, .is_optional = false, .completions = {}}, test_case.token, value);
+            if (ok != test_case.value.has_value() || (ok && value != *test_case.value)) {
+                return fmt::format("'{}' {} as a {}", test_case.token, ok ? "parsed wrong" : "didn't parse", static_cast<int>(test_case.type));
+            }
+        }
+        return {};
+    }
+
+    // A command with every kind of argument, which records what it was run with.
+    struct RecordingCommand {
+        std::optional<CommandArgs> last_args;
+        uint32_t run_n = 0;
+
+        auto make() -> ConsoleCommand {
+            return {
+                .name = "place",
+                .help = "Places something",
+                .args = {
+                    {.name = "count", .type = CommandArgType::INT, .is_optional = false, .completions = {}},
+                    {.name = "scale", .type = CommandArgType::FLOAT, .is_optional = false, .completions = {}},
+                    {.name = "snap", .type = CommandArgType::BOOL, .is_optional = true, .completions = {}},
+                    {.name = "material", .type = CommandArgType::STRING, .is_optional = true, .completions = {"stone", "Sand", "snow"}},
+                },
+                .run = [this](CommandArgs const &args) {
+                    last_args = args;
+                    ++run_n;
+                },
+            };
+        }
+    };
+
+    auto test_execute() -> std::string {
+        auto recorder = RecordingCommand{};
+        auto registry = CommandRegistry{};
+        registry.add(recorder.make());
+
+        auto result = registry.execute("place 3 0.5 on \"red sand\"");
+        if (!result.ok || recorder.run_n != 1) {
+            return fmt::format("a valid command line failed: {}", result.error);
+        }
+        auto const &args = *recorder.last_args;
+        if (args.values.size() != 4 || args.get_int(0) != 3 || args.get_float(1) != 0.5 || !args.get_bool(2) || args.get_string(3) != "red sand") {
+            return "the command ran with the wrong arguments";
+        }
+        result = registry.execute("  place 3 0.5 ");
+        if (!result.ok || recorder.run_n != 2 || recorder.last_args->has(2)) {
+            return "leaving out the optional arguments didn't work";
+        }
+
+        // None of these may run the command.
+        for (auto const *command_line : {"place 3", "place x 0.5", "place 3 0.5 maybe", "place 3 0.5 on stone extra", "plac 3 0.5"}) {
+            result = registry.execute(command_line);
+            if (result.ok || result.error.empty() || recorder.run_n != 2) {
+                return fmt::format("'{}' didn't fail", command_line);
+            }
+        }
+        if (registry.execute("place").error.find("Usage: place <count:int> <scale:float> [snap:bool] [material]") == std::string::npos) {
+            return fmt::format("a missing argument didn't show the usage: {}", registry.execute("place").error);
+        }
+        if (!registry.execute("   ").ok || recorder.run_n != 2) {
+            return "an empty command line didn't do nothing";
+        }
+
+        auto replaced_n = 0u;
+        registry.add({.name = "place", .help = {}, .args = {}, .run = [&](CommandArgs const &) { ++replaced_n; }});
+        if (!registry.execute("place").ok || replaced_n != 1 || recorder.run_n != 2) {
+            return "adding a command of the same name didn't replace it";
+        }
+        registry.remove("place");
+        registry.remove("place");
+        if (registry.find("place") != nullptr || registry.execute("place").ok) {
+            return "a removed command is still there";
+        }
+        return {};
+    }
+
+    auto test_complete() -> std::string {
+        auto recorder = RecordingCommand{};
+        auto registry = CommandRegistry{};
+        registry.add(recorder.make());
+        registry.add({.name = "pick", .help = {}, .args = {}, .run = {}});
+        registry.add({.name = "reload", .help = {}, .args = {}, .run = {}});
+
+        struct Case {
+            std::string_view command_line;
+            std::vector<std::string> completions;
+        };
+        auto const cases = std::array{
+            Case{"", {"pick", "place", "reload"}},
+            Case{"p", {"pick", "place"}},
+            Case{"PL", {"place"}},
+            Case{"x", {}},
+            // The arguments without completions offer none.
+            Case{"place ", {}},
+            Case{"place 3 0.5 ", {"on", "off"}},
+            Case{"place 3 0.5 o", {"on", "off"}},
+            Case{"place 3 0.5 of", {"off"}},
+            Case{"place 3 0.5 on s", {"stone", "Sand", "snow"}},
+            Case{"place 3 0.5 on sa", {"Sand"}},
+            Case{"place 3 0.5 on stone ", {}},
+            Case{"unknown ", {}},
+        };
+        for (auto const &test_case : cases) {
+            auto const completions = registry.complete(test_case.command_line);
+            if (completions != test_case.completions) {
+                return fmt::format("'{}' completed to {} candidates, instead of {}", test_case.command_line, completions.size(), test_case.completions.size());
+            }
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"tokenize", test_tokenize},
+        UnitTestCase{"parse arguments", test_parse_arg},
+        UnitTestCase{"execute", test_execute},
+        UnitTestCase{"complete", test_complete},
+    };
+    return run_unit_tests(cases);
+}
@@ -1,10 +1,59 @@
 #include "debug.hpp"
 #include <fmt/format.h>
 
+#include <algorithm>
+#include <array>
+
 debug_utils::Console::Console() {
     s_instance = this;
     clear_log();
     memset(input_buffer, 0, sizeof(input_buffer));
+
+    add_command({
+        .name = "help",
+        .help = "Lists the commands, or describes one of them",
+        .args = {{.name = "command", .type = CommandArgType::STRING, .is_optional = true, .completions = {}}},
+        .run = [](CommandArgs const &args) {
+            auto const &registry = s_instance->command_registry;
+            if (args.has(0)) {
+                if (auto const *command = registry.find(args.get_string(0))) {
+                    add_log(fmt::format("{}\n  {}", command_usage(*command), command->help));
+                } else {
+                    add_log(fmt::format("[error] Unknown command: '{}'", args.get_string(0)));
+                }
+                return;
+            }
+            for (auto const &[name, command] : registry.commands) {
+                add_log(fmt::format("{:<24} {}", name, command.help));
+            }
+        },
+    });
+    add_command({
+        .name = "clear",
+        .help = "Clears the console",
+        .args = {},
+        .run = [](CommandArgs const &) { clear_log(); },
+    });
+    add_command({
+        .name = "log_level",
+        .help = "Sets the lowest level that gets logged",
+        .args = {{.name = "level", .type = CommandArgType::STRING, .is_optional = false, .completions = {"trace", "info", "warn", "error"}}},
+        .run = [](CommandArgs const &args) {
+            auto const &name = args.get_string(0);
+            auto const levels = std::array{
+                std::pair{"trace", LogLevel::TRACE},
+                std::pair{"info", LogLevel::INFO},
+                std::pair{"warn", LogLevel::WARN},
+                std::pair{"error", LogLevel::ERR},
+            };
+            auto const iter = std::find_if(levels.begin(), levels.end(), [&](auto const &level) { return name == level.first; });
+            if (iter == levels.end() || Logger::s_instance == nullptr) {
+                add_log(fmt::format("[error] Can't set the log level to '{}'", name));
+                return;
+            }
+            Logger::s_instance->min_level = iter->second;
+        },
+    });
 }
 
 debug_utils::Console::~Console() {
@@ -24,29 +73,33 @@ void debug_utils::Console::clear_log() {
 }
 
 void debug_utils::Console::add_log(std::string const &str) {
-    auto &self = *s_instance;
-    {
-        auto lock = std::lock_guard{*self.items_mtx};
-        self.items.push_back(str);
-    }
-    std::cout << str << std::endl;
+    log_unformatted(log_level_of(str), str);
 }
 
-static auto Stricmp(const char *s1, const char *s2) -> int {
-    int d = 0;
-    while ((d = toupper(*s2) - toupper(*s1)) == 0 && (*s1 != 0)) {
-        s1++;
-        s2++;
-    }
-    return d;
+auto debug_utils::Console::log_sink() -> LogSink {
+    return LogSink{
+        .write = [](std::span<LogRecord const> records) {
+            if (s_instance == nullptr) {
+                return;
+            }
+            auto &self = *s_instance;
+            auto lock = std::lock_guard{*self.items_mtx};
+            for (auto const &record : records) {
+                self.items.push_back({record.level, record.text});
+            }
+            while (self.items.size() > MAX_ITEM_N) {
+                self.items.pop_front();
+            }
+        },
+        .flush = {},
+    };
 }
 
-static auto Strnicmp(const char *s1, const char *s2, int n) -> int {
+static auto Stricmp(const char *s1, const char *s2) -> int {
     int d = 0;
-    while (n > 0 && (d = toupper(*s2) - toupper(*s1)) == 0 && (*s1 != 0)) {
+    while ((d = toupper(*s2) - toupper(*s1)) == 0 && (*s1 != 0)) {
         s1++;
         s2++;
-        n--;
     }
     return d;
 }
@@ -111,22 +164,25 @@ void debug_utils::Console::draw(const char *title, bool *p_open) {
     {
         auto lock = std::lock_guard{*self.items_mtx};
         for (auto const &item : self.items) {
-            if (!self.filter.PassFilter(item.c_str())) {
+            if (!self.filter.PassFilter(item.text.c_str())) {
                 continue;
             }
             ImVec4 color;
             bool has_color = false;
-            if (strstr(item.c_str(), "[error]") != nullptr) {
+            if (item.level == LogLevel::ERR) {
                 color = ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
                 has_color = true;
-            } else if (strncmp(item.c_str(), "# ", 2) == 0) {
+            } else if (item.level == LogLevel::WARN) {
+                color = ImVec4(1.0f, 0.9f, 0.4f, 1.0f);
+                has_color = true;
+            } else if (strncmp(item.text.c_str(), "# ", 2) == 0) {
                 color = ImVec4(1.0f, 0.8f, 0.6f, 1.0f);
                 has_color = true;
             }
             if (has_color) {
                 ImGui::PushStyleColor(ImGuiCol_Text, color);
             }
-            ImGui::TextUnformatted(item.c_str());
+            ImGui::TextUnformatted(item.text.c_str());
             if (has_color) {
                 ImGui::PopStyleColor();
             }
@@ -177,10 +233,25 @@ void debug_utils::Console::exec_command(const char *command_line) {
         }
     }
     self.history.push_back(Strdup(command_line));
-    add_log(fmt::format("Unknown command: '{}'\n", command_line));
+    auto const result = self.command_registry.execute(command_line);
+    if (!result.ok) {
+        add_log(fmt::format("[error] {}", result.error));
+    }
     self.scroll_to_bottom = true;
 }
 
+void debug_utils::Console::add_command(ConsoleCommand command) {
+    if (s_instance != nullptr) {
+        s_instance->command_registry.add(std::move(command));
+    }
+}
+
+void debug_utils::Console::remove_command(std::string_view name) {
+    if (s_instance != nullptr) {
+        s_instance->command_registry.remove(name);
+    }
+}
+
 auto debug_utils::Console::on_text_edit(ImGuiInputTextCallbackData *data) -> int {
     auto &self = *s_instance;
     switch (data->EventFlag) {
@@ -189,32 +260,27 @@ auto debug_utils::Console::on_text_edit(ImGuiInputTextCallbackData *data) -> int
         const char *word_start = word_end;
         while (word_start > data->Buf) {
             const char c = word_start[-1];
-            if (c == ' ' || c == '\t' || c == ',' || c == ';') {
+            if (c == ' ' || c == '\t') {
                 break;
             }
             word_start--;
         }
-        ImVector<const char *> candidates;
-        for (auto &command : self.commands) {
-            if (Strnicmp(command, word_start, static_cast<daxa_i32>(word_end - word_start)) == 0) {
-                candidates.push_back(command);
-            }
-        }
+        auto const candidates = self.command_registry.complete(std::string_view{data->Buf, static_cast<size_t>(data->CursorPos)});
         if (candidates.empty()) {
             add_log(fmt::format("No match for \"{}\"!\n", /* (int)(word_end - word_start), */ word_start));
         } else if (candidates.size() == 1) {
             data->DeleteChars(static_cast<daxa_i32>(word_start - data->Buf), static_cast<daxa_i32>(word_end - word_start));
-            data->InsertChars(data->CursorPos, candidates[0]);
+            data->InsertChars(data->CursorPos, candidates[0].c_str());
             data->InsertChars(data->CursorPos, " ");
         } else {
             int match_len = static_cast<daxa_i32>(word_end - word_start);
             for (;;) {
                 int c = 0;
                 bool all_candidates_matches = true;
-                for (int i = 0; i < candidates.size() && all_candidates_matches; i++) {
+                for (size_t i = 0; i < candidates.size() && all_candidates_matches; i++) {
                     if (i == 0) {
-                        c = toupper(candidates[i][match_len]);
-                    } else if (c == 0 || c != toupper(candidates[i][match_len])) {
+                        c = toupper(candidates[i].c_str()[match_len]);
+                    } else if (c == 0 || c != toupper(candidates[i].c_str()[match_len])) {
                         all_candidates_matches = false;
                     }
                 }
@@ -225,7 +291,7 @@ auto debug_utils::Console::on_text_edit(ImGuiInputTextCallbackData *data) -> int
             }
             if (match_len > 0) {
                 data->DeleteChars(static_cast<daxa_i32>(word_start - data->Buf), static_cast<daxa_i32>(word_end - word_start));
-                data->InsertChars(data->CursorPos, candidates[0], candidates[0] + match_len);
+                data->InsertChars(data->CursorPos, candidates[0].c_str(), candidates[0].c_str() + match_len);
             }
             add_log("Possible matches:\n");
             for (auto &candidate : candidates) {
@@ -2,15 +2,26 @@
 
 #include <mutex>
 #include <map>
+#include <deque>
 
 #include <application/settings.inl>
+#include <utilities/log.hpp>
+#include <utilities/command_registry.hpp>
 #include <imgui.h>
 
 namespace debug_utils {
     struct Console {
+        // Older items are discarded.
+        static constexpr size_t MAX_ITEM_N = 4096;
+
+        struct Item {
+            LogLevel level;
+            std::string text;
+        };
+
         char input_buffer[256]{};
-        std::vector<std::string> items;
-        std::vector<const char *> commands;
+        std::deque<Item> items;
+        CommandRegistry command_registry;
         std::vector<char *> history;
         int history_pos{-1};
         ImGuiTextFilter filter;
@@ -23,9 +34,16 @@ namespace debug_utils {
         ~Console();
 
         static void clear_log();
+        // Goes through the Logger when there is one, so this doesn't block on the console or stdout.
         static void add_log(std::string const &str);
+        // Appends to the console's history. Used by the Logger's drain thread.
+        static auto log_sink() -> LogSink;
         static void draw(const char *title, bool *p_open);
         static void exec_command(const char *command_line);
+        // Commands are run on the main thread, from draw(). Whatever a command captures has to
+        // outlive it, so remove it again before that goes away.
+        static void add_command(ConsoleCommand command);
+        static void remove_command(std::string_view name);
         static int on_text_edit(ImGuiInputTextCallbackData *data);
     };
 
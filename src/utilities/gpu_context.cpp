@@ -3,11 +3,14 @@
 #include <application/input.inl>
 #include <application/settings.inl>
 
-#include <minizip/unzip.h>
+#include <utilities/log.hpp>
+#include <utilities/thread_pool.hpp>
+
 #include <FreeImage.h>
 #include <fmt/format.h>
 
-#include <random>
+#include <algorithm>
+#include <bit>
 
 GpuContext::GpuContext() {
     daxa_instance = daxa::create_instance({});
@@ -42,7 +45,7 @@ GpuContext::GpuContext() {
         },
         .register_null_pipelines_when_first_compile_fails = true,
         .name = "pipeline_manager",
-    });
+    }, ".out/shader_cache");
 
     pipeline_manager->add_virtual_file({
         .name = "FULL_SCREEN_TRIANGLE_VERTEX_SHADER",
@@ -105,6 +108,7 @@ GpuContext::GpuContext() {
         .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
         .name = "staging_output_buffer",
     });
+    upload_ring.create(device, memory_ledger);
     sampler_nnc = device.create_sampler({
         .magnification_filter = daxa::Filter::NEAREST,
         .minification_filter = daxa::Filter::NEAREST,
@@ -172,48 +176,7 @@ GpuContext::GpuContext() {
                     .name = "staging_buffer",
                 });
                 auto *buffer_ptr = ti.device.get_host_address_as<uint8_t>(staging_buffer).value();
-                auto *stbn_zip = unzOpen("assets/STBN.zip");
-                for (auto i = 0; i < 64; ++i) {
-                    [[maybe_unused]] int err = 0;
-                    daxa_i32 size_x = 0;
-                    daxa_i32 size_y = 0;
-                    auto load_image = [&](char const *path, uint8_t *buffer_out_ptr) {
-                        err = unzLocateFile(stbn_zip, path, 1);
-                        assert(err == UNZ_OK);
-                        auto file_info = unz_file_info{};
-                        err = unzGetCurrentFileInfo(stbn_zip, &file_info, nullptr, 0, nullptr, 0, nullptr, 0);
-                        assert(err == UNZ_OK);
-                        auto file_data = std::vector<uint8_t>{};
-                        file_data.resize(file_info.uncompressed_size);
-                        err = unzOpenCurrentFile(stbn_zip);
-                        assert(err == UNZ_OK);
-                        err = unzReadCurrentFile(stbn_zip, file_data.data(), static_cast<uint32_t>(file_data.size()));
-                        assert(err == file_data.size());
-
-                        auto fi_mem = FreeImage_OpenMemory(file_data.data(), static_cast<DWORD>(file_data.size()));
-                        auto fi_file_desc = FreeImage_GetFileTypeFromMemory(fi_mem, 0);
-                        FIBITMAP *fi_bitmap = FreeImage_LoadFromMemory(fi_file_desc, fi_mem);
-                        FreeImage_CloseMemory(fi_mem);
-                        size_x = static_cast<int32_t>(FreeImage_GetWidth(fi_bitmap));
-                        size_y = static_cast<int32_t>(FreeImage_GetHeight(fi_bitmap));
-                        auto *temp_data = FreeImage_GetBits(fi_bitmap);
-                        assert(temp_data != nullptr && "Failed to load image");
-                        auto pixel_size = FreeImage_GetBPP(fi_bitmap);
-                        if (pixel_size != 32) {
-                            auto *temp = FreeImage_ConvertTo32Bits(fi_bitmap);
-                            FreeImage_Unload(fi_bitmap);
-                            fi_bitmap = temp;
-                        }
-
-                        if (temp_data != nullptr) {
-                            assert(size_x == 128 && size_y == 128);
-                            std::copy(temp_data + 0, temp_data + 128 * 128 * 4, buffer_out_ptr);
-                        }
-                        FreeImage_Unload(fi_bitmap);
-                    };
-                    auto vec2_name = std::string{"STBN/stbn_vec2_2Dx1D_128x128x64_"} + std::to_string(i) + ".png";
-                    load_image(vec2_name.c_str(), buffer_ptr + (128 * 128 * 4) * i + (128 * 128 * 4 * 64) * 0);
-                }
+                noise_cache.load_stbn_vec2("assets/STBN.zip", {buffer_ptr, NoiseCache::STBN_VEC2_SIZE});
 
                 ti.recorder.pipeline_barrier({
                     .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
@@ -398,6 +361,14 @@ GpuContext::GpuContext() {
         task_test_texture.set_images({.images = std::array{debug_texture}});
         task_test_texture2.set_images({.images = std::array{debug_texture}});
     }
+
+    auto const texture_tag = GpuMemoryTag{.owner = "gpu_context", .category = GpuMemoryCategory::TEXTURES, .lifetime = GpuMemoryLifetime::PERSISTENT};
+    for (auto image : {value_noise_image, blue_noise_vec2_image, debug_texture, test_texture, test_texture2}) {
+        track_gpu_image(memory_ledger, device, image, texture_tag);
+    }
+    for (auto buffer : {input_buffer, output_buffer, staging_output_buffer}) {
+        track_gpu_buffer(memory_ledger, device, buffer, memory_tag);
+    }
 }
 
 GpuContext::~GpuContext() {
@@ -416,6 +387,7 @@ GpuContext::~GpuContext() {
     device.destroy_buffer(input_buffer);
     device.destroy_buffer(output_buffer);
     device.destroy_buffer(staging_output_buffer);
+    upload_ring.destroy();
     device.destroy_sampler(sampler_nnc);
     device.destroy_sampler(sampler_lnc);
     device.destroy_sampler(sampler_llc);
@@ -433,23 +405,20 @@ void GpuContext::create_swapchain(daxa::SwapchainInfo const &info) {
     swapchain = device.create_swapchain(info);
 }
 
-void GpuContext::use_resources() {
-    frame_task_graph.use_persistent_image(task_swapchain_image);
-
-    auto use_shared_resources = [this](daxa::TaskGraph &task_graph) {
-        task_graph.use_persistent_image(task_value_noise_image);
-        task_graph.use_persistent_image(task_blue_noise_vec2_image);
-        task_graph.use_persistent_image(task_debug_texture);
-        task_graph.use_persistent_image(task_test_texture);
-        task_graph.use_persistent_image(task_test_texture2);
+void GpuContext::use_resources(daxa::TaskGraph &task_graph) {
+    if (&task_graph == &frame_task_graph) {
+        task_graph.use_persistent_image(task_swapchain_image);
+    }
 
-        task_graph.use_persistent_buffer(task_input_buffer);
-        task_graph.use_persistent_buffer(task_output_buffer);
-        task_graph.use_persistent_buffer(task_staging_output_buffer);
-    };
+    task_graph.use_persistent_image(task_value_noise_image);
+    task_graph.use_persistent_image(task_blue_noise_vec2_image);
+    task_graph.use_persistent_image(task_debug_texture);
+    task_graph.use_persistent_image(task_test_texture);
+    task_graph.use_persistent_image(task_test_texture2);
 
-    use_shared_resources(frame_task_graph);
-    use_shared_resources(startup_task_graph);
+    task_graph.use_persistent_buffer(task_input_buffer);
+    task_graph.use_persistent_buffer(task_output_buffer);
+    task_graph.use_persistent_buffer(task_staging_output_buffer);
 }
 
 void GpuContext::update_seeded_value_noise(uint64_t seed) {
@@ -469,11 +438,7 @@ void GpuContext::update_seeded_value_noise(uint64_t seed) {
                 .name = "staging_buffer",
             });
             auto *buffer_ptr = ti.device.get_host_address_as<uint8_t>(staging_buffer).value();
-            std::mt19937_64 rng(seed);
-            std::uniform_int_distribution<std::mt19937::result_type> dist(0, 255);
-            for (daxa_u32 i = 0; i < (256 * 256 * 256 * 1); ++i) {
-                buffer_ptr[i] = dist(rng) & 0xff;
-            }
+            noise_cache.load_value_noise(seed, {buffer_ptr, NoiseCache::VALUE_NOISE_SIZE}, ThreadPool::s_instance);
             ti.recorder.pipeline_barrier({
                 .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
             });
@@ -498,13 +463,131 @@ void GpuContext::update_seeded_value_noise(uint64_t seed) {
     temp_task_graph.execute({});
 }
 
+namespace {
+    template <typename ResourceId>
+    auto memory_id(ResourceId id) -> uint64_t {
+        return std::bit_cast<uint64_t>(id);
+    }
+
+    auto upload_memory_tag(GpuMemoryLifetime lifetime) -> GpuMemoryTag {
+        return {.owner = "upload_ring", .category = GpuMemoryCategory::UPLOADS, .lifetime = lifetime};
+    }
+} // namespace
+
+auto gpu_buffer_allocation_size(daxa::Device &device, daxa::BufferInfo const &info) -> uint64_t {
+    return std::max<uint64_t>(device.buffer_memory_requirements(info).size, info.size);
+}
+
+void track_gpu_buffer(GpuMemoryLedger &ledger, daxa::Device &device, daxa::BufferId buffer, GpuMemoryTag const &tag) {
+    if (buffer.is_empty()) {
+        return;
+    }
+    auto const info = device.info_buffer(buffer).value();
+    ledger.track(GpuMemoryResourceKind::BUFFER, memory_id(buffer), std::string{info.name.view()}, tag, gpu_buffer_allocation_size(device, info));
+}
+
+void track_gpu_image(GpuMemoryLedger &ledger, daxa::Device &device, daxa::ImageId image, GpuMemoryTag const &tag) {
+    if (image.is_empty()) {
+        return;
+    }
+    auto const info = device.info_image(image).value();
+    ledger.track(GpuMemoryResourceKind::IMAGE, memory_id(image), std::string{info.name.view()}, tag, device.image_memory_requirements(info).size);
+}
+
+void untrack_gpu_buffer(GpuMemoryLedger &ledger, daxa::BufferId buffer) {
+    ledger.untrack(GpuMemoryResourceKind::BUFFER, memory_id(buffer));
+}
+
+void untrack_gpu_image(GpuMemoryLedger &ledger, daxa::ImageId image) {
+    ledger.untrack(GpuMemoryResourceKind::IMAGE, memory_id(image));
+}
+
+void track_gpu_tlas(GpuMemoryLedger &ledger, daxa::Device &device, daxa::TlasId tlas, GpuMemoryTag const &tag) {
+    if (tlas.is_empty()) {
+        return;
+    }
+    auto const info = device.info_tlas(tlas).value();
+    ledger.track(GpuMemoryResourceKind::ACCELERATION_STRUCTURE, memory_id(tlas), std::string{info.name.view()}, tag, info.size);
+}
+
+void untrack_gpu_tlas(GpuMemoryLedger &ledger, daxa::TlasId tlas) {
+    ledger.untrack(GpuMemoryResourceKind::ACCELERATION_STRUCTURE, memory_id(tlas));
+}
+
+void GpuUploadRing::create(daxa::Device &a_device, GpuMemoryLedger &a_memory_ledger, size_t capacity) {
+    device = a_device;
+    memory_ledger = &a_memory_ledger;
+    buffer = device.create_buffer({
+        .size = capacity,
+        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .name = "upload_ring_buffer",
+    });
+    track_gpu_buffer(*memory_ledger, device, buffer, upload_memory_tag(GpuMemoryLifetime::PERSISTENT));
+    host_ptr = device.get_host_address_as<uint8_t>(buffer).value();
+    ring.init(capacity);
+}
+
+void GpuUploadRing::destroy() {
+    for (auto const &overflow : overflow_buffers) {
+        untrack_gpu_buffer(*memory_ledger, overflow.buffer);
+        device.destroy_buffer(overflow.buffer);
+    }
+    overflow_buffers.clear();
+    if (!buffer.is_empty()) {
+        untrack_gpu_buffer(*memory_ledger, buffer);
+        device.destroy_buffer(buffer);
+        buffer = {};
+    }
+    host_ptr = nullptr;
+}
+
+void GpuUploadRing::begin_frame(uint64_t a_frame_index) {
+    frame_index = a_frame_index;
+    // Same latency as the buffers VoxelWorld retires.
+    auto const frame_latency = uint64_t{FRAMES_IN_FLIGHT + 1};
+    if (frame_index < frame_latency) {
+        return;
+    }
+    // Frames end with their index + 1 as the fence value, so that 0 means none are done.
+    auto const completed_fence_value = frame_index - frame_latency + 1;
+    ring.collect(completed_fence_value);
+    while (!overflow_buffers.empty() && overflow_buffers.front().frame + 1 <= completed_fence_value) {
+        untrack_gpu_buffer(*memory_ledger, overflow_buffers.front().buffer);
+        device.destroy_buffer(overflow_buffers.front().buffer);
+        overflow_buffers.pop_front();
+    }
+}
+
+void GpuUploadRing::end_frame() {
+    ring.end_frame(frame_index + 1);
+}
+
+auto GpuUploadRing::allocate(size_t size, size_t alignment) -> UploadAllocation {
+    if (auto const offset = ring.allocate(size, alignment)) {
+        return {.buffer = buffer, .offset = *offset, .host_ptr = host_ptr + *offset};
+    }
+    auto overflow_buffer = device.create_buffer({
+        .size = std::max<size_t>(size, 1),
+        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .name = "upload_overflow_buffer",
+    });
+    track_gpu_buffer(*memory_ledger, device, overflow_buffer, upload_memory_tag(GpuMemoryLifetime::PER_FRAME));
+    overflow_buffers.push_back({.buffer = overflow_buffer, .frame = frame_index});
+    return {.buffer = overflow_buffer, .offset = 0, .host_ptr = device.get_host_address_as<uint8_t>(overflow_buffer).value()};
+}
+
 auto GpuContext::find_or_add_temporal_buffer(daxa::BufferInfo const &info) -> TemporalBuffer {
     auto id = std::string{info.name.view()};
     auto iter = temporal_buffers.find(id);
 
     if (iter == temporal_buffers.end()) {
+        auto const size = gpu_buffer_allocation_size(device, info);
+        if (!memory_ledger.can_grow(memory_tag.category, size)) {
+            log_warning("TemporalBuffer \"{}\" of {} goes over the GPU memory budget of {}", id, memory_tag.owner, gpu_memory_category_name(memory_tag.category));
+        }
         auto result = TemporalBuffer{};
         result.resource_id = device.create_buffer(info);
+        memory_ledger.track(GpuMemoryResourceKind::BUFFER, memory_id(result.resource_id), id, memory_tag, size);
         result.task_resource = daxa::TaskBuffer(daxa::TaskBufferInfo{.initial_buffers = {.buffers = std::array{result.resource_id}}, .name = id});
         auto emplace_result = temporal_buffers.emplace(id, result);
         iter = emplace_result.first;
@@ -523,8 +606,13 @@ auto GpuContext::find_or_add_temporal_image(daxa::ImageInfo const &info) -> Temp
     auto iter = temporal_images.find(id);
 
     if (iter == temporal_images.end()) {
+        auto const size = device.image_memory_requirements(info).size;
+        if (!memory_ledger.can_grow(memory_tag.category, size)) {
+            log_warning("TemporalImage \"{}\" of {} goes over the GPU memory budget of {}", id, memory_tag.owner, gpu_memory_category_name(memory_tag.category));
+        }
         auto result = TemporalImage{};
         result.resource_id = device.create_image(info);
+        memory_ledger.track(GpuMemoryResourceKind::IMAGE, memory_id(result.resource_id), id, memory_tag, size);
         result.task_resource = daxa::TaskImage(daxa::TaskImageInfo{.initial_images = {.images = std::array{result.resource_id}}, .name = id});
         auto emplace_result = temporal_images.emplace(id, result);
         iter = emplace_result.first;
@@ -541,6 +629,7 @@ auto GpuContext::find_or_add_temporal_image(daxa::ImageInfo const &info) -> Temp
 void GpuContext::remove_temporal_buffer(std::string const &id) {
     auto iter = temporal_buffers.find(id);
     if (iter != temporal_buffers.end()) {
+        untrack_gpu_buffer(memory_ledger, iter->second.resource_id);
         device.destroy_buffer(iter->second.resource_id);
         temporal_buffers.erase(iter);
     }
@@ -549,6 +638,7 @@ void GpuContext::remove_temporal_buffer(std::string const &id) {
 void GpuContext::remove_temporal_image(std::string const &id) {
     auto iter = temporal_images.find(id);
     if (iter != temporal_images.end()) {
+        untrack_gpu_image(memory_ledger, iter->second.resource_id);
         device.destroy_image(iter->second.resource_id);
         temporal_images.erase(iter);
     }
@@ -561,3 +651,48 @@ void GpuContext::remove_temporal_buffer(daxa::BufferId id) {
 void GpuContext::remove_temporal_image(daxa::ImageId id) {
     remove_temporal_image(std::string{device.info_image(id).value().name.view()});
 }
+
+auto GpuContext::reload_pipeline(std::string_view name) -> uint32_t {
+    auto const has_exact_match = compute_pipelines.contains(std::string{name}) ||
+                                 ray_tracing_pipelines.contains(std::string{name}) ||
+                                 raster_pipelines.contains(std::string{name});
+    auto const matches = [&](std::string const &shader_id) {
+        return has_exact_match ? shader_id == name : shader_id.starts_with(name);
+    };
+    auto result = 0u;
+    result += static_cast<uint32_t>(std::erase_if(compute_pipelines, [&](auto const &entry) {
+        if (!matches(entry.first)) {
+            return false;
+        }
+        if (entry.second->is_valid()) {
+            pipeline_manager->remove_compute_pipeline(entry.second->pipeline);
+        }
+        return true;
+    }));
+    result += static_cast<uint32_t>(std::erase_if(ray_tracing_pipelines, [&](auto const &entry) { return matches(entry.first); }));
+    result += static_cast<uint32_t>(std::erase_if(raster_pipelines, [&](auto const &entry) {
+        if (!matches(entry.first)) {
+            return false;
+        }
+        if (entry.second->is_valid()) {
+            pipeline_manager->remove_raster_pipeline(entry.second->pipeline);
+        }
+        return true;
+    }));
+    return result;
+}
+
+auto GpuContext::pipeline_names() const -> std::vector<std::string> {
+    auto result = std::vector<std::string>{};
+    for (auto const &[shader_id, pipeline] : compute_pipelines) {
+        result.push_back(shader_id);
+    }
+    for (auto const &[shader_id, pipeline] : ray_tracing_pipelines) {
+        result.push_back(shader_id);
+    }
+    for (auto const &[shader_id, pipeline] : raster_pipelines) {
+        result.push_back(shader_id);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
@@ -3,7 +3,10 @@
 #include <daxa/daxa.hpp>
 #include <daxa/utils/task_graph.hpp>
 #include "async_pipeline_manager.hpp"
+#include "gpu_memory.hpp"
 #include "gpu_task.hpp"
+#include "noise_cache.hpp"
+#include "upload_ring.hpp"
 
 struct TemporalBuffer {
     daxa::BufferId resource_id;
@@ -14,6 +17,58 @@ struct TemporalImage {
     daxa::TaskImage task_resource;
 };
 
+// Tracks what the device allocates for a resource, which includes its alignment and padding. Ids
+// that are empty are ignored, and so are those that aren't tracked when they're untracked.
+void track_gpu_buffer(GpuMemoryLedger &ledger, daxa::Device &device, daxa::BufferId buffer, GpuMemoryTag const &tag);
+void track_gpu_image(GpuMemoryLedger &ledger, daxa::Device &device, daxa::ImageId image, GpuMemoryTag const &tag);
+void untrack_gpu_buffer(GpuMemoryLedger &ledger, daxa::BufferId buffer);
+void untrack_gpu_image(GpuMemoryLedger &ledger, daxa::ImageId image);
+void track_gpu_tlas(GpuMemoryLedger &ledger, daxa::Device &device, daxa::TlasId tlas, GpuMemoryTag const &tag);
+void untrack_gpu_tlas(GpuMemoryLedger &ledger, daxa::TlasId tlas);
+// For buffers that the memory requirements of have to be known before they're created, to ask the
+// ledger for headroom.
+auto gpu_buffer_allocation_size(daxa::Device &device, daxa::BufferInfo const &info) -> uint64_t;
+
+struct UploadAllocation {
+    daxa::BufferId buffer;
+    size_t offset;
+    uint8_t *host_ptr;
+
+    template <typename T>
+    auto as() const -> T * { return reinterpret_cast<T *>(host_ptr); }
+};
+
+// A persistent host-visible buffer that the data copied to the GPU every frame is sub-allocated
+// from, instead of each upload creating and destroying a staging buffer of its own. Allocations
+// live until the frames in flight are done with them. The ones that don't fit get a buffer of
+// their own, which is destroyed on the same schedule.
+struct GpuUploadRing {
+    static constexpr size_t DEFAULT_CAPACITY = size_t{64} << 20;
+    static constexpr size_t DEFAULT_ALIGNMENT = 16;
+
+    daxa::Device device;
+    GpuMemoryLedger *memory_ledger = nullptr;
+    daxa::BufferId buffer;
+    uint8_t *host_ptr = nullptr;
+    UploadRing ring;
+    struct OverflowBuffer {
+        daxa::BufferId buffer;
+        uint64_t frame;
+    };
+    std::deque<OverflowBuffer> overflow_buffers;
+    uint64_t frame_index = 0;
+
+    void create(daxa::Device &a_device, GpuMemoryLedger &a_memory_ledger, size_t capacity = DEFAULT_CAPACITY);
+    // Only call this once the device is idle.
+    void destroy();
+    // Call once a frame, after acquiring the swapchain image, which is when the frames before the
+    // ones in flight are known to be done. Every allocation until end_frame() belongs to the frame.
+    void begin_frame(uint64_t a_frame_index);
+    void end_frame();
+    // The returned bytes may be written until the work that reads them is submitted.
+    auto allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT) -> UploadAllocation;
+};
+
 using TemporalBuffers = std::unordered_map<std::string, TemporalBuffer>;
 using TemporalImages = std::unordered_map<std::string, TemporalImage>;
 
@@ -35,6 +90,7 @@ struct GpuContext {
     daxa::BufferId input_buffer;
     daxa::BufferId output_buffer;
     daxa::BufferId staging_output_buffer;
+    GpuUploadRing upload_ring;
 
     daxa::SamplerId sampler_nnc;
     daxa::SamplerId sampler_lnc;
@@ -53,8 +109,13 @@ struct GpuContext {
     daxa::TaskBuffer task_staging_output_buffer{{.name = "task_staging_output_buffer"}};
 
     std::shared_ptr<AsyncPipelineManager> pipeline_manager;
+    NoiseCache noise_cache{.folder = ".out/noise_cache"};
     TemporalBuffers temporal_buffers;
     TemporalImages temporal_images;
+    GpuMemoryLedger memory_ledger;
+    // What the temporal resources that are created now are tracked as. Set it with a
+    // GpuMemoryTagScope around the code that creates them.
+    GpuMemoryTag memory_tag{};
 
     daxa::TaskGraph startup_task_graph;
     daxa::TaskGraph frame_task_graph;
@@ -66,9 +127,13 @@ struct GpuContext {
 
     void create_swapchain(daxa::SwapchainInfo const &info);
 
-    void use_resources();
+    // Registers the resources every task graph may use with `task_graph`, which is either the
+    // startup or the frame task graph.
+    void use_resources(daxa::TaskGraph &task_graph);
     void update_seeded_value_noise(uint64_t seed);
 
+    // Resources that are created are tracked with `memory_tag`. They're still created if they don't
+    // fit into its budget, since what needs them can't do without, but that's logged.
     auto find_or_add_temporal_buffer(daxa::BufferInfo const &info) -> TemporalBuffer;
     auto find_or_add_temporal_image(daxa::ImageInfo const &info) -> TemporalImage;
     void remove_temporal_buffer(std::string const &id);
@@ -76,6 +141,11 @@ struct GpuContext {
     void remove_temporal_buffer(daxa::BufferId id);
     void remove_temporal_image(daxa::ImageId id);
 
+    // Drops the pipelines whose shader id is `name` (or, if there is none, starts with it), so that
+    // they are compiled again the next time the task graph is recorded. Returns how many there were.
+    auto reload_pipeline(std::string_view name) -> uint32_t;
+    auto pipeline_names() const -> std::vector<std::string>;
+
     std::unordered_map<std::string, std::shared_ptr<AsyncManagedComputePipeline>> compute_pipelines;
     std::unordered_map<std::string, std::shared_ptr<AsyncManagedRayTracingPipeline>> ray_tracing_pipelines;
     std::unordered_map<std::string, std::shared_ptr<AsyncManagedRasterPipeline>> raster_pipelines;
@@ -0,0 +1,184 @@
+#include "gpu_memory.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+    constexpr auto CATEGORY_NAMES = std::array<std::string_view, static_cast<size_t>(GpuMemoryCategory::COUNT)>{
+        "voxels",
+        "acceleration_structures",
+        "particles",
+        "render_targets",
+        "renderer_caches",
+        "textures",
+        "uploads",
+        "task_graph_transients",
+        "misc",
+    };
+
+    auto megabytes(uint64_t bytes) -> double {
+        return static_cast<double>(bytes) / 1'000'000.0;
+    }
+} // namespace
+
+auto gpu_memory_category_name(GpuMemoryCategory category) -> std::string_view {
+    if (category >= GpuMemoryCategory::COUNT) {
+        return "unknown";
+    }
+    return CATEGORY_NAMES[static_cast<size_t>(category)];
+}
+
+auto gpu_memory_lifetime_name(GpuMemoryLifetime lifetime) -> std::string_view {
+    switch (lifetime) {
+    case GpuMemoryLifetime::PERSISTENT: return "persistent";
+    case GpuMemoryLifetime::PER_RECORDING: return "per_recording";
+    case GpuMemoryLifetime::PER_FRAME: return "per_frame";
+    }
+    return "unknown";
+}
+
+auto gpu_memory_resource_kind_name(GpuMemoryResourceKind kind) -> std::string_view {
+    switch (kind) {
+    case GpuMemoryResourceKind::BUFFER: return "buffer";
+    case GpuMemoryResourceKind::IMAGE: return "image";
+    case GpuMemoryResourceKind::ACCELERATION_STRUCTURE: return "acceleration_structure";
+    case GpuMemoryResourceKind::OTHER: return "other";
+    }
+    return "unknown";
+}
+
+auto gpu_memory_category_from_name(std::string_view name) -> GpuMemoryCategory {
+    for (size_t category_i = 0; category_i < CATEGORY_NAMES.size(); ++category_i) {
+        auto const &category_name = CATEGORY_NAMES[category_i];
+        auto const equal = std::equal(name.begin(), name.end(), category_name.begin(), category_name.end(), [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == b;
+        });
+        if (equal) {
+            return static_cast<GpuMemoryCategory>(category_i);
+        }
+    }
+    return GpuMemoryCategory::COUNT;
+}
+
+void GpuMemoryLedger::track(GpuMemoryResourceKind kind, uint64_t id, std::string name, GpuMemoryTag tag, uint64_t size) {
+    untrack(kind, id);
+    auto &category = categories[static_cast<size_t>(tag.category)];
+    category.current_bytes += size;
+    category.peak_bytes = std::max(category.peak_bytes, category.current_bytes);
+    ++category.allocation_n;
+    current_bytes += size;
+    peak_bytes = std::max(peak_bytes, current_bytes);
+    allocations.insert_or_assign({kind, id}, GpuMemoryAllocation{.kind = kind, .name = std::move(name), .tag = std::move(tag), .size = size});
+    ++revision;
+}
+
+auto GpuMemoryLedger::untrack(GpuMemoryResourceKind kind, uint64_t id) -> bool {
+    auto iter = allocations.find({kind, id});
+    if (iter == allocations.end()) {
+        return false;
+    }
+    auto &category = categories[static_cast<size_t>(iter->second.tag.category)];
+    category.current_bytes -= iter->second.size;
+    --category.allocation_n;
+    current_bytes -= iter->second.size;
+    allocations.erase(iter);
+    ++revision;
+    return true;
+}
+
+auto GpuMemoryLedger::find(GpuMemoryResourceKind kind, uint64_t id) const -> GpuMemoryAllocation const * {
+    auto iter = allocations.find({kind, id});
+    return iter == allocations.end() ? nullptr : &iter->second;
+}
+
+void GpuMemoryLedger::set_budget(GpuMemoryCategory category, uint64_t budget_bytes) {
+    categories[static_cast<size_t>(category)].budget_bytes = budget_bytes;
+    ++revision;
+}
+
+void GpuMemoryLedger::set_total_budget(uint64_t budget_bytes) {
+    total_budget_bytes = budget_bytes;
+    ++revision;
+}
+
+auto GpuMemoryLedger::headroom(GpuMemoryCategory category) const -> uint64_t {
+    auto const remaining = [](uint64_t budget, uint64_t used) {
+        if (budget == 0) {
+            return UNLIMITED;
+        }
+        return budget > used ? budget - used : 0;
+    };
+    auto const &usage = categories[static_cast<size_t>(category)];
+    return std::min(remaining(usage.budget_bytes, usage.current_bytes), remaining(total_budget_bytes, current_bytes));
+}
+
+auto GpuMemoryLedger::can_grow(GpuMemoryCategory category, uint64_t extra_bytes) -> bool {
+    if (extra_bytes <= headroom(category)) {
+        return true;
+    }
+    ++categories[static_cast<size_t>(category)].denied_growth_n;
+    return false;
+}
+
+auto gpu_heap_growth_count(uint64_t headroom_bytes, uint64_t bytes_per_element, uint64_t required_n, uint64_t preferred_n) -> uint64_t {
+    return std::max(std::min(preferred_n, headroom_bytes / std::max<uint64_t>(bytes_per_element, 1)), required_n);
+}
+
+auto GpuMemoryLedger::snapshot() const -> GpuMemorySnapshot {
+    auto result = GpuMemorySnapshot{
+        .categories = {},
+        .owners = {},
+        .allocations = {},
+        .current_bytes = current_bytes,
+        .peak_bytes = peak_bytes,
+        .budget_bytes = total_budget_bytes,
+    };
+    for (size_t category_i = 0; category_i < categories.size(); ++category_i) {
+        auto const &usage = categories[category_i];
+        result.categories.push_back({
+            .category = static_cast<GpuMemoryCategory>(category_i),
+            .current_bytes = usage.current_bytes,
+            .peak_bytes = usage.peak_bytes,
+            .budget_bytes = usage.budget_bytes,
+            .allocation_n = usage.allocation_n,
+            .denied_growth_n = usage.denied_growth_n,
+        });
+    }
+    result.allocations.reserve(allocations.size());
+    for (auto const &[key, allocation] : allocations) {
+        result.allocations.push_back(allocation);
+        auto owner = std::find_if(result.owners.begin(), result.owners.end(), [&allocation](auto const &o) { return o.owner == allocation.tag.owner; });
+        if (owner == result.owners.end()) {
+            owner = result.owners.insert(result.owners.end(), {.owner = allocation.tag.owner, .bytes = 0, .allocation_n = 0});
+        }
+        owner->bytes += allocation.size;
+        ++owner->allocation_n;
+    }
+    std::sort(result.owners.begin(), result.owners.end(), [](auto const &a, auto const &b) { return a.bytes > b.bytes; });
+    std::sort(result.allocations.begin(), result.allocations.end(), [](auto const &a, auto const &b) { return a.size > b.size; });
+    return result;
+}
+
+auto GpuMemorySnapshot::report_lines() const -> std::vector<std::string> {
+    auto result = std::vector<std::string>{};
+    auto const budget_string = [](uint64_t budget) {
+        return budget == 0 ? std::string{"-"} : fmt::format("{:.1f}", megabytes(budget));
+    };
+    result.push_back(fmt::format("{:<24} {:>10} {:>10} {:>10} {:>7} {:>7}", "category", "MB", "peak MB", "budget MB", "count", "denied"));
+    for (auto const &category : categories) {
+        if (category.peak_bytes == 0 && category.budget_bytes == 0) {
+            continue;
+        }
+        result.push_back(fmt::format("{:<24} {:>10.1f} {:>10.1f} {:>10} {:>7} {:>7}", gpu_memory_category_name(category.category),
+                                     megabytes(category.current_bytes), megabytes(category.peak_bytes), budget_string(category.budget_bytes),
+                                     category.allocation_n, category.denied_growth_n));
+    }
+    result.push_back(fmt::format("{:<24} {:>10.1f} {:>10.1f} {:>10}", "total", megabytes(current_bytes), megabytes(peak_bytes), budget_string(budget_bytes)));
+    result.push_back(fmt::format("{:<24} {:>10} {:>7}", "owner", "MB", "count"));
+    for (auto const &owner : owners) {
+        result.push_back(fmt::format("{:<24} {:>10.1f} {:>7}", owner.owner, megabytes(owner.bytes), owner.allocation_n));
+    }
+    return result;
+}
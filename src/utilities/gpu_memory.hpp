@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum struct GpuMemoryCategory {
+    VOXELS,
+    ACCELERATION_STRUCTURES,
+    PARTICLES,
+    RENDER_TARGETS,
+    RENDERER_CACHES,
+    TEXTURES,
+    UPLOADS,
+    TASK_GRAPH_TRANSIENTS,
+    MISC,
+    COUNT,
+};
+
+enum struct GpuMemoryLifetime {
+    // Lives until the app exits, or until the system that owns it grows it.
+    PERSISTENT,
+    // Created while recording the task graphs, and may be replaced by the next recording.
+    PER_RECORDING,
+    // Released once the frames in flight are done with it.
+    PER_FRAME,
+};
+
+enum struct GpuMemoryResourceKind {
+    BUFFER,
+    IMAGE,
+    // A TLAS, whose memory daxa allocates itself. BLASes live in buffers of their own.
+    ACCELERATION_STRUCTURE,
+    // Memory the ledger can't see being allocated, like the transients of a task graph.
+    OTHER,
+};
+
+auto gpu_memory_category_name(GpuMemoryCategory category) -> std::string_view;
+auto gpu_memory_lifetime_name(GpuMemoryLifetime lifetime) -> std::string_view;
+auto gpu_memory_resource_kind_name(GpuMemoryResourceKind kind) -> std::string_view;
+// Case-insensitive, so that the console can take "voxels". Returns COUNT for unknown names.
+auto gpu_memory_category_from_name(std::string_view name) -> GpuMemoryCategory;
+
+struct GpuMemoryTag {
+    std::string owner = "gpu_context";
+    GpuMemoryCategory category = GpuMemoryCategory::MISC;
+    GpuMemoryLifetime lifetime = GpuMemoryLifetime::PERSISTENT;
+};
+
+// Sets the tag that the resources created while it lives are tracked with, and puts the previous
+// one back when it goes out of scope.
+struct GpuMemoryTagScope {
+    GpuMemoryTag &current;
+    GpuMemoryTag previous;
+
+    GpuMemoryTagScope(GpuMemoryTag &a_current, GpuMemoryTag tag) : current{a_current}, previous{std::move(a_current)} {
+        current = std::move(tag);
+    }
+    ~GpuMemoryTagScope() { current = std::move(previous); }
+    GpuMemoryTagScope(GpuMemoryTagScope const &) = delete;
+    GpuMemoryTagScope &operator=(GpuMemoryTagScope const &) = delete;
+};
+
+struct GpuMemoryAllocation {
+    GpuMemoryResourceKind kind;
+    std::string name;
+    GpuMemoryTag tag;
+    uint64_t size;
+};
+
+struct GpuMemorySnapshot {
+    struct Category {
+        GpuMemoryCategory category;
+        uint64_t current_bytes;
+        uint64_t peak_bytes;
+        // 0 means unlimited.
+        uint64_t budget_bytes;
+        uint32_t allocation_n;
+        uint64_t denied_growth_n;
+    };
+    struct Owner {
+        std::string owner;
+        uint64_t bytes;
+        uint32_t allocation_n;
+    };
+
+    std::vector<Category> categories;
+    // Largest first, like the allocations.
+    std::vector<Owner> owners;
+    std::vector<GpuMemoryAllocation> allocations;
+    uint64_t current_bytes;
+    uint64_t peak_bytes;
+    uint64_t budget_bytes;
+
+    // One line per category, then the owners, for the console.
+    auto report_lines() const -> std::vector<std::string>;
+};
+
+// CPU-side record of every GPU allocation the engine makes, tagged with who owns it, what it's
+// for and how long it lives, with the current and peak bytes of each category. Systems that grow
+// their buffers ask it for headroom first, so that budgets set here (none by default) are kept by
+// those that can refuse to grow. GPU heaps can't, see gpu_heap_growth_count().
+// Sizes are what the caller says the device allocated; GpuContext tracks the memory requirements
+// daxa reports, so alignment and padding are included.
+struct GpuMemoryLedger {
+    static constexpr uint64_t UNLIMITED = ~uint64_t{0};
+
+    struct CategoryUsage {
+        uint64_t current_bytes = 0;
+        uint64_t peak_bytes = 0;
+        uint64_t budget_bytes = 0;
+        uint32_t allocation_n = 0;
+        uint64_t denied_growth_n = 0;
+    };
+
+    std::map<std::pair<GpuMemoryResourceKind, uint64_t>, GpuMemoryAllocation> allocations;
+    std::array<CategoryUsage, static_cast<size_t>(GpuMemoryCategory::COUNT)> categories{};
+    uint64_t current_bytes = 0;
+    uint64_t peak_bytes = 0;
+    uint64_t total_budget_bytes = 0;
+    // Increases whenever anything is tracked or untracked, so that views of it know to update.
+    uint64_t revision = 0;
+
+    // Tracking an id that's already tracked replaces it, which is how OTHER allocations change size.
+    void track(GpuMemoryResourceKind kind, uint64_t id, std::string name, GpuMemoryTag tag, uint64_t size);
+    // Returns whether the id was tracked.
+    auto untrack(GpuMemoryResourceKind kind, uint64_t id) -> bool;
+    auto find(GpuMemoryResourceKind kind, uint64_t id) const -> GpuMemoryAllocation const *;
+
+    auto usage(GpuMemoryCategory category) const -> CategoryUsage const & { return categories[static_cast<size_t>(category)]; }
+    // 0 means unlimited. Lowering a budget below what's in use doesn't release anything, it only
+    // stops the category from growing where that can be refused.
+    void set_budget(GpuMemoryCategory category, uint64_t budget_bytes);
+    void set_total_budget(uint64_t budget_bytes);
+    // Bytes the category may still allocate within both its budget and the total one, or UNLIMITED.
+    auto headroom(GpuMemoryCategory category) const -> uint64_t;
+    // Whether `extra_bytes` more fit into the headroom. Denials are counted per category.
+    auto can_grow(GpuMemoryCategory category, uint64_t extra_bytes) -> bool;
+
+    auto snapshot() const -> GpuMemorySnapshot;
+};
+
+// Elements a GPU heap grows to. Its shaders (allocator.glsl) can't refuse an allocation, so it always
+// fits the `required_n` elements the GPU may allocate until the CPU catches up, even past the budget.
+// The headroom only limits the extra room toward `preferred_n`.
+auto gpu_heap_growth_count(uint64_t headroom_bytes, uint64_t bytes_per_element, uint64_t required_n, uint64_t preferred_n) -> uint64_t;
@@ -0,0 +1,356 @@
+#include <utilities/gpu_memory.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <optional>
+#include <random>
+
+namespace {
+    constexpr uint32_t MOCK_OP_N = 200000;
+
+    // Drives a ledger from a mock allocator that rounds sizes up like a device would, with systems
+    // of every category that create, grow (asking for headroom first, and refusing to grow past it)
+    // and release resources while their budgets change, and checks the usage, peaks and budgets
+    // against what the mock allocator kept track of.
+    auto check_mock_allocator(uint32_t seed) -> std::string {
+        auto rng = std::mt19937_64{seed};
+        auto const random_below = [&rng](uint64_t n) { return std::uniform_int_distribution<uint64_t>{0, n - 1}(rng); };
+
+        // Hands out ids that use all 64 bits, like daxa's index and version, and rounds sizes up to
+        // the alignment a device would.
+        struct MockAllocation {
+            GpuMemoryResourceKind kind;
+            uint64_t id;
+            uint32_t system_i;
+            uint64_t size;
+        };
+        auto next_index = uint64_t{1};
+        auto const mock_allocate = [&](GpuMemoryResourceKind kind, uint32_t system_i, uint64_t requested_size) {
+            auto const alignment = kind == GpuMemoryResourceKind::IMAGE ? uint64_t{64} << 10 : uint64_t{256};
+            auto const id = (random_below(uint64_t{1} << 44) << 20) | (next_index++ & 0xfffff);
+            return MockAllocation{.kind = kind, .id = id, .system_i = system_i, .size = (requested_size + alignment - 1) / alignment * alignment};
+        };
+
+        struct System {
+            GpuMemoryTag tag;
+            // Grows one buffer by asking for headroom first, like the voxel heap. The others only
+            // create and release resources of fixed sizes.
+            bool grows;
+            std::vector<MockAllocation> live;
+        };
+        auto systems = std::vector<System>{};
+        for (size_t category_i = 0; category_i < static_cast<size_t>(GpuMemoryCategory::COUNT); ++category_i) {
+            auto const category = static_cast<GpuMemoryCategory>(category_i);
+            for (auto const grows : {false, true}) {
+                systems.push_back({
+                    .tag = {.owner = fmt::format("{}_{}", gpu_memory_category_name(category), grows ? "heap" : "fixed"), .category = category, .lifetime = grows ? GpuMemoryLifetime::PERSISTENT : GpuMemoryLifetime::PER_RECORDING},
+                    .grows = grows,
+                    .live = {},
+                });
+            }
+        }
+
+        // What the ledger should say, kept track of here.
+        struct ExpectedCategory {
+            uint64_t current_bytes = 0;
+            uint64_t peak_bytes = 0;
+            uint32_t allocation_n = 0;
+        };
+        auto expected = std::array<ExpectedCategory, static_cast<size_t>(GpuMemoryCategory::COUNT)>{};
+        auto expected_bytes = uint64_t{0};
+        auto expected_peak_bytes = uint64_t{0};
+        auto denied_growth_n = uint64_t{0};
+        // Old buffers of a growth, released a few operations later like a deferred destroy.
+        auto deferred = std::vector<MockAllocation>{};
+        auto transient_size = std::optional<uint64_t>{};
+
+        auto ledger = GpuMemoryLedger{};
+        auto const add_expected = [&](GpuMemoryCategory category, uint64_t size) {
+            auto &e = expected[static_cast<size_t>(category)];
+            e.current_bytes += size;
+            e.peak_bytes = std::max(e.peak_bytes, e.current_bytes);
+            ++e.allocation_n;
+            expected_bytes += size;
+            expected_peak_bytes = std::max(expected_peak_bytes, expected_bytes);
+        };
+        auto const remove_expected = [&](GpuMemoryCategory category, uint64_t size) {
+            auto &e = expected[static_cast<size_t>(category)];
+            e.current_bytes -= size;
+            --e.allocation_n;
+            expected_bytes -= size;
+        };
+        auto const create = [&](uint32_t system_i, GpuMemoryResourceKind kind, uint64_t requested_size) {
+            auto &system = systems[system_i];
+            auto const allocation = mock_allocate(kind, system_i, requested_size);
+            ledger.track(allocation.kind, allocation.id, fmt::format("{}_{}", system.tag.owner, system.live.size()), system.tag, allocation.size);
+            add_expected(system.tag.category, allocation.size);
+            system.live.push_back(allocation);
+        };
+        auto const release = [&](MockAllocation const &allocation) {
+            if (!ledger.untrack(allocation.kind, allocation.id)) {
+                return false;
+            }
+            remove_expected(systems[allocation.system_i].tag.category, allocation.size);
+            return true;
+        };
+
+        for (uint32_t op_i = 0; op_i < MOCK_OP_N; ++op_i) {
+            auto const op = random_below(100);
+            auto const system_i = static_cast<uint32_t>(random_below(systems.size()));
+            auto &system = systems[system_i];
+            auto const category = system.tag.category;
+            auto op_name = std::string_view{};
+            if (op < 35) {
+                op_name = "create";
+                if (!system.grows && system.live.size() < 64) {
+                    auto const kind = random_below(2) == 0 ? GpuMemoryResourceKind::BUFFER : GpuMemoryResourceKind::IMAGE;
+                    create(system_i, kind, 1 + random_below(uint64_t{4} << 20));
+                }
+            } else if (op < 55) {
+                op_name = "grow";
+                if (system.grows) {
+                    // Both buffers are alive while the contents are copied, so the new one has to
+                    // fit next to the old.
+                    auto const old_size = system.live.empty() ? uint64_t{0} : system.live.back().size;
+                    // Starts over once it's large, like a heap that was cleared by loading another world.
+                    auto const grown_size = old_size < (uint64_t{256} << 20) ? old_size * 3 / 2 : 0;
+                    auto const requested_size = std::max<uint64_t>(grown_size, 1 + random_below(uint64_t{1} << 20));
+                    auto const new_size = mock_allocate(GpuMemoryResourceKind::BUFFER, system_i, requested_size).size;
+                    if (!ledger.can_grow(category, new_size)) {
+                        ++denied_growth_n;
+                    } else {
+                        auto const &usage = ledger.usage(category);
+                        create(system_i, GpuMemoryResourceKind::BUFFER, requested_size);
+                        if ((usage.budget_bytes != 0 && usage.current_bytes > usage.budget_bytes) ||
+                            (ledger.total_budget_bytes != 0 && ledger.current_bytes > ledger.total_budget_bytes)) {
+                            return fmt::format("op {}: growing {} by {} bytes was allowed, but went over its budget ({} of {} bytes, {} of {} in total)", op_i, system.tag.owner, new_size,
+                                               usage.current_bytes, usage.budget_bytes, ledger.current_bytes, ledger.total_budget_bytes);
+                        }
+                        if (system.live.size() > 1) {
+                            deferred.push_back(system.live.front());
+                            system.live.erase(system.live.begin());
+                        }
+                    }
+                }
+            } else if (op < 80) {
+                op_name = "release";
+                if (!system.live.empty() && !system.grows) {
+                    auto const live_i = random_below(system.live.size());
+                    if (!release(system.live[live_i])) {
+                        return fmt::format("op {}: {} wasn't tracked when it was released", op_i, system.tag.owner);
+                    }
+                    system.live.erase(system.live.begin() + static_cast<ptrdiff_t>(live_i));
+                }
+            } else if (op < 87) {
+                op_name = "collect";
+                for (auto const &allocation : deferred) {
+                    release(allocation);
+                }
+                deferred.clear();
+            } else if (op < 93) {
+                op_name = "budget";
+                auto const budget = random_below(3) == 0 ? uint64_t{0} : random_below(uint64_t{64} << 20);
+                if (random_below(4) == 0) {
+                    ledger.set_total_budget(budget == 0 ? 0 : budget * 8);
+                } else {
+                    ledger.set_budget(category, budget);
+                }
+            } else if (op < 99) {
+                // Re-tracking the same id changes its size.
+                op_name = "transients";
+                auto const new_transient_size = random_below(uint64_t{32} << 20);
+                ledger.track(GpuMemoryResourceKind::OTHER, 0, "transients", {.owner = "task_graph", .category = GpuMemoryCategory::TASK_GRAPH_TRANSIENTS, .lifetime = GpuMemoryLifetime::PER_RECORDING}, new_transient_size);
+                if (transient_size) {
+                    remove_expected(GpuMemoryCategory::TASK_GRAPH_TRANSIENTS, *transient_size);
+                }
+                add_expected(GpuMemoryCategory::TASK_GRAPH_TRANSIENTS, new_transient_size);
+                transient_size = new_transient_size;
+            } else {
+                op_name = "untrack unknown";
+                if (ledger.untrack(GpuMemoryResourceKind::IMAGE, ~uint64_t{0})) {
+                    return fmt::format("op {}: an id that was never tracked was untracked", op_i);
+                }
+            }
+
+            if (ledger.current_bytes != expected_bytes || ledger.peak_bytes != expected_peak_bytes) {
+                return fmt::format("op {} ({}): the ledger has {} bytes (peak {}), but {} (peak {}) are allocated", op_i, op_name, ledger.current_bytes, ledger.peak_bytes, expected_bytes, expected_peak_bytes);
+            }
+            for (size_t category_i = 0; category_i < expected.size(); ++category_i) {
+                auto const &usage = ledger.categories[category_i];
+                auto const &e = expected[category_i];
+                if (usage.current_bytes != e.current_bytes || usage.peak_bytes != e.peak_bytes || usage.allocation_n != e.allocation_n) {
+                    return fmt::format("op {} ({}): the ledger has {} bytes (peak {}) in {} allocations of {}, but {} (peak {}) in {} are allocated",
+                                       op_i, op_name, usage.current_bytes, usage.peak_bytes, usage.allocation_n, gpu_memory_category_name(static_cast<GpuMemoryCategory>(category_i)),
+                                       e.current_bytes, e.peak_bytes, e.allocation_n);
+                }
+            }
+        }
+
+        auto const snapshot = ledger.snapshot();
+        auto category_bytes = uint64_t{0};
+        auto snapshot_denied_growth_n = uint64_t{0};
+        for (auto const &category : snapshot.categories) {
+            category_bytes += category.current_bytes;
+            snapshot_denied_growth_n += category.denied_growth_n;
+        }
+        auto owner_bytes = uint64_t{0};
+        for (auto const &owner : snapshot.owners) {
+            owner_bytes += owner.bytes;
+        }
+        if (category_bytes != snapshot.current_bytes || owner_bytes != snapshot.current_bytes || snapshot.allocations.size() != ledger.allocations.size()) {
+            return fmt::format("the snapshot's categories add up to {} bytes and its owners to {}, of {}", category_bytes, owner_bytes, snapshot.current_bytes);
+        }
+        if (snapshot_denied_growth_n != denied_growth_n) {
+            return fmt::format("the ledger counted {} denied growths, but {} were denied", snapshot_denied_growth_n, denied_growth_n);
+        }
+        if (denied_growth_n == 0) {
+            return "no growth was ever denied, so the budgets weren't exercised";
+        }
+        return {};
+    }
+
+    auto test_mock_allocator() -> std::string {
+        for (auto const seed : {0u, 1u, 2u, 3u}) {
+            if (auto error = check_mock_allocator(seed); !error.empty()) {
+                return fmt::format("{} (seed {})", error, seed);
+            }
+        }
+        return {};
+    }
+
+    auto test_headroom() -> std::string {
+        auto ledger = GpuMemoryLedger{};
+        auto const tag = GpuMemoryTag{.owner = "voxel_world", .category = GpuMemoryCategory::VOXELS, .lifetime = GpuMemoryLifetime::PERSISTENT};
+        ledger.track(GpuMemoryResourceKind::BUFFER, 1, "heap", tag, 600);
+        if (ledger.headroom(GpuMemoryCategory::VOXELS) != GpuMemoryLedger::UNLIMITED) {
+            return "a category without budgets has limited headroom";
+        }
+        ledger.set_budget(GpuMemoryCategory::VOXELS, 1000);
+        if (ledger.headroom(GpuMemoryCategory::VOXELS) != 400) {
+            return fmt::format("expected 400 bytes of headroom under a budget of 1000, got {}", ledger.headroom(GpuMemoryCategory::VOXELS));
+        }
+        // The total budget is shared with the other categories.
+        ledger.track(GpuMemoryResourceKind::IMAGE, 1, "noise", {.owner = "gpu_context", .category = GpuMemoryCategory::TEXTURES, .lifetime = GpuMemoryLifetime::PERSISTENT}, 300);
+        ledger.set_total_budget(1100);
+        if (ledger.headroom(GpuMemoryCategory::VOXELS) != 200 || ledger.headroom(GpuMemoryCategory::PARTICLES) != 200) {
+            return fmt::format("expected 200 bytes of headroom under a total budget of 1100, got {} and {}", ledger.headroom(GpuMemoryCategory::VOXELS), ledger.headroom(GpuMemoryCategory::PARTICLES));
+        }
+        if (!ledger.can_grow(GpuMemoryCategory::VOXELS, 200) || ledger.can_grow(GpuMemoryCategory::VOXELS, 201)) {
+            return "can_grow() doesn't agree with the headroom";
+        }
+        // Lowering a budget below what's in use only stops growth.
+        ledger.set_budget(GpuMemoryCategory::VOXELS, 100);
+        if (ledger.headroom(GpuMemoryCategory::VOXELS) != 0 || ledger.usage(GpuMemoryCategory::VOXELS).current_bytes != 600) {
+            return "a budget below what's in use changed the usage, or left headroom";
+        }
+        if (ledger.usage(GpuMemoryCategory::VOXELS).denied_growth_n != 1) {
+            return fmt::format("expected 1 denied growth, got {}", ledger.usage(GpuMemoryCategory::VOXELS).denied_growth_n);
+        }
+        return {};
+    }
+
+    // A GPU heap whose growth is denied grows anyway, by what the GPU may allocate, like
+    // AllocatorBufferState does.
+    auto test_heap_growth_past_budget() -> std::string {
+        auto ledger = GpuMemoryLedger{};
+        auto const tag = GpuMemoryTag{.owner = "voxel_malloc", .category = GpuMemoryCategory::VOXELS, .lifetime = GpuMemoryLifetime::PERSISTENT};
+        constexpr auto BYTES_PER_ELEMENT = uint64_t{8};
+        ledger.track(GpuMemoryResourceKind::BUFFER, 1, "heap", tag, 600);
+        if (auto const count = gpu_heap_growth_count(ledger.headroom(GpuMemoryCategory::VOXELS), BYTES_PER_ELEMENT, 100, 150); count != 150) {
+            return fmt::format("without a budget, expected the heap to grow to 150 elements, got {}", count);
+        }
+        // Room for 50 elements, more than the 20 required.
+        ledger.set_budget(GpuMemoryCategory::VOXELS, 1000);
+        if (auto const count = gpu_heap_growth_count(ledger.headroom(GpuMemoryCategory::VOXELS), BYTES_PER_ELEMENT, 20, 150); count != 50) {
+            return fmt::format("expected the heap to grow to the 50 elements that fit, got {}", count);
+        }
+        // Less room than required.
+        auto const count = gpu_heap_growth_count(ledger.headroom(GpuMemoryCategory::VOXELS), BYTES_PER_ELEMENT, 100, 150);
+        if (count != 100) {
+            return fmt::format("expected the heap to grow to the 100 required elements past its budget, got {}", count);
+        }
+        if (ledger.can_grow(GpuMemoryCategory::VOXELS, count * BYTES_PER_ELEMENT) || ledger.usage(GpuMemoryCategory::VOXELS).denied_growth_n != 1) {
+            return "growing past the budget wasn't counted as denied";
+        }
+        ledger.track(GpuMemoryResourceKind::BUFFER, 2, "heap", tag, count * BYTES_PER_ELEMENT);
+        if (ledger.usage(GpuMemoryCategory::VOXELS).current_bytes != 1400 || ledger.headroom(GpuMemoryCategory::VOXELS) != 0) {
+            return fmt::format("expected 1400 bytes in use and no headroom, got {} bytes", ledger.usage(GpuMemoryCategory::VOXELS).current_bytes);
+        }
+        // Once over, growth is only by what's required.
+        if (auto const next_count = gpu_heap_growth_count(ledger.headroom(GpuMemoryCategory::VOXELS), BYTES_PER_ELEMENT, 120, 180); next_count != 120) {
+            return fmt::format("expected the heap over its budget to grow to the 120 required elements, got {}", next_count);
+        }
+        return {};
+    }
+
+    auto test_retrack_replaces() -> std::string {
+        auto ledger = GpuMemoryLedger{};
+        auto const tag = GpuMemoryTag{.owner = "task_graph", .category = GpuMemoryCategory::TASK_GRAPH_TRANSIENTS, .lifetime = GpuMemoryLifetime::PER_RECORDING};
+        ledger.track(GpuMemoryResourceKind::OTHER, 0, "transients", tag, 500);
+        ledger.track(GpuMemoryResourceKind::OTHER, 0, "transients", tag, 200);
+        // The same id of another kind is another allocation.
+        ledger.track(GpuMemoryResourceKind::BUFFER, 0, "buffer", tag, 50);
+        auto const &usage = ledger.usage(GpuMemoryCategory::TASK_GRAPH_TRANSIENTS);
+        if (usage.current_bytes != 250 || usage.peak_bytes != 500 || usage.allocation_n != 2 || ledger.allocations.size() != 2) {
+            return fmt::format("expected 250 bytes (peak 500) in 2 allocations, got {} (peak {}) in {}", usage.current_bytes, usage.peak_bytes, usage.allocation_n);
+        }
+        auto const *found = ledger.find(GpuMemoryResourceKind::OTHER, 0);
+        if (found == nullptr || found->size != 200) {
+            return "the re-tracked allocation doesn't have its new size";
+        }
+        auto const revision = ledger.revision;
+        if (!ledger.untrack(GpuMemoryResourceKind::OTHER, 0) || ledger.untrack(GpuMemoryResourceKind::OTHER, 0) || ledger.revision != revision + 1) {
+            return "untracking twice didn't fail the second time, or didn't bump the revision once";
+        }
+        return {};
+    }
+
+    auto test_category_names() -> std::string {
+        for (size_t category_i = 0; category_i < static_cast<size_t>(GpuMemoryCategory::COUNT); ++category_i) {
+            auto const category = static_cast<GpuMemoryCategory>(category_i);
+            auto name = std::string{gpu_memory_category_name(category)};
+            std::transform(name.begin(), name.end(), name.begin(), [](char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); });
+            if (gpu_memory_category_from_name(name) != category) {
+                return fmt::format("'{}' isn't parsed back into its category", name);
+            }
+        }
+        if (gpu_memory_category_from_name("voxel") != GpuMemoryCategory::COUNT) {
+            return "a prefix of a category name was accepted";
+        }
+        return {};
+    }
+
+    auto test_tag_scope() -> std::string {
+        auto current = GpuMemoryTag{};
+        {
+            auto const outer = GpuMemoryTagScope{current, {.owner = "renderer", .category = GpuMemoryCategory::RENDER_TARGETS, .lifetime = GpuMemoryLifetime::PER_RECORDING}};
+            {
+                auto const inner = GpuMemoryTagScope{current, {.owner = "ircache", .category = GpuMemoryCategory::RENDERER_CACHES, .lifetime = GpuMemoryLifetime::PER_RECORDING}};
+                if (current.owner != "ircache") {
+                    return "the inner scope's tag isn't current";
+                }
+            }
+            if (current.owner != "renderer" || current.category != GpuMemoryCategory::RENDER_TARGETS) {
+                return "the outer scope's tag wasn't put back";
+            }
+        }
+        if (current.owner != GpuMemoryTag{}.owner || current.category != GpuMemoryCategory::MISC) {
+            return "the default tag wasn't put back";
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"mock allocator with changing budgets", test_mock_allocator},
+        UnitTestCase{"headroom under category and total budgets", test_headroom},
+        UnitTestCase{"heap growth past the budget", test_heap_growth_past_budget},
+        UnitTestCase{"tracking an id again replaces it", test_retrack_replaces},
+        UnitTestCase{"category names", test_category_names},
+        UnitTestCase{"tag scopes nest", test_tag_scope},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,290 @@
+#include "log.hpp"
+
+#include <utilities/debug.hpp>
+
+#include <fmt/chrono.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    std::atomic<uint64_t> next_logger_generation{1};
+
+    struct ThreadQueueSlot {
+        uint64_t generation = 0;
+        std::shared_ptr<Logger::ThreadQueue> queue;
+
+        ThreadQueueSlot() = default;
+        ThreadQueueSlot(ThreadQueueSlot const &) = delete;
+        ThreadQueueSlot &operator=(ThreadQueueSlot const &) = delete;
+        ~ThreadQueueSlot() {
+            if (queue != nullptr) {
+                queue->is_orphaned.store(true, std::memory_order_release);
+            }
+        }
+    };
+    thread_local ThreadQueueSlot thread_queue_slot;
+} // namespace
+
+auto Logger::ThreadQueue::try_push(LogRecord &&record) -> bool {
+    auto const write_i = write_index.load(std::memory_order_relaxed);
+    if (write_i - read_index.load(std::memory_order_acquire) >= THREAD_QUEUE_CAPACITY) {
+        return false;
+    }
+    records[write_i % THREAD_QUEUE_CAPACITY] = std::move(record);
+    write_index.store(write_i + 1, std::memory_order_release);
+    return true;
+}
+
+void Logger::ThreadQueue::pop_all(std::vector<LogRecord> &out) {
+    auto const read_i = read_index.load(std::memory_order_relaxed);
+    auto const write_i = write_index.load(std::memory_order_acquire);
+    for (auto i = read_i; i < write_i; ++i) {
+        out.push_back(std::move(records[i % THREAD_QUEUE_CAPACITY]));
+    }
+    read_index.store(write_i, std::memory_order_release);
+}
+
+Logger::Logger(std::vector<LogSink> a_sinks)
+    : sinks{std::move(a_sinks)},
+      generation{next_logger_generation.fetch_add(1, std::memory_order_relaxed)} {
+    drain_thread = std::thread{&Logger::drain_thread_main, this};
+    if (s_instance == nullptr) {
+        s_instance = this;
+    }
+}
+
+Logger::~Logger() {
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+    {
+        auto lock = std::lock_guard{drain_mtx};
+        should_stop = true;
+    }
+    drain_cv.notify_one();
+    drain_thread.join();
+}
+
+auto Logger::thread_queue() -> ThreadQueue & {
+    auto &slot = thread_queue_slot;
+    if (slot.generation != generation) {
+        if (slot.queue != nullptr) {
+            slot.queue->is_orphaned.store(true, std::memory_order_release);
+        }
+        slot.generation = generation;
+        slot.queue = std::make_shared<ThreadQueue>();
+        auto lock = std::lock_guard{queues_mtx};
+        queues.push_back(slot.queue);
+    }
+    return *slot.queue;
+}
+
+void Logger::submit(LogLevel level, std::string text) {
+    auto &queue = thread_queue();
+    auto record = LogRecord{
+        .sequence = next_sequence.fetch_add(1, std::memory_order_relaxed),
+        .level = level,
+        .time = std::chrono::system_clock::now(),
+        .text = std::move(text),
+    };
+    auto const must_wait = level >= LogLevel::WARN && std::this_thread::get_id() != drain_thread.get_id();
+    while (!queue.try_push(std::move(record))) {
+        if (!must_wait) {
+            stats.dropped_n.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wake_drain_thread();
+        std::this_thread::yield();
+    }
+    auto const queued_n = queue.write_index.load(std::memory_order_relaxed) - queue.read_index.load(std::memory_order_relaxed);
+    if (level >= LogLevel::WARN || queued_n > THREAD_QUEUE_CAPACITY / 2) {
+        wake_drain_thread();
+    }
+}
+
+void Logger::flush() {
+    if (std::this_thread::get_id() == drain_thread.get_id()) {
+        return;
+    }
+    auto lock = std::unique_lock{drain_mtx};
+    auto const request_n = ++flush_request_n;
+    should_wake = true;
+    is_wake_pending.store(true, std::memory_order_release);
+    drain_cv.notify_one();
+    flushed_cv.wait(lock, [&] { return flushed_request_n >= request_n || should_stop; });
+}
+
+void Logger::wake_drain_thread() {
+    // Skips the lock while a wake-up is already pending, as this can be called for every record.
+    if (is_wake_pending.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    {
+        auto lock = std::lock_guard{drain_mtx};
+        should_wake = true;
+    }
+    drain_cv.notify_one();
+}
+
+void Logger::drain_thread_main() {
+    auto records = std::vector<LogRecord>{};
+    auto lock = std::unique_lock{drain_mtx};
+    while (true) {
+        drain_cv.wait_for(lock, DRAIN_INTERVAL, [this] { return should_wake || should_stop; });
+        should_wake = false;
+        is_wake_pending.store(false, std::memory_order_release);
+        auto const request_n = flush_request_n;
+        auto const stopping = should_stop;
+        lock.unlock();
+        drain(records);
+        lock.lock();
+        flushed_request_n = request_n;
+        flushed_cv.notify_all();
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+void Logger::drain(std::vector<LogRecord> &records) {
+    records.clear();
+    {
+        auto lock = std::lock_guard{queues_mtx};
+        auto queue_iter = queues.begin();
+        while (queue_iter != queues.end()) {
+            auto &queue = **queue_iter;
+            // Checked before popping, so that nothing pushed before the thread exited is missed.
+            auto const is_orphaned = queue.is_orphaned.load(std::memory_order_acquire);
+            queue.pop_all(records);
+            queue_iter = is_orphaned ? queues.erase(queue_iter) : queue_iter + 1;
+        }
+    }
+    std::sort(records.begin(), records.end(), [](LogRecord const &a, LogRecord const &b) { return a.sequence < b.sequence; });
+
+    auto const dropped_n = stats.dropped_n.load(std::memory_order_relaxed);
+    if (dropped_n != reported_dropped_n) {
+        records.push_back(LogRecord{
+            .sequence = records.empty() ? 0 : records.back().sequence,
+            .level = LogLevel::WARN,
+            .time = std::chrono::system_clock::now(),
+            .text = fmt::format("{}Dropped {} log records, as their thread's queue was full", log_level_prefix(LogLevel::WARN), dropped_n - reported_dropped_n),
+        });
+        reported_dropped_n = dropped_n;
+    }
+    if (records.empty()) {
+        return;
+    }
+    for (auto const &sink : sinks) {
+        sink.write(records);
+        if (sink.flush) {
+            sink.flush();
+        }
+    }
+    stats.drained_n.fetch_add(records.size(), std::memory_order_relaxed);
+}
+
+auto make_stdout_log_sink() -> LogSink {
+    auto buffer = std::make_shared<std::string>();
+    return LogSink{
+        .write = [buffer](std::span<LogRecord const> records) {
+            buffer->clear();
+            for (auto const &record : records) {
+                buffer->append(record.text);
+                buffer->push_back('\n');
+            }
+            std::cout.write(buffer->data(), static_cast<std::streamsize>(buffer->size()));
+        },
+        .flush = []() { std::cout.flush(); },
+    };
+}
+
+auto make_rotating_file_log_sink(std::filesystem::path const &folder, std::string const &base_name, uintmax_t max_size, uint32_t max_file_n) -> LogSink {
+    struct State {
+        std::filesystem::path folder;
+        std::string base_name;
+        uintmax_t max_size;
+        uint32_t max_file_n;
+        std::ofstream file{};
+        uintmax_t size = 0;
+        std::string buffer{};
+
+        auto file_path(uint32_t index) const -> std::filesystem::path {
+            return folder / (index == 0 ? fmt::format("{}.log", base_name) : fmt::format("{}.{}.log", base_name, index));
+        }
+        void open() {
+            auto ec = std::error_code{};
+            std::filesystem::create_directories(folder, ec);
+            auto const path = file_path(0);
+            size = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+            file.open(path, std::ios::binary | std::ios::app);
+        }
+        void rotate() {
+            file.close();
+            auto ec = std::error_code{};
+            std::filesystem::remove(file_path(max_file_n), ec);
+            for (auto index = max_file_n; index > 0; --index) {
+                std::filesystem::rename(file_path(index - 1), file_path(index), ec);
+            }
+            open();
+        }
+    };
+    auto state = std::make_shared<State>(State{
+        .folder = folder,
+        .base_name = base_name,
+        .max_size = max_size,
+        .max_file_n = max_file_n,
+    });
+    return LogSink{
+        .write = [state](std::span<LogRecord const> records) {
+            auto &self = *state;
+            if (!self.file.is_open()) {
+                self.open();
+            }
+            self.buffer.clear();
+            for (auto const &record : records) {
+                auto const seconds = std::chrono::floor<std::chrono::seconds>(record.time);
+                auto const milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(record.time - seconds).count();
+                fmt::format_to(std::back_inserter(self.buffer), "[{:%Y-%m-%d %H:%M:%S}.{:03}] {}\n", seconds, milliseconds, record.text);
+            }
+            if (self.size > 0 && self.size + self.buffer.size() > self.max_size) {
+                self.rotate();
+            }
+            self.file.write(self.buffer.data(), static_cast<std::streamsize>(self.buffer.size()));
+            self.size += self.buffer.size();
+        },
+        .flush = [state]() { state->file.flush(); },
+    };
+}
+
+auto log_level_prefix(LogLevel level) -> std::string_view {
+    switch (level) {
+    case LogLevel::WARN: return "[warning] ";
+    case LogLevel::ERR: return "[error] ";
+    default: return "";
+    }
+}
+
+auto log_level_of(std::string_view text) -> LogLevel {
+    if (text.find("[error]") != std::string_view::npos) {
+        return LogLevel::ERR;
+    }
+    if (text.find("[warning]") != std::string_view::npos) {
+        return LogLevel::WARN;
+    }
+    return LogLevel::INFO;
+}
+
+void log_unformatted(LogLevel level, std::string text) {
+    if (auto *logger = Logger::s_instance; logger != nullptr) {
+        logger->submit(level, std::move(text));
+        return;
+    }
+    // Before the Logger exists (or after it's gone), log synchronously.
+    auto const record = LogRecord{.sequence = 0, .level = level, .time = std::chrono::system_clock::now(), .text = std::move(text)};
+    if (debug_utils::Console::s_instance != nullptr) {
+        debug_utils::Console::log_sink().write({&record, 1});
+    }
+    std::cout << record.text << std::endl;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+// Short names, as windows.h defines ERROR.
+enum struct LogLevel : uint8_t {
+    TRACE,
+    INFO,
+    WARN,
+    ERR,
+};
+
+struct LogRecord {
+    // Global submission order, so that the records of all threads can be merged back in order.
+    uint64_t sequence = 0;
+    LogLevel level = LogLevel::INFO;
+    std::chrono::system_clock::time_point time{};
+    std::string text;
+};
+
+// Where drained records go. Both are called on the logger's drain thread only, with records in
+// submission order. `flush` may be empty.
+struct LogSink {
+    std::function<void(std::span<LogRecord const> records)> write;
+    std::function<void()> flush;
+};
+
+// Every thread that logs gets its own single-producer ring of records, so submitting never takes a
+// lock or waits on another logging thread. A background thread drains all the rings, merges the
+// records by sequence number and hands them to the sinks, which then do all the slow I/O.
+struct Logger {
+    static constexpr size_t THREAD_QUEUE_CAPACITY = 1024;
+    static constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds{10};
+
+    struct ThreadQueue {
+        std::array<LogRecord, THREAD_QUEUE_CAPACITY> records;
+        alignas(64) std::atomic<uint64_t> write_index{0};
+        alignas(64) std::atomic<uint64_t> read_index{0};
+        // Set once the owning thread exited, after which the drain thread removes the queue.
+        std::atomic<bool> is_orphaned{false};
+
+        // Only called by the owning thread.
+        auto try_push(LogRecord &&record) -> bool;
+        // Only called by the drain thread.
+        void pop_all(std::vector<LogRecord> &out);
+    };
+
+    struct Stats {
+        // Records that were thrown away because their thread's queue was full.
+        std::atomic<uint64_t> dropped_n{0};
+        std::atomic<uint64_t> drained_n{0};
+    };
+
+    inline static Logger *s_instance = nullptr;
+
+    // Lower levels are discarded before they are even queued.
+    std::atomic<LogLevel> min_level{LogLevel::INFO};
+    Stats stats{};
+
+    // Starts the drain thread. The first Logger becomes s_instance, which log_message() submits to.
+    explicit Logger(std::vector<LogSink> sinks);
+    ~Logger();
+
+    Logger(Logger const &) = delete;
+    Logger(Logger &&) noexcept = delete;
+    Logger &operator=(Logger const &) = delete;
+    Logger &operator=(Logger &&) noexcept = delete;
+
+    // Never blocks for TRACE and INFO records, which are dropped when the calling thread's queue is
+    // full. WARN and ERR records wait for the drain thread to make room instead.
+    void submit(LogLevel level, std::string text);
+    // Blocks until everything that was submitted before the call reached the sinks.
+    void flush();
+
+  private:
+    std::vector<LogSink> sinks;
+    std::atomic<uint64_t> next_sequence{0};
+    // Tells the thread_local queue of each thread whether it belongs to this Logger.
+    uint64_t generation;
+    uint64_t reported_dropped_n = 0;
+
+    std::mutex queues_mtx;
+    std::vector<std::shared_ptr<ThreadQueue>> queues;
+
+    std::mutex drain_mtx;
+    std::condition_variable drain_cv;
+    std::condition_variable flushed_cv;
+    std::atomic<bool> is_wake_pending{false};
+    bool should_wake = false;
+    bool should_stop = false;
+    uint64_t flush_request_n = 0;
+    uint64_t flushed_request_n = 0;
+    std::thread drain_thread;
+
+    auto thread_queue() -> ThreadQueue &;
+    void wake_drain_thread();
+    void drain_thread_main();
+    void drain(std::vector<LogRecord> &records);
+};
+
+// Writes to stdout, flushing once per drained batch rather than once per line.
+auto make_stdout_log_sink() -> LogSink;
+// Appends to `folder / (base_name + ".log")`. Once that grows past `max_size` bytes, it becomes
+// base_name.1.log (and base_name.1.log becomes base_name.2.log, and so on), keeping at most
+// `max_file_n` old files.
+auto make_rotating_file_log_sink(std::filesystem::path const &folder, std::string const &base_name, uintmax_t max_size, uint32_t max_file_n) -> LogSink;
+
+// Formats on the calling thread, and only if `level` passes Logger::min_level. The format string is
+// checked at compile time. Without a Logger, this falls back to debug_utils::Console::add_log.
+template <typename... Args>
+void log_message(LogLevel level, fmt::format_string<Args...> format, Args &&...args);
+
+template <typename... Args>
+void log_trace(fmt::format_string<Args...> format, Args &&...args) { log_message(LogLevel::TRACE, format, std::forward<Args>(args)...); }
+template <typename... Args>
+void log_info(fmt::format_string<Args...> format, Args &&...args) { log_message(LogLevel::INFO, format, std::forward<Args>(args)...); }
+template <typename... Args>
+void log_warning(fmt::format_string<Args...> format, Args &&...args) { log_message(LogLevel::WARN, format, std::forward<Args>(args)...); }
+template <typename... Args>
+void log_error(fmt::format_string<Args...> format, Args &&...args) { log_message(LogLevel::ERR, format, std::forward<Args>(args)...); }
+
+// Prefixed to the text by log_warning() and log_error(), which is also how the level of plain
+// add_log() strings is recognized.
+auto log_level_prefix(LogLevel level) -> std::string_view;
+auto log_level_of(std::string_view text) -> LogLevel;
+void log_unformatted(LogLevel level, std::string text);
+
+template <typename... Args>
+void log_message(LogLevel level, fmt::format_string<Args...> format, Args &&...args) {
+    auto *logger = Logger::s_instance;
+    if (logger != nullptr && level < logger->min_level.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto text = std::string{log_level_prefix(level)};
+    fmt::format_to(std::back_inserter(text), format, std::forward<Args>(args)...);
+    log_unformatted(level, std::move(text));
+}
@@ -0,0 +1,76 @@
+#include <utilities/log.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Measures how many records per second many threads can submit at once, through the Logger (into a
+// sink that discards them) and through the previous mutex-and-vector scheme.
+// Usage: gvox_engine_log_bench [thread count]
+
+namespace {
+    constexpr auto MESSAGE_N_PER_THREAD = uint32_t{200'000};
+
+    struct LoggerResult {
+        double submit_seconds;
+        double total_seconds;
+        uint64_t dropped_n;
+    };
+} // namespace
+
+auto main(int argc, char const *argv[]) -> int {
+    auto const thread_n = benchmark_count_arg(std::span{argv, static_cast<size_t>(argc)}, 8);
+    auto const total_n = uint64_t{thread_n} * MESSAGE_N_PER_THREAD;
+    auto run_threads = [thread_n](auto &&log_one) {
+        auto const t0 = std::chrono::steady_clock::now();
+        auto threads = std::vector<std::thread>{};
+        threads.reserve(thread_n);
+        for (uint32_t thread_i = 0; thread_i < thread_n; ++thread_i) {
+            threads.emplace_back([&log_one, thread_i]() {
+                for (uint32_t message_i = 0; message_i < MESSAGE_N_PER_THREAD; ++message_i) {
+                    log_one(fmt::format("thread {} record {} of {}", thread_i, message_i, MESSAGE_N_PER_THREAD));
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    // A sink that discards everything, so that only the submission path is measured.
+    auto run_logger = [&run_threads](LogLevel level) {
+        auto const t0 = std::chrono::steady_clock::now();
+        auto logger = Logger{{LogSink{.write = [](std::span<LogRecord const>) {}, .flush = {}}}};
+        auto const submit_seconds = run_threads([&logger, level](std::string text) { logger.submit(level, std::move(text)); });
+        logger.flush();
+        return LoggerResult{
+            .submit_seconds = submit_seconds,
+            .total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(),
+            .dropped_n = logger.stats.dropped_n.load(),
+        };
+    };
+    // INFO records are dropped once the drain thread falls behind, while WARN records wait for it.
+    auto const info_result = run_logger(LogLevel::INFO);
+    auto const warn_result = run_logger(LogLevel::WARN);
+
+    // What Console::add_log used to do, minus the write to stdout.
+    auto mtx = std::mutex{};
+    auto items = std::vector<std::string>{};
+    auto const mutex_seconds = run_threads([&](std::string text) {
+        auto lock = std::lock_guard{mtx};
+        items.push_back(std::move(text));
+    });
+
+    auto const rate = [total_n](double seconds) { return static_cast<double>(total_n) / seconds / 1'000'000.0; };
+    fmt::print("Logging {} threads x {} records:\n", thread_n, MESSAGE_N_PER_THREAD);
+    for (auto const &[name, result] : {std::pair{"logger, INFO", info_result}, std::pair{"logger, WARN", warn_result}}) {
+        fmt::print("  {:<14} {:8.3f} s to submit ({:6.2f} M/s), {:8.3f} s until drained, {} dropped\n",
+                   name, result.submit_seconds, rate(result.submit_seconds), result.total_seconds, result.dropped_n);
+    }
+    fmt::print("  {:<14} {:8.3f} s to submit ({:6.2f} M/s)\n", "mutex+vector", mutex_seconds, rate(mutex_seconds));
+    return 0;
+}
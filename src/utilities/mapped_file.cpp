@@ -0,0 +1,130 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+MappedFile::MappedFile(std::filesystem::path const &path) {
+    auto *file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    auto file_size = LARGE_INTEGER{};
+    if (GetFileSizeEx(file, &file_size) == 0) {
+        CloseHandle(file);
+        return;
+    }
+    file_handle = file;
+    byte_n = static_cast<size_t>(file_size.QuadPart);
+    if (byte_n == 0) {
+        is_mapped = true;
+        return;
+    }
+    mapping_handle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr) {
+        close();
+        return;
+    }
+    ptr = static_cast<uint8_t const *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (ptr == nullptr) {
+        close();
+        return;
+    }
+    is_mapped = true;
+}
+
+void MappedFile::close() {
+    if (ptr != nullptr) {
+        UnmapViewOfFile(ptr);
+    }
+    if (mapping_handle != nullptr) {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr) {
+        CloseHandle(file_handle);
+    }
+    ptr = nullptr;
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+    byte_n = 0;
+    is_mapped = false;
+}
+
+void MappedFile::advise_sequential() const {
+    // Covered by FILE_FLAG_SEQUENTIAL_SCAN when opening the file.
+}
+#else
+MappedFile::MappedFile(std::filesystem::path const &path) {
+    auto const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat file_stat = {};
+    if (::fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        return;
+    }
+    byte_n = static_cast<size_t>(file_stat.st_size);
+    if (byte_n == 0) {
+        ::close(fd);
+        is_mapped = true;
+        return;
+    }
+    auto *mapping = ::mmap(nullptr, byte_n, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        byte_n = 0;
+        return;
+    }
+    ptr = static_cast<uint8_t const *>(mapping);
+    is_mapped = true;
+}
+
+void MappedFile::close() {
+    if (ptr != nullptr) {
+        ::munmap(const_cast<uint8_t *>(ptr), byte_n);
+    }
+    ptr = nullptr;
+    byte_n = 0;
+    is_mapped = false;
+}
+
+void MappedFile::advise_sequential() const {
+    if (ptr != nullptr) {
+        ::madvise(const_cast<uint8_t *>(ptr), byte_n, MADV_SEQUENTIAL);
+    }
+}
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        ptr = std::exchange(other.ptr, nullptr);
+        byte_n = std::exchange(other.byte_n, 0);
+        is_mapped = std::exchange(other.is_mapped, false);
+#if defined(_WIN32)
+        file_handle = std::exchange(other.file_handle, nullptr);
+        mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+    }
+    return *this;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+// Read-only view of a whole file, mapped into the address space. The pages are backed by the file
+// itself, so the OS can drop them under memory pressure instead of them counting towards the heap.
+struct MappedFile {
+    MappedFile() = default;
+    explicit MappedFile(std::filesystem::path const &path);
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    auto is_open() const -> bool { return is_mapped; }
+    auto data() const -> uint8_t const * { return ptr; }
+    auto size() const -> size_t { return byte_n; }
+    auto bytes() const -> std::span<uint8_t const> { return {ptr, byte_n}; }
+
+    // Hints that the file is about to be read front to back, so the OS can read ahead.
+    void advise_sequential() const;
+
+  private:
+    void close();
+
+    uint8_t const *ptr = nullptr;
+    size_t byte_n = 0;
+    // Empty files can't be mapped, but are still valid files.
+    bool is_mapped = false;
+#if defined(_WIN32)
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
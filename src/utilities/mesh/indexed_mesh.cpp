@@ -0,0 +1,187 @@
+#include "indexed_mesh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    constexpr uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+    constexpr float QUANTIZED_MAX = 65535.0f;
+
+    auto quantize(float x, float min, float extent) -> uint16_t {
+        if (!(extent > 0.0f)) {
+            return 0;
+        }
+        return static_cast<uint16_t>(std::clamp(std::round((x - min) / extent * QUANTIZED_MAX), 0.0f, QUANTIZED_MAX));
+    }
+
+    auto dequantize(uint16_t q, float min, float extent) -> float {
+        return min + static_cast<float>(q) / QUANTIZED_MAX * extent;
+    }
+
+    auto hash_vertex(IndexedMeshVertex const &vertex) -> uint64_t {
+        auto const pos = uint64_t{vertex.pos[0]} | (uint64_t{vertex.pos[1]} << 16) | (uint64_t{vertex.pos[2]} << 32);
+        auto const tex = uint64_t{vertex.tex[0]} | (uint64_t{vertex.tex[1]} << 16);
+        auto hash = (pos * 0x9e3779b97f4a7c15ull) ^ (tex * 0xbf58476d1ce4e5b9ull);
+        return hash ^ (hash >> 29);
+    }
+
+    // Splits the triangles into runs that stay within the meshlet limits, in order.
+    void build_meshlets(IndexedMesh &mesh, std::span<uint32_t const> indices) {
+        // The meshlet that last counted each vertex.
+        auto vertex_meshlets = std::vector<uint32_t>(mesh.vertices.size(), NO_VERTEX);
+        auto meshlet = IndexedMeshlet{};
+        auto meshlet_vertex_n = uint32_t{0};
+        auto const meshlet_i = [&mesh]() { return static_cast<uint32_t>(mesh.meshlets.size()); };
+        auto const start_meshlet = [&](uint32_t first_triangle) {
+            meshlet = IndexedMeshlet{
+                .first_triangle = first_triangle,
+                .triangle_n = 0,
+                .bound_min = {0xffff, 0xffff, 0xffff},
+                .bound_max = {0, 0, 0},
+            };
+            meshlet_vertex_n = 0;
+        };
+        auto const new_vertex_n = [&](std::span<uint32_t const, 3> triangle) {
+            auto result = uint32_t{0};
+            for (uint32_t i = 0; i < 3; ++i) {
+                auto const is_repeat = (i > 0 && triangle[i] == triangle[0]) || (i > 1 && triangle[i] == triangle[1]);
+                if (!is_repeat && vertex_meshlets[triangle[i]] != meshlet_i()) {
+                    ++result;
+                }
+            }
+            return result;
+        };
+
+        start_meshlet(0);
+        auto const triangle_n = static_cast<uint32_t>(indices.size() / 3);
+        for (uint32_t triangle_i = 0; triangle_i < triangle_n; ++triangle_i) {
+            auto const triangle = std::span<uint32_t const, 3>{indices.data() + size_t{triangle_i} * 3, 3};
+            if (meshlet.triangle_n == IndexedMesh::MESHLET_MAX_TRIANGLE_N || meshlet_vertex_n + new_vertex_n(triangle) > IndexedMesh::MESHLET_MAX_VERTEX_N) {
+                mesh.meshlets.push_back(meshlet);
+                start_meshlet(triangle_i);
+            }
+            meshlet_vertex_n += new_vertex_n(triangle);
+            for (auto vertex_i : triangle) {
+                vertex_meshlets[vertex_i] = meshlet_i();
+                auto const &pos = mesh.vertices[vertex_i].pos;
+                for (uint32_t axis_i = 0; axis_i < 3; ++axis_i) {
+                    meshlet.bound_min[axis_i] = std::min(meshlet.bound_min[axis_i], pos[axis_i]);
+                    meshlet.bound_max[axis_i] = std::max(meshlet.bound_max[axis_i], pos[axis_i]);
+                }
+            }
+            ++meshlet.triangle_n;
+        }
+        if (meshlet.triangle_n != 0) {
+            mesh.meshlets.push_back(meshlet);
+        }
+    }
+} // namespace
+
+auto IndexedMesh::index(size_t i) const -> uint32_t {
+    if (index_type == MeshIndexType::U16) {
+        auto result = uint16_t{};
+        std::memcpy(&result, index_data.data() + i * 2, 2);
+        return result;
+    }
+    auto result = uint32_t{};
+    std::memcpy(&result, index_data.data() + i * 4, 4);
+    return result;
+}
+
+auto IndexedMesh::position(uint32_t vertex_i) const -> glm::vec3 {
+    auto const &pos = vertices[vertex_i].pos;
+    auto const extent = bound_max - bound_min;
+    return {dequantize(pos[0], bound_min.x, extent.x), dequantize(pos[1], bound_min.y, extent.y), dequantize(pos[2], bound_min.z, extent.z)};
+}
+
+auto IndexedMesh::tex(uint32_t vertex_i) const -> glm::vec2 {
+    auto const &uv = vertices[vertex_i].tex;
+    auto const extent = tex_max - tex_min;
+    return {dequantize(uv[0], tex_min.x, extent.x), dequantize(uv[1], tex_min.y, extent.y)};
+}
+
+auto IndexedMesh::meshlet_bound_min(IndexedMeshlet const &meshlet) const -> glm::vec3 {
+    auto const extent = bound_max - bound_min;
+    return {dequantize(meshlet.bound_min[0], bound_min.x, extent.x), dequantize(meshlet.bound_min[1], bound_min.y, extent.y), dequantize(meshlet.bound_min[2], bound_min.z, extent.z)};
+}
+
+auto IndexedMesh::meshlet_bound_max(IndexedMeshlet const &meshlet) const -> glm::vec3 {
+    auto const extent = bound_max - bound_min;
+    return {dequantize(meshlet.bound_max[0], bound_min.x, extent.x), dequantize(meshlet.bound_max[1], bound_min.y, extent.y), dequantize(meshlet.bound_max[2], bound_min.z, extent.z)};
+}
+
+auto IndexedMesh::memory_size() const -> size_t {
+    return vertices.size() * sizeof(IndexedMeshVertex) + index_data.size() + meshlets.size() * sizeof(IndexedMeshlet);
+}
+
+auto build_indexed_mesh(IndexedMeshSource const &source) -> IndexedMesh {
+    auto result = IndexedMesh{};
+    auto const index_n = source.indices.size() / 3 * 3;
+    if (index_n == 0) {
+        return result;
+    }
+
+    // Only the vertices that are used count towards the bounds.
+    auto const has_tex = !source.tex.empty();
+    result.bound_min = glm::vec3(std::numeric_limits<float>::max());
+    result.bound_max = glm::vec3(std::numeric_limits<float>::lowest());
+    result.tex_min = has_tex ? glm::vec2(std::numeric_limits<float>::max()) : glm::vec2(0.0f);
+    result.tex_max = has_tex ? glm::vec2(std::numeric_limits<float>::lowest()) : glm::vec2(0.0f);
+    for (size_t i = 0; i < index_n; ++i) {
+        auto const vertex_i = source.indices[i];
+        result.bound_min = glm::min(result.bound_min, source.positions[vertex_i]);
+        result.bound_max = glm::max(result.bound_max, source.positions[vertex_i]);
+        if (has_tex) {
+            result.tex_min = glm::min(result.tex_min, source.tex[vertex_i]);
+            result.tex_max = glm::max(result.tex_max, source.tex[vertex_i]);
+        }
+    }
+    auto const extent = result.bound_max - result.bound_min;
+    auto const tex_extent = result.tex_max - result.tex_min;
+
+    // Each source vertex is quantized once, then looked up in an open-addressed table of the
+    // distinct quantized vertices.
+    auto source_to_vertex = std::vector<uint32_t>(source.positions.size(), NO_VERTEX);
+    auto const slot_n = std::bit_ceil(std::max<size_t>(16, std::min(source.positions.size(), index_n) * 2));
+    auto slots = std::vector<uint32_t>(slot_n, NO_VERTEX);
+    auto indices = std::vector<uint32_t>(index_n);
+    for (size_t i = 0; i < index_n; ++i) {
+        auto &vertex_i = source_to_vertex[source.indices[i]];
+        if (vertex_i == NO_VERTEX) {
+            auto const &pos = source.positions[source.indices[i]];
+            auto const tex = has_tex ? source.tex[source.indices[i]] : glm::vec2(0.0f);
+            auto const vertex = IndexedMeshVertex{
+                .pos = {quantize(pos.x, result.bound_min.x, extent.x), quantize(pos.y, result.bound_min.y, extent.y), quantize(pos.z, result.bound_min.z, extent.z)},
+                .tex = {quantize(tex.x, result.tex_min.x, tex_extent.x), quantize(tex.y, result.tex_min.y, tex_extent.y)},
+            };
+            auto slot_i = hash_vertex(vertex) & (slot_n - 1);
+            while (slots[slot_i] != NO_VERTEX && result.vertices[slots[slot_i]] != vertex) {
+                slot_i = (slot_i + 1) & (slot_n - 1);
+            }
+            if (slots[slot_i] == NO_VERTEX) {
+                slots[slot_i] = static_cast<uint32_t>(result.vertices.size());
+                result.vertices.push_back(vertex);
+            }
+            vertex_i = slots[slot_i];
+        }
+        indices[i] = vertex_i;
+    }
+
+    if (result.vertices.size() <= 0x10000) {
+        result.index_type = MeshIndexType::U16;
+        result.index_data.resize(index_n * 2);
+        for (size_t i = 0; i < index_n; ++i) {
+            auto const index = static_cast<uint16_t>(indices[i]);
+            std::memcpy(result.index_data.data() + i * 2, &index, 2);
+        }
+    } else {
+        result.index_type = MeshIndexType::U32;
+        result.index_data.resize(index_n * 4);
+        std::memcpy(result.index_data.data(), indices.data(), index_n * 4);
+    }
+    build_meshlets(result, indices);
+    return result;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// What meshes are kept as between import and voxelization. Vertices are stored once, however many
+// triangles share them, with positions as 16-bit fractions of the mesh's bounding box and UVs as
+// 16-bit fractions of the mesh's UV bounding box. Two vertices that quantize to the same values are
+// the same vertex. Triangles keep their import order, since later triangles win when voxelizing.
+
+struct IndexedMeshVertex {
+    std::array<uint16_t, 3> pos;
+    std::array<uint16_t, 2> tex;
+
+    auto operator==(IndexedMeshVertex const &) const -> bool = default;
+};
+
+enum struct MeshIndexType : uint8_t {
+    U16,
+    U32,
+};
+
+// A run of consecutive triangles using at most MESHLET_MAX_VERTEX_N distinct vertices, with the
+// quantized bounding box of those vertices.
+struct IndexedMeshlet {
+    uint32_t first_triangle;
+    uint32_t triangle_n;
+    std::array<uint16_t, 3> bound_min;
+    std::array<uint16_t, 3> bound_max;
+};
+
+struct IndexedMesh {
+    static constexpr uint32_t MESHLET_MAX_VERTEX_N = 64;
+    static constexpr uint32_t MESHLET_MAX_TRIANGLE_N = 124;
+
+    // The exact bounds of the source positions and UVs, which the quantized values are relative to.
+    glm::vec3 bound_min{};
+    glm::vec3 bound_max{};
+    glm::vec2 tex_min{};
+    glm::vec2 tex_max{};
+    std::vector<IndexedMeshVertex> vertices;
+    // 16-bit indices whenever the vertices fit, 3 per triangle.
+    MeshIndexType index_type = MeshIndexType::U16;
+    std::vector<uint8_t> index_data;
+    std::vector<IndexedMeshlet> meshlets;
+
+    auto vertex_n() const -> size_t { return vertices.size(); }
+    auto index_n() const -> size_t { return index_data.size() / (index_type == MeshIndexType::U16 ? 2 : 4); }
+    auto triangle_n() const -> size_t { return index_n() / 3; }
+    auto index(size_t i) const -> uint32_t;
+    auto position(uint32_t vertex_i) const -> glm::vec3;
+    auto tex(uint32_t vertex_i) const -> glm::vec2;
+    auto meshlet_bound_min(IndexedMeshlet const &meshlet) const -> glm::vec3;
+    auto meshlet_bound_max(IndexedMeshlet const &meshlet) const -> glm::vec3;
+    // Bytes of vertices, indices and meshlets.
+    auto memory_size() const -> size_t;
+};
+
+struct IndexedMeshSource {
+    std::span<glm::vec3 const> positions;
+    // Optional. If given, one per position.
+    std::span<glm::vec2 const> tex;
+    // 3 per triangle, into `positions`.
+    std::span<uint32_t const> indices;
+};
+
+// Quantizes the vertices the triangles use, merges the ones that end up equal, and splits the
+// triangles into meshlets.
+auto build_indexed_mesh(IndexedMeshSource const &source) -> IndexedMesh;
@@ -1,5 +1,10 @@
 #include "mesh_model.hpp"
 
+#include <utilities/log.hpp>
+#include <utilities/mapped_file.hpp>
+#include <utilities/mesh/texture_pixels.hpp>
+#include <utilities/thread_pool.hpp>
+
 #include <daxa/daxa.hpp>
 #include <daxa/utils/task_graph.hpp>
 
@@ -11,7 +16,113 @@
 #include <daxa/utils/task_graph_types.hpp>
 #include <FreeImage.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <optional>
+
 namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Textures are decoded one per job, since a single one can take long enough already.
+    constexpr size_t TEXTURE_DECODE_BATCH_SIZE = 1;
+
+    constexpr auto FREEIMAGE_IS_BGR = FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR;
+
+    struct TextureDecodeTimes {
+        std::atomic_uint64_t image_decode_ns{0};
+        std::atomic_uint64_t convert_ns{0};
+        std::atomic_uint64_t mip_ns{0};
+    };
+
+    auto elapsed_ns(Clock::time_point begin, Clock::time_point end) -> uint64_t {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    void run_parallel(ThreadPool *thread_pool, size_t count, size_t batch_size, std::function<void(size_t, size_t)> const &f) {
+        if (thread_pool != nullptr) {
+            thread_pool->parallel_for(count, batch_size, f);
+        } else if (count > 0) {
+            f(0, count);
+        }
+    }
+
+    // The layout of what FreeImage decoded, if its pixels can be converted as they are. Anything else
+    // (palettes, 16-bit channels, floats) goes through FreeImage's own conversion first.
+    auto freeimage_pixel_format(FIBITMAP *bitmap) -> std::optional<TexturePixelFormat> {
+        if (FreeImage_GetImageType(bitmap) != FIT_BITMAP) {
+            return std::nullopt;
+        }
+        switch (FreeImage_GetBPP(bitmap)) {
+        case 32: return FREEIMAGE_IS_BGR ? TexturePixelFormat::BGRA8 : TexturePixelFormat::RGBA8;
+        case 24: return FREEIMAGE_IS_BGR ? TexturePixelFormat::BGR8 : TexturePixelFormat::RGB8;
+        case 8:
+            if (FreeImage_GetColorType(bitmap) == FIC_MINISBLACK) {
+                return TexturePixelFormat::GRAY8;
+            }
+            break;
+        default: break;
+        }
+        return std::nullopt;
+    }
+
+    // Fills in the texture's pixels and whole mip chain from `format` pixels, `pitch` bytes per row.
+    void set_texture_pixels(Texture &texture, TexturePixelFormat format, uint8_t const *bits, size_t pitch, uint32_t size_x, uint32_t size_y, TextureDecodeTimes &times) {
+        auto const t0 = Clock::now();
+        texture.size_x = size_x;
+        texture.size_y = size_y;
+        texture.mip_level_n = texture_mip_level_n(size_x, size_y);
+        texture.pixel_data.resize(texture_mip_chain_size(size_x, size_y, texture.mip_level_n));
+        texture.pixels = texture.pixel_data.data();
+        auto const level_0_size = size_t{size_x} * size_y * 4;
+        if (pitch == size_t{size_x} * texture_pixel_size(format)) {
+            convert_pixels_to_bgra8(format, bits, {texture.pixel_data.data(), level_0_size});
+        } else {
+            for (uint32_t yi = 0; yi < size_y; ++yi) {
+                convert_pixels_to_bgra8(format, bits + yi * pitch, {texture.pixel_data.data() + size_t{yi} * size_x * 4, size_t{size_x} * 4});
+            }
+        }
+        auto const t1 = Clock::now();
+        generate_texture_mips(texture.pixel_data, size_x, size_y, texture.mip_level_n);
+        auto const t2 = Clock::now();
+        times.convert_ns.fetch_add(elapsed_ns(t0, t1), std::memory_order_relaxed);
+        times.mip_ns.fetch_add(elapsed_ns(t1, t2), std::memory_order_relaxed);
+    }
+
+    auto decode_texture(Texture &texture, std::span<uint8_t const> file_bytes, TextureDecodeTimes &times) -> bool {
+        auto const t0 = Clock::now();
+        // FreeImage only reads from the memory, despite the pointer not being const.
+        auto *memory = FreeImage_OpenMemory(const_cast<BYTE *>(file_bytes.data()), static_cast<DWORD>(file_bytes.size()));
+        auto file_type = FreeImage_GetFileTypeFromMemory(memory, 0);
+        if (file_type == FIF_UNKNOWN) {
+            // Some formats, like TGA, have no signature to go by.
+            file_type = FreeImage_GetFIFFromFilename(texture.path.string().c_str());
+        }
+        FIBITMAP *bitmap = nullptr;
+        if (file_type != FIF_UNKNOWN && FreeImage_FIFSupportsReading(file_type)) {
+            bitmap = FreeImage_LoadFromMemory(file_type, memory, 0);
+        }
+        FreeImage_CloseMemory(memory);
+        if (bitmap == nullptr) {
+            return false;
+        }
+        auto format = freeimage_pixel_format(bitmap);
+        if (!format.has_value()) {
+            auto *converted = FreeImage_ConvertTo32Bits(bitmap);
+            FreeImage_Unload(bitmap);
+            if (converted == nullptr) {
+                return false;
+            }
+            bitmap = converted;
+            format = FREEIMAGE_IS_BGR ? TexturePixelFormat::BGRA8 : TexturePixelFormat::RGBA8;
+        }
+        times.image_decode_ns.fetch_add(elapsed_ns(t0, Clock::now()), std::memory_order_relaxed);
+        set_texture_pixels(texture, *format, FreeImage_GetBits(bitmap), FreeImage_GetPitch(bitmap), FreeImage_GetWidth(bitmap), FreeImage_GetHeight(bitmap), times);
+        FreeImage_Unload(bitmap);
+        return true;
+    }
+
     void load_textures(Mesh &mesh, TextureMap &global_textures, aiMaterial *mat, std::filesystem::path const &rootdir) {
         auto texture_n = std::min(1u, mat->GetTextureCount(aiTextureType_DIFFUSE));
         if (texture_n == 0) {
@@ -31,50 +142,53 @@ namespace {
         }
     }
 
-    void process_node(daxa::Device device, MeshModel &model, aiNode *node, aiScene const *scene, std::filesystem::path const &rootdir, glm::mat4 const &parent_transform) {
+    void process_node(MeshModel &model, aiNode *node, aiScene const *scene, std::filesystem::path const &rootdir, glm::mat4 const &parent_transform) {
         auto transform = *reinterpret_cast<glm::mat4 *>(&node->mTransformation);
         transform = transform * parent_transform;
         auto transposed_transform = glm::transpose(transform);
+        auto positions = std::vector<glm::vec3>{};
+        auto tex = std::vector<glm::vec2>{};
+        auto indices = std::vector<uint32_t>{};
         for (uint32_t mesh_i = 0; mesh_i < node->mNumMeshes; ++mesh_i) {
             aiMesh *aimesh = scene->mMeshes[node->mMeshes[mesh_i]];
-            // TODO: Fix. Min and Max bounds seem to be broken.
-            auto g_min = transposed_transform * glm::vec4(aimesh->mAABB.mMin.x, aimesh->mAABB.mMin.y, aimesh->mAABB.mMin.z, 1.0);
-            auto g_max = transposed_transform * glm::vec4(aimesh->mAABB.mMax.x, aimesh->mAABB.mMax.y, aimesh->mAABB.mMax.z, 1.0);
-            model.bound_min.x = std::min(g_min.x, model.bound_min.x);
-            model.bound_min.y = std::min(g_min.y, model.bound_min.y);
-            model.bound_min.z = std::min(g_min.z, model.bound_min.z);
-            model.bound_max.x = std::max(g_max.x, model.bound_max.x);
-            model.bound_max.y = std::max(g_max.y, model.bound_max.y);
-            model.bound_max.z = std::max(g_max.z, model.bound_max.z);
+            positions.resize(aimesh->mNumVertices);
+            tex.resize(aimesh->mTextureCoords[0] != nullptr ? aimesh->mNumVertices : 0);
+            for (uint32_t vert_i = 0; vert_i < aimesh->mNumVertices; ++vert_i) {
+                positions[vert_i] = {aimesh->mVertices[vert_i].x, aimesh->mVertices[vert_i].y, aimesh->mVertices[vert_i].z};
+                if (!tex.empty()) {
+                    tex[vert_i] = {aimesh->mTextureCoords[0][vert_i].x, aimesh->mTextureCoords[0][vert_i].y};
+                }
+            }
+            // Triangulating still leaves any points and lines as they are.
+            indices.clear();
+            indices.reserve(size_t{aimesh->mNumFaces} * 3);
+            for (uint32_t face_i = 0; face_i < aimesh->mNumFaces; ++face_i) {
+                auto const &face = aimesh->mFaces[face_i];
+                if (face.mNumIndices == 3) {
+                    indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+                }
+            }
             model.meshes.push_back({});
             auto &o_mesh = model.meshes.back();
             o_mesh.modl_mat = *reinterpret_cast<daxa_f32mat4x4 *>(&transposed_transform);
-            auto &verts = o_mesh.verts;
-            verts.reserve(aimesh->mNumFaces * 3);
-            for (size_t face_i = 0; face_i < aimesh->mNumFaces; ++face_i) {
-                for (uint32_t index_i = 0; index_i < 3; ++index_i) {
-                    auto vert_i = aimesh->mFaces[face_i].mIndices[index_i];
-                    auto pos = aimesh->mVertices[vert_i];
-                    auto tex = aimesh->mTextureCoords[0][vert_i];
-                    verts.push_back({
-                        .pos = {pos.x, pos.y, pos.z},
-                        .tex = {tex.x, tex.y},
-                    });
+            o_mesh.geometry = build_indexed_mesh({.positions = positions, .tex = tex, .indices = indices});
+            if (o_mesh.geometry.triangle_n() != 0) {
+                // The transform can flip or rotate the box, so every corner counts.
+                for (uint32_t corner_i = 0; corner_i < 8; ++corner_i) {
+                    auto const corner = glm::vec3(
+                        (corner_i & 1) != 0 ? o_mesh.geometry.bound_max.x : o_mesh.geometry.bound_min.x,
+                        (corner_i & 2) != 0 ? o_mesh.geometry.bound_max.y : o_mesh.geometry.bound_min.y,
+                        (corner_i & 4) != 0 ? o_mesh.geometry.bound_max.z : o_mesh.geometry.bound_min.z);
+                    auto const p = transposed_transform * glm::vec4(corner, 1.0f);
+                    model.bound_min = {std::min(p.x, model.bound_min.x), std::min(p.y, model.bound_min.y), std::min(p.z, model.bound_min.z)};
+                    model.bound_max = {std::max(p.x, model.bound_max.x), std::max(p.y, model.bound_max.y), std::max(p.z, model.bound_max.z)};
                 }
             }
             aiMaterial *material = scene->mMaterials[aimesh->mMaterialIndex];
             load_textures(o_mesh, model.textures, material, rootdir);
-            o_mesh.vertex_buffer = device.create_buffer(daxa::BufferInfo{
-                .size = sizeof(MeshVertex) * o_mesh.verts.size(),
-                .name = "vertex_buffer",
-            });
-            o_mesh.normal_buffer = device.create_buffer(daxa::BufferInfo{
-                .size = sizeof(MeshVertex) * o_mesh.verts.size() / 3,
-                .name = "normal_buffer",
-            });
         }
         for (uint32_t i = 0; i < node->mNumChildren; ++i) {
-            process_node(device, model, node->mChildren[i], scene, rootdir, transform);
+            process_node(model, node->mChildren[i], scene, rootdir, transform);
         }
     }
 
@@ -103,156 +217,207 @@ namespace {
     };
 } // namespace
 
-void open_mesh_model(daxa::Device device, MeshModel &model, std::filesystem::path const &filepath, std::string const &name) {
+auto load_mesh_model(MeshModel &model, std::filesystem::path const &filepath, ThreadPool *thread_pool, MeshTextureLoadStats *stats) -> bool {
     Assimp::Importer import{};
-    aiScene const *scene = import.ReadFile(filepath.string(), aiProcess_Triangulate | aiProcess_GenBoundingBoxes);
+    aiScene const *scene = import.ReadFile(filepath.string(), aiProcess_Triangulate);
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        return;
+        return false;
     }
-    model.textures["#default_texture"] = std::make_shared<Texture>();
+    auto const default_texture = std::make_shared<Texture>();
+    model.textures["#default_texture"] = default_texture;
     model.bound_min = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
-    model.bound_max = {std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min()};
-    process_node(device, model, scene->mRootNode, scene, filepath.parent_path(), {{1, 0, 0, 0}, {0, 0, -1, 0}, {0, 1, 0, 0}, {0, 0, 0, 1}});
-    auto texture_staging_buffers = std::vector<daxa::BufferId>{};
+    model.bound_max = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    process_node(model, scene->mRootNode, scene, filepath.parent_path(), {{1, 0, 0, 0}, {0, 0, -1, 0}, {0, 1, 0, 0}, {0, 0, 0, 1}});
+
+    auto times = TextureDecodeTimes{};
+    auto local_stats = MeshTextureLoadStats{};
+    set_texture_pixels(*default_texture, TexturePixelFormat::BGRA8, reinterpret_cast<uint8_t const *>(default_texture_pixels.data()), 16 * 4, 16, 16, times);
+
+    auto textures = std::vector<std::shared_ptr<Texture>>{};
+    for (auto const &[key, texture] : model.textures) {
+        if (texture != default_texture) {
+            textures.push_back(texture);
+        }
+    }
+    local_stats.texture_n = static_cast<uint32_t>(textures.size());
+
+    // Reads and hashes every file, so that files with the same contents are only decoded once.
+    auto const t0 = Clock::now();
+    auto files = std::vector<MappedFile>(textures.size());
+    auto hashes = std::vector<uint64_t>(textures.size());
+    run_parallel(thread_pool, textures.size(), TEXTURE_DECODE_BATCH_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            files[i] = MappedFile{textures[i]->path};
+            hashes[i] = hash_texture_content(files[i].bytes());
+        }
+    });
+    // Each texture that gets replaced, by the first one with the same contents or by the default.
+    auto replacements = std::unordered_map<Texture const *, std::shared_ptr<Texture>>{};
+    auto distinct_textures = std::unordered_map<uint64_t, std::vector<size_t>>{};
+    auto decode_indices = std::vector<size_t>{};
+    for (size_t i = 0; i < textures.size(); ++i) {
+        if (!files[i].is_open()) {
+            log_warning("Couldn't read the texture {}", textures[i]->path.string());
+            replacements[textures[i].get()] = default_texture;
+            ++local_stats.failed_n;
+            continue;
+        }
+        local_stats.file_bytes += files[i].size();
+        auto &same_hash = distinct_textures[hashes[i]];
+        auto const original = std::find_if(same_hash.begin(), same_hash.end(), [&](size_t other_i) {
+            return std::ranges::equal(files[other_i].bytes(), files[i].bytes());
+        });
+        if (original != same_hash.end()) {
+            replacements[textures[i].get()] = textures[*original];
+            ++local_stats.duplicate_n;
+            continue;
+        }
+        same_hash.push_back(i);
+        decode_indices.push_back(i);
+    }
+    auto const t1 = Clock::now();
+
+    auto decoded = std::vector<uint8_t>(textures.size());
+    run_parallel(thread_pool, decode_indices.size(), TEXTURE_DECODE_BATCH_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto const texture_i = decode_indices[i];
+            decoded[texture_i] = decode_texture(*textures[texture_i], files[texture_i].bytes(), times) ? 1 : 0;
+            files[texture_i] = MappedFile{};
+        }
+    });
+    auto const t2 = Clock::now();
+    for (auto texture_i : decode_indices) {
+        if (decoded[texture_i] == 0) {
+            log_warning("Couldn't decode the texture {}", textures[texture_i]->path.string());
+            replacements[textures[texture_i].get()] = default_texture;
+            ++local_stats.failed_n;
+        }
+    }
+    // Duplicates of a texture that failed to decode get the default texture too.
+    for (auto &[texture, replacement] : replacements) {
+        if (auto iter = replacements.find(replacement.get()); iter != replacements.end()) {
+            replacement = iter->second;
+        }
+    }
+    for (auto &mesh : model.meshes) {
+        for (auto &texture : mesh.textures) {
+            if (auto iter = replacements.find(texture.get()); iter != replacements.end()) {
+                texture = iter->second;
+            }
+        }
+    }
+    std::erase_if(model.textures, [&replacements](auto const &entry) { return replacements.contains(entry.second.get()); });
+
+    if (stats != nullptr) {
+        for (auto const &[key, texture] : model.textures) {
+            local_stats.pixel_bytes += texture->pixel_data.size();
+        }
+        local_stats.hash_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        local_stats.decode_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        local_stats.image_decode_cpu_ms = static_cast<double>(times.image_decode_ns.load()) * 1e-6;
+        local_stats.convert_cpu_ms = static_cast<double>(times.convert_ns.load()) * 1e-6;
+        local_stats.mip_cpu_ms = static_cast<double>(times.mip_ns.load()) * 1e-6;
+        *stats = local_stats;
+    }
+    return true;
+}
+
+void open_mesh_model(daxa::Device device, MeshModel &model, std::filesystem::path const &filepath, std::string const &name) {
+    if (!load_mesh_model(model, filepath, ThreadPool::s_instance)) {
+        return;
+    }
+    for (auto &mesh : model.meshes) {
+        mesh.vertex_buffer = device.create_buffer(daxa::BufferInfo{
+            .size = sizeof(MeshVertex) * mesh.geometry.triangle_n() * 3,
+            .name = "vertex_buffer",
+        });
+        mesh.normal_buffer = device.create_buffer(daxa::BufferInfo{
+            .size = sizeof(MeshVertex) * mesh.geometry.triangle_n(),
+            .name = "normal_buffer",
+        });
+    }
+    // Every level of every texture goes into one staging buffer, with one copy per level.
+    auto staging_size = size_t{0};
+    for (auto const &[key, texture] : model.textures) {
+        staging_size += texture->pixel_data.size();
+    }
+    auto texture_staging_buffer = device.create_buffer({
+        .size = staging_size,
+        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .name = "texture_staging_buffer",
+    });
+    auto *staging_buffer_ptr = device.get_host_address_as<uint8_t>(texture_staging_buffer).value();
+    auto staging_offset = size_t{0};
     daxa::TaskGraph mip_task_list = daxa::TaskGraph({
         .device = device,
         .name = "mesh upload task list",
     });
-    auto fi_bitmaps = std::vector<FIBITMAP *>{};
     for (auto &[key, texture] : model.textures) {
-        if (key == "#default_texture") {
-            texture->pixels = reinterpret_cast<uint8_t const *>(default_texture_pixels.data());
-            texture->size_x = static_cast<uint32_t>(16);
-            texture->size_y = static_cast<uint32_t>(16);
-        } else {
-            auto fi_file_desc = FreeImage_GetFileType(texture->path.string().c_str(), 0);
-            FIBITMAP *fi_bitmap = FreeImage_Load(fi_file_desc, texture->path.string().c_str());
-            auto pixel_size = FreeImage_GetBPP(fi_bitmap);
-            if (pixel_size != 32) {
-                auto *temp = FreeImage_ConvertTo32Bits(fi_bitmap);
-                FreeImage_Unload(fi_bitmap);
-                fi_bitmap = temp;
-            }
-            texture->size_x = static_cast<uint32_t>(FreeImage_GetWidth(fi_bitmap));
-            texture->size_y = static_cast<uint32_t>(FreeImage_GetHeight(fi_bitmap));
-            texture->pixels = FreeImage_GetBits(fi_bitmap);
-            assert(texture->pixels != nullptr && "Failed to load image");
-            fi_bitmaps.push_back(fi_bitmap);
-        }
-        auto src_channel_n = 4u;
-        auto dst_channel_n = 4u;
+        auto const sx = texture->size_x;
+        auto const sy = texture->size_y;
+        auto const mip_level_n = texture->mip_level_n;
         texture->image_id = device.create_image({
             .format = daxa::Format::B8G8R8A8_SRGB,
-            .size = {texture->size_x, texture->size_y, 1},
-            .mip_level_count = 4,
-            .usage = daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST,
+            .size = {sx, sy, 1},
+            .mip_level_count = mip_level_n,
+            .usage = daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_DST,
             .name = "image",
         });
-        auto sx = static_cast<uint32_t>(texture->size_x);
-        auto sy = static_cast<uint32_t>(texture->size_y);
-        auto data = texture->pixels;
-        auto &image_id = texture->image_id;
-        size_t image_size = sx * sy * sizeof(uint8_t) * dst_channel_n;
-        auto texture_staging_buffer = device.create_buffer({
-            .size = image_size,
-            .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-            .name = "texture_staging_buffer",
-        });
-        auto *staging_buffer_ptr = device.get_host_address_as<uint8_t>(texture_staging_buffer).value();
-        for (size_t i = 0; i < sx * sy; ++i) {
-            size_t src_offset = i * src_channel_n;
-            size_t dst_offset = i * dst_channel_n;
-            for (size_t ci = 0; ci < std::min(src_channel_n, dst_channel_n); ++ci) {
-                staging_buffer_ptr[ci + dst_offset] = data[ci + src_offset];
-            }
-        }
-        texture_staging_buffers.push_back(texture_staging_buffer);
+        std::memcpy(staging_buffer_ptr + staging_offset, texture->pixel_data.data(), texture->pixel_data.size());
 
         texture->task_image = daxa::TaskImage(daxa::TaskImageInfo{
             .initial_images = {
-                .images = std::array{image_id},
+                .images = std::array{texture->image_id},
                 .latest_slice_states = std::array{daxa::ImageSliceState{
                     .latest_layout = daxa::ImageLayout::TRANSFER_DST_OPTIMAL,
-                    .slice = {.level_count = 4},
+                    .slice = {.level_count = mip_level_n},
                 }},
             },
             .name = name + key,
         });
         mip_task_list.use_persistent_image(texture->task_image);
-        auto task_image_mip_view = texture->task_image.view().view({.base_mip_level = 0, .level_count = 4});
+        auto task_image_mip_view = texture->task_image.view().view({.base_mip_level = 0, .level_count = mip_level_n});
 
         mip_task_list.add_task({
             .attachments = {
                 daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_image_mip_view),
             },
-            .task = [texture_staging_buffer, task_image_mip_view, sx, sy](daxa::TaskInterface const &ti) {
-                ti.recorder.copy_buffer_to_image({
-                    .buffer = texture_staging_buffer,
-                    .image = ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0],
-                    .image_layout = ti.get(daxa::TaskImageAttachmentIndex{0}).layout,
-                    .image_offset = {0, 0, 0},
-                    .image_extent = {sx, sy, 1},
-                });
-            },
-            .name = "upload",
-        });
-        for (uint32_t i = 0; i < 3; ++i) {
-            auto view_a = texture->task_image.view().view({.base_mip_level = i});
-            auto view_b = texture->task_image.view().view({.base_mip_level = i + 1});
-            mip_task_list.add_task({
-                .attachments = {
-                    daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, view_a),
-                    daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, view_b),
-                },
-                .task = [=, &device](daxa::TaskInterface const &ti) {
-                    auto image_a = ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0];
-                    auto image_b = ti.get(daxa::TaskImageAttachmentIndex{1}).ids[0];
-                    auto image_info = device.info_image(image_a).value();
-                    auto mip_size = std::array<int32_t, 3>{std::max<int32_t>(1, static_cast<int32_t>(image_info.size.x)), std::max<int32_t>(1, static_cast<int32_t>(image_info.size.y)), std::max<int32_t>(1, static_cast<int32_t>(image_info.size.z))};
-                    for (uint32_t j = 0; j < i; ++j) {
-                        mip_size = {std::max<int32_t>(1, mip_size[0] / 2), std::max<int32_t>(1, mip_size[1] / 2), std::max<int32_t>(1, mip_size[2] / 2)};
-                    }
-                    auto next_mip_size = std::array<int32_t, 3>{std::max<int32_t>(1, mip_size[0] / 2), std::max<int32_t>(1, mip_size[1] / 2), std::max<int32_t>(1, mip_size[2] / 2)};
-                    ti.recorder.blit_image_to_image({
-                        .src_image = image_a,
-                        .src_image_layout = ti.get(daxa::TaskImageAttachmentIndex{0}).layout,
-                        .dst_image = image_b,
-                        .dst_image_layout = ti.get(daxa::TaskImageAttachmentIndex{1}).layout,
-                        .src_slice = {
-                            .mip_level = i,
-                            .base_array_layer = 0,
-                            .layer_count = 1,
-                        },
-                        .src_offsets = {{{0, 0, 0}, {mip_size[0], mip_size[1], mip_size[2]}}},
-                        .dst_slice = {
-                            .mip_level = i + 1,
+            .task = [texture_staging_buffer, staging_offset, sx, sy, mip_level_n](daxa::TaskInterface const &ti) {
+                auto level_offset = staging_offset;
+                for (uint32_t level_i = 0; level_i < mip_level_n; ++level_i) {
+                    auto const level_x = std::max(1u, sx >> level_i);
+                    auto const level_y = std::max(1u, sy >> level_i);
+                    ti.recorder.copy_buffer_to_image({
+                        .buffer = texture_staging_buffer,
+                        .buffer_offset = level_offset,
+                        .image = ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0],
+                        .image_layout = ti.get(daxa::TaskImageAttachmentIndex{0}).layout,
+                        .image_slice = {
+                            .mip_level = level_i,
                             .base_array_layer = 0,
                             .layer_count = 1,
                         },
-                        .dst_offsets = {{{0, 0, 0}, {next_mip_size[0], next_mip_size[1], next_mip_size[2]}}},
-                        .filter = daxa::Filter::LINEAR,
+                        .image_offset = {0, 0, 0},
+                        .image_extent = {level_x, level_y, 1},
                     });
-                },
-                .name = "mip_level_" + std::to_string(i),
-            });
-        }
+                    level_offset += size_t{level_x} * level_y * 4;
+                }
+            },
+            .name = "upload",
+        });
         mip_task_list.add_task({
             .attachments = {
-                daxa::inl_attachment(daxa::TaskImageAccess::FRAGMENT_SHADER_SAMPLED, daxa::ImageViewType::REGULAR_2D, texture->task_image.view().view({.base_mip_level = 0, .level_count = 4})),
+                daxa::inl_attachment(daxa::TaskImageAccess::FRAGMENT_SHADER_SAMPLED, daxa::ImageViewType::REGULAR_2D, task_image_mip_view),
             },
             .task = [](daxa::TaskInterface const &) {},
             .name = "Transition",
         });
+        staging_offset += texture->pixel_data.size();
     }
 
     mip_task_list.submit({});
     mip_task_list.complete({});
     mip_task_list.execute({});
     device.wait_idle();
-    for (auto texture_staging_buffer : texture_staging_buffers) {
-        device.destroy_buffer(texture_staging_buffer);
-    }
-    for (auto *fi_bitmap : fi_bitmaps) {
-        FreeImage_Unload(fi_bitmap);
-    }
+    device.destroy_buffer(texture_staging_buffer);
 }
@@ -3,17 +3,23 @@
 #include <daxa/daxa.hpp>
 #include <daxa/utils/task_graph.hpp>
 #include <utilities/mesh/mesh_model.inl>
+#include <utilities/mesh/indexed_mesh.hpp>
+
+struct ThreadPool;
 
 struct Texture {
     std::filesystem::path path;
     daxa::ImageId image_id;
     daxa::TaskImage task_image;
     daxa_u32 size_x, size_y;
-    daxa_i32 channel_n;
+    daxa_u32 mip_level_n;
+    // 32-bit sRGB BGRA, rows as FreeImage stores them. Every mip level, one after another, starting
+    // with the full size one (see texture_pixels.hpp), so that the whole chain uploads as is.
     uint8_t const *pixels;
+    std::vector<uint8_t> pixel_data;
 };
 struct Mesh {
-    std::vector<MeshVertex> verts;
+    IndexedMesh geometry;
     std::vector<std::shared_ptr<Texture>> textures;
     daxa_f32mat4x4 modl_mat;
     daxa::BufferId vertex_buffer;
@@ -23,8 +29,30 @@ using TextureMap = std::unordered_map<std::string, std::shared_ptr<Texture>>;
 struct MeshModel {
     TextureMap textures;
     std::vector<Mesh> meshes;
+    // Of every mesh's bounding box, after its transform.
     daxa_f32vec3 bound_min;
     daxa_f32vec3 bound_max;
 };
 
+struct MeshTextureLoadStats {
+    uint32_t texture_n = 0;
+    // Textures whose file had the same contents as another's, and that now share its Texture.
+    uint32_t duplicate_n = 0;
+    // Textures that couldn't be read or decoded, and got the default texture instead.
+    uint32_t failed_n = 0;
+    uint64_t file_bytes = 0;
+    uint64_t pixel_bytes = 0;
+    // Wall-clock time of reading and hashing the files, and of decoding the distinct ones.
+    double hash_ms = 0.0;
+    double decode_ms = 0.0;
+    // Where the decoding went, summed over threads.
+    double image_decode_cpu_ms = 0.0;
+    double convert_cpu_ms = 0.0;
+    double mip_cpu_ms = 0.0;
+};
+
+// Loads the geometry and decodes the textures without touching the GPU. The textures are decoded
+// on `thread_pool` if given. Textures with the same file contents are only decoded once, and share
+// one Texture, so model.textures only holds the distinct ones.
+auto load_mesh_model(MeshModel &model, std::filesystem::path const &filepath, ThreadPool *thread_pool = nullptr, MeshTextureLoadStats *stats = nullptr) -> bool;
 void open_mesh_model(daxa::Device device, MeshModel &model, std::filesystem::path const &filepath, std::string const &name);
@@ -0,0 +1,445 @@
+#include "mesh_voxelizer.hpp"
+
+#include <utilities/thread_pool.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <span>
+
+namespace {
+    // Triangles are binned into tiles, and each tile is voxelized by a single job. Tiles never share
+    // bricks, so the jobs don't need to synchronize, and the triangle order (later triangles win,
+    // like the rasterizer's last write) stays the same no matter how many threads run.
+    constexpr uint32_t TILE_SIZE = 64;
+    constexpr uint32_t BRICK_SIZE = MeshVoxelBrick::SIZE;
+
+    // A mesh's unique vertices, each transformed once, and its triangles, which are read through
+    // its indices while binning and voxelizing rather than expanded up front.
+    struct VoxelizerMesh {
+        // Null for a triangle soup, whose vertices are in triangle order.
+        IndexedMesh const *geometry;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> tex;
+        Texture const *texture;
+
+        auto triangle(size_t tri_i) const -> std::array<uint32_t, 3> {
+            if (geometry == nullptr) {
+                auto const first = static_cast<uint32_t>(tri_i * 3);
+                return {first, first + 1, first + 2};
+            }
+            return {geometry->index(tri_i * 3), geometry->index(tri_i * 3 + 1), geometry->index(tri_i * 3 + 2)};
+        }
+    };
+
+    struct VoxelizerTriangleRef {
+        uint32_t mesh_i;
+        uint32_t triangle_i;
+    };
+
+    struct VoxelizerTile {
+        glm::uvec3 min;
+        glm::uvec3 max;
+        std::vector<VoxelizerTriangleRef> triangles;
+        std::vector<MeshVoxelBrick> bricks;
+        std::unordered_map<uint64_t, uint32_t> brick_lookup;
+    };
+
+    auto msign(glm::vec2 v) -> glm::vec2 {
+        return {v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f};
+    }
+
+    // CPU versions of the packing functions used by the GPU voxelizer.
+    auto octahedral_8(glm::vec3 nor) -> uint32_t {
+        auto xy = glm::vec2(nor.x, nor.y) / (std::abs(nor.x) + std::abs(nor.y) + std::abs(nor.z));
+        if (nor.z < 0.0f) {
+            xy = (1.0f - glm::abs(glm::vec2(xy.y, xy.x))) * msign(xy);
+        }
+        auto d = glm::round(7.5f + xy * 7.5f);
+        return static_cast<uint32_t>(d.x) | (static_cast<uint32_t>(d.y) << 4);
+    }
+
+    auto pack_unit(float x, uint32_t bit_n) -> uint32_t {
+        auto scl = static_cast<float>((1u << bit_n) - 1);
+        return static_cast<uint32_t>(std::round(x * scl));
+    }
+
+    auto pack_base(glm::vec3 normal) -> uint32_t {
+        auto const material_type = 1u;
+        auto const roughness = 0.9f;
+        return material_type | (pack_unit(std::sqrt(roughness), 4) << 2) | (octahedral_8(normal) << 6);
+    }
+
+    // The GPU path samples an sRGB texture and packs pow(linear, 1/2.2), which gives back the
+    // stored byte (up to the difference between the sRGB curve and a 2.2 gamma).
+    auto pack_texel(Texture const *texture, glm::vec2 uv) -> uint32_t {
+        if (texture == nullptr || texture->pixels == nullptr || texture->size_x == 0 || texture->size_y == 0) {
+            return 0x3ffffu << 14;
+        }
+        auto u = uv.x - std::floor(uv.x);
+        auto v = uv.y - std::floor(uv.y);
+        auto x = std::min(static_cast<uint32_t>(u * static_cast<float>(texture->size_x)), texture->size_x - 1);
+        auto y = std::min(static_cast<uint32_t>(v * static_cast<float>(texture->size_y)), texture->size_y - 1);
+        auto const *texel = texture->pixels + (size_t{y} * texture->size_x + x) * 4;
+        auto to_6bit = [](uint8_t c) { return static_cast<uint32_t>(c) * 63 / 255; };
+        auto color = to_6bit(texel[2]) | (to_6bit(texel[1]) << 6) | (to_6bit(texel[0]) << 12);
+        return color << 14;
+    }
+
+    // Akenine-Möller's triangle/box overlap test, for a box of half size 0.5 centered at `center`.
+    auto triangle_overlaps_voxel(glm::vec3 center, std::array<glm::vec3, 3> const &tri, glm::vec3 normal) -> bool {
+        auto const v0 = tri[0] - center;
+        auto const v1 = tri[1] - center;
+        auto const v2 = tri[2] - center;
+        auto const e0 = v1 - v0;
+        auto const e1 = v2 - v1;
+        auto const e2 = v0 - v2;
+        auto const half = 0.5f;
+
+        auto axis_test = [&](glm::vec3 axis) -> bool {
+            auto p0 = glm::dot(v0, axis);
+            auto p1 = glm::dot(v1, axis);
+            auto p2 = glm::dot(v2, axis);
+            auto r = half * (std::abs(axis.x) + std::abs(axis.y) + std::abs(axis.z));
+            return std::min({p0, p1, p2}) <= r && std::max({p0, p1, p2}) >= -r;
+        };
+
+        for (auto const &e : {e0, e1, e2}) {
+            if (!axis_test({0.0f, -e.z, e.y}) || !axis_test({e.z, 0.0f, -e.x}) || !axis_test({-e.y, e.x, 0.0f})) {
+                return false;
+            }
+        }
+        auto const tri_min = glm::min(v0, glm::min(v1, v2));
+        auto const tri_max = glm::max(v0, glm::max(v1, v2));
+        if (tri_min.x > half || tri_max.x < -half || tri_min.y > half || tri_max.y < -half || tri_min.z > half || tri_max.z < -half) {
+            return false;
+        }
+        return axis_test(normal);
+    }
+
+    auto barycentric(glm::vec3 p, std::array<glm::vec3, 3> const &tri) -> glm::vec3 {
+        auto const e0 = tri[1] - tri[0];
+        auto const e1 = tri[2] - tri[0];
+        auto const ep = p - tri[0];
+        auto const d00 = glm::dot(e0, e0);
+        auto const d01 = glm::dot(e0, e1);
+        auto const d11 = glm::dot(e1, e1);
+        auto const d20 = glm::dot(ep, e0);
+        auto const d21 = glm::dot(ep, e1);
+        auto const denom = d00 * d11 - d01 * d01;
+        if (denom <= 0.0f) {
+            return {1.0f, 0.0f, 0.0f};
+        }
+        auto const v = (d11 * d20 - d01 * d21) / denom;
+        auto const w = (d00 * d21 - d01 * d20) / denom;
+        // Voxel centers can be just outside the triangle, so clamp to its closest point.
+        auto result = glm::max(glm::vec3(1.0f - v - w, v, w), glm::vec3(0.0f));
+        return result / (result.x + result.y + result.z);
+    }
+
+    void write_voxel(VoxelizerTile &tile, glm::uvec3 p, uint32_t value) {
+        auto const brick_p = p / BRICK_SIZE;
+        auto const key = VoxelizedMesh::brick_key(brick_p.x, brick_p.y, brick_p.z);
+        auto [iter, inserted] = tile.brick_lookup.try_emplace(key, static_cast<uint32_t>(tile.bricks.size()));
+        if (inserted) {
+            tile.bricks.emplace_back();
+        }
+        auto const in_brick = p % BRICK_SIZE;
+        tile.bricks[iter->second].voxels[in_brick.x + in_brick.y * BRICK_SIZE + in_brick.z * BRICK_SIZE * BRICK_SIZE] = value;
+    }
+
+    // `mesh`'s positions must be in voxel space.
+    void voxelize_triangle(VoxelizerTile &tile, VoxelizerMesh const &mesh, size_t tri_i) {
+        auto const vert_is = mesh.triangle(tri_i);
+        auto const pos = std::array{mesh.positions[vert_is[0]], mesh.positions[vert_is[1]], mesh.positions[vert_is[2]]};
+        auto const normal = glm::cross(pos[1] - pos[0], pos[2] - pos[0]);
+        auto const abs_normal = glm::abs(normal);
+        if (abs_normal.x + abs_normal.y + abs_normal.z == 0.0f) {
+            return;
+        }
+
+        auto const tri_min_f = glm::floor(glm::min(pos[0], glm::min(pos[1], pos[2])));
+        auto const tri_max_f = glm::floor(glm::max(pos[0], glm::max(pos[1], pos[2])));
+        auto const lo = glm::max(glm::ivec3(tri_min_f), glm::ivec3(tile.min));
+        auto const hi = glm::min(glm::ivec3(tri_max_f), glm::ivec3(tile.max) - 1);
+        if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z) {
+            return;
+        }
+        auto const tex = std::array{mesh.tex[vert_is[0]], mesh.tex[vert_is[1]], mesh.tex[vert_is[2]]};
+        // Everything but the colour, see pack_voxel in voxels/pack_unpack.glsl
+        auto const normal_len = glm::length(normal);
+        auto const packed_base = pack_base(normal_len > 0.0f ? normal / normal_len : glm::vec3(0, 0, 1));
+
+        // Walk the voxel columns along the normal's dominant axis. In each column, only the voxels
+        // between the triangle's plane at the column's corners can overlap it.
+        auto const d = abs_normal.x > abs_normal.y ? (abs_normal.x > abs_normal.z ? 0 : 2) : (abs_normal.y > abs_normal.z ? 1 : 2);
+        auto const a = (d + 1) % 3;
+        auto const b = (d + 2) % 3;
+        auto const plane_d = glm::dot(normal, pos[0]);
+
+        for (auto ia = lo[a]; ia <= hi[a]; ++ia) {
+            for (auto ib = lo[b]; ib <= hi[b]; ++ib) {
+                auto depth_min = std::numeric_limits<float>::max();
+                auto depth_max = std::numeric_limits<float>::lowest();
+                for (auto corner_a : {ia, ia + 1}) {
+                    for (auto corner_b : {ib, ib + 1}) {
+                        auto depth = (plane_d - normal[a] * static_cast<float>(corner_a) - normal[b] * static_cast<float>(corner_b)) / normal[d];
+                        depth_min = std::min(depth_min, depth);
+                        depth_max = std::max(depth_max, depth);
+                    }
+                }
+                // The slack keeps float error from dropping voxels the plane only just touches.
+                auto const id_lo = std::max(lo[d], static_cast<int>(std::floor(depth_min - 1.0e-3f)));
+                auto const id_hi = std::min(hi[d], static_cast<int>(std::floor(depth_max + 1.0e-3f)));
+                for (auto id = id_lo; id <= id_hi; ++id) {
+                    auto p = glm::ivec3{};
+                    p[a] = ia;
+                    p[b] = ib;
+                    p[d] = id;
+                    auto const center = glm::vec3(p) + 0.5f;
+                    if (!triangle_overlaps_voxel(center, pos, normal)) {
+                        continue;
+                    }
+                    auto const bary = barycentric(center, pos);
+                    auto const uv = tex[0] * bary.x + tex[1] * bary.y + tex[2] * bary.z;
+                    write_voxel(tile, glm::uvec3(p), packed_base | pack_texel(mesh.texture, uv));
+                }
+            }
+        }
+    }
+
+    void run_parallel(ThreadPool *thread_pool, size_t count, size_t batch_size, std::function<void(size_t, size_t)> const &f) {
+        if (thread_pool != nullptr) {
+            thread_pool->parallel_for(count, batch_size, f);
+        } else if (count > 0) {
+            f(0, count);
+        }
+    }
+
+    // Consecutive triangles, binned into tiles all at once when their bounds fall within one tile,
+    // which is most of the time.
+    struct VoxelizerTriangleGroup {
+        uint32_t mesh_i;
+        size_t first_triangle;
+        size_t triangle_n;
+        // In model space.
+        glm::vec3 bound_min;
+        glm::vec3 bound_max;
+    };
+
+    // Voxelizes meshes whose vertices are in model space, every triangle of them in one of `groups`.
+    // Every vertex must be used by a triangle, since the vertices make the bounds.
+    auto voxelize_triangles(std::span<VoxelizerMesh> meshes, std::span<VoxelizerTriangleGroup const> groups, MeshVoxelizerInfo const &info, ThreadPool *thread_pool) -> VoxelizedMesh {
+        auto result = VoxelizedMesh{};
+        if (groups.empty() || info.resolution == 0) {
+            return result;
+        }
+
+        auto bound_min = glm::vec3(std::numeric_limits<float>::max());
+        auto bound_max = glm::vec3(std::numeric_limits<float>::lowest());
+        for (auto const &mesh : meshes) {
+            for (auto const &p : mesh.positions) {
+                bound_min = glm::min(bound_min, p);
+                bound_max = glm::max(bound_max, p);
+            }
+        }
+        auto const bound_range = bound_max - bound_min;
+        auto const max_extent = std::max({bound_range.x, bound_range.y, bound_range.z, std::numeric_limits<float>::min()});
+        auto const scale = static_cast<float>(info.resolution) / max_extent;
+        auto const size = glm::max(glm::uvec3(glm::ceil(bound_range * scale)), glm::uvec3(1));
+        result.size = {size.x, size.y, size.z};
+
+        // Into voxel space. Keep a hair away from the far faces, so that the longest axis doesn't
+        // produce a slice of voxels past the end of the grid.
+        auto const voxel_scale = scale * (1.0f - 1.0e-6f);
+        for (auto &mesh : meshes) {
+            run_parallel(thread_pool, mesh.positions.size(), 4096, [&](size_t begin, size_t end) {
+                for (size_t vert_i = begin; vert_i < end; ++vert_i) {
+                    mesh.positions[vert_i] = (mesh.positions[vert_i] - bound_min) * voxel_scale;
+                }
+            });
+        }
+
+        auto const tile_n = (size + TILE_SIZE - 1u) / TILE_SIZE;
+        auto tiles = std::vector<VoxelizerTile>(size_t{tile_n.x} * tile_n.y * tile_n.z);
+        for (uint32_t zi = 0; zi < tile_n.z; ++zi) {
+            for (uint32_t yi = 0; yi < tile_n.y; ++yi) {
+                for (uint32_t xi = 0; xi < tile_n.x; ++xi) {
+                    auto &tile = tiles[xi + yi * tile_n.x + zi * tile_n.x * tile_n.y];
+                    tile.min = glm::uvec3(xi, yi, zi) * TILE_SIZE;
+                    tile.max = glm::min(tile.min + TILE_SIZE, size);
+                }
+            }
+        }
+        auto const tile_range = [&](glm::vec3 min, glm::vec3 max) {
+            auto const to_tile = [&](glm::vec3 p) { return glm::min(glm::uvec3(glm::clamp(p, glm::vec3(0.0f), glm::vec3(size))) / TILE_SIZE, tile_n - 1u); };
+            return std::array{to_tile(min), to_tile(max)};
+        };
+        for (auto const &group : groups) {
+            // Padded by a little, since the group's bounds and its triangles were transformed separately.
+            auto const group_range = tile_range((group.bound_min - bound_min) * voxel_scale - 0.01f, (group.bound_max - bound_min) * voxel_scale + 0.01f);
+            if (group_range[0] == group_range[1]) {
+                auto &tile_triangles = tiles[group_range[0].x + group_range[0].y * tile_n.x + group_range[0].z * tile_n.x * tile_n.y].triangles;
+                for (auto tri_i = group.first_triangle; tri_i < group.first_triangle + group.triangle_n; ++tri_i) {
+                    tile_triangles.push_back({group.mesh_i, static_cast<uint32_t>(tri_i)});
+                }
+                continue;
+            }
+            auto const &mesh = meshes[group.mesh_i];
+            for (auto tri_i = group.first_triangle; tri_i < group.first_triangle + group.triangle_n; ++tri_i) {
+                auto const vert_is = mesh.triangle(tri_i);
+                auto const &p0 = mesh.positions[vert_is[0]];
+                auto const &p1 = mesh.positions[vert_is[1]];
+                auto const &p2 = mesh.positions[vert_is[2]];
+                auto const [tile_min, tile_max] = tile_range(glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2)));
+                for (uint32_t zi = tile_min.z; zi <= tile_max.z; ++zi) {
+                    for (uint32_t yi = tile_min.y; yi <= tile_max.y; ++yi) {
+                        for (uint32_t xi = tile_min.x; xi <= tile_max.x; ++xi) {
+                            tiles[xi + yi * tile_n.x + zi * tile_n.x * tile_n.y].triangles.push_back({group.mesh_i, static_cast<uint32_t>(tri_i)});
+                        }
+                    }
+                }
+            }
+        }
+
+        auto active_tiles = std::vector<VoxelizerTile *>{};
+        for (auto &tile : tiles) {
+            if (!tile.triangles.empty()) {
+                active_tiles.push_back(&tile);
+            }
+        }
+        auto is_cancelled = [&info]() { return info.cancelled != nullptr && info.cancelled->load(std::memory_order_relaxed); };
+        auto finished_tile_n = std::atomic_size_t{0};
+        run_parallel(thread_pool, active_tiles.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (is_cancelled()) {
+                    return;
+                }
+                auto &tile = *active_tiles[i];
+                for (auto const &tri : tile.triangles) {
+                    voxelize_triangle(tile, meshes[tri.mesh_i], tri.triangle_i);
+                }
+                tile.triangles = {};
+                auto const done_n = finished_tile_n.fetch_add(1, std::memory_order_relaxed) + 1;
+                if (info.progress != nullptr) {
+                    info.progress->store(static_cast<float>(done_n) / static_cast<float>(active_tiles.size()), std::memory_order_relaxed);
+                }
+            }
+        });
+        if (is_cancelled()) {
+            return {};
+        }
+
+        auto brick_n = size_t{0};
+        for (auto const *tile : active_tiles) {
+            brick_n += tile->bricks.size();
+        }
+        result.bricks.reserve(brick_n);
+        result.brick_lookup.reserve(brick_n);
+        for (auto *tile : active_tiles) {
+            for (auto const &[key, brick_i] : tile->brick_lookup) {
+                result.brick_lookup.emplace(key, static_cast<uint32_t>(result.bricks.size()));
+                result.bricks.push_back(tile->bricks[brick_i]);
+            }
+            tile->bricks = {};
+            tile->brick_lookup = {};
+        }
+
+        return result;
+    }
+} // namespace
+
+auto VoxelizedMesh::find_brick(uint32_t brick_x, uint32_t brick_y, uint32_t brick_z) const -> MeshVoxelBrick const * {
+    auto iter = brick_lookup.find(brick_key(brick_x, brick_y, brick_z));
+    if (iter == brick_lookup.end()) {
+        return nullptr;
+    }
+    return &bricks[iter->second];
+}
+
+auto VoxelizedMesh::sample(uint32_t x, uint32_t y, uint32_t z) const -> uint32_t {
+    auto const *brick = find_brick(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+    if (brick == nullptr) {
+        return 0;
+    }
+    return brick->voxels[(x % BRICK_SIZE) + (y % BRICK_SIZE) * BRICK_SIZE + (z % BRICK_SIZE) * BRICK_SIZE * BRICK_SIZE];
+}
+
+auto voxelize_mesh(MeshModel const &model, MeshVoxelizerInfo const &info, ThreadPool *thread_pool) -> VoxelizedMesh {
+    auto group_n = size_t{0};
+    for (auto const &mesh : model.meshes) {
+        group_n += mesh.geometry.meshlets.size();
+    }
+    if (group_n == 0 || info.resolution == 0) {
+        return {};
+    }
+
+    // Transform into model space. Each vertex is transformed once, however many triangles use it.
+    // The bounds are taken from the transformed vertices rather than model.bound_min/max, which
+    // come from the meshes' bounding boxes.
+    auto meshes = std::vector<VoxelizerMesh>(model.meshes.size());
+    auto groups = std::vector<VoxelizerTriangleGroup>{};
+    groups.reserve(group_n);
+    for (size_t mesh_i = 0; mesh_i < model.meshes.size(); ++mesh_i) {
+        auto const &model_mesh = model.meshes[mesh_i];
+        auto const &geometry = model_mesh.geometry;
+        auto const &modl_mat = *reinterpret_cast<glm::mat4 const *>(&model_mesh.modl_mat);
+        auto &mesh = meshes[mesh_i];
+        mesh.geometry = &geometry;
+        mesh.texture = model_mesh.textures.empty() ? nullptr : model_mesh.textures[0].get();
+        mesh.positions.resize(geometry.vertex_n());
+        mesh.tex.resize(geometry.vertex_n());
+        run_parallel(thread_pool, geometry.vertex_n(), 4096, [&](size_t begin, size_t end) {
+            for (size_t vert_i = begin; vert_i < end; ++vert_i) {
+                mesh.positions[vert_i] = glm::vec3(modl_mat * glm::vec4(geometry.position(static_cast<uint32_t>(vert_i)), 1.0f));
+                mesh.tex[vert_i] = geometry.tex(static_cast<uint32_t>(vert_i));
+            }
+        });
+        for (auto const &meshlet : geometry.meshlets) {
+            auto const local_min = geometry.meshlet_bound_min(meshlet);
+            auto const local_max = geometry.meshlet_bound_max(meshlet);
+            auto group = VoxelizerTriangleGroup{
+                .mesh_i = static_cast<uint32_t>(mesh_i),
+                .first_triangle = meshlet.first_triangle,
+                .triangle_n = meshlet.triangle_n,
+                .bound_min = glm::vec3(std::numeric_limits<float>::max()),
+                .bound_max = glm::vec3(std::numeric_limits<float>::lowest()),
+            };
+            for (uint32_t corner_i = 0; corner_i < 8; ++corner_i) {
+                auto const corner = glm::vec3(
+                    (corner_i & 1) != 0 ? local_max.x : local_min.x,
+                    (corner_i & 2) != 0 ? local_max.y : local_min.y,
+                    (corner_i & 4) != 0 ? local_max.z : local_min.z);
+                auto const p = glm::vec3(modl_mat * glm::vec4(corner, 1.0f));
+                group.bound_min = glm::min(group.bound_min, p);
+                group.bound_max = glm::max(group.bound_max, p);
+            }
+            groups.push_back(group);
+        }
+    }
+    return voxelize_triangles(meshes, groups, info, thread_pool);
+}
+
+auto voxelize_triangle_soup(std::span<glm::vec3 const> positions, std::span<glm::vec2 const> tex, MeshVoxelizerInfo const &info, ThreadPool *thread_pool) -> VoxelizedMesh {
+    auto const triangle_n = positions.size() / 3;
+    auto mesh = VoxelizerMesh{
+        .geometry = nullptr,
+        .positions = {positions.begin(), positions.begin() + static_cast<std::ptrdiff_t>(triangle_n * 3)},
+        .tex = {tex.begin(), tex.begin() + static_cast<std::ptrdiff_t>(triangle_n * 3)},
+        .texture = nullptr,
+    };
+    if (triangle_n == 0) {
+        return {};
+    }
+    auto const everything = VoxelizerTriangleGroup{
+        .mesh_i = 0,
+        .first_triangle = 0,
+        .triangle_n = triangle_n,
+        .bound_min = glm::vec3(std::numeric_limits<float>::lowest()),
+        .bound_max = glm::vec3(std::numeric_limits<float>::max()),
+    };
+    return voxelize_triangles(std::span{&mesh, 1}, std::span{&everything, 1}, info, thread_pool);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <utilities/mesh/mesh_model.hpp>
+
+#include <array>
+#include <atomic>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct ThreadPool;
+
+struct MeshVoxelizerInfo {
+    // Number of voxels along the longest side of the model's bounding box. The other sides are
+    // scaled to keep the model's proportions.
+    uint32_t resolution = 768;
+    // Optional. Goes from 0 to 1 as tiles finish, and stops the voxelization (with an empty result)
+    // once `cancelled` is set.
+    std::atomic<float> *progress = nullptr;
+    std::atomic_bool const *cancelled = nullptr;
+};
+
+struct MeshVoxelBrick {
+    static constexpr uint32_t SIZE = 8;
+    // Packed voxels (see pack_voxel in voxels/pack_unpack.glsl), 0 is air.
+    std::array<uint32_t, SIZE * SIZE * SIZE> voxels{};
+};
+
+// Only the bricks that a triangle touched are stored, so memory scales with the model's surface
+// area rather than with the volume of its bounding box.
+struct VoxelizedMesh {
+    daxa_u32vec3 size{};
+    std::vector<MeshVoxelBrick> bricks;
+    std::unordered_map<uint64_t, uint32_t> brick_lookup;
+
+    static auto brick_key(uint32_t brick_x, uint32_t brick_y, uint32_t brick_z) -> uint64_t {
+        return uint64_t{brick_x} | (uint64_t{brick_y} << 21) | (uint64_t{brick_z} << 42);
+    }
+    auto find_brick(uint32_t brick_x, uint32_t brick_y, uint32_t brick_z) const -> MeshVoxelBrick const *;
+    auto sample(uint32_t x, uint32_t y, uint32_t z) const -> uint32_t;
+};
+
+// Conservatively voxelizes every triangle of `model` (a voxel is filled when it overlaps a
+// triangle) and colours it with the triangle's first texture. Runs on `thread_pool` if given.
+auto voxelize_mesh(MeshModel const &model, MeshVoxelizerInfo const &info, ThreadPool *thread_pool) -> VoxelizedMesh;
+
+// Voxelizes an untextured triangle soup, three vertices per triangle, straight from its floats
+// rather than through an IndexedMesh.
+auto voxelize_triangle_soup(std::span<glm::vec3 const> positions, std::span<glm::vec2 const> tex, MeshVoxelizerInfo const &info, ThreadPool *thread_pool) -> VoxelizedMesh;
@@ -0,0 +1,54 @@
+#include <utilities/log.hpp>
+#include <utilities/mesh/mesh_model.hpp>
+#include <utilities/mesh/mesh_voxelizer.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <FreeImage.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+
+// Loads a mesh model into IndexedMeshes, and voxelizes it on the thread pool.
+// Usage: gvox_engine_mesh_voxelizer_bench <mesh model>
+
+auto main(int argc, char const *argv[]) -> int {
+    if (argc < 2) {
+        fmt::print("Usage: gvox_engine_mesh_voxelizer_bench <mesh model>\n");
+        return 1;
+    }
+    using Clock = std::chrono::steady_clock;
+    auto const elapsed_ms = [](Clock::time_point begin) { return std::chrono::duration<double, std::milli>(Clock::now() - begin).count(); };
+    auto const model_path = std::filesystem::path{argv[1]};
+
+    auto logger = Logger{{make_stdout_log_sink()}};
+    auto thread_pool = ThreadPool{};
+    thread_pool.start();
+    FreeImage_Initialise();
+
+    auto model = MeshModel{};
+    auto const load_start = Clock::now();
+    if (!load_mesh_model(model, model_path, &thread_pool)) {
+        log_error("Failed to load the mesh model '{}'", model_path.string());
+        FreeImage_DeInitialise();
+        return 1;
+    }
+    auto const load_ms = elapsed_ms(load_start);
+    auto triangle_n = size_t{0};
+    auto vertex_n = size_t{0};
+    auto mesh_bytes = size_t{0};
+    for (auto const &mesh : model.meshes) {
+        triangle_n += mesh.geometry.triangle_n();
+        vertex_n += mesh.geometry.vertex_n();
+        mesh_bytes += mesh.geometry.memory_size();
+    }
+    auto const voxelize_start = Clock::now();
+    auto const voxelized = voxelize_mesh(model, {}, &thread_pool);
+    auto const voxelize_ms = elapsed_ms(voxelize_start);
+    fmt::print("'{}': {} meshes, {} triangles, {} vertices ({:.2f} per triangle corner), {:.2f} MB as triangle soup, {:.2f} MB indexed\n",
+               model_path.string(), model.meshes.size(), triangle_n, vertex_n, static_cast<double>(vertex_n) / static_cast<double>(std::max<size_t>(1, triangle_n * 3)),
+               static_cast<double>(sizeof(MeshVertex) * triangle_n * 3) / static_cast<double>(1 << 20), static_cast<double>(mesh_bytes) / static_cast<double>(1 << 20));
+    fmt::print("Loaded in {:.1f} ms, voxelized into {} bricks in {:.1f} ms\n", load_ms, voxelized.bricks.size(), voxelize_ms);
+    FreeImage_DeInitialise();
+    return 0;
+}
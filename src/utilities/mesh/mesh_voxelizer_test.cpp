@@ -0,0 +1,198 @@
+#include <utilities/mesh/mesh_voxelizer.hpp>
+#include <utilities/thread_pool.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr uint32_t RESOLUTION = 256;
+
+    struct MeshCoverage {
+        uint64_t voxel_n = 0;
+        // Voxels that only one of the two voxelizations covers.
+        uint64_t mismatch_n = 0;
+        // Mismatches that the other voxelization doesn't cover any neighbour of, which the
+        // quantization can't explain.
+        uint64_t unexplained_n = 0;
+    };
+
+    struct TriangleSoup {
+        std::string name;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> tex;
+    };
+
+    // A heightfield of `n` x `n` quads, like a photogrammetry scan, where most vertices are shared
+    // by six triangles.
+    auto make_grid_soup(uint32_t n, std::mt19937 &rng) -> TriangleSoup {
+        auto soup = TriangleSoup{.name = "grid", .positions = {}, .tex = {}};
+        auto noise = std::uniform_real_distribution<float>{-0.02f, 0.02f};
+        auto heights = std::vector<float>(size_t{n + 1} * (n + 1));
+        for (uint32_t yi = 0; yi <= n; ++yi) {
+            for (uint32_t xi = 0; xi <= n; ++xi) {
+                auto const x = static_cast<float>(xi) / static_cast<float>(n);
+                auto const y = static_cast<float>(yi) / static_cast<float>(n);
+                heights[xi + yi * (n + 1)] = 0.2f * std::sin(x * 9.0f) * std::cos(y * 7.0f) + noise(rng);
+            }
+        }
+        auto const add_vertex = [&](uint32_t xi, uint32_t yi) {
+            auto const x = static_cast<float>(xi) / static_cast<float>(n);
+            auto const y = static_cast<float>(yi) / static_cast<float>(n);
+            soup.positions.push_back({x, heights[xi + yi * (n + 1)], y});
+            soup.tex.push_back({x, y});
+        };
+        for (uint32_t yi = 0; yi < n; ++yi) {
+            for (uint32_t xi = 0; xi < n; ++xi) {
+                add_vertex(xi, yi), add_vertex(xi + 1, yi), add_vertex(xi + 1, yi + 1);
+                add_vertex(xi, yi), add_vertex(xi + 1, yi + 1), add_vertex(xi, yi + 1);
+            }
+        }
+        return soup;
+    }
+
+    // The vertices along the seam share their position but not their UV, so they must stay apart.
+    auto make_sphere_soup(uint32_t stack_n, uint32_t slice_n) -> TriangleSoup {
+        auto soup = TriangleSoup{.name = "sphere", .positions = {}, .tex = {}};
+        auto const add_vertex = [&](uint32_t stack_i, uint32_t slice_i) {
+            auto const u = static_cast<float>(slice_i) / static_cast<float>(slice_n);
+            auto const v = static_cast<float>(stack_i) / static_cast<float>(stack_n);
+            auto const theta = u * 2.0f * std::numbers::pi_v<float>;
+            auto const phi = v * std::numbers::pi_v<float>;
+            soup.positions.push_back({std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)});
+            soup.tex.push_back({u, v});
+        };
+        for (uint32_t stack_i = 0; stack_i < stack_n; ++stack_i) {
+            for (uint32_t slice_i = 0; slice_i < slice_n; ++slice_i) {
+                add_vertex(stack_i, slice_i), add_vertex(stack_i + 1, slice_i), add_vertex(stack_i + 1, slice_i + 1);
+                add_vertex(stack_i, slice_i), add_vertex(stack_i + 1, slice_i + 1), add_vertex(stack_i, slice_i + 1);
+            }
+        }
+        return soup;
+    }
+
+    // Long thin triangles far from the origin, like the ones CAD exports are full of.
+    auto make_sliver_soup(uint32_t triangle_n, std::mt19937 &rng) -> TriangleSoup {
+        auto soup = TriangleSoup{.name = "slivers", .positions = {}, .tex = {}};
+        auto coord = std::uniform_real_distribution<float>{0.0f, 50.0f};
+        auto offset = std::uniform_real_distribution<float>{-0.05f, 0.05f};
+        auto const origin = glm::vec3(1.0e4f, -2.0e4f, 3.0e4f);
+        for (uint32_t tri_i = 0; tri_i < triangle_n; ++tri_i) {
+            auto const a = origin + glm::vec3(coord(rng), coord(rng), coord(rng));
+            auto const b = origin + glm::vec3(coord(rng), coord(rng), coord(rng));
+            auto const c = (a + b) * 0.5f + glm::vec3(offset(rng), offset(rng), offset(rng));
+            for (auto const &p : {a, b, c}) {
+                soup.positions.push_back(p);
+                soup.tex.push_back({0.5f, 0.5f});
+            }
+        }
+        return soup;
+    }
+
+    auto is_covered(VoxelizedMesh const &mesh, glm::ivec3 p) -> bool {
+        if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= static_cast<int>(mesh.size.x) || p.y >= static_cast<int>(mesh.size.y) || p.z >= static_cast<int>(mesh.size.z)) {
+            return false;
+        }
+        return mesh.sample(static_cast<uint32_t>(p.x), static_cast<uint32_t>(p.y), static_cast<uint32_t>(p.z)) != 0;
+    }
+
+    // Adds up the voxels `a` covers and `b` doesn't.
+    void count_coverage_mismatches(VoxelizedMesh const &a, VoxelizedMesh const &b, MeshCoverage &result) {
+        for (auto const &[key, brick_i] : a.brick_lookup) {
+            auto const brick_p = glm::ivec3(static_cast<int>(key & 0x1fffff), static_cast<int>((key >> 21) & 0x1fffff), static_cast<int>(key >> 42)) * static_cast<int>(MeshVoxelBrick::SIZE);
+            auto const &brick = a.bricks[brick_i];
+            for (uint32_t voxel_i = 0; voxel_i < brick.voxels.size(); ++voxel_i) {
+                if (brick.voxels[voxel_i] == 0) {
+                    continue;
+                }
+                auto const p = brick_p + glm::ivec3(static_cast<int>(voxel_i % MeshVoxelBrick::SIZE), static_cast<int>(voxel_i / MeshVoxelBrick::SIZE % MeshVoxelBrick::SIZE), static_cast<int>(voxel_i / (MeshVoxelBrick::SIZE * MeshVoxelBrick::SIZE)));
+                if (is_covered(b, p)) {
+                    continue;
+                }
+                ++result.mismatch_n;
+                auto has_neighbour = false;
+                for (int32_t i = 0; i < 27 && !has_neighbour; ++i) {
+                    has_neighbour = is_covered(b, p + glm::ivec3(i % 3 - 1, i / 3 % 3 - 1, i / 9 - 1));
+                }
+                if (!has_neighbour) {
+                    ++result.unexplained_n;
+                }
+            }
+        }
+    }
+
+    // Voxelizes `soup` both directly and through build_indexed_mesh(), and compares the voxels they
+    // cover. Quantization moves vertices by up to 1/131070 of the mesh's extent, which can only flip
+    // voxels along the surface.
+    auto check_indexed_coverage(TriangleSoup const &soup, size_t expected_vertex_n) -> std::string {
+        auto const triangle_n = soup.positions.size() / 3;
+        auto indices = std::vector<uint32_t>(triangle_n * 3);
+        for (uint32_t i = 0; i < indices.size(); ++i) {
+            indices[i] = i;
+        }
+        auto model = MeshModel{};
+        auto &mesh = model.meshes.emplace_back();
+        auto const identity = glm::mat4(1.0f);
+        std::memcpy(&mesh.modl_mat, &identity, sizeof(identity));
+        mesh.geometry = build_indexed_mesh({.positions = soup.positions, .tex = soup.tex, .indices = indices});
+        if (expected_vertex_n != 0 && mesh.geometry.vertex_n() != expected_vertex_n) {
+            return fmt::format("{} triangle corners were merged into {} vertices, instead of {}", triangle_n * 3, mesh.geometry.vertex_n(), expected_vertex_n);
+        }
+
+        auto *thread_pool = ThreadPool::s_instance;
+        auto const indexed = voxelize_mesh(model, {.resolution = RESOLUTION}, thread_pool);
+        auto const reference = voxelize_triangle_soup(soup.positions, soup.tex, {.resolution = RESOLUTION}, thread_pool);
+        auto coverage = MeshCoverage{};
+        for (auto const &brick : reference.bricks) {
+            coverage.voxel_n += static_cast<uint64_t>(std::count_if(brick.voxels.begin(), brick.voxels.end(), [](uint32_t voxel) { return voxel != 0; }));
+        }
+        count_coverage_mismatches(reference, indexed, coverage);
+        count_coverage_mismatches(indexed, reference, coverage);
+        fmt::print("  {}: {} triangles, {} vertices instead of {}, {:.2f} MB instead of {:.2f} MB, {} voxels, {} mismatched\n", soup.name, triangle_n,
+                   mesh.geometry.vertex_n(), triangle_n * 3, static_cast<double>(mesh.geometry.memory_size()) / static_cast<double>(1 << 20),
+                   static_cast<double>(triangle_n * 3 * sizeof(MeshVertex)) / static_cast<double>(1 << 20), coverage.voxel_n, coverage.mismatch_n);
+        if (coverage.voxel_n == 0) {
+            return "the triangle soup covers no voxels";
+        }
+        if (coverage.unexplained_n != 0 || coverage.mismatch_n * 100 > coverage.voxel_n) {
+            return fmt::format("{} of {} voxels differ, {} of them away from the surface", coverage.mismatch_n, coverage.voxel_n, coverage.unexplained_n);
+        }
+        return {};
+    }
+
+    // Most vertices are shared by six triangles, and every grid point is one vertex.
+    auto test_grid() -> std::string {
+        auto rng = std::mt19937{0};
+        return check_indexed_coverage(make_grid_soup(256, rng), size_t{257} * 257);
+    }
+
+    // The seam and the poles share positions but not UVs, so every (stack, slice) pair stays its own
+    // vertex.
+    auto test_sphere() -> std::string {
+        return check_indexed_coverage(make_sphere_soup(96, 192), size_t{97} * 193);
+    }
+
+    auto test_slivers() -> std::string {
+        auto rng = std::mt19937{1};
+        return check_indexed_coverage(make_sliver_soup(2000, rng), 0);
+    }
+} // namespace
+
+auto main() -> int {
+    auto thread_pool = ThreadPool{};
+    thread_pool.start();
+    auto const cases = std::array{
+        UnitTestCase{"indexed grid", test_grid},
+        UnitTestCase{"indexed sphere with a UV seam", test_sphere},
+        UnitTestCase{"indexed slivers far from the origin", test_slivers},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,334 @@
+#include "texture_pixels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEXTURE_PIXELS_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+// GCC and Clang only allow SSSE3 intrinsics in functions built for it. MSVC allows them anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define TEXTURE_PIXELS_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define TEXTURE_PIXELS_TARGET_SSSE3
+#endif
+#else
+#define TEXTURE_PIXELS_X64 0
+#endif
+
+namespace {
+    void convert_pixels_scalar(TexturePixelFormat format, uint8_t const *src, uint8_t *dst, size_t pixel_n) {
+        switch (format) {
+        case TexturePixelFormat::GRAY8:
+            for (size_t i = 0; i < pixel_n; ++i) {
+                dst[i * 4 + 0] = src[i];
+                dst[i * 4 + 1] = src[i];
+                dst[i * 4 + 2] = src[i];
+                dst[i * 4 + 3] = 255;
+            }
+            break;
+        case TexturePixelFormat::BGR8:
+        case TexturePixelFormat::RGB8: {
+            size_t const b_i = format == TexturePixelFormat::BGR8 ? 0 : 2;
+            for (size_t i = 0; i < pixel_n; ++i) {
+                dst[i * 4 + 0] = src[i * 3 + b_i];
+                dst[i * 4 + 1] = src[i * 3 + 1];
+                dst[i * 4 + 2] = src[i * 3 + 2 - b_i];
+                dst[i * 4 + 3] = 255;
+            }
+        } break;
+        case TexturePixelFormat::BGRA8:
+            std::memcpy(dst, src, pixel_n * 4);
+            break;
+        case TexturePixelFormat::RGBA8:
+            for (size_t i = 0; i < pixel_n; ++i) {
+                dst[i * 4 + 0] = src[i * 4 + 2];
+                dst[i * 4 + 1] = src[i * 4 + 1];
+                dst[i * 4 + 2] = src[i * 4 + 0];
+                dst[i * 4 + 3] = src[i * 4 + 3];
+            }
+            break;
+        }
+    }
+
+#if TEXTURE_PIXELS_X64
+    // Each shuffle makes 4 BGRA pixels, with 0x80 clearing the alpha bytes for `alpha` to fill in.
+    TEXTURE_PIXELS_TARGET_SSSE3 auto convert_pixels_ssse3(TexturePixelFormat format, uint8_t const *src, uint8_t *dst, size_t pixel_n) -> size_t {
+        auto const alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+        auto *dst_vectors = reinterpret_cast<__m128i *>(dst);
+        size_t i = 0;
+        switch (format) {
+        case TexturePixelFormat::GRAY8: {
+            auto const shuffles = std::array{
+                _mm_setr_epi8(0, 0, 0, -128, 1, 1, 1, -128, 2, 2, 2, -128, 3, 3, 3, -128),
+                _mm_setr_epi8(4, 4, 4, -128, 5, 5, 5, -128, 6, 6, 6, -128, 7, 7, 7, -128),
+                _mm_setr_epi8(8, 8, 8, -128, 9, 9, 9, -128, 10, 10, 10, -128, 11, 11, 11, -128),
+                _mm_setr_epi8(12, 12, 12, -128, 13, 13, 13, -128, 14, 14, 14, -128, 15, 15, 15, -128),
+            };
+            for (; i + 16 <= pixel_n; i += 16) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+                for (size_t part_i = 0; part_i < 4; ++part_i) {
+                    _mm_storeu_si128(dst_vectors + i / 4 + part_i, _mm_or_si128(_mm_shuffle_epi8(v, shuffles[part_i]), alpha));
+                }
+            }
+        } break;
+        case TexturePixelFormat::BGR8:
+        case TexturePixelFormat::RGB8: {
+            auto const shuffle = format == TexturePixelFormat::BGR8
+                                     ? _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128)
+                                     : _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+            // 4 pixels only take 12 of the 16 bytes loaded, so stop while the load still fits.
+            for (; i + 6 <= pixel_n; i += 4) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 3));
+                _mm_storeu_si128(dst_vectors + i / 4, _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+            }
+        } break;
+        case TexturePixelFormat::BGRA8:
+            std::memcpy(dst, src, pixel_n * 4);
+            return pixel_n;
+        case TexturePixelFormat::RGBA8: {
+            auto const shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+            for (; i + 4 <= pixel_n; i += 4) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+                _mm_storeu_si128(dst_vectors + i / 4, _mm_shuffle_epi8(v, shuffle));
+            }
+        } break;
+        }
+        return i;
+    }
+
+    auto cpu_supports_ssse3() -> bool {
+        auto regs = std::array<uint32_t, 4>{};
+#if defined(_MSC_VER)
+        auto int_regs = std::array<int, 4>{};
+        __cpuid(int_regs.data(), 1);
+        std::copy(int_regs.begin(), int_regs.end(), regs.begin());
+#else
+        __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        return (regs[2] & (1u << 9)) != 0;
+    }
+#endif
+
+    auto detect_pixel_convert_isa() -> PixelConvertIsa {
+#if TEXTURE_PIXELS_X64
+        return cpu_supports_ssse3() ? PixelConvertIsa::SSSE3 : PixelConvertIsa::SCALAR;
+#else
+        return PixelConvertIsa::SCALAR;
+#endif
+    }
+
+    auto best_isa() -> PixelConvertIsa {
+        static auto const result = detect_pixel_convert_isa();
+        return result;
+    }
+    std::atomic<PixelConvertIsa> active_isa{best_isa()};
+
+    auto srgb_to_linear(double srgb) -> double {
+        return srgb <= 0.04045 ? srgb / 12.92 : std::pow((srgb + 0.055) / 1.055, 2.4);
+    }
+    auto linear_to_srgb(double linear) -> double {
+        return linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+    }
+
+    // Fine enough that every 8-bit sRGB value survives the round trip through linear.
+    constexpr uint32_t LINEAR_TO_SRGB_TABLE_SIZE = 16384;
+
+    struct SrgbTables {
+        std::array<float, 256> to_linear{};
+        std::array<uint8_t, LINEAR_TO_SRGB_TABLE_SIZE> to_srgb{};
+
+        SrgbTables() {
+            for (uint32_t i = 0; i < to_linear.size(); ++i) {
+                to_linear[i] = static_cast<float>(srgb_to_linear(i / 255.0));
+            }
+            for (uint32_t i = 0; i < to_srgb.size(); ++i) {
+                to_srgb[i] = static_cast<uint8_t>(std::lround(linear_to_srgb(i / double{LINEAR_TO_SRGB_TABLE_SIZE - 1}) * 255.0));
+            }
+        }
+
+        auto encode(float linear) const -> uint8_t {
+            auto const i = static_cast<uint32_t>(std::clamp(linear, 0.0f, 1.0f) * static_cast<float>(LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f);
+            return to_srgb[i];
+        }
+    };
+
+    auto srgb_tables() -> SrgbTables const & {
+        static auto const result = SrgbTables{};
+        return result;
+    }
+
+    // The source texels one destination texel covers along an axis, weighted by how much of each.
+    // Going from n to n / 2 texels covers at most 3.
+    struct MipTaps {
+        uint32_t first = 0;
+        uint32_t n = 0;
+        std::array<float, 3> weights{};
+    };
+
+    void compute_mip_taps(uint32_t src_size, uint32_t dst_size, std::vector<MipTaps> &out) {
+        out.resize(dst_size);
+        // In units of 1/dst_size source texels, so that everything stays exact.
+        for (uint32_t dst_i = 0; dst_i < dst_size; ++dst_i) {
+            auto const begin = uint64_t{dst_i} * src_size;
+            auto const end = begin + src_size;
+            auto &taps = out[dst_i];
+            taps.first = static_cast<uint32_t>(begin / dst_size);
+            taps.n = 0;
+            for (auto src_i = uint64_t{taps.first}; src_i * dst_size < end; ++src_i) {
+                auto const covered = std::min(end, (src_i + 1) * dst_size) - std::max(begin, src_i * dst_size);
+                taps.weights[taps.n++] = static_cast<float>(static_cast<double>(covered) / static_cast<double>(src_size));
+            }
+        }
+    }
+
+    // The common case, where every texel is the average of exactly 2x2 texels above it.
+    void downsample_mip_even(uint8_t const *src, uint32_t src_x, uint8_t *dst, uint32_t dst_x, uint32_t dst_y) {
+        auto const &tables = srgb_tables();
+        for (uint32_t yi = 0; yi < dst_y; ++yi) {
+            auto const *row0 = src + size_t{yi} * 2 * src_x * 4;
+            auto const *row1 = row0 + size_t{src_x} * 4;
+            auto *texel = dst + size_t{yi} * dst_x * 4;
+            for (uint32_t xi = 0; xi < dst_x; ++xi, row0 += 8, row1 += 8, texel += 4) {
+                for (uint32_t c = 0; c < 3; ++c) {
+                    auto const sum = tables.to_linear[row0[c]] + tables.to_linear[row0[c + 4]] + tables.to_linear[row1[c]] + tables.to_linear[row1[c + 4]];
+                    texel[c] = tables.encode(sum * 0.25f);
+                }
+                texel[3] = static_cast<uint8_t>((uint32_t{row0[3]} + row0[7] + row1[3] + row1[7] + 2) / 4);
+            }
+        }
+    }
+
+    void downsample_mip(uint8_t const *src, uint32_t src_x, uint32_t src_y, uint8_t *dst, uint32_t dst_x, uint32_t dst_y) {
+        if (src_x == dst_x * 2 && src_y == dst_y * 2) {
+            downsample_mip_even(src, src_x, dst, dst_x, dst_y);
+            return;
+        }
+        auto const &tables = srgb_tables();
+        thread_local auto x_taps = std::vector<MipTaps>{};
+        thread_local auto y_taps = std::vector<MipTaps>{};
+        compute_mip_taps(src_x, dst_x, x_taps);
+        compute_mip_taps(src_y, dst_y, y_taps);
+        for (uint32_t yi = 0; yi < dst_y; ++yi) {
+            auto const &ty = y_taps[yi];
+            for (uint32_t xi = 0; xi < dst_x; ++xi) {
+                auto const &tx = x_taps[xi];
+                auto sum = std::array<float, 4>{};
+                for (uint32_t j = 0; j < ty.n; ++j) {
+                    auto const *row = src + (size_t{ty.first + j} * src_x + tx.first) * 4;
+                    for (uint32_t i = 0; i < tx.n; ++i) {
+                        auto const weight = ty.weights[j] * tx.weights[i];
+                        sum[0] += tables.to_linear[row[i * 4 + 0]] * weight;
+                        sum[1] += tables.to_linear[row[i * 4 + 1]] * weight;
+                        sum[2] += tables.to_linear[row[i * 4 + 2]] * weight;
+                        sum[3] += static_cast<float>(row[i * 4 + 3]) * weight;
+                    }
+                }
+                auto *texel = dst + (size_t{yi} * dst_x + xi) * 4;
+                texel[0] = tables.encode(sum[0]);
+                texel[1] = tables.encode(sum[1]);
+                texel[2] = tables.encode(sum[2]);
+                texel[3] = static_cast<uint8_t>(std::min(sum[3] + 0.5f, 255.0f));
+            }
+        }
+    }
+} // namespace
+
+auto pixel_convert_isa() -> PixelConvertIsa {
+    return active_isa.load(std::memory_order_relaxed);
+}
+
+auto best_pixel_convert_isa() -> PixelConvertIsa {
+    return best_isa();
+}
+
+void set_pixel_convert_isa(PixelConvertIsa isa) {
+    active_isa.store(std::min(isa, best_isa()), std::memory_order_relaxed);
+}
+
+auto pixel_convert_isa_name(PixelConvertIsa isa) -> std::string_view {
+    switch (isa) {
+    case PixelConvertIsa::SSSE3: return "ssse3";
+    default: return "scalar";
+    }
+}
+
+auto texture_pixel_format_name(TexturePixelFormat format) -> std::string_view {
+    switch (format) {
+    case TexturePixelFormat::GRAY8: return "gray8";
+    case TexturePixelFormat::BGR8: return "bgr8";
+    case TexturePixelFormat::RGB8: return "rgb8";
+    case TexturePixelFormat::BGRA8: return "bgra8";
+    default: return "rgba8";
+    }
+}
+
+void convert_pixels_to_bgra8(TexturePixelFormat format, uint8_t const *src, std::span<uint8_t> dst) {
+    auto const pixel_n = dst.size() / 4;
+    size_t done_n = 0;
+#if TEXTURE_PIXELS_X64
+    if (active_isa.load(std::memory_order_relaxed) == PixelConvertIsa::SSSE3) {
+        done_n = convert_pixels_ssse3(format, src, dst.data(), pixel_n);
+    }
+#endif
+    convert_pixels_scalar(format, src + done_n * texture_pixel_size(format), dst.data() + done_n * 4, pixel_n - done_n);
+}
+
+auto texture_mip_level_n(uint32_t size_x, uint32_t size_y) -> uint32_t {
+    return std::bit_width(std::max({size_x, size_y, 1u}));
+}
+
+auto texture_mip_chain_size(uint32_t size_x, uint32_t size_y, uint32_t level_n) -> size_t {
+    auto result = size_t{0};
+    for (uint32_t level_i = 0; level_i < level_n; ++level_i) {
+        result += size_t{std::max(1u, size_x >> level_i)} * std::max(1u, size_y >> level_i) * 4;
+    }
+    return result;
+}
+
+void generate_texture_mips(std::span<uint8_t> chain, uint32_t size_x, uint32_t size_y, uint32_t level_n) {
+    auto *src = chain.data();
+    for (uint32_t level_i = 1; level_i < level_n; ++level_i) {
+        auto const src_x = std::max(1u, size_x >> (level_i - 1));
+        auto const src_y = std::max(1u, size_y >> (level_i - 1));
+        auto const dst_x = std::max(1u, size_x >> level_i);
+        auto const dst_y = std::max(1u, size_y >> level_i);
+        auto *dst = src + size_t{src_x} * src_y * 4;
+        downsample_mip(src, src_x, src_y, dst, dst_x, dst_y);
+        src = dst;
+    }
+}
+
+auto hash_texture_content(std::span<uint8_t const> bytes) -> uint64_t {
+    constexpr auto K0 = 0x9e3779b97f4a7c15ull;
+    constexpr auto K1 = 0xbf58476d1ce4e5b9ull;
+    auto hash = K0 ^ (bytes.size() * K1);
+    auto const mix = [&hash](uint64_t word) {
+        hash = std::rotl(hash ^ (word * K1), 27) * K0;
+    };
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        auto word = uint64_t{};
+        std::memcpy(&word, bytes.data() + i, 8);
+        mix(word);
+    }
+    if (i < bytes.size()) {
+        auto word = uint64_t{};
+        std::memcpy(&word, bytes.data() + i, bytes.size() - i);
+        mix(word);
+    }
+    // splitmix64's finalizer, so that every input bit affects every output bit.
+    hash = (hash ^ (hash >> 30)) * K1;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// The CPU stages of getting a decoded image ready for upload: converting its pixels to the 32-bit
+// BGRA the mesh textures use, and filling in its mip chain. Doesn't depend on the device or on the
+// image decoder, so it can be tested and measured on its own (see texture_pixels_test.cpp and
+// texture_pixels_bench.cpp).
+
+// Pixel layouts as they come out of the decoder, in byte order.
+enum struct TexturePixelFormat : uint8_t {
+    GRAY8,
+    BGR8,
+    RGB8,
+    BGRA8,
+    RGBA8,
+};
+
+// The instruction sets the pixel conversion comes in. The best one the CPU supports is picked on
+// first use.
+enum struct PixelConvertIsa : uint8_t {
+    SCALAR,
+    SSSE3,
+};
+
+constexpr auto texture_pixel_size(TexturePixelFormat format) -> uint32_t {
+    switch (format) {
+    case TexturePixelFormat::GRAY8: return 1;
+    case TexturePixelFormat::BGR8:
+    case TexturePixelFormat::RGB8: return 3;
+    default: return 4;
+    }
+}
+
+auto pixel_convert_isa() -> PixelConvertIsa;
+auto best_pixel_convert_isa() -> PixelConvertIsa;
+// Clamped to best_pixel_convert_isa(). Only meant for comparing the converters.
+void set_pixel_convert_isa(PixelConvertIsa isa);
+auto pixel_convert_isa_name(PixelConvertIsa isa) -> std::string_view;
+auto texture_pixel_format_name(TexturePixelFormat format) -> std::string_view;
+
+// Converts dst.size() / 4 pixels of `format` from `src` into BGRA. Formats without alpha get 255.
+void convert_pixels_to_bgra8(TexturePixelFormat format, uint8_t const *src, std::span<uint8_t> dst);
+
+// Full chain down to 1x1. Each level is half the size of the one above, rounded down, like Vulkan's.
+auto texture_mip_level_n(uint32_t size_x, uint32_t size_y) -> uint32_t;
+// Bytes of `level_n` BGRA levels stored one after another, starting with the full size one.
+auto texture_mip_chain_size(uint32_t size_x, uint32_t size_y, uint32_t level_n) -> size_t;
+// Fills in levels 1 to level_n - 1 of `chain`, whose level 0 must already hold the sRGB image. Each
+// level is box filtered from the one above in linear light, which is what blitting between levels
+// of an sRGB image does. Levels of odd size weigh the source texels by how much of them each texel
+// covers, so no row or column gets dropped.
+void generate_texture_mips(std::span<uint8_t> chain, uint32_t size_x, uint32_t size_y, uint32_t level_n);
+
+// Hash of an encoded image file, for finding textures that are the same file under different paths.
+// Not meant to be collision free; check the bytes when two hashes match.
+auto hash_texture_content(std::span<uint8_t const> bytes) -> uint64_t;
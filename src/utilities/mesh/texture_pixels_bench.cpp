@@ -0,0 +1,112 @@
+#include <utilities/log.hpp>
+#include <utilities/mesh/mesh_model.hpp>
+#include <utilities/mesh/texture_pixels.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <FreeImage.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+
+// The CPU stages of getting mesh textures ready for upload, then, if a model is given, loading its
+// textures on one thread and on the pool.
+// Usage: gvox_engine_texture_pixels_bench [mesh model]
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr uint32_t IMAGE_SIZE = 2048;
+
+    // Converted pixels are summed into this, so that the loops can't be optimized out.
+    uint32_t volatile benchmark_sink = 0;
+
+    auto random_bytes(std::mt19937 &rng, size_t n) -> std::vector<uint8_t> {
+        auto result = std::vector<uint8_t>(n);
+        for (auto &byte : result) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        return result;
+    }
+
+    // Conversion throughput per format and supported instruction set.
+    void benchmark_conversion(std::mt19937 &rng) {
+        auto const pixel_n = size_t{IMAGE_SIZE} * IMAGE_SIZE;
+        auto const src = random_bytes(rng, pixel_n * 4);
+        auto dst = std::vector<uint8_t>(pixel_n * 4);
+        auto const previous_isa = pixel_convert_isa();
+        fmt::print("Pixel conversion to BGRA, in ns per pixel (best instruction set: {}):\n", pixel_convert_isa_name(best_pixel_convert_isa()));
+        fmt::print("{:>7} {:>7} {:>8}\n", "format", "isa", "pixel");
+        for (auto format : {TexturePixelFormat::GRAY8, TexturePixelFormat::BGR8, TexturePixelFormat::RGB8, TexturePixelFormat::BGRA8, TexturePixelFormat::RGBA8}) {
+            for (auto isa = PixelConvertIsa::SCALAR; isa <= best_pixel_convert_isa(); isa = static_cast<PixelConvertIsa>(static_cast<uint32_t>(isa) + 1)) {
+                set_pixel_convert_isa(isa);
+                auto best_ns = std::numeric_limits<double>::max();
+                for (uint32_t repeat_i = 0; repeat_i < 5; ++repeat_i) {
+                    auto const t0 = Clock::now();
+                    convert_pixels_to_bgra8(format, src.data(), dst);
+                    auto const t1 = Clock::now();
+                    benchmark_sink = benchmark_sink + dst[repeat_i * 4099 % dst.size()];
+                    best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(t1 - t0).count());
+                }
+                fmt::print("{:>7} {:>7} {:>8.3f}\n", texture_pixel_format_name(format), pixel_convert_isa_name(isa), best_ns / static_cast<double>(pixel_n));
+            }
+        }
+        set_pixel_convert_isa(previous_isa);
+    }
+
+    // Time to generate the whole mip chain, in ns per base level pixel.
+    void benchmark_mips(std::mt19937 &rng) {
+        auto const level_n = texture_mip_level_n(IMAGE_SIZE, IMAGE_SIZE);
+        auto chain = std::vector<uint8_t>(texture_mip_chain_size(IMAGE_SIZE, IMAGE_SIZE, level_n));
+        auto const base = random_bytes(rng, size_t{IMAGE_SIZE} * IMAGE_SIZE * 4);
+        std::copy(base.begin(), base.end(), chain.begin());
+        auto best_ns = std::numeric_limits<double>::max();
+        for (uint32_t repeat_i = 0; repeat_i < 3; ++repeat_i) {
+            auto const t0 = Clock::now();
+            generate_texture_mips(chain, IMAGE_SIZE, IMAGE_SIZE, level_n);
+            auto const t1 = Clock::now();
+            benchmark_sink = benchmark_sink + chain.back();
+            best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(t1 - t0).count());
+        }
+        fmt::print("Mip chain generation: {:.2f} ns per pixel\n", best_ns / (static_cast<double>(IMAGE_SIZE) * static_cast<double>(IMAGE_SIZE)));
+    }
+
+    auto benchmark_model_textures(std::filesystem::path const &model_path) -> bool {
+        auto logger = Logger{{make_stdout_log_sink()}};
+        auto thread_pool = ThreadPool{};
+        thread_pool.start();
+        FreeImage_Initialise();
+        auto is_ok = true;
+        fmt::print("Loading the textures of '{}':\n", model_path.string());
+        fmt::print("{:>8} {:>9} {:>10} {:>7} {:>8} {:>9} {:>9} {:>10} {:>10} {:>8}\n", "threads", "textures", "duplicate", "failed", "file MB", "pixel MB", "hash ms", "decode ms", "image cpu", "mip cpu");
+        for (auto *pool : {static_cast<ThreadPool *>(nullptr), &thread_pool}) {
+            auto model = MeshModel{};
+            auto stats = MeshTextureLoadStats{};
+            if (!load_mesh_model(model, model_path, pool, &stats)) {
+                log_error("Failed to load the mesh model '{}'", model_path.string());
+                is_ok = false;
+                break;
+            }
+            fmt::print("{:>8} {:>9} {:>10} {:>7} {:>8.1f} {:>9.1f} {:>9.1f} {:>10.1f} {:>10.1f} {:>8.1f}\n", pool == nullptr ? 1u : pool->thread_count() + 1,
+                       stats.texture_n, stats.duplicate_n, stats.failed_n, static_cast<double>(stats.file_bytes) / static_cast<double>(1 << 20),
+                       static_cast<double>(stats.pixel_bytes) / static_cast<double>(1 << 20), stats.hash_ms, stats.decode_ms,
+                       stats.image_decode_cpu_ms + stats.convert_cpu_ms, stats.mip_cpu_ms);
+        }
+        FreeImage_DeInitialise();
+        return is_ok;
+    }
+} // namespace
+
+auto main(int argc, char const *argv[]) -> int {
+    auto rng = std::mt19937{0};
+    benchmark_conversion(rng);
+    benchmark_mips(rng);
+    if (argc < 2) {
+        return 0;
+    }
+    return benchmark_model_textures(argv[1]) ? 0 : 1;
+}
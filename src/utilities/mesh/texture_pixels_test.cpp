@@ -0,0 +1,196 @@
+#include <utilities/mesh/texture_pixels.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+    constexpr auto ALL_PIXEL_FORMATS = std::array{
+        TexturePixelFormat::GRAY8,
+        TexturePixelFormat::BGR8,
+        TexturePixelFormat::RGB8,
+        TexturePixelFormat::BGRA8,
+        TexturePixelFormat::RGBA8,
+    };
+
+    auto random_bytes(std::mt19937 &rng, size_t n) -> std::vector<uint8_t> {
+        auto result = std::vector<uint8_t>(n);
+        for (auto &byte : result) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        return result;
+    }
+
+    auto next_isa(PixelConvertIsa isa) -> PixelConvertIsa {
+        return static_cast<PixelConvertIsa>(static_cast<uint32_t>(isa) + 1);
+    }
+
+    auto srgb_to_linear(double srgb) -> double {
+        return srgb <= 0.04045 ? srgb / 12.92 : std::pow((srgb + 0.055) / 1.055, 2.4);
+    }
+    auto linear_to_srgb(double linear) -> double {
+        return linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+    }
+
+    // Straight from the definition, in doubles, with the exact sRGB curves.
+    void reference_downsample_mip(uint8_t const *src, uint32_t src_x, uint32_t src_y, uint8_t *dst, uint32_t dst_x, uint32_t dst_y) {
+        auto const coverage = [](uint32_t src_i, uint32_t src_size, uint32_t dst_i, uint32_t dst_size) {
+            auto const scale = static_cast<double>(src_size) / static_cast<double>(dst_size);
+            auto const overlap = std::min(dst_i * scale + scale, src_i + 1.0) - std::max(dst_i * scale, double(src_i));
+            return std::max(overlap, 0.0) / scale;
+        };
+        for (uint32_t yi = 0; yi < dst_y; ++yi) {
+            for (uint32_t xi = 0; xi < dst_x; ++xi) {
+                auto sum = std::array<double, 4>{};
+                for (uint32_t sy = 0; sy < src_y; ++sy) {
+                    for (uint32_t sx = 0; sx < src_x; ++sx) {
+                        auto const weight = coverage(sx, src_x, xi, dst_x) * coverage(sy, src_y, yi, dst_y);
+                        auto const *texel = src + (size_t{sy} * src_x + sx) * 4;
+                        for (uint32_t c = 0; c < 3; ++c) {
+                            sum[c] += srgb_to_linear(texel[c] / 255.0) * weight;
+                        }
+                        sum[3] += texel[3] * weight;
+                    }
+                }
+                auto *texel = dst + (size_t{yi} * dst_x + xi) * 4;
+                for (uint32_t c = 0; c < 3; ++c) {
+                    texel[c] = static_cast<uint8_t>(std::lround(linear_to_srgb(sum[c]) * 255.0));
+                }
+                texel[3] = static_cast<uint8_t>(std::lround(sum[3]));
+            }
+        }
+    }
+
+    // Every length up to a few vectors, so that every tail gets hit, with every supported
+    // instruction set against the scalar converter.
+    auto test_isas_match_scalar() -> std::string {
+        auto rng = std::mt19937{0};
+        auto const previous_isa = pixel_convert_isa();
+        auto result = std::string{};
+        for (auto format : ALL_PIXEL_FORMATS) {
+            auto const pixel_size = texture_pixel_size(format);
+            for (uint32_t pixel_n = 0; pixel_n < 67 && result.empty(); ++pixel_n) {
+                auto const src = random_bytes(rng, size_t{pixel_n} * pixel_size);
+                auto expected = std::vector<uint8_t>(size_t{pixel_n} * 4);
+                set_pixel_convert_isa(PixelConvertIsa::SCALAR);
+                convert_pixels_to_bgra8(format, src.data(), expected);
+                for (auto isa = next_isa(PixelConvertIsa::SCALAR); isa <= best_pixel_convert_isa() && result.empty(); isa = next_isa(isa)) {
+                    set_pixel_convert_isa(isa);
+                    auto converted = std::vector<uint8_t>(size_t{pixel_n} * 4);
+                    convert_pixels_to_bgra8(format, src.data(), converted);
+                    if (converted != expected) {
+                        result = fmt::format("{} conversion of {} pixels with {} differs", texture_pixel_format_name(format), pixel_n, pixel_convert_isa_name(isa));
+                    }
+                }
+            }
+        }
+        set_pixel_convert_isa(previous_isa);
+        return result;
+    }
+
+    auto test_channel_order() -> std::string {
+        auto rng = std::mt19937{1};
+        constexpr uint32_t pixel_n = 37;
+        for (auto format : ALL_PIXEL_FORMATS) {
+            auto const pixel_size = texture_pixel_size(format);
+            auto const src = random_bytes(rng, size_t{pixel_n} * pixel_size);
+            auto converted = std::vector<uint8_t>(size_t{pixel_n} * 4);
+            convert_pixels_to_bgra8(format, src.data(), converted);
+            for (uint32_t i = 0; i < pixel_n; ++i) {
+                auto const *texel = converted.data() + size_t{i} * 4;
+                auto const *pixel = src.data() + size_t{i} * pixel_size;
+                auto const is_bgr_order = format == TexturePixelFormat::BGR8 || format == TexturePixelFormat::BGRA8;
+                auto const expected_b = format == TexturePixelFormat::GRAY8 ? pixel[0] : pixel[is_bgr_order ? 0 : 2];
+                auto const expected_g = format == TexturePixelFormat::GRAY8 ? pixel[0] : pixel[1];
+                auto const expected_r = format == TexturePixelFormat::GRAY8 ? pixel[0] : pixel[is_bgr_order ? 2 : 0];
+                auto const expected_a = pixel_size == 4 ? pixel[3] : uint8_t{255};
+                if (texel[0] != expected_b || texel[1] != expected_g || texel[2] != expected_r || texel[3] != expected_a) {
+                    return fmt::format("{} pixel {} converted to the wrong channels", texture_pixel_format_name(format), i);
+                }
+            }
+        }
+        return {};
+    }
+
+    // Every 8-bit value has to survive going through linear, or uniform textures would drift.
+    auto test_uniform_mips() -> std::string {
+        constexpr uint32_t size = 4;
+        auto const level_n = texture_mip_level_n(size, size);
+        auto chain = std::vector<uint8_t>(texture_mip_chain_size(size, size, level_n));
+        for (uint32_t value = 0; value < 256; ++value) {
+            std::fill(chain.begin(), chain.begin() + size * size * 4, static_cast<uint8_t>(value));
+            generate_texture_mips(chain, size, size, level_n);
+            if (auto const iter = std::find_if(chain.begin(), chain.end(), [value](uint8_t byte) { return byte != value; }); iter != chain.end()) {
+                return fmt::format("a texture of {} everywhere has {} at byte {} of its mip chain", value, *iter, iter - chain.begin());
+            }
+        }
+        return {};
+    }
+
+    // Odd and even sizes, squares and strips, against the reference downsampler. Levels can differ
+    // by one where the linear value falls right between two sRGB values.
+    auto test_mips_match_reference() -> std::string {
+        auto rng = std::mt19937{2};
+        auto const sizes = std::array<std::array<uint32_t, 2>, 7>{{{1, 1}, {2, 2}, {3, 3}, {7, 4}, {16, 9}, {1, 13}, {37, 21}}};
+        for (auto const &[size_x, size_y] : sizes) {
+            auto const level_n = texture_mip_level_n(size_x, size_y);
+            auto chain = std::vector<uint8_t>(texture_mip_chain_size(size_x, size_y, level_n));
+            auto const base = random_bytes(rng, size_t{size_x} * size_y * 4);
+            std::copy(base.begin(), base.end(), chain.begin());
+            generate_texture_mips(chain, size_x, size_y, level_n);
+            auto offset = size_t{0};
+            for (uint32_t level_i = 1; level_i < level_n; ++level_i) {
+                auto const src_x = std::max(1u, size_x >> (level_i - 1));
+                auto const src_y = std::max(1u, size_y >> (level_i - 1));
+                auto const dst_x = std::max(1u, size_x >> level_i);
+                auto const dst_y = std::max(1u, size_y >> level_i);
+                auto expected = std::vector<uint8_t>(size_t{dst_x} * dst_y * 4);
+                reference_downsample_mip(chain.data() + offset, src_x, src_y, expected.data(), dst_x, dst_y);
+                offset += size_t{src_x} * src_y * 4;
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    if (std::abs(int{chain[offset + i]} - int{expected[i]}) > 1) {
+                        return fmt::format("mip {} of a {}x{} image is {} at byte {}, where it should be {}", level_i, size_x, size_y, chain[offset + i], i, expected[i]);
+                    }
+                }
+            }
+            if (offset + 4 != chain.size()) {
+                return fmt::format("the mip chain of a {}x{} image doesn't end in a single texel", size_x, size_y);
+            }
+        }
+        return {};
+    }
+
+    auto test_content_hash() -> std::string {
+        auto rng = std::mt19937{3};
+        for (size_t byte_n : {0u, 1u, 7u, 8u, 9u, 1000u}) {
+            auto bytes = random_bytes(rng, byte_n);
+            auto const hash = hash_texture_content(bytes);
+            auto const copy = bytes;
+            if (hash_texture_content(copy) != hash) {
+                return fmt::format("the same {} bytes hashed differently", byte_n);
+            }
+            if (byte_n == 0) {
+                continue;
+            }
+            bytes[byte_n - 1] ^= 1;
+            if (hash_texture_content(bytes) == hash) {
+                return fmt::format("flipping the last of {} bytes didn't change the hash", byte_n);
+            }
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"instruction sets match the scalar conversion", test_isas_match_scalar},
+        UnitTestCase{"channel order", test_channel_order},
+        UnitTestCase{"uniform textures keep their value", test_uniform_mips},
+        UnitTestCase{"mips match the reference", test_mips_match_reference},
+        UnitTestCase{"content hash", test_content_hash},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,227 @@
+#include "noise_cache.hpp"
+
+#include <utilities/debug.hpp>
+#include <utilities/mapped_file.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <minizip/unzip.h>
+#include <FreeImage.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr uint32_t NOISE_CACHE_MAGIC = 0x4e435647; // "GVCN"
+    // Bump when the entry format changes.
+    constexpr uint32_t NOISE_CACHE_VERSION = 1;
+
+    struct NoiseCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_stamp;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    constexpr size_t VALUE_NOISE_BATCH_SIZE = size_t{1} << 16;
+
+    auto entry_path(std::filesystem::path const &folder, std::string_view name) -> std::filesystem::path {
+        return folder / (std::string{name} + ".bin");
+    }
+
+    // Changes whenever the zip is replaced or touched, which is all the invalidation the STBN entry needs.
+    auto file_stamp(std::filesystem::path const &path) -> uint64_t {
+        auto ec = std::error_code{};
+        auto const size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return 0;
+        }
+        auto const write_time = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return 0;
+        }
+        auto const stamp = std::array{static_cast<uint64_t>(size), static_cast<uint64_t>(write_time.time_since_epoch().count())};
+        return noise_cache_checksum({reinterpret_cast<uint8_t const *>(stamp.data()), sizeof(stamp)});
+    }
+
+    auto decode_stbn_vec2(std::filesystem::path const &stbn_zip_path, std::span<uint8_t> out) -> bool {
+        auto *stbn_zip = unzOpen(stbn_zip_path.string().c_str());
+        if (stbn_zip == nullptr) {
+            return false;
+        }
+        auto const slice_size = out.size() / 64;
+        auto file_data = std::vector<uint8_t>{};
+        auto result = true;
+        for (auto i = 0; i < 64 && result; ++i) {
+            auto const path = fmt::format("STBN/stbn_vec2_2Dx1D_128x128x64_{}.png", i);
+            auto file_info = unz_file_info{};
+            if (unzLocateFile(stbn_zip, path.c_str(), 1) != UNZ_OK ||
+                unzGetCurrentFileInfo(stbn_zip, &file_info, nullptr, 0, nullptr, 0, nullptr, 0) != UNZ_OK ||
+                unzOpenCurrentFile(stbn_zip) != UNZ_OK) {
+                result = false;
+                break;
+            }
+            file_data.resize(file_info.uncompressed_size);
+            auto const read_n = unzReadCurrentFile(stbn_zip, file_data.data(), static_cast<uint32_t>(file_data.size()));
+            unzCloseCurrentFile(stbn_zip);
+            if (read_n != static_cast<int>(file_data.size())) {
+                result = false;
+                break;
+            }
+
+            auto *fi_mem = FreeImage_OpenMemory(file_data.data(), static_cast<DWORD>(file_data.size()));
+            auto fi_file_desc = FreeImage_GetFileTypeFromMemory(fi_mem, 0);
+            FIBITMAP *fi_bitmap = FreeImage_LoadFromMemory(fi_file_desc, fi_mem);
+            FreeImage_CloseMemory(fi_mem);
+            if (fi_bitmap == nullptr) {
+                result = false;
+                break;
+            }
+            if (FreeImage_GetBPP(fi_bitmap) != 32) {
+                auto *temp = FreeImage_ConvertTo32Bits(fi_bitmap);
+                FreeImage_Unload(fi_bitmap);
+                fi_bitmap = temp;
+            }
+            auto const size_x = FreeImage_GetWidth(fi_bitmap);
+            auto const size_y = FreeImage_GetHeight(fi_bitmap);
+            auto const *bits = FreeImage_GetBits(fi_bitmap);
+            if (bits == nullptr || size_t{size_x} * size_y * 4 != slice_size) {
+                result = false;
+            } else {
+                std::copy(bits, bits + slice_size, out.data() + slice_size * static_cast<size_t>(i));
+            }
+            FreeImage_Unload(fi_bitmap);
+        }
+        unzClose(stbn_zip);
+        return result;
+    }
+} // namespace
+
+auto noise_cache_checksum(std::span<uint8_t const> data) -> uint64_t {
+    auto hash = 0xcbf29ce484222325ull ^ uint64_t{data.size()};
+    auto const word_n = data.size() / sizeof(uint64_t);
+    for (size_t i = 0; i < word_n; ++i) {
+        auto word = uint64_t{};
+        std::memcpy(&word, data.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (size_t i = word_n * sizeof(uint64_t); i < data.size(); ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void generate_value_noise(uint64_t seed, std::span<uint8_t> out, ThreadPool *thread_pool) {
+    auto generate = [seed, out](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            out[i] = value_noise_texel(seed, i);
+        }
+    };
+    if (thread_pool != nullptr) {
+        thread_pool->parallel_for(out.size(), VALUE_NOISE_BATCH_SIZE, generate);
+    } else {
+        generate(0, out.size());
+    }
+}
+
+auto NoiseCache::load(std::string_view name, uint64_t source_stamp, std::span<uint8_t> out) const -> bool {
+    auto const file = MappedFile(entry_path(folder, name));
+    if (!file.is_open() || file.size() != sizeof(NoiseCacheHeader) + out.size()) {
+        return false;
+    }
+    file.advise_sequential();
+    auto header = NoiseCacheHeader{};
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != NOISE_CACHE_MAGIC || header.version != NOISE_CACHE_VERSION ||
+        header.source_stamp != source_stamp || header.size != out.size()) {
+        return false;
+    }
+    auto const texels = file.bytes().subspan(sizeof(NoiseCacheHeader));
+    if (noise_cache_checksum(texels) != header.checksum) {
+        debug_utils::Console::add_log(fmt::format("[noise cache] Discarding corrupt entry {}", name));
+        return false;
+    }
+    std::copy(texels.begin(), texels.end(), out.begin());
+    return true;
+}
+
+void NoiseCache::store(std::string_view name, uint64_t source_stamp, std::span<uint8_t const> data) const {
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(folder, ec);
+    auto const path = entry_path(folder, name);
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        auto file = std::ofstream(temp_path, std::ios::binary | std::ios::trunc);
+        auto const header = NoiseCacheHeader{
+            .magic = NOISE_CACHE_MAGIC,
+            .version = NOISE_CACHE_VERSION,
+            .source_stamp = source_stamp,
+            .size = data.size(),
+            .checksum = noise_cache_checksum(data),
+        };
+        file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        file.write(reinterpret_cast<char const *>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file.good()) {
+            file.close();
+            std::filesystem::remove(temp_path, ec);
+            debug_utils::Console::add_log(fmt::format("[noise cache] Failed to write {}", path.string()));
+            return;
+        }
+    }
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+    }
+}
+
+auto NoiseCache::load_stbn_vec2(std::filesystem::path const &stbn_zip_path, std::span<uint8_t> out) const -> bool {
+    auto const stamp = file_stamp(stbn_zip_path);
+    if (load("stbn_vec2", stamp, out)) {
+        return true;
+    }
+    if (!decode_stbn_vec2(stbn_zip_path, out)) {
+        debug_utils::Console::add_log(fmt::format("[error] Failed to decode the blue noise from {}", stbn_zip_path.string()));
+        return false;
+    }
+    store("stbn_vec2", stamp, out);
+    return true;
+}
+
+void NoiseCache::load_value_noise(uint64_t seed, std::span<uint8_t> out, ThreadPool *thread_pool) const {
+    auto const name = fmt::format("value_noise_{:016x}", seed);
+    if (load(name, VALUE_NOISE_GENERATOR_VERSION, out)) {
+        return;
+    }
+    generate_value_noise(seed, out, thread_pool);
+    store(name, VALUE_NOISE_GENERATOR_VERSION, out);
+    prune_value_noise_entries();
+}
+
+void NoiseCache::prune_value_noise_entries() const {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type write_time;
+    };
+    auto entries = std::vector<Entry>{};
+    auto ec = std::error_code{};
+    for (auto const &dir_entry : std::filesystem::directory_iterator(folder, ec)) {
+        auto const filename = dir_entry.path().filename().string();
+        if (filename.starts_with("value_noise_") && dir_entry.path().extension() == ".bin") {
+            entries.push_back({dir_entry.path(), dir_entry.last_write_time(ec)});
+        }
+    }
+    if (entries.size() <= MAX_VALUE_NOISE_ENTRY_N) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](Entry const &a, Entry const &b) { return a.write_time > b.write_time; });
+    for (size_t i = MAX_VALUE_NOISE_ENTRY_N; i < entries.size(); ++i) {
+        std::filesystem::remove(entries[i].path, ec);
+    }
+}
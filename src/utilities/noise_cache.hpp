@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+
+struct ThreadPool;
+
+// On-disk cache of the noise volumes that are uploaded at startup, so that they don't have to be
+// decoded or generated on every launch. Each entry is a single file holding a header and the raw
+// texels, and is read back with one mapped read. Entries are checked against the stamp of whatever
+// they were produced from, and against a checksum of their contents, so stale or corrupt entries
+// are simply regenerated.
+struct NoiseCache {
+    static constexpr size_t STBN_VEC2_SIZE = size_t{128} * 128 * 4 * 64;
+    static constexpr size_t VALUE_NOISE_SIZE = size_t{256} * 256 * 256;
+    // Bump when generate_value_noise() produces different texels.
+    static constexpr uint64_t VALUE_NOISE_GENERATOR_VERSION = 1;
+    // Value noise entries beyond this are removed, oldest first.
+    static constexpr size_t MAX_VALUE_NOISE_ENTRY_N = 8;
+
+    std::filesystem::path folder;
+
+    // Fills `out` from the entry called `name`, and returns whether it was there and valid.
+    auto load(std::string_view name, uint64_t source_stamp, std::span<uint8_t> out) const -> bool;
+    // Writes the entry through a temporary file, so that a crash never leaves a torn entry behind.
+    void store(std::string_view name, uint64_t source_stamp, std::span<uint8_t const> data) const;
+
+    // Fills `out` with the STBN volume, from the cache or by decoding `stbn_zip_path` (which then
+    // gets cached). Returns false if neither worked.
+    auto load_stbn_vec2(std::filesystem::path const &stbn_zip_path, std::span<uint8_t> out) const -> bool;
+    // Fills `out` with the value noise for `seed`, from the cache or with generate_value_noise().
+    void load_value_noise(uint64_t seed, std::span<uint8_t> out, ThreadPool *thread_pool) const;
+    void prune_value_noise_entries() const;
+};
+
+// Stateless hash of a texel, so that any texel of the volume can be generated on its own, in any
+// order and on any thread.
+inline auto value_noise_texel(uint64_t seed, uint64_t texel_index) -> uint8_t {
+    auto x = seed ^ (texel_index * 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x = x ^ (x >> 31);
+    return static_cast<uint8_t>(x >> 56);
+}
+
+// Fills `out` with value_noise_texel() of every texel index, split over `thread_pool` when there is one.
+void generate_value_noise(uint64_t seed, std::span<uint8_t> out, ThreadPool *thread_pool);
+
+auto noise_cache_checksum(std::span<uint8_t const> data) -> uint64_t;
@@ -0,0 +1,192 @@
+#include <utilities/noise_cache.hpp>
+#include <utilities/thread_pool.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+namespace {
+    auto fresh_cache(std::string_view name) -> NoiseCache {
+        auto const folder = std::filesystem::path{".out/noise_cache_test"} / name;
+        std::filesystem::remove_all(folder);
+        return NoiseCache{.folder = folder};
+    }
+
+    auto make_texels(size_t size, uint8_t salt) -> std::vector<uint8_t> {
+        auto result = std::vector<uint8_t>(size);
+        for (size_t i = 0; i < size; ++i) {
+            result[i] = static_cast<uint8_t>(i * 7 + salt);
+        }
+        return result;
+    }
+
+    // Changes one byte of the entry file, counted from its end, so that it hits the texels.
+    void flip_byte_from_end(std::filesystem::path const &path, size_t offset_from_end) {
+        auto file = std::fstream(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(-static_cast<std::streamoff>(offset_from_end), std::ios::end);
+        auto byte = static_cast<char>(file.get());
+        file.seekp(-static_cast<std::streamoff>(offset_from_end), std::ios::end);
+        file.put(static_cast<char>(byte ^ 0x10));
+    }
+
+    auto test_round_trip() -> std::string {
+        auto const cache = fresh_cache("round_trip");
+        auto const texels = make_texels(1000, 1);
+        auto out = std::vector<uint8_t>(texels.size());
+        if (cache.load("entry", 5, out)) {
+            return "an entry that was never stored loaded";
+        }
+        cache.store("entry", 5, texels);
+        if (!cache.load("entry", 5, out) || out != texels) {
+            return "the stored entry didn't load back";
+        }
+        if (std::filesystem::exists(cache.folder / "entry.bin.tmp")) {
+            return "the temporary file was left behind";
+        }
+        return {};
+    }
+
+    // Entries of another source, of another size, or with damaged texels are rejected, and leave
+    // the output alone.
+    auto test_rejects_stale_and_corrupt_entries() -> std::string {
+        auto const cache = fresh_cache("rejects");
+        auto const texels = make_texels(1000, 2);
+        cache.store("entry", 5, texels);
+        auto out = std::vector<uint8_t>(texels.size());
+        if (cache.load("entry", 6, out)) {
+            return "an entry with another source stamp loaded";
+        }
+        auto other_size = std::vector<uint8_t>(texels.size() + 1);
+        if (cache.load("entry", 5, other_size) || cache.load("entry", 5, std::span{out}.first(out.size() - 1))) {
+            return "an entry of another size loaded";
+        }
+        flip_byte_from_end(cache.folder / "entry.bin", 100);
+        if (cache.load("entry", 5, out)) {
+            return "an entry with a damaged texel loaded";
+        }
+        if (out != std::vector<uint8_t>(texels.size())) {
+            return "a rejected entry was copied out anyway";
+        }
+        cache.store("entry", 5, texels);
+        std::filesystem::resize_file(cache.folder / "entry.bin", 500);
+        if (cache.load("entry", 5, out)) {
+            return "a truncated entry loaded";
+        }
+        return {};
+    }
+
+    // The texels don't depend on how generation is split over threads.
+    auto test_value_noise_generation() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(3);
+        auto serial = std::vector<uint8_t>(NoiseCache::VALUE_NOISE_SIZE);
+        auto parallel = std::vector<uint8_t>(NoiseCache::VALUE_NOISE_SIZE);
+        generate_value_noise(42, serial, nullptr);
+        generate_value_noise(42, parallel, &pool);
+        if (serial != parallel) {
+            return "the serial and the parallel value noise differ";
+        }
+        for (size_t i = 0; i < serial.size(); i += 9973) {
+            if (serial[i] != value_noise_texel(42, i)) {
+                return fmt::format("texel {} isn't value_noise_texel()", i);
+            }
+        }
+        // A different seed shouldn't just shift or repeat the texels.
+        auto other_seed = std::vector<uint8_t>(4096);
+        generate_value_noise(43, other_seed, nullptr);
+        auto same_n = 0u;
+        for (size_t i = 0; i < other_seed.size(); ++i) {
+            same_n += other_seed[i] == serial[i] ? 1u : 0u;
+        }
+        if (same_n > other_seed.size() / 64) {
+            return fmt::format("{} of {} texels are the same for another seed", same_n, other_seed.size());
+        }
+        return {};
+    }
+
+    // The first load generates and stores an entry, and the next one reads it instead.
+    auto test_value_noise_cache() -> std::string {
+        auto const cache = fresh_cache("value_noise");
+        auto expected = std::vector<uint8_t>(4096);
+        generate_value_noise(7, expected, nullptr);
+        auto out = std::vector<uint8_t>(expected.size());
+        cache.load_value_noise(7, out, nullptr);
+        if (out != expected) {
+            return "a miss didn't generate the value noise";
+        }
+        auto const entry_path = cache.folder / "value_noise_0000000000000007.bin";
+        if (!std::filesystem::exists(entry_path)) {
+            return "a miss didn't store an entry";
+        }
+        // Replacing the entry's texels shows whether the next load reads it.
+        auto const replaced = make_texels(expected.size(), 3);
+        cache.store("value_noise_0000000000000007", NoiseCache::VALUE_NOISE_GENERATOR_VERSION, replaced);
+        cache.load_value_noise(7, out, nullptr);
+        if (out != replaced) {
+            return "a hit didn't read the entry";
+        }
+        cache.store("value_noise_0000000000000007", NoiseCache::VALUE_NOISE_GENERATOR_VERSION + 1, replaced);
+        cache.load_value_noise(7, out, nullptr);
+        if (out != expected) {
+            return "an entry of another generator version was used";
+        }
+        return {};
+    }
+
+    // Only the newest value noise entries are kept, and nothing else in the folder is touched.
+    auto test_prune_value_noise_entries() -> std::string {
+        auto const cache = fresh_cache("prune");
+        auto const texels = make_texels(16, 4);
+        constexpr size_t entry_n = NoiseCache::MAX_VALUE_NOISE_ENTRY_N + 4;
+        auto const now = std::filesystem::file_time_type::clock::now();
+        for (size_t i = 0; i < entry_n; ++i) {
+            auto const name = fmt::format("value_noise_{:016x}", i);
+            cache.store(name, NoiseCache::VALUE_NOISE_GENERATOR_VERSION, texels);
+            // Entry i is the i-th oldest, however fast they were written.
+            std::filesystem::last_write_time(cache.folder / (name + ".bin"), now - std::chrono::hours(entry_n - i));
+        }
+        cache.store("stbn_vec2", 1, texels);
+        std::filesystem::last_write_time(cache.folder / "stbn_vec2.bin", now - std::chrono::hours(1000));
+        cache.prune_value_noise_entries();
+        for (size_t i = 0; i < entry_n; ++i) {
+            auto const is_kept = std::filesystem::exists(cache.folder / fmt::format("value_noise_{:016x}.bin", i));
+            if (is_kept != (i >= entry_n - NoiseCache::MAX_VALUE_NOISE_ENTRY_N)) {
+                return fmt::format("entry {} of {} was {}", i, entry_n, is_kept ? "kept" : "removed");
+            }
+        }
+        if (!std::filesystem::exists(cache.folder / "stbn_vec2.bin")) {
+            return "the blue noise entry was removed";
+        }
+        return {};
+    }
+
+    // A blue noise source that can't be decoded fails the load, and isn't cached.
+    auto test_stbn_decode_failure() -> std::string {
+        auto const cache = fresh_cache("stbn");
+        std::filesystem::create_directories(cache.folder);
+        auto const zip_path = cache.folder / "not_a_zip.zip";
+        std::ofstream(zip_path, std::ios::binary) << "not a zip";
+        auto out = std::vector<uint8_t>(NoiseCache::STBN_VEC2_SIZE);
+        if (cache.load_stbn_vec2(cache.folder / "missing.zip", out) || cache.load_stbn_vec2(zip_path, out)) {
+            return "a missing or broken zip loaded";
+        }
+        if (std::filesystem::exists(cache.folder / "stbn_vec2.bin")) {
+            return "a failed decode was cached";
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"round trip", test_round_trip},
+        UnitTestCase{"stale and corrupt entries are rejected", test_rejects_stale_and_corrupt_entries},
+        UnitTestCase{"value noise generation", test_value_noise_generation},
+        UnitTestCase{"value noise cache", test_value_noise_cache},
+        UnitTestCase{"pruning value noise entries", test_prune_value_noise_entries},
+        UnitTestCase{"blue noise decode failure", test_stbn_decode_failure},
+    };
+    return run_unit_tests(cases);
+}
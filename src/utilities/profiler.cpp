@@ -0,0 +1,179 @@
+#include "profiler.hpp"
+
+#include <utilities/log.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+    std::atomic<uint64_t> next_profiler_generation{1};
+
+    struct ThreadBufferSlot {
+        uint64_t generation = 0;
+        std::shared_ptr<CpuProfiler::ThreadBuffer> buffer;
+    };
+    thread_local ThreadBufferSlot thread_buffer_slot;
+
+    void append_json_string(std::string &out, std::string_view str) {
+        out.push_back('"');
+        for (auto c : str) {
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c));
+            } else {
+                out.push_back(c);
+            }
+        }
+        out.push_back('"');
+    }
+} // namespace
+
+CpuProfiler::CpuProfiler() : generation{next_profiler_generation.fetch_add(1, std::memory_order_relaxed)} {
+    if (s_instance == nullptr) {
+        s_instance = this;
+    }
+}
+
+CpuProfiler::~CpuProfiler() {
+    if (is_capturing.load()) {
+        stop_capture();
+    }
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+auto CpuProfiler::thread_buffer() -> ThreadBuffer & {
+    auto &slot = thread_buffer_slot;
+    if (slot.generation != generation) {
+        slot.generation = generation;
+        slot.buffer = std::make_shared<ThreadBuffer>();
+        auto lock = std::lock_guard{buffers_mtx};
+        slot.buffer->thread_index = static_cast<uint32_t>(buffers.size());
+        slot.buffer->thread_name = fmt::format("thread {}", buffers.size());
+        buffers.push_back(slot.buffer);
+    }
+    return *slot.buffer;
+}
+
+void CpuProfiler::record(ProfileEvent const &event) {
+    auto &buffer = thread_buffer();
+    auto const current_capture_index = capture_index.load(std::memory_order_acquire);
+    if (buffer.capture_index.load(std::memory_order_relaxed) != current_capture_index) {
+        buffer.capture_index.store(current_capture_index, std::memory_order_relaxed);
+        buffer.event_n.store(0, std::memory_order_relaxed);
+        buffer.dropped_n.store(0, std::memory_order_relaxed);
+    }
+    auto const event_i = buffer.event_n.load(std::memory_order_relaxed);
+    if (event_i >= MAX_EVENTS_PER_THREAD) {
+        buffer.dropped_n.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto const chunk_i = event_i / ThreadBuffer::CHUNK_EVENT_N;
+    if (chunk_i >= buffer.chunks.size()) {
+        auto lock = std::lock_guard{buffer.mtx};
+        buffer.chunks.push_back(std::make_unique<ThreadBuffer::Chunk>());
+    }
+    (*buffer.chunks[chunk_i])[event_i % ThreadBuffer::CHUNK_EVENT_N] = event;
+    buffer.event_n.store(event_i + 1, std::memory_order_release);
+}
+
+void CpuProfiler::set_thread_name(std::string name) {
+    auto &buffer = thread_buffer();
+    auto lock = std::lock_guard{buffer.mtx};
+    buffer.thread_name = std::move(name);
+}
+
+void CpuProfiler::start_capture(uint32_t frame_n, std::filesystem::path output_path) {
+    // Threads drop the events of the previous capture the next time they record.
+    capture_index.fetch_add(1, std::memory_order_release);
+    frames_left = std::max(frame_n, 1u);
+    capture_path = std::move(output_path);
+    capture_start_ns = now_ns();
+    is_capturing.store(true, std::memory_order_relaxed);
+    log_info("Capturing a CPU profile of {} frames", frames_left);
+}
+
+void CpuProfiler::stop_capture() {
+    if (!is_capturing.exchange(false, std::memory_order_relaxed)) {
+        return;
+    }
+    frames_left = 0;
+    if (write_chrome_trace(capture_path)) {
+        log_info("Wrote the CPU profile to {}", capture_path.string());
+    } else {
+        log_error("Failed to write the CPU profile to {}", capture_path.string());
+    }
+}
+
+void CpuProfiler::begin_frame() {
+    if (!is_capturing.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (frames_left == 0 || --frames_left == 0) {
+        stop_capture();
+    }
+}
+
+auto CpuProfiler::write_chrome_trace(std::filesystem::path const &path) -> bool {
+    auto ec = std::error_code{};
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), ec);
+    }
+    auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Timestamps are in microseconds, relative to the start of the capture.
+    auto const to_us = [this](int64_t ns) { return static_cast<double>(ns - capture_start_ns) / 1000.0; };
+    auto out = std::string{"{\"traceEvents\":[\n"};
+    auto first = true;
+    auto const begin_event = [&]() {
+        if (!first) {
+            out.append(",\n");
+        }
+        first = false;
+    };
+
+    auto const current_capture_index = capture_index.load(std::memory_order_acquire);
+    auto lock = std::lock_guard{buffers_mtx};
+    for (auto const &buffer : buffers) {
+        auto buffer_lock = std::lock_guard{buffer->mtx};
+        auto const event_n = buffer->event_n.load(std::memory_order_acquire);
+        if (buffer->capture_index.load(std::memory_order_relaxed) != current_capture_index || event_n == 0) {
+            continue;
+        }
+        begin_event();
+        fmt::format_to(std::back_inserter(out), R"({{"ph":"M","name":"thread_name","pid":1,"tid":{},"args":{{"name":)", buffer->thread_index);
+        append_json_string(out, buffer->thread_name);
+        out.append("}}");
+        if (auto const dropped_n = buffer->dropped_n.load(std::memory_order_relaxed); dropped_n != 0) {
+            log_warning("The CPU profile of {} is missing {} events", buffer->thread_name, dropped_n);
+        }
+        for (size_t event_i = 0; event_i < event_n; ++event_i) {
+            auto const &event = (*buffer->chunks[event_i / ThreadBuffer::CHUNK_EVENT_N])[event_i % ThreadBuffer::CHUNK_EVENT_N];
+            begin_event();
+            if (event.type == ProfileEvent::Type::ZONE) {
+                out.append(R"({"ph":"X","name":)");
+                append_json_string(out, event.name);
+                fmt::format_to(std::back_inserter(out), R"(,"pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})", buffer->thread_index, to_us(event.start_ns), static_cast<double>(event.end_ns - event.start_ns) / 1000.0);
+            } else {
+                out.append(R"({"ph":"C","name":)");
+                append_json_string(out, event.name);
+                fmt::format_to(std::back_inserter(out), R"(,"pid":1,"tid":{},"ts":{:.3f},"args":{{"value":{}}}}})", buffer->thread_index, to_us(event.start_ns), event.value);
+            }
+            if (out.size() > (size_t{1} << 20)) {
+                file.write(out.data(), static_cast<std::streamsize>(out.size()));
+                out.clear();
+            }
+        }
+    }
+    out.append("\n]}\n");
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    return file.good();
+}
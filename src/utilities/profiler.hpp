@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Compiles all PROFILE_ZONE and PROFILE_COUNTER uses down to nothing when false.
+#define ENABLE_CPU_PROFILER true
+
+struct ProfileEvent {
+    enum struct Type : uint8_t {
+        ZONE,
+        COUNTER,
+    };
+    // Must outlive the capture, which string literals do.
+    char const *name;
+    Type type;
+    int64_t start_ns;
+    // Zones only.
+    int64_t end_ns;
+    // Counters only.
+    double value;
+};
+
+// Captures zones and counters of all threads for a number of frames, and writes them out as Chrome
+// trace JSON (which Perfetto opens too). Each thread records into its own buffer without locking, so
+// a zone costs two clock reads while capturing, and one atomic load otherwise.
+struct CpuProfiler {
+    // Events beyond this, per thread and capture, are dropped.
+    static constexpr size_t MAX_EVENTS_PER_THREAD = size_t{1} << 20;
+    // What gvox_engine_profiler_bench allows a zone to cost while capturing.
+    static constexpr double ZONE_OVERHEAD_BUDGET_NS = 150.0;
+
+    // Only the owning thread writes events. Others read the first `event_n` of them, and only take
+    // `mtx` to see `chunks` and `thread_name` in a consistent state.
+    struct ThreadBuffer {
+        static constexpr size_t CHUNK_EVENT_N = 4096;
+        using Chunk = std::array<ProfileEvent, CHUNK_EVENT_N>;
+
+        std::mutex mtx;
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::string thread_name;
+        uint32_t thread_index = 0;
+        // The capture the events are from. The owning thread resets the buffer when it changes.
+        std::atomic<uint32_t> capture_index{0};
+        std::atomic<size_t> event_n{0};
+        std::atomic<uint64_t> dropped_n{0};
+    };
+
+    inline static CpuProfiler *s_instance = nullptr;
+
+    std::atomic<bool> is_capturing{false};
+    std::atomic<uint32_t> capture_index{0};
+
+    CpuProfiler();
+    ~CpuProfiler();
+
+    CpuProfiler(CpuProfiler const &) = delete;
+    CpuProfiler(CpuProfiler &&) noexcept = delete;
+    CpuProfiler &operator=(CpuProfiler const &) = delete;
+    CpuProfiler &operator=(CpuProfiler &&) noexcept = delete;
+
+    // Captures the next `frame_n` frames, and writes them to `output_path` once they're done.
+    void start_capture(uint32_t frame_n, std::filesystem::path output_path);
+    // Ends the capture early, and writes what was captured so far.
+    void stop_capture();
+    // Call at the start of every frame, on the main thread.
+    void begin_frame();
+
+    void record(ProfileEvent const &event);
+    void set_thread_name(std::string name);
+    // Returns whether the file could be written.
+    auto write_chrome_trace(std::filesystem::path const &path) -> bool;
+
+    static auto now_ns() -> int64_t {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+  private:
+    std::mutex buffers_mtx;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    uint64_t generation;
+    uint32_t frames_left = 0;
+    std::filesystem::path capture_path;
+    int64_t capture_start_ns = 0;
+
+    auto thread_buffer() -> ThreadBuffer &;
+};
+
+struct ProfileZone {
+    char const *name;
+    int64_t start_ns = -1;
+
+    explicit ProfileZone(char const *a_name) : name{a_name} {
+        auto *profiler = CpuProfiler::s_instance;
+        if (profiler != nullptr && profiler->is_capturing.load(std::memory_order_relaxed)) {
+            start_ns = CpuProfiler::now_ns();
+        }
+    }
+    ~ProfileZone() {
+        if (start_ns < 0) {
+            return;
+        }
+        // Recorded even if the capture stopped in the meantime, so that zones around the end of a
+        // capture aren't lost.
+        if (auto *profiler = CpuProfiler::s_instance; profiler != nullptr) {
+            profiler->record({.name = name, .type = ProfileEvent::Type::ZONE, .start_ns = start_ns, .end_ns = CpuProfiler::now_ns(), .value = 0.0});
+        }
+    }
+    ProfileZone(ProfileZone const &) = delete;
+    ProfileZone(ProfileZone &&) noexcept = delete;
+    ProfileZone &operator=(ProfileZone const &) = delete;
+    ProfileZone &operator=(ProfileZone &&) noexcept = delete;
+};
+
+inline void profile_counter(char const *name, double value) {
+    auto *profiler = CpuProfiler::s_instance;
+    if (profiler != nullptr && profiler->is_capturing.load(std::memory_order_relaxed)) {
+        profiler->record({.name = name, .type = ProfileEvent::Type::COUNTER, .start_ns = CpuProfiler::now_ns(), .end_ns = 0, .value = value});
+    }
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#if ENABLE_CPU_PROFILER
+#define PROFILE_ZONE(name) ProfileZone const PROFILE_CONCAT(profile_zone_, __LINE__) { name }
+#define PROFILE_COUNTER(name, value) profile_counter(name, static_cast<double>(value))
+#else
+#define PROFILE_ZONE(name) static_cast<void>(0)
+#define PROFILE_COUNTER(name, value) static_cast<void>(0)
+#endif
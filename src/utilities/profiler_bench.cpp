@@ -0,0 +1,32 @@
+#include <utilities/profiler.hpp>
+#include <utilities/unit_test.hpp>
+
+// Measures what a zone costs while not capturing and while capturing. Fails if the capturing cost is
+// over CpuProfiler::ZONE_OVERHEAD_BUDGET_NS.
+// Usage: gvox_engine_profiler_bench [zone count]
+
+auto main(int argc, char const *argv[]) -> int {
+    auto const zone_n = benchmark_count_arg(std::span{argv, static_cast<size_t>(argc)}, 1'000'000);
+    // The only one, so it's the instance the zones record into.
+    auto profiler = CpuProfiler{};
+
+    auto const time_zones = [zone_n]() {
+        auto const t0 = CpuProfiler::now_ns();
+        for (uint32_t i = 0; i < zone_n; ++i) {
+            PROFILE_ZONE("benchmark zone");
+        }
+        return static_cast<double>(CpuProfiler::now_ns() - t0) / static_cast<double>(zone_n);
+    };
+    auto const idle_ns = time_zones();
+    profiler.is_capturing.store(true);
+    auto const capturing_ns = time_zones();
+    profiler.is_capturing.store(false);
+
+    auto const within_budget = capturing_ns <= CpuProfiler::ZONE_OVERHEAD_BUDGET_NS;
+    fmt::print("Profile zones: {:.1f} ns each while idle, {:.1f} ns each while capturing (budget {:.0f} ns), over {} zones\n",
+               idle_ns, capturing_ns, CpuProfiler::ZONE_OVERHEAD_BUDGET_NS, zone_n);
+    if (!within_budget) {
+        fmt::print("Profile zones are over their overhead budget\n");
+    }
+    return within_budget ? 0 : 1;
+}
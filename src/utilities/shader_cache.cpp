@@ -0,0 +1,341 @@
+#include "shader_cache.hpp"
+
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <string_view>
+
+namespace {
+    // Bump when the key layout or the entry format changes.
+    constexpr uint32_t SHADER_CACHE_VERSION = 1;
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+    // Two FNV-1a streams with different offset bases, giving a 128-bit key.
+    struct KeyHasher {
+        uint64_t lo = 0xcbf29ce484222325ull;
+        uint64_t hi = 0x84222325cbf29ce4ull;
+
+        void add_bytes(std::string_view bytes) {
+            for (auto c : bytes) {
+                lo = (lo ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+                hi = (hi ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+                hi ^= hi >> 29;
+            }
+        }
+        // Length-prefixed, so that ("ab", "c") and ("a", "bc") hash differently.
+        void add(std::string_view str) {
+            auto const size = uint64_t{str.size()};
+            add_bytes(std::string_view{reinterpret_cast<char const *>(&size), sizeof(size)});
+            add_bytes(str);
+        }
+    };
+
+    auto parse_include(std::string_view line, bool &is_quoted) -> std::optional<std::string_view> {
+        auto skip_space = [&line]() {
+            while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) {
+                line.remove_prefix(1);
+            }
+        };
+        skip_space();
+        if (line.empty() || line.front() != '#') {
+            return std::nullopt;
+        }
+        line.remove_prefix(1);
+        skip_space();
+        if (!line.starts_with("include")) {
+            return std::nullopt;
+        }
+        line.remove_prefix(7);
+        skip_space();
+        if (line.empty() || (line.front() != '<' && line.front() != '"')) {
+            return std::nullopt;
+        }
+        is_quoted = line.front() == '"';
+        auto const close = line.find(is_quoted ? '"' : '>', 1);
+        if (close == std::string_view::npos) {
+            return std::nullopt;
+        }
+        return line.substr(1, close - 1);
+    }
+} // namespace
+
+void add_shader_cache_compile_options(ShaderCacheKeyInfo &key_info, ShaderCacheCompileOptions const &manager_options, ShaderCacheCompileOptions const &pipeline_options) {
+    auto const entry_point = pipeline_options.entry_point.has_value() ? pipeline_options.entry_point : manager_options.entry_point;
+    auto const language = pipeline_options.language.has_value() ? pipeline_options.language : manager_options.language;
+    auto const enable_debug_info = pipeline_options.enable_debug_info.has_value() ? pipeline_options.enable_debug_info : manager_options.enable_debug_info;
+    key_info.options += fmt::format(";entry_point={};language={};debug_info={}",
+                                    entry_point.value_or(""), language.value_or(""),
+                                    enable_debug_info.has_value() ? (*enable_debug_info ? "1" : "0") : "");
+    // The pipeline's defines come first, followed by the pipeline manager's.
+    for (auto const *options : {&pipeline_options, &manager_options}) {
+        key_info.defines.insert(key_info.defines.end(), options->defines.begin(), options->defines.end());
+    }
+}
+
+auto ShaderCacheKey::to_string() const -> std::string {
+    return fmt::format("{:016x}{:016x}", hash_hi, hash_lo);
+}
+
+ShaderCache::ShaderCache(ShaderCacheInfo a_info) : info{std::move(a_info)} {
+    std::filesystem::create_directories(info.folder);
+    // Left over from compiles that were running when the app last exited.
+    auto ec = std::error_code{};
+    std::filesystem::remove_all(info.folder / "staging", ec);
+    auto manifest_file = std::ifstream(info.folder / "manifest.json");
+    if (!manifest_file.good()) {
+        return;
+    }
+    auto json = nlohmann::json::parse(manifest_file, nullptr, false);
+    if (json.is_discarded() || !json.contains("version") || json["version"] != SHADER_CACHE_VERSION) {
+        return;
+    }
+    if (!json.contains("compiler_version") || json["compiler_version"] != info.compiler_version) {
+        // Every key hashes the compiler version, so the old entries can never be hit again.
+        for (auto const &[key, entry] : json["entries"].items()) {
+            std::filesystem::remove(info.folder / (key + ".spv"));
+        }
+        return;
+    }
+    for (auto const &[key, entry] : json["entries"].items()) {
+        if (std::filesystem::exists(info.folder / (key + ".spv"))) {
+            manifest_entries[key] = ManifestEntry{.name = entry["name"].get<std::string>(), .size = entry["size"].get<size_t>()};
+        }
+    }
+}
+
+ShaderCache::~ShaderCache() {
+    write_manifest();
+}
+
+void ShaderCache::add_virtual_file(std::string const &name, std::string const &contents) {
+    auto lock = std::lock_guard{mtx};
+    virtual_files[name] = contents;
+}
+
+auto ShaderCache::read_source_file(std::filesystem::path const &path) const -> std::optional<std::string> {
+    if (info.read_file) {
+        return info.read_file(path);
+    }
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file.good()) {
+        return std::nullopt;
+    }
+    auto stream = std::stringstream{};
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+auto ShaderCache::compute_key(ShaderCacheKeyInfo const &key_info) const -> ShaderCacheKey {
+    auto result = ShaderCacheKey{};
+    auto hasher = KeyHasher{};
+    hasher.add(fmt::format("version {}", SHADER_CACHE_VERSION));
+    hasher.add(info.compiler_version);
+    hasher.add(key_info.name);
+    hasher.add(key_info.options);
+    for (auto const &[name, value] : key_info.defines) {
+        hasher.add(name);
+        hasher.add(value);
+    }
+
+    auto virtual_files_copy = std::map<std::string, std::string>{};
+    {
+        auto lock = std::lock_guard{mtx};
+        virtual_files_copy = virtual_files;
+    }
+
+    struct PendingSource {
+        std::string contents;
+        std::filesystem::path folder;
+    };
+    auto pending = std::vector<PendingSource>{};
+    auto visited = std::set<std::string>{};
+
+    auto find_on_disk = [&](std::filesystem::path const &path) -> std::optional<std::pair<std::filesystem::path, std::string>> {
+        if (auto contents = read_source_file(path)) {
+            return std::pair{path.lexically_normal(), std::move(*contents)};
+        }
+        return std::nullopt;
+    };
+
+    if (!key_info.source_path.empty()) {
+        auto found = std::optional<std::pair<std::filesystem::path, std::string>>{};
+        for (auto const &root : info.root_paths) {
+            if ((found = find_on_disk(root / key_info.source_path))) {
+                break;
+            }
+        }
+        if (!found) {
+            found = find_on_disk(key_info.source_path);
+        }
+        if (found) {
+            hasher.add(found->first.generic_string());
+            hasher.add(found->second);
+            visited.insert(found->first.generic_string());
+            result.file_dependencies.push_back(found->first);
+            pending.push_back({std::move(found->second), found->first.parent_path()});
+        } else {
+            hasher.add("missing:" + key_info.source_path.generic_string());
+        }
+    } else {
+        hasher.add(key_info.source_code);
+        pending.push_back({key_info.source_code, {}});
+    }
+
+    // Walks the include closure. Includes in disabled #if blocks or comments are hashed too, which
+    // only means that editing them invalidates a few more entries than strictly necessary.
+    while (!pending.empty()) {
+        auto source = std::move(pending.back());
+        pending.pop_back();
+        auto stream = std::istringstream{source.contents};
+        auto line = std::string{};
+        while (std::getline(stream, line)) {
+            auto is_quoted = false;
+            auto include = parse_include(line, is_quoted);
+            if (!include) {
+                continue;
+            }
+            auto const include_str = std::string{*include};
+            if (auto iter = virtual_files_copy.find(include_str); iter != virtual_files_copy.end()) {
+                if (visited.insert("virtual:" + include_str).second) {
+                    hasher.add("virtual:" + include_str);
+                    hasher.add(iter->second);
+                    result.virtual_file_dependencies.push_back(include_str);
+                    pending.push_back({iter->second, {}});
+                }
+                continue;
+            }
+            auto found = std::optional<std::pair<std::filesystem::path, std::string>>{};
+            if (is_quoted && !source.folder.empty()) {
+                found = find_on_disk(source.folder / include_str);
+            }
+            for (auto const &root : info.root_paths) {
+                if (found) {
+                    break;
+                }
+                found = find_on_disk(root / include_str);
+            }
+            if (!found) {
+                // Either the compile fails, or the include was never reached. Both are fine to key on.
+                if (visited.insert("missing:" + include_str).second) {
+                    hasher.add("missing:" + include_str);
+                }
+                continue;
+            }
+            auto const path_str = found->first.generic_string();
+            if (!visited.insert(path_str).second) {
+                continue;
+            }
+            hasher.add(path_str);
+            hasher.add(found->second);
+            result.file_dependencies.push_back(found->first);
+            pending.push_back({std::move(found->second), found->first.parent_path()});
+        }
+    }
+
+    result.hash_lo = hasher.lo;
+    result.hash_hi = hasher.hi;
+    return result;
+}
+
+auto ShaderCache::entry_path(ShaderCacheKey const &key) const -> std::filesystem::path {
+    return info.folder / (key.to_string() + ".spv");
+}
+
+auto ShaderCache::staging_folder(ShaderCacheKey const &key) const -> std::filesystem::path {
+    return info.folder / "staging" / key.to_string();
+}
+
+auto ShaderCache::load(ShaderCacheKey const &key) -> std::optional<std::vector<uint32_t>> {
+    auto const path = entry_path(key);
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file.good()) {
+        miss_n.fetch_add(1);
+        return std::nullopt;
+    }
+    auto const size = std::filesystem::file_size(path);
+    auto result = std::vector<uint32_t>(size / sizeof(uint32_t));
+    file.read(reinterpret_cast<char *>(result.data()), static_cast<std::streamsize>(result.size() * sizeof(uint32_t)));
+    if (size == 0 || size % sizeof(uint32_t) != 0 || !file.good() || result[0] != SPIRV_MAGIC) {
+        file.close();
+        std::filesystem::remove(path);
+        invalid_n.fetch_add(1);
+        miss_n.fetch_add(1);
+        return std::nullopt;
+    }
+    hit_n.fetch_add(1);
+    return result;
+}
+
+void ShaderCache::store(ShaderCacheKey const &key, std::string const &name, std::span<uint32_t const> spirv) {
+    if (spirv.empty() || spirv[0] != SPIRV_MAGIC) {
+        return;
+    }
+    auto const path = entry_path(key);
+    // Write next to the entry and rename it into place, so that a crash (or a second instance of
+    // the app) never leaves a half written entry behind.
+    auto const temp_path = std::filesystem::path{path}.replace_extension(".tmp");
+    {
+        auto file = std::ofstream(temp_path, std::ios::binary);
+        file.write(reinterpret_cast<char const *>(spirv.data()), static_cast<std::streamsize>(spirv.size_bytes()));
+        if (!file.good()) {
+            return;
+        }
+    }
+    auto ec = std::error_code{};
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return;
+    }
+    store_n.fetch_add(1);
+    auto lock = std::lock_guard{mtx};
+    manifest_entries[key.to_string()] = ManifestEntry{.name = name, .size = spirv.size_bytes()};
+}
+
+auto ShaderCache::find_or_compile(ShaderCacheKeyInfo const &key_info, CompileFunction const &compile) -> std::optional<std::vector<uint32_t>> {
+    auto const key = compute_key(key_info);
+    if (auto cached = load(key)) {
+        return cached;
+    }
+    auto result = compile();
+    if (result) {
+        store(key, key_info.name, *result);
+    }
+    return result;
+}
+
+auto ShaderCache::stats() const -> ShaderCacheStats {
+    return {
+        .hit_n = hit_n.load(),
+        .miss_n = miss_n.load(),
+        .store_n = store_n.load(),
+        .invalid_n = invalid_n.load(),
+    };
+}
+
+void ShaderCache::write_manifest() {
+    auto json = nlohmann::json{};
+    json["version"] = SHADER_CACHE_VERSION;
+    json["compiler_version"] = info.compiler_version;
+    auto const session_stats = stats();
+    json["last_session"] = {
+        {"hits", session_stats.hit_n},
+        {"misses", session_stats.miss_n},
+        {"stores", session_stats.store_n},
+        {"invalid", session_stats.invalid_n},
+    };
+    auto &entries_json = json["entries"];
+    entries_json = nlohmann::json::object();
+    {
+        auto lock = std::lock_guard{mtx};
+        for (auto const &[key, entry] : manifest_entries) {
+            entries_json[key] = {{"name", entry.name}, {"size", entry.size}};
+        }
+    }
+    auto f = std::ofstream(info.folder / "manifest.json");
+    f << std::setw(4) << json;
+}
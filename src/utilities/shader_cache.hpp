@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// On-disk cache of compiled shader binaries. Entries are addressed by a hash of everything that can
+// change the output: the shader source and every file it (transitively) includes, the defines, the
+// compiler version and any extra options the caller passes in. Nothing in here knows about daxa, so
+// the keying and invalidation can be driven by a fake file system and compiler.
+
+struct ShaderCacheKey {
+    uint64_t hash_lo = 0;
+    uint64_t hash_hi = 0;
+    // Files from disk and virtual files that went into the hash, so callers can watch them.
+    std::vector<std::filesystem::path> file_dependencies;
+    std::vector<std::string> virtual_file_dependencies;
+
+    auto to_string() const -> std::string;
+};
+
+struct ShaderCacheKeyInfo {
+    std::string name;
+    // Exactly one of these is used. A non-empty path wins.
+    std::filesystem::path source_path;
+    std::string source_code;
+    std::vector<std::pair<std::string, std::string>> defines;
+    // Anything else that changes the generated code, e.g. the shader stage.
+    std::string options;
+};
+
+// The compile options that change the generated code, without daxa's types. Unset ones fall back to
+// the options they're merged over, and in the end to the compiler's defaults.
+struct ShaderCacheCompileOptions {
+    std::optional<std::string> entry_point;
+    std::optional<std::string> language;
+    std::optional<bool> enable_debug_info;
+    std::vector<std::pair<std::string, std::string>> defines;
+};
+
+// Adds what a pipeline is compiled with to `key_info`: its own options merged over the ones the
+// pipeline manager applies to every pipeline, the same way the pipeline manager merges them.
+void add_shader_cache_compile_options(ShaderCacheKeyInfo &key_info, ShaderCacheCompileOptions const &manager_options, ShaderCacheCompileOptions const &pipeline_options);
+
+struct ShaderCacheStats {
+    uint32_t hit_n;
+    uint32_t miss_n;
+    uint32_t store_n;
+    // Entries that existed, but were rejected when loading them (truncated, not SPIR-V).
+    uint32_t invalid_n;
+};
+
+struct ShaderCacheInfo {
+    std::filesystem::path folder;
+    std::string compiler_version;
+    // Searched in order for `#include <...>`, and after the including file's folder for `#include "..."`.
+    std::vector<std::filesystem::path> root_paths;
+    // Returns the file's contents, or nothing if it doesn't exist. Reads from disk when empty.
+    std::function<std::optional<std::string>(std::filesystem::path const &)> read_file;
+};
+
+struct ShaderCache {
+    using CompileFunction = std::function<std::optional<std::vector<uint32_t>>()>;
+
+    explicit ShaderCache(ShaderCacheInfo a_info);
+    ~ShaderCache();
+
+    ShaderCache(ShaderCache const &) = delete;
+    ShaderCache(ShaderCache &&) noexcept = delete;
+    ShaderCache &operator=(ShaderCache const &) = delete;
+    ShaderCache &operator=(ShaderCache &&) noexcept = delete;
+
+    // Virtual files are matched by name before anything on disk, like the pipeline manager does.
+    void add_virtual_file(std::string const &name, std::string const &contents);
+
+    auto compute_key(ShaderCacheKeyInfo const &key_info) const -> ShaderCacheKey;
+    auto load(ShaderCacheKey const &key) -> std::optional<std::vector<uint32_t>>;
+    void store(ShaderCacheKey const &key, std::string const &name, std::span<uint32_t const> spirv);
+    auto find_or_compile(ShaderCacheKeyInfo const &key_info, CompileFunction const &compile) -> std::optional<std::vector<uint32_t>>;
+
+    // A folder unique to `key` that a compiler can write its output to before it is stored.
+    auto staging_folder(ShaderCacheKey const &key) const -> std::filesystem::path;
+
+    auto stats() const -> ShaderCacheStats;
+    // Writes manifest.json, listing every entry along with this session's hit/miss counts.
+    void write_manifest();
+
+  private:
+    struct ManifestEntry {
+        std::string name;
+        size_t size;
+    };
+
+    auto entry_path(ShaderCacheKey const &key) const -> std::filesystem::path;
+    auto read_source_file(std::filesystem::path const &path) const -> std::optional<std::string>;
+
+    ShaderCacheInfo info;
+    mutable std::mutex mtx;
+    std::map<std::string, std::string> virtual_files;
+    std::map<std::string, ManifestEntry> manifest_entries;
+    std::atomic_uint32_t hit_n{0};
+    std::atomic_uint32_t miss_n{0};
+    std::atomic_uint32_t store_n{0};
+    std::atomic_uint32_t invalid_n{0};
+};
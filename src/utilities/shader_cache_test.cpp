@@ -0,0 +1,326 @@
+#include <utilities/shader_cache.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <map>
+
+namespace {
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+    // Shader sources served from memory, by path.
+    struct FakeFiles {
+        std::map<std::filesystem::path, std::string> files;
+
+        auto read_function() -> std::function<std::optional<std::string>(std::filesystem::path const &)> {
+            return [this](std::filesystem::path const &path) -> std::optional<std::string> {
+                if (auto iter = files.find(path.lexically_normal()); iter != files.end()) {
+                    return iter->second;
+                }
+                return std::nullopt;
+            };
+        }
+    };
+
+    // Stands in for the GLSL compiler. The output only has to start like SPIR-V.
+    struct FakeCompiler {
+        uint32_t compile_n = 0;
+
+        auto function(uint32_t payload) -> ShaderCache::CompileFunction {
+            return [this, payload]() -> std::optional<std::vector<uint32_t>> {
+                ++compile_n;
+                return std::vector<uint32_t>{SPIRV_MAGIC, payload, 0, 0, 0};
+            };
+        }
+    };
+
+    auto fresh_folder(std::string_view name) -> std::filesystem::path {
+        auto const folder = std::filesystem::path{".out/shader_cache_test"} / name;
+        std::filesystem::remove_all(folder);
+        return folder;
+    }
+
+    auto make_files() -> FakeFiles {
+        auto result = FakeFiles{};
+        result.files["shaders/main.glsl"] = "#include \"common.glsl\"\n#include <shared/math.glsl>\n#include <g_samplers>\nvoid main() {}\n";
+        result.files["shaders/common.glsl"] = "#pragma once\n#include <shared/math.glsl>\n";
+        result.files["lib/shared/math.glsl"] = "#pragma once\n  #  include \"constants.glsl\"\nfloat square(float x);\n";
+        result.files["lib/shared/constants.glsl"] = "#define PI 3.14159\n";
+        result.files["lib/shared/unused.glsl"] = "#define UNUSED 1\n";
+        return result;
+    }
+
+    auto make_info(std::filesystem::path const &folder, FakeFiles &files, std::string compiler_version = "fake 1.0") -> ShaderCacheInfo {
+        return {
+            .folder = folder,
+            .compiler_version = std::move(compiler_version),
+            .root_paths = {"shaders", "lib"},
+            .read_file = files.read_function(),
+        };
+    }
+
+    auto main_key_info() -> ShaderCacheKeyInfo {
+        return {
+            .name = "main",
+            .source_path = "main.glsl",
+            .source_code = {},
+            .defines = {{"RADIUS", "2"}, {"FAST", "1"}},
+            .options = "comp",
+        };
+    }
+
+    auto test_hit_after_miss() -> std::string {
+        auto files = make_files();
+        auto compiler = FakeCompiler{};
+        auto cache = ShaderCache{make_info(fresh_folder("hit_after_miss"), files)};
+        auto const first = cache.find_or_compile(main_key_info(), compiler.function(1));
+        auto const second = cache.find_or_compile(main_key_info(), compiler.function(2));
+        if (!first || !second || *first != *second) {
+            return "the cached binary isn't the one that was compiled";
+        }
+        auto const stats = cache.stats();
+        if (compiler.compile_n != 1 || stats.hit_n != 1 || stats.miss_n != 1 || stats.store_n != 1) {
+            return fmt::format("compiled {} times, with {} hits, {} misses and {} stores", compiler.compile_n, stats.hit_n, stats.miss_n, stats.store_n);
+        }
+        return {};
+    }
+
+    // The include closure is found through quoted includes relative to the including file, the
+    // root paths and virtual files, and every one of them goes into the key.
+    auto test_key_covers_include_closure() -> std::string {
+        auto files = make_files();
+        auto cache = ShaderCache{make_info(fresh_folder("include_closure"), files)};
+        cache.add_virtual_file("g_samplers", "#pragma once\n");
+        auto const key = cache.compute_key(main_key_info());
+        auto const expected_files = std::vector<std::filesystem::path>{"shaders/main.glsl", "shaders/common.glsl", "lib/shared/math.glsl", "lib/shared/constants.glsl"};
+        for (auto const &path : expected_files) {
+            if (std::find(key.file_dependencies.begin(), key.file_dependencies.end(), path) == key.file_dependencies.end()) {
+                return fmt::format("'{}' isn't a dependency", path.generic_string());
+            }
+        }
+        if (key.file_dependencies.size() != expected_files.size() || key.virtual_file_dependencies != std::vector<std::string>{"g_samplers"}) {
+            return fmt::format("found {} file and {} virtual file dependencies", key.file_dependencies.size(), key.virtual_file_dependencies.size());
+        }
+
+        auto const expect_changed = [&](std::string_view what, bool is_changed) -> std::string {
+            auto const changed_key = cache.compute_key(main_key_info());
+            if ((changed_key.to_string() != key.to_string()) != is_changed) {
+                return fmt::format("changing {} {} the key", what, is_changed ? "didn't change" : "changed");
+            }
+            return {};
+        };
+        auto const edit_file = [&](std::filesystem::path const &path, std::string_view what, bool is_changed) -> std::string {
+            auto const original = files.files[path];
+            files.files[path] += "// edited\n";
+            auto result = expect_changed(what, is_changed);
+            files.files[path] = original;
+            return result;
+        };
+        for (auto const &path : expected_files) {
+            if (auto error = edit_file(path, path.generic_string(), true); !error.empty()) {
+                return error;
+            }
+        }
+        if (auto error = edit_file("lib/shared/unused.glsl", "a file that isn't included", false); !error.empty()) {
+            return error;
+        }
+        cache.add_virtual_file("g_samplers", "#pragma once\n// edited\n");
+        if (auto error = expect_changed("a virtual file", true); !error.empty()) {
+            return error;
+        }
+        cache.add_virtual_file("g_samplers", "#pragma once\n");
+        return expect_changed("nothing", false);
+    }
+
+    auto test_key_covers_inputs() -> std::string {
+        auto files = make_files();
+        auto cache = ShaderCache{make_info(fresh_folder("inputs"), files)};
+        auto const key = cache.compute_key(main_key_info()).to_string();
+        auto variants = std::vector<std::pair<std::string_view, ShaderCacheKeyInfo>>{};
+        auto key_info = main_key_info();
+        key_info.defines[0].second = "3";
+        variants.emplace_back("a define's value", key_info);
+        key_info = main_key_info();
+        key_info.defines.pop_back();
+        variants.emplace_back("the defines", key_info);
+        key_info = main_key_info();
+        std::swap(key_info.defines[0], key_info.defines[1]);
+        variants.emplace_back("the order of the defines", key_info);
+        key_info = main_key_info();
+        key_info.options = "frag";
+        variants.emplace_back("the options", key_info);
+        key_info = main_key_info();
+        key_info.source_path = "common.glsl";
+        variants.emplace_back("the source path", key_info);
+        // Splitting a string differently may not collide.
+        key_info = main_key_info();
+        key_info.defines = {{"RADIUS2", ""}, {"FAST", "1"}};
+        variants.emplace_back("where a define's name ends", key_info);
+        for (auto const &[what, variant] : variants) {
+            if (cache.compute_key(variant).to_string() == key) {
+                return fmt::format("changing {} didn't change the key", what);
+            }
+        }
+        auto other_compiler_cache = ShaderCache{make_info(fresh_folder("inputs_other_compiler"), files, "fake 2.0")};
+        if (other_compiler_cache.compute_key(main_key_info()).to_string() == key) {
+            return "changing the compiler version didn't change the key";
+        }
+        return {};
+    }
+
+    // The options the pipeline manager applies to every pipeline are keyed like the pipeline's own,
+    // and the pipeline's own win where both are set.
+    auto test_key_covers_manager_options() -> std::string {
+        auto files = make_files();
+        auto cache = ShaderCache{make_info(fresh_folder("manager_options"), files)};
+        auto const manager_options = ShaderCacheCompileOptions{
+            .entry_point = {},
+            .language = "glsl",
+            .enable_debug_info = true,
+            .defines = {{"DEBUG", "1"}},
+        };
+        auto const pipeline_options = ShaderCacheCompileOptions{.entry_point = {}, .language = {}, .enable_debug_info = {}, .defines = {{"RADIUS", "2"}}};
+        auto const key_of = [&](ShaderCacheCompileOptions const &manager, ShaderCacheCompileOptions const &pipeline) {
+            auto key_info = main_key_info();
+            key_info.defines.clear();
+            add_shader_cache_compile_options(key_info, manager, pipeline);
+            return cache.compute_key(key_info).to_string();
+        };
+        auto const key = key_of(manager_options, pipeline_options);
+
+        auto variants = std::vector<std::pair<std::string_view, ShaderCacheCompileOptions>>{};
+        auto options = manager_options;
+        options.enable_debug_info = false;
+        variants.emplace_back("the debug info", options);
+        options = manager_options;
+        options.enable_debug_info.reset();
+        variants.emplace_back("whether the debug info is set", options);
+        options = manager_options;
+        options.language = "slang";
+        variants.emplace_back("the language", options);
+        options = manager_options;
+        options.entry_point = "main";
+        variants.emplace_back("the entry point", options);
+        options = manager_options;
+        options.defines[0].second = "0";
+        variants.emplace_back("a define", options);
+        for (auto const &[what, variant] : variants) {
+            if (key_of(variant, pipeline_options) == key) {
+                return fmt::format("changing the pipeline manager's {} didn't change the key", what);
+            }
+        }
+
+        // Set on the pipeline, the pipeline manager's value doesn't matter.
+        auto pipeline_debug_options = pipeline_options;
+        pipeline_debug_options.enable_debug_info = false;
+        auto manager_no_debug_options = manager_options;
+        manager_no_debug_options.enable_debug_info = false;
+        if (key_of(manager_options, pipeline_debug_options) != key_of(manager_no_debug_options, pipeline_debug_options)) {
+            return "the pipeline manager's debug info overrode the pipeline's";
+        }
+        return {};
+    }
+
+    // Include cycles end, and missing includes are keyed by name, so adding the file later changes the key.
+    auto test_cycles_and_missing_includes() -> std::string {
+        auto files = FakeFiles{};
+        files.files["shaders/a.glsl"] = "#include \"b.glsl\"\n#include \"missing.glsl\"\n";
+        files.files["shaders/b.glsl"] = "#include \"a.glsl\"\n";
+        auto cache = ShaderCache{make_info(fresh_folder("cycles"), files)};
+        auto key_info = ShaderCacheKeyInfo{.name = "a", .source_path = "a.glsl", .source_code = {}, .defines = {}, .options = {}};
+        auto const key = cache.compute_key(key_info);
+        if (key.file_dependencies.size() != 2) {
+            return fmt::format("found {} dependencies in a cycle of 2 files", key.file_dependencies.size());
+        }
+        files.files["shaders/missing.glsl"] = "\n";
+        if (cache.compute_key(key_info).to_string() == key.to_string()) {
+            return "adding a missing include didn't change the key";
+        }
+        return {};
+    }
+
+    // Entries outlive the cache object, but not a change of compiler, and broken entries are
+    // recompiled instead of being handed out.
+    auto test_persistence_and_invalidation() -> std::string {
+        auto files = make_files();
+        auto const folder = fresh_folder("persistence");
+        auto compiler = FakeCompiler{};
+        auto entry_path = std::filesystem::path{};
+        {
+            auto cache = ShaderCache{make_info(folder, files)};
+            cache.find_or_compile(main_key_info(), compiler.function(1));
+            entry_path = folder / (cache.compute_key(main_key_info()).to_string() + ".spv");
+        }
+        {
+            auto cache = ShaderCache{make_info(folder, files)};
+            cache.find_or_compile(main_key_info(), compiler.function(1));
+            if (compiler.compile_n != 1 || cache.stats().hit_n != 1) {
+                return "a new cache object over the same folder missed";
+            }
+        }
+        {
+            // Truncated in the middle of a word.
+            std::filesystem::resize_file(entry_path, 7);
+            auto cache = ShaderCache{make_info(folder, files)};
+            auto const result = cache.find_or_compile(main_key_info(), compiler.function(1));
+            if (!result || result->size() != 5 || compiler.compile_n != 2 || cache.stats().invalid_n != 1) {
+                return fmt::format("a truncated entry was {}", compiler.compile_n == 2 ? "recompiled wrong" : "loaded");
+            }
+            auto const not_spirv = cache.find_or_compile({.name = "bad", .source_path = {}, .source_code = "x", .defines = {}, .options = {}}, []() {
+                return std::optional{std::vector<uint32_t>{1, 2, 3}};
+            });
+            if (!not_spirv || cache.stats().store_n != 1) {
+                return "output that isn't SPIR-V was stored";
+            }
+        }
+        {
+            auto cache = ShaderCache{make_info(folder, files, "fake 2.0")};
+            if (std::filesystem::exists(entry_path)) {
+                return "entries of the old compiler version are still there";
+            }
+        }
+        return {};
+    }
+
+    auto test_manifest() -> std::string {
+        auto files = make_files();
+        auto const folder = fresh_folder("manifest");
+        auto compiler = FakeCompiler{};
+        auto key = std::string{};
+        {
+            auto cache = ShaderCache{make_info(folder, files)};
+            cache.find_or_compile(main_key_info(), compiler.function(1));
+            cache.find_or_compile(main_key_info(), compiler.function(1));
+            key = cache.compute_key(main_key_info()).to_string();
+        }
+        auto manifest_file = std::ifstream(folder / "manifest.json");
+        auto const json = nlohmann::json::parse(manifest_file, nullptr, false);
+        if (json.is_discarded()) {
+            return "the manifest isn't JSON";
+        }
+        if (!json.contains("entries") || !json["entries"].contains(key) || json["entries"][key]["name"] != "main" || json["entries"][key]["size"] != 5 * sizeof(uint32_t)) {
+            return "the manifest doesn't list the entry";
+        }
+        auto const &session = json["last_session"];
+        if (session["hits"] != 1 || session["misses"] != 1 || session["stores"] != 1) {
+            return fmt::format("the manifest has the session stats {}", session.dump());
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"hit after a miss", test_hit_after_miss},
+        UnitTestCase{"the key covers the include closure", test_key_covers_include_closure},
+        UnitTestCase{"the key covers defines, options and the compiler", test_key_covers_inputs},
+        UnitTestCase{"the key covers the pipeline manager's options", test_key_covers_manager_options},
+        UnitTestCase{"include cycles and missing includes", test_cycles_and_missing_includes},
+        UnitTestCase{"persistence and invalidation", test_persistence_and_invalidation},
+        UnitTestCase{"manifest", test_manifest},
+    };
+    return run_unit_tests(cases);
+}
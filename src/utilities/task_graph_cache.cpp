@@ -0,0 +1,109 @@
+#include "task_graph_cache.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+
+auto TaskGraphCache::Plan::any() const -> bool {
+    return std::find(graphs.begin(), graphs.end(), true) != graphs.end();
+}
+
+auto TaskGraphCache::add_graph(std::string name) -> uint32_t {
+    graphs.push_back({.name = std::move(name)});
+    return static_cast<uint32_t>(graphs.size() - 1);
+}
+
+auto TaskGraphCache::add_subgraph(uint32_t graph_index, std::string name) -> uint32_t {
+    subgraphs.push_back({.name = std::move(name), .graph_index = graph_index, .inputs = {}, .recorded_inputs = {}});
+    return static_cast<uint32_t>(subgraphs.size() - 1);
+}
+
+void TaskGraphCache::set_inputs(uint32_t subgraph_index, std::vector<TaskGraphInput> inputs) {
+    subgraphs[subgraph_index].inputs = std::move(inputs);
+}
+
+void TaskGraphCache::invalidate() {
+    for (auto &graph : graphs) {
+        graph.is_invalidated = true;
+    }
+}
+
+auto TaskGraphCache::plan() -> Plan {
+    auto result = Plan{.graphs = std::vector<bool>(graphs.size(), false), .changes = {}};
+    for (uint32_t graph_i = 0; graph_i < graphs.size(); ++graph_i) {
+        if (graphs[graph_i].is_invalidated) {
+            result.graphs[graph_i] = true;
+            result.changes.push_back(fmt::format("{}: invalidated", graphs[graph_i].name));
+        }
+    }
+    for (auto const &subgraph : subgraphs) {
+        if (subgraph.inputs == subgraph.recorded_inputs) {
+            continue;
+        }
+        result.graphs[subgraph.graph_index] = true;
+        auto const find_input = [](std::vector<TaskGraphInput> const &inputs, std::string const &name) {
+            return std::find_if(inputs.begin(), inputs.end(), [&name](TaskGraphInput const &input) { return input.name == name; });
+        };
+        for (auto const &input : subgraph.inputs) {
+            auto const recorded = find_input(subgraph.recorded_inputs, input.name);
+            if (recorded == subgraph.recorded_inputs.end()) {
+                result.changes.push_back(fmt::format("{}.{}: {}", subgraph.name, input.name, input.value));
+            } else if (recorded->value != input.value) {
+                result.changes.push_back(fmt::format("{}.{}: {} -> {}", subgraph.name, input.name, recorded->value, input.value));
+            }
+        }
+        for (auto const &recorded : subgraph.recorded_inputs) {
+            if (find_input(subgraph.inputs, recorded.name) == subgraph.inputs.end()) {
+                result.changes.push_back(fmt::format("{}.{}: {} -> (gone)", subgraph.name, recorded.name, recorded.value));
+            }
+        }
+    }
+    for (uint32_t graph_i = 0; graph_i < graphs.size(); ++graph_i) {
+        if (!result.graphs[graph_i]) {
+            ++graphs[graph_i].skip_n;
+        }
+    }
+    if (result.any()) {
+        last_changes = result.changes;
+    }
+    return result;
+}
+
+void TaskGraphCache::mark_subgraph_recorded(uint32_t subgraph_index, uint64_t record_ns) {
+    auto &subgraph = subgraphs[subgraph_index];
+    ++subgraph.record_n;
+    subgraph.last_record_ns = record_ns;
+    subgraph.total_record_ns += record_ns;
+}
+
+void TaskGraphCache::mark_graph_recorded(uint32_t graph_index, uint64_t record_ns, bool drained) {
+    auto &graph = graphs[graph_index];
+    graph.is_invalidated = false;
+    ++graph.record_n;
+    graph.drain_n += drained ? 1 : 0;
+    graph.last_record_ns = record_ns;
+    graph.total_record_ns += record_ns;
+    for (auto &subgraph : subgraphs) {
+        if (subgraph.graph_index == graph_index) {
+            subgraph.recorded_inputs = subgraph.inputs;
+        }
+    }
+}
+
+auto TaskGraphCache::stats_lines() const -> std::vector<std::string> {
+    auto const ms = [](uint64_t ns) { return static_cast<double>(ns) / 1'000'000.0; };
+    auto const mean_ms = [&ms](uint64_t total_ns, uint64_t n) { return n == 0 ? 0.0 : ms(total_ns) / static_cast<double>(n); };
+    auto result = std::vector<std::string>{};
+    for (uint32_t graph_i = 0; graph_i < graphs.size(); ++graph_i) {
+        auto const &graph = graphs[graph_i];
+        result.push_back(fmt::format("{}: recorded {} times, skipped {}, waited for idle {}, last {:.2f} ms, mean {:.2f} ms",
+                                     graph.name, graph.record_n, graph.skip_n, graph.drain_n, ms(graph.last_record_ns), mean_ms(graph.total_record_ns, graph.record_n)));
+        for (auto const &subgraph : subgraphs) {
+            if (subgraph.graph_index == graph_i) {
+                result.push_back(fmt::format("  {:<12} {} inputs, last {:.2f} ms, mean {:.2f} ms",
+                                             subgraph.name, subgraph.inputs.size(), ms(subgraph.last_record_ns), mean_ms(subgraph.total_record_ns, subgraph.record_n)));
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU-only description of what the task graphs were recorded from, so that they're only recorded
+// again once something they were recorded from actually changed. Each subgraph (the passes that one
+// system adds) lists its inputs as name/value strings, like a setting and its value, or a
+// resolution. Subgraphs belong to one of the daxa task graphs. daxa compiles a task graph as a
+// whole, so a subgraph whose inputs changed means recording its whole task graph again, but the
+// task graphs none of whose subgraphs changed are kept as they are.
+struct TaskGraphInput {
+    std::string name;
+    std::string value;
+
+    auto operator==(TaskGraphInput const &) const -> bool = default;
+};
+
+struct TaskGraphCache {
+    struct Graph {
+        std::string name;
+        bool is_invalidated = true;
+        uint64_t record_n = 0;
+        // Times the graph was asked to be recorded, but none of its subgraphs' inputs had changed.
+        uint64_t skip_n = 0;
+        // Times the device had to go idle before recording it.
+        uint64_t drain_n = 0;
+        uint64_t last_record_ns = 0;
+        uint64_t total_record_ns = 0;
+    };
+    struct Subgraph {
+        std::string name;
+        uint32_t graph_index;
+        std::vector<TaskGraphInput> inputs;
+        // What `inputs` were when its graph was last recorded.
+        std::vector<TaskGraphInput> recorded_inputs;
+        uint64_t record_n = 0;
+        uint64_t last_record_ns = 0;
+        uint64_t total_record_ns = 0;
+    };
+    struct Plan {
+        // By graph index.
+        std::vector<bool> graphs;
+        // One line per input that differs from when its subgraph was recorded, for the console.
+        std::vector<std::string> changes;
+
+        auto any() const -> bool;
+        auto records(uint32_t graph_index) const -> bool { return graphs[graph_index]; }
+    };
+
+    std::vector<Graph> graphs;
+    std::vector<Subgraph> subgraphs;
+    // The changes of the last plan that recorded anything.
+    std::vector<std::string> last_changes;
+
+    auto add_graph(std::string name) -> uint32_t;
+    auto add_subgraph(uint32_t graph_index, std::string name) -> uint32_t;
+    // Everything the passes of the subgraph are recorded from. To be set before each plan().
+    void set_inputs(uint32_t subgraph_index, std::vector<TaskGraphInput> inputs);
+    // Makes every graph be recorded again, for changes that the inputs don't capture, like
+    // pipelines that were dropped to be compiled again.
+    void invalidate();
+
+    // Compares the inputs of every subgraph with those its graph was recorded with. The graphs
+    // it doesn't record count as skipped.
+    auto plan() -> Plan;
+    // How long adding the passes of a subgraph took, while its graph is recorded.
+    void mark_subgraph_recorded(uint32_t subgraph_index, uint64_t record_ns);
+    // Once all of a graph's subgraphs are recorded and it's compiled. `record_ns` includes them.
+    void mark_graph_recorded(uint32_t graph_index, uint64_t record_ns, bool drained);
+
+    // Record and skip counts and times, one line per graph and per subgraph.
+    auto stats_lines() const -> std::vector<std::string>;
+};
@@ -0,0 +1,210 @@
+#include <utilities/task_graph_cache.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <fmt/ranges.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+namespace {
+    constexpr uint32_t EVENT_N = 100000;
+
+    // The settings the renderer's passes depend on, with how many values each can take.
+    struct SimulatedSetting {
+        char const *name;
+        int32_t value_n;
+        int32_t factory_default;
+    };
+    constexpr auto SIMULATED_SETTINGS = std::array{
+        SimulatedSetting{"Graphics/TAA Method", 3, 1},
+        SimulatedSetting{"Graphics/Update Sky", 2, 1},
+        SimulatedSetting{"Graphics/Use HWRT", 2, 1},
+        SimulatedSetting{"Graphics/global_illumination", 2, 0},
+        SimulatedSetting{"Graphics/denoise_shadow_mask", 2, 0},
+        SimulatedSetting{"Graphics/Render Shadows", 2, 1},
+        SimulatedSetting{"Graphics/Draw Particles", 2, 1},
+    };
+    constexpr auto SIMULATED_DEBUG_PASSES = std::array{"[final]", "gbuffer", "ssao", "rtdgi", "taa", "particles"};
+
+    struct SimulatedRendererState {
+        std::array<int32_t, SIMULATED_SETTINGS.size()> settings;
+        std::array<uint32_t, 2> render_resolution;
+        std::array<uint32_t, 2> output_resolution;
+        uint32_t debug_pass;
+
+        auto operator==(SimulatedRendererState const &) const -> bool = default;
+    };
+
+    auto simulated_renderer_inputs(SimulatedRendererState const &state) -> std::vector<TaskGraphInput> {
+        auto result = std::vector<TaskGraphInput>{};
+        for (size_t setting_i = 0; setting_i < SIMULATED_SETTINGS.size(); ++setting_i) {
+            result.push_back({.name = SIMULATED_SETTINGS[setting_i].name, .value = fmt::format("{}", state.settings[setting_i])});
+        }
+        result.push_back({.name = "render_resolution", .value = fmt::format("{}x{}", state.render_resolution[0], state.render_resolution[1])});
+        result.push_back({.name = "output_resolution", .value = fmt::format("{}x{}", state.output_resolution[0], state.output_resolution[1])});
+        result.push_back({.name = "debug_pass", .value = SIMULATED_DEBUG_PASSES[state.debug_pass]});
+        return result;
+    }
+
+    // The same layout as VoxelApp's.
+    struct SimulatedLayout {
+        TaskGraphCache cache;
+        uint32_t startup_graph;
+        uint32_t frame_graph;
+        uint32_t renderer_subgraph;
+
+        SimulatedLayout() {
+            startup_graph = cache.add_graph("startup");
+            frame_graph = cache.add_graph("frame");
+            cache.add_subgraph(startup_graph, "voxel_world");
+            cache.add_subgraph(startup_graph, "particles");
+            cache.add_subgraph(frame_graph, "io");
+            cache.add_subgraph(frame_graph, "voxel_world");
+            cache.add_subgraph(frame_graph, "particles");
+            renderer_subgraph = cache.add_subgraph(frame_graph, "renderer");
+        }
+
+        // Records what the plan says, like VoxelApp::record_tasks(). Returns the graphs recorded.
+        auto record(TaskGraphCache::Plan const &plan) -> uint32_t {
+            auto result = 0u;
+            for (uint32_t graph_i = 0; graph_i < cache.graphs.size(); ++graph_i) {
+                if (!plan.records(graph_i)) {
+                    continue;
+                }
+                for (uint32_t subgraph_i = 0; subgraph_i < cache.subgraphs.size(); ++subgraph_i) {
+                    if (cache.subgraphs[subgraph_i].graph_index == graph_i) {
+                        cache.mark_subgraph_recorded(subgraph_i, 0);
+                    }
+                }
+                cache.mark_graph_recorded(graph_i, 0, false);
+                ++result;
+            }
+            return result;
+        }
+    };
+
+    // Replays random UI events against the subgraphs of the app (settings that are toggled, set to
+    // what they already are, or toggled back; window resizes; render scale changes that may not
+    // change the resolution; debug pass selection; pipeline reloads), and checks each plan against
+    // inputs that are kept track of separately.
+    auto test_random_ui_events() -> std::string {
+        auto rng = std::mt19937{0};
+        auto const random_below = [&rng](uint32_t n) { return std::uniform_int_distribution<uint32_t>{0, n - 1}(rng); };
+
+        auto layout = SimulatedLayout{};
+        auto &cache = layout.cache;
+        auto window_size = std::array<uint32_t, 2>{1280, 720};
+        auto render_scale = 1.0f;
+        auto state = SimulatedRendererState{.settings = {}, .render_resolution = {}, .output_resolution = {}, .debug_pass = 0};
+        for (size_t setting_i = 0; setting_i < SIMULATED_SETTINGS.size(); ++setting_i) {
+            state.settings[setting_i] = SIMULATED_SETTINGS[setting_i].factory_default;
+        }
+        auto const update_resolutions = [&]() {
+            state.output_resolution = window_size;
+            state.render_resolution = {static_cast<uint32_t>(static_cast<float>(window_size[0]) * render_scale), static_cast<uint32_t>(static_cast<float>(window_size[1]) * render_scale)};
+        };
+        update_resolutions();
+
+        // Kept track of apart from the cache: what the frame graph was last recorded with.
+        auto recorded_state = state;
+        auto is_invalidated = true;
+        auto graph_record_n = uint64_t{0};
+
+        for (uint32_t event_i = 0; event_i < EVENT_N; ++event_i) {
+            auto const kind = random_below(100);
+            auto const setting_i = random_below(static_cast<uint32_t>(SIMULATED_SETTINGS.size()));
+            auto const &setting = SIMULATED_SETTINGS[setting_i];
+            if (event_i == 0) {
+                // Startup records everything.
+            } else if (kind < 40) {
+                state.settings[setting_i] = (state.settings[setting_i] + 1 + static_cast<int32_t>(random_below(static_cast<uint32_t>(setting.value_n - 1)))) % setting.value_n;
+            } else if (kind < 50) {
+                // The "Reset" button marks every setting of the category as changed, changed or not.
+                for (size_t i = 0; i < SIMULATED_SETTINGS.size(); ++i) {
+                    state.settings[i] = SIMULATED_SETTINGS[i].factory_default;
+                }
+            } else if (kind < 55) {
+                // Toggled and back before the next frame.
+                auto const value = state.settings[setting_i];
+                state.settings[setting_i] = (value + 1) % setting.value_n;
+                state.settings[setting_i] = value;
+            } else if (kind < 70) {
+                // Resizing the swapchain to the extent it already has changes nothing.
+                if (random_below(4) != 0) {
+                    window_size = {320 + random_below(3520), 240 + random_below(1920)};
+                }
+                update_resolutions();
+            } else if (kind < 85) {
+                // Dragging the render scale slider moves it by less than a pixel, often.
+                render_scale = std::clamp(render_scale + (static_cast<float>(random_below(21)) - 10.0f) * 0.0002f, 0.2f, 4.0f);
+                update_resolutions();
+            } else if (kind < 95) {
+                state.debug_pass = random_below(static_cast<uint32_t>(SIMULATED_DEBUG_PASSES.size()));
+            } else {
+                cache.invalidate();
+                is_invalidated = true;
+            }
+
+            cache.set_inputs(layout.renderer_subgraph, simulated_renderer_inputs(state));
+            auto const plan = cache.plan();
+            auto const expects_startup = is_invalidated;
+            auto const expects_frame = is_invalidated || state != recorded_state;
+            if (plan.records(layout.startup_graph) != expects_startup || plan.records(layout.frame_graph) != expects_frame) {
+                return fmt::format("event {} (kind {}): recorded startup {} and frame {}, instead of {} and {}", event_i, kind,
+                                   plan.records(layout.startup_graph), plan.records(layout.frame_graph), expects_startup, expects_frame);
+            }
+            if (plan.changes.empty() == plan.any()) {
+                return fmt::format("event {} (kind {}): {} changes listed for a plan that records {}", event_i, kind, plan.changes.size(), plan.any() ? "something" : "nothing");
+            }
+            graph_record_n += layout.record(plan);
+            if (expects_frame) {
+                recorded_state = state;
+            }
+            is_invalidated = false;
+        }
+
+        // Recording everything on every event, like before the cache, would record both graphs.
+        auto const baseline_graph_record_n = uint64_t{EVENT_N} * cache.graphs.size();
+        fmt::print("  recorded {} graphs over {} events, instead of {}\n", graph_record_n, EVENT_N, baseline_graph_record_n);
+        auto skip_n = uint64_t{0};
+        auto record_n = uint64_t{0};
+        for (auto const &graph : cache.graphs) {
+            skip_n += graph.skip_n;
+            record_n += graph.record_n;
+        }
+        if (record_n != graph_record_n || record_n + skip_n != baseline_graph_record_n) {
+            return fmt::format("the cache counted {} records and {} skips, but {} graphs were recorded out of {}", record_n, skip_n, graph_record_n, baseline_graph_record_n);
+        }
+        return {};
+    }
+
+    auto test_changes_listed() -> std::string {
+        auto layout = SimulatedLayout{};
+        auto &cache = layout.cache;
+        cache.set_inputs(layout.renderer_subgraph, {{.name = "a", .value = "1"}, {.name = "b", .value = "2"}});
+        layout.record(cache.plan());
+        cache.set_inputs(layout.renderer_subgraph, {{.name = "a", .value = "3"}, {.name = "c", .value = "4"}});
+        auto const plan = cache.plan();
+        auto const expected = std::vector<std::string>{"renderer.a: 1 -> 3", "renderer.c: 4", "renderer.b: 2 -> (gone)"};
+        if (plan.changes != expected || plan.records(layout.startup_graph) || !plan.records(layout.frame_graph)) {
+            return fmt::format("expected only the frame graph, with changes [{}], got [{}]", fmt::join(expected, ", "), fmt::join(plan.changes, ", "));
+        }
+        if (cache.last_changes != expected) {
+            return "the changes of the last plan that recorded anything weren't kept";
+        }
+        layout.record(plan);
+        if (cache.plan().any() || cache.last_changes != expected) {
+            return "a plan without changes recorded something, or replaced the last changes";
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"random UI events", test_random_ui_events},
+        UnitTestCase{"changed inputs are listed", test_changes_listed},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,269 @@
+#include "thread_pool.hpp"
+
+#include <utilities/profiler.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+#include <fmt/format.h>
+
+ThreadPool::ThreadPool() {
+    if (s_instance == nullptr) {
+        s_instance = this;
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+void ThreadPool::start(uint32_t thread_n) {
+#if ENABLE_THREAD_POOL
+    if (!threads.empty()) {
+        return;
+    }
+    if (thread_n == 0) {
+        auto const hw_thread_n = std::thread::hardware_concurrency();
+        // The thread calling wait() participates too, so leave one hardware thread for it.
+        thread_n = std::max(hw_thread_n, 2u) - 1;
+    }
+    should_terminate = false;
+    queues.resize(thread_n + 1);
+    for (auto &queue : queues) {
+        queue = std::make_unique<WorkerQueue>();
+    }
+    threads.reserve(thread_n);
+    for (uint32_t i = 0; i < thread_n; i++) {
+        threads.emplace_back(&ThreadPool::thread_loop, this, i);
+    }
+#else
+    (void)thread_n;
+#endif
+}
+
+void ThreadPool::stop() {
+#if ENABLE_THREAD_POOL
+    if (threads.empty()) {
+        return;
+    }
+    {
+        auto lock = std::unique_lock{sleep_mutex};
+        should_terminate = true;
+    }
+    sleep_condition.notify_all();
+    for (std::thread &active_thread : threads) {
+        active_thread.join();
+    }
+    // Workers exit as soon as they see should_terminate, even with jobs still queued. Those run
+    // here, so that every handle gets done and no parent waits on a child that was dropped. Jobs
+    // they enqueue go to the external queue, which this keeps draining.
+    while (try_run_one()) {
+    }
+    threads.clear();
+    queues.clear();
+#endif
+}
+
+auto ThreadPool::enqueue(std::function<void()> job, JobHandle const &parent) -> JobHandle {
+    auto state = std::make_shared<JobState>();
+    if (parent.valid()) {
+        parent.state->pending_n.fetch_add(1, std::memory_order_relaxed);
+        state->parent = parent.state;
+    }
+    auto result = JobHandle{state};
+    active_job_n.fetch_add(1);
+#if ENABLE_THREAD_POOL
+    if (!threads.empty()) {
+        auto &queue = *queues[queue_index_for_this_thread()];
+        {
+            auto lock = std::lock_guard{queue.mtx};
+            queue.jobs.push_back(Job{std::move(job), std::move(state)});
+        }
+        queued_job_n.fetch_add(1);
+        if (sleeping_thread_n.load() > 0) {
+            auto lock = std::lock_guard{sleep_mutex};
+            sleep_condition.notify_one();
+        }
+        return result;
+    }
+#endif
+    auto inline_job = Job{std::move(job), std::move(state)};
+    run_job(inline_job);
+    return result;
+}
+
+void ThreadPool::parallel_for(size_t count, size_t batch_size, std::function<void(size_t, size_t)> const &f) {
+    batch_size = std::max<size_t>(batch_size, 1);
+    if (count <= batch_size) {
+        if (count > 0) {
+            f(0, count);
+        }
+        return;
+    }
+    auto root = JobHandle{std::make_shared<JobState>()};
+    // The first batch is left for the calling thread.
+    for (size_t begin = batch_size; begin < count; begin += batch_size) {
+        auto end = std::min(begin + batch_size, count);
+        enqueue([&f, begin, end]() { f(begin, end); }, root);
+    }
+    f(0, batch_size);
+    finish(root.state);
+    wait(root);
+}
+
+void ThreadPool::wait(JobHandle const &handle) {
+    if (handle.done()) {
+        return;
+    }
+    PROFILE_ZONE("wait");
+#if ENABLE_THREAD_POOL
+    uint32_t idle_spin_n = 0;
+    while (!handle.done()) {
+        if (try_run_one()) {
+            idle_spin_n = 0;
+            continue;
+        }
+        // The job we're waiting on is running on another thread. Spin briefly, then sleep until new
+        // work shows up. The timeout covers jobs finishing, which doesn't signal the condition.
+        if (++idle_spin_n < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        auto lock = std::unique_lock{sleep_mutex};
+        sleeping_thread_n.fetch_add(1);
+        sleep_condition.wait_for(lock, std::chrono::milliseconds(1), [this, &handle] {
+            return queued_job_n.load() > 0 || handle.done() || should_terminate.load();
+        });
+        sleeping_thread_n.fetch_sub(1);
+    }
+#else
+    (void)handle;
+#endif
+}
+
+void ThreadPool::wait_idle() {
+#if ENABLE_THREAD_POOL
+    while (busy()) {
+        if (!try_run_one()) {
+            std::this_thread::yield();
+        }
+    }
+#endif
+}
+
+auto ThreadPool::busy() const -> bool {
+    return active_job_n.load() > 0;
+}
+
+auto ThreadPool::thread_count() const -> uint32_t {
+#if ENABLE_THREAD_POOL
+    return static_cast<uint32_t>(threads.size());
+#else
+    return 0;
+#endif
+}
+
+auto ThreadPool::is_worker_thread() const -> bool {
+    return tl_pool == this;
+}
+
+void ThreadPool::run_job(Job &job) {
+    {
+        PROFILE_ZONE("job");
+        job.task();
+    }
+    finish(std::move(job.state));
+    active_job_n.fetch_sub(1);
+}
+
+void ThreadPool::finish(std::shared_ptr<JobState> state) {
+    while (state != nullptr) {
+        if (state->pending_n.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            break;
+        }
+        state = std::move(state->parent);
+    }
+}
+
+#if ENABLE_THREAD_POOL
+void ThreadPool::thread_loop(uint32_t worker_index) {
+    tl_pool = this;
+    tl_worker_index = worker_index;
+    if (CpuProfiler::s_instance != nullptr) {
+        CpuProfiler::s_instance->set_thread_name(fmt::format("worker {}", worker_index));
+    }
+    while (true) {
+        if (try_run_one()) {
+            continue;
+        }
+        auto lock = std::unique_lock{sleep_mutex};
+        sleeping_thread_n.fetch_add(1);
+        sleep_condition.wait(lock, [this] {
+            return queued_job_n.load() > 0 || should_terminate.load();
+        });
+        sleeping_thread_n.fetch_sub(1);
+        if (should_terminate) {
+            return;
+        }
+    }
+}
+
+auto ThreadPool::queue_index_for_this_thread() const -> uint32_t {
+    if (tl_pool == this) {
+        return tl_worker_index;
+    }
+    return static_cast<uint32_t>(queues.size() - 1);
+}
+
+auto ThreadPool::try_pop(uint32_t queue_index, Job &out_job) -> bool {
+    auto &queue = *queues[queue_index];
+    auto lock = std::lock_guard{queue.mtx};
+    if (queue.jobs.empty()) {
+        return false;
+    }
+    // Workers take their newest job (hot in cache, and children of what they just ran).
+    // The shared external queue stays FIFO.
+    if (queue_index + 1 < queues.size()) {
+        out_job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+    } else {
+        out_job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+    }
+    queued_job_n.fetch_sub(1);
+    return true;
+}
+
+auto ThreadPool::try_steal(uint32_t thief_index, Job &out_job) -> bool {
+    auto const queue_n = static_cast<uint32_t>(queues.size());
+    for (uint32_t i = 1; i < queue_n; ++i) {
+        auto &queue = *queues[(thief_index + i) % queue_n];
+        auto lock = std::unique_lock{queue.mtx, std::try_to_lock};
+        if (!lock.owns_lock() || queue.jobs.empty()) {
+            continue;
+        }
+        // Steal the oldest job, which is the least likely to be touched by the owner next.
+        out_job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        queued_job_n.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+auto ThreadPool::try_run_one() -> bool {
+    if (queues.empty() || queued_job_n.load() == 0) {
+        return false;
+    }
+    auto const queue_index = queue_index_for_this_thread();
+    auto job = Job{};
+    if (!try_pop(queue_index, job) && !try_steal(queue_index, job)) {
+        return false;
+    }
+    run_job(job);
+    return true;
+}
+#endif
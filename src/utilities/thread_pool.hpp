@@ -1,6 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <memory>
+#include <atomic>
+#include <optional>
 
 #define ENABLE_THREAD_POOL true
 
@@ -8,83 +11,114 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
 #include <future>
 #include <vector>
 #endif
 
+struct ThreadPool;
+
+struct JobState {
+    // 1 for the job itself, plus one for each child that hasn't finished yet.
+    std::atomic_uint32_t pending_n{1};
+    std::shared_ptr<JobState> parent;
+};
+
+struct JobHandle {
+    std::shared_ptr<JobState> state;
+
+    auto valid() const -> bool { return state != nullptr; }
+    auto done() const -> bool { return state == nullptr || state->pending_n.load(std::memory_order_acquire) == 0; }
+};
+
+template <typename T>
+struct JobFuture {
+    JobHandle handle;
+    std::shared_ptr<std::optional<T>> result;
+
+    auto valid() const -> bool { return handle.valid(); }
+    auto done() const -> bool { return handle.done(); }
+    // Blocks until the job (and its children) finished. The calling thread helps run jobs meanwhile.
+    auto get(ThreadPool &pool) -> T &;
+};
+
 struct ThreadPool {
-    void start() {
-#if ENABLE_THREAD_POOL
-        uint32_t const num_threads = 8; // std::thread::hardware_concurrency();
-        threads.resize(num_threads);
-        for (uint32_t i = 0; i < num_threads; i++) {
-            threads.at(i) = std::thread(&ThreadPool::thread_loop, this);
-        }
-#endif
-    }
-    void enqueue(std::function<void()> const &job) {
-#if ENABLE_THREAD_POOL
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            jobs.push(job);
-        }
-        mutex_condition.notify_one();
-#else
-        job();
-#endif
-    }
-    void stop() {
-#if ENABLE_THREAD_POOL
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            should_terminate = true;
-        }
-        mutex_condition.notify_all();
-        for (std::thread &active_thread : threads) {
-            active_thread.join();
-        }
-        threads.clear();
-#endif
-    }
-    auto busy() -> bool {
-#if ENABLE_THREAD_POOL
-        bool pool_busy;
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            pool_busy = !jobs.empty();
-        }
-        return pool_busy;
-#else
-        return false;
-#endif
+    struct Job {
+        std::function<void()> task;
+        std::shared_ptr<JobState> state;
+    };
+
+    inline static ThreadPool *s_instance = nullptr;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool(ThreadPool &&) noexcept = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool &&) noexcept = delete;
+
+    // thread_n == 0 means one worker per hardware thread, minus the calling thread.
+    void start(uint32_t thread_n = 0);
+    // Joins the workers, then runs the jobs that are still queued on the calling thread. Must not be
+    // called from a job.
+    void stop();
+
+    // When `parent` is given, the parent handle is not considered done until this job is also done.
+    auto enqueue(std::function<void()> job, JobHandle const &parent = {}) -> JobHandle;
+
+    template <typename F, typename R = std::invoke_result_t<F>>
+    auto enqueue_with_result(F &&f, JobHandle const &parent = {}) -> JobFuture<R> {
+        auto result = std::make_shared<std::optional<R>>();
+        auto handle = enqueue([result, f = std::forward<F>(f)]() mutable { result->emplace(f()); }, parent);
+        return {handle, result};
     }
 
+    // Splits [0, count) into batches of `batch_size` and calls f(begin, end) for each of them.
+    // Blocks until all batches are done, running batches on the calling thread too.
+    void parallel_for(size_t count, size_t batch_size, std::function<void(size_t, size_t)> const &f);
+
+    // Runs other jobs until `handle` is done, rather than spinning.
+    void wait(JobHandle const &handle);
+    void wait_idle();
+
+    auto busy() const -> bool;
+    auto thread_count() const -> uint32_t;
+    auto is_worker_thread() const -> bool;
+
+    inline static thread_local ThreadPool *tl_pool = nullptr;
+    inline static thread_local uint32_t tl_worker_index = 0;
+
   private:
-    void thread_loop() {
-#if ENABLE_THREAD_POOL
-        while (true) {
-            std::function<void()> job;
-            {
-                std::unique_lock<std::mutex> lock(queue_mutex);
-                mutex_condition.wait(lock, [this] {
-                    return !jobs.empty() || should_terminate;
-                });
-                if (should_terminate) {
-                    return;
-                }
-                job = jobs.front();
-                jobs.pop();
-            }
-            job();
-        }
-#endif
-    }
 #if ENABLE_THREAD_POOL
-    bool should_terminate = false;
-    std::mutex queue_mutex;
-    std::condition_variable mutex_condition;
+    struct WorkerQueue {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+    };
+
+    void thread_loop(uint32_t worker_index);
+    auto try_pop(uint32_t queue_index, Job &out_job) -> bool;
+    auto try_steal(uint32_t thief_index, Job &out_job) -> bool;
+    auto try_run_one() -> bool;
+    auto queue_index_for_this_thread() const -> uint32_t;
+
+    // One deque per worker, plus one extra (the last one) for jobs pushed from outside the pool.
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
     std::vector<std::thread> threads;
-    std::queue<std::function<void()>> jobs;
+    std::atomic_uint32_t queued_job_n{0};
+    std::atomic_uint32_t sleeping_thread_n{0};
+    std::atomic_bool should_terminate{false};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
 #endif
+    std::atomic_uint32_t active_job_n{0};
+
+    void run_job(Job &job);
+    void finish(std::shared_ptr<JobState> state);
 };
+
+template <typename T>
+auto JobFuture<T>::get(ThreadPool &pool) -> T & {
+    pool.wait(handle);
+    return **result;
+}
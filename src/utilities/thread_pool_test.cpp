@@ -0,0 +1,112 @@
+#include <utilities/thread_pool.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+namespace {
+    auto test_parallel_for() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(3);
+        constexpr size_t count = 100000;
+        auto values = std::vector<uint32_t>(count);
+        pool.parallel_for(count, 1000, [&values](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                values[i] += static_cast<uint32_t>(i % 7) + 1;
+            }
+        });
+        for (size_t i = 0; i < count; ++i) {
+            if (values[i] != static_cast<uint32_t>(i % 7) + 1) {
+                return fmt::format("element {} was visited {} times", i, values[i] / (static_cast<uint32_t>(i % 7) + 1));
+            }
+        }
+        return {};
+    }
+
+    // A parent is done only once the children enqueued under it are, however deep.
+    auto test_children() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(3);
+        auto leaf_n = std::atomic_uint32_t{0};
+        auto const root = pool.enqueue([] {});
+        for (uint32_t i = 0; i < 16; ++i) {
+            pool.enqueue([&pool, &leaf_n, root] {
+                for (uint32_t j = 0; j < 16; ++j) {
+                    pool.enqueue([&leaf_n] { leaf_n.fetch_add(1); }, root);
+                }
+            }, root);
+        }
+        pool.wait(root);
+        if (leaf_n.load() != 16 * 16) {
+            return fmt::format("the root was done after {} of {} leaves", leaf_n.load(), 16 * 16);
+        }
+        auto future = pool.enqueue_with_result([] { return 42; });
+        if (future.get(pool) != 42) {
+            return "enqueue_with_result() returned the wrong value";
+        }
+        pool.wait_idle();
+        return pool.busy() ? "the pool is still busy after wait_idle()" : std::string{};
+    }
+
+    // Jobs still queued when the pool stops used to be dropped without finishing their handles,
+    // which left their parents (and anyone waiting on them) pending forever.
+    auto test_stop_finishes_queued_jobs() -> std::string {
+        for (uint32_t round_i = 0; round_i < 200; ++round_i) {
+            auto pool = ThreadPool{};
+            pool.start(2);
+            auto run_n = std::atomic_uint32_t{0};
+            auto const parent = JobHandle{std::make_shared<JobState>()};
+            auto handles = std::vector<JobHandle>{};
+            for (uint32_t i = 0; i < 64; ++i) {
+                handles.push_back(pool.enqueue([&run_n] { run_n.fetch_add(1); }, parent));
+            }
+            pool.stop();
+            auto const done_n = std::count_if(handles.begin(), handles.end(), [](JobHandle const &handle) { return handle.done(); });
+            if (run_n.load() != handles.size() || static_cast<size_t>(done_n) != handles.size()) {
+                return fmt::format("round {}: {} of {} jobs ran and {} were done after stop()", round_i, run_n.load(), handles.size(), done_n);
+            }
+            if (pool.busy()) {
+                return fmt::format("round {}: the pool is busy after stop()", round_i);
+            }
+            // Only the parent's own count is left.
+            if (parent.state->pending_n.load() != 1) {
+                return fmt::format("round {}: the parent still waits on {} children after stop()", round_i, parent.state->pending_n.load() - 1);
+            }
+        }
+        return {};
+    }
+
+    // After stop(), jobs run inline, and start() brings the workers back.
+    auto test_restart() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(2);
+        pool.stop();
+        auto is_run = false;
+        if (!pool.enqueue([&is_run] { is_run = true; }).done() || !is_run) {
+            return "a job enqueued into a stopped pool didn't run inline";
+        }
+        pool.start(2);
+        auto sum = std::atomic_uint64_t{0};
+        pool.parallel_for(1000, 10, [&sum](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                sum.fetch_add(i);
+            }
+        });
+        if (sum.load() != 999 * 1000 / 2) {
+            return fmt::format("parallel_for() after a restart summed to {}", sum.load());
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"parallel_for visits every element once", test_parallel_for},
+        UnitTestCase{"parents wait for their children", test_children},
+        UnitTestCase{"stop finishes queued jobs", test_stop_finishes_queued_jobs},
+        UnitTestCase{"restart", test_restart},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+// The unit tests are plain executables next to the code they cover (`<name>_test.cpp`), registered
+// with CTest by gvox_engine_add_test() in CMakeLists.txt. Like the checks in the engine, a case
+// returns a description of the first thing that went wrong, or an empty string if nothing did.
+struct UnitTestCase {
+    std::string_view name;
+    std::function<std::string()> run;
+};
+
+// Runs every case, even after one failed. Returns the exit code of the test executable.
+inline auto run_unit_tests(std::span<UnitTestCase const> cases) -> int {
+    auto failed_n = size_t{0};
+    for (auto const &test_case : cases) {
+        auto const error = test_case.run();
+        if (error.empty()) {
+            fmt::print("[pass] {}\n", test_case.name);
+        } else {
+            fmt::print("[fail] {}: {}\n", test_case.name, error);
+            ++failed_n;
+        }
+    }
+    fmt::print("{} of {} passed\n", cases.size() - failed_n, cases.size());
+    return failed_n == 0 ? 0 : 1;
+}
+
+// Parses the optional count that the benchmarks take as their only argument.
+inline auto benchmark_count_arg(std::span<char const *const> args, uint32_t default_n) -> uint32_t {
+    if (args.size() < 2) {
+        return default_n;
+    }
+    auto const result = std::strtoul(args[1], nullptr, 10);
+    return result == 0 ? default_n : static_cast<uint32_t>(result);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+// Bookkeeping of a ring buffer that uploads are sub-allocated from, linearly. Everything allocated
+// during a frame is released at once, when the fence value the frame ended with is reached, so
+// allocating is only a few additions. Doesn't touch the device, so that it can be driven by a fake
+// fence (see upload_ring_test.cpp); GpuUploadRing owns the actual buffer.
+struct UploadRing {
+    struct FrameStats {
+        uint64_t allocation_n = 0;
+        uint64_t allocated_bytes = 0;
+        // Lost to alignment, and to skipping the end of the ring when an allocation didn't fit there.
+        uint64_t padding_bytes = 0;
+        uint64_t wrap_n = 0;
+        // Allocations that didn't fit, which the caller has to put somewhere else.
+        uint64_t overflow_n = 0;
+        uint64_t overflow_bytes = 0;
+
+        void add(FrameStats const &other) {
+            allocation_n += other.allocation_n;
+            allocated_bytes += other.allocated_bytes;
+            padding_bytes += other.padding_bytes;
+            wrap_n += other.wrap_n;
+            overflow_n += other.overflow_n;
+            overflow_bytes += other.overflow_bytes;
+        }
+    };
+    struct Stats {
+        FrameStats last_frame{};
+        FrameStats total{};
+        uint64_t frame_n = 0;
+        uint64_t peak_used_bytes = 0;
+    };
+    struct PendingFrame {
+        uint64_t fence_value;
+        // What `head` was at the end of the frame.
+        uint64_t end;
+    };
+
+    uint64_t capacity = 0;
+    // Bytes allocated and released since init(), so head - tail is what's in use, and the next
+    // allocation goes at head % capacity.
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    std::deque<PendingFrame> pending_frames;
+    FrameStats frame{};
+    Stats stats{};
+
+    void init(uint64_t new_capacity) {
+        capacity = new_capacity;
+        head = 0;
+        tail = 0;
+        pending_frames.clear();
+        frame = {};
+        stats = {};
+    }
+
+    auto used_bytes() const -> uint64_t { return head - tail; }
+
+    // Returns the offset of `size` bytes, aligned to `alignment` (a power of two that divides the
+    // capacity), or nothing if they don't fit until older frames are released.
+    auto allocate(uint64_t size, uint64_t alignment) -> std::optional<uint64_t> {
+        if (size == 0 || size > capacity) {
+            ++frame.overflow_n;
+            frame.overflow_bytes += size;
+            return std::nullopt;
+        }
+        auto const position = head % capacity;
+        auto offset = (position + alignment - 1) & ~(alignment - 1);
+        auto skipped = offset - position;
+        auto const wraps = offset + size > capacity;
+        if (wraps) {
+            skipped = capacity - position;
+            offset = 0;
+        }
+        if (used_bytes() + skipped + size > capacity) {
+            ++frame.overflow_n;
+            frame.overflow_bytes += size;
+            return std::nullopt;
+        }
+        head += skipped + size;
+        ++frame.allocation_n;
+        frame.allocated_bytes += size;
+        frame.padding_bytes += skipped;
+        frame.wrap_n += wraps ? 1 : 0;
+        stats.peak_used_bytes = std::max(stats.peak_used_bytes, used_bytes());
+        return offset;
+    }
+
+    // Everything allocated since the last call is released once `fence_value` is reached.
+    void end_frame(uint64_t fence_value) {
+        if (head != (pending_frames.empty() ? tail : pending_frames.back().end)) {
+            pending_frames.push_back({fence_value, head});
+        }
+        stats.last_frame = frame;
+        stats.total.add(frame);
+        ++stats.frame_n;
+        frame = {};
+    }
+
+    // Releases the frames whose fence value is at most `completed_fence_value`.
+    void collect(uint64_t completed_fence_value) {
+        while (!pending_frames.empty() && pending_frames.front().fence_value <= completed_fence_value) {
+            tail = pending_frames.front().end;
+            pending_frames.pop_front();
+        }
+    }
+};
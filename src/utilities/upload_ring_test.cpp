@@ -0,0 +1,185 @@
+#include <utilities/upload_ring.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <array>
+#include <map>
+#include <random>
+
+namespace {
+    struct FakeFenceInfo {
+        uint32_t frame_n = 20000;
+        uint64_t capacity = uint64_t{1} << 20;
+        // The fake GPU finishes each frame between 1 and this many frames after it was submitted.
+        uint32_t max_frame_latency = 3;
+        uint32_t seed = 0;
+    };
+
+    // Drives an UploadRing with a fake fence that completes frames some random number of frames
+    // late, with allocations of random sizes and alignments (some larger than the ring), and checks
+    // every byte handed out against the allocations that are still live.
+    auto check_fake_fence(FakeFenceInfo const &info) -> std::string {
+        auto ring = UploadRing{};
+        ring.init(info.capacity);
+        auto rng = std::mt19937{info.seed};
+        auto const random_below = [&rng](uint64_t n) { return std::uniform_int_distribution<uint64_t>{0, n - 1}(rng); };
+
+        struct LiveAllocation {
+            uint64_t end;
+            // Fence value of the frame it was made in.
+            uint64_t fence_value;
+        };
+        // By offset. Never overlap, if the ring works.
+        auto live_allocations = std::map<uint64_t, LiveAllocation>{};
+        auto completed_fence_value = uint64_t{0};
+        auto allocated_bytes = uint64_t{0};
+        auto overflow_n = uint64_t{0};
+
+        for (uint64_t frame_i = 0; frame_i < info.frame_n; ++frame_i) {
+            // Frame `frame_i` ends with fence value frame_i + 1, and the fake GPU is up to
+            // max_frame_latency frames behind.
+            auto const latency = 1 + random_below(info.max_frame_latency);
+            if (frame_i + 1 > latency) {
+                completed_fence_value = std::max(completed_fence_value, frame_i + 1 - latency);
+            }
+            std::erase_if(live_allocations, [&](auto const &entry) { return entry.second.fence_value <= completed_fence_value; });
+            ring.collect(completed_fence_value);
+
+            auto const allocation_n = random_below(9);
+            for (uint64_t allocation_i = 0; allocation_i < allocation_n; ++allocation_i) {
+                auto const kind = random_below(100);
+                auto size = uint64_t{};
+                if (kind < 70) {
+                    size = 1 + random_below(4096);
+                } else if (kind < 95) {
+                    size = 4096 + random_below(60 * 1024);
+                } else {
+                    size = info.capacity / 4 + random_below(info.capacity + info.capacity / 4);
+                }
+                auto const alignment = uint64_t{1} << random_below(9);
+                auto const offset = ring.allocate(size, alignment);
+                if (!offset) {
+                    ++overflow_n;
+                    continue;
+                }
+                allocated_bytes += size;
+                if (*offset % alignment != 0 || *offset + size > info.capacity) {
+                    return fmt::format("frame {}: {} bytes aligned to {} were put at {}, in a ring of {}", frame_i, size, alignment, *offset, info.capacity);
+                }
+                // The live allocation starting last before the end of the new one is the only one
+                // that can overlap it.
+                auto next = live_allocations.lower_bound(*offset + size);
+                if (next != live_allocations.begin()) {
+                    auto const &[prev_offset, prev] = *std::prev(next);
+                    if (prev.end > *offset) {
+                        return fmt::format("frame {}: bytes {}..{} overlap bytes {}..{} of frame {}, which is still in flight", frame_i, *offset, *offset + size, prev_offset, prev.end, prev.fence_value - 1);
+                    }
+                }
+                live_allocations.emplace(*offset, LiveAllocation{.end = *offset + size, .fence_value = frame_i + 1});
+            }
+            ring.end_frame(frame_i + 1);
+        }
+
+        ring.collect(info.frame_n);
+        if (ring.used_bytes() != 0) {
+            return fmt::format("{} bytes are still in use after every frame was done", ring.used_bytes());
+        }
+        if (ring.stats.total.allocated_bytes != allocated_bytes) {
+            return fmt::format("counted {} bytes allocated, but {} were", ring.stats.total.allocated_bytes, allocated_bytes);
+        }
+        if (ring.stats.total.overflow_n != overflow_n) {
+            return fmt::format("counted {} overflows, but {} allocations didn't fit", ring.stats.total.overflow_n, overflow_n);
+        }
+        if (ring.stats.frame_n != info.frame_n) {
+            return fmt::format("counted {} frames, but {} ended", ring.stats.frame_n, info.frame_n);
+        }
+        return {};
+    }
+
+    auto test_fake_fence() -> std::string {
+        for (auto const max_frame_latency : {1u, 3u}) {
+            for (auto const seed : {0u, 1u, 2u}) {
+                if (auto error = check_fake_fence({.max_frame_latency = max_frame_latency, .seed = seed}); !error.empty()) {
+                    return fmt::format("{} (latency {}, seed {})", error, max_frame_latency, seed);
+                }
+            }
+        }
+        return {};
+    }
+
+    auto test_alignment_and_wrap() -> std::string {
+        auto ring = UploadRing{};
+        ring.init(1024);
+        if (ring.allocate(100, 1) != 0) {
+            return "the first allocation isn't at the start";
+        }
+        if (auto const offset = ring.allocate(10, 64); offset != 128) {
+            return fmt::format("aligned to 64 after 100 bytes, got {}", offset.value_or(~uint64_t{0}));
+        }
+        ring.end_frame(1);
+        ring.collect(1);
+        if (auto const offset = ring.allocate(800, 1); offset != 138) {
+            return fmt::format("expected 800 bytes right after the released frame, at 138, got {}", offset.value_or(~uint64_t{0}));
+        }
+        // 938 + 100 doesn't fit before the end, so the last 86 bytes are skipped.
+        if (auto const offset = ring.allocate(100, 1); offset != 0) {
+            return fmt::format("expected 100 bytes to wrap to 0, got {}", offset.value_or(~uint64_t{0}));
+        }
+        if (ring.frame.wrap_n != 1 || ring.frame.padding_bytes != 86) {
+            return fmt::format("expected one wrap skipping 86 bytes, got {} wraps skipping {}", ring.frame.wrap_n, ring.frame.padding_bytes);
+        }
+        // The skipped bytes count as used until the frame is released.
+        if (ring.used_bytes() != 986 || ring.stats.peak_used_bytes != 986) {
+            return fmt::format("expected 986 bytes used, got {} (peak {})", ring.used_bytes(), ring.stats.peak_used_bytes);
+        }
+        return {};
+    }
+
+    // Nothing of a frame may be reused before its fence value is reached.
+    auto test_release_waits_for_fence() -> std::string {
+        auto ring = UploadRing{};
+        ring.init(1024);
+        if (!ring.allocate(1024, 1)) {
+            return "an allocation as large as the ring didn't fit into an empty ring";
+        }
+        ring.end_frame(1);
+        if (ring.allocate(1, 1)) {
+            return "allocated into a full ring";
+        }
+        ring.end_frame(2);
+        ring.collect(0);
+        if (ring.allocate(1, 1)) {
+            return "allocated before the fence of the full frame was reached";
+        }
+        ring.collect(1);
+        if (!ring.allocate(1, 1)) {
+            return "couldn't allocate after every frame was released";
+        }
+        ring.end_frame(3);
+        if (ring.stats.total.overflow_n != 2 || ring.stats.total.overflow_bytes != 2) {
+            return fmt::format("expected 2 overflows of 1 byte, got {} of {} bytes", ring.stats.total.overflow_n, ring.stats.total.overflow_bytes);
+        }
+        return {};
+    }
+
+    auto test_too_large() -> std::string {
+        auto ring = UploadRing{};
+        ring.init(1024);
+        if (ring.allocate(1025, 1) || ring.allocate(0, 1)) {
+            return "handed out an allocation larger than the ring, or an empty one";
+        }
+        if (ring.used_bytes() != 0 || ring.frame.overflow_n != 2) {
+            return fmt::format("expected nothing used and 2 overflows, got {} bytes used and {} overflows", ring.used_bytes(), ring.frame.overflow_n);
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"random allocations against a fake fence", test_fake_fence},
+        UnitTestCase{"alignment and wrapping", test_alignment_and_wrap},
+        UnitTestCase{"frames released by their fence value", test_release_waits_for_fence},
+        UnitTestCase{"allocations that can never fit", test_too_large},
+    };
+    return run_unit_tests(cases);
+}
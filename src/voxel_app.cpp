@@ -43,15 +43,9 @@ VoxelApp::VoxelApp() : AppWindow(APPNAME, {1280, 720}), ui{AppUi(AppWindow::glfw
         .name = "swapchain",
     });
 
-    AppSettings::add<settings::SliderFloat>({"Camera", "FOV", {.value = 74.0f, .min = 0.0f, .max = 179.0f}});
-
-    AppSettings::add<settings::InputFloat>({"UI", "Scale", {.value = 1.0f}});
-    AppSettings::add<settings::Checkbox>({"UI", "show_debug_info", {.value = false}});
-    AppSettings::add<settings::Checkbox>({"UI", "show_console", {.value = false}});
-    AppSettings::add<settings::Checkbox>({"UI", "autosave", {.value = true}});
-    AppSettings::add<settings::Checkbox>({"General", "battery_saving_mode", {.value = false}});
-
-    AppSettings::add<settings::SliderFloat>({"Graphics", "Render Res Scale", {.value = 1.0f, .min = 0.2f, .max = 4.0f}, {.task_graph_depends = true}});
+    fov_setting = AppSettings::add<settings::SliderFloat>({"Camera", "FOV", {.value = 74.0f, .min = 0.0f, .max = 179.0f}});
+    battery_saving_mode_setting = AppSettings::add<settings::Checkbox>({"General", "battery_saving_mode", {.value = false}});
+    render_res_scale_setting = AppSettings::add<settings::SliderFloat>({"Graphics", "Render Res Scale", {.value = 1.0f, .min = 0.2f, .max = 4.0f}, {.task_graph_depends = true}});
 
     auto const &device_props = gpu_context.device.properties();
     debug_utils::DebugDisplay::set_debug_string("GPU", reinterpret_cast<char const *>(device_props.device_name));
@@ -63,19 +57,34 @@ VoxelApp::VoxelApp() : AppWindow(APPNAME, {1280, 720}), ui{AppUi(AppWindow::glfw
     });
 
     voxel_model_loader.create(gpu_context);
+    voxel_world.upload_ring = &gpu_context.upload_ring;
+    voxel_world.memory_ledger = &gpu_context.memory_ledger;
+
+    auto const startup_graph = task_graph_cache.add_graph("startup");
+    auto const frame_graph = task_graph_cache.add_graph("frame");
+    task_graph_layout = {
+        .startup_graph = startup_graph,
+        .frame_graph = frame_graph,
+        .world_startup = task_graph_cache.add_subgraph(startup_graph, "voxel_world"),
+        .particles_startup = task_graph_cache.add_subgraph(startup_graph, "particles"),
+        .io = task_graph_cache.add_subgraph(frame_graph, "io"),
+        .world = task_graph_cache.add_subgraph(frame_graph, "voxel_world"),
+        .particles = task_graph_cache.add_subgraph(frame_graph, "particles"),
+        .renderer = task_graph_cache.add_subgraph(frame_graph, "renderer"),
+    };
 
     record_tasks();
     gpu_context.pipeline_manager->wait();
+    add_console_commands();
     debug_utils::Console::add_log(fmt::format("startup: {} s\n", std::chrono::duration<float>(Clock::now() - start).count()));
 }
 VoxelApp::~VoxelApp() {
+    remove_console_commands();
     gpu_context.device.wait_idle();
     gpu_context.device.collect_garbage();
 
     voxel_model_loader.destroy();
-
-    // TODO: Remove this
-    gpu_context.device.destroy_tlas(voxel_world.buffers.tlas);
+    voxel_world.destroy(gpu_context.device);
 }
 
 void VoxelApp::run() {
@@ -88,7 +97,7 @@ void VoxelApp::run() {
         if (!AppWindow::minimized) {
             on_resize(window_size.x, window_size.y);
 
-            if (AppSettings::get<settings::Checkbox>("General", "battery_saving_mode").value) {
+            if (AppSettings::get(battery_saving_mode_setting).value) {
                 std::this_thread::sleep_for(10ms);
             }
 
@@ -100,13 +109,23 @@ void VoxelApp::run() {
 }
 
 void VoxelApp::on_update() {
+    if (CpuProfiler::s_instance != nullptr) {
+        CpuProfiler::s_instance->begin_frame();
+    }
+    PROFILE_ZONE("frame");
     auto now = Clock::now();
 
-    gpu_context.swapchain_image = gpu_context.swapchain.acquire_next_image();
+    {
+        PROFILE_ZONE("acquire_next_image");
+        gpu_context.swapchain_image = gpu_context.swapchain.acquire_next_image();
+    }
 
     auto t0 = Clock::now();
     gpu_input.time = std::chrono::duration<daxa_f32>(now - start).count();
     gpu_input.delta_time = std::chrono::duration<daxa_f32>(now - prev_time).count();
+    if (fixed_delta_time > 0.0f) {
+        gpu_input.delta_time = fixed_delta_time;
+    }
     prev_time = now;
     gpu_input.render_res_scl = render_res_scl;
 
@@ -123,21 +142,24 @@ void VoxelApp::on_update() {
     if (gpu_context.swapchain_image.is_empty()) {
         return;
     }
+    gpu_context.upload_ring.begin_frame(gpu_input.frame_index);
 
     if (ui.should_upload_seed_data) {
         gpu_context.update_seeded_value_noise(std::hash<std::string>{}(ui.settings.world_seed_str));
         ui.should_upload_seed_data = false;
     }
 
-    if (ui.should_run_startup || voxel_model_loader.model_is_ready) {
+    bool const ran_startup = ui.should_run_startup || voxel_model_loader.model_is_ready;
+    if (ran_startup) {
         run_startup();
         ui.should_run_startup = false;
+        voxel_model_loader.model_is_ready = false;
     }
 
     voxel_model_loader.update(ui);
 
     if (ui.should_record_task_graph) {
-        gpu_context.device.wait_idle();
+        PROFILE_ZONE("record_tasks");
         record_tasks();
     }
 
@@ -153,7 +175,7 @@ void VoxelApp::on_update() {
         prev_phys_update_time = now;
     }
 
-    if (needs_vram_calc) {
+    if (needs_vram_calc || (gpu_context.memory_ledger.revision != vram_calc_revision && now - vram_calc_time > std::chrono::seconds(1))) {
         calc_vram_usage();
     }
 
@@ -161,28 +183,64 @@ void VoxelApp::on_update() {
     player_input.halton_jitter = gpu_input.halton_jitter;
     player_input.delta_time = gpu_input.delta_time;
     player_input.sensitivity = ui.settings.mouse_sensitivity;
-    player_input.fov = AppSettings::get<settings::SliderFloat>("Camera", "FOV").value * (std::numbers::pi_v<daxa_f32> / 180.0f);
+    player_input.fov = AppSettings::get(fov_setting).value * (std::numbers::pi_v<daxa_f32> / 180.0f);
     player_input.mouse = gpu_input.mouse;
     std::copy(std::begin(gpu_input.actions), std::end(gpu_input.actions), std::begin(player_input.actions));
-    player_perframe(player_input, gpu_input.player, voxel_world);
+    if (replay_recorder != nullptr) {
+        replay_recorder->begin_frame(gpu_input, player_input, ran_startup);
+    }
+    {
+        PROFILE_ZONE("player_perframe");
+        player_perframe(player_input, gpu_input.player, voxel_world);
+    }
 
-    voxel_world.begin_frame(gpu_context.device, gpu_input, gpu_output.voxel_world);
+    voxel_world.replay_recorder = replay_recorder;
+    {
+        PROFILE_ZONE("VoxelWorld::begin_frame");
+        voxel_world.begin_frame(gpu_context.device, gpu_input, gpu_output.voxel_world);
+    }
+    if (replay_recorder != nullptr) {
+        replay_recorder->end_frame(gpu_input.player);
+    }
 
     gpu_input.fif_index = gpu_input.frame_index % (FRAMES_IN_FLIGHT + 1);
-    gpu_context.frame_task_graph.execute({});
+    {
+        PROFILE_ZONE("frame_task_graph.execute");
+        gpu_context.frame_task_graph.execute({});
+    }
+    gpu_context.upload_ring.end_frame();
+    {
+        auto const &upload_stats = gpu_context.upload_ring.ring.stats;
+        PROFILE_COUNTER("upload ring bytes", upload_stats.last_frame.allocated_bytes);
+        debug_utils::DebugDisplay::set_debug_string(
+            "Uploads",
+            fmt::format("{:.2f} MB in {} ({} overflowed), {:.2f}/{:.2f} MB used at most",
+                        static_cast<double>(upload_stats.last_frame.allocated_bytes) / 1'000'000.0, upload_stats.last_frame.allocation_n, upload_stats.total.overflow_n,
+                        static_cast<double>(upload_stats.peak_used_bytes) / 1'000'000.0, static_cast<double>(gpu_context.upload_ring.ring.capacity) / 1'000'000.0));
+    }
 
     gpu_input.resize_factor = 1.0f;
 
     gpu_input.mouse.pos_delta = {0.0f, 0.0f};
     gpu_input.mouse.scroll_delta = {0.0f, 0.0f};
 
-    renderer.end_frame(gpu_context.device, gpu_input.delta_time);
+    {
+        PROFILE_ZONE("Renderer::end_frame");
+        renderer.end_frame(gpu_context.device, gpu_input.delta_time);
+    }
 
     auto t1 = Clock::now();
-    ui.update(gpu_input.delta_time, std::chrono::duration<daxa_f32>(t1 - t0).count());
+    {
+        PROFILE_ZONE("AppUi::update");
+        ui.update(gpu_input.delta_time, std::chrono::duration<daxa_f32>(t1 - t0).count());
+    }
+    PROFILE_COUNTER("frame_index", gpu_input.frame_index);
 
     ++gpu_input.frame_index;
-    gpu_context.device.collect_garbage();
+    {
+        PROFILE_ZONE("collect_garbage");
+        gpu_context.device.collect_garbage();
+    }
 }
 void VoxelApp::on_mouse_move(daxa_f32 x, daxa_f32 y) {
     daxa_f32vec2 const center = {static_cast<daxa_f32>(window_size.x / 2), static_cast<daxa_f32>(window_size.y / 2)};
@@ -256,20 +314,16 @@ void VoxelApp::on_key(daxa_i32 key_id, daxa_i32 action) {
 }
 void VoxelApp::on_resize(daxa_u32 sx, daxa_u32 sy) {
     minimized = (sx == 0 || sy == 0);
-    auto new_render_res_scl = AppSettings::get<settings::SliderFloat>("Graphics", "Render Res Scale").value;
+    auto new_render_res_scl = AppSettings::get(render_res_scale_setting).value;
     auto resized = sx != window_size.x || sy != window_size.y || render_res_scl != new_render_res_scl;
     if (!minimized && resized) {
         gpu_context.swapchain.resize();
         window_size.x = gpu_context.swapchain.get_surface_extent().x;
         window_size.y = gpu_context.swapchain.get_surface_extent().y;
         render_res_scl = new_render_res_scl;
-        {
-            // resize render images
-            // gpu_context.render_images.size.x = static_cast<daxa_u32>(static_cast<daxa_f32>(window_size.x) * render_res_scl);
-            // gpu_context.render_images.size.y = static_cast<daxa_u32>(static_cast<daxa_f32>(window_size.y) * render_res_scl);
-            gpu_context.device.wait_idle();
-            needs_vram_calc = true;
-        }
+        // The render images are resized by recording the frame task graph again, which waits for
+        // the device only if it has to. The swapchain's extent is the output resolution, so the
+        // frame task graph is recorded again whenever resizing the swapchain changed it.
         record_tasks();
         gpu_input.resize_factor = 0.0f;
         on_update();
@@ -283,6 +337,7 @@ void VoxelApp::on_drop(std::span<char const *> filepaths) {
 void VoxelApp::run_startup() {
     player_startup(gpu_input.player);
     gpu_context.startup_task_graph.execute({});
+    voxel_world.clear_cpu_chunks();
 
     ui.should_run_startup = false;
 }
@@ -294,25 +349,91 @@ void VoxelApp::record_tasks() {
     gpu_input.frame_dim.y = static_cast<daxa_u32>(static_cast<daxa_f32>(window_size.y) * render_res_scl);
     gpu_input.rounded_frame_dim = round_frame_dim(gpu_input.frame_dim);
     gpu_input.output_resolution = window_size;
+    gpu_context.render_resolution = gpu_input.rounded_frame_dim;
+    gpu_context.output_resolution = gpu_input.output_resolution;
+
+    // Every setting that asks for the task graphs to be recorded again is read while recording the
+    // renderer's passes (the particles' render passes included). The render scale only matters
+    // through the render resolution, which most changes of it leave as it is.
+    auto const set_renderer_inputs = [this]() {
+        auto renderer_inputs = std::vector<TaskGraphInput>{};
+        for (auto const &[category_id, category] : AppSettings::s_instance->categories) {
+            for (auto const &[setting_id, entry] : category) {
+                if (entry.config.task_graph_depends && entry.index != render_res_scale_setting.index) {
+                    renderer_inputs.push_back({.name = category_id + "/" + setting_id, .value = setting_value_to_string(entry.data)});
+                }
+            }
+        }
+        renderer_inputs.push_back({.name = "render_resolution", .value = fmt::format("{}x{}", gpu_context.render_resolution.x, gpu_context.render_resolution.y)});
+        renderer_inputs.push_back({.name = "output_resolution", .value = fmt::format("{}x{}", gpu_context.output_resolution.x, gpu_context.output_resolution.y)});
+        renderer_inputs.push_back({.name = "debug_pass", .value = debug_utils::DebugDisplay::s_instance->selected_pass_name});
+        task_graph_cache.set_inputs(task_graph_layout.renderer, std::move(renderer_inputs));
+    };
+    set_renderer_inputs();
+
+    auto const plan = task_graph_cache.plan();
+    if (!plan.any()) {
+        return;
+    }
+    auto const records_startup = plan.records(task_graph_layout.startup_graph);
+    auto const records_frame = plan.records(task_graph_layout.frame_graph);
+
+    // daxa keeps the resources of a task graph that's replaced until the GPU is done with them,
+    // except for aliased transients, whose memory goes away with the task graph.
+    auto const needs_idle = GVOX_ENGINE_INSTALL || (records_frame && renderer.needs_idle_to_record());
+    if (needs_idle) {
+        PROFILE_ZONE("wait_idle");
+        gpu_context.device.wait_idle();
+    }
+
+    auto const voxel_world_memory_tag = GpuMemoryTag{.owner = "voxel_world", .category = GpuMemoryCategory::VOXELS, .lifetime = GpuMemoryLifetime::PERSISTENT};
+    auto const particles_memory_tag = GpuMemoryTag{.owner = "particles", .category = GpuMemoryCategory::PARTICLES, .lifetime = GpuMemoryLifetime::PERSISTENT};
+    auto const ns_since = [](Clock::time_point t0) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    };
+
+    if (records_startup) {
+        PROFILE_ZONE("record startup_task_graph");
+        auto const graph_t0 = Clock::now();
+        gpu_context.startup_task_graph = daxa::TaskGraph({
+            .device = gpu_context.device,
+            .alias_transients = GVOX_ENGINE_INSTALL,
+            .name = "startup_task-graph",
+        });
+        gpu_context.use_resources(gpu_context.startup_task_graph);
 
+        auto t0 = Clock::now();
+        {
+            auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, voxel_world_memory_tag};
+            voxel_world.record_startup(gpu_context);
+        }
+        task_graph_cache.mark_subgraph_recorded(task_graph_layout.world_startup, ns_since(t0));
+        t0 = Clock::now();
+        {
+            auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, particles_memory_tag};
+            particles.record_startup(gpu_context);
+        }
+        task_graph_cache.mark_subgraph_recorded(task_graph_layout.particles_startup, ns_since(t0));
+
+        gpu_context.startup_task_graph.submit({});
+        gpu_context.startup_task_graph.complete({});
+        task_graph_cache.mark_graph_recorded(task_graph_layout.startup_graph, ns_since(graph_t0), needs_idle);
+    }
+
+    if (!records_frame) {
+        return;
+    }
+    PROFILE_ZONE("record frame_task_graph");
+    auto const graph_t0 = Clock::now();
     gpu_context.frame_task_graph = daxa::TaskGraph({
         .device = gpu_context.device,
         .swapchain = gpu_context.swapchain,
         .alias_transients = GVOX_ENGINE_INSTALL,
         .name = "frame_task_graph",
     });
-    gpu_context.startup_task_graph = daxa::TaskGraph({
-        .device = gpu_context.device,
-        .alias_transients = GVOX_ENGINE_INSTALL,
-        .name = "startup_task-graph",
-    });
-    gpu_context.use_resources();
-    gpu_context.render_resolution = gpu_input.rounded_frame_dim;
-    gpu_context.output_resolution = gpu_input.output_resolution;
-
-    voxel_world.record_startup(gpu_context);
-    particles.record_startup(gpu_context);
+    gpu_context.use_resources(gpu_context.frame_task_graph);
 
+    auto t0 = Clock::now();
     debug_utils::DebugDisplay::begin_passes();
 
     gpu_context.frame_task_graph.use_persistent_buffer(voxel_model_loader.task_gvox_model_buffer);
@@ -322,28 +443,41 @@ void VoxelApp::record_tasks() {
             daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, gpu_context.task_input_buffer),
         },
         .task = [this](daxa::TaskInterface const &ti) {
-            auto staging_input_buffer = ti.device.create_buffer({
-                .size = sizeof(GpuInput),
-                .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                .name = "staging_input_buffer",
-            });
-            ti.recorder.destroy_buffer_deferred(staging_input_buffer);
-            auto *buffer_ptr = ti.device.get_host_address_as<GpuInput>(staging_input_buffer).value();
-            *buffer_ptr = gpu_input;
+            auto const staging_input = gpu_context.upload_ring.allocate(sizeof(GpuInput));
+            *staging_input.as<GpuInput>() = gpu_input;
             ti.recorder.copy_buffer_to_buffer({
-                .src_buffer = staging_input_buffer,
+                .src_buffer = staging_input.buffer,
                 .dst_buffer = gpu_context.task_input_buffer.get_state().buffers[0],
+                .src_offset = staging_input.offset,
                 .size = sizeof(GpuInput),
             });
         },
         .name = "GpuInputUploadTransferTask",
     });
+    auto io_ns = ns_since(t0);
 
-    voxel_world.record_frame(gpu_context, voxel_model_loader.task_gvox_model_buffer, particles);
-    particles.simulate(gpu_context, voxel_world.buffers);
+    t0 = Clock::now();
+    {
+        auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, voxel_world_memory_tag};
+        voxel_world.record_frame(gpu_context, voxel_model_loader.task_gvox_model_buffer, particles);
+    }
+    task_graph_cache.mark_subgraph_recorded(task_graph_layout.world, ns_since(t0));
+    t0 = Clock::now();
+    {
+        auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, particles_memory_tag};
+        particles.simulate(gpu_context, voxel_world.buffers);
+    }
+    task_graph_cache.mark_subgraph_recorded(task_graph_layout.particles, ns_since(t0));
 
-    renderer.render(gpu_context, voxel_world.buffers, particles, gpu_context.task_swapchain_image, gpu_context.swapchain.get_format());
+    t0 = Clock::now();
+    {
+        // Most of what the renderer creates is sized by the resolution, and replaced when it changes.
+        auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, {.owner = "renderer", .category = GpuMemoryCategory::RENDER_TARGETS, .lifetime = GpuMemoryLifetime::PER_RECORDING}};
+        renderer.render(gpu_context, voxel_world.buffers, particles, gpu_context.task_swapchain_image, gpu_context.swapchain.get_format());
+    }
+    task_graph_cache.mark_subgraph_recorded(task_graph_layout.renderer, ns_since(t0));
 
+    t0 = Clock::now();
     gpu_context.frame_task_graph.add_task({
         .attachments = {
             daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, gpu_context.task_output_buffer),
@@ -374,13 +508,22 @@ void VoxelApp::record_tasks() {
         },
         .name = "ImGui draw",
     });
+    io_ns += ns_since(t0);
+    task_graph_cache.mark_subgraph_recorded(task_graph_layout.io, io_ns);
 
     gpu_context.frame_task_graph.submit({});
     gpu_context.frame_task_graph.present({});
     gpu_context.frame_task_graph.complete({});
 
-    gpu_context.startup_task_graph.submit({});
-    gpu_context.startup_task_graph.complete({});
+    // Some of the settings are only added the first time the passes that read them are recorded.
+    set_renderer_inputs();
+    task_graph_cache.mark_graph_recorded(task_graph_layout.frame_graph, ns_since(graph_t0), needs_idle);
+
+    auto const &frame_stats = task_graph_cache.graphs[task_graph_layout.frame_graph];
+    debug_utils::DebugDisplay::set_debug_string(
+        "Task graphs",
+        fmt::format("frame recorded {} times ({} kept) in {:.2f} ms, {} waits for idle",
+                    frame_stats.record_n, frame_stats.skip_n, static_cast<double>(frame_stats.last_record_ns) / 1'000'000.0, frame_stats.drain_n));
 
     needs_vram_calc = true;
 }
@@ -427,71 +570,148 @@ void VoxelApp::calc_vram_usage() {
     debug_gpu_resource_infos.clear();
     ui_strings.clear();
 
-    size_t result_size = 0;
+    // daxa allocates the transients of the frame task graph itself, when it's completed.
+    gpu_context.memory_ledger.track(
+        GpuMemoryResourceKind::OTHER, 0, "Per-frame Transient Memory Buffer",
+        {.owner = "frame_task_graph", .category = GpuMemoryCategory::TASK_GRAPH_TRANSIENTS, .lifetime = GpuMemoryLifetime::PER_RECORDING},
+        gpu_context.frame_task_graph.get_transient_memory_size());
 
-    auto format_to_pixel_size = [](daxa::Format format) -> daxa_u32 {
-        switch (format) {
-        case daxa::Format::R16G16B16_SFLOAT: return 3 * 2;
-        case daxa::Format::R16G16B16A16_SFLOAT: return 4 * 2;
-        case daxa::Format::R32G32B32_SFLOAT: return 3 * 4;
-        default:
-        case daxa::Format::R32G32B32A32_SFLOAT: return 4 * 4;
-        }
-    };
-
-    auto image_size = [this, &format_to_pixel_size, &result_size, &debug_gpu_resource_infos](daxa::ImageId image) {
-        if (image.is_empty()) {
-            return;
-        }
-        auto image_info = gpu_context.device.info_image(image).value();
-        auto size = format_to_pixel_size(image_info.format) * image_info.size.x * image_info.size.y * image_info.size.z;
+    auto const snapshot = gpu_context.memory_ledger.snapshot();
+    for (auto const &allocation : snapshot.allocations) {
         debug_gpu_resource_infos.push_back({
-            .type = "image",
-            .name = image_info.name.data(),
-            .size = size,
+            .type = fmt::format("{} {}", gpu_memory_category_name(allocation.tag.category), gpu_memory_resource_kind_name(allocation.kind)),
+            .name = allocation.name,
+            .size = allocation.size,
         });
-        result_size += size;
-    };
-    auto buffer_size = [this, &result_size, &debug_gpu_resource_infos](daxa::BufferId buffer) {
-        if (buffer.is_empty()) {
-            return;
-        }
-        auto buffer_info = gpu_context.device.info_buffer(buffer).value();
-        debug_gpu_resource_infos.push_back({
-            .type = "buffer",
-            .name = buffer_info.name.data(),
-            .size = buffer_info.size,
-        });
-        result_size += buffer_info.size;
-    };
-
-    buffer_size(gpu_context.input_buffer);
-
-    for (auto &[name, temporal_buffer] : gpu_context.temporal_buffers) {
-        buffer_size(temporal_buffer.resource_id);
-    }
-    for (auto &[name, temporal_image] : gpu_context.temporal_images) {
-        image_size(temporal_image.resource_id);
     }
 
-#if defined(VOXELS_ORIGINAL_IMPL)
-    buffer_size(voxel_world.buffers.voxel_malloc.allocator_buffer);
-    buffer_size(voxel_world.buffers.voxel_malloc.element_buffer);
-    buffer_size(voxel_world.buffers.voxel_malloc.available_element_stack_buffer);
-    buffer_size(voxel_world.buffers.voxel_malloc.released_element_stack_buffer);
-#endif
+    needs_vram_calc = false;
+    vram_calc_revision = gpu_context.memory_ledger.revision;
+    vram_calc_time = Clock::now();
 
-    {
-        auto size = gpu_context.frame_task_graph.get_transient_memory_size();
-        debug_gpu_resource_infos.push_back({
-            .type = "buffer",
-            .name = "Per-frame Transient Memory Buffer",
-            .size = size,
-        });
-        result_size += size;
-    }
+    auto const usage_string = fmt::format("{:.1f} MB (peak {:.1f} MB)", static_cast<double>(snapshot.current_bytes) / 1'000'000.0, static_cast<double>(snapshot.peak_bytes) / 1'000'000.0);
+    debug_utils::DebugDisplay::set_debug_string("VRAM", usage_string);
+    ui_strings.push_back(fmt::format("VRAM usage: {}", usage_string));
+}
 
-    needs_vram_calc = false;
+void VoxelApp::add_console_commands() {
+    debug_utils::Console::add_command({
+        .name = "settings",
+        .help = "Prints the registered settings, or those of one category",
+        .args = {{.name = "category", .type = CommandArgType::STRING, .is_optional = true, .completions = {}}},
+        .run = [](CommandArgs const &args) {
+            for (auto const &[category_id, category] : AppSettings::s_instance->categories) {
+                if (args.has(0) && category_id != args.get_string(0)) {
+                    continue;
+                }
+                debug_utils::Console::add_log(fmt::format("{}:", category_id));
+                for (auto const &[setting_id, entry] : category) {
+                    debug_utils::Console::add_log(fmt::format("  {:<32} {}", setting_id, setting_value_to_string(entry.data)));
+                }
+            }
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "reload_pipeline",
+        .help = "Recompiles one pipeline, rather than all of them like the shader hot-reload does",
+        .args = {{.name = "name", .type = CommandArgType::STRING, .is_optional = false, .completions = gpu_context.pipeline_names()}},
+        .run = [this](CommandArgs const &args) {
+            auto const reloaded_n = gpu_context.reload_pipeline(args.get_string(0));
+            if (reloaded_n == 0) {
+                debug_utils::Console::add_log(fmt::format("[error] No pipeline called '{}'", args.get_string(0)));
+                return;
+            }
+            task_graph_cache.invalidate();
+            ui.should_record_task_graph = true;
+            debug_utils::Console::add_log(fmt::format("Reloading {} pipeline(s)", reloaded_n));
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "profile_capture",
+        .help = "Captures a CPU profile of the next frames, as Chrome trace JSON (open it in Perfetto or chrome://tracing)",
+        .args = {
+            {.name = "frames", .type = CommandArgType::INT, .is_optional = false, .completions = {}},
+            {.name = "path", .type = CommandArgType::STRING, .is_optional = true, .completions = {}},
+        },
+        .run = [](CommandArgs const &args) {
+            if (CpuProfiler::s_instance == nullptr) {
+                debug_utils::Console::add_log("[error] There's no CPU profiler");
+                return;
+            }
+            auto const frame_n = static_cast<uint32_t>(std::clamp<int64_t>(args.get_int(0), 1, 10000));
+            auto path = args.has(1) ? std::filesystem::path{args.get_string(1)} : std::filesystem::path{".out/profiles/cpu_profile.json"};
+            CpuProfiler::s_instance->start_capture(frame_n, std::move(path));
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "profile_stop",
+        .help = "Ends the running CPU profile capture early, and writes it",
+        .args = {},
+        .run = [](CommandArgs const &) {
+            if (CpuProfiler::s_instance != nullptr) {
+                CpuProfiler::s_instance->stop_capture();
+            }
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "task_graph_stats",
+        .help = "Prints how often each task graph was recorded or kept, how long recording it and its subgraphs took, and what changed last",
+        .args = {},
+        .run = [this](CommandArgs const &) {
+            for (auto const &line : task_graph_cache.stats_lines()) {
+                debug_utils::Console::add_log(line);
+            }
+            debug_utils::Console::add_log("last changes:");
+            for (auto const &change : task_graph_cache.last_changes) {
+                debug_utils::Console::add_log(fmt::format("  {}", change));
+            }
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "gpu_memory",
+        .help = "Prints the GPU memory in use and its peak by category and by owner, with the budgets",
+        .args = {},
+        .run = [this](CommandArgs const &) {
+            for (auto const &line : gpu_context.memory_ledger.snapshot().report_lines()) {
+                debug_utils::Console::add_log(line);
+            }
+        },
+    });
+    auto budget_completions = std::vector<std::string>{"total"};
+    for (uint32_t category_i = 0; category_i < static_cast<uint32_t>(GpuMemoryCategory::COUNT); ++category_i) {
+        budget_completions.emplace_back(gpu_memory_category_name(static_cast<GpuMemoryCategory>(category_i)));
+    }
+    debug_utils::Console::add_command({
+        .name = "gpu_memory_budget",
+        .help = "Sets how many MB a GPU memory category (or the total) may grow to, 0 for no limit. What's already allocated stays",
+        .args = {
+            {.name = "category", .type = CommandArgType::STRING, .is_optional = false, .completions = std::move(budget_completions)},
+            {.name = "megabytes", .type = CommandArgType::INT, .is_optional = false, .completions = {}},
+        },
+        .run = [this](CommandArgs const &args) {
+            auto const budget_bytes = static_cast<uint64_t>(std::max<int64_t>(args.get_int(1), 0)) * 1'000'000;
+            if (args.get_string(0) == "total") {
+                gpu_context.memory_ledger.set_total_budget(budget_bytes);
+                return;
+            }
+            auto const category = gpu_memory_category_from_name(args.get_string(0));
+            if (category == GpuMemoryCategory::COUNT) {
+                debug_utils::Console::add_log(fmt::format("[error] No GPU memory category called '{}'", args.get_string(0)));
+                return;
+            }
+            gpu_context.memory_ledger.set_budget(category, budget_bytes);
+        },
+    });
+    voxel_world.add_console_commands();
+}
 
-    ui_strings.push_back(fmt::format("Est. VRAM usage: {} MB", static_cast<float>(result_size) / 1000000));
+void VoxelApp::remove_console_commands() {
+    debug_utils::Console::remove_command("settings");
+    debug_utils::Console::remove_command("reload_pipeline");
+    debug_utils::Console::remove_command("profile_capture");
+    debug_utils::Console::remove_command("profile_stop");
+    debug_utils::Console::remove_command("task_graph_stats");
+    debug_utils::Console::remove_command("gpu_memory");
+    debug_utils::Console::remove_command("gpu_memory_budget");
+    voxel_world.remove_console_commands();
 }
@@ -4,6 +4,7 @@
 #include <application/ui.hpp>
 #include <application/audio.hpp>
 #include <application/player.hpp>
+#include <application/replay.hpp>
 
 #include <renderer/renderer.hpp>
 #include <voxels/voxel_world.inl>
@@ -11,6 +12,8 @@
 #include <daxa/utils/imgui.hpp>
 
 #include <utilities/gpu_context.hpp>
+#include <utilities/profiler.hpp>
+#include <utilities/task_graph_cache.hpp>
 
 #include <chrono>
 #include <future>
@@ -38,9 +41,37 @@ struct VoxelApp : AppWindow<VoxelApp> {
     std::vector<std::string> ui_strings;
 
     bool needs_vram_calc = true;
+    // What the GPU memory ledger was at the last calc_vram_usage(). It changes outside of
+    // recording too, like when the voxel heap grows, so it's checked at most once a second.
+    uint64_t vram_calc_revision = 0;
+    Clock::time_point vram_calc_time{};
+
+    // What the startup and frame task graphs were last recorded from, so that record_tasks() only
+    // records the ones whose inputs changed.
+    struct TaskGraphLayout {
+        uint32_t startup_graph;
+        uint32_t frame_graph;
+        uint32_t world_startup;
+        uint32_t particles_startup;
+        uint32_t io;
+        uint32_t world;
+        uint32_t particles;
+        uint32_t renderer;
+    };
+    TaskGraphCache task_graph_cache;
+    TaskGraphLayout task_graph_layout{};
+
+    // Set from the command line. A non-zero fixed timestep replaces the measured frame time, which
+    // makes recordings replay identically.
+    ReplayRecorder *replay_recorder = nullptr;
+    daxa_f32 fixed_delta_time = 0.0f;
 
     daxa_f32 render_res_scl{1.0f};
 
+    SettingHandle<settings::SliderFloat> fov_setting;
+    SettingHandle<settings::Checkbox> battery_saving_mode_setting;
+    SettingHandle<settings::SliderFloat> render_res_scale_setting;
+
     VoxelApp();
     VoxelApp(VoxelApp const &) = delete;
     VoxelApp(VoxelApp &&) = delete;
@@ -62,4 +93,6 @@ struct VoxelApp : AppWindow<VoxelApp> {
     void record_tasks();
 
     void calc_vram_usage();
+    void add_console_commands();
+    void remove_console_commands();
 };
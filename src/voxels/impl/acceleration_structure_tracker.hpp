@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+// Free lists of GPU resources (buffers), bucketed by power of two size classes. Resources that are
+// given back are retired first, and only become reusable once the frames that may still use them
+// on the GPU are done. Only does the bookkeeping, so that it can run without a device; creating
+// and destroying the resources is left to the caller.
+template <typename Resource>
+struct SizeClassPool {
+    static constexpr uint32_t MIN_SIZE_CLASS = 8;
+    static constexpr uint32_t SIZE_CLASS_N = 48;
+    // Free resources beyond this are destroyed when they come out of retirement.
+    static constexpr size_t MAX_FREE_PER_SIZE_CLASS = 32;
+
+    struct RetiredResource {
+        Resource resource;
+        uint32_t size_class;
+        uint64_t retire_frame;
+    };
+    struct Stats {
+        uint64_t acquire_n = 0;
+        uint64_t reuse_n = 0;
+        uint64_t retire_n = 0;
+        uint64_t destroy_n = 0;
+        // Bytes held by free and retired resources.
+        uint64_t pooled_bytes = 0;
+    };
+
+    std::array<std::vector<Resource>, SIZE_CLASS_N> free_lists{};
+    std::deque<RetiredResource> retired_resources;
+    Stats stats{};
+
+    static constexpr auto size_class(uint64_t size) -> uint32_t {
+        auto const result = static_cast<uint32_t>(std::bit_width(size > 1 ? size - 1 : 0));
+        return result < MIN_SIZE_CLASS ? MIN_SIZE_CLASS : result;
+    }
+    // What a resource of the given class has to be created with, so that any request of that class
+    // fits into it.
+    static constexpr auto class_size(uint32_t size_class_index) -> uint64_t {
+        return uint64_t{1} << size_class_index;
+    }
+
+    // Returns a free resource that fits `size` bytes, if there is one. Otherwise, the caller creates
+    // one of class_size(size_class(size)) bytes.
+    auto acquire(uint64_t size) -> std::optional<Resource> {
+        ++stats.acquire_n;
+        auto &free_list = free_lists[size_class(size)];
+        if (free_list.empty()) {
+            return std::nullopt;
+        }
+        ++stats.reuse_n;
+        stats.pooled_bytes -= class_size(size_class(size));
+        auto result = free_list.back();
+        free_list.pop_back();
+        return result;
+    }
+
+    // Gives back a resource acquired for `size` bytes, which the GPU may use up until `frame`.
+    void retire(Resource resource, uint64_t size, uint64_t frame) {
+        ++stats.retire_n;
+        auto const size_class_index = size_class(size);
+        stats.pooled_bytes += class_size(size_class_index);
+        retired_resources.push_back({resource, size_class_index, frame});
+    }
+
+    // Makes the resources that were retired at least `frame_latency` frames before `frame` reusable.
+    template <typename DestroyFunc>
+    void collect(uint64_t frame, uint64_t frame_latency, DestroyFunc &&destroy) {
+        while (!retired_resources.empty() && retired_resources.front().retire_frame + frame_latency <= frame) {
+            auto const &retired = retired_resources.front();
+            auto &free_list = free_lists[retired.size_class];
+            if (free_list.size() < MAX_FREE_PER_SIZE_CLASS) {
+                free_list.push_back(retired.resource);
+            } else {
+                ++stats.destroy_n;
+                stats.pooled_bytes -= class_size(retired.size_class);
+                destroy(retired.resource);
+            }
+            retired_resources.pop_front();
+        }
+    }
+
+    // Destroys every free and retired resource. Only call this once the GPU is idle.
+    template <typename DestroyFunc>
+    void clear(DestroyFunc &&destroy) {
+        for (auto &free_list : free_lists) {
+            for (auto const &resource : free_list) {
+                destroy(resource);
+            }
+            free_list.clear();
+        }
+        for (auto const &retired : retired_resources) {
+            destroy(retired.resource);
+        }
+        retired_resources.clear();
+        stats.pooled_bytes = 0;
+    }
+};
+
+// Keeps a persistent, densely packed TLAS instance array, where every key (a chunk index) that has
+// an instance owns a slot. Slots of removed keys are reused, and only the slots that changed since
+// the last take_dirty_ranges() need to be uploaded again.
+struct TlasInstanceTracker {
+    static constexpr uint32_t INVALID = ~0u;
+
+    struct SlotRange {
+        uint32_t first;
+        uint32_t count;
+    };
+    struct Stats {
+        uint32_t live_n = 0;
+        // Slots uploaded by the last take_dirty_ranges(), and in total.
+        uint32_t updated_n = 0;
+        uint64_t total_updated_n = 0;
+    };
+
+    std::vector<uint32_t> key_slots;
+    // INVALID for free slots. The size of this is the number of instances the TLAS is built with.
+    std::vector<uint32_t> slot_keys;
+    std::vector<uint32_t> free_slots;
+    std::vector<uint32_t> dirty_slots;
+    std::vector<bool> slot_is_dirty;
+    Stats stats{};
+
+    void init(uint32_t key_n) {
+        key_slots.assign(key_n, INVALID);
+        slot_keys.clear();
+        free_slots.clear();
+        dirty_slots.clear();
+        slot_is_dirty.clear();
+        stats = {};
+    }
+
+    auto slot_n() const -> uint32_t { return static_cast<uint32_t>(slot_keys.size()); }
+    auto slot_of(uint32_t key) const -> uint32_t { return key_slots[key]; }
+
+    // Returns the slot of `key`, which gets one if it didn't have one yet. Either way, the slot has
+    // to be uploaded again.
+    auto insert(uint32_t key) -> uint32_t {
+        auto slot = key_slots[key];
+        if (slot == INVALID) {
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+                slot_keys[slot] = key;
+            } else {
+                slot = slot_n();
+                slot_keys.push_back(key);
+                slot_is_dirty.push_back(false);
+            }
+            key_slots[key] = slot;
+            ++stats.live_n;
+        }
+        mark_slot_dirty(slot);
+        return slot;
+    }
+
+    // Frees the slot of `key`. The slot is still uploaded once more, so that it can be cleared.
+    void erase(uint32_t key) {
+        auto const slot = key_slots[key];
+        if (slot == INVALID) {
+            return;
+        }
+        key_slots[key] = INVALID;
+        slot_keys[slot] = INVALID;
+        free_slots.push_back(slot);
+        --stats.live_n;
+        mark_slot_dirty(slot);
+    }
+
+    void mark_dirty(uint32_t key) {
+        if (key_slots[key] != INVALID) {
+            mark_slot_dirty(key_slots[key]);
+        }
+    }
+    void mark_all_dirty() {
+        for (uint32_t slot = 0; slot < slot_n(); ++slot) {
+            mark_slot_dirty(slot);
+        }
+    }
+    auto has_dirty_slots() const -> bool { return !dirty_slots.empty(); }
+
+    // Returns the dirty slots as sorted, coalesced ranges, and marks them clean.
+    auto take_dirty_ranges() -> std::vector<SlotRange> {
+        std::sort(dirty_slots.begin(), dirty_slots.end());
+        auto result = std::vector<SlotRange>{};
+        for (auto slot : dirty_slots) {
+            slot_is_dirty[slot] = false;
+            if (!result.empty() && result.back().first + result.back().count == slot) {
+                ++result.back().count;
+            } else {
+                result.push_back({slot, 1});
+            }
+        }
+        stats.updated_n = static_cast<uint32_t>(dirty_slots.size());
+        stats.total_updated_n += stats.updated_n;
+        dirty_slots.clear();
+        return result;
+    }
+
+    void mark_slot_dirty(uint32_t slot) {
+        if (!slot_is_dirty[slot]) {
+            slot_is_dirty[slot] = true;
+            dirty_slots.push_back(slot);
+        }
+    }
+};
@@ -0,0 +1,265 @@
+#include <voxels/impl/acceleration_structure_tracker.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <array>
+#include <map>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    // Checks the ranges of one take_dirty_ranges() against the slots that were touched since the
+    // last one.
+    auto check_dirty_ranges(std::vector<TlasInstanceTracker::SlotRange> const &ranges, std::set<uint32_t> const &touched_slots, uint32_t slot_n) -> std::string {
+        auto covered = std::set<uint32_t>{};
+        for (size_t range_i = 0; range_i < ranges.size(); ++range_i) {
+            auto const &range = ranges[range_i];
+            if (range.count == 0 || range.first + range.count > slot_n) {
+                return fmt::format("range [{}, +{}) is empty or past the {} slots", range.first, range.count, slot_n);
+            }
+            if (range_i > 0 && ranges[range_i - 1].first + ranges[range_i - 1].count >= range.first) {
+                return fmt::format("range [{}, +{}) isn't sorted or coalesced with the one before", range.first, range.count);
+            }
+            for (uint32_t slot = range.first; slot < range.first + range.count; ++slot) {
+                covered.insert(slot);
+            }
+        }
+        if (covered != touched_slots) {
+            return fmt::format("the ranges cover {} slots, but {} were touched", covered.size(), touched_slots.size());
+        }
+        return {};
+    }
+
+    // Random inserts, erases and updates, mirrored in a map of key to slot. The instance array stays
+    // packed, and only the touched slots are uploaded.
+    auto test_tracker_churn() -> std::string {
+        constexpr uint32_t key_n = 4096;
+        auto rng = std::mt19937{0};
+        auto tracker = TlasInstanceTracker{};
+        tracker.init(key_n);
+        auto key_slots = std::map<uint32_t, uint32_t>{};
+        auto peak_live_n = size_t{0};
+        auto total_touched_n = uint64_t{0};
+        for (uint32_t frame_i = 0; frame_i < 200; ++frame_i) {
+            auto touched_slots = std::set<uint32_t>{};
+            // Grows for the first frames, then churns around a steady number of instances.
+            auto const insert_share = frame_i < 50 ? 0.8f : 0.5f;
+            auto const op_n = rng() % 300;
+            for (uint32_t op_i = 0; op_i < op_n; ++op_i) {
+                auto const key = static_cast<uint32_t>(rng() % key_n);
+                auto const roll = std::uniform_real_distribution<float>{}(rng);
+                if (roll < insert_share) {
+                    auto const slot = tracker.insert(key);
+                    auto const [iter, inserted] = key_slots.emplace(key, slot);
+                    if (!inserted && iter->second != slot) {
+                        return fmt::format("frame {}: key {} moved from slot {} to {}", frame_i, key, iter->second, slot);
+                    }
+                    touched_slots.insert(slot);
+                } else if (roll < 0.9f) {
+                    if (auto iter = key_slots.find(key); iter != key_slots.end()) {
+                        touched_slots.insert(iter->second);
+                        key_slots.erase(iter);
+                    }
+                    tracker.erase(key);
+                } else {
+                    if (auto iter = key_slots.find(key); iter != key_slots.end()) {
+                        touched_slots.insert(iter->second);
+                    }
+                    tracker.mark_dirty(key);
+                }
+                peak_live_n = std::max(peak_live_n, key_slots.size());
+            }
+
+            auto used_slots = std::unordered_set<uint32_t>{};
+            for (auto const &[key, slot] : key_slots) {
+                if (tracker.slot_of(key) != slot || slot >= tracker.slot_n() || tracker.slot_keys[slot] != key || !used_slots.insert(slot).second) {
+                    return fmt::format("frame {}: key {} doesn't own slot {}", frame_i, key, slot);
+                }
+            }
+            if (tracker.stats.live_n != key_slots.size() || tracker.slot_n() != peak_live_n || tracker.free_slots.size() != peak_live_n - key_slots.size()) {
+                return fmt::format("frame {}: {} live keys in {} slots, with {} free, after a peak of {} keys", frame_i, tracker.stats.live_n, tracker.slot_n(), tracker.free_slots.size(), peak_live_n);
+            }
+            for (auto const slot : tracker.free_slots) {
+                if (tracker.slot_keys[slot] != TlasInstanceTracker::INVALID) {
+                    return fmt::format("frame {}: free slot {} still has key {}", frame_i, slot, tracker.slot_keys[slot]);
+                }
+            }
+
+            if (tracker.has_dirty_slots() != !touched_slots.empty()) {
+                return fmt::format("frame {}: has_dirty_slots() is wrong", frame_i);
+            }
+            auto const ranges = tracker.take_dirty_ranges();
+            if (auto error = check_dirty_ranges(ranges, touched_slots, tracker.slot_n()); !error.empty()) {
+                return fmt::format("frame {}: {}", frame_i, error);
+            }
+            total_touched_n += touched_slots.size();
+            if (tracker.stats.updated_n != touched_slots.size() || tracker.stats.total_updated_n != total_touched_n || tracker.has_dirty_slots()) {
+                return fmt::format("frame {}: the stats count {} updated slots, instead of {}", frame_i, tracker.stats.updated_n, touched_slots.size());
+            }
+        }
+
+        tracker.mark_all_dirty();
+        auto const ranges = tracker.take_dirty_ranges();
+        if (ranges.size() != 1 || ranges[0].first != 0 || ranges[0].count != tracker.slot_n()) {
+            return "mark_all_dirty() didn't make one range over every slot";
+        }
+        return {};
+    }
+
+    // Erasing keys frees their slot for the next insert, and erasing or updating a key that has no
+    // slot does nothing.
+    auto test_tracker_slot_reuse() -> std::string {
+        auto tracker = TlasInstanceTracker{};
+        tracker.init(16);
+        for (uint32_t key = 0; key < 4; ++key) {
+            tracker.insert(key);
+        }
+        tracker.take_dirty_ranges();
+        tracker.erase(1);
+        tracker.erase(1);
+        tracker.mark_dirty(1);
+        tracker.mark_dirty(9);
+        auto const ranges = tracker.take_dirty_ranges();
+        if (ranges.size() != 1 || ranges[0].first != 1 || ranges[0].count != 1) {
+            return "erasing a key didn't upload its slot exactly once";
+        }
+        if (tracker.insert(9) != 1 || tracker.slot_n() != 4 || tracker.stats.live_n != 4) {
+            return fmt::format("the next insert didn't reuse the freed slot, and made {} slots", tracker.slot_n());
+        }
+        tracker.init(16);
+        if (tracker.slot_n() != 0 || tracker.slot_of(9) != TlasInstanceTracker::INVALID || tracker.has_dirty_slots() || tracker.stats.live_n != 0) {
+            return "init() didn't reset the tracker";
+        }
+        return {};
+    }
+
+    using BufferPool = SizeClassPool<uint32_t>;
+
+    auto test_size_classes() -> std::string {
+        for (uint64_t size = 1; size < (uint64_t{1} << 40); size = size * 3 / 2 + 1) {
+            auto const size_class = BufferPool::size_class(size);
+            auto const class_size = BufferPool::class_size(size_class);
+            if (class_size < size || size_class >= BufferPool::SIZE_CLASS_N) {
+                return fmt::format("{} bytes went into class {} of {} bytes", size, size_class, class_size);
+            }
+            // Only the smallest class rounds up by more than 2x.
+            if (size_class > BufferPool::MIN_SIZE_CLASS && class_size >= size * 2) {
+                return fmt::format("{} bytes went into a class twice as large, of {} bytes", size, class_size);
+            }
+        }
+        if (BufferPool::size_class(1024) != 10 || BufferPool::size_class(1025) != 11 || BufferPool::size_class(0) != BufferPool::MIN_SIZE_CLASS) {
+            return "a power of two, or 0, went into the wrong class";
+        }
+        return {};
+    }
+
+    // A retired buffer only comes back out once its frames are done, and only for its own class.
+    auto test_pool_retire_latency() -> std::string {
+        constexpr uint64_t frame_latency = 2;
+        auto pool = BufferPool{};
+        auto destroy_n = 0u;
+        auto const destroy = [&](uint32_t /*unused*/) { ++destroy_n; };
+        pool.retire(7, 3000, 10);
+        for (uint64_t frame = 10; frame < 10 + frame_latency; ++frame) {
+            pool.collect(frame, frame_latency, destroy);
+            if (pool.acquire(3000)) {
+                return fmt::format("a buffer retired in frame 10 came back in frame {}", frame);
+            }
+        }
+        pool.collect(10 + frame_latency, frame_latency, destroy);
+        if (pool.acquire(100'000) || pool.acquire(1000)) {
+            return "a buffer came back for a request of another size class";
+        }
+        auto const reused = pool.acquire(2500);
+        if (reused != 7 || pool.acquire(2500)) {
+            return "the buffer didn't come back exactly once";
+        }
+        if (destroy_n != 0 || pool.stats.acquire_n != 6 || pool.stats.reuse_n != 1 || pool.stats.pooled_bytes != 0) {
+            return fmt::format("{} acquires, {} reuses and {} pooled bytes", pool.stats.acquire_n, pool.stats.reuse_n, pool.stats.pooled_bytes);
+        }
+        return {};
+    }
+
+    // Random acquires and retires over many frames. No buffer is handed out while it's in use or
+    // retired, or destroyed twice, and the byte count matches what the pool holds.
+    auto test_pool_churn() -> std::string {
+        constexpr uint64_t frame_latency = 3;
+        auto rng = std::mt19937{1};
+        auto pool = BufferPool{};
+        auto next_buffer = uint32_t{0};
+        // Buffers that are acquired, with the size they were acquired for.
+        auto live_buffers = std::unordered_map<uint32_t, uint64_t>{};
+        // The frame each pooled buffer was retired in.
+        auto retire_frames = std::unordered_map<uint32_t, uint64_t>{};
+        auto destroyed = std::unordered_set<uint32_t>{};
+        auto error = std::string{};
+        auto const destroy = [&](uint32_t buffer) {
+            if (error.empty() && (!retire_frames.contains(buffer) || !destroyed.insert(buffer).second)) {
+                error = fmt::format("buffer {} was destroyed while in use, or twice", buffer);
+            }
+            retire_frames.erase(buffer);
+        };
+        auto pick_size = std::uniform_int_distribution<uint64_t>{1, 1 << 20};
+        for (uint64_t frame = 0; frame < 500; ++frame) {
+            pool.collect(frame, frame_latency, destroy);
+            auto const op_n = rng() % 40;
+            for (uint32_t op_i = 0; op_i < op_n; ++op_i) {
+                if (rng() % 2 == 0 || live_buffers.empty()) {
+                    auto const size = pick_size(rng);
+                    auto buffer = pool.acquire(size);
+                    if (buffer) {
+                        auto const retire_iter = retire_frames.find(*buffer);
+                        if (retire_iter == retire_frames.end() || retire_iter->second + frame_latency > frame) {
+                            return fmt::format("frame {}: buffer {} was handed out too early", frame, *buffer);
+                        }
+                        retire_frames.erase(retire_iter);
+                    } else {
+                        buffer = next_buffer++;
+                    }
+                    live_buffers[*buffer] = size;
+                } else {
+                    auto const iter = std::next(live_buffers.begin(), static_cast<std::ptrdiff_t>(rng() % live_buffers.size()));
+                    pool.retire(iter->first, iter->second, frame);
+                    retire_frames[iter->first] = frame;
+                    live_buffers.erase(iter);
+                }
+            }
+            if (!error.empty()) {
+                return fmt::format("frame {}: {}", frame, error);
+            }
+            auto pooled_bytes = uint64_t{0};
+            for (uint32_t size_class = 0; size_class < BufferPool::SIZE_CLASS_N; ++size_class) {
+                if (pool.free_lists[size_class].size() > BufferPool::MAX_FREE_PER_SIZE_CLASS) {
+                    return fmt::format("frame {}: class {} has {} free buffers", frame, size_class, pool.free_lists[size_class].size());
+                }
+                pooled_bytes += pool.free_lists[size_class].size() * BufferPool::class_size(size_class);
+            }
+            for (auto const &retired : pool.retired_resources) {
+                pooled_bytes += BufferPool::class_size(retired.size_class);
+            }
+            if (pool.stats.pooled_bytes != pooled_bytes) {
+                return fmt::format("frame {}: the stats count {} pooled bytes, instead of {}", frame, pool.stats.pooled_bytes, pooled_bytes);
+            }
+        }
+        if (pool.stats.reuse_n == 0 || pool.stats.destroy_n == 0) {
+            return fmt::format("{} reuses and {} destroys", pool.stats.reuse_n, pool.stats.destroy_n);
+        }
+        pool.clear(destroy);
+        if (!error.empty() || !retire_frames.empty() || pool.stats.pooled_bytes != 0) {
+            return fmt::format("clear() left {} buffers{}", retire_frames.size(), error.empty() ? "" : ", and " + error);
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"tracker churn", test_tracker_churn},
+        UnitTestCase{"tracker slot reuse", test_tracker_slot_reuse},
+        UnitTestCase{"size classes", test_size_classes},
+        UnitTestCase{"retired buffers wait for their frames", test_pool_retire_latency},
+        UnitTestCase{"pool churn", test_pool_churn},
+    };
+    return run_unit_tests(cases);
+}
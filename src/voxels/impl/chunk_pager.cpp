@@ -0,0 +1,151 @@
+#include "chunk_pager.hpp"
+
+#include <utilities/log.hpp>
+#include <utilities/profiler.hpp>
+
+#include <vector>
+
+ChunkPager::ChunkPager(ChunkPagerConfig a_config) : config{std::move(a_config)}, disk{config.spill_folder} {
+    disk.compression_level = config.compression_level;
+}
+
+auto ChunkPager::hit_rate() const -> double {
+    if (stats.restore_request_n == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(stats.memory_hit_n + stats.disk_hit_n) / static_cast<double>(stats.restore_request_n);
+}
+
+void ChunkPager::insert(glm::ivec3 chunk_pos, WorldStoredChunk chunk, bool is_on_disk, bool is_prefetched) {
+    auto const key = world_pos_key(chunk_pos);
+    if (auto iter = entries.find(key); iter != entries.end()) {
+        erase(iter);
+    }
+    lru.push_front(key);
+    stats.memory_bytes += chunk.bytes.size();
+    stats.peak_memory_bytes = std::max(stats.peak_memory_bytes, stats.memory_bytes);
+    entries.emplace(key, Entry{
+                             .chunk_pos = chunk_pos,
+                             .chunk = std::move(chunk),
+                             .lru_iter = lru.begin(),
+                             .is_on_disk = is_on_disk,
+                             .is_prefetched = is_prefetched,
+                         });
+}
+
+void ChunkPager::erase(std::unordered_map<uint64_t, Entry>::iterator iter) {
+    stats.memory_bytes -= iter->second.chunk.bytes.size();
+    lru.erase(iter->second.lru_iter);
+    entries.erase(iter);
+}
+
+void ChunkPager::evict(glm::ivec3 chunk_pos, std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> palette_chunks) {
+    PROFILE_ZONE("ChunkPager::evict");
+    ++stats.evicted_n;
+    insert(chunk_pos, store_world_chunk(palette_chunks, config.compression_level), false, false);
+}
+
+auto ChunkPager::restore(glm::ivec3 chunk_pos, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> bool {
+    PROFILE_ZONE("ChunkPager::restore");
+    ++stats.restore_request_n;
+    if (auto iter = entries.find(world_pos_key(chunk_pos)); iter != entries.end()) {
+        auto const is_prefetched = iter->second.is_prefetched;
+        auto const loaded = load_world_chunk(iter->second.chunk, out, allocator);
+        // The chunk lives in the window again, so the copy is of no more use. The disk still has
+        // the last spilled version, which the next eviction replaces.
+        erase(iter);
+        if (loaded) {
+            ++stats.memory_hit_n;
+            stats.useful_prefetch_n += is_prefetched ? 1 : 0;
+            return true;
+        }
+        log_error("Chunk ({}, {}, {}) failed to decode from the chunk pager", chunk_pos.x, chunk_pos.y, chunk_pos.z);
+    } else if (!config.spill_folder.empty()) {
+        auto const status = disk.read_stored_chunk(chunk_pos, scratch);
+        if (status == WorldChunkLoadStatus::LOADED && load_world_chunk(scratch, out, allocator)) {
+            ++stats.disk_hit_n;
+            return true;
+        }
+        if (status != WorldChunkLoadStatus::MISSING) {
+            log_warning("Regenerating chunk ({}, {}, {}), whose spilled copy is corrupt", chunk_pos.x, chunk_pos.y, chunk_pos.z);
+        }
+    }
+    ++stats.miss_n;
+    return false;
+}
+
+void ChunkPager::shrink_to(size_t byte_n) {
+    auto spill_keys = std::vector<uint64_t>{};
+    auto spill_refs = std::vector<WorldStoredChunkRef>{};
+    auto freed_n = size_t{};
+    // Walks the LRU list from the back, without removing anything until the spilled chunks are written.
+    for (auto iter = lru.rbegin(); iter != lru.rend() && stats.memory_bytes - freed_n > byte_n; ++iter) {
+        auto &entry = entries.at(*iter);
+        freed_n += entry.chunk.bytes.size();
+        if (!entry.is_on_disk && !config.spill_folder.empty()) {
+            spill_refs.push_back({.chunk_pos = entry.chunk_pos, .chunk = &entry.chunk});
+        } else if (!entry.is_on_disk) {
+            ++stats.dropped_n;
+        }
+        spill_keys.push_back(*iter);
+    }
+    if (!spill_refs.empty()) {
+        PROFILE_ZONE("ChunkPager::spill");
+        auto const save_stats = disk.save_stored_chunks(spill_refs);
+        if (save_stats.failed_region_n != 0) {
+            // Stays in memory, over budget, to be tried again on the next update.
+            log_error("The chunk pager failed to spill to {}", config.spill_folder.string());
+            return;
+        }
+        stats.spilled_n += spill_refs.size();
+    }
+    for (auto key : spill_keys) {
+        erase(entries.find(key));
+    }
+}
+
+void ChunkPager::prefetch(glm::ivec3 window_origin, glm::vec3 velocity) {
+    auto const lead = velocity * config.prefetch_seconds;
+    auto const step_n = std::min(static_cast<int32_t>(std::ceil(std::max({std::abs(lead.x), std::abs(lead.y), std::abs(lead.z)}))), config.window_size);
+    if (step_n <= 0 || config.max_prefetch_n_per_update == 0) {
+        return;
+    }
+    PROFILE_ZONE("ChunkPager::prefetch");
+    // One chunk step at a time along the predicted path, so that the nearest chunks are read first.
+    auto read_n = uint32_t{};
+    auto previous_origin = window_origin;
+    for (int32_t step_i = 1; step_i <= step_n && read_n < config.max_prefetch_n_per_update; ++step_i) {
+        auto const step_lead = lead * (static_cast<float>(step_i) / static_cast<float>(step_n));
+        auto const origin = window_origin + glm::ivec3(static_cast<int32_t>(std::round(step_lead.x)), static_cast<int32_t>(std::round(step_lead.y)), static_cast<int32_t>(std::round(step_lead.z)));
+        for_each_chunk_outside_window(origin, previous_origin, config.window_size, [&](glm::ivec3 chunk_pos) {
+            if (read_n >= config.max_prefetch_n_per_update || entries.contains(world_pos_key(chunk_pos)) || !disk.has_chunk(chunk_pos)) {
+                return;
+            }
+            ++read_n;
+            auto chunk = WorldStoredChunk{};
+            if (disk.read_stored_chunk(chunk_pos, chunk) == WorldChunkLoadStatus::LOADED) {
+                ++stats.prefetched_n;
+                insert(chunk_pos, std::move(chunk), true, true);
+            }
+        });
+        previous_origin = origin;
+    }
+}
+
+void ChunkPager::update(glm::ivec3 window_origin, glm::vec3 velocity) {
+    PROFILE_ZONE("ChunkPager::update");
+    if (stats.memory_bytes > config.memory_budget) {
+        shrink_to(static_cast<size_t>(static_cast<double>(config.memory_budget) * static_cast<double>(config.spill_watermark)));
+    }
+    if (!config.spill_folder.empty()) {
+        prefetch(window_origin, velocity);
+        // The prefetched chunks are the most recently used now, so this pushes out older ones.
+        if (stats.memory_bytes > config.memory_budget) {
+            shrink_to(config.memory_budget);
+        }
+    }
+}
+
+void ChunkPager::flush() {
+    shrink_to(0);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <span>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include <voxels/impl/world_save.hpp>
+
+// Keeps the chunks that scroll out of the chunk window, so that they come back as they were instead
+// of being regenerated. Evicted chunks stay in memory in their stored (compressed) form, and once
+// that's over budget, the least recently used ones spill into region files. Chunks the window is
+// about to take in, going by the player's velocity, are read back from disk ahead of time. Only deals
+// in chunk positions and palette chunks, so it can be driven without the device.
+//
+// VoxelWorld doesn't drive it yet. The chunk window lives on the device, which generates the chunks
+// that scroll in, and the CPU chunks only mirror it through the chunk updates. Restoring a chunk
+// needs an upload path through the chunk edit and allocation shaders first; evicting into the pager
+// before then would keep edits that can never come back. Wiring it up takes:
+// - a buffer of restored chunks, filled from restore() for the chunks entering the window, which the
+//   chunk edit shader copies voxels from instead of running the world brush for those chunks,
+// - evict() from VoxelWorld::apply_chunk_updates, when an update's world chunk differs from the
+//   CpuVoxelChunk::world_chunk of the slot it replaces,
+// - update() once per frame, with the window origin and the player's velocity in chunks.
+
+struct ChunkPagerConfig {
+    // Chunks per axis of the window, which starts at the origin passed to update().
+    int32_t window_size = CHUNKS_PER_AXIS;
+    // Stored bytes kept in memory before the least recently used chunks spill to disk.
+    size_t memory_budget = size_t{256} << 20;
+    // Share of the budget that spilling goes down to, so that region files are rewritten for
+    // batches of chunks rather than for every few that get evicted.
+    float spill_watermark = 0.75f;
+    // How far ahead, in seconds at the current velocity, chunks are read back from disk.
+    float prefetch_seconds = 1.0f;
+    // Disk reads per update() at most, so that a fast player can't stall a frame.
+    uint32_t max_prefetch_n_per_update = 64;
+    int compression_level = 1;
+    // Where chunks spill to. When empty, chunks over the budget are dropped instead.
+    std::filesystem::path spill_folder;
+};
+
+struct ChunkPagerStats {
+    uint64_t evicted_n = 0;
+    uint64_t restore_request_n = 0;
+    // Restores served from memory, prefetched chunks included.
+    uint64_t memory_hit_n = 0;
+    // Restores that had to read the disk right when the chunk was needed.
+    uint64_t disk_hit_n = 0;
+    uint64_t miss_n = 0;
+    uint64_t spilled_n = 0;
+    uint64_t dropped_n = 0;
+    uint64_t prefetched_n = 0;
+    // Prefetched chunks that got restored before being pushed out of memory again.
+    uint64_t useful_prefetch_n = 0;
+    size_t memory_bytes = 0;
+    size_t peak_memory_bytes = 0;
+};
+
+struct ChunkPager {
+    ChunkPagerConfig config;
+    ChunkPagerStats stats;
+
+    explicit ChunkPager(ChunkPagerConfig a_config);
+
+    // Call for every chunk that leaves the window, before its slot is reused.
+    void evict(glm::ivec3 chunk_pos, std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> palette_chunks);
+    // Call for every chunk that enters the window. Returns false, leaving `out` alone, if the pager
+    // doesn't have the chunk, which then has to be generated. See load_world_chunk() for `out`.
+    auto restore(glm::ivec3 chunk_pos, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> bool;
+    // Call once per frame, after the evictions and restores. Spills what's over budget, and
+    // prefetches the chunks the window will take in if it keeps moving at `velocity`, in chunks per
+    // second.
+    void update(glm::ivec3 window_origin, glm::vec3 velocity);
+    // Spills every chunk that's only in memory.
+    void flush();
+
+    auto cached_chunk_n() const -> size_t { return entries.size(); }
+    // Share of the restore requests that found the chunk, in memory or on disk.
+    auto hit_rate() const -> double;
+
+  private:
+    struct Entry {
+        glm::ivec3 chunk_pos;
+        WorldStoredChunk chunk;
+        std::list<uint64_t>::iterator lru_iter;
+        // The disk has the same chunk, so dropping it from memory loses nothing.
+        bool is_on_disk = false;
+        bool is_prefetched = false;
+    };
+
+    std::unordered_map<uint64_t, Entry> entries;
+    // Keys of `entries`, most recently used first.
+    std::list<uint64_t> lru;
+    WorldSave disk;
+    WorldStoredChunk scratch;
+
+    void insert(glm::ivec3 chunk_pos, WorldStoredChunk chunk, bool is_on_disk, bool is_prefetched);
+    void erase(std::unordered_map<uint64_t, Entry>::iterator iter);
+    // Spills or drops least recently used chunks until at most `byte_n` are left in memory.
+    void shrink_to(size_t byte_n);
+    void prefetch(glm::ivec3 window_origin, glm::vec3 velocity);
+};
+
+// Calls f(chunk_pos) for every chunk of the window at `origin` that isn't in the window at
+// `other_origin`, both being `window_size` chunks per axis. With the origins swapped, that's the
+// chunks leaving rather than entering.
+template <typename F>
+void for_each_chunk_outside_window(glm::ivec3 origin, glm::ivec3 other_origin, int32_t window_size, F const &f) {
+    auto const visit = [&](glm::ivec3 box_min, glm::ivec3 box_max) {
+        for (auto z = box_min.z; z < box_max.z; ++z) {
+            for (auto y = box_min.y; y < box_max.y; ++y) {
+                for (auto x = box_min.x; x < box_max.x; ++x) {
+                    f(glm::ivec3(x, y, z));
+                }
+            }
+        }
+    };
+    auto const window_max = origin + glm::ivec3(window_size);
+    auto const other_max = other_origin + glm::ivec3(window_size);
+    // The part of the window left of, right of, and inside the other window along x, then the same
+    // along y within the x overlap, and along z within the x and y overlap.
+    auto inner_min = origin;
+    auto inner_max = window_max;
+    for (int axis = 0; axis < 3; ++axis) {
+        auto const overlap_min = std::max(inner_min[axis], other_origin[axis]);
+        auto const overlap_max = std::min(inner_max[axis], other_max[axis]);
+        if (overlap_min >= overlap_max) {
+            visit(inner_min, inner_max);
+            return;
+        }
+        auto below_max = inner_max;
+        below_max[axis] = overlap_min;
+        visit(inner_min, below_max);
+        auto above_min = inner_min;
+        above_min[axis] = overlap_max;
+        visit(above_min, inner_max);
+        inner_min[axis] = overlap_min;
+        inner_max[axis] = overlap_max;
+    }
+}
@@ -0,0 +1,23 @@
+#include <voxels/impl/chunk_pager.hpp>
+#include <voxels/impl/chunk_pager_test_helpers.hpp>
+#include <utilities/unit_test.hpp>
+
+// Chunk paging of a simulated flight, without and with prefetching.
+// Usage: gvox_engine_chunk_pager_bench [frame count]
+
+auto main(int argc, char const *argv[]) -> int {
+    auto const frame_n = benchmark_count_arg(std::span{argv, static_cast<size_t>(argc)}, 3600);
+    auto is_ok = true;
+    fmt::print("Chunk paging over {} frames, without and with prefetching:\n", frame_n);
+    fmt::print("{:>9} {:>9} {:>9} {:>9} {:>9} {:>8} {:>10} {:>9} {:>8} {:>8} {:>8} {:>5} {:>9}\n", "prefetch", "requests", "memory", "disk", "miss", "hit", "prefetched", "spilled", "peak MB", "mean ms", "max ms", "lost", "mismatch");
+    for (auto const prefetch_seconds : {0.0f, 1.0f}) {
+        auto const result = simulate_chunk_paging({.frame_n = frame_n, .prefetch_seconds = prefetch_seconds});
+        fmt::print("{:>8.1f}s {:>9} {:>9} {:>9} {:>9} {:>8.3f} {:>10} {:>9} {:>8.2f} {:>8.3f} {:>8.2f} {:>5} {:>9}\n", prefetch_seconds,
+                   result.stats.restore_request_n, result.stats.memory_hit_n, result.stats.disk_hit_n, result.stats.miss_n, result.hit_rate,
+                   fmt::format("{}/{}", result.stats.useful_prefetch_n, result.stats.prefetched_n), result.stats.spilled_n,
+                   static_cast<double>(result.stats.peak_memory_bytes) / static_cast<double>(1 << 20), result.mean_frame_ms, result.max_frame_ms,
+                   result.lost_edit_n, result.mismatch_n);
+        is_ok = is_ok && result.lost_edit_n == 0 && result.mismatch_n == 0;
+    }
+    return is_ok ? 0 : 1;
+}
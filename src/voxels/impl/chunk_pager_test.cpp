@@ -0,0 +1,125 @@
+#include <voxels/impl/chunk_pager.hpp>
+#include <voxels/impl/chunk_pager_test_helpers.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <unordered_set>
+
+namespace {
+    auto is_in_window(glm::ivec3 chunk_pos, glm::ivec3 origin, int32_t window_size) -> bool {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (chunk_pos[axis] < origin[axis] || chunk_pos[axis] >= origin[axis] + window_size) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Every chunk of the new window that isn't in the old one is visited exactly once, and nothing else.
+    auto test_window_difference() -> std::string {
+        constexpr int32_t window_size = 8;
+        auto const origin = glm::ivec3(5, -2, 7);
+        for (auto const shift : {glm::ivec3(0, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(-3, 2, 1), glm::ivec3(7, -7, 7), glm::ivec3(20, 0, 0)}) {
+            auto const new_origin = origin + shift;
+            auto visited = std::unordered_set<uint64_t>{};
+            auto visit_n = 0u;
+            auto error = std::string{};
+            for_each_chunk_outside_window(new_origin, origin, window_size, [&](glm::ivec3 chunk_pos) {
+                ++visit_n;
+                visited.insert(world_pos_key(chunk_pos));
+                if (error.empty() && (!is_in_window(chunk_pos, new_origin, window_size) || is_in_window(chunk_pos, origin, window_size))) {
+                    error = fmt::format("shift ({}, {}, {}): visited ({}, {}, {}), which didn't enter the window", shift.x, shift.y, shift.z, chunk_pos.x, chunk_pos.y, chunk_pos.z);
+                }
+            });
+            if (!error.empty()) {
+                return error;
+            }
+            auto expected_n = 0u;
+            for (auto z = new_origin.z; z < new_origin.z + window_size; ++z) {
+                for (auto y = new_origin.y; y < new_origin.y + window_size; ++y) {
+                    for (auto x = new_origin.x; x < new_origin.x + window_size; ++x) {
+                        expected_n += is_in_window(glm::ivec3(x, y, z), origin, window_size) ? 0u : 1u;
+                    }
+                }
+            }
+            if (visit_n != expected_n || visited.size() != expected_n) {
+                return fmt::format("shift ({}, {}, {}): visited {} chunks ({} distinct), instead of {}", shift.x, shift.y, shift.z, visit_n, visited.size(), expected_n);
+            }
+        }
+        return {};
+    }
+
+    // Evicts a few edited chunks into a pager with the given budget, and restores them.
+    auto check_round_trip(size_t memory_budget, std::filesystem::path const &spill_folder, bool expects_restored) -> std::string {
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(spill_folder, ec);
+        auto pager = ChunkPager{{.memory_budget = memory_budget, .spill_folder = spill_folder}};
+        auto allocator = PaletteBlobAllocator{};
+        auto chunk = SimChunk{};
+        auto expected = SimChunk{};
+        auto const chunk_positions = std::array{glm::ivec3(0, 0, 0), glm::ivec3(-1, 3, 2), glm::ivec3(100, -4, -100)};
+        for (uint32_t chunk_i = 0; chunk_i < chunk_positions.size(); ++chunk_i) {
+            generate_sim_chunk(chunk_positions[chunk_i], chunk_i + 1, 0, chunk, allocator);
+            pager.evict(chunk_positions[chunk_i], chunk.palette_chunks);
+            free_sim_chunk(chunk, allocator);
+        }
+        pager.update(glm::ivec3(1000), glm::vec3(0.0f));
+
+        auto error = std::string{};
+        for (uint32_t chunk_i = 0; chunk_i < chunk_positions.size() && error.empty(); ++chunk_i) {
+            auto const &chunk_pos = chunk_positions[chunk_i];
+            auto const is_restored = pager.restore(chunk_pos, chunk.palette_chunks, allocator);
+            generate_sim_chunk(chunk_pos, chunk_i + 1, 0, expected, allocator);
+            if (is_restored != expects_restored) {
+                error = fmt::format("chunk ({}, {}, {}) was {}restored", chunk_pos.x, chunk_pos.y, chunk_pos.z, is_restored ? "" : "not ");
+            } else if (is_restored && !same_palette_chunks(chunk.palette_chunks, expected.palette_chunks)) {
+                error = fmt::format("chunk ({}, {}, {}) came back different", chunk_pos.x, chunk_pos.y, chunk_pos.z);
+            }
+            free_sim_chunk(chunk, allocator);
+        }
+        free_sim_chunk(expected, allocator);
+        std::filesystem::remove_all(spill_folder, ec);
+        return error;
+    }
+
+    auto test_restore_from_memory() -> std::string {
+        return check_round_trip(size_t{256} << 20, {}, true);
+    }
+
+    auto test_restore_from_disk() -> std::string {
+        return check_round_trip(0, ".out/chunk_pager_test_spill", true);
+    }
+
+    auto test_drop_without_spill_folder() -> std::string {
+        return check_round_trip(0, {}, false);
+    }
+
+    // A shorter flight than chunk_pager_bench's, which still brings chunks back from memory and disk.
+    auto test_simulated_flight() -> std::string {
+        auto disk_hit_ns = std::array<uint64_t, 2>{};
+        for (uint32_t prefetch_i = 0; prefetch_i < 2; ++prefetch_i) {
+            auto const result = simulate_chunk_paging({.frame_n = 900, .prefetch_seconds = static_cast<float>(prefetch_i)});
+            if (result.lost_edit_n != 0 || result.mismatch_n != 0) {
+                return fmt::format("lost {} edits and restored {} chunks wrong, prefetching {} s ahead", result.lost_edit_n, result.mismatch_n, prefetch_i);
+            }
+            if (result.stats.memory_hit_n == 0 || result.stats.spilled_n == 0) {
+                return fmt::format("{} restores from memory and {} chunks spilled, the flight doesn't exercise the pager", result.stats.memory_hit_n, result.stats.spilled_n);
+            }
+            disk_hit_ns[prefetch_i] = result.stats.disk_hit_n;
+        }
+        if (disk_hit_ns[1] >= disk_hit_ns[0]) {
+            return fmt::format("prefetching left {} blocking disk reads, against {} without", disk_hit_ns[1], disk_hit_ns[0]);
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"chunks entering the window", test_window_difference},
+        UnitTestCase{"restore from memory", test_restore_from_memory},
+        UnitTestCase{"restore from disk", test_restore_from_disk},
+        UnitTestCase{"drop without a spill folder", test_drop_without_spill_folder},
+        UnitTestCase{"simulated flight", test_simulated_flight},
+    };
+    return run_unit_tests(cases);
+}
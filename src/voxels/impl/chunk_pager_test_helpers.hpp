@@ -0,0 +1,214 @@
+#pragma once
+
+#include <voxels/impl/chunk_pager.hpp>
+
+#include <fmt/format.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// A simulated chunk window for chunk_pager_test.cpp and chunk_pager_bench.cpp.
+
+struct ChunkPagingSimulationInfo {
+    uint32_t frame_n = 3600;
+    float delta_time = 1.0f / 60.0f;
+    int32_t window_size = 16;
+    // The player flies a figure eight of this radius, in chunks, at this speed, in chunks per second.
+    float path_radius = 40.0f;
+    float speed = 10.0f;
+    // Every this many frames, a chunk next to the player gets edited.
+    uint32_t edit_interval = 4;
+    size_t memory_budget = size_t{4} << 20;
+    float prefetch_seconds = 1.0f;
+    uint32_t seed = 0;
+};
+struct ChunkPagingSimulationResult {
+    ChunkPagerStats stats;
+    double hit_rate;
+    // Time spent in the pager per frame.
+    double mean_frame_ms;
+    double max_frame_ms;
+    // Edits that didn't survive leaving the window and coming back, and restored chunks that came
+    // back different. Both should be 0.
+    uint64_t lost_edit_n;
+    uint64_t mismatch_n;
+};
+
+
+inline auto sim_hash(uint32_t x) -> uint32_t {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+struct SimChunk {
+    std::array<CpuPaletteChunk, PALETTES_PER_CHUNK> palette_chunks{};
+    uint32_t version = 0;
+};
+
+// Ground below y = 0 and sky above, with the version mixed into one palette region, so that
+// every edit makes a different chunk.
+inline void generate_sim_chunk(glm::ivec3 chunk_pos, uint32_t version, uint32_t seed, SimChunk &out, PaletteBlobAllocator &allocator) {
+    auto const chunk_hash = sim_hash(static_cast<uint32_t>(world_pos_key(chunk_pos)) ^ sim_hash(version) ^ seed);
+    for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+        auto &palette_chunk = out.palette_chunks[region_i];
+        allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+        auto const region_y = static_cast<int32_t>((region_i / PALETTES_PER_CHUNK_AXIS) % PALETTES_PER_CHUNK_AXIS);
+        auto const is_ground = chunk_pos.y * PALETTES_PER_CHUNK_AXIS + region_y < 0;
+        auto const voxel = is_ground ? ((0x707070u + (sim_hash(chunk_hash + region_i) & 0x3u) * 0x010101u) << 8) | 1 : 0u;
+        palette_chunk.variant_n = 1;
+        palette_chunk.has_air = is_ground ? 0 : 1;
+        palette_chunk.blob_ptr = std::bit_cast<uint32_t *>(size_t{voxel});
+    }
+    auto voxels = PaletteRegionVoxels{};
+    for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+        voxels[voxel_i] = ((sim_hash(chunk_hash ^ voxel_i) & 0x7u) << 8) | 1;
+    }
+    auto blob = std::vector<uint32_t>{};
+    auto &edited = out.palette_chunks[0];
+    auto const encoded = encode_palette_region(voxels, blob);
+    edited.variant_n = encoded.variant_n;
+    edited.has_air = 0;
+    edited.blob_ptr = allocator.allocate(encoded.variant_n);
+    std::copy(blob.begin(), blob.end(), edited.blob_ptr);
+    out.version = version;
+}
+
+inline void free_sim_chunk(SimChunk &chunk, PaletteBlobAllocator &allocator) {
+    for (auto &palette_chunk : chunk.palette_chunks) {
+        allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+        palette_chunk = {};
+    }
+}
+
+inline auto same_palette_chunks(std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> a, std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> b) -> bool {
+    auto a_voxels = PaletteRegionVoxels{};
+    auto b_voxels = PaletteRegionVoxels{};
+    for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+        if (a[region_i].variant_n != b[region_i].variant_n || a[region_i].has_air != b[region_i].has_air) {
+            return false;
+        }
+        decode_palette_region(a[region_i], a_voxels);
+        decode_palette_region(b[region_i], b_voxels);
+        if (a_voxels != b_voxels) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Drives a ChunkPager with a player flying a figure eight, which keeps bringing chunks back into the
+// window, while editing chunks along the way. Needs no device.
+inline auto simulate_chunk_paging(ChunkPagingSimulationInfo const &info) -> ChunkPagingSimulationResult {
+    using Clock = std::chrono::steady_clock;
+    auto const folder = std::filesystem::path{fmt::format(".out/chunk_paging_simulation_{}", info.seed)};
+    auto ec = std::error_code{};
+    std::filesystem::remove_all(folder, ec);
+
+    auto pager = ChunkPager{{
+        .window_size = info.window_size,
+        .memory_budget = info.memory_budget,
+        .spill_watermark = 0.75f,
+        .prefetch_seconds = info.prefetch_seconds,
+        .max_prefetch_n_per_update = 64,
+        .compression_level = 1,
+        .spill_folder = folder,
+    }};
+    auto allocator = PaletteBlobAllocator{};
+    auto result = ChunkPagingSimulationResult{};
+
+    // A figure eight around the origin, a little above the ground.
+    auto const angular_speed = info.speed / info.path_radius;
+    auto const player_pos = [&](float t) {
+        return glm::vec3(info.path_radius * std::sin(angular_speed * t), 0.5f + 2.0f * std::sin(angular_speed * t * 0.5f), info.path_radius * 0.5f * std::sin(2.0f * angular_speed * t));
+    };
+    auto const window_origin_at = [&](glm::vec3 pos) {
+        return glm::ivec3(static_cast<int32_t>(std::floor(pos.x)), static_cast<int32_t>(std::floor(pos.y)), static_cast<int32_t>(std::floor(pos.z))) - glm::ivec3(info.window_size / 2);
+    };
+
+    auto live_chunks = std::unordered_map<uint64_t, SimChunk>{};
+    // Latest version of every chunk that was ever edited.
+    auto edit_versions = std::unordered_map<uint64_t, uint32_t>{};
+    auto expected = SimChunk{};
+    auto window_origin = window_origin_at(player_pos(0.0f));
+    // Against a window that doesn't overlap, which visits the whole window.
+    for_each_chunk_outside_window(window_origin, window_origin + glm::ivec3(info.window_size), info.window_size, [&](glm::ivec3 chunk_pos) {
+        generate_sim_chunk(chunk_pos, 0, info.seed, live_chunks[world_pos_key(chunk_pos)], allocator);
+    });
+
+    auto rng = std::mt19937{info.seed};
+    auto total_ms = 0.0;
+    auto frame_ms = 0.0;
+    // Only the pager is timed, not generating and checking the chunks around it.
+    auto const timed = [&](auto const &f) {
+        auto const t0 = Clock::now();
+        auto const r = f();
+        frame_ms += std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        return r;
+    };
+    auto previous_pos = player_pos(0.0f);
+    for (uint32_t frame_i = 1; frame_i <= info.frame_n; ++frame_i) {
+        auto const pos = player_pos(static_cast<float>(frame_i) * info.delta_time);
+        auto const velocity = (pos - previous_pos) / info.delta_time;
+        previous_pos = pos;
+        auto const new_window_origin = window_origin_at(pos);
+
+        frame_ms = 0.0;
+        for_each_chunk_outside_window(window_origin, new_window_origin, info.window_size, [&](glm::ivec3 chunk_pos) {
+            auto iter = live_chunks.find(world_pos_key(chunk_pos));
+            timed([&] {
+                pager.evict(chunk_pos, iter->second.palette_chunks);
+                return 0;
+            });
+            free_sim_chunk(iter->second, allocator);
+            live_chunks.erase(iter);
+        });
+        for_each_chunk_outside_window(new_window_origin, window_origin, info.window_size, [&](glm::ivec3 chunk_pos) {
+            auto const key = world_pos_key(chunk_pos);
+            auto &chunk = live_chunks[key];
+            auto const version_iter = edit_versions.find(key);
+            auto const version = version_iter != edit_versions.end() ? version_iter->second : 0u;
+            if (timed([&] { return pager.restore(chunk_pos, chunk.palette_chunks, allocator); })) {
+                chunk.version = version;
+                generate_sim_chunk(chunk_pos, version, info.seed, expected, allocator);
+                result.mismatch_n += same_palette_chunks(chunk.palette_chunks, expected.palette_chunks) ? 0u : 1u;
+            } else {
+                result.lost_edit_n += version != 0 ? 1u : 0u;
+                generate_sim_chunk(chunk_pos, version, info.seed, chunk, allocator);
+            }
+        });
+        window_origin = new_window_origin;
+        timed([&] {
+            pager.update(window_origin, velocity);
+            return 0;
+        });
+        total_ms += frame_ms;
+        result.max_frame_ms = std::max(result.max_frame_ms, frame_ms);
+
+        if (info.edit_interval != 0 && frame_i % info.edit_interval == 0) {
+            auto offset_dist = std::uniform_int_distribution<int32_t>{-2, 2};
+            auto const chunk_pos = window_origin + glm::ivec3(info.window_size / 2) + glm::ivec3(offset_dist(rng), offset_dist(rng), offset_dist(rng));
+            auto const key = world_pos_key(chunk_pos);
+            auto &chunk = live_chunks.at(key);
+            auto &version = edit_versions[key];
+            version = std::max(version, chunk.version) + 1;
+            generate_sim_chunk(chunk_pos, version, info.seed, chunk, allocator);
+        }
+    }
+
+    free_sim_chunk(expected, allocator);
+    for (auto &[key, chunk] : live_chunks) {
+        free_sim_chunk(chunk, allocator);
+    }
+    result.stats = pager.stats;
+    result.hit_rate = pager.hit_rate();
+    result.mean_frame_ms = total_ms / static_cast<double>(std::max(info.frame_n, 1u));
+    std::filesystem::remove_all(folder, ec);
+    return result;
+}
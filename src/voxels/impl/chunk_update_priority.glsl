@@ -0,0 +1,33 @@
+#pragma once
+
+// The priority functions of chunk_update_priority.inl. PerChunkCompute in voxel_world.comp.glsl
+// includes this as GLSL, and chunk_update_scheduler.cpp includes it as C++ (with vec3, uint and
+// the math functions defined to match), so the CPU reference runs the very code the GPU does.
+// Only use what means the same in both: float literals with an f suffix, and explicit conversions
+// wherever the types differ.
+
+// Whether a chunk, `chunk_offset` away from the camera in chunks, overlaps the view cone.
+bool chunk_is_in_view(vec3 chunk_offset, vec3 forward, float tan_half_diagonal_fov) {
+    const float CHUNK_RADIUS = 0.8660254f; // sqrt(3) / 2
+    float dist = length(chunk_offset);
+    if (dist <= CHUNK_RADIUS) {
+        return true;
+    }
+    float angle = acos(clamp(dot(chunk_offset, forward) / dist, -1.0f, 1.0f));
+    return angle <= atan(tan_half_diagonal_fov) + asin(CHUNK_RADIUS / dist);
+}
+
+float chunk_update_priority(float distance, bool is_in_view, uint frames_since_edit, uint wait_n) {
+    float priority = max(float(CHUNK_UPDATE_DISTANCE_POINTS) - distance, 0.0f);
+    if (is_in_view) {
+        priority += float(CHUNK_UPDATE_IN_VIEW_POINTS);
+    }
+    if (frames_since_edit < uint(CHUNK_UPDATE_EDIT_FADE_FRAMES)) {
+        priority += float(CHUNK_UPDATE_EDIT_POINTS) * (1.0f - float(frames_since_edit) / float(CHUNK_UPDATE_EDIT_FADE_FRAMES));
+    }
+    return priority + float(wait_n) * float(CHUNK_UPDATE_AGING_POINTS);
+}
+
+uint chunk_update_priority_bucket(float priority) {
+    return uint(clamp(priority, 0.0f, float(CHUNK_UPDATE_PRIORITY_BUCKET_N - 1)));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Policy for picking the chunks to update each frame, shared by PerChunkCompute and
+// ChunkElectCompute in voxel_world.comp.glsl and by their CPU reference in
+// chunk_update_scheduler.hpp, so it must not include anything.
+//
+// Every chunk that wants an update gets a priority in points, and an estimated cost. Chunks are
+// elected from the highest priority down until either the cost budget or the update slots
+// (MAX_CHUNK_UPDATES_PER_FRAME) run out.
+
+// Priorities are bucketed by whole points, clamped to the last bucket.
+#define CHUNK_UPDATE_PRIORITY_BUCKET_N 128
+// A chunk gets this many points, minus its distance to the player in chunks.
+#define CHUNK_UPDATE_DISTANCE_POINTS 32.0
+#define CHUNK_UPDATE_IN_VIEW_POINTS 16.0
+// Points for a chunk the player edited this frame, fading out over CHUNK_UPDATE_EDIT_FADE_FRAMES.
+#define CHUNK_UPDATE_EDIT_POINTS 48.0
+#define CHUNK_UPDATE_EDIT_FADE_FRAMES 120
+// Points for every frame a request has gone unelected, so that no chunk waits forever. After 2048
+// frames, a request is in the last bucket no matter where it is. Faster aging lets the backlog
+// behind the player outrank what comes into view whenever updates can't keep up with the window.
+#define CHUNK_UPDATE_AGING_POINTS 0.0625
+
+// Rough costs. Generating evaluates the terrain for every voxel of the chunk, which is what
+// dominates; an edit only evaluates the brush on top of the chunk's voxels.
+#define CHUNK_UPDATE_COST_GENERATE 4
+#define CHUNK_UPDATE_COST_EDIT 2
+// The same throughput as a full frame of generated chunks used to get.
+#define CHUNK_UPDATE_COST_BUDGET (MAX_CHUNK_UPDATES_PER_FRAME * CHUNK_UPDATE_COST_GENERATE)
+
+// VoxelLeafChunk::update_request holds the request's brush flags, priority bucket and cost, or 0
+// when the chunk doesn't want an update this frame.
+#define CHUNK_UPDATE_REQUEST_BUCKET_SHIFT 8
+#define CHUNK_UPDATE_REQUEST_COST_SHIFT 16
@@ -0,0 +1,21 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Compiles chunk_update_priority.glsl as GLSL on its own, without the daxa preamble, so that a
+// change to the code it shares with chunk_update_scheduler.cpp can't only build on the CPU side.
+// Registered with CTest when glslangValidator is found, see CMakeLists.txt.
+
+#include <voxels/impl/chunk_update_priority.inl>
+#include <voxels/impl/chunk_update_priority.glsl>
+
+layout(std430, binding = 0) buffer Buckets {
+    uint buckets[];
+};
+
+layout(local_size_x = 64) in;
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    vec3 chunk_offset = vec3(float(i % 8u), float(i / 8u % 8u), 4.0f) - 4.0f;
+    bool is_in_view = chunk_is_in_view(chunk_offset, vec3(0.0f, 0.0f, 1.0f), 1.0f);
+    buckets[i] = chunk_update_priority_bucket(chunk_update_priority(length(chunk_offset), is_in_view, i, i / 4u));
+}
@@ -0,0 +1,247 @@
+#include "chunk_update_scheduler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+// The same source as PerChunkCompute compiles, see chunk_update_priority.glsl.
+namespace chunk_update_glsl {
+    using uint = uint32_t;
+    using vec3 = glm::vec3;
+    using glm::dot;
+    using glm::length;
+    using std::acos;
+    using std::asin;
+    using std::atan;
+    using std::clamp;
+    using std::max;
+#include <voxels/impl/chunk_update_priority.glsl>
+} // namespace chunk_update_glsl
+
+auto chunk_update_cost(ChunkUpdateKind kind) -> uint32_t {
+    return kind == ChunkUpdateKind::GENERATE ? CHUNK_UPDATE_COST_GENERATE : CHUNK_UPDATE_COST_EDIT;
+}
+
+auto chunk_is_in_view(glm::vec3 chunk_offset, glm::vec3 forward, float tan_half_diagonal_fov) -> bool {
+    return chunk_update_glsl::chunk_is_in_view(chunk_offset, forward, tan_half_diagonal_fov);
+}
+
+auto chunk_update_priority(float distance, bool is_in_view, uint32_t frames_since_edit, uint32_t wait_n) -> float {
+    return chunk_update_glsl::chunk_update_priority(distance, is_in_view, frames_since_edit, wait_n);
+}
+
+auto chunk_update_priority_bucket(float priority) -> uint32_t {
+    return chunk_update_glsl::chunk_update_priority_bucket(priority);
+}
+
+void elect_chunk_updates(std::span<ChunkUpdateCandidate const> candidates, ChunkElectionLimits const &limits, std::vector<uint32_t> &out) {
+    auto costs = std::array<uint32_t, CHUNK_UPDATE_PRIORITY_BUCKET_N>{};
+    auto ns = std::array<uint32_t, CHUNK_UPDATE_PRIORITY_BUCKET_N>{};
+    for (auto const &candidate : candidates) {
+        costs[candidate.priority_bucket] += candidate.cost;
+        ns[candidate.priority_bucket] += 1;
+    }
+    // What the buckets above each bucket add up to, which the GPU sums per chunk.
+    auto costs_above = std::array<uint32_t, CHUNK_UPDATE_PRIORITY_BUCKET_N>{};
+    auto ns_above = std::array<uint32_t, CHUNK_UPDATE_PRIORITY_BUCKET_N>{};
+    for (uint32_t i = CHUNK_UPDATE_PRIORITY_BUCKET_N - 1; i > 0; --i) {
+        costs_above[i - 1] = costs_above[i] + costs[i];
+        ns_above[i - 1] = ns_above[i] + ns[i];
+    }
+
+    auto cutoff_bucket_cost = uint32_t{0};
+    auto cutoff_bucket_n = uint32_t{0};
+    for (uint32_t candidate_i = 0; candidate_i < candidates.size(); ++candidate_i) {
+        auto const &candidate = candidates[candidate_i];
+        auto const bucket = candidate.priority_bucket;
+        auto const cost_above = costs_above[bucket];
+        auto const n_above = ns_above[bucket];
+        if (cost_above >= limits.cost_budget || n_above >= limits.max_update_n) {
+            continue;
+        }
+        auto is_elected = false;
+        if (cost_above + costs[bucket] <= limits.cost_budget && n_above + ns[bucket] <= limits.max_update_n) {
+            is_elected = true;
+        } else {
+            auto const prev_cost = cutoff_bucket_cost;
+            auto const prev_n = cutoff_bucket_n;
+            cutoff_bucket_cost += candidate.cost;
+            cutoff_bucket_n += 1;
+            is_elected = prev_cost + candidate.cost <= limits.cost_budget - cost_above && prev_n < limits.max_update_n - n_above;
+        }
+        if (is_elected) {
+            out.push_back(candidate_i);
+        }
+    }
+}
+
+namespace {
+    struct ScheduleSlot {
+        glm::ivec3 world_chunk;
+        bool is_generated = false;
+        bool has_been_in_view = false;
+        uint32_t in_view_since_frame = 0;
+        uint32_t wait_n = 0;
+        uint32_t last_edit_frame = 0;
+    };
+
+    auto chunk_of(glm::vec3 pos) -> glm::ivec3 {
+        auto const p = glm::floor(pos / CHUNK_WORLDSPACE_SIZE);
+        return {static_cast<int32_t>(p.x), static_cast<int32_t>(p.y), static_cast<int32_t>(p.z)};
+    }
+
+    auto percentile(std::vector<double> const &sorted, uint32_t pct) -> double {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+        return sorted[std::min(sorted.size() - 1, sorted.size() * pct / 100)];
+    }
+} // namespace
+
+auto simulate_chunk_update_schedule(ChunkScheduleSimulationInfo const &info) -> ChunkScheduleSimulationResult {
+    using Clock = std::chrono::steady_clock;
+    constexpr auto WINDOW_SIZE = int32_t{CHUNKS_PER_AXIS};
+    constexpr auto SLOT_N = uint32_t{CHUNKS_PER_AXIS * CHUNKS_PER_AXIS * CHUNKS_PER_AXIS};
+    auto result = ChunkScheduleSimulationResult{};
+
+    // Nothing is generated at first, like after startup.
+    auto slots = std::vector<ScheduleSlot>(SLOT_N, ScheduleSlot{.world_chunk = glm::ivec3(INT32_MIN)});
+    // Seconds since the start at the beginning of every frame.
+    auto frame_times = std::vector<double>{};
+    frame_times.reserve(info.flight.size() + 1);
+    frame_times.push_back(0.0);
+    auto time_to_visible = std::vector<double>{};
+    auto candidates = std::vector<ChunkUpdateCandidate>{};
+    auto candidate_slots = std::vector<uint32_t>{};
+    auto candidate_kinds = std::vector<ChunkUpdateKind>{};
+    auto elected = std::vector<uint32_t>{};
+    auto stale_share_sum = 0.0;
+    auto schedule_ms_sum = 0.0;
+    auto prev_window_min = glm::ivec3(INT32_MIN);
+
+    for (uint32_t frame_i = 0; frame_i < info.flight.size(); ++frame_i) {
+        auto const &frame = info.flight[frame_i];
+        frame_times.push_back(frame_times.back() + static_cast<double>(frame.delta_time));
+        auto const view = ChunkUpdateView{
+            .pos = frame.pos / CHUNK_WORLDSPACE_SIZE,
+            .forward = frame.forward,
+            .tan_half_diagonal_fov = frame.tan_half_diagonal_fov,
+        };
+        auto const window_min = chunk_of(frame.pos) - glm::ivec3(WINDOW_SIZE / 2);
+        // Like PerChunkCompute, the brush only edits on frames where the window stays put.
+        auto const is_editing = frame.is_editing && window_min == prev_window_min;
+        prev_window_min = window_min;
+        auto const brush_chunk = chunk_of(frame.pos + frame.forward * info.edit_distance);
+        auto const wrapped_min = (window_min % WINDOW_SIZE + WINDOW_SIZE) % WINDOW_SIZE;
+
+        auto const t0 = Clock::now();
+        candidates.clear();
+        candidate_slots.clear();
+        candidate_kinds.clear();
+        auto in_view_n = uint32_t{0};
+        auto stale_in_view_n = uint32_t{0};
+        for (uint32_t slot_i = 0; slot_i < SLOT_N; ++slot_i) {
+            auto &slot = slots[slot_i];
+            auto const slot_index = static_cast<int32_t>(slot_i);
+            auto const slot_pos = glm::ivec3(slot_index % WINDOW_SIZE, slot_index / WINDOW_SIZE % WINDOW_SIZE, slot_index / (WINDOW_SIZE * WINDOW_SIZE));
+            auto const world_chunk = window_min + (slot_pos - wrapped_min + WINDOW_SIZE) % WINDOW_SIZE;
+            if (slot.world_chunk != world_chunk) {
+                // Left the window before it was ever generated.
+                if (slot.has_been_in_view && !slot.is_generated) {
+                    time_to_visible.push_back(frame_times[frame_i] - frame_times[slot.in_view_since_frame]);
+                }
+                slot = ScheduleSlot{.world_chunk = world_chunk};
+            }
+
+            auto const chunk_offset = glm::vec3(world_chunk) + 0.5f - view.pos;
+            auto const is_in_view = chunk_is_in_view(chunk_offset, view.forward, view.tan_half_diagonal_fov);
+            if (is_in_view) {
+                ++in_view_n;
+                stale_in_view_n += slot.is_generated ? 0 : 1;
+                if (!slot.has_been_in_view) {
+                    slot.has_been_in_view = true;
+                    slot.in_view_since_frame = frame_i;
+                    if (slot.is_generated) {
+                        time_to_visible.push_back(0.0);
+                    }
+                }
+            }
+
+            auto kind = ChunkUpdateKind::GENERATE;
+            if (slot.is_generated) {
+                auto const d = glm::abs(world_chunk - brush_chunk);
+                if (!is_editing || d.x > 1 || d.y > 1 || d.z > 1) {
+                    slot.wait_n = 0;
+                    continue;
+                }
+                kind = ChunkUpdateKind::EDIT;
+                slot.last_edit_frame = frame_i + 1;
+            }
+            auto const frames_since_edit = slot.last_edit_frame == 0 ? uint32_t{CHUNK_UPDATE_EDIT_FADE_FRAMES} : frame_i + 1 - slot.last_edit_frame;
+            auto const priority = chunk_update_priority(glm::length(chunk_offset), is_in_view, frames_since_edit, slot.wait_n);
+            candidates.push_back({.priority_bucket = chunk_update_priority_bucket(priority), .cost = chunk_update_cost(kind)});
+            candidate_slots.push_back(slot_i);
+            candidate_kinds.push_back(kind);
+        }
+
+        elected.clear();
+        if (info.policy == ChunkSchedulePolicy::PRIORITY) {
+            elect_chunk_updates(candidates, info.limits, elected);
+        } else {
+            for (uint32_t i = 0; i < std::min(static_cast<uint32_t>(candidates.size()), info.limits.max_update_n); ++i) {
+                elected.push_back(i);
+            }
+        }
+        schedule_ms_sum += std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+        // Every candidate waits another frame, except for the elected ones.
+        for (auto const slot_i : candidate_slots) {
+            slots[slot_i].wait_n += 1;
+        }
+        for (auto const candidate_i : elected) {
+            auto &slot = slots[candidate_slots[candidate_i]];
+            slot.wait_n = 0;
+            if (candidate_kinds[candidate_i] == ChunkUpdateKind::GENERATE) {
+                slot.is_generated = true;
+                ++result.generated_n;
+                if (slot.has_been_in_view) {
+                    time_to_visible.push_back(frame_times[frame_i] - frame_times[slot.in_view_since_frame]);
+                }
+            }
+        }
+        for (uint32_t candidate_i = 0; candidate_i < candidates.size(); ++candidate_i) {
+            if (candidate_kinds[candidate_i] == ChunkUpdateKind::EDIT) {
+                ++result.edit_request_n;
+                result.dropped_edit_n += slots[candidate_slots[candidate_i]].wait_n != 0 ? 1u : 0u;
+            }
+        }
+        for (auto const slot_i : candidate_slots) {
+            result.max_wait_frame_n = std::max(result.max_wait_frame_n, slots[slot_i].wait_n);
+        }
+        stale_share_sum += in_view_n != 0 ? static_cast<double>(stale_in_view_n) / static_cast<double>(in_view_n) : 0.0;
+    }
+
+    auto const end_time = frame_times.back();
+    for (auto const &slot : slots) {
+        if (slot.has_been_in_view && !slot.is_generated) {
+            time_to_visible.push_back(end_time - frame_times[slot.in_view_since_frame]);
+        }
+    }
+    std::sort(time_to_visible.begin(), time_to_visible.end());
+    auto const frame_n = static_cast<double>(std::max<size_t>(info.flight.size(), 1));
+    result.time_to_visible_n = time_to_visible.size();
+    if (!time_to_visible.empty()) {
+        auto sum = 0.0;
+        for (auto const t : time_to_visible) {
+            sum += t;
+        }
+        result.mean_time_to_visible_ms = sum / static_cast<double>(time_to_visible.size()) * 1000.0;
+        result.p95_time_to_visible_ms = percentile(time_to_visible, 95) * 1000.0;
+        result.p99_time_to_visible_ms = percentile(time_to_visible, 99) * 1000.0;
+        result.max_time_to_visible_ms = time_to_visible.back() * 1000.0;
+    }
+    result.mean_stale_in_view_share = stale_share_sum / frame_n;
+    result.mean_schedule_ms = schedule_ms_sum / frame_n;
+    return result;
+}
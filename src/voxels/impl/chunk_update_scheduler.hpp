@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <voxels/impl/voxel_malloc.inl>
+#include <voxels/impl/chunk_update_priority.inl>
+
+// CPU reference of how PerChunkCompute and ChunkElectCompute (voxel_world.comp.glsl) pick the chunks
+// to update each frame, so that the policy can be tuned and measured without a device. The priority
+// functions compile from the same chunk_update_priority.glsl as the shaders do; the election is
+// written twice, so keep elect_chunk_updates in sync with ChunkElectCompute.
+
+enum struct ChunkUpdateKind : uint8_t {
+    GENERATE,
+    EDIT,
+};
+
+struct ChunkUpdateView {
+    // In chunks, like chunk positions.
+    glm::vec3 pos;
+    glm::vec3 forward;
+    float tan_half_diagonal_fov;
+};
+
+struct ChunkUpdateCandidate {
+    uint32_t priority_bucket;
+    uint32_t cost;
+};
+
+struct ChunkElectionLimits {
+    uint32_t cost_budget = CHUNK_UPDATE_COST_BUDGET;
+    uint32_t max_update_n = MAX_CHUNK_UPDATES_PER_FRAME;
+};
+
+auto chunk_update_cost(ChunkUpdateKind kind) -> uint32_t;
+// Whether a chunk, `chunk_offset` away from the camera in chunks, overlaps the view cone.
+auto chunk_is_in_view(glm::vec3 chunk_offset, glm::vec3 forward, float tan_half_diagonal_fov) -> bool;
+auto chunk_update_priority(float distance, bool is_in_view, uint32_t frames_since_edit, uint32_t wait_n) -> float;
+auto chunk_update_priority_bucket(float priority) -> uint32_t;
+
+// Appends the indices of the elected candidates to `out`. Whole buckets are elected from the highest
+// down, and the bucket that only partly fits is taken in order, where the GPU takes it in whatever
+// order its threads get there. Candidates costing more than the budget are never elected.
+void elect_chunk_updates(std::span<ChunkUpdateCandidate const> candidates, ChunkElectionLimits const &limits, std::vector<uint32_t> &out);
+
+enum struct ChunkSchedulePolicy : uint8_t {
+    // How chunks were picked before priorities: the first requests to get a slot win, which on the
+    // GPU comes down to dispatch order, modelled here as chunk index order.
+    FIRST_COME,
+    PRIORITY,
+};
+
+struct ChunkScheduleFlightFrame {
+    // In meters.
+    glm::vec3 pos;
+    glm::vec3 forward;
+    float tan_half_diagonal_fov;
+    float delta_time;
+    // Whether the player is holding the brush, which edits the chunks around the point it aims at.
+    bool is_editing;
+};
+
+struct ChunkScheduleSimulationInfo {
+    std::span<ChunkScheduleFlightFrame const> flight;
+    ChunkSchedulePolicy policy = ChunkSchedulePolicy::PRIORITY;
+    ChunkElectionLimits limits;
+    // How far ahead of the camera, in meters, the brush is taken to be.
+    float edit_distance = 8.0f;
+};
+
+struct ChunkScheduleSimulationResult {
+    uint64_t generated_n = 0;
+    uint64_t edit_request_n = 0;
+    // Edit requests that weren't elected on the frame they were made. Those aren't retried; a held
+    // brush only asks again on the next frame.
+    uint64_t dropped_edit_n = 0;
+    // Time from a chunk coming into view until it was generated, 0 for chunks that were generated
+    // before. Chunks that left the window, or the simulation ended, before they were generated count
+    // with the time they waited.
+    uint64_t time_to_visible_n = 0;
+    double mean_time_to_visible_ms = 0.0;
+    double p95_time_to_visible_ms = 0.0;
+    double p99_time_to_visible_ms = 0.0;
+    double max_time_to_visible_ms = 0.0;
+    // Average share of the chunks in view that weren't generated yet.
+    double mean_stale_in_view_share = 0.0;
+    uint32_t max_wait_frame_n = 0;
+    // CPU time of prioritizing and electing, per frame.
+    double mean_schedule_ms = 0.0;
+};
+
+// Flies the chunk window along `info.flight`, starting from an empty world, and elects updates each
+// frame the way the voxel world does. Elected chunks count as done on the same frame.
+auto simulate_chunk_update_schedule(ChunkScheduleSimulationInfo const &info) -> ChunkScheduleSimulationResult;
@@ -0,0 +1,56 @@
+#include <voxels/impl/chunk_update_scheduler.hpp>
+#include <application/replay.hpp>
+#include <utilities/log.hpp>
+
+#include <fmt/format.h>
+
+#include <bit>
+#include <cstdlib>
+
+// Flies the chunk update scheduler along the player's path in a recording, with both policies.
+// Usage: gvox_engine_chunk_update_scheduler_bench <replay file> [fixed dt]
+
+auto main(int argc, char const *argv[]) -> int {
+    if (argc < 2) {
+        fmt::print("Usage: gvox_engine_chunk_update_scheduler_bench <replay file> [fixed dt]\n");
+        return 1;
+    }
+    auto const replay_path = std::filesystem::path{argv[1]};
+    auto fixed_delta_time = argc < 3 ? 0.0f : std::strtof(argv[2], nullptr);
+
+    auto logger = Logger{{make_stdout_log_sink()}};
+    auto reader = ReplayReader{replay_path};
+    if (!reader.is_open()) {
+        return 1;
+    }
+    if (fixed_delta_time <= 0.0f) {
+        fixed_delta_time = reader.fixed_delta_time;
+    }
+    auto flight = std::vector<ChunkScheduleFlightFrame>{};
+    auto frame = ReplayFrame{};
+    while (reader.read_frame(frame)) {
+        auto const &player = frame.player_result;
+        auto const clip_to_view = std::bit_cast<glm::mat4>(player.cam.clip_to_view);
+        flight.push_back({
+            .pos = glm::vec3(player.player_unit_offset.x, player.player_unit_offset.y, player.player_unit_offset.z) + std::bit_cast<glm::vec3>(player.pos),
+            .forward = std::bit_cast<glm::vec3>(player.forward),
+            .tan_half_diagonal_fov = glm::length(glm::vec2(clip_to_view[0][0], clip_to_view[1][1])),
+            .delta_time = fixed_delta_time > 0.0f ? fixed_delta_time : frame.gpu_input.delta_time,
+            .is_editing = frame.gpu_input.actions[GAME_ACTION_BRUSH_A] != 0,
+        });
+    }
+    if (flight.empty()) {
+        log_error("No frames in '{}'", replay_path.string());
+        return 1;
+    }
+
+    fmt::print("Chunk update scheduling along {} recorded frames, time to visible in ms:\n", flight.size());
+    fmt::print("{:>10} {:>9} {:>8} {:>8} {:>8} {:>8} {:>8} {:>12} {:>8} {:>9}\n", "policy", "generated", "mean", "p95", "p99", "max", "stale", "edits lost", "max wait", "cpu ms");
+    for (auto const policy : {ChunkSchedulePolicy::FIRST_COME, ChunkSchedulePolicy::PRIORITY}) {
+        auto const result = simulate_chunk_update_schedule({.flight = flight, .policy = policy, .limits = {}});
+        fmt::print("{:>10} {:>9} {:>8.1f} {:>8.1f} {:>8.1f} {:>8.1f} {:>8.3f} {:>12} {:>8} {:>9.3f}\n", policy == ChunkSchedulePolicy::PRIORITY ? "priority" : "first-come",
+                   result.generated_n, result.mean_time_to_visible_ms, result.p95_time_to_visible_ms, result.p99_time_to_visible_ms, result.max_time_to_visible_ms,
+                   result.mean_stale_in_view_share, fmt::format("{}/{}", result.dropped_edit_n, result.edit_request_n), result.max_wait_frame_n, result.mean_schedule_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <voxels/impl/chunk_update_scheduler.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <array>
+#include <random>
+
+namespace {
+    auto test_priority() -> std::string {
+        auto const base = chunk_update_priority(10.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES, 0);
+        if (base != static_cast<float>(CHUNK_UPDATE_DISTANCE_POINTS) - 10.0f) {
+            return fmt::format("a chunk 10 away got {} points", base);
+        }
+        if (chunk_update_priority(11.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES, 0) >= base) {
+            return "a farther chunk didn't get fewer points";
+        }
+        if (chunk_update_priority(1000.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES, 0) != 0.0f) {
+            return "a chunk far outside the window got distance points";
+        }
+        if (chunk_update_priority(10.0f, true, CHUNK_UPDATE_EDIT_FADE_FRAMES, 0) != base + static_cast<float>(CHUNK_UPDATE_IN_VIEW_POINTS)) {
+            return "a chunk in view didn't get the view points";
+        }
+        if (chunk_update_priority(10.0f, false, 0, 0) != base + static_cast<float>(CHUNK_UPDATE_EDIT_POINTS)) {
+            return "a chunk edited this frame didn't get the edit points";
+        }
+        auto const half_faded = chunk_update_priority(10.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES / 2, 0);
+        if (half_faded != base + static_cast<float>(CHUNK_UPDATE_EDIT_POINTS) * 0.5f) {
+            return fmt::format("the edit points didn't fade linearly, {} halfway", half_faded - base);
+        }
+        if (chunk_update_priority(10.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES * 10, 0) != base) {
+            return "an old edit still gets points";
+        }
+        if (chunk_update_priority(10.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES, 16) != base + 16.0f * static_cast<float>(CHUNK_UPDATE_AGING_POINTS)) {
+            return "waiting didn't age the request";
+        }
+        return {};
+    }
+
+    auto test_priority_bucket() -> std::string {
+        struct Case {
+            float priority;
+            uint32_t bucket;
+        };
+        auto const cases = std::array{
+            Case{-5.0f, 0},
+            Case{0.0f, 0},
+            Case{0.99f, 0},
+            Case{1.0f, 1},
+            Case{47.5f, 47},
+            Case{static_cast<float>(CHUNK_UPDATE_PRIORITY_BUCKET_N - 1), CHUNK_UPDATE_PRIORITY_BUCKET_N - 1},
+            Case{1.0e9f, CHUNK_UPDATE_PRIORITY_BUCKET_N - 1},
+        };
+        for (auto const &test_case : cases) {
+            auto const bucket = chunk_update_priority_bucket(test_case.priority);
+            if (bucket != test_case.bucket) {
+                return fmt::format("priority {} went into bucket {}, instead of {}", test_case.priority, bucket, test_case.bucket);
+            }
+        }
+        // Every request that has waited long enough ends up in the last bucket.
+        if (chunk_update_priority_bucket(chunk_update_priority(1000.0f, false, CHUNK_UPDATE_EDIT_FADE_FRAMES, 2048)) != CHUNK_UPDATE_PRIORITY_BUCKET_N - 1) {
+            return "a request that waited 2048 frames isn't in the last bucket";
+        }
+        return {};
+    }
+
+    auto test_in_view() -> std::string {
+        auto const forward = glm::vec3(1, 0, 0);
+        // A 90 degree diagonal field of view.
+        auto const tan_half_fov = 1.0f;
+        struct Case {
+            glm::vec3 chunk_offset;
+            bool is_in_view;
+        };
+        auto const cases = std::array{
+            Case{{0.0f, 0.0f, 0.0f}, true},
+            Case{{-0.5f, 0.5f, 0.0f}, true},
+            Case{{10.0f, 0.0f, 0.0f}, true},
+            Case{{10.0f, 9.9f, 0.0f}, true},
+            // Outside the cone, but close enough to it that part of the chunk is inside.
+            Case{{10.0f, 10.9f, 0.0f}, true},
+            Case{{10.0f, 12.0f, 0.0f}, false},
+            Case{{0.0f, 0.0f, 10.0f}, false},
+            Case{{-10.0f, 0.0f, 0.0f}, false},
+        };
+        for (auto const &test_case : cases) {
+            if (chunk_is_in_view(test_case.chunk_offset, forward, tan_half_fov) != test_case.is_in_view) {
+                return fmt::format("the chunk at ({}, {}, {}) is wrongly {} view", test_case.chunk_offset.x, test_case.chunk_offset.y, test_case.chunk_offset.z, test_case.is_in_view ? "out of" : "in");
+            }
+        }
+        return {};
+    }
+
+    // Fills whole buckets from the highest down, and never goes over the limits.
+    auto test_elect() -> std::string {
+        auto rng = std::mt19937{17};
+        auto candidates = std::vector<ChunkUpdateCandidate>{};
+        auto elected = std::vector<uint32_t>{};
+        for (uint32_t round_i = 0; round_i < 200; ++round_i) {
+            auto const limits = ChunkElectionLimits{.cost_budget = 1 + static_cast<uint32_t>(rng() % 200), .max_update_n = 1 + static_cast<uint32_t>(rng() % 64)};
+            candidates.resize(rng() % 300);
+            for (auto &candidate : candidates) {
+                candidate = {.priority_bucket = static_cast<uint32_t>(rng() % 8) * 16, .cost = rng() % 2 == 0 ? uint32_t{CHUNK_UPDATE_COST_GENERATE} : uint32_t{CHUNK_UPDATE_COST_EDIT}};
+            }
+            elected.clear();
+            elect_chunk_updates(candidates, limits, elected);
+
+            auto is_elected = std::vector<bool>(candidates.size());
+            auto cost = uint32_t{0};
+            for (uint32_t i = 0; i < elected.size(); ++i) {
+                if (i > 0 && elected[i] <= elected[i - 1]) {
+                    return "the elected candidates aren't in order";
+                }
+                is_elected[elected[i]] = true;
+                cost += candidates[elected[i]].cost;
+            }
+            if (cost > limits.cost_budget || elected.size() > limits.max_update_n) {
+                return fmt::format("elected {} candidates costing {}, over the limits of {} costing {}", elected.size(), cost, limits.max_update_n, limits.cost_budget);
+            }
+            auto lowest_elected_bucket = uint32_t{CHUNK_UPDATE_PRIORITY_BUCKET_N};
+            for (auto const i : elected) {
+                lowest_elected_bucket = std::min(lowest_elected_bucket, candidates[i].priority_bucket);
+            }
+            for (uint32_t i = 0; i < candidates.size(); ++i) {
+                if (!is_elected[i] && candidates[i].priority_bucket > lowest_elected_bucket) {
+                    return fmt::format("a candidate of bucket {} was left out for one of bucket {}", candidates[i].priority_bucket, lowest_elected_bucket);
+                }
+            }
+            if (elected.empty() && !candidates.empty() && limits.cost_budget >= CHUNK_UPDATE_COST_GENERATE) {
+                return "nothing was elected";
+            }
+        }
+        return {};
+    }
+
+    // Flying straight ahead from startup, electing by priority gets the chunks in view generated
+    // sooner than electing whoever comes first.
+    auto test_simulated_flight() -> std::string {
+        auto flight = std::vector<ChunkScheduleFlightFrame>(300);
+        for (uint32_t i = 0; i < flight.size(); ++i) {
+            flight[i] = {
+                .pos = glm::vec3(static_cast<float>(i) * 0.5f, 10.0f, 20.0f),
+                .forward = glm::vec3(1, 0, 0),
+                .tan_half_diagonal_fov = 1.0f,
+                .delta_time = 1.0f / 60.0f,
+                .is_editing = i % 60 < 30,
+            };
+        }
+        auto const first_come = simulate_chunk_update_schedule({.flight = flight, .policy = ChunkSchedulePolicy::FIRST_COME, .limits = {}});
+        auto const priority = simulate_chunk_update_schedule({.flight = flight, .policy = ChunkSchedulePolicy::PRIORITY, .limits = {}});
+        if (priority.time_to_visible_n == 0 || priority.generated_n == 0) {
+            return "nothing came into view or was generated";
+        }
+        if (priority.mean_time_to_visible_ms >= first_come.mean_time_to_visible_ms || priority.mean_stale_in_view_share >= first_come.mean_stale_in_view_share) {
+            return fmt::format("priority took {:.1f} ms to visible with {:.3f} stale, first-come {:.1f} ms with {:.3f}",
+                               priority.mean_time_to_visible_ms, priority.mean_stale_in_view_share, first_come.mean_time_to_visible_ms, first_come.mean_stale_in_view_share);
+        }
+        if (priority.max_wait_frame_n > 2048) {
+            return fmt::format("a request waited {} frames", priority.max_wait_frame_n);
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"priority", test_priority},
+        UnitTestCase{"priority bucket", test_priority_bucket},
+        UnitTestCase{"in view", test_in_view},
+        UnitTestCase{"elect", test_elect},
+        UnitTestCase{"simulated flight", test_simulated_flight},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <voxels/impl/voxel_malloc.inl>
+#include <voxels/impl/palette_codec.hpp>
+#include <utilities/math.hpp>
+
+// Slab allocator for the CPU copies of palette blobs. Every blob whose palette uses the same number
+// of bits per voxel lands in the same size class, so the slot size only depends on the bit width.
+// Palettes with more than PALETTE_MAX_COMPRESSED_VARIANT_N variants are stored raw and get their
+// own class.
+struct PaletteBlobAllocator {
+    static constexpr uint32_t MAX_BITS_PER_VARIANT = ceil_log2(PALETTE_MAX_COMPRESSED_VARIANT_N);
+    static constexpr uint32_t RAW_SIZE_CLASS = MAX_BITS_PER_VARIANT + 1;
+    static constexpr uint32_t SIZE_CLASS_N = RAW_SIZE_CLASS + 1;
+    static constexpr uint32_t SLOTS_PER_PAGE = 64;
+
+    struct SizeClassStats {
+        uint32_t slot_size_u32s;
+        uint32_t page_n;
+        uint32_t live_slot_n;
+        uint32_t free_slot_n;
+    };
+
+    // Exact number of u32s a blob with `variant_n` variants takes up. 0 means the value is stored in
+    // the blob pointer itself.
+    static constexpr auto blob_size(uint32_t variant_n) -> uint32_t {
+        return palette_blob_size(variant_n);
+    }
+    static constexpr auto size_class(uint32_t variant_n) -> uint32_t {
+        if (variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+            return RAW_SIZE_CLASS;
+        }
+        return ceil_log2(variant_n);
+    }
+    static constexpr auto slot_size(uint32_t size_class_index) -> uint32_t {
+        if (size_class_index == RAW_SIZE_CLASS) {
+            return PALETTE_REGION_TOTAL_SIZE;
+        }
+        auto const max_variant_n = std::min(1u << size_class_index, uint32_t(PALETTE_MAX_COMPRESSED_VARIANT_N));
+        return blob_size(max_variant_n);
+    }
+
+    PaletteBlobAllocator() = default;
+    PaletteBlobAllocator(PaletteBlobAllocator const &) = delete;
+    PaletteBlobAllocator(PaletteBlobAllocator &&) noexcept = default;
+    PaletteBlobAllocator &operator=(PaletteBlobAllocator const &) = delete;
+    PaletteBlobAllocator &operator=(PaletteBlobAllocator &&) noexcept = default;
+
+    auto allocate(uint32_t variant_n) -> uint32_t * {
+        if (variant_n < 2) {
+            return nullptr;
+        }
+        auto &size_class_data = size_classes[size_class(variant_n)];
+        if (size_class_data.free_slots.empty()) {
+            auto const slot_u32s = slot_size(size_class(variant_n));
+            auto &page = size_class_data.pages.emplace_back(std::make_unique<uint32_t[]>(size_t{slot_u32s} * SLOTS_PER_PAGE));
+            size_class_data.free_slots.reserve(size_class_data.free_slots.size() + SLOTS_PER_PAGE);
+            // Push in reverse so that slots get handed out front to back.
+            for (uint32_t i = SLOTS_PER_PAGE; i > 0; --i) {
+                size_class_data.free_slots.push_back(page.get() + size_t{slot_u32s} * (i - 1));
+            }
+        }
+        auto *result = size_class_data.free_slots.back();
+        size_class_data.free_slots.pop_back();
+        ++size_class_data.live_slot_n;
+        return result;
+    }
+
+    void deallocate(uint32_t *blob_ptr, uint32_t variant_n) {
+        if (variant_n < 2 || blob_ptr == nullptr) {
+            return;
+        }
+        auto &size_class_data = size_classes[size_class(variant_n)];
+        size_class_data.free_slots.push_back(blob_ptr);
+        --size_class_data.live_slot_n;
+    }
+
+    auto stats(uint32_t size_class_index) const -> SizeClassStats {
+        auto const &size_class_data = size_classes[size_class_index];
+        return {
+            .slot_size_u32s = slot_size(size_class_index),
+            .page_n = static_cast<uint32_t>(size_class_data.pages.size()),
+            .live_slot_n = size_class_data.live_slot_n,
+            .free_slot_n = static_cast<uint32_t>(size_class_data.free_slots.size()),
+        };
+    }
+
+    auto reserved_bytes() const -> size_t {
+        auto result = size_t{0};
+        for (uint32_t i = 1; i < SIZE_CLASS_N; ++i) {
+            result += size_t{slot_size(i)} * SLOTS_PER_PAGE * sizeof(uint32_t) * size_classes[i].pages.size();
+        }
+        return result;
+    }
+
+  private:
+    struct SizeClass {
+        std::vector<std::unique_ptr<uint32_t[]>> pages;
+        std::vector<uint32_t *> free_slots;
+        uint32_t live_slot_n = 0;
+    };
+    std::array<SizeClass, SIZE_CLASS_N> size_classes{};
+};
@@ -0,0 +1,404 @@
+#include "palette_codec.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PALETTE_CODEC_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+// GCC and Clang only allow AVX2 intrinsics in functions built for it. MSVC allows them anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define PALETTE_CODEC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PALETTE_CODEC_TARGET_AVX2
+#endif
+#else
+#define PALETTE_CODEC_X64 0
+#endif
+
+namespace {
+    // The decoders below only handle packed regions, so 1 <= bits_per_variant <= 9. The packed
+    // indices take up exactly 16 * bits_per_variant u32s.
+
+    void decode_indices_scalar(uint32_t const *packed_u32s, uint32_t bits_per_variant, uint16_t *out) {
+        auto const mask = (uint64_t{1} << bits_per_variant) - 1;
+        auto bits = uint64_t{0};
+        auto bit_n = 0u;
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+            if (bit_n < bits_per_variant) {
+                bits |= uint64_t{*packed_u32s++} << bit_n;
+                bit_n += 32;
+            }
+            out[voxel_i] = static_cast<uint16_t>(bits & mask);
+            bits >>= bits_per_variant;
+            bit_n -= bits_per_variant;
+        }
+    }
+
+    void decode_values_scalar(uint32_t const *blob_u32s, uint32_t variant_n, uint32_t *out) {
+        auto indices = PaletteRegionIndices{};
+        decode_indices_scalar(blob_u32s + variant_n, palette_bits_per_variant(variant_n), indices.data());
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+            out[voxel_i] = blob_u32s[indices[voxel_i]];
+        }
+    }
+
+#if PALETTE_CODEC_X64
+    // SSE2 has neither per-lane shifts nor gathers, so it only speeds up the widths that divide a
+    // byte, by splitting bytes in halves until every byte holds one index. The others fall back to
+    // scalar.
+    void decode_indices_sse2(uint32_t const *packed_u32s, uint32_t bits_per_variant, uint16_t *out) {
+        if (bits_per_variant != 1 && bits_per_variant != 2 && bits_per_variant != 4 && bits_per_variant != 8) {
+            decode_indices_scalar(packed_u32s, bits_per_variant, out);
+            return;
+        }
+        auto const zero = _mm_setzero_si128();
+        auto const *packed = reinterpret_cast<__m128i const *>(packed_u32s);
+        auto const packed_vector_n = bits_per_variant * PALETTE_REGION_TOTAL_SIZE / 128;
+        for (uint32_t vector_i = 0; vector_i < packed_vector_n; ++vector_i) {
+            // Each pass doubles the number of vectors, keeping the indices in order.
+            // Not a std::array, as that drops the alignment attribute of __m128i.
+            __m128i bytes[8];
+            auto byte_vector_n = 1u;
+            bytes[0] = _mm_loadu_si128(packed + vector_i);
+            for (auto field_bits = 4u; field_bits >= bits_per_variant; field_bits /= 2) {
+                auto const field_mask = _mm_set1_epi8(static_cast<char>((1 << field_bits) - 1));
+                for (auto i = byte_vector_n; i > 0; --i) {
+                    auto const v = bytes[i - 1];
+                    auto const lo = _mm_and_si128(v, field_mask);
+                    auto const hi = _mm_and_si128(_mm_srli_epi16(v, static_cast<int>(field_bits)), field_mask);
+                    bytes[(i - 1) * 2 + 0] = _mm_unpacklo_epi8(lo, hi);
+                    bytes[(i - 1) * 2 + 1] = _mm_unpackhi_epi8(lo, hi);
+                }
+                byte_vector_n *= 2;
+            }
+            auto *dst = reinterpret_cast<__m128i *>(out) + vector_i * byte_vector_n * 2;
+            for (uint32_t i = 0; i < byte_vector_n; ++i) {
+                _mm_storeu_si128(dst + i * 2 + 0, _mm_unpacklo_epi8(bytes[i], zero));
+                _mm_storeu_si128(dst + i * 2 + 1, _mm_unpackhi_epi8(bytes[i], zero));
+            }
+        }
+    }
+
+    void decode_values_sse2(uint32_t const *blob_u32s, uint32_t variant_n, uint32_t *out) {
+        auto indices = PaletteRegionIndices{};
+        decode_indices_sse2(blob_u32s + variant_n, palette_bits_per_variant(variant_n), indices.data());
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+            out[voxel_i] = blob_u32s[indices[voxel_i]];
+        }
+    }
+
+    struct Avx2Unpacker {
+        __m256i lane_bit_offsets;
+        __m256i mask;
+        __m256i last_word;
+        int const *packed;
+        uint32_t bits_per_variant;
+
+        // The indices of voxels [voxel_i, voxel_i + 8).
+        PALETTE_CODEC_TARGET_AVX2 auto unpack(uint32_t voxel_i) const -> __m256i {
+            auto const bit_offsets = _mm256_add_epi32(lane_bit_offsets, _mm256_set1_epi32(static_cast<int>(voxel_i * bits_per_variant)));
+            auto const words = _mm256_srli_epi32(bit_offsets, 5);
+            auto const shifts = _mm256_and_si256(bit_offsets, _mm256_set1_epi32(31));
+            // Clamped so the last index doesn't read past the blob. An index that doesn't straddle
+            // two u32s only uses bits of `lo`, as the shift by 32 - 0 leaves nothing of `hi`.
+            auto const next_words = _mm256_min_epu32(_mm256_add_epi32(words, _mm256_set1_epi32(1)), last_word);
+            auto const lo = _mm256_i32gather_epi32(packed, words, 4);
+            auto const hi = _mm256_i32gather_epi32(packed, next_words, 4);
+            auto const bits = _mm256_or_si256(_mm256_srlv_epi32(lo, shifts), _mm256_sllv_epi32(hi, _mm256_sub_epi32(_mm256_set1_epi32(32), shifts)));
+            return _mm256_and_si256(bits, mask);
+        }
+    };
+
+    PALETTE_CODEC_TARGET_AVX2 auto make_avx2_unpacker(uint32_t const *packed_u32s, uint32_t bits_per_variant) -> Avx2Unpacker {
+        auto const b = static_cast<int>(bits_per_variant);
+        return {
+            .lane_bit_offsets = _mm256_setr_epi32(0, b, 2 * b, 3 * b, 4 * b, 5 * b, 6 * b, 7 * b),
+            .mask = _mm256_set1_epi32((1 << b) - 1),
+            .last_word = _mm256_set1_epi32(16 * b - 1),
+            .packed = reinterpret_cast<int const *>(packed_u32s),
+            .bits_per_variant = bits_per_variant,
+        };
+    }
+
+    PALETTE_CODEC_TARGET_AVX2 void decode_indices_avx2(uint32_t const *packed_u32s, uint32_t bits_per_variant, uint16_t *out) {
+        auto const unpacker = make_avx2_unpacker(packed_u32s, bits_per_variant);
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; voxel_i += 16) {
+            auto const a = unpacker.unpack(voxel_i + 0);
+            auto const b = unpacker.unpack(voxel_i + 8);
+            // packus interleaves the 128-bit halves of its inputs, the permute puts them back in order.
+            auto const packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0b11011000);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + voxel_i), packed);
+        }
+    }
+
+    PALETTE_CODEC_TARGET_AVX2 void decode_values_avx2(uint32_t const *blob_u32s, uint32_t variant_n, uint32_t *out) {
+        auto const unpacker = make_avx2_unpacker(blob_u32s + variant_n, palette_bits_per_variant(variant_n));
+        auto const *variants = reinterpret_cast<int const *>(blob_u32s);
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; voxel_i += 8) {
+            auto const values = _mm256_i32gather_epi32(variants, unpacker.unpack(voxel_i), 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + voxel_i), values);
+        }
+    }
+
+    auto cpu_supports_avx2() -> bool {
+        auto regs = std::array<uint32_t, 4>{};
+        auto const cpuid = [&regs](uint32_t leaf) {
+#if defined(_MSC_VER)
+            auto int_regs = std::array<int, 4>{};
+            __cpuidex(int_regs.data(), static_cast<int>(leaf), 0);
+            std::copy(int_regs.begin(), int_regs.end(), regs.begin());
+#else
+            __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        };
+        cpuid(0);
+        if (regs[0] < 7) {
+            return false;
+        }
+        cpuid(1);
+        auto const has_osxsave = (regs[2] & (1u << 27)) != 0;
+        auto const has_avx = (regs[2] & (1u << 28)) != 0;
+        if (!has_osxsave || !has_avx) {
+            return false;
+        }
+        // The OS also has to save the YMM registers on context switches.
+#if defined(_MSC_VER) && !defined(__clang__)
+        auto const xcr0 = _xgetbv(0);
+#else
+        uint32_t xcr0_lo = 0;
+        uint32_t xcr0_hi = 0;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        auto const xcr0 = (uint64_t{xcr0_hi} << 32) | xcr0_lo;
+#endif
+        if ((xcr0 & 0x6) != 0x6) {
+            return false;
+        }
+        cpuid(7);
+        return (regs[1] & (1u << 5)) != 0;
+    }
+#endif
+
+    auto detect_palette_decode_isa() -> PaletteDecodeIsa {
+#if PALETTE_CODEC_X64
+        return cpu_supports_avx2() ? PaletteDecodeIsa::AVX2 : PaletteDecodeIsa::SSE2;
+#else
+        return PaletteDecodeIsa::SCALAR;
+#endif
+    }
+
+    auto best_isa() -> PaletteDecodeIsa {
+        static auto const result = detect_palette_decode_isa();
+        return result;
+    }
+    std::atomic<PaletteDecodeIsa> active_isa{best_isa()};
+
+    void decode_packed_indices(uint32_t const *packed_u32s, uint32_t bits_per_variant, uint16_t *out) {
+        switch (active_isa.load(std::memory_order_relaxed)) {
+#if PALETTE_CODEC_X64
+        case PaletteDecodeIsa::AVX2: decode_indices_avx2(packed_u32s, bits_per_variant, out); break;
+        case PaletteDecodeIsa::SSE2: decode_indices_sse2(packed_u32s, bits_per_variant, out); break;
+#endif
+        default: decode_indices_scalar(packed_u32s, bits_per_variant, out); break;
+        }
+    }
+
+    // Sets the bits of the nonzero flags, one per voxel.
+    void pack_voxel_flags(uint8_t const *voxel_flags, PaletteRegionMask &out) {
+#if PALETTE_CODEC_X64
+        auto const zero = _mm_setzero_si128();
+        for (uint32_t word_i = 0; word_i < out.size(); ++word_i) {
+            auto bits = uint64_t{0};
+            for (uint32_t part_i = 0; part_i < 4; ++part_i) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(voxel_flags + word_i * 64 + part_i * 16));
+                auto const is_zero = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+                bits |= uint64_t{~is_zero & 0xffffu} << (part_i * 16);
+            }
+            out[word_i] = bits;
+        }
+#else
+        for (uint32_t word_i = 0; word_i < out.size(); ++word_i) {
+            auto bits = uint64_t{0};
+            for (uint32_t bit_i = 0; bit_i < 64; ++bit_i) {
+                bits |= uint64_t{voxel_flags[word_i * 64 + bit_i] != 0} << bit_i;
+            }
+            out[word_i] = bits;
+        }
+#endif
+    }
+
+    void decode_packed_values(uint32_t const *blob_u32s, uint32_t variant_n, uint32_t *out) {
+        switch (active_isa.load(std::memory_order_relaxed)) {
+#if PALETTE_CODEC_X64
+        case PaletteDecodeIsa::AVX2: decode_values_avx2(blob_u32s, variant_n, out); break;
+        case PaletteDecodeIsa::SSE2: decode_values_sse2(blob_u32s, variant_n, out); break;
+#endif
+        default: decode_values_scalar(blob_u32s, variant_n, out); break;
+        }
+    }
+} // namespace
+
+auto encode_palette_region(std::span<uint32_t const, PALETTE_REGION_TOTAL_SIZE> voxels, std::vector<uint32_t> &blob) -> CpuPaletteChunk {
+    auto variants = std::vector<uint32_t>(voxels.begin(), voxels.end());
+    std::sort(variants.begin(), variants.end());
+    variants.erase(std::unique(variants.begin(), variants.end()), variants.end());
+    auto const variant_n = static_cast<uint32_t>(variants.size());
+
+    blob.assign(palette_blob_size(variant_n), 0u);
+    if (variant_n < 2) {
+        return {.has_air = 0, .variant_n = variant_n, .blob_ptr = std::bit_cast<uint32_t *>(size_t{voxels[0]})};
+    }
+    if (variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+        std::copy(voxels.begin(), voxels.end(), blob.begin());
+        return {.has_air = 0, .variant_n = variant_n, .blob_ptr = blob.data()};
+    }
+
+    std::copy(variants.begin(), variants.end(), blob.begin());
+    auto const bits_per_variant = palette_bits_per_variant(variant_n);
+    auto *packed_u32s = blob.data() + variant_n;
+    for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+        auto const variant_i = static_cast<uint32_t>(std::lower_bound(variants.begin(), variants.end(), voxels[voxel_i]) - variants.begin());
+        auto const bit_index = voxel_i * bits_per_variant;
+        auto const data_index = bit_index / 32;
+        auto const data_offset = bit_index % 32;
+        packed_u32s[data_index] |= variant_i << data_offset;
+        if (data_offset + bits_per_variant > 32) {
+            packed_u32s[data_index + 1] |= variant_i >> (32 - data_offset);
+        }
+    }
+    return {.has_air = 0, .variant_n = variant_n, .blob_ptr = blob.data()};
+}
+
+auto decode_palette_voxel(CpuPaletteChunk const &palette_chunk, uint32_t voxel_index) -> uint32_t {
+    if (palette_chunk.variant_n < 2) {
+        return static_cast<uint32_t>(std::bit_cast<uint64_t>(palette_chunk.blob_ptr));
+    }
+    auto const *blob_u32s = palette_chunk.blob_ptr;
+    if (palette_chunk.variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+        return blob_u32s[voxel_index];
+    }
+    auto const bits_per_variant = palette_bits_per_variant(palette_chunk.variant_n);
+    auto const mask = (~0u) >> (32 - bits_per_variant);
+    auto const bit_index = voxel_index * bits_per_variant;
+    auto const data_index = bit_index / 32;
+    auto const data_offset = bit_index - data_index * 32;
+    auto variant_i = (blob_u32s[palette_chunk.variant_n + data_index + 0] >> data_offset) & mask;
+    if (data_offset + bits_per_variant > 32) {
+        auto const shift = bits_per_variant - ((data_offset + bits_per_variant) & 0x1f);
+        variant_i |= (blob_u32s[palette_chunk.variant_n + data_index + 1] << shift) & mask;
+    }
+    return blob_u32s[variant_i];
+}
+
+auto palette_decode_isa() -> PaletteDecodeIsa {
+    return active_isa.load(std::memory_order_relaxed);
+}
+
+auto best_palette_decode_isa() -> PaletteDecodeIsa {
+    return best_isa();
+}
+
+void set_palette_decode_isa(PaletteDecodeIsa isa) {
+    active_isa.store(std::min(isa, best_isa()), std::memory_order_relaxed);
+}
+
+auto palette_decode_isa_name(PaletteDecodeIsa isa) -> std::string_view {
+    switch (isa) {
+    case PaletteDecodeIsa::SSE2: return "sse2";
+    case PaletteDecodeIsa::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+void decode_palette_region_indices(CpuPaletteChunk const &palette_chunk, std::span<uint16_t, PALETTE_REGION_TOTAL_SIZE> out) {
+    if (palette_chunk.variant_n < 2) {
+        std::fill(out.begin(), out.end(), uint16_t{0});
+    } else if (palette_chunk.variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+        std::iota(out.begin(), out.end(), uint16_t{0});
+    } else {
+        decode_packed_indices(palette_chunk.blob_ptr + palette_chunk.variant_n, palette_bits_per_variant(palette_chunk.variant_n), out.data());
+    }
+}
+
+void decode_palette_region(CpuPaletteChunk const &palette_chunk, std::span<uint32_t, PALETTE_REGION_TOTAL_SIZE> out) {
+    if (palette_chunk.variant_n < 2) {
+        std::fill(out.begin(), out.end(), static_cast<uint32_t>(std::bit_cast<uint64_t>(palette_chunk.blob_ptr)));
+    } else if (palette_chunk.variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+        std::copy(palette_chunk.blob_ptr, palette_chunk.blob_ptr + PALETTE_REGION_TOTAL_SIZE, out.begin());
+    } else {
+        decode_packed_values(palette_chunk.blob_ptr, palette_chunk.variant_n, out.data());
+    }
+}
+
+auto decode_palette_region_mask(CpuPaletteChunk const &palette_chunk, std::span<uint8_t const> flags) -> PaletteRegionMask {
+    auto result = PaletteRegionMask{};
+    auto const set_n = static_cast<size_t>(std::count_if(flags.begin(), flags.end(), [](uint8_t flag) { return flag != 0; }));
+    if (set_n == 0) {
+        return result;
+    }
+    if (set_n == flags.size()) {
+        result.fill(~uint64_t{0});
+        return result;
+    }
+    if (palette_chunk.variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+        pack_voxel_flags(flags.data(), result);
+        return result;
+    }
+    auto indices = PaletteRegionIndices{};
+    decode_palette_region_indices(palette_chunk, indices);
+    auto voxel_flags = std::array<uint8_t, PALETTE_REGION_TOTAL_SIZE>{};
+    for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+        voxel_flags[voxel_i] = flags[indices[voxel_i]];
+    }
+    pack_voxel_flags(voxel_flags.data(), result);
+    return result;
+}
+
+void decode_palette_regions(std::span<CpuPaletteChunk const> palette_chunks, glm::uvec3 region_n, std::span<uint32_t> out) {
+    auto const voxel_n = region_n * uint32_t{PALETTE_REGION_SIZE};
+    auto region_voxels = PaletteRegionVoxels{};
+    for (uint32_t region_zi = 0; region_zi < region_n.z; ++region_zi) {
+        for (uint32_t region_yi = 0; region_yi < region_n.y; ++region_yi) {
+            for (uint32_t region_xi = 0; region_xi < region_n.x; ++region_xi) {
+                auto const region_index = region_xi + region_yi * region_n.x + region_zi * region_n.x * region_n.y;
+                decode_palette_region(palette_chunks[region_index], region_voxels);
+                // Each row of a region is contiguous in the output too.
+                for (uint32_t zi = 0; zi < PALETTE_REGION_SIZE; ++zi) {
+                    for (uint32_t yi = 0; yi < PALETTE_REGION_SIZE; ++yi) {
+                        auto const out_x = region_xi * PALETTE_REGION_SIZE;
+                        auto const out_y = region_yi * PALETTE_REGION_SIZE + yi;
+                        auto const out_z = region_zi * PALETTE_REGION_SIZE + zi;
+                        auto const *src = region_voxels.data() + palette_voxel_index(glm::uvec3{0, yi, zi});
+                        std::copy(src, src + PALETTE_REGION_SIZE, out.begin() + (out_x + out_y * voxel_n.x + out_z * voxel_n.x * voxel_n.y));
+                    }
+                }
+            }
+        }
+    }
+}
+
+auto sample_gvox_palette_voxel(GvoxPaletteModelView const &model, glm::ivec3 voxel_i, uint32_t channel_index) -> uint32_t {
+    if (glm::any(glm::lessThan(voxel_i, glm::ivec3{0})) || glm::any(glm::greaterThanEqual(glm::uvec3{voxel_i}, model.extent))) {
+        return 0;
+    }
+    auto const region_n = (model.extent + uint32_t{PALETTE_REGION_SIZE - 1}) / uint32_t{PALETTE_REGION_SIZE};
+    auto const region_header_n = region_n.x * region_n.y * region_n.z;
+    auto const region_i = glm::uvec3{voxel_i} / uint32_t{PALETTE_REGION_SIZE};
+    auto const in_region_i = glm::uvec3{voxel_i} - region_i * uint32_t{PALETTE_REGION_SIZE};
+    auto const region_index = region_i.x + region_i.y * region_n.x + region_i.z * region_n.x * region_n.y;
+    auto const channel_offset = (region_index * model.channel_n + channel_index) * 2;
+    auto const variant_n = model.data[channel_offset + 0];
+    auto const blob_ptr = model.data[channel_offset + 1];
+    if (variant_n < 2) {
+        return blob_ptr;
+    }
+    auto const *blob_u32s = model.data.data() + 2 * region_header_n * model.channel_n + blob_ptr / 4;
+    auto const palette_chunk = CpuPaletteChunk{.has_air = 0, .variant_n = variant_n, .blob_ptr = const_cast<uint32_t *>(blob_u32s)};
+    return decode_palette_voxel(palette_chunk, palette_voxel_index(in_region_i));
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <voxels/impl/palette_format.inl>
+
+// CPU side of the bit-packed palette format. The blob of a region holds its `variant_n` distinct
+// voxel values, followed by ceil_log2(variant_n) bits per voxel indexing into them, packed from the
+// lowest bit up and allowed to straddle two u32s. Regions with more than
+// PALETTE_MAX_COMPRESSED_VARIANT_N variants store every voxel raw instead, and uniform regions store
+// their one voxel in place of the blob pointer. Doesn't depend on the device or the voxel world, so
+// it's built as its own library.
+
+struct CpuPaletteChunk {
+    uint32_t has_air : 1 {};
+    uint32_t variant_n{};
+    uint32_t *blob_ptr{};
+};
+
+using PaletteRegionVoxels = std::array<uint32_t, PALETTE_REGION_TOTAL_SIZE>;
+using PaletteRegionIndices = std::array<uint16_t, PALETTE_REGION_TOTAL_SIZE>;
+// Bit (voxel index % 64) of u64 (voxel index / 64).
+using PaletteRegionMask = std::array<uint64_t, PALETTE_REGION_TOTAL_SIZE / 64>;
+
+// The instruction sets the region decoders come in. The best one the CPU supports is picked on
+// first use.
+enum struct PaletteDecodeIsa : uint8_t {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+constexpr auto palette_bits_per_variant(uint32_t variant_n) -> uint32_t {
+    return variant_n < 2 ? 0u : std::bit_width(variant_n - 1);
+}
+
+// Exact number of u32s a blob with `variant_n` variants takes up. 0 means the value is stored in the
+// blob pointer itself.
+constexpr auto palette_blob_size(uint32_t variant_n) -> uint32_t {
+    if (variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+        return PALETTE_REGION_TOTAL_SIZE;
+    } else if (variant_n > 1) {
+        return variant_n + (palette_bits_per_variant(variant_n) * PALETTE_REGION_TOTAL_SIZE + 31) / 32;
+    }
+    return 0;
+}
+
+// Index of a voxel within its region, as used by the packed indices.
+constexpr auto palette_voxel_index(glm::uvec3 in_region_i) -> uint32_t {
+    return in_region_i.x + in_region_i.y * PALETTE_REGION_SIZE + in_region_i.z * PALETTE_REGION_SIZE * PALETTE_REGION_SIZE;
+}
+
+// Encodes `voxels` into `blob`, which is resized to palette_blob_size() of the result. The result
+// points into `blob`, or holds the voxel itself if the region is uniform. Variants are sorted by value.
+// `has_air` is left for the caller, since what counts as air isn't the codec's business.
+auto encode_palette_region(std::span<uint32_t const, PALETTE_REGION_TOTAL_SIZE> voxels, std::vector<uint32_t> &blob) -> CpuPaletteChunk;
+
+auto palette_decode_isa() -> PaletteDecodeIsa;
+auto best_palette_decode_isa() -> PaletteDecodeIsa;
+// Clamped to best_palette_decode_isa(). Only meant for comparing the decoders.
+void set_palette_decode_isa(PaletteDecodeIsa isa);
+auto palette_decode_isa_name(PaletteDecodeIsa isa) -> std::string_view;
+
+auto decode_palette_voxel(CpuPaletteChunk const &palette_chunk, uint32_t voxel_index) -> uint32_t;
+// The variant each voxel uses. For raw regions that's the voxel index, and for uniform ones 0.
+void decode_palette_region_indices(CpuPaletteChunk const &palette_chunk, std::span<uint16_t, PALETTE_REGION_TOTAL_SIZE> out);
+// Same result as decode_palette_voxel() for every voxel of the region, in one vectorized pass.
+void decode_palette_region(CpuPaletteChunk const &palette_chunk, std::span<uint32_t, PALETTE_REGION_TOTAL_SIZE> out);
+// Sets the bits of the voxels whose variant has a nonzero flag, with one flag per variant (per
+// voxel for raw regions, one for uniform regions). Doesn't decode anything if all or none of the
+// flags are set.
+auto decode_palette_region_mask(CpuPaletteChunk const &palette_chunk, std::span<uint8_t const> flags) -> PaletteRegionMask;
+// The same, but evaluates `predicate` on every variant to get the flags.
+template <typename Predicate>
+auto decode_palette_region_mask(CpuPaletteChunk const &palette_chunk, Predicate const &predicate) -> PaletteRegionMask {
+    auto flags = std::array<uint8_t, PALETTE_REGION_TOTAL_SIZE>{};
+    if (palette_chunk.variant_n < 2) {
+        flags[0] = predicate(static_cast<uint32_t>(std::bit_cast<uint64_t>(palette_chunk.blob_ptr))) ? 1 : 0;
+        return decode_palette_region_mask(palette_chunk, std::span<uint8_t const>{flags.data(), 1});
+    }
+    auto const flag_n = palette_chunk.variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N ? uint32_t{PALETTE_REGION_TOTAL_SIZE} : palette_chunk.variant_n;
+    for (uint32_t i = 0; i < flag_n; ++i) {
+        flags[i] = predicate(palette_chunk.blob_ptr[i]) ? 1 : 0;
+    }
+    return decode_palette_region_mask(palette_chunk, std::span<uint8_t const>{flags.data(), flag_n});
+}
+// Decodes `region_n` regions (x-major, like the regions of a chunk) into one dense x-major array
+// of region_n * PALETTE_REGION_SIZE voxels per axis.
+void decode_palette_regions(std::span<CpuPaletteChunk const> palette_chunks, glm::uvec3 region_n, std::span<uint32_t> out);
+
+// The data of a "gvox_palette" model: a (variant_n, blob offset in bytes) header per region and
+// channel, regions in x-major order, followed by the blobs.
+struct GvoxPaletteModelView {
+    std::span<uint32_t const> data;
+    glm::uvec3 extent;
+    uint32_t channel_n;
+};
+
+// CPU mirror of sample_gvox_palette_voxel() in gvox_model.glsl. Voxels outside the model are 0.
+auto sample_gvox_palette_voxel(GvoxPaletteModelView const &model, glm::ivec3 voxel_i, uint32_t channel_index) -> uint32_t;
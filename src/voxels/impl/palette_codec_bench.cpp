@@ -0,0 +1,68 @@
+#include <voxels/impl/palette_codec.hpp>
+#include <voxels/impl/palette_codec_test_helpers.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <chrono>
+
+// Decode throughput of decode_palette_voxel(), decode_palette_region() and
+// decode_palette_region_mask(), per bit width and supported instruction set.
+// Usage: gvox_engine_palette_codec_bench [region count per width]
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Decoded voxels are summed into this, so that the loops can't be optimized out.
+    uint32_t volatile benchmark_sink = 0;
+} // namespace
+
+auto main(int argc, char const *argv[]) -> int {
+    auto const region_n = benchmark_count_arg(std::span{argv, static_cast<size_t>(argc)}, 4096);
+    auto const voxel_n = static_cast<double>(region_n) * PALETTE_REGION_TOTAL_SIZE;
+    auto const ns_per_voxel = [voxel_n](Clock::time_point t0, Clock::time_point t1) {
+        return std::chrono::duration<double, std::nano>(t1 - t0).count() / voxel_n;
+    };
+    // Half of the variants are solid, so the mask can't take its shortcut.
+    auto const is_solid = [](uint32_t voxel) { return (voxel & 1) != 0; };
+
+    fmt::print("Palette decode of {} regions per width, in ns per voxel (best instruction set: {}):\n", region_n, palette_decode_isa_name(best_palette_decode_isa()));
+    fmt::print("{:>5} {:>9} {:>7} {:>8} {:>8} {:>8} {:>8}\n", "bits", "variants", "isa", "voxel", "region", "speedup", "mask");
+    auto rng = std::mt19937{0};
+    auto decoded = PaletteRegionVoxels{};
+    auto checksum = uint32_t{0};
+    for (uint32_t bits_per_variant = 1; bits_per_variant <= PALETTE_MAX_BITS_PER_VARIANT + 1; ++bits_per_variant) {
+        auto const is_raw = bits_per_variant > PALETTE_MAX_BITS_PER_VARIANT;
+        auto const variant_n = palette_variant_n_range(is_raw ? 0 : bits_per_variant).second;
+        auto regions = std::vector<EncodedPaletteRegion>{};
+        regions.reserve(region_n);
+        for (uint32_t region_i = 0; region_i < region_n; ++region_i) {
+            regions.push_back(make_encoded_palette_region(random_palette_region(rng, variant_n)));
+        }
+
+        auto const t0 = Clock::now();
+        for (auto const &region : regions) {
+            for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+                checksum += decode_palette_voxel(region.palette_chunk, voxel_i);
+            }
+        }
+        auto const voxel_decode_ns = ns_per_voxel(t0, Clock::now());
+
+        for (auto isa = PaletteDecodeIsa::SCALAR; isa <= best_palette_decode_isa(); isa = next_palette_decode_isa(isa)) {
+            set_palette_decode_isa(isa);
+            auto const t1 = Clock::now();
+            for (auto const &region : regions) {
+                decode_palette_region(region.palette_chunk, decoded);
+                checksum += decoded[region.palette_chunk.variant_n % PALETTE_REGION_TOTAL_SIZE];
+            }
+            auto const t2 = Clock::now();
+            for (auto const &region : regions) {
+                checksum += static_cast<uint32_t>(decode_palette_region_mask(region.palette_chunk, is_solid)[0]);
+            }
+            auto const t3 = Clock::now();
+            auto const region_decode_ns = ns_per_voxel(t1, t2);
+            fmt::print("{:>5} {:>9} {:>7} {:>8.2f} {:>8.2f} {:>7.2f}x {:>8.2f}\n", is_raw ? 32u : bits_per_variant, variant_n, palette_decode_isa_name(isa),
+                       voxel_decode_ns, region_decode_ns, voxel_decode_ns / region_decode_ns, ns_per_voxel(t2, t3));
+        }
+    }
+    benchmark_sink = checksum;
+    return 0;
+}
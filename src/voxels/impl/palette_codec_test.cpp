@@ -0,0 +1,204 @@
+#include <voxels/impl/palette_codec.hpp>
+#include <voxels/impl/palette_codec_test_helpers.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <array>
+
+namespace {
+    // Regions per bit width and instruction set, on top of the smallest and largest variant count
+    // of each width.
+    constexpr uint32_t RANDOM_REGION_N = 64;
+    constexpr auto SEEDS = std::array{0u, 1u, 2u, 3u};
+
+    // Runs `check` once per instruction set the CPU supports, and puts the one that was active back.
+    template <typename Check>
+    auto for_each_decode_isa(Check const &check) -> std::string {
+        auto const previous_isa = palette_decode_isa();
+        auto result = std::string{};
+        for (auto isa = PaletteDecodeIsa::SCALAR; isa <= best_palette_decode_isa() && result.empty(); isa = next_palette_decode_isa(isa)) {
+            set_palette_decode_isa(isa);
+            result = check();
+            if (!result.empty()) {
+                result = fmt::format("{} ({})", result, palette_decode_isa_name(isa));
+            }
+        }
+        set_palette_decode_isa(previous_isa);
+        return result;
+    }
+
+    // Every decoder has to give back the voxels that were encoded.
+    auto check_region(PaletteRegionVoxels const &voxels, uint32_t variant_n) -> std::string {
+        auto const encoded = make_encoded_palette_region(voxels);
+        if (encoded.palette_chunk.variant_n != variant_n) {
+            return fmt::format("encoded {} variants as {}", variant_n, encoded.palette_chunk.variant_n);
+        }
+        if (encoded.blob.size() != palette_blob_size(variant_n)) {
+            return fmt::format("blob of {} variants is {} u32s, expected {}", variant_n, encoded.blob.size(), palette_blob_size(variant_n));
+        }
+        if (variant_n >= 2 && variant_n <= PALETTE_MAX_COMPRESSED_VARIANT_N && !std::is_sorted(encoded.blob.begin(), encoded.blob.begin() + variant_n)) {
+            return fmt::format("the {} variants aren't sorted", variant_n);
+        }
+        auto decoded = PaletteRegionVoxels{};
+        decode_palette_region(encoded.palette_chunk, decoded);
+        auto indices = PaletteRegionIndices{};
+        decode_palette_region_indices(encoded.palette_chunk, indices);
+        // Bit 0 is as good a voxel property as any.
+        auto const mask = decode_palette_region_mask(encoded.palette_chunk, [](uint32_t voxel) { return (voxel & 1) != 0; });
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+            auto const expected = voxels[voxel_i];
+            auto const single = decode_palette_voxel(encoded.palette_chunk, voxel_i);
+            if (single != expected || decoded[voxel_i] != expected) {
+                return fmt::format("{} variants, voxel {}: expected {:#x}, decoded {:#x} (voxel) and {:#x} (region)", variant_n, voxel_i, expected, single, decoded[voxel_i]);
+            }
+            auto const from_index = variant_n < 2 ? (indices[voxel_i] == 0 ? expected : ~expected) : encoded.blob[indices[voxel_i]];
+            if (from_index != expected) {
+                return fmt::format("{} variants, voxel {}: decoded index {} refers to {:#x}, expected {:#x}", variant_n, voxel_i, indices[voxel_i], from_index, expected);
+            }
+            if (((mask[voxel_i / 64] >> (voxel_i % 64)) & 1) != (expected & 1)) {
+                return fmt::format("{} variants, voxel {}: mask bit doesn't match {:#x}", variant_n, voxel_i, expected);
+            }
+        }
+        return {};
+    }
+
+    auto test_round_trip() -> std::string {
+        return for_each_decode_isa([] {
+            for (auto const seed : SEEDS) {
+                auto rng = std::mt19937{seed};
+                if (auto error = check_region(random_palette_region(rng, 1), 1); !error.empty()) {
+                    return error;
+                }
+                for (uint32_t bits_per_variant = 0; bits_per_variant <= PALETTE_MAX_BITS_PER_VARIANT; ++bits_per_variant) {
+                    auto const [min_variant_n, max_variant_n] = palette_variant_n_range(bits_per_variant);
+                    auto pick_variant_n = std::uniform_int_distribution<uint32_t>{min_variant_n, max_variant_n};
+                    for (uint32_t region_i = 0; region_i < RANDOM_REGION_N + 2; ++region_i) {
+                        auto const variant_n = region_i == 0 ? min_variant_n : region_i == 1 ? max_variant_n : pick_variant_n(rng);
+                        if (auto error = check_region(random_palette_region(rng, variant_n), variant_n); !error.empty()) {
+                            return fmt::format("{} (seed {})", error, seed);
+                        }
+                    }
+                }
+            }
+            return std::string{};
+        });
+    }
+
+    // Masks where every flag or none is set take a shortcut that doesn't decode anything.
+    auto test_mask_shortcuts() -> std::string {
+        auto rng = std::mt19937{0};
+        for (auto const variant_n : {1u, 7u, 300u, 600u}) {
+            auto const encoded = make_encoded_palette_region(random_palette_region(rng, variant_n));
+            auto const all = decode_palette_region_mask(encoded.palette_chunk, [](uint32_t) { return true; });
+            auto const none = decode_palette_region_mask(encoded.palette_chunk, [](uint32_t) { return false; });
+            if (!std::all_of(all.begin(), all.end(), [](uint64_t bits) { return bits == ~uint64_t{0}; })) {
+                return fmt::format("{} variants: not every bit is set when every variant is", variant_n);
+            }
+            if (!std::all_of(none.begin(), none.end(), [](uint64_t bits) { return bits == 0; })) {
+                return fmt::format("{} variants: bits are set when no variant is", variant_n);
+            }
+        }
+        return {};
+    }
+
+    // Two by two by one regions, with every kind of region in them.
+    auto test_decode_regions() -> std::string {
+        return for_each_decode_isa([] {
+            constexpr auto region_n = glm::uvec3{2, 2, 1};
+            constexpr auto voxel_n = region_n * uint32_t{PALETTE_REGION_SIZE};
+            auto rng = std::mt19937{0};
+            auto regions = std::vector<EncodedPaletteRegion>{};
+            auto region_voxels = std::vector<PaletteRegionVoxels>{};
+            auto palette_chunks = std::vector<CpuPaletteChunk>{};
+            for (auto const variant_n : {1u, 3u, 40u, 400u}) {
+                region_voxels.push_back(random_palette_region(rng, variant_n));
+                regions.push_back(make_encoded_palette_region(region_voxels.back()));
+                palette_chunks.push_back(regions.back().palette_chunk);
+            }
+            auto out = std::vector<uint32_t>(size_t{voxel_n.x} * voxel_n.y * voxel_n.z);
+            decode_palette_regions(palette_chunks, region_n, out);
+            for (uint32_t zi = 0; zi < voxel_n.z; ++zi) {
+                for (uint32_t yi = 0; yi < voxel_n.y; ++yi) {
+                    for (uint32_t xi = 0; xi < voxel_n.x; ++xi) {
+                        auto const voxel_i = glm::uvec3{xi, yi, zi};
+                        auto const region_i = voxel_i / uint32_t{PALETTE_REGION_SIZE};
+                        auto const expected = region_voxels[region_i.x + region_i.y * region_n.x][palette_voxel_index(voxel_i % uint32_t{PALETTE_REGION_SIZE})];
+                        auto const decoded = out[xi + yi * voxel_n.x + zi * voxel_n.x * voxel_n.y];
+                        if (decoded != expected) {
+                            return fmt::format("voxel ({}, {}, {}): expected {:#x}, decoded {:#x}", xi, yi, zi, expected, decoded);
+                        }
+                    }
+                }
+            }
+            return std::string{};
+        });
+    }
+
+    // Two regions side by side, the second one cut off, with one uniform and one packed channel,
+    // laid out the way the gvox "gvox_palette" format has them.
+    auto test_gvox_palette_model() -> std::string {
+        constexpr auto extent = glm::uvec3{PALETTE_REGION_SIZE + 5, PALETTE_REGION_SIZE, PALETTE_REGION_SIZE};
+        constexpr uint32_t region_n = 2;
+        constexpr uint32_t channel_n = 2;
+        auto rng = std::mt19937{0};
+        auto data = std::vector<uint32_t>(size_t{2} * region_n * channel_n);
+        auto region_voxels = std::array<std::array<PaletteRegionVoxels, channel_n>, region_n>{};
+        for (uint32_t region_i = 0; region_i < region_n; ++region_i) {
+            for (uint32_t channel_i = 0; channel_i < channel_n; ++channel_i) {
+                auto &voxels = region_voxels[region_i][channel_i];
+                voxels = random_palette_region(rng, channel_i == 0 ? 1 : 5 + region_i * 100);
+                auto const encoded = make_encoded_palette_region(voxels);
+                auto const header_i = (region_i * channel_n + channel_i) * 2;
+                data[header_i + 0] = encoded.palette_chunk.variant_n;
+                if (encoded.blob.empty()) {
+                    data[header_i + 1] = voxels[0];
+                } else {
+                    data[header_i + 1] = static_cast<uint32_t>((data.size() - size_t{2} * region_n * channel_n) * sizeof(uint32_t));
+                    data.insert(data.end(), encoded.blob.begin(), encoded.blob.end());
+                }
+            }
+        }
+        auto const model = GvoxPaletteModelView{.data = data, .extent = extent, .channel_n = channel_n};
+        for (int32_t zi = -1; zi <= static_cast<int32_t>(extent.z); ++zi) {
+            for (int32_t yi = -1; yi <= static_cast<int32_t>(extent.y); ++yi) {
+                for (int32_t xi = -1; xi <= static_cast<int32_t>(extent.x); ++xi) {
+                    auto const voxel_i = glm::ivec3{xi, yi, zi};
+                    auto const in_model = glm::all(glm::greaterThanEqual(voxel_i, glm::ivec3{0})) && glm::all(glm::lessThan(voxel_i, glm::ivec3{extent}));
+                    for (uint32_t channel_i = 0; channel_i < channel_n; ++channel_i) {
+                        auto expected = 0u;
+                        if (in_model) {
+                            auto const region_i = static_cast<uint32_t>(xi) / PALETTE_REGION_SIZE;
+                            expected = region_voxels[region_i][channel_i][palette_voxel_index(glm::uvec3{voxel_i} % uint32_t{PALETTE_REGION_SIZE})];
+                        }
+                        auto const sampled = sample_gvox_palette_voxel(model, voxel_i, channel_i);
+                        if (sampled != expected) {
+                            return fmt::format("voxel ({}, {}, {}) channel {}: expected {:#x}, sampled {:#x}", xi, yi, zi, channel_i, expected, sampled);
+                        }
+                    }
+                }
+            }
+        }
+        return {};
+    }
+
+    auto test_decode_isa_clamped() -> std::string {
+        auto const previous_isa = palette_decode_isa();
+        set_palette_decode_isa(PaletteDecodeIsa::AVX2);
+        auto const isa = palette_decode_isa();
+        set_palette_decode_isa(previous_isa);
+        if (isa != best_palette_decode_isa()) {
+            return fmt::format("asked for avx2 and got {}, but the best the CPU supports is {}", palette_decode_isa_name(isa), palette_decode_isa_name(best_palette_decode_isa()));
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"round trip of every bit width", test_round_trip},
+        UnitTestCase{"region mask shortcuts", test_mask_shortcuts},
+        UnitTestCase{"decode of several regions", test_decode_regions},
+        UnitTestCase{"gvox palette model sampling", test_gvox_palette_model},
+        UnitTestCase{"decode isa clamped to the CPU", test_decode_isa_clamped},
+    };
+    return run_unit_tests(cases);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <voxels/impl/palette_codec.hpp>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Random regions for palette_codec_test.cpp and palette_codec_bench.cpp.
+
+struct EncodedPaletteRegion {
+    CpuPaletteChunk palette_chunk;
+    std::vector<uint32_t> blob;
+};
+
+inline auto make_encoded_palette_region(PaletteRegionVoxels const &voxels) -> EncodedPaletteRegion {
+    auto result = EncodedPaletteRegion{};
+    result.palette_chunk = encode_palette_region(voxels, result.blob);
+    // Moving a vector keeps its buffer, so blob_ptr stays valid when this is moved around.
+    return result;
+}
+
+// A region using exactly `variant_n` distinct voxels, each at least once.
+inline auto random_palette_region(std::mt19937 &rng, uint32_t variant_n) -> PaletteRegionVoxels {
+    auto variants = std::vector<uint32_t>{};
+    variants.reserve(variant_n);
+    while (variants.size() < variant_n) {
+        auto const value = static_cast<uint32_t>(rng());
+        if (std::find(variants.begin(), variants.end(), value) == variants.end()) {
+            variants.push_back(value);
+        }
+    }
+    auto result = PaletteRegionVoxels{};
+    auto pick = std::uniform_int_distribution<uint32_t>{0, variant_n - 1};
+    for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+        result[voxel_i] = voxel_i < variant_n ? variants[voxel_i] : variants[pick(rng)];
+    }
+    std::shuffle(result.begin(), result.end(), rng);
+    return result;
+}
+
+constexpr uint32_t PALETTE_MAX_BITS_PER_VARIANT = palette_bits_per_variant(PALETTE_MAX_COMPRESSED_VARIANT_N);
+
+// The smallest and largest variant count of each bit width, and of raw regions for 0.
+inline auto palette_variant_n_range(uint32_t bits_per_variant) -> std::pair<uint32_t, uint32_t> {
+    if (bits_per_variant == 0) {
+        return {PALETTE_MAX_COMPRESSED_VARIANT_N + 1, PALETTE_REGION_TOTAL_SIZE};
+    }
+    return {(1u << (bits_per_variant - 1)) + 1, std::min(1u << bits_per_variant, uint32_t{PALETTE_MAX_COMPRESSED_VARIANT_N})};
+}
+
+inline auto next_palette_decode_isa(PaletteDecodeIsa isa) -> PaletteDecodeIsa {
+    return static_cast<PaletteDecodeIsa>(static_cast<uint32_t>(isa) + 1);
+}
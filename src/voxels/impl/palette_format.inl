@@ -0,0 +1,12 @@
+#pragma once
+
+// Layout of a palette region. Shared by the voxel world, gvox palette models and the CPU palette
+// codec, so it must not include anything.
+
+#define PALETTE_REGION_SIZE 8
+#define PALETTE_REGION_TOTAL_SIZE (PALETTE_REGION_SIZE * PALETTE_REGION_SIZE * PALETTE_REGION_SIZE)
+#define PALETTE_MAX_COMPRESSED_VARIANT_N 367
+
+#if PALETTE_REGION_SIZE != 8
+#error Unsupported Palette Region Size
+#endif
@@ -24,6 +24,12 @@ void main() {
 
     deref(ptrs.globals).chunk_update_n = 0;
     deref(ptrs.globals).chunk_update_heap_alloc_n = 0;
+    for (uint i = 0; i < CHUNK_UPDATE_PRIORITY_BUCKET_N; ++i) {
+        deref(ptrs.globals).update_request_costs[i] = 0;
+        deref(ptrs.globals).update_request_ns[i] = 0;
+    }
+    deref(ptrs.globals).cutoff_bucket_cost = 0;
+    deref(ptrs.globals).cutoff_bucket_n = 0;
 
     deref(ptrs.globals).prev_offset = deref(ptrs.globals).offset;
     deref(ptrs.globals).offset = deref(gpu_input).player.player_unit_offset;
@@ -2,6 +2,7 @@
 
 #include <core.inl>
 #include <utilities/allocator.inl>
+#include <voxels/impl/palette_format.inl>
 
 #define CHUNK_SIZE 64 // A chunk = 64^3 voxels
 #define CHUNKS_PER_AXIS 32
@@ -20,14 +21,6 @@
 #error "this is not currently supported"
 #endif
 
-#define PALETTE_REGION_SIZE 8
-#define PALETTE_REGION_TOTAL_SIZE (PALETTE_REGION_SIZE * PALETTE_REGION_SIZE * PALETTE_REGION_SIZE)
-#define PALETTE_MAX_COMPRESSED_VARIANT_N 367
-
-#if PALETTE_REGION_SIZE != 8
-#error Unsupported Palette Region Size
-#endif
-
 #define PALETTES_PER_CHUNK_AXIS (CHUNK_SIZE / PALETTE_REGION_SIZE)
 #define PALETTES_PER_CHUNK (PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS)
 
@@ -0,0 +1,381 @@
+#include "voxel_occupancy.hpp"
+#include "voxel_world.inl"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <span>
+
+namespace {
+    using RegionBits = std::array<uint64_t, PALETTE_REGION_SIZE>;
+
+    auto voxel_is_solid(uint32_t packed_voxel_data) -> bool {
+        auto material_type = (packed_voxel_data >> 0) & 3;
+        return material_type != 0;
+    }
+
+    auto test_bit(std::span<uint64_t const> bits, uint32_t i) -> bool {
+        return ((bits[i / 64] >> (i % 64)) & 1) != 0;
+    }
+
+    auto region_index(glm::ivec3 region_i) -> uint32_t {
+        return static_cast<uint32_t>(region_i.x + region_i.y * PALETTES_PER_CHUNK_AXIS + region_i.z * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS);
+    }
+
+    auto chunk_shift_of(daxa_i32vec3 player_unit_offset) -> glm::ivec3 {
+        return std::bit_cast<glm::ivec3>(player_unit_offset) >> glm::ivec3(6 + LOG2_VOXEL_SIZE);
+    }
+
+    auto in_grid(glm::ivec3 voxel_i) -> bool {
+        return glm::all(glm::greaterThanEqual(voxel_i, glm::ivec3(0))) && glm::all(glm::lessThan(voxel_i, glm::ivec3(VoxelOccupancy::GRID_VOXEL_N)));
+    }
+
+    auto decode_region_bits(CpuPaletteChunk const &palette_chunk) -> RegionBits {
+        return decode_palette_region_mask(palette_chunk, voxel_is_solid);
+    }
+
+    // Whether any voxel in the inclusive in-chunk box is solid.
+    auto chunk_overlaps(VoxelOccupancyChunk const &chunk, glm::ivec3 lo, glm::ivec3 hi) -> bool {
+        auto const region_lo = lo / PALETTE_REGION_SIZE;
+        auto const region_hi = hi / PALETTE_REGION_SIZE;
+        for (int32_t rzi = region_lo.z; rzi <= region_hi.z; ++rzi) {
+            for (int32_t ryi = region_lo.y; ryi <= region_hi.y; ++ryi) {
+                for (int32_t rxi = region_lo.x; rxi <= region_hi.x; ++rxi) {
+                    auto const region_i = glm::ivec3(rxi, ryi, rzi);
+                    auto const index = region_index(region_i);
+                    if (!test_bit(chunk.region_nonempty, index)) {
+                        continue;
+                    }
+                    if (test_bit(chunk.region_full, index)) {
+                        return true;
+                    }
+                    auto const region_min = region_i * PALETTE_REGION_SIZE;
+                    auto const in_lo = glm::max(lo, region_min) - region_min;
+                    auto const in_hi = glm::min(hi, region_min + (PALETTE_REGION_SIZE - 1)) - region_min;
+                    auto const row_mask = ((uint64_t{1} << (in_hi.x - in_lo.x + 1)) - 1) << in_lo.x;
+                    auto slice_mask = uint64_t{0};
+                    for (int32_t yi = in_lo.y; yi <= in_hi.y; ++yi) {
+                        slice_mask |= row_mask << (yi * PALETTE_REGION_SIZE);
+                    }
+                    auto const &bits = chunk.region_bits[chunk.region_bits_index[index]];
+                    for (int32_t zi = in_lo.z; zi <= in_hi.z; ++zi) {
+                        if ((bits[static_cast<size_t>(zi)] & slice_mask) != 0) {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+} // namespace
+
+void VoxelOccupancy::init(size_t chunk_n) {
+    chunks.clear();
+    chunks.resize(chunk_n);
+    chunk_nonempty.assign((chunk_n + 63) / 64, 0);
+}
+
+void VoxelOccupancy::update_chunk(uint32_t chunk_index, CpuVoxelChunk const &voxel_chunk) {
+    auto &chunk_ptr = chunks[chunk_index];
+    if (!chunk_ptr) {
+        chunk_ptr = std::make_unique<VoxelOccupancyChunk>();
+    }
+    auto &chunk = *chunk_ptr;
+    chunk.region_nonempty = {};
+    chunk.region_full = {};
+    chunk.region_bits.clear();
+
+    for (uint32_t palette_region_i = 0; palette_region_i < PALETTES_PER_CHUNK; ++palette_region_i) {
+        auto const &palette_chunk = voxel_chunk.palette_chunks[palette_region_i];
+        auto const region_bit = uint64_t{1} << (palette_region_i % 64);
+        chunk.region_bits_index[palette_region_i] = VoxelOccupancyChunk::NO_REGION_BITS;
+
+        if (palette_chunk.variant_n < 2) {
+            if (voxel_is_solid(static_cast<uint32_t>(std::bit_cast<uint64_t>(palette_chunk.blob_ptr)))) {
+                chunk.region_nonempty[palette_region_i / 64] |= region_bit;
+                chunk.region_full[palette_region_i / 64] |= region_bit;
+            }
+            continue;
+        }
+        if (!palette_chunk.has_air) {
+            chunk.region_nonempty[palette_region_i / 64] |= region_bit;
+            chunk.region_full[palette_region_i / 64] |= region_bit;
+            continue;
+        }
+        auto bits = decode_region_bits(palette_chunk);
+        auto any_bits = uint64_t{0};
+        for (auto slice : bits) {
+            any_bits |= slice;
+        }
+        if (any_bits == 0) {
+            continue;
+        }
+        chunk.region_nonempty[palette_region_i / 64] |= region_bit;
+        chunk.region_bits_index[palette_region_i] = static_cast<uint16_t>(chunk.region_bits.size());
+        chunk.region_bits.push_back(bits);
+    }
+
+    auto const chunk_bit = uint64_t{1} << (chunk_index % 64);
+    auto const is_empty = std::all_of(chunk.region_nonempty.begin(), chunk.region_nonempty.end(), [](uint64_t x) { return x == 0; });
+    if (is_empty) {
+        chunk_ptr.reset();
+        chunk_nonempty[chunk_index / 64] &= ~chunk_bit;
+    } else {
+        chunk_nonempty[chunk_index / 64] |= chunk_bit;
+    }
+}
+
+auto VoxelOccupancy::world_to_voxel(daxa_f32vec3 pos, daxa_i32vec3 player_unit_offset) -> glm::vec3 {
+    glm::vec3 offset = glm::vec3(std::bit_cast<glm::ivec3>(player_unit_offset) & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)) + glm::vec3(CHUNKS_PER_AXIS) * CHUNK_WORLDSPACE_SIZE * 0.5f;
+    return (std::bit_cast<glm::vec3>(pos) + offset) * float(VOXEL_SCL);
+}
+
+auto VoxelOccupancy::voxel_to_world(glm::vec3 voxel_pos, daxa_i32vec3 player_unit_offset) -> daxa_f32vec3 {
+    glm::vec3 offset = glm::vec3(std::bit_cast<glm::ivec3>(player_unit_offset) & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)) + glm::vec3(CHUNKS_PER_AXIS) * CHUNK_WORLDSPACE_SIZE * 0.5f;
+    return std::bit_cast<daxa_f32vec3>(voxel_pos / float(VOXEL_SCL) - offset);
+}
+
+auto VoxelOccupancy::chunk_at(glm::ivec3 chunk_i, glm::ivec3 chunk_shift) const -> VoxelOccupancyChunk const * {
+    // Wraps around like calc_chunk_index in voxel_world.cpp.
+    auto const wrapped_i = (chunk_i + chunk_shift) & (CHUNKS_PER_AXIS - 1);
+    auto const chunk_index = static_cast<uint32_t>(wrapped_i.x + wrapped_i.y * CHUNKS_PER_AXIS + wrapped_i.z * CHUNKS_PER_AXIS * CHUNKS_PER_AXIS);
+    if (chunk_index >= chunks.size() || !test_bit(chunk_nonempty, chunk_index)) {
+        return nullptr;
+    }
+    return chunks[chunk_index].get();
+}
+
+auto VoxelOccupancy::is_solid(glm::ivec3 voxel_i, daxa_i32vec3 player_unit_offset) const -> bool {
+    if (!in_grid(voxel_i)) {
+        return false;
+    }
+    auto const *chunk = chunk_at(voxel_i / CHUNK_SIZE, chunk_shift_of(player_unit_offset));
+    if (chunk == nullptr) {
+        return false;
+    }
+    auto const inchunk_i = voxel_i & (CHUNK_SIZE - 1);
+    auto const index = region_index(inchunk_i / PALETTE_REGION_SIZE);
+    if (!test_bit(chunk->region_nonempty, index)) {
+        return false;
+    }
+    if (test_bit(chunk->region_full, index)) {
+        return true;
+    }
+    auto const inregion_i = inchunk_i & (PALETTE_REGION_SIZE - 1);
+    auto const slice = chunk->region_bits[chunk->region_bits_index[index]][static_cast<size_t>(inregion_i.z)];
+    return ((slice >> (inregion_i.x + inregion_i.y * PALETTE_REGION_SIZE)) & 1) != 0;
+}
+
+auto VoxelOccupancy::overlaps(glm::ivec3 voxel_min, glm::ivec3 voxel_max, daxa_i32vec3 player_unit_offset) const -> bool {
+    auto const lo = glm::max(voxel_min, glm::ivec3(0));
+    auto const hi = glm::min(voxel_max, glm::ivec3(GRID_VOXEL_N - 1));
+    if (glm::any(glm::greaterThan(lo, hi))) {
+        return false;
+    }
+    auto const chunk_shift = chunk_shift_of(player_unit_offset);
+    auto const chunk_lo = lo / CHUNK_SIZE;
+    auto const chunk_hi = hi / CHUNK_SIZE;
+    for (int32_t czi = chunk_lo.z; czi <= chunk_hi.z; ++czi) {
+        for (int32_t cyi = chunk_lo.y; cyi <= chunk_hi.y; ++cyi) {
+            for (int32_t cxi = chunk_lo.x; cxi <= chunk_hi.x; ++cxi) {
+                auto const chunk_i = glm::ivec3(cxi, cyi, czi);
+                auto const *chunk = chunk_at(chunk_i, chunk_shift);
+                if (chunk == nullptr) {
+                    continue;
+                }
+                auto const chunk_min = chunk_i * CHUNK_SIZE;
+                auto const in_lo = glm::max(lo, chunk_min) - chunk_min;
+                auto const in_hi = glm::min(hi, chunk_min + (CHUNK_SIZE - 1)) - chunk_min;
+                if (chunk_overlaps(*chunk, in_lo, in_hi)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+auto VoxelOccupancy::raycast(daxa_f32vec3 origin, daxa_f32vec3 direction, float max_distance, daxa_i32vec3 player_unit_offset) const -> VoxelRayHit {
+    auto dir = std::bit_cast<glm::vec3>(direction);
+    auto const dir_length = glm::length(dir);
+    if (!(dir_length > 0.0f)) {
+        return {};
+    }
+    dir = dir / dir_length;
+    auto const ray_origin = world_to_voxel(origin, player_unit_offset);
+    constexpr auto INF = std::numeric_limits<float>::infinity();
+    auto inv_dir = glm::vec3(INF);
+    for (int32_t axis = 0; axis < 3; ++axis) {
+        if (dir[axis] != 0.0f) {
+            inv_dir[axis] = 1.0f / dir[axis];
+        }
+    }
+
+    // Clip the ray to the loaded voxels, so the traversal starts inside of them.
+    auto t = 0.0f;
+    auto t_max = max_distance * float(VOXEL_SCL);
+    auto normal = glm::ivec3(0);
+    for (int32_t axis = 0; axis < 3; ++axis) {
+        if (dir[axis] == 0.0f) {
+            if (ray_origin[axis] < 0.0f || ray_origin[axis] >= float(GRID_VOXEL_N)) {
+                return {};
+            }
+            continue;
+        }
+        auto t0 = (0.0f - ray_origin[axis]) * inv_dir[axis];
+        auto t1 = (float(GRID_VOXEL_N) - ray_origin[axis]) * inv_dir[axis];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        if (t0 > t) {
+            t = t0;
+            normal = glm::ivec3(0);
+            normal[axis] = dir[axis] > 0.0f ? -1 : 1;
+        }
+        t_max = std::min(t_max, t1);
+    }
+    if (t > t_max) {
+        return {};
+    }
+
+    auto const chunk_shift = chunk_shift_of(player_unit_offset);
+    auto voxel_i = glm::clamp(glm::ivec3(glm::floor(ray_origin + dir * t)), glm::ivec3(0), glm::ivec3(GRID_VOXEL_N - 1));
+    if (normal != glm::ivec3(0)) {
+        // Entering through a face of the grid puts the ray on the boundary, where rounding can pick
+        // either side of it.
+        for (int32_t axis = 0; axis < 3; ++axis) {
+            if (normal[axis] != 0) {
+                voxel_i[axis] = normal[axis] < 0 ? 0 : GRID_VOXEL_N - 1;
+            }
+        }
+    }
+
+    while (t <= t_max) {
+        // Size of the empty cell (a chunk, a palette region or a voxel) around voxel_i. 0 means the
+        // voxel is solid.
+        auto cell_size = int32_t{1};
+        auto const *chunk = chunk_at(voxel_i / CHUNK_SIZE, chunk_shift);
+        if (chunk == nullptr) {
+            cell_size = CHUNK_SIZE;
+        } else {
+            auto const inchunk_i = voxel_i & (CHUNK_SIZE - 1);
+            auto const index = region_index(inchunk_i / PALETTE_REGION_SIZE);
+            if (!test_bit(chunk->region_nonempty, index)) {
+                cell_size = PALETTE_REGION_SIZE;
+            } else if (test_bit(chunk->region_full, index)) {
+                cell_size = 0;
+            } else {
+                auto const inregion_i = inchunk_i & (PALETTE_REGION_SIZE - 1);
+                auto const slice = chunk->region_bits[chunk->region_bits_index[index]][static_cast<size_t>(inregion_i.z)];
+                if (((slice >> (inregion_i.x + inregion_i.y * PALETTE_REGION_SIZE)) & 1) != 0) {
+                    cell_size = 0;
+                }
+            }
+        }
+        if (cell_size == 0) {
+            auto const distance = t / float(VOXEL_SCL);
+            return VoxelRayHit{
+                .hit = true,
+                .distance = distance,
+                .position = std::bit_cast<daxa_f32vec3>(std::bit_cast<glm::vec3>(origin) + dir * distance),
+                .voxel_i = voxel_i,
+                .normal = normal,
+            };
+        }
+
+        // Skip to where the ray leaves the cell.
+        auto const cell_min = voxel_i & ~(cell_size - 1);
+        auto exit_axis = 0;
+        auto exit_t = INF;
+        for (int32_t axis = 0; axis < 3; ++axis) {
+            if (dir[axis] == 0.0f) {
+                continue;
+            }
+            auto const boundary = float(cell_min[axis] + (dir[axis] > 0.0f ? cell_size : 0));
+            auto const axis_t = (boundary - ray_origin[axis]) * inv_dir[axis];
+            if (axis_t < exit_t) {
+                exit_t = axis_t;
+                exit_axis = axis;
+            }
+        }
+        t = std::max(t, exit_t);
+        auto const ray_pos = glm::ivec3(glm::floor(ray_origin + dir * t));
+        for (int32_t axis = 0; axis < 3; ++axis) {
+            voxel_i[axis] = std::clamp(ray_pos[axis], cell_min[axis], cell_min[axis] + cell_size - 1);
+        }
+        voxel_i[exit_axis] = dir[exit_axis] > 0.0f ? cell_min[exit_axis] + cell_size : cell_min[exit_axis] - 1;
+        normal = glm::ivec3(0);
+        normal[exit_axis] = dir[exit_axis] > 0.0f ? -1 : 1;
+        if (!in_grid(voxel_i)) {
+            break;
+        }
+    }
+    return {};
+}
+
+auto VoxelOccupancy::sweep(daxa_f32vec3 box_min, daxa_f32vec3 box_max, daxa_f32vec3 motion, daxa_i32vec3 player_unit_offset) const -> VoxelSweepHit {
+    auto const lo = world_to_voxel(box_min, player_unit_offset);
+    auto const hi = world_to_voxel(box_max, player_unit_offset);
+    auto const m = std::bit_cast<glm::vec3>(motion) * float(VOXEL_SCL);
+
+    // Most sweeps don't come near anything, and are answered by the summary bits alone.
+    auto const swept_lo = glm::ivec3(glm::floor(glm::min(lo, lo + m)));
+    auto const swept_hi = glm::ivec3(glm::ceil(glm::max(hi, hi + m))) - 1;
+    if (!overlaps(swept_lo, swept_hi, player_unit_offset)) {
+        return {};
+    }
+
+    // Step the leading faces of the box through the voxel boundaries in the order they are crossed,
+    // and test the layer of voxels that each crossing adds.
+    constexpr auto INF = std::numeric_limits<float>::infinity();
+    auto boundary = glm::vec3(0.0f);
+    auto next_t = glm::vec3(INF);
+    for (int32_t axis = 0; axis < 3; ++axis) {
+        if (m[axis] > 0.0f) {
+            boundary[axis] = std::ceil(hi[axis]);
+            next_t[axis] = (boundary[axis] - hi[axis]) / m[axis];
+        } else if (m[axis] < 0.0f) {
+            boundary[axis] = std::floor(lo[axis]);
+            next_t[axis] = (boundary[axis] - lo[axis]) / m[axis];
+        }
+    }
+    while (true) {
+        auto axis = 0;
+        if (next_t[1] < next_t[axis]) {
+            axis = 1;
+        }
+        if (next_t[2] < next_t[axis]) {
+            axis = 2;
+        }
+        auto const t = next_t[axis];
+        if (t > 1.0f) {
+            return {};
+        }
+        auto layer_lo = glm::ivec3(0);
+        auto layer_hi = glm::ivec3(0);
+        for (int32_t other_axis = 0; other_axis < 3; ++other_axis) {
+            // A face that is moving into a voxel it touches covers it, otherwise crossing two
+            // boundaries at once would miss the voxel on the diagonal.
+            auto const other_lo = lo[other_axis] + m[other_axis] * t;
+            auto const other_hi = hi[other_axis] + m[other_axis] * t;
+            layer_lo[other_axis] = static_cast<int32_t>(m[other_axis] < 0.0f ? std::ceil(other_lo) - 1.0f : std::floor(other_lo));
+            layer_hi[other_axis] = static_cast<int32_t>(m[other_axis] > 0.0f ? std::floor(other_hi) : std::ceil(other_hi) - 1.0f);
+        }
+        auto const layer = static_cast<int32_t>(boundary[axis]) - (m[axis] > 0.0f ? 0 : 1);
+        layer_lo[axis] = layer;
+        layer_hi[axis] = layer;
+        if (overlaps(layer_lo, layer_hi, player_unit_offset)) {
+            auto result = VoxelSweepHit{.hit = true, .t = t};
+            result.normal[axis] = m[axis] > 0.0f ? -1 : 1;
+            return result;
+        }
+        if (m[axis] > 0.0f) {
+            boundary[axis] += 1.0f;
+            next_t[axis] = (boundary[axis] - hi[axis]) / m[axis];
+        } else {
+            boundary[axis] -= 1.0f;
+            next_t[axis] = (boundary[axis] - lo[axis]) / m[axis];
+        }
+    }
+}
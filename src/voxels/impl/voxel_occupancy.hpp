@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <voxels/impl/voxel_malloc.inl>
+#include <utilities/math.hpp>
+
+struct CpuVoxelChunk;
+
+// Which voxels of one chunk are solid, at one bit per voxel. Palette regions that are entirely empty
+// or entirely solid only get their summary bit, and store no voxel bits at all.
+struct VoxelOccupancyChunk {
+    static constexpr uint32_t REGION_MASK_U64S = PALETTES_PER_CHUNK / 64;
+    static constexpr uint16_t NO_REGION_BITS = 0xffff;
+
+    // One bit per palette region, indexed like CpuVoxelChunk::palette_chunks.
+    std::array<uint64_t, REGION_MASK_U64S> region_nonempty{};
+    std::array<uint64_t, REGION_MASK_U64S> region_full{};
+    // Index into region_bits, for the regions that are partially solid.
+    std::array<uint16_t, PALETTES_PER_CHUNK> region_bits_index{};
+    // One u64 per z slice of a region (which fits, as PALETTE_REGION_SIZE is 8), with bit (x + y * 8)
+    // set for each solid voxel.
+    std::vector<std::array<uint64_t, PALETTE_REGION_SIZE>> region_bits;
+};
+
+struct VoxelRayHit {
+    bool hit = false;
+    // In world space, along the (normalized) ray direction.
+    float distance = 0.0f;
+    daxa_f32vec3 position{};
+    // Index of the hit voxel, in the voxel space of VoxelOccupancy::world_to_voxel.
+    glm::ivec3 voxel_i{};
+    // Face the ray entered the voxel through. Zero when the ray started inside a solid voxel.
+    glm::ivec3 normal{};
+};
+
+struct VoxelSweepHit {
+    bool hit = false;
+    // Fraction of the motion that can be applied before the box touches a solid voxel.
+    float t = 1.0f;
+    glm::ivec3 normal{};
+};
+
+// CPU-side occupancy hierarchy over VoxelWorld::voxel_chunks, for collision, picking and brush
+// placement. There are three levels: a bit per chunk, a bit per palette region, and a bit per voxel,
+// and every query skips over whole chunks or regions that are empty. Queries interpret positions
+// the same way VoxelWorld::sample does, and everything outside of the loaded chunks is empty.
+struct VoxelOccupancy {
+    static constexpr int32_t GRID_VOXEL_N = CHUNKS_PER_AXIS * CHUNK_SIZE;
+
+    // Null for chunks without any solid voxels.
+    std::vector<std::unique_ptr<VoxelOccupancyChunk>> chunks;
+    // One bit per chunk, set when the chunk has any solid voxels.
+    std::vector<uint64_t> chunk_nonempty;
+
+    void init(size_t chunk_n);
+    // Rebuilds the bits of the chunk at `chunk_index` from its palettes.
+    void update_chunk(uint32_t chunk_index, CpuVoxelChunk const &voxel_chunk);
+
+    // Continuous voxel space position of a world space position. The voxel a position lies in is
+    // the floor of this.
+    static auto world_to_voxel(daxa_f32vec3 pos, daxa_i32vec3 player_unit_offset) -> glm::vec3;
+    static auto voxel_to_world(glm::vec3 voxel_pos, daxa_i32vec3 player_unit_offset) -> daxa_f32vec3;
+
+    auto is_solid(glm::ivec3 voxel_i, daxa_i32vec3 player_unit_offset) const -> bool;
+    // Whether any voxel between `voxel_min` and `voxel_max` (both inclusive) is solid.
+    auto overlaps(glm::ivec3 voxel_min, glm::ivec3 voxel_max, daxa_i32vec3 player_unit_offset) const -> bool;
+    // Finds the first solid voxel along a world space ray, by DDA that steps over empty chunks and
+    // palette regions in one go.
+    auto raycast(daxa_f32vec3 origin, daxa_f32vec3 direction, float max_distance, daxa_i32vec3 player_unit_offset) const -> VoxelRayHit;
+    // Moves a world space box by `motion`, and stops it at the first solid voxel it would overlap.
+    // Voxels the box already overlaps are ignored.
+    auto sweep(daxa_f32vec3 box_min, daxa_f32vec3 box_max, daxa_f32vec3 motion, daxa_i32vec3 player_unit_offset) const -> VoxelSweepHit;
+
+    auto chunk_at(glm::ivec3 chunk_i, glm::ivec3 chunk_shift) const -> VoxelOccupancyChunk const *;
+};
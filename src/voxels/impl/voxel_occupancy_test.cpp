@@ -0,0 +1,386 @@
+#include <voxels/impl/voxel_world_test_helpers.hpp>
+#include <voxels/impl/voxel_occupancy.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Checks every occupancy query against VoxelWorld::sample, which reads the palettes directly, on
+// random chunks around the middle of the grid.
+
+namespace {
+    // Not a multiple of a chunk on any axis, and negative on one, so the grid is both shifted and
+    // wrapped around.
+    constexpr auto PLAYER_UNIT_OFFSET = daxa_i32vec3{150, -77, 9};
+    constexpr auto INF = std::numeric_limits<float>::infinity();
+    // The chunks that get voxels, in grid space. Every fifth of them is left empty.
+    constexpr int32_t CLUSTER_MIN_CHUNK = CHUNKS_PER_AXIS / 2 - 2;
+    constexpr int32_t CLUSTER_CHUNK_N = 4;
+    constexpr int32_t CLUSTER_MIN_VOXEL = CLUSTER_MIN_CHUNK * CHUNK_SIZE;
+    constexpr int32_t CLUSTER_VOXEL_N = CLUSTER_CHUNK_N * CHUNK_SIZE;
+    // Queries start up to a chunk away from the cluster, so they also cross chunks that were never
+    // loaded.
+    constexpr int32_t QUERY_MARGIN = CHUNK_SIZE;
+
+    auto in_grid(glm::ivec3 voxel_i) -> bool {
+        return glm::all(glm::greaterThanEqual(voxel_i, glm::ivec3(0))) && glm::all(glm::lessThan(voxel_i, glm::ivec3(VoxelOccupancy::GRID_VOXEL_N)));
+    }
+
+    auto reference_is_solid(VoxelWorld &voxel_world, glm::ivec3 voxel_i) -> bool {
+        if (!in_grid(voxel_i)) {
+            return false;
+        }
+        return voxel_world.sample(VoxelOccupancy::voxel_to_world(glm::vec3(voxel_i) + 0.5f, PLAYER_UNIT_OFFSET), PLAYER_UNIT_OFFSET);
+    }
+
+    // Index into VoxelWorld::voxel_chunks of the chunk at `chunk_i` in grid space.
+    auto stored_chunk_index(glm::ivec3 chunk_i) -> uint32_t {
+        auto const chunk_shift = std::bit_cast<glm::ivec3>(PLAYER_UNIT_OFFSET) >> glm::ivec3(6 + LOG2_VOXEL_SIZE);
+        auto const wrapped_i = (chunk_i + chunk_shift) & (CHUNKS_PER_AXIS - 1);
+        return static_cast<uint32_t>(wrapped_i.x + wrapped_i.y * CHUNKS_PER_AXIS + wrapped_i.z * CHUNKS_PER_AXIS * CHUNKS_PER_AXIS);
+    }
+
+    auto cluster_chunk_indices() -> std::vector<uint32_t> {
+        auto result = std::vector<uint32_t>{};
+        auto chunk_n = 0;
+        for (int32_t zi = 0; zi < CLUSTER_CHUNK_N; ++zi) {
+            for (int32_t yi = 0; yi < CLUSTER_CHUNK_N; ++yi) {
+                for (int32_t xi = 0; xi < CLUSTER_CHUNK_N; ++xi) {
+                    if (chunk_n++ % 5 != 4) {
+                        result.push_back(stored_chunk_index(glm::ivec3(xi, yi, zi) + CLUSTER_MIN_CHUNK));
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // Mostly air, so that a fair share of the queries miss.
+    auto make_voxel_world(std::mt19937 &rng) -> std::unique_ptr<VoxelWorld> {
+        auto voxel_world = std::make_unique<VoxelWorld>();
+        voxel_world->init_cpu_chunks();
+        auto const updates = make_chunk_updates(rng, cluster_chunk_indices(), 0.9f);
+        voxel_world->apply_chunk_updates(updates.chunk_updates, updates.heap.data(), PLAYER_UNIT_OFFSET);
+        return voxel_world;
+    }
+
+    auto random_query_voxel(std::mt19937 &rng) -> glm::vec3 {
+        auto pick = std::uniform_real_distribution<float>{float(CLUSTER_MIN_VOXEL - QUERY_MARGIN), float(CLUSTER_MIN_VOXEL + CLUSTER_VOXEL_N + QUERY_MARGIN)};
+        return {pick(rng), pick(rng), pick(rng)};
+    }
+
+    auto check_is_solid(VoxelWorld &voxel_world, std::mt19937 &rng) -> std::string {
+        auto solid_n = 0u;
+        for (uint32_t query_i = 0; query_i < 200000; ++query_i) {
+            auto const voxel_i = glm::ivec3(glm::floor(random_query_voxel(rng)));
+            auto const expected = reference_is_solid(voxel_world, voxel_i);
+            if (voxel_world.occupancy.is_solid(voxel_i, PLAYER_UNIT_OFFSET) != expected) {
+                return fmt::format("voxel ({}, {}, {}) should be {}", voxel_i.x, voxel_i.y, voxel_i.z, expected ? "solid" : "empty");
+            }
+            solid_n += expected ? 1 : 0;
+        }
+        if (solid_n == 0) {
+            return "none of the voxels were solid";
+        }
+        for (auto const voxel_i : {glm::ivec3(-1, 0, 0), glm::ivec3(0, VoxelOccupancy::GRID_VOXEL_N, 0), glm::ivec3(CLUSTER_MIN_VOXEL, CLUSTER_MIN_VOXEL, -CLUSTER_MIN_VOXEL)}) {
+            if (voxel_world.occupancy.is_solid(voxel_i, PLAYER_UNIT_OFFSET)) {
+                return fmt::format("voxel ({}, {}, {}) outside of the grid is solid", voxel_i.x, voxel_i.y, voxel_i.z);
+            }
+        }
+        return {};
+    }
+
+    auto test_is_solid() -> std::string {
+        auto rng = std::mt19937{0};
+        auto voxel_world = make_voxel_world(rng);
+        return check_is_solid(*voxel_world, rng);
+    }
+
+    // Boxes of up to a palette region and a half on a side.
+    auto test_overlaps() -> std::string {
+        auto rng = std::mt19937{1};
+        auto voxel_world = make_voxel_world(rng);
+        auto pick_size = std::uniform_int_distribution<int32_t>{0, PALETTE_REGION_SIZE * 3 / 2};
+        auto hit_n = 0u;
+        for (uint32_t query_i = 0; query_i < 4000; ++query_i) {
+            auto const voxel_min = glm::ivec3(glm::floor(random_query_voxel(rng)));
+            auto const voxel_max = voxel_min + glm::ivec3(pick_size(rng), pick_size(rng), pick_size(rng));
+            auto expected = false;
+            for (int32_t zi = voxel_min.z; zi <= voxel_max.z && !expected; ++zi) {
+                for (int32_t yi = voxel_min.y; yi <= voxel_max.y && !expected; ++yi) {
+                    for (int32_t xi = voxel_min.x; xi <= voxel_max.x && !expected; ++xi) {
+                        expected = reference_is_solid(*voxel_world, glm::ivec3(xi, yi, zi));
+                    }
+                }
+            }
+            if (voxel_world->occupancy.overlaps(voxel_min, voxel_max, PLAYER_UNIT_OFFSET) != expected) {
+                return fmt::format("the box from ({}, {}, {}) to ({}, {}, {}) should {}overlap", voxel_min.x, voxel_min.y, voxel_min.z, voxel_max.x, voxel_max.y, voxel_max.z, expected ? "" : "not ");
+            }
+            hit_n += expected ? 1 : 0;
+        }
+        if (hit_n == 0 || hit_n == 4000) {
+            return fmt::format("{} of the boxes overlapped", hit_n);
+        }
+        auto const edge_min = glm::ivec3(-4, VoxelOccupancy::GRID_VOXEL_N - 4, 0);
+        if (voxel_world->occupancy.overlaps(edge_min, edge_min + 8, PLAYER_UNIT_OFFSET) || voxel_world->occupancy.overlaps(glm::ivec3(2), glm::ivec3(1), PLAYER_UNIT_OFFSET)) {
+            return "a box on the edge of the grid, or an empty box, overlapped";
+        }
+        return {};
+    }
+
+    struct ReferenceRayHit {
+        bool hit = false;
+        float t = 0.0f;
+        glm::ivec3 voxel_i{};
+        glm::ivec3 normal{};
+    };
+
+    // Visits every voxel along the ray one at a time, in voxel space, with `dir` normalized.
+    auto reference_raycast(VoxelWorld &voxel_world, glm::vec3 origin, glm::vec3 dir, float max_t) -> ReferenceRayHit {
+        auto inv_dir = glm::vec3(INF);
+        for (int32_t axis = 0; axis < 3; ++axis) {
+            if (dir[axis] != 0.0f) {
+                inv_dir[axis] = 1.0f / dir[axis];
+            }
+        }
+        auto voxel_i = glm::ivec3(glm::floor(origin));
+        auto normal = glm::ivec3(0);
+        auto t = 0.0f;
+        while (t <= max_t) {
+            if (reference_is_solid(voxel_world, voxel_i)) {
+                return {.hit = true, .t = t, .voxel_i = voxel_i, .normal = normal};
+            }
+            auto next_axis = 0;
+            auto next_t = INF;
+            for (int32_t axis = 0; axis < 3; ++axis) {
+                if (dir[axis] == 0.0f) {
+                    continue;
+                }
+                auto const boundary = float(voxel_i[axis] + (dir[axis] > 0.0f ? 1 : 0));
+                auto const axis_t = (boundary - origin[axis]) * inv_dir[axis];
+                if (axis_t < next_t) {
+                    next_t = axis_t;
+                    next_axis = axis;
+                }
+            }
+            t = next_t;
+            voxel_i[next_axis] += dir[next_axis] > 0.0f ? 1 : -1;
+            normal = glm::ivec3(0);
+            normal[next_axis] = dir[next_axis] > 0.0f ? -1 : 1;
+        }
+        return {};
+    }
+
+    auto random_direction(std::mt19937 &rng) -> glm::vec3 {
+        auto pick = std::normal_distribution<float>{};
+        auto dir = glm::vec3(pick(rng), pick(rng), pick(rng));
+        // Rays along an axis or a plane take their own paths through the DDA.
+        auto const zero_axes = static_cast<int32_t>(rng() % 8);
+        for (int32_t axis = 0; axis < 3 && zero_axes < 3; ++axis) {
+            if (axis != zero_axes) {
+                dir[axis] = 0.0f;
+            }
+        }
+        if (zero_axes == 3) {
+            dir[static_cast<int32_t>(rng() % 3)] = 0.0f;
+        }
+        return glm::normalize(dir);
+    }
+
+    auto check_raycast(VoxelWorld &voxel_world, std::mt19937 &rng) -> std::string {
+        auto hit_n = 0u;
+        auto pick_distance = std::uniform_real_distribution<float>{0.0f, float(CLUSTER_VOXEL_N)};
+        for (uint32_t query_i = 0; query_i < 4000; ++query_i) {
+            auto dir = random_direction(rng);
+            auto start = random_query_voxel(rng);
+            auto max_t = pick_distance(rng);
+            if (query_i % 8 == 0) {
+                // From outside of the grid, towards the cluster.
+                auto const target = random_query_voxel(rng);
+                start = target - dir * float(VoxelOccupancy::GRID_VOXEL_N);
+                max_t = float(VoxelOccupancy::GRID_VOXEL_N) * 2.0f;
+            }
+            auto const origin = VoxelOccupancy::voxel_to_world(start, PLAYER_UNIT_OFFSET);
+            auto const result = voxel_world.occupancy.raycast(origin, std::bit_cast<daxa_f32vec3>(dir), max_t / float(VOXEL_SCL), PLAYER_UNIT_OFFSET);
+            auto const expected = reference_raycast(voxel_world, VoxelOccupancy::world_to_voxel(origin, PLAYER_UNIT_OFFSET), dir, max_t);
+            // Hits right at the maximum distance can go either way with rounding.
+            if (expected.hit && expected.t > max_t - 0.001f) {
+                continue;
+            }
+            auto const description = [&]() {
+                return fmt::format("the ray from ({}, {}, {}) along ({}, {}, {})", start.x, start.y, start.z, dir.x, dir.y, dir.z);
+            };
+            if (result.hit != expected.hit) {
+                return fmt::format("{} should {}hit", description(), expected.hit ? "" : "not ");
+            }
+            if (!expected.hit) {
+                continue;
+            }
+            ++hit_n;
+            if (result.voxel_i != expected.voxel_i || result.normal != expected.normal) {
+                return fmt::format("{} hit voxel ({}, {}, {}) instead of ({}, {}, {}), or through the wrong face", description(), result.voxel_i.x, result.voxel_i.y, result.voxel_i.z, expected.voxel_i.x, expected.voxel_i.y, expected.voxel_i.z);
+            }
+            if (std::abs(result.distance * float(VOXEL_SCL) - expected.t) > 0.001f) {
+                return fmt::format("{} hit at {} voxels instead of {}", description(), result.distance * float(VOXEL_SCL), expected.t);
+            }
+        }
+        if (hit_n == 0) {
+            return "none of the rays hit";
+        }
+        return {};
+    }
+
+    auto test_raycast() -> std::string {
+        auto rng = std::mt19937{2};
+        auto voxel_world = make_voxel_world(rng);
+        return check_raycast(*voxel_world, rng);
+    }
+
+    // The first time in [0, 1] at which the box moving by `motion` overlaps a solid voxel it didn't
+    // overlap to begin with, in voxel space. Tests every voxel in reach on its own.
+    auto reference_sweep(VoxelWorld &voxel_world, glm::vec3 lo, glm::vec3 hi, glm::vec3 motion) -> VoxelSweepHit {
+        auto result = VoxelSweepHit{};
+        auto const initial_lo = glm::ivec3(glm::floor(lo));
+        auto const initial_hi = glm::ivec3(glm::ceil(hi)) - 1;
+        auto const swept_lo = glm::ivec3(glm::floor(glm::min(lo, lo + motion)));
+        auto const swept_hi = glm::ivec3(glm::ceil(glm::max(hi, hi + motion))) - 1;
+        for (int32_t zi = swept_lo.z; zi <= swept_hi.z; ++zi) {
+            for (int32_t yi = swept_lo.y; yi <= swept_hi.y; ++yi) {
+                for (int32_t xi = swept_lo.x; xi <= swept_hi.x; ++xi) {
+                    auto const voxel_i = glm::ivec3(xi, yi, zi);
+                    if (glm::all(glm::greaterThanEqual(voxel_i, initial_lo)) && glm::all(glm::greaterThanEqual(initial_hi, voxel_i))) {
+                        continue;
+                    }
+                    if (!reference_is_solid(voxel_world, voxel_i)) {
+                        continue;
+                    }
+                    // The box overlaps the voxel while lo + motion * t < voxel + 1 and
+                    // hi + motion * t > voxel on every axis.
+                    auto enter_t = -INF;
+                    auto exit_t = INF;
+                    auto enter_axis = 0;
+                    for (int32_t axis = 0; axis < 3; ++axis) {
+                        auto const voxel_lo = float(voxel_i[axis]);
+                        auto const voxel_hi = voxel_lo + 1.0f;
+                        if (motion[axis] == 0.0f) {
+                            if (lo[axis] >= voxel_hi || hi[axis] <= voxel_lo) {
+                                exit_t = -INF;
+                            }
+                            continue;
+                        }
+                        auto axis_enter_t = (motion[axis] > 0.0f ? voxel_lo - hi[axis] : voxel_hi - lo[axis]) / motion[axis];
+                        auto const axis_exit_t = (motion[axis] > 0.0f ? voxel_hi - lo[axis] : voxel_lo - hi[axis]) / motion[axis];
+                        if (axis_enter_t > enter_t) {
+                            enter_t = axis_enter_t;
+                            enter_axis = axis;
+                        }
+                        exit_t = std::min(exit_t, axis_exit_t);
+                    }
+                    if (enter_t >= 0.0f && enter_t <= 1.0f && enter_t < exit_t && (!result.hit || enter_t < result.t)) {
+                        result = {.hit = true, .t = enter_t, .normal = glm::ivec3(0)};
+                        result.normal[enter_axis] = motion[enter_axis] > 0.0f ? -1 : 1;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    auto test_sweep() -> std::string {
+        auto rng = std::mt19937{3};
+        auto voxel_world = make_voxel_world(rng);
+        auto pick_size = std::uniform_real_distribution<float>{0.3f, 3.0f};
+        auto pick_motion = std::uniform_real_distribution<float>{-6.0f, 6.0f};
+        auto hit_n = 0u;
+        for (uint32_t query_i = 0; query_i < 4000; ++query_i) {
+            auto const start = random_query_voxel(rng);
+            auto motion = glm::vec3(pick_motion(rng), pick_motion(rng), pick_motion(rng));
+            if (query_i % 4 == 0) {
+                // Like walking on the ground.
+                motion[static_cast<int32_t>(rng() % 3)] = 0.0f;
+            }
+            auto const box_min = VoxelOccupancy::voxel_to_world(start, PLAYER_UNIT_OFFSET);
+            auto const box_max = VoxelOccupancy::voxel_to_world(start + glm::vec3(pick_size(rng), pick_size(rng), pick_size(rng)), PLAYER_UNIT_OFFSET);
+            auto const world_motion = std::bit_cast<daxa_f32vec3>(motion / float(VOXEL_SCL));
+            auto const result = voxel_world->occupancy.sweep(box_min, box_max, world_motion, PLAYER_UNIT_OFFSET);
+            // The same voxel space box as the sweep works with, rounding included.
+            auto const expected = reference_sweep(
+                *voxel_world,
+                VoxelOccupancy::world_to_voxel(box_min, PLAYER_UNIT_OFFSET),
+                VoxelOccupancy::world_to_voxel(box_max, PLAYER_UNIT_OFFSET),
+                std::bit_cast<glm::vec3>(world_motion) * float(VOXEL_SCL));
+            if (result.hit != expected.hit || (expected.hit && (std::abs(result.t - expected.t) > 0.0001f || result.normal != expected.normal))) {
+                return fmt::format(
+                    "the box at ({}, {}, {}) moving by ({}, {}, {}) {} at {} instead of {} at {}",
+                    start.x, start.y, start.z, motion.x, motion.y, motion.z,
+                    result.hit ? "hit" : "missed", result.t, expected.hit ? "hitting" : "missing", expected.t);
+            }
+            hit_n += expected.hit ? 1 : 0;
+        }
+        if (hit_n == 0 || hit_n == 4000) {
+            return fmt::format("{} of the boxes hit", hit_n);
+        }
+        return {};
+    }
+
+    // Chunks that are loaded again replace their bits, and chunks that turned all air drop them.
+    auto test_chunk_updates() -> std::string {
+        auto rng = std::mt19937{4};
+        auto voxel_world = make_voxel_world(rng);
+        auto chunk_indices = cluster_chunk_indices();
+        std::shuffle(chunk_indices.begin(), chunk_indices.end(), rng);
+        auto const half = chunk_indices.size() / 2;
+        auto const reloaded = make_chunk_updates(rng, std::span{chunk_indices}.first(half), 0.9f);
+        voxel_world->apply_chunk_updates(reloaded.chunk_updates, reloaded.heap.data(), PLAYER_UNIT_OFFSET);
+        auto const cleared = make_chunk_updates(rng, std::span{chunk_indices}.subspan(half), 1.0f);
+        voxel_world->apply_chunk_updates(cleared.chunk_updates, cleared.heap.data(), PLAYER_UNIT_OFFSET);
+        for (auto const chunk_i : std::span{chunk_indices}.subspan(half)) {
+            if (voxel_world->occupancy.chunks[chunk_i] != nullptr) {
+                return fmt::format("chunk {} is all air, but kept its bits", chunk_i);
+            }
+        }
+        if (auto error = check_is_solid(*voxel_world, rng); !error.empty()) {
+            return error;
+        }
+        return check_raycast(*voxel_world, rng);
+    }
+
+    // Recording the startup task graph again, like a resize does, keeps the occupancy, so the player
+    // keeps standing on the ground. Only running it, which clears the world, empties it.
+    auto test_record_startup_again() -> std::string {
+        auto rng = std::mt19937{5};
+        auto voxel_world = make_voxel_world(rng);
+        voxel_world->init_cpu_chunks();
+        if (auto error = check_is_solid(*voxel_world, rng); !error.empty()) {
+            return fmt::format("after recording the startup again, {}", error);
+        }
+        voxel_world->clear_cpu_chunks();
+        for (auto const chunk_i : cluster_chunk_indices()) {
+            if (voxel_world->occupancy.chunks[chunk_i] != nullptr) {
+                return fmt::format("chunk {} kept its bits when the world was cleared", chunk_i);
+            }
+        }
+        auto const voxel_i = glm::ivec3(CLUSTER_MIN_VOXEL + CLUSTER_VOXEL_N / 2);
+        if (voxel_world->occupancy.overlaps(voxel_i - CLUSTER_VOXEL_N / 2, voxel_i + CLUSTER_VOXEL_N / 2, PLAYER_UNIT_OFFSET)) {
+            return "the cleared world is still solid";
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"is_solid matches sample", test_is_solid},
+        UnitTestCase{"overlaps matches sample", test_overlaps},
+        UnitTestCase{"raycast matches a voxel by voxel DDA", test_raycast},
+        UnitTestCase{"sweep matches testing every voxel", test_sweep},
+        UnitTestCase{"chunks that are loaded again or cleared", test_chunk_updates},
+        UnitTestCase{"recording the startup again keeps the occupancy", test_record_startup_again},
+    };
+    return run_unit_tests(cases);
+}
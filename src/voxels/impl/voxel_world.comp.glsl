@@ -10,47 +10,59 @@ daxa_RWBufferPtr(VoxelLeafChunk) voxel_chunks = push.uses.voxel_chunks;
 
 #include <utilities/gpu/math.glsl>
 #include <voxels/impl/voxels.glsl>
+#include <voxels/impl/chunk_update_priority.glsl>
 
 #define VOXEL_WORLD deref(voxel_globals)
 #define PLAYER deref(gpu_input).player
 #define CHUNKS(i) deref(advance(voxel_chunks, i))
 #define INDIRECT deref(voxel_globals).indirect_dispatch
 
-void try_elect(in out VoxelChunkUpdateInfo work_item, in out uint update_index) {
-    uint prev_update_n = atomicAdd(VOXEL_WORLD.chunk_update_n, 1);
+uint chunk_update_cost(uint brush_flags) {
+    return (brush_flags & BRUSH_FLAGS_WORLD_BRUSH) != 0 ? CHUNK_UPDATE_COST_GENERATE : CHUNK_UPDATE_COST_EDIT;
+}
 
-    // Check if the work item can be added
-    if (prev_update_n < MAX_CHUNK_UPDATES_PER_FRAME) {
-        // Set the chunk edit dispatch z axis (64/8, 64/8, 64 x 8 x 8 / 8 = 64 x 8) = (8, 8, 512)
-        atomicAdd(INDIRECT.chunk_edit_dispatch.z, CHUNK_SIZE / 8);
-        atomicAdd(INDIRECT.subchunk_x2x4_dispatch.z, 1);
-        atomicAdd(INDIRECT.subchunk_x8up_dispatch.z, 1);
-        // Set the chunk update info
-        VOXEL_WORLD.chunk_update_infos[prev_update_n] = work_item;
-        update_index = prev_update_n + 1;
+// Records the request for ChunkElectCompute to pick from, and adds it to the priority histogram.
+void request_update(uint chunk_index, ivec3 world_chunk, uint brush_flags) {
+    uint frame_index = deref(gpu_input).frame_index;
+    if ((brush_flags & BRUSH_FLAGS_WORLD_BRUSH) == 0) {
+        CHUNKS(chunk_index).last_edit_frame = frame_index + 1;
     }
+    uint last_edit_frame = CHUNKS(chunk_index).last_edit_frame;
+    uint frames_since_edit = last_edit_frame == 0 ? uint(CHUNK_UPDATE_EDIT_FADE_FRAMES) : frame_index + 1 - last_edit_frame;
+
+    // Relative to the player in whole units first, so that it stays precise far from the origin.
+    vec3 chunk_offset = (vec3((world_chunk << (6 + LOG2_VOXEL_SIZE)) - PLAYER.player_unit_offset) + CHUNK_WORLDSPACE_SIZE * 0.5 - PLAYER.pos) / CHUNK_WORLDSPACE_SIZE;
+    float tan_half_diagonal_fov = length(vec2(PLAYER.cam.clip_to_view[0][0], PLAYER.cam.clip_to_view[1][1]));
+    bool is_in_view = chunk_is_in_view(chunk_offset, PLAYER.forward, tan_half_diagonal_fov);
+
+    float priority = chunk_update_priority(length(chunk_offset), is_in_view, frames_since_edit, CHUNKS(chunk_index).update_wait_n);
+    uint bucket = chunk_update_priority_bucket(priority);
+    uint cost = chunk_update_cost(brush_flags);
+    atomicAdd(VOXEL_WORLD.update_request_costs[bucket], cost);
+    atomicAdd(VOXEL_WORLD.update_request_ns[bucket], 1);
+    CHUNKS(chunk_index).update_request = brush_flags | (bucket << CHUNK_UPDATE_REQUEST_BUCKET_SHIFT) | (cost << CHUNK_UPDATE_REQUEST_COST_SHIFT);
 }
 
 layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
 void main() {
     ivec3 chunk_n = ivec3(CHUNKS_PER_AXIS);
 
-    VoxelChunkUpdateInfo terrain_work_item;
-    terrain_work_item.i = ivec3(gl_GlobalInvocationID.xyz) & (chunk_n - 1);
-
+    ivec3 chunk_i = ivec3(gl_GlobalInvocationID.xyz) & (chunk_n - 1);
     ivec3 offset = (VOXEL_WORLD.offset >> ivec3(6 + LOG2_VOXEL_SIZE));
     ivec3 prev_offset = (VOXEL_WORLD.prev_offset >> ivec3(6 + LOG2_VOXEL_SIZE));
 
-    terrain_work_item.chunk_offset = offset;
-    terrain_work_item.brush_flags = BRUSH_FLAGS_WORLD_BRUSH;
-
     // (const) number of chunks in each axis
-    uint chunk_index = calc_chunk_index_from_worldspace(terrain_work_item.i, chunk_n);
+    uint chunk_index = calc_chunk_index_from_worldspace(chunk_i, chunk_n);
 
-    uint update_index = 0;
+    // Wrapped chunk index in leaf chunk space (0^3 - 31^3)
+    ivec3 wrapped_chunk_i = imod3(chunk_i - imod3(offset - ivec3(chunk_n), ivec3(chunk_n)), ivec3(chunk_n));
+    // Leaf chunk position in world space
+    ivec3 world_chunk = offset + wrapped_chunk_i - ivec3(chunk_n / 2);
+
+    uint brush_flags = 0;
 
     if ((CHUNKS(chunk_index).flags & CHUNK_FLAGS_ACCEL_GENERATED) == 0) {
-        try_elect(terrain_work_item, update_index);
+        brush_flags = BRUSH_FLAGS_WORLD_BRUSH;
     } else if (offset != prev_offset) {
         // invalidate chunks outside the chunk_offset
         ivec3 diff = clamp(ivec3(offset - prev_offset), -chunk_n, chunk_n);
@@ -67,23 +79,20 @@ void main() {
         start.z = diff.z < 0 ? 0 : chunk_n.z - diff.z;
         end.z = diff.z < 0 ? -diff.z : chunk_n.z;
 
-        uvec3 temp_chunk_i = uvec3((ivec3(terrain_work_item.i) - offset) % ivec3(chunk_n));
+        uvec3 temp_chunk_i = uvec3((ivec3(chunk_i) - offset) % ivec3(chunk_n));
 
         if ((temp_chunk_i.x >= start.x && temp_chunk_i.x < end.x) ||
             (temp_chunk_i.y >= start.y && temp_chunk_i.y < end.y) ||
             (temp_chunk_i.z >= start.z && temp_chunk_i.z < end.z)) {
             CHUNKS(chunk_index).flags &= ~CHUNK_FLAGS_ACCEL_GENERATED;
-            try_elect(terrain_work_item, update_index);
+            // The slot holds a different chunk now, which hasn't been waiting or been edited.
+            CHUNKS(chunk_index).update_wait_n = 0;
+            CHUNKS(chunk_index).last_edit_frame = 0;
+            brush_flags = BRUSH_FLAGS_WORLD_BRUSH;
         }
     } else {
-        // Wrapped chunk index in leaf chunk space (0^3 - 31^3)
-        ivec3 wrapped_chunk_i = imod3(terrain_work_item.i - imod3(terrain_work_item.chunk_offset - ivec3(chunk_n), ivec3(chunk_n)), ivec3(chunk_n));
-        // Leaf chunk position in world space
-        ivec3 world_chunk = terrain_work_item.chunk_offset + wrapped_chunk_i - ivec3(chunk_n / 2);
         vec3 world_chunk_center = vec3(world_chunk << (6 + LOG2_VOXEL_SIZE)) + (32 * VOXEL_SIZE);
 
-        terrain_work_item.brush_input = VOXEL_WORLD.brush_input;
-
         ivec3 brush_chunk = (ivec3(floor(VOXEL_WORLD.brush_input.pos)) + VOXEL_WORLD.brush_input.pos_offset) >> (6 + LOG2_VOXEL_SIZE);
         bool is_near_brush = all(greaterThanEqual(world_chunk, brush_chunk - 1)) && all(lessThanEqual(world_chunk, brush_chunk + 1));
 
@@ -93,15 +102,20 @@ void main() {
         is_near_brush_b = is_near_brush_b || (length(world_brush_pos + vec3(0, 0, 9) - world_chunk_center) < 10);
 
         if (is_near_brush_a && deref(gpu_input).actions[GAME_ACTION_BRUSH_A] != 0) {
-            terrain_work_item.brush_flags = BRUSH_FLAGS_USER_BRUSH_A;
-            try_elect(terrain_work_item, update_index);
+            brush_flags = BRUSH_FLAGS_USER_BRUSH_A;
         } else if (is_near_brush_b && deref(gpu_input).actions[GAME_ACTION_BRUSH_B] != 0 && deref(voxel_globals).brush_state.initial_frame == deref(gpu_input).frame_index) {
-            terrain_work_item.brush_flags = BRUSH_FLAGS_USER_BRUSH_B;
-            try_elect(terrain_work_item, update_index);
+            brush_flags = BRUSH_FLAGS_USER_BRUSH_B;
         }
     }
 
-    CHUNKS(chunk_index).update_index = update_index;
+    if (brush_flags != 0) {
+        request_update(chunk_index, world_chunk, brush_flags);
+    } else {
+        CHUNKS(chunk_index).update_request = 0;
+        CHUNKS(chunk_index).update_wait_n = 0;
+    }
+    // ChunkElectCompute sets it for the chunks it elects.
+    CHUNKS(chunk_index).update_index = 0;
 }
 
 #undef INDIRECT
@@ -111,6 +125,89 @@ void main() {
 
 #endif
 
+#if ChunkElectComputeShader
+
+DAXA_DECL_PUSH_CONSTANT(ChunkElectComputePush, push)
+daxa_RWBufferPtr(VoxelWorldGlobals) voxel_globals = push.uses.voxel_globals;
+daxa_RWBufferPtr(VoxelLeafChunk) voxel_chunks = push.uses.voxel_chunks;
+
+#include <utilities/gpu/math.glsl>
+#include <voxels/impl/voxels.glsl>
+
+#define VOXEL_WORLD deref(voxel_globals)
+#define CHUNKS(i) deref(advance(voxel_chunks, i))
+#define INDIRECT deref(voxel_globals).indirect_dispatch
+
+void try_elect(in out VoxelChunkUpdateInfo work_item, in out uint update_index) {
+    uint prev_update_n = atomicAdd(VOXEL_WORLD.chunk_update_n, 1);
+
+    // Check if the work item can be added
+    if (prev_update_n < MAX_CHUNK_UPDATES_PER_FRAME) {
+        // Set the chunk edit dispatch z axis (64/8, 64/8, 64 x 8 x 8 / 8 = 64 x 8) = (8, 8, 512)
+        atomicAdd(INDIRECT.chunk_edit_dispatch.z, CHUNK_SIZE / 8);
+        atomicAdd(INDIRECT.subchunk_x2x4_dispatch.z, 1);
+        atomicAdd(INDIRECT.subchunk_x8up_dispatch.z, 1);
+        // Set the chunk update info
+        VOXEL_WORLD.chunk_update_infos[prev_update_n] = work_item;
+        update_index = prev_update_n + 1;
+    }
+}
+
+// Elects the requests PerChunkCompute made, highest priority bucket first. Every chunk sums the
+// buckets above its own, so the buckets that fit as a whole are elected without any contention,
+// and only the chunks of the one bucket that straddles the budget race for what's left of it.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+void main() {
+    ivec3 chunk_n = ivec3(CHUNKS_PER_AXIS);
+    ivec3 chunk_i = ivec3(gl_GlobalInvocationID.xyz) & (chunk_n - 1);
+    uint chunk_index = calc_chunk_index_from_worldspace(chunk_i, chunk_n);
+
+    uint request = CHUNKS(chunk_index).update_request;
+    if (request == 0) {
+        return;
+    }
+    uint bucket = (request >> CHUNK_UPDATE_REQUEST_BUCKET_SHIFT) & 0xff;
+    uint cost = request >> CHUNK_UPDATE_REQUEST_COST_SHIFT;
+
+    uint cost_above = 0;
+    uint n_above = 0;
+    for (uint i = CHUNK_UPDATE_PRIORITY_BUCKET_N - 1; i > bucket; --i) {
+        cost_above += VOXEL_WORLD.update_request_costs[i];
+        n_above += VOXEL_WORLD.update_request_ns[i];
+    }
+
+    bool is_elected = false;
+    if (cost_above < CHUNK_UPDATE_COST_BUDGET && n_above < MAX_CHUNK_UPDATES_PER_FRAME) {
+        if (cost_above + VOXEL_WORLD.update_request_costs[bucket] <= CHUNK_UPDATE_COST_BUDGET &&
+            n_above + VOXEL_WORLD.update_request_ns[bucket] <= MAX_CHUNK_UPDATES_PER_FRAME) {
+            is_elected = true;
+        } else {
+            // Reserving slots too keeps these from taking the ones the buckets above are owed.
+            uint prev_cost = atomicAdd(VOXEL_WORLD.cutoff_bucket_cost, cost);
+            uint prev_n = atomicAdd(VOXEL_WORLD.cutoff_bucket_n, 1);
+            is_elected = prev_cost + cost <= CHUNK_UPDATE_COST_BUDGET - cost_above && prev_n < MAX_CHUNK_UPDATES_PER_FRAME - n_above;
+        }
+    }
+
+    uint update_index = 0;
+    if (is_elected) {
+        VoxelChunkUpdateInfo work_item;
+        work_item.i = chunk_i;
+        work_item.chunk_offset = VOXEL_WORLD.offset >> ivec3(6 + LOG2_VOXEL_SIZE);
+        work_item.brush_flags = request & BRUSH_FLAGS_BRUSH_MASK;
+        work_item.brush_input = VOXEL_WORLD.brush_input;
+        try_elect(work_item, update_index);
+    }
+    CHUNKS(chunk_index).update_index = update_index;
+    CHUNKS(chunk_index).update_wait_n = update_index != 0 ? 0 : CHUNKS(chunk_index).update_wait_n + 1;
+}
+
+#undef INDIRECT
+#undef CHUNKS
+#undef VOXEL_WORLD
+
+#endif
+
 #if ChunkEditComputeShader
 
 DAXA_DECL_PUSH_CONSTANT(ChunkEditComputePush, push)
@@ -928,9 +1025,13 @@ void main() {
         deref(advance(chunk_update_heap, frame_index * MAX_CHUNK_UPDATES_PER_FRAME_VOXEL_COUNT + output_offset + palette_region_voxel_index)) = compression_result[palette_region_voxel_index];
     }
     if (palette_region_voxel_index == 0) {
+        ivec3 chunk_offset = VOXEL_WORLD.chunk_update_infos[temp_chunk_index].chunk_offset;
+        ivec3 wrapped_chunk_i = imod3(chunk_i - imod3(chunk_offset - ivec3(chunk_n), ivec3(chunk_n)), ivec3(chunk_n));
         CpuChunkUpdateInfo chunk_update_info;
         chunk_update_info.chunk_index = chunk_index;
         chunk_update_info.flags = 1;
+        chunk_update_info.world_chunk = chunk_offset + wrapped_chunk_i - ivec3(chunk_n / 2);
+        chunk_update_info.brush_flags = VOXEL_WORLD.chunk_update_infos[temp_chunk_index].brush_flags;
         deref(advance(chunk_updates, frame_index * MAX_CHUNK_UPDATES_PER_FRAME + temp_chunk_index)).info = chunk_update_info;
         PaletteHeader palette_header;
         palette_header.variant_n = palette_size;
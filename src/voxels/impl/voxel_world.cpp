@@ -1,4 +1,7 @@
 #include "voxel_world.inl"
+#include <application/replay.hpp>
+#include <utilities/profiler.hpp>
+#include <utilities/gpu/defs.glsl>
 #include <fmt/format.h>
 
 #ifndef defer
@@ -44,37 +47,7 @@ static uint32_t calc_palette_voxel_index(glm::uvec3 inchunk_voxel_i) {
 }
 
 PackedVoxel sample_palette(CpuPaletteChunk palette_header, uint32_t palette_voxel_index) {
-    if (palette_header.variant_n < 2) {
-        return PackedVoxel(static_cast<uint32_t>(std::bit_cast<uint64_t>(palette_header.blob_ptr)));
-    }
-    // daxa_RWBufferPtr(uint) blob_u32s;
-    // voxel_malloc_address_to_u32_ptr(allocator, palette_header.blob_ptr, blob_u32s);
-    // blob_u32s = advance(blob_u32s, PALETTE_ACCELERATION_STRUCTURE_SIZE_U32S);
-    auto const *blob_u32s = palette_header.blob_ptr;
-    if (palette_header.variant_n > PALETTE_MAX_COMPRESSED_VARIANT_N) {
-        return PackedVoxel(blob_u32s[palette_voxel_index]);
-    }
-    auto bits_per_variant = ceil_log2(palette_header.variant_n);
-    auto mask = (~0u) >> (32 - bits_per_variant);
-    auto bit_index = palette_voxel_index * bits_per_variant;
-    auto data_index = bit_index / 32;
-    auto data_offset = bit_index - data_index * 32;
-    auto my_palette_index = (blob_u32s[palette_header.variant_n + data_index + 0] >> data_offset) & mask;
-    if (data_offset + bits_per_variant > 32) {
-        auto shift = bits_per_variant - ((data_offset + bits_per_variant) & 0x1f);
-        my_palette_index |= (blob_u32s[palette_header.variant_n + data_index + 1] << shift) & mask;
-    }
-    auto voxel_data = blob_u32s[my_palette_index];
-
-    // debug_utils::Console::add_log(fmt::format("\nCPU {} ", bit_index));
-
-    // debug_utils::Console::add_log("\nCPU ");
-    // for (uint32_t i = 0; i < palette_header.variant_n; ++i) {
-    //     debug_utils::Console::add_log(fmt::format("{} ", blob_u32s[i]));
-    // }
-    // debug_utils::Console::add_log("\n");
-
-    return PackedVoxel(voxel_data);
+    return PackedVoxel(decode_palette_voxel(palette_header, palette_voxel_index));
 }
 
 PackedVoxel sample_voxel_chunk(CpuVoxelChunk const &voxel_chunk, glm::uvec3 inchunk_voxel_i) {
@@ -119,6 +92,10 @@ auto get_aligned(daxa_u64 operand, daxa_u64 granularity) -> daxa_u64 {
     return ((operand + (granularity - 1)) & ~(granularity - 1));
 };
 
+static auto acceleration_structure_memory_tag() -> GpuMemoryTag {
+    return {.owner = "voxel_world", .category = GpuMemoryCategory::ACCELERATION_STRUCTURES, .lifetime = GpuMemoryLifetime::PERSISTENT};
+}
+
 void VoxelWorld::record_startup(GpuContext &gpu_context) {
     buffers.chunk_updates = gpu_context.find_or_add_temporal_buffer({
         .size = sizeof(ChunkUpdate) * MAX_CHUNK_UPDATES_PER_FRAME * (FRAMES_IN_FLIGHT + 1),
@@ -142,16 +119,10 @@ void VoxelWorld::record_startup(GpuContext &gpu_context) {
         .size = sizeof(VoxelLeafChunk) * chunk_n,
         .name = "voxel_chunks",
     });
-    voxel_chunks.resize(chunk_n);
+    init_cpu_chunks();
 
     init_gpu_malloc(gpu_context);
 
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.chunk_updates.task_resource);
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.chunk_update_heap.task_resource);
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.voxel_globals.task_resource);
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.voxel_chunks.task_resource);
-    buffers.voxel_malloc.for_each_task_buffer([&gpu_context](auto &task_buffer) { gpu_context.frame_task_graph.use_persistent_buffer(task_buffer); });
-
     gpu_context.startup_task_graph.use_persistent_buffer(buffers.voxel_globals.task_resource);
     gpu_context.startup_task_graph.use_persistent_buffer(buffers.voxel_chunks.task_resource);
     buffers.voxel_malloc.for_each_task_buffer([&gpu_context](auto &task_buffer) { gpu_context.startup_task_graph.use_persistent_buffer(task_buffer); });
@@ -221,6 +192,7 @@ void VoxelWorld::record_startup(GpuContext &gpu_context) {
 
     if (!rt_initialized) {
         rt_initialized = true;
+        auto const memory_scope = GpuMemoryTagScope{gpu_context.memory_tag, acceleration_structure_memory_tag()};
 
         auto acceleration_structure_scratch_offset_alignment = gpu_context.device.properties().acceleration_structure_properties.value().min_acceleration_structure_scratch_offset_alignment;
 
@@ -303,6 +275,7 @@ void VoxelWorld::record_startup(GpuContext &gpu_context) {
             .size = tlas_build_sizes.acceleration_structure_size,
             .name = "tlas",
         });
+        track_gpu_tlas(*memory_ledger, gpu_context.device, buffers.tlas, acceleration_structure_memory_tag());
         auto tlas_scratch_buffer = gpu_context.device.create_buffer({
             .size = tlas_build_sizes.build_scratch_size,
             .name = "tlas build scratch buffer",
@@ -328,17 +301,420 @@ void VoxelWorld::record_startup(GpuContext &gpu_context) {
         temp_task_graph.complete({});
         temp_task_graph.execute({});
     }
-
-    gpu_context.frame_task_graph.use_persistent_tlas(buffers.task_tlas);
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.blas_geom_pointers.task_resource);
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.blas_attr_pointers.task_resource);
-    gpu_context.frame_task_graph.use_persistent_buffer(buffers.blas_transforms.task_resource);
 }
 
 static constexpr auto chunk_index(int xi, int yi, int zi) {
     return xi + yi * CHUNKS_PER_AXIS + zi * CHUNKS_PER_AXIS * CHUNKS_PER_AXIS;
 }
 
+static auto voxel_is_air(uint32_t packed_voxel_data) -> bool {
+    auto material_type = (packed_voxel_data >> 0) & 3;
+    return material_type == 0;
+}
+
+void VoxelWorld::init_cpu_chunks() {
+    auto chunk_n = (CHUNKS_PER_AXIS);
+    chunk_n = chunk_n * chunk_n * chunk_n;
+    if (!voxel_chunks.empty()) {
+        return;
+    }
+    voxel_chunks.resize(chunk_n);
+    occupancy.init(chunk_n);
+    tlas_instance_tracker.init(static_cast<uint32_t>(chunk_n));
+    dirty_chunk_indices.clear();
+    for (uint32_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
+        if (voxel_chunks[chunk_i].needs_blas_rebuild) {
+            dirty_chunk_indices.push_back(chunk_i);
+        }
+    }
+}
+
+void VoxelWorld::clear_cpu_chunks() {
+    for (uint32_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
+        auto &voxel_chunk = voxel_chunks[chunk_i];
+        for (auto &palette_chunk : voxel_chunk.palette_chunks) {
+            palette_blob_allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+            palette_chunk = {};
+        }
+        voxel_chunk.needs_save = false;
+        voxel_chunk.world_chunk.reset();
+        // Rebuilding the now empty chunk drops its BLAS and frees its TLAS instance slot.
+        mark_chunk_dirty(chunk_i);
+    }
+    occupancy.init(voxel_chunks.size());
+}
+
+void VoxelWorld::mark_chunk_dirty(uint32_t chunk_i) {
+    auto &voxel_chunk = voxel_chunks[chunk_i];
+    if (!voxel_chunk.needs_blas_rebuild) {
+        voxel_chunk.needs_blas_rebuild = true;
+        dirty_chunk_indices.push_back(chunk_i);
+    }
+}
+
+auto VoxelWorld::apply_chunk_updates(std::span<ChunkUpdate const> chunk_updates, uint32_t const *output_heap, daxa_i32vec3 player_unit_offset) -> uint32_t {
+    auto copied_bytes = 0u;
+    for (auto const &chunk_update : chunk_updates) {
+        if (chunk_update.info.flags != 1) {
+            // copied_bytes += sizeof(uint32_t);
+            continue;
+        }
+        copied_bytes += sizeof(chunk_update);
+        auto &voxel_chunk = voxel_chunks[chunk_update.info.chunk_index];
+        voxel_chunk.world_chunk = std::bit_cast<glm::ivec3>(chunk_update.info.world_chunk);
+        // The world brush generates the same terrain again, so only edits need saving. Generating
+        // the slot again drops an edit that wasn't saved.
+        voxel_chunk.needs_save = (chunk_update.info.brush_flags & (BRUSH_FLAGS_USER_BRUSH_A | BRUSH_FLAGS_USER_BRUSH_B)) != 0;
+
+        bool px_face_updated = false;
+        bool py_face_updated = false;
+        bool pz_face_updated = false;
+        bool nx_face_updated = false;
+        bool ny_face_updated = false;
+        bool nz_face_updated = false;
+
+        for (uint32_t palette_region_i = 0; palette_region_i < PALETTES_PER_CHUNK; ++palette_region_i) {
+            auto const &palette_header = chunk_update.palette_headers[palette_region_i];
+            auto &palette_chunk = voxel_chunk.palette_chunks[palette_region_i];
+            auto palette_size = palette_header.variant_n;
+            auto compressed_size = PaletteBlobAllocator::blob_size(palette_size);
+            palette_blob_allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+            palette_chunk.variant_n = palette_size;
+            if (palette_size > PALETTE_MAX_COMPRESSED_VARIANT_N) {
+                palette_size = PALETTE_REGION_TOTAL_SIZE;
+            }
+            auto prev_has_air = palette_chunk.has_air;
+            palette_chunk.has_air = false;
+            if (compressed_size != 0) {
+                palette_chunk.blob_ptr = palette_blob_allocator.allocate(palette_chunk.variant_n);
+                memcpy(palette_chunk.blob_ptr, output_heap + palette_header.blob_ptr, compressed_size * sizeof(uint32_t));
+                copied_bytes += compressed_size * sizeof(uint32_t);
+                for (uint32_t i = 0; i < palette_size; ++i) {
+                    if (voxel_is_air(palette_chunk.blob_ptr[i])) {
+                        palette_chunk.has_air = true;
+                        break;
+                    }
+                }
+            } else {
+                palette_chunk.blob_ptr = std::bit_cast<uint32_t *>(size_t(palette_header.blob_ptr));
+                if (voxel_is_air(palette_header.blob_ptr)) {
+                    palette_chunk.has_air = true;
+                }
+            }
+
+            if (palette_chunk.has_air != prev_has_air) {
+                // updated palette chunk
+                auto palette_region_xi = (palette_region_i / 1) % PALETTES_PER_CHUNK_AXIS;
+                auto palette_region_yi = (palette_region_i / PALETTES_PER_CHUNK_AXIS) % PALETTES_PER_CHUNK_AXIS;
+                auto palette_region_zi = (palette_region_i / PALETTES_PER_CHUNK_AXIS / PALETTES_PER_CHUNK_AXIS);
+
+                if (palette_region_xi == 0)
+                    nx_face_updated = true;
+                if (palette_region_yi == 0)
+                    ny_face_updated = true;
+                if (palette_region_zi == 0)
+                    nz_face_updated = true;
+                if (palette_region_xi == PALETTES_PER_CHUNK_AXIS - 1)
+                    px_face_updated = true;
+                if (palette_region_yi == PALETTES_PER_CHUNK_AXIS - 1)
+                    py_face_updated = true;
+                if (palette_region_zi == PALETTES_PER_CHUNK_AXIS - 1)
+                    pz_face_updated = true;
+            }
+        }
+
+        occupancy.update_chunk(chunk_update.info.chunk_index, voxel_chunk);
+
+        {
+            auto chunk_xi = int(chunk_update.info.chunk_index / 1) % CHUNKS_PER_AXIS;
+            auto chunk_yi = int(chunk_update.info.chunk_index / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS;
+            auto chunk_zi = int(chunk_update.info.chunk_index / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS);
+
+            int32_t chunk_xi_ws = (int32_t(chunk_xi) - (player_unit_offset.x >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+            int32_t chunk_yi_ws = (int32_t(chunk_yi) - (player_unit_offset.y >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+            int32_t chunk_zi_ws = (int32_t(chunk_zi) - (player_unit_offset.z >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+
+            // mark neighbors as dirty
+            if (nx_face_updated && chunk_xi_ws != 0) {
+                auto chunk_nxi = (chunk_xi - 1) & (CHUNKS_PER_AXIS - 1);
+                mark_chunk_dirty(static_cast<uint32_t>(chunk_index(chunk_nxi, chunk_yi, chunk_zi)));
+            }
+            if (ny_face_updated && chunk_yi_ws != 0) {
+                auto chunk_nyi = (chunk_yi - 1) & (CHUNKS_PER_AXIS - 1);
+                mark_chunk_dirty(static_cast<uint32_t>(chunk_index(chunk_xi, chunk_nyi, chunk_zi)));
+            }
+            if (nz_face_updated && chunk_zi_ws != 0) {
+                auto chunk_nzi = (chunk_zi - 1) & (CHUNKS_PER_AXIS - 1);
+                mark_chunk_dirty(static_cast<uint32_t>(chunk_index(chunk_xi, chunk_yi, chunk_nzi)));
+            }
+            if (px_face_updated && chunk_xi_ws != (CHUNKS_PER_AXIS - 1)) {
+                auto chunk_nxi = (chunk_xi + 1) & (CHUNKS_PER_AXIS - 1);
+                mark_chunk_dirty(static_cast<uint32_t>(chunk_index(chunk_nxi, chunk_yi, chunk_zi)));
+            }
+            if (py_face_updated && chunk_yi_ws != (CHUNKS_PER_AXIS - 1)) {
+                auto chunk_nyi = (chunk_yi + 1) & (CHUNKS_PER_AXIS - 1);
+                mark_chunk_dirty(static_cast<uint32_t>(chunk_index(chunk_xi, chunk_nyi, chunk_zi)));
+            }
+            if (pz_face_updated && chunk_zi_ws != (CHUNKS_PER_AXIS - 1)) {
+                auto chunk_nzi = (chunk_zi + 1) & (CHUNKS_PER_AXIS - 1);
+                mark_chunk_dirty(static_cast<uint32_t>(chunk_index(chunk_xi, chunk_yi, chunk_nzi)));
+            }
+        }
+
+        mark_chunk_dirty(chunk_update.info.chunk_index);
+    }
+    return copied_bytes;
+}
+
+static void build_chunk_bricks(std::vector<CpuVoxelChunk> &voxel_chunks, uint64_t chunk_i, daxa_i32vec3 player_unit_offset) {
+    auto &voxel_chunk = voxel_chunks[chunk_i];
+    auto &blas_chunk = voxel_chunk.blas_chunk;
+    blas_chunk.blas_geoms.clear();
+    blas_chunk.attrib_bricks.clear();
+    for (int32_t palette_zi = 0; palette_zi < PALETTES_PER_CHUNK_AXIS; ++palette_zi) {
+        for (int32_t palette_yi = 0; palette_yi < PALETTES_PER_CHUNK_AXIS; ++palette_yi) {
+            for (int32_t palette_xi = 0; palette_xi < PALETTES_PER_CHUNK_AXIS; ++palette_xi) {
+                auto palette_region_i = palette_xi + palette_yi * PALETTES_PER_CHUNK_AXIS + palette_zi * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS;
+                auto &palette_chunk = voxel_chunk.palette_chunks[palette_region_i];
+                auto neighbors_air = false;
+                // check neighbor palettes
+                for (int32_t ni = 0; ni < 3; ++ni) {
+                    for (int32_t nj = -1; nj <= 1; nj += 2) {
+                        int32_t nxi = ni == 0 ? nj : 0;
+                        int32_t nyi = ni == 1 ? nj : 0;
+                        int32_t nzi = ni == 2 ? nj : 0;
+                        CpuPaletteChunk const *temp_palette_chunk = nullptr;
+                        if ((nxi == -1 && palette_xi == 0) || (nxi == 1 && palette_xi == PALETTES_PER_CHUNK_AXIS - 1) ||
+                            (nyi == -1 && palette_yi == 0) || (nyi == 1 && palette_yi == PALETTES_PER_CHUNK_AXIS - 1) ||
+                            (nzi == -1 && palette_zi == 0) || (nzi == 1 && palette_zi == PALETTES_PER_CHUNK_AXIS - 1)) {
+                            auto neighbor_chunk_xi = (int32_t(chunk_i % CHUNKS_PER_AXIS) + nxi) & (CHUNKS_PER_AXIS - 1);
+                            auto neighbor_chunk_yi = (int32_t((chunk_i / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS) + nyi) & (CHUNKS_PER_AXIS - 1);
+                            auto neighbor_chunk_zi = (int32_t(chunk_i / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS) + nzi) & (CHUNKS_PER_AXIS - 1);
+                            int32_t chunk_xi_ws = (int32_t(neighbor_chunk_xi) - (player_unit_offset.x >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+                            int32_t chunk_yi_ws = (int32_t(neighbor_chunk_yi) - (player_unit_offset.y >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+                            int32_t chunk_zi_ws = (int32_t(neighbor_chunk_zi) - (player_unit_offset.z >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+                            if ((nxi == -1 && chunk_xi_ws == (CHUNKS_PER_AXIS - 1)) || (nxi == 1 && chunk_xi_ws == 0) ||
+                                (nyi == -1 && chunk_yi_ws == (CHUNKS_PER_AXIS - 1)) || (nyi == 1 && chunk_yi_ws == 0) ||
+                                (nzi == -1 && chunk_zi_ws == (CHUNKS_PER_AXIS - 1)) || (nzi == 1 && chunk_zi_ws == 0))
+                                continue;
+                            auto &neighbor_chunk = voxel_chunks[chunk_index(neighbor_chunk_xi, neighbor_chunk_yi, neighbor_chunk_zi)];
+                            auto neighbor_palette_xi = (palette_xi + nxi) & (PALETTES_PER_CHUNK_AXIS - 1);
+                            auto neighbor_palette_yi = (palette_yi + nyi) & (PALETTES_PER_CHUNK_AXIS - 1);
+                            auto neighbor_palette_zi = (palette_zi + nzi) & (PALETTES_PER_CHUNK_AXIS - 1);
+                            temp_palette_chunk = &neighbor_chunk.palette_chunks[neighbor_palette_xi + neighbor_palette_yi * PALETTES_PER_CHUNK_AXIS + neighbor_palette_zi * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS];
+                        } else {
+                            temp_palette_chunk = &voxel_chunk.palette_chunks[palette_region_i + nxi + nyi * PALETTES_PER_CHUNK_AXIS + nzi * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS];
+                        }
+                        if (temp_palette_chunk->has_air) {
+                            neighbors_air = true;
+                        }
+                    }
+                }
+                if (((palette_chunk.variant_n > 1) || (palette_chunk.variant_n == 1 && !palette_chunk.has_air)) && neighbors_air) {
+                    blas_chunk.blas_geoms.push_back({});
+                    blas_chunk.attrib_bricks.push_back({});
+                    auto &blas_geom = blas_chunk.blas_geoms.back();
+                    auto &blas_attr = blas_chunk.attrib_bricks.back();
+                    auto blas_geom_i = palette_region_i;
+                    uint32_t blas_geom_xi = (blas_geom_i / 1) % 8;
+                    uint32_t blas_geom_yi = (blas_geom_i / 8) % 8;
+                    uint32_t blas_geom_zi = (blas_geom_i / 64) % 8;
+                    blas_geom.aabb.minimum = {
+                        blas_geom_xi * float(VOXEL_SIZE) * BLAS_BRICK_SIZE,
+                        blas_geom_yi * float(VOXEL_SIZE) * BLAS_BRICK_SIZE,
+                        blas_geom_zi * float(VOXEL_SIZE) * BLAS_BRICK_SIZE,
+                    };
+                    blas_geom.aabb.maximum = blas_geom.aabb.minimum;
+                    blas_geom.aabb.maximum.x += float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
+                    blas_geom.aabb.maximum.y += float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
+                    blas_geom.aabb.maximum.z += float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
+                    // Bricks are palette regions, so both are indexed the same way.
+                    static_assert(BLAS_BRICK_SIZE == PALETTE_REGION_SIZE);
+                    auto voxels = PaletteRegionVoxels{};
+                    decode_palette_region(palette_chunk, voxels);
+                    for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+                        blas_attr.packed_voxels[voxel_i] = PackedVoxel(voxels[voxel_i]);
+                    }
+                    auto solid_mask = PaletteRegionMask{};
+                    if (palette_chunk.has_air) {
+                        solid_mask = decode_palette_region_mask(palette_chunk, [](uint32_t voxel) { return !voxel_is_air(voxel); });
+                    } else {
+                        solid_mask.fill(~uint64_t{0});
+                    }
+                    for (uint32_t u32_i = 0; u32_i < PALETTE_REGION_TOTAL_SIZE / 32; ++u32_i) {
+                        blas_geom.bitmask[u32_i] = static_cast<uint32_t>(solid_mask[u32_i / 2] >> ((u32_i % 2) * 32));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void VoxelWorld::build_dirty_chunk_bricks(daxa_i32vec3 player_unit_offset, ThreadPool *thread_pool) {
+    // Each job only writes to its own chunk's BlasChunk, and only reads palettes, which aren't
+    // modified past apply_chunk_updates.
+    auto build_range = [this, player_unit_offset](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            build_chunk_bricks(voxel_chunks, dirty_chunk_indices[i], player_unit_offset);
+        }
+    };
+    if (thread_pool != nullptr) {
+        thread_pool->parallel_for(dirty_chunk_indices.size(), 4, build_range);
+    } else {
+        build_range(0, dirty_chunk_indices.size());
+    }
+}
+
+void VoxelWorld::clear_dirty_chunks() {
+    for (auto chunk_i : dirty_chunk_indices) {
+        voxel_chunks[chunk_i].needs_blas_rebuild = false;
+    }
+    dirty_chunk_indices.clear();
+}
+
+auto VoxelWorld::save_world(std::filesystem::path const &folder, bool only_changed, ThreadPool *thread_pool) -> WorldSaveStats {
+    PROFILE_ZONE("save_world");
+    auto chunks = std::vector<WorldSaveChunk>{};
+    auto chunk_indices = std::vector<uint32_t>{};
+    for (uint32_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
+        auto const &voxel_chunk = voxel_chunks[chunk_i];
+        if (!voxel_chunk.world_chunk.has_value() || (only_changed && !voxel_chunk.needs_save)) {
+            continue;
+        }
+        chunks.push_back({.chunk_pos = *voxel_chunk.world_chunk, .palette_chunks = voxel_chunk.palette_chunks});
+        chunk_indices.push_back(chunk_i);
+    }
+    auto world_save = WorldSave{folder};
+    auto const stats = world_save.save_chunks(chunks, thread_pool);
+    // Chunks of regions that failed are simply saved again next time.
+    if (stats.failed_region_n == 0) {
+        for (auto chunk_i : chunk_indices) {
+            voxel_chunks[chunk_i].needs_save = false;
+        }
+    }
+    return stats;
+}
+
+auto VoxelWorld::count_changed_saved_chunks(std::filesystem::path const &folder) -> uint32_t {
+    auto world_save = WorldSave{folder};
+    auto allocator = PaletteBlobAllocator{};
+    auto loaded = std::array<CpuPaletteChunk, PALETTES_PER_CHUNK>{};
+    auto current_voxels = PaletteRegionVoxels{};
+    auto loaded_voxels = PaletteRegionVoxels{};
+    auto changed_n = uint32_t{};
+    for (uint32_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
+        if (!voxel_chunks[chunk_i].world_chunk.has_value()) {
+            continue;
+        }
+        auto const status = world_save.load_chunk(*voxel_chunks[chunk_i].world_chunk, loaded, allocator);
+        if (status == WorldChunkLoadStatus::MISSING) {
+            continue;
+        }
+        auto is_changed = status == WorldChunkLoadStatus::CORRUPT;
+        for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK && !is_changed; ++region_i) {
+            decode_palette_region(voxel_chunks[chunk_i].palette_chunks[region_i], current_voxels);
+            decode_palette_region(loaded[region_i], loaded_voxels);
+            is_changed = current_voxels != loaded_voxels;
+        }
+        changed_n += is_changed ? 1 : 0;
+    }
+    for (auto &palette_chunk : loaded) {
+        allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+    }
+    return changed_n;
+}
+
+void VoxelWorld::add_console_commands() {
+    debug_utils::Console::add_command({
+        .name = "chunk_alloc_stats",
+        .help = "Prints the palette blob allocator and BLAS buffer pool stats",
+        .args = {},
+        .run = [this](CommandArgs const &) {
+            debug_utils::Console::add_log(fmt::format("palette blobs: {:.2f} MB reserved", static_cast<double>(palette_blob_allocator.reserved_bytes()) / 1'000'000.0));
+            for (uint32_t size_class_i = 1; size_class_i < PaletteBlobAllocator::SIZE_CLASS_N; ++size_class_i) {
+                auto const stats = palette_blob_allocator.stats(size_class_i);
+                if (stats.page_n == 0) {
+                    continue;
+                }
+                debug_utils::Console::add_log(fmt::format(
+                    "  class {:2} ({:4} u32s): {:5} pages, {:7} live, {:7} free",
+                    size_class_i, stats.slot_size_u32s, stats.page_n, stats.live_slot_n, stats.free_slot_n));
+            }
+            auto const log_pool = [](std::string_view name, SizeClassPool<daxa::BufferId> const &pool) {
+                debug_utils::Console::add_log(fmt::format(
+                    "{}: {}/{} reused, {} retired, {} destroyed, {:.2f} MB pooled",
+                    name, pool.stats.reuse_n, pool.stats.acquire_n, pool.stats.retire_n, pool.stats.destroy_n,
+                    static_cast<double>(pool.stats.pooled_bytes) / 1'000'000.0));
+            };
+            log_pool("blas buffers", blas_buffer_pool);
+            log_pool("blas scratch buffers", blas_scratch_buffer_pool);
+            log_pool("geometry buffers", geom_buffer_pool);
+            log_pool("attribute buffers", attr_buffer_pool);
+            debug_utils::Console::add_log(fmt::format(
+                "tlas: {} live instances in {} slots, {} uploaded in total, {} chunks waiting for a BLAS rebuild",
+                tlas_instance_tracker.stats.live_n, tlas_instance_tracker.slot_n(), tlas_instance_tracker.stats.total_updated_n, dirty_chunk_indices.size()));
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "rebuild_chunk",
+        .help = "Rebuilds the bricks and BLAS of one chunk, or of all of them with -1",
+        .args = {{.name = "chunk_index", .type = CommandArgType::INT, .is_optional = false, .completions = {}}},
+        .run = [this](CommandArgs const &args) {
+            auto const chunk_i = args.get_int(0);
+            if (chunk_i == -1) {
+                for (uint32_t i = 0; i < voxel_chunks.size(); ++i) {
+                    mark_chunk_dirty(i);
+                }
+                return;
+            }
+            if (chunk_i < 0 || static_cast<size_t>(chunk_i) >= voxel_chunks.size()) {
+                debug_utils::Console::add_log(fmt::format("[error] There are only {} chunks", voxel_chunks.size()));
+                return;
+            }
+            mark_chunk_dirty(static_cast<uint32_t>(chunk_i));
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "tlas_full_update",
+        .help = "Uploads every TLAS instance each frame, rather than only the changed ones",
+        .args = {{.name = "enabled", .type = CommandArgType::BOOL, .is_optional = false, .completions = {}}},
+        .run = [this](CommandArgs const &args) { force_full_tlas_update = args.get_bool(0); },
+    });
+    debug_utils::Console::add_command({
+        .name = "world_save",
+        .help = "Saves the chunks that were edited since the last save, or all of them, as region files",
+        .args = {
+            {.name = "folder", .type = CommandArgType::STRING, .is_optional = true, .completions = {}},
+            {.name = "all", .type = CommandArgType::BOOL, .is_optional = true, .completions = {}},
+        },
+        .run = [this](CommandArgs const &args) {
+            auto const folder = args.has(0) ? std::filesystem::path{args.get_string(0)} : std::filesystem::path{".out/world"};
+            auto const only_changed = !(args.has(1) && args.get_bool(1));
+            auto const stats = save_world(folder, only_changed, ThreadPool::s_instance);
+            debug_utils::Console::add_log(fmt::format(
+                "Saved {} chunks into {} regions ({} kept as they were), {:.2f} MB stored",
+                stats.written_chunk_n, stats.region_n, stats.kept_chunk_n, static_cast<double>(stats.stored_bytes) / 1'000'000.0));
+        },
+    });
+    debug_utils::Console::add_command({
+        .name = "world_verify",
+        .help = "Counts the chunks whose saved copy differs from the current world",
+        .args = {{.name = "folder", .type = CommandArgType::STRING, .is_optional = true, .completions = {}}},
+        .run = [this](CommandArgs const &args) {
+            auto const folder = args.has(0) ? std::filesystem::path{args.get_string(0)} : std::filesystem::path{".out/world"};
+            debug_utils::Console::add_log(fmt::format("{} saved chunks differ from the world", count_changed_saved_chunks(folder)));
+        },
+    });
+}
+
+void VoxelWorld::remove_console_commands() {
+    debug_utils::Console::remove_command("chunk_alloc_stats");
+    debug_utils::Console::remove_command("rebuild_chunk");
+    debug_utils::Console::remove_command("tlas_full_update");
+    debug_utils::Console::remove_command("world_save");
+    debug_utils::Console::remove_command("world_verify");
+}
+
 void VoxelWorld::begin_frame(daxa::Device &device, GpuInput const &gpu_input, VoxelWorldOutput const &gpu_output) {
     buffers.voxel_malloc.check_for_realloc(device, gpu_output.voxel_malloc_output.current_element_count);
     // buffers.voxel_leaf_chunk_malloc.check_for_realloc(device, gpu_output.voxel_leaf_chunk_output.current_element_count);
@@ -393,257 +769,137 @@ void VoxelWorld::begin_frame(daxa::Device &device, GpuInput const &gpu_input, Vo
         chunk_updates.resize(MAX_CHUNK_UPDATES_PER_FRAME);
         memcpy(chunk_updates.data(), chunk_updates_ptr, chunk_updates.size() * sizeof(ChunkUpdate));
 
-        auto copied_bytes = 0u;
-
-        auto blas_instances_buffer = device.create_buffer({
-            .size = sizeof(daxa_BlasInstanceData) * voxel_chunks.size(),
-            .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-            .name = "blas instances array buffer",
-        });
-        defer { device.destroy_buffer(blas_instances_buffer); };
-        auto *blas_instances = device.get_host_address_as<daxa_BlasInstanceData>(blas_instances_buffer).value();
-
-        auto voxel_is_air = [](uint32_t packed_voxel_data) {
-            auto material_type = (packed_voxel_data >> 0) & 3;
-            return material_type == 0;
-        };
-
-        for (auto const &chunk_update : chunk_updates) {
-            if (chunk_update.info.flags != 1) {
-                // copied_bytes += sizeof(uint32_t);
-                continue;
-            }
-            copied_bytes += sizeof(chunk_update);
-            auto &voxel_chunk = voxel_chunks[chunk_update.info.chunk_index];
-
-            bool px_face_updated = false;
-            bool py_face_updated = false;
-            bool pz_face_updated = false;
-            bool nx_face_updated = false;
-            bool ny_face_updated = false;
-            bool nz_face_updated = false;
-
-            for (uint32_t palette_region_i = 0; palette_region_i < PALETTES_PER_CHUNK; ++palette_region_i) {
-                auto const &palette_header = chunk_update.palette_headers[palette_region_i];
-                auto &palette_chunk = voxel_chunk.palette_chunks[palette_region_i];
-                auto palette_size = palette_header.variant_n;
-                auto compressed_size = 0u;
-                if (palette_chunk.variant_n > 1) {
-                    delete[] palette_chunk.blob_ptr;
-                }
-                palette_chunk.variant_n = palette_size;
-                auto bits_per_variant = ceil_log2(palette_size);
-                if (palette_size > PALETTE_MAX_COMPRESSED_VARIANT_N) {
-                    compressed_size = PALETTE_REGION_TOTAL_SIZE;
-                    palette_size = PALETTE_REGION_TOTAL_SIZE;
-                } else if (palette_size > 1) {
-                    compressed_size = palette_size + (bits_per_variant * PALETTE_REGION_TOTAL_SIZE + 31) / 32;
-                } else {
-                    // no blob
-                }
-                auto prev_has_air = palette_chunk.has_air;
-                palette_chunk.has_air = false;
-                if (compressed_size != 0) {
-                    palette_chunk.blob_ptr = new uint32_t[compressed_size];
-                    memcpy(palette_chunk.blob_ptr, output_heap + palette_header.blob_ptr, compressed_size * sizeof(uint32_t));
-                    copied_bytes += compressed_size * sizeof(uint32_t);
-                    for (uint32_t i = 0; i < palette_size; ++i) {
-                        if (voxel_is_air(palette_chunk.blob_ptr[i])) {
-                            palette_chunk.has_air = true;
-                            break;
-                        }
-                    }
-                } else {
-                    palette_chunk.blob_ptr = std::bit_cast<uint32_t *>(size_t(palette_header.blob_ptr));
-                    if (voxel_is_air(palette_header.blob_ptr)) {
-                        palette_chunk.has_air = true;
-                    }
-                }
-
-                if (palette_chunk.has_air != prev_has_air) {
-                    // updated palette chunk
-                    auto palette_region_xi = (palette_region_i / 1) % PALETTES_PER_CHUNK_AXIS;
-                    auto palette_region_yi = (palette_region_i / PALETTES_PER_CHUNK_AXIS) % PALETTES_PER_CHUNK_AXIS;
-                    auto palette_region_zi = (palette_region_i / PALETTES_PER_CHUNK_AXIS / PALETTES_PER_CHUNK_AXIS);
-
-                    if (palette_region_xi == 0)
-                        nx_face_updated = true;
-                    if (palette_region_yi == 0)
-                        ny_face_updated = true;
-                    if (palette_region_zi == 0)
-                        nz_face_updated = true;
-                    if (palette_region_xi == PALETTES_PER_CHUNK_AXIS - 1)
-                        px_face_updated = true;
-                    if (palette_region_yi == PALETTES_PER_CHUNK_AXIS - 1)
-                        py_face_updated = true;
-                    if (palette_region_zi == PALETTES_PER_CHUNK_AXIS - 1)
-                        pz_face_updated = true;
-                }
-            }
-
-            {
-                auto chunk_xi = int(chunk_update.info.chunk_index / 1) % CHUNKS_PER_AXIS;
-                auto chunk_yi = int(chunk_update.info.chunk_index / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS;
-                auto chunk_zi = int(chunk_update.info.chunk_index / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS);
-
-                int32_t chunk_xi_ws = (int32_t(chunk_xi) - (gpu_input.player.player_unit_offset.x >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-                int32_t chunk_yi_ws = (int32_t(chunk_yi) - (gpu_input.player.player_unit_offset.y >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-                int32_t chunk_zi_ws = (int32_t(chunk_zi) - (gpu_input.player.player_unit_offset.z >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-
-                // mark neighbors as dirty
-                if (nx_face_updated && chunk_xi_ws != 0) {
-                    auto chunk_nxi = (chunk_xi - 1) & (CHUNKS_PER_AXIS - 1);
-                    voxel_chunks[chunk_index(chunk_nxi, chunk_yi, chunk_zi)].needs_blas_rebuild = true;
-                }
-                if (ny_face_updated && chunk_yi_ws != 0) {
-                    auto chunk_nyi = (chunk_yi - 1) & (CHUNKS_PER_AXIS - 1);
-                    voxel_chunks[chunk_index(chunk_xi, chunk_nyi, chunk_zi)].needs_blas_rebuild = true;
-                }
-                if (nz_face_updated && chunk_zi_ws != 0) {
-                    auto chunk_nzi = (chunk_zi - 1) & (CHUNKS_PER_AXIS - 1);
-                    voxel_chunks[chunk_index(chunk_xi, chunk_yi, chunk_nzi)].needs_blas_rebuild = true;
-                }
-                if (px_face_updated && chunk_xi_ws != (CHUNKS_PER_AXIS - 1)) {
-                    auto chunk_nxi = (chunk_xi + 1) & (CHUNKS_PER_AXIS - 1);
-                    voxel_chunks[chunk_index(chunk_nxi, chunk_yi, chunk_zi)].needs_blas_rebuild = true;
-                }
-                if (py_face_updated && chunk_yi_ws != (CHUNKS_PER_AXIS - 1)) {
-                    auto chunk_nyi = (chunk_yi + 1) & (CHUNKS_PER_AXIS - 1);
-                    voxel_chunks[chunk_index(chunk_xi, chunk_nyi, chunk_zi)].needs_blas_rebuild = true;
-                }
-                if (pz_face_updated && chunk_zi_ws != (CHUNKS_PER_AXIS - 1)) {
-                    auto chunk_nzi = (chunk_zi + 1) & (CHUNKS_PER_AXIS - 1);
-                    voxel_chunks[chunk_index(chunk_xi, chunk_yi, chunk_nzi)].needs_blas_rebuild = true;
-                }
-            }
+        if (replay_recorder != nullptr) {
+            replay_recorder->record_chunk_updates(chunk_updates, output_heap);
+        }
 
-            voxel_chunk.needs_blas_rebuild = true;
+        [[maybe_unused]] auto copied_bytes = uint32_t{};
+        {
+            PROFILE_ZONE("apply_chunk_updates");
+            copied_bytes = apply_chunk_updates(chunk_updates, output_heap, gpu_input.player.player_unit_offset);
         }
+        PROFILE_COUNTER("chunk update bytes", copied_bytes);
 
         // if (copied_bytes > 0) {
         //     debug_utils::Console::add_log(fmt::format("{} MB copied", double(copied_bytes) / 1'000'000.0));
         // }
 
-        for (uint64_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
-            auto &voxel_chunk = voxel_chunks[chunk_i];
-            if (!voxel_chunk.needs_blas_rebuild) {
-                continue;
-            }
-            auto &blas_chunk = voxel_chunk.blas_chunk;
-            blas_chunk.blas_geoms.clear();
-            blas_chunk.attrib_bricks.clear();
-            for (int32_t palette_zi = 0; palette_zi < PALETTES_PER_CHUNK_AXIS; ++palette_zi) {
-                for (int32_t palette_yi = 0; palette_yi < PALETTES_PER_CHUNK_AXIS; ++palette_yi) {
-                    for (int32_t palette_xi = 0; palette_xi < PALETTES_PER_CHUNK_AXIS; ++palette_xi) {
-                        auto palette_region_i = palette_xi + palette_yi * PALETTES_PER_CHUNK_AXIS + palette_zi * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS;
-                        auto &palette_chunk = voxel_chunk.palette_chunks[palette_region_i];
-                        auto neighbors_air = false;
-                        // check neighbor palettes
-                        for (int32_t ni = 0; ni < 3; ++ni) {
-                            for (int32_t nj = -1; nj <= 1; nj += 2) {
-                                int32_t nxi = ni == 0 ? nj : 0;
-                                int32_t nyi = ni == 1 ? nj : 0;
-                                int32_t nzi = ni == 2 ? nj : 0;
-                                CpuPaletteChunk const *temp_palette_chunk = nullptr;
-                                if ((nxi == -1 && palette_xi == 0) || (nxi == 1 && palette_xi == PALETTES_PER_CHUNK_AXIS - 1) ||
-                                    (nyi == -1 && palette_yi == 0) || (nyi == 1 && palette_yi == PALETTES_PER_CHUNK_AXIS - 1) ||
-                                    (nzi == -1 && palette_zi == 0) || (nzi == 1 && palette_zi == PALETTES_PER_CHUNK_AXIS - 1)) {
-                                    auto neighbor_chunk_xi = (int32_t(chunk_i % CHUNKS_PER_AXIS) + nxi) & (CHUNKS_PER_AXIS - 1);
-                                    auto neighbor_chunk_yi = (int32_t((chunk_i / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS) + nyi) & (CHUNKS_PER_AXIS - 1);
-                                    auto neighbor_chunk_zi = (int32_t(chunk_i / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS) + nzi) & (CHUNKS_PER_AXIS - 1);
-                                    int32_t chunk_xi_ws = (int32_t(neighbor_chunk_xi) - (gpu_input.player.player_unit_offset.x >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-                                    int32_t chunk_yi_ws = (int32_t(neighbor_chunk_yi) - (gpu_input.player.player_unit_offset.y >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-                                    int32_t chunk_zi_ws = (int32_t(neighbor_chunk_zi) - (gpu_input.player.player_unit_offset.z >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-                                    if ((nxi == -1 && chunk_xi_ws == (CHUNKS_PER_AXIS - 1)) || (nxi == 1 && chunk_xi_ws == 0) ||
-                                        (nyi == -1 && chunk_yi_ws == (CHUNKS_PER_AXIS - 1)) || (nyi == 1 && chunk_yi_ws == 0) ||
-                                        (nzi == -1 && chunk_zi_ws == (CHUNKS_PER_AXIS - 1)) || (nzi == 1 && chunk_zi_ws == 0))
-                                        continue;
-                                    auto &neighbor_chunk = voxel_chunks[chunk_index(neighbor_chunk_xi, neighbor_chunk_yi, neighbor_chunk_zi)];
-                                    auto neighbor_palette_xi = (palette_xi + nxi) & (PALETTES_PER_CHUNK_AXIS - 1);
-                                    auto neighbor_palette_yi = (palette_yi + nyi) & (PALETTES_PER_CHUNK_AXIS - 1);
-                                    auto neighbor_palette_zi = (palette_zi + nzi) & (PALETTES_PER_CHUNK_AXIS - 1);
-                                    temp_palette_chunk = &neighbor_chunk.palette_chunks[neighbor_palette_xi + neighbor_palette_yi * PALETTES_PER_CHUNK_AXIS + neighbor_palette_zi * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS];
-                                } else {
-                                    temp_palette_chunk = &voxel_chunk.palette_chunks[palette_region_i + nxi + nyi * PALETTES_PER_CHUNK_AXIS + nzi * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS];
-                                }
-                                if (temp_palette_chunk->has_air) {
-                                    neighbors_air = true;
-                                }
-                            }
-                        }
-                        if (((palette_chunk.variant_n > 1) || (palette_chunk.variant_n == 1 && !palette_chunk.has_air)) && neighbors_air) {
-                            blas_chunk.blas_geoms.push_back({});
-                            blas_chunk.attrib_bricks.push_back({});
-                            auto &blas_geom = blas_chunk.blas_geoms.back();
-                            auto &blas_attr = blas_chunk.attrib_bricks.back();
-                            auto blas_geom_i = palette_region_i;
-                            uint32_t blas_geom_xi = (blas_geom_i / 1) % 8;
-                            uint32_t blas_geom_yi = (blas_geom_i / 8) % 8;
-                            uint32_t blas_geom_zi = (blas_geom_i / 64) % 8;
-                            blas_geom.aabb.minimum = {
-                                blas_geom_xi * float(VOXEL_SIZE) * BLAS_BRICK_SIZE,
-                                blas_geom_yi * float(VOXEL_SIZE) * BLAS_BRICK_SIZE,
-                                blas_geom_zi * float(VOXEL_SIZE) * BLAS_BRICK_SIZE,
-                            };
-                            blas_geom.aabb.maximum = blas_geom.aabb.minimum;
-                            blas_geom.aabb.maximum.x += float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
-                            blas_geom.aabb.maximum.y += float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
-                            blas_geom.aabb.maximum.z += float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
-                            for (int32_t zi = 0; zi < BLAS_BRICK_SIZE; ++zi) {
-                                for (int32_t yi = 0; yi < BLAS_BRICK_SIZE; ++yi) {
-                                    for (int32_t xi = 0; xi < BLAS_BRICK_SIZE; ++xi) {
-                                        const uint32_t bit_index = xi + yi * BLAS_BRICK_SIZE + zi * BLAS_BRICK_SIZE * BLAS_BRICK_SIZE;
-                                        const uint32_t u32_index = bit_index / 32;
-                                        const uint32_t in_u32_index = bit_index & 0x1f;
-                                        blas_geom.bitmask[u32_index] &= ~(1 << in_u32_index);
-                                        auto packed_voxel = sample_palette(palette_chunk, bit_index);
-                                        blas_attr.packed_voxels[bit_index] = packed_voxel;
-                                        // set bit
-                                        if (!voxel_is_air(packed_voxel.data)) {
-                                            blas_geom.bitmask[u32_index] |= 1 << in_u32_index;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+        {
+            PROFILE_ZONE("build_dirty_chunk_bricks");
+            build_dirty_chunk_bricks(gpu_input.player.player_unit_offset, ThreadPool::s_instance);
         }
 
+        // Buffers retired this frame may be used by the GPU until the frames in flight are done.
+        auto const frame_index = uint64_t{gpu_input.frame_index};
+        auto const retire_frame_latency = uint64_t{FRAMES_IN_FLIGHT + 1};
+        auto const destroy_buffer = [this, &device](daxa::BufferId buffer) {
+            untrack_gpu_buffer(*memory_ledger, buffer);
+            device.destroy_buffer(buffer);
+        };
+        blas_buffer_pool.collect(frame_index, retire_frame_latency, destroy_buffer);
+        blas_scratch_buffer_pool.collect(frame_index, retire_frame_latency, destroy_buffer);
+        geom_buffer_pool.collect(frame_index, retire_frame_latency, destroy_buffer);
+        attr_buffer_pool.collect(frame_index, retire_frame_latency, destroy_buffer);
+
         auto geom_pointers_host_ptr = device.get_host_address_as<daxa::DeviceAddress>(staging_blas_geom_pointers.resource_id).value();
         auto attr_pointers_host_ptr = device.get_host_address_as<daxa::DeviceAddress>(staging_blas_attr_pointers.resource_id).value();
+        auto blas_transforms_host_ptr = device.get_host_address_as<daxa_f32vec3>(staging_blas_transforms.resource_id).value();
         auto acceleration_structure_scratch_offset_alignment = device.properties().acceleration_structure_properties.value().min_acceleration_structure_scratch_offset_alignment;
-        auto tracked_blases = std::vector<daxa::BlasId>{};
-        for (uint64_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
-            auto &voxel_chunk = voxel_chunks[chunk_i];
-            if (!voxel_chunk.needs_blas_rebuild) {
-                continue;
+
+        // Chunk positions only change when the player crosses into another chunk.
+        auto const chunk_shift = std::bit_cast<glm::ivec3>(gpu_input.player.player_unit_offset) >> glm::ivec3(6 + LOG2_VOXEL_SIZE);
+        auto const chunk_shift_changed = !blas_chunk_shift.has_value() || *blas_chunk_shift != chunk_shift;
+        blas_chunk_shift = chunk_shift;
+        auto const update_chunk_position = [&](uint32_t chunk_i) {
+            auto &blas_chunk = voxel_chunks[chunk_i].blas_chunk;
+            uint32_t chunk_xi = (chunk_i / 1) % CHUNKS_PER_AXIS;
+            uint32_t chunk_yi = (chunk_i / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS;
+            uint32_t chunk_zi = (chunk_i / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS;
+            auto const CHUNK_WS_SIZE = float(CHUNK_SIZE * VOXEL_SIZE);
+            int32_t chunk_xi_ws = (int32_t(chunk_xi) - (gpu_input.player.player_unit_offset.x >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+            int32_t chunk_yi_ws = (int32_t(chunk_yi) - (gpu_input.player.player_unit_offset.y >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+            int32_t chunk_zi_ws = (int32_t(chunk_zi) - (gpu_input.player.player_unit_offset.z >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
+            blas_chunk.position = {
+                chunk_xi_ws * CHUNK_WS_SIZE - CHUNK_WS_SIZE * (float(CHUNKS_PER_AXIS / 2)) - (gpu_input.player.player_unit_offset.x & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)),
+                chunk_yi_ws * CHUNK_WS_SIZE - CHUNK_WS_SIZE * (float(CHUNKS_PER_AXIS / 2)) - (gpu_input.player.player_unit_offset.y & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)),
+                chunk_zi_ws * CHUNK_WS_SIZE - CHUNK_WS_SIZE * (float(CHUNKS_PER_AXIS / 2)) - (gpu_input.player.player_unit_offset.z & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)),
+            };
+            blas_transforms_host_ptr[chunk_i] = blas_chunk.position;
+        };
+        auto const write_blas_instance = [&](uint32_t chunk_i) {
+            auto const &blas_chunk = voxel_chunks[chunk_i].blas_chunk;
+            auto const slot = tlas_instance_tracker.insert(chunk_i);
+            if (slot >= blas_instances.size()) {
+                blas_instances.resize(tlas_instance_tracker.slot_n());
+            }
+            blas_instances[slot] = daxa_BlasInstanceData{
+                .transform = {
+                    {1, 0, 0, blas_chunk.position.x},
+                    {0, 1, 0, blas_chunk.position.y},
+                    {0, 0, 1, blas_chunk.position.z},
+                },
+                .instance_custom_index = chunk_i,
+                .mask = 0xffu,
+                .instance_shader_binding_table_record_offset = 0,
+                .flags = {},
+                .blas_device_address = device.get_device_address(blas_chunk.blas).value(),
+            };
+        };
+        auto const acquire_buffer = [this, &device](SizeClassPool<daxa::BufferId> &pool, size_t size, char const *name) {
+            if (auto buffer = pool.acquire(size)) {
+                return *buffer;
+            }
+            auto const buffer = device.create_buffer({
+                .size = SizeClassPool<daxa::BufferId>::class_size(SizeClassPool<daxa::BufferId>::size_class(size)),
+                .name = name,
+            });
+            track_gpu_buffer(*memory_ledger, device, buffer, acceleration_structure_memory_tag());
+            return buffer;
+        };
+
+        if (chunk_shift_changed) {
+            for (uint32_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
+                update_chunk_position(chunk_i);
             }
+        }
+
+        auto built_chunk_indices = std::vector<uint32_t>{};
+        auto blas_scratch_offsets = std::vector<size_t>{};
+        auto blas_scratch_size = size_t{0};
+        for (auto chunk_i : dirty_chunk_indices) {
+            auto &voxel_chunk = voxel_chunks[chunk_i];
             auto &blas_chunk = voxel_chunk.blas_chunk;
-            if (blas_chunk.blas_geoms.empty()) {
-                continue;
+
+            // The previous BLAS may still be traced by the frames in flight. Destroying it is
+            // deferred by the device, and its buffers go back to the pools once they are done.
+            if (!blas_chunk.blas.is_empty()) {
+                device.destroy_blas(blas_chunk.blas);
+                blas_chunk.blas = {};
+                blas_buffer_pool.retire(blas_chunk.blas_buffer, blas_chunk.blas_buffer_size, frame_index);
+                geom_buffer_pool.retire(blas_chunk.geom_buffer, blas_chunk.geom_buffer_size, frame_index);
+                attr_buffer_pool.retire(blas_chunk.attr_buffer, blas_chunk.attr_buffer_size, frame_index);
+                blas_chunk.blas_buffer = {};
+                blas_chunk.geom_buffer = {};
+                blas_chunk.attr_buffer = {};
             }
 
-            {
-                if (!blas_chunk.attr_buffer.is_empty()) {
-                    device.destroy_buffer(blas_chunk.attr_buffer);
+            if (blas_chunk.blas_geoms.empty()) {
+                auto const slot = tlas_instance_tracker.slot_of(chunk_i);
+                if (slot != TlasInstanceTracker::INVALID) {
+                    blas_instances[slot] = {};
+                    tlas_instance_tracker.erase(chunk_i);
                 }
-                blas_chunk.attr_buffer = device.create_buffer({
-                    .size = sizeof(VoxelBrickAttribs) * blas_chunk.attrib_bricks.size(),
-                    .name = "attr_buffer",
-                });
-                auto attr_dev_ptr = device.get_device_address(blas_chunk.attr_buffer).value();
-                attr_pointers_host_ptr[chunk_i] = attr_dev_ptr;
+                geom_pointers_host_ptr[chunk_i] = {};
+                attr_pointers_host_ptr[chunk_i] = {};
+                continue;
             }
 
-            if (!blas_chunk.geom_buffer.is_empty()) {
-                device.destroy_buffer(blas_chunk.geom_buffer);
-            }
-            blas_chunk.geom_buffer = device.create_buffer({
-                .size = sizeof(BlasGeom) * blas_chunk.blas_geoms.size(),
-                .name = "geom_buffer",
-            });
+            blas_chunk.attr_buffer_size = sizeof(VoxelBrickAttribs) * blas_chunk.attrib_bricks.size();
+            blas_chunk.attr_buffer = acquire_buffer(attr_buffer_pool, blas_chunk.attr_buffer_size, "attr_buffer");
+            attr_pointers_host_ptr[chunk_i] = device.get_device_address(blas_chunk.attr_buffer).value();
+
+            blas_chunk.geom_buffer_size = sizeof(BlasGeom) * blas_chunk.blas_geoms.size();
+            blas_chunk.geom_buffer = acquire_buffer(geom_buffer_pool, blas_chunk.geom_buffer_size, "geom_buffer");
             auto geom_dev_ptr = device.get_device_address(blas_chunk.geom_buffer).value();
             geom_pointers_host_ptr[chunk_i] = geom_dev_ptr;
             auto geometry = std::array{
@@ -661,21 +917,10 @@ void VoxelWorld::begin_frame(daxa::Device &device, GpuInput const &gpu_input, Vo
                 .scratch_data = {}, // Ignored in get_acceleration_structure_build_sizes.
             };
             auto build_size_info = device.get_blas_build_sizes(blas_chunk.blas_build_info);
-            auto scratch_alignment_size = get_aligned(build_size_info.build_scratch_size, acceleration_structure_scratch_offset_alignment);
-            auto blas_scratch_buffer = device.create_buffer({
-                .size = scratch_alignment_size,
-                .name = "blas_scratch_buffer",
-            });
-            defer { device.destroy_buffer(blas_scratch_buffer); };
-            blas_chunk.blas_build_info.scratch_data = device.get_device_address(blas_scratch_buffer).value();
-            auto build_aligment_size = get_aligned(build_size_info.acceleration_structure_size, ACCELERATION_STRUCTURE_BUILD_OFFSET_ALIGMENT);
-            if (!blas_chunk.blas_buffer.is_empty()) {
-                device.destroy_buffer(blas_chunk.blas_buffer);
-            }
-            blas_chunk.blas_buffer = device.create_buffer({
-                .size = build_aligment_size,
-                .name = "blas_buffer",
-            });
+            blas_scratch_offsets.push_back(blas_scratch_size);
+            blas_scratch_size += get_aligned(build_size_info.build_scratch_size, acceleration_structure_scratch_offset_alignment);
+            blas_chunk.blas_buffer_size = get_aligned(build_size_info.acceleration_structure_size, ACCELERATION_STRUCTURE_BUILD_OFFSET_ALIGMENT);
+            blas_chunk.blas_buffer = acquire_buffer(blas_buffer_pool, blas_chunk.blas_buffer_size, "blas_buffer");
             blas_chunk.blas = device.create_blas_from_buffer({
                 .blas_info = {
                     .size = build_size_info.acceleration_structure_size,
@@ -685,144 +930,112 @@ void VoxelWorld::begin_frame(daxa::Device &device, GpuInput const &gpu_input, Vo
                 .offset = 0,
             });
             blas_chunk.blas_build_info.dst_blas = blas_chunk.blas;
-            tracked_blases.push_back(blas_chunk.blas);
-        }
+            built_chunk_indices.push_back(chunk_i);
 
-        for (uint64_t blas_i = 0; blas_i < voxel_chunks.size(); ++blas_i) {
-            auto &voxel_chunk = voxel_chunks[blas_i];
-            auto &blas_chunk = voxel_chunk.blas_chunk;
-            if (blas_chunk.blas_geoms.empty()) {
-                continue;
-            }
-            auto blas_iter = std::find(tracked_blases.begin(), tracked_blases.end(), blas_chunk.blas);
-            if (blas_iter == tracked_blases.end()) {
-                tracked_blases.push_back(blas_chunk.blas);
+            if (!chunk_shift_changed) {
+                update_chunk_position(chunk_i);
             }
+            write_blas_instance(chunk_i);
         }
-        task_chunk_blases.set_blas({.blas = tracked_blases});
-        temp_task_graph.use_persistent_blas(task_chunk_blases);
-
-        auto blas_transforms_host_ptr = device.get_host_address_as<daxa_f32vec3>(staging_blas_transforms.resource_id).value();
 
-        auto blas_instance_info = std::array{
-            daxa::TlasInstanceInfo{
-                .data = {}, // Ignored in get_acceleration_structure_build_sizes.
-                .count = static_cast<uint32_t>(voxel_chunks.size()),
-                .is_data_array_of_pointers = false, // Buffer contains flat array of instances, not an array of pointers to instances.
-                .flags = daxa::GeometryFlagBits::OPAQUE,
-            },
-        };
-        for (size_t blas_i = 0; blas_i < voxel_chunks.size(); ++blas_i) {
-            auto &voxel_chunk = voxel_chunks[blas_i];
-            auto &blas_chunk = voxel_chunk.blas_chunk;
-
-            auto chunk_i = blas_i;
-            uint32_t chunk_xi = (chunk_i / 1) % CHUNKS_PER_AXIS;
-            uint32_t chunk_yi = (chunk_i / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS;
-            uint32_t chunk_zi = (chunk_i / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS) % CHUNKS_PER_AXIS;
-            auto const CHUNK_WS_SIZE = float(CHUNK_SIZE * VOXEL_SIZE);
-            int32_t chunk_xi_ws = (int32_t(chunk_xi) - (gpu_input.player.player_unit_offset.x >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-            int32_t chunk_yi_ws = (int32_t(chunk_yi) - (gpu_input.player.player_unit_offset.y >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-            int32_t chunk_zi_ws = (int32_t(chunk_zi) - (gpu_input.player.player_unit_offset.z >> (6 + LOG2_VOXEL_SIZE))) & (CHUNKS_PER_AXIS - 1);
-            blas_chunk.position = {
-                chunk_xi_ws * CHUNK_WS_SIZE - CHUNK_WS_SIZE * (float(CHUNKS_PER_AXIS / 2)) - (gpu_input.player.player_unit_offset.x & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)),
-                chunk_yi_ws * CHUNK_WS_SIZE - CHUNK_WS_SIZE * (float(CHUNKS_PER_AXIS / 2)) - (gpu_input.player.player_unit_offset.y & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)),
-                chunk_zi_ws * CHUNK_WS_SIZE - CHUNK_WS_SIZE * (float(CHUNKS_PER_AXIS / 2)) - (gpu_input.player.player_unit_offset.z & ((1 << (6 + LOG2_VOXEL_SIZE)) - 1)),
-            };
-            blas_transforms_host_ptr[blas_i] = blas_chunk.position;
-            blas_instances[blas_i] = daxa_BlasInstanceData{
-                .transform = {
-                    {1, 0, 0, blas_chunk.position.x},
-                    {0, 1, 0, blas_chunk.position.y},
-                    {0, 0, 1, blas_chunk.position.z},
-                },
-                .instance_custom_index = uint32_t(blas_i),
-                .mask = blas_chunk.blas_geoms.empty() ? 0x00u : 0xffu,
-                .instance_shader_binding_table_record_offset = 0,
-                .flags = {},
-                .blas_device_address = device.get_device_address(blas_chunk.blas).value(),
-            };
+        if (chunk_shift_changed) {
+            for (auto chunk_i : tlas_instance_tracker.slot_keys) {
+                if (chunk_i != TlasInstanceTracker::INVALID) {
+                    write_blas_instance(chunk_i);
+                }
+            }
         }
-        temp_task_graph.use_persistent_buffer(staging_blas_geom_pointers.task_resource);
-        temp_task_graph.use_persistent_buffer(buffers.blas_geom_pointers.task_resource);
-        temp_task_graph.use_persistent_buffer(staging_blas_attr_pointers.task_resource);
-        temp_task_graph.use_persistent_buffer(buffers.blas_attr_pointers.task_resource);
-        temp_task_graph.use_persistent_buffer(staging_blas_transforms.task_resource);
-        temp_task_graph.use_persistent_buffer(buffers.blas_transforms.task_resource);
-        temp_task_graph.add_task({
-            .attachments = {
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, staging_blas_geom_pointers.task_resource),
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, buffers.blas_geom_pointers.task_resource),
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, staging_blas_attr_pointers.task_resource),
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, buffers.blas_attr_pointers.task_resource),
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, staging_blas_transforms.task_resource),
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, buffers.blas_transforms.task_resource),
-            },
-            .task = [&](daxa::TaskInterface const &ti) {
-                ti.recorder.copy_buffer_to_buffer({
-                    .src_buffer = ti.get(daxa::TaskBufferAttachmentIndex{0}).ids[0],
-                    .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{1}).ids[0],
-                    .size = sizeof(daxa::DeviceAddress) * voxel_chunks.size(),
-                });
-                ti.recorder.copy_buffer_to_buffer({
-                    .src_buffer = ti.get(daxa::TaskBufferAttachmentIndex{2}).ids[0],
-                    .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{3}).ids[0],
-                    .size = sizeof(daxa::DeviceAddress) * voxel_chunks.size(),
-                });
-                ti.recorder.copy_buffer_to_buffer({
-                    .src_buffer = ti.get(daxa::TaskBufferAttachmentIndex{4}).ids[0],
-                    .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{5}).ids[0],
-                    .size = sizeof(daxa_f32vec3) * voxel_chunks.size(),
-                });
 
-                // NOTE(grundlett): Hacky way of not needing to sync on these buffers...
+        // All BLASes of this frame share one scratch buffer, at disjoint offsets.
+        if (blas_scratch_size != 0) {
+            auto blas_scratch_buffer = acquire_buffer(blas_scratch_buffer_pool, blas_scratch_size, "blas_scratch_buffer");
+            auto blas_scratch_address = device.get_device_address(blas_scratch_buffer).value();
+            for (size_t built_i = 0; built_i < built_chunk_indices.size(); ++built_i) {
+                voxel_chunks[built_chunk_indices[built_i]].blas_chunk.blas_build_info.scratch_data = blas_scratch_address + blas_scratch_offsets[built_i];
+            }
+            blas_scratch_buffer_pool.retire(blas_scratch_buffer, blas_scratch_size, frame_index);
+        }
 
-                for (uint64_t chunk_i = 0; chunk_i < voxel_chunks.size(); ++chunk_i) {
-                    auto &voxel_chunk = voxel_chunks[chunk_i];
-                    if (!voxel_chunk.needs_blas_rebuild) {
-                        continue;
-                    }
-                    auto &blas_chunk = voxel_chunk.blas_chunk;
-                    if (blas_chunk.blas_geoms.empty()) {
-                        continue;
-                    }
+        auto live_blases = std::vector<daxa::BlasId>{};
+        live_blases.reserve(tlas_instance_tracker.stats.live_n);
+        for (auto chunk_i : tlas_instance_tracker.slot_keys) {
+            if (chunk_i != TlasInstanceTracker::INVALID) {
+                live_blases.push_back(voxel_chunks[chunk_i].blas_chunk.blas);
+            }
+        }
+        task_chunk_blases.set_blas({.blas = live_blases});
+        temp_task_graph.use_persistent_blas(task_chunk_blases);
 
-                    auto staging_buffer = ti.device.create_buffer({
-                        .size = sizeof(BlasGeom) * blas_chunk.blas_geoms.size() + sizeof(VoxelBrickAttribs) * blas_chunk.attrib_bricks.size(),
-                        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                        .name = "staging_buffer",
+        if (!dirty_chunk_indices.empty() || chunk_shift_changed) {
+            temp_task_graph.use_persistent_buffer(staging_blas_geom_pointers.task_resource);
+            temp_task_graph.use_persistent_buffer(buffers.blas_geom_pointers.task_resource);
+            temp_task_graph.use_persistent_buffer(staging_blas_attr_pointers.task_resource);
+            temp_task_graph.use_persistent_buffer(buffers.blas_attr_pointers.task_resource);
+            temp_task_graph.use_persistent_buffer(staging_blas_transforms.task_resource);
+            temp_task_graph.use_persistent_buffer(buffers.blas_transforms.task_resource);
+            temp_task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, staging_blas_geom_pointers.task_resource),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, buffers.blas_geom_pointers.task_resource),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, staging_blas_attr_pointers.task_resource),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, buffers.blas_attr_pointers.task_resource),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, staging_blas_transforms.task_resource),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, buffers.blas_transforms.task_resource),
+                },
+                .task = [&](daxa::TaskInterface const &ti) {
+                    ti.recorder.copy_buffer_to_buffer({
+                        .src_buffer = ti.get(daxa::TaskBufferAttachmentIndex{0}).ids[0],
+                        .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{1}).ids[0],
+                        .size = sizeof(daxa::DeviceAddress) * voxel_chunks.size(),
                     });
-                    ti.recorder.destroy_buffer_deferred(staging_buffer);
-                    auto staging_ptr = device.get_host_address_as<uint8_t>(staging_buffer).value();
-                    auto geom_host_ptr = reinterpret_cast<BlasGeom *>(staging_ptr + 0);
-                    auto attr_host_ptr = reinterpret_cast<VoxelBrickAttribs *>(staging_ptr + sizeof(BlasGeom) * blas_chunk.blas_geoms.size());
-                    std::copy(blas_chunk.blas_geoms.begin(), blas_chunk.blas_geoms.end(), geom_host_ptr);
-                    std::copy(blas_chunk.attrib_bricks.begin(), blas_chunk.attrib_bricks.end(), attr_host_ptr);
                     ti.recorder.copy_buffer_to_buffer({
-                        .src_buffer = staging_buffer,
-                        .dst_buffer = blas_chunk.geom_buffer,
-                        .size = sizeof(BlasGeom) * blas_chunk.blas_geoms.size(),
+                        .src_buffer = ti.get(daxa::TaskBufferAttachmentIndex{2}).ids[0],
+                        .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{3}).ids[0],
+                        .size = sizeof(daxa::DeviceAddress) * voxel_chunks.size(),
                     });
                     ti.recorder.copy_buffer_to_buffer({
-                        .src_buffer = staging_buffer,
-                        .dst_buffer = blas_chunk.attr_buffer,
-                        .src_offset = sizeof(BlasGeom) * blas_chunk.blas_geoms.size(),
-                        .size = sizeof(VoxelBrickAttribs) * blas_chunk.attrib_bricks.size(),
+                        .src_buffer = ti.get(daxa::TaskBufferAttachmentIndex{4}).ids[0],
+                        .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{5}).ids[0],
+                        .size = sizeof(daxa_f32vec3) * voxel_chunks.size(),
                     });
-                }
-            },
-            .name = "copy pointers",
-        });
 
-        temp_task_graph.add_task({
-            .attachments = {
-                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, buffers.blas_transforms.task_resource),
-                daxa::inl_attachment(daxa::TaskBlasAccess::BUILD_WRITE, task_chunk_blases),
-            },
-            .task = [&](daxa::TaskInterface const &ti) {
-                for (auto &voxel_chunk : voxel_chunks) {
-                    auto &blas_chunk = voxel_chunk.blas_chunk;
-                    if (!blas_chunk.blas_geoms.empty() && voxel_chunk.needs_blas_rebuild) {
+                    // NOTE(grundlett): Hacky way of not needing to sync on these buffers...
+
+                    for (auto chunk_i : built_chunk_indices) {
+                        auto &voxel_chunk = voxel_chunks[chunk_i];
+                        auto &blas_chunk = voxel_chunk.blas_chunk;
+
+                        auto const geom_size = sizeof(BlasGeom) * blas_chunk.blas_geoms.size();
+                        auto const staging = upload_ring->allocate(geom_size + sizeof(VoxelBrickAttribs) * blas_chunk.attrib_bricks.size());
+                        std::copy(blas_chunk.blas_geoms.begin(), blas_chunk.blas_geoms.end(), staging.as<BlasGeom>());
+                        std::copy(blas_chunk.attrib_bricks.begin(), blas_chunk.attrib_bricks.end(), reinterpret_cast<VoxelBrickAttribs *>(staging.host_ptr + geom_size));
+                        ti.recorder.copy_buffer_to_buffer({
+                            .src_buffer = staging.buffer,
+                            .dst_buffer = blas_chunk.geom_buffer,
+                            .src_offset = staging.offset,
+                            .size = geom_size,
+                        });
+                        ti.recorder.copy_buffer_to_buffer({
+                            .src_buffer = staging.buffer,
+                            .dst_buffer = blas_chunk.attr_buffer,
+                            .src_offset = staging.offset + geom_size,
+                            .size = sizeof(VoxelBrickAttribs) * blas_chunk.attrib_bricks.size(),
+                        });
+                    }
+                },
+                .name = "copy pointers",
+            });
+        }
+
+        if (!built_chunk_indices.empty()) {
+            temp_task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, buffers.blas_transforms.task_resource),
+                    daxa::inl_attachment(daxa::TaskBlasAccess::BUILD_WRITE, task_chunk_blases),
+                },
+                .task = [&](daxa::TaskInterface const &ti) {
+                    for (auto chunk_i : built_chunk_indices) {
+                        auto &blas_chunk = voxel_chunks[chunk_i].blas_chunk;
                         auto geom_dev_ptr = device.get_device_address(blas_chunk.geom_buffer).value();
                         auto geometry = std::array{
                             daxa::BlasAabbGeometryInfo{
@@ -837,55 +1050,183 @@ void VoxelWorld::begin_frame(daxa::Device &device, GpuInput const &gpu_input, Vo
                             .blas_build_infos = std::array{blas_chunk.blas_build_info},
                         });
                     }
-                    voxel_chunk.needs_blas_rebuild = false;
-                }
-            },
-            .name = "blas build",
-        });
+                },
+                .name = "blas build",
+            });
+        }
 
-        blas_instance_info[0].data = device.get_device_address(blas_instances_buffer).value();
-        auto tlas_build_info = daxa::TlasBuildInfo{
-            .flags = daxa::AccelerationStructureBuildFlagBits::PREFER_FAST_TRACE,
-            .dst_tlas = {}, // Ignored in get_acceleration_structure_build_sizes.
-            .instances = blas_instance_info,
-            .scratch_data = {}, // Ignored in get_acceleration_structure_build_sizes.
-        };
-        auto tlas_build_sizes = device.get_tlas_build_sizes(tlas_build_info);
-        if (!buffers.tlas.is_empty()) {
-            device.destroy_tlas(buffers.tlas);
+        // The TLAS (and the instance buffer it is built from) only get recreated when the instance
+        // count outgrows them.
+        auto const instance_n = tlas_instance_tracker.slot_n();
+        if (instance_n > tlas_instance_capacity) {
+            tlas_instance_capacity = std::max({instance_n, tlas_instance_capacity * 2, 1024u});
+            if (!blas_instances_buffer.is_empty()) {
+                untrack_gpu_buffer(*memory_ledger, blas_instances_buffer);
+                device.destroy_buffer(blas_instances_buffer);
+            }
+            blas_instances_buffer = device.create_buffer({
+                .size = sizeof(daxa_BlasInstanceData) * tlas_instance_capacity,
+                .name = "blas instances array buffer",
+            });
+            track_gpu_buffer(*memory_ledger, device, blas_instances_buffer, acceleration_structure_memory_tag());
+            task_blas_instances_buffer.set_buffers({.buffers = std::array{blas_instances_buffer}});
+            tlas_instance_tracker.mark_all_dirty();
+
+            auto blas_instance_info = std::array{
+                daxa::TlasInstanceInfo{
+                    .data = {}, // Ignored in get_acceleration_structure_build_sizes.
+                    .count = tlas_instance_capacity,
+                    .is_data_array_of_pointers = false, // Buffer contains flat array of instances, not an array of pointers to instances.
+                    .flags = daxa::GeometryFlagBits::OPAQUE,
+                },
+            };
+            auto tlas_build_sizes = device.get_tlas_build_sizes({
+                .flags = daxa::AccelerationStructureBuildFlagBits::PREFER_FAST_TRACE,
+                .instances = blas_instance_info,
+            });
+            if (!buffers.tlas.is_empty()) {
+                untrack_gpu_tlas(*memory_ledger, buffers.tlas);
+                device.destroy_tlas(buffers.tlas);
+            }
+            buffers.tlas = device.create_tlas({
+                .size = tlas_build_sizes.acceleration_structure_size,
+                .name = "tlas",
+            });
+            track_gpu_tlas(*memory_ledger, device, buffers.tlas, acceleration_structure_memory_tag());
+            buffers.task_tlas.set_tlas({.tlas = std::array{buffers.tlas}});
+            if (!tlas_scratch_buffer.is_empty()) {
+                untrack_gpu_buffer(*memory_ledger, tlas_scratch_buffer);
+                device.destroy_buffer(tlas_scratch_buffer);
+            }
+            tlas_scratch_buffer = device.create_buffer({
+                .size = tlas_build_sizes.build_scratch_size,
+                .name = "tlas build scratch buffer",
+            });
+            track_gpu_buffer(*memory_ledger, device, tlas_scratch_buffer, acceleration_structure_memory_tag());
         }
-        buffers.tlas = device.create_tlas({
-            .size = tlas_build_sizes.acceleration_structure_size,
-            .name = "tlas",
-        });
-        buffers.task_tlas.set_tlas({.tlas = std::array{buffers.tlas}});
-        auto tlas_scratch_buffer = device.create_buffer({
-            .size = tlas_build_sizes.build_scratch_size,
-            .name = "tlas build scratch buffer",
-        });
-        defer { device.destroy_buffer(tlas_scratch_buffer); };
-        tlas_build_info.dst_tlas = buffers.tlas;
-        tlas_build_info.scratch_data = device.get_device_address(tlas_scratch_buffer).value();
-        temp_task_graph.use_persistent_tlas(buffers.task_tlas);
-        temp_task_graph.add_task({
-            .attachments = {
-                daxa::inl_attachment(daxa::TaskBlasAccess::BUILD_READ, task_chunk_blases),
-                daxa::inl_attachment(daxa::TaskTlasAccess::BUILD_WRITE, buffers.task_tlas),
-            },
-            .task = [&](daxa::TaskInterface const &ti) {
-                ti.recorder.build_acceleration_structures({
-                    .tlas_build_infos = std::array{tlas_build_info},
-                });
-            },
-            .name = "tlas build",
-        });
+
+        if (force_full_tlas_update) {
+            tlas_instance_tracker.mark_all_dirty();
+        }
+        if (tlas_instance_tracker.has_dirty_slots()) {
+            auto const dirty_ranges = tlas_instance_tracker.take_dirty_ranges();
+            auto const instances_staging = upload_ring->allocate(sizeof(daxa_BlasInstanceData) * tlas_instance_tracker.stats.updated_n);
+            auto *staging_instances = instances_staging.as<daxa_BlasInstanceData>();
+            for (auto const &range : dirty_ranges) {
+                staging_instances = std::copy_n(blas_instances.begin() + range.first, range.count, staging_instances);
+            }
+
+            auto blas_instance_info = std::array{
+                daxa::TlasInstanceInfo{
+                    .data = device.get_device_address(blas_instances_buffer).value(),
+                    .count = instance_n,
+                    .is_data_array_of_pointers = false, // Buffer contains flat array of instances, not an array of pointers to instances.
+                    .flags = daxa::GeometryFlagBits::OPAQUE,
+                },
+            };
+            auto tlas_build_info = daxa::TlasBuildInfo{
+                .flags = daxa::AccelerationStructureBuildFlagBits::PREFER_FAST_TRACE,
+                .dst_tlas = buffers.tlas,
+                .instances = blas_instance_info,
+                .scratch_data = device.get_device_address(tlas_scratch_buffer).value(),
+            };
+            temp_task_graph.use_persistent_buffer(task_blas_instances_buffer);
+            temp_task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_blas_instances_buffer),
+                },
+                .task = [&](daxa::TaskInterface const &ti) {
+                    auto src_offset = instances_staging.offset;
+                    for (auto const &range : dirty_ranges) {
+                        ti.recorder.copy_buffer_to_buffer({
+                            .src_buffer = instances_staging.buffer,
+                            .dst_buffer = ti.get(daxa::TaskBufferAttachmentIndex{0}).ids[0],
+                            .src_offset = src_offset,
+                            .dst_offset = sizeof(daxa_BlasInstanceData) * range.first,
+                            .size = sizeof(daxa_BlasInstanceData) * range.count,
+                        });
+                        src_offset += sizeof(daxa_BlasInstanceData) * range.count;
+                    }
+                },
+                .name = "upload blas instances",
+            });
+            temp_task_graph.use_persistent_tlas(buffers.task_tlas);
+            temp_task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBlasAccess::BUILD_READ, task_chunk_blases),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::ACCELERATION_STRUCTURE_BUILD_READ, task_blas_instances_buffer),
+                    daxa::inl_attachment(daxa::TaskTlasAccess::BUILD_WRITE, buffers.task_tlas),
+                },
+                .task = [&](daxa::TaskInterface const &ti) {
+                    ti.recorder.build_acceleration_structures({
+                        .tlas_build_infos = std::array{tlas_build_info},
+                    });
+                },
+                .name = "tlas build",
+            });
+        }
+
+        debug_utils::DebugDisplay::set_debug_string(
+            "TLAS Instances",
+            fmt::format("{} live, {} updated", tlas_instance_tracker.stats.live_n, tlas_instance_tracker.stats.updated_n));
+        debug_utils::DebugDisplay::set_debug_string(
+            "BLAS Buffer Reuse",
+            fmt::format("{}/{} ({:.2f} MB pooled)", blas_buffer_pool.stats.reuse_n, blas_buffer_pool.stats.acquire_n, static_cast<double>(blas_buffer_pool.stats.pooled_bytes) / 1'000'000.0));
+
         temp_task_graph.submit({});
         temp_task_graph.complete({});
         temp_task_graph.execute({});
+        for (auto chunk_i : dirty_chunk_indices) {
+            voxel_chunks[chunk_i].needs_blas_rebuild = false;
+        }
+        dirty_chunk_indices.clear();
+    }
+}
+
+void VoxelWorld::destroy(daxa::Device &device) {
+    auto const destroy_buffer = [this, &device](daxa::BufferId buffer) {
+        untrack_gpu_buffer(*memory_ledger, buffer);
+        device.destroy_buffer(buffer);
+    };
+    for (auto &voxel_chunk : voxel_chunks) {
+        auto &blas_chunk = voxel_chunk.blas_chunk;
+        if (!blas_chunk.blas.is_empty()) {
+            device.destroy_blas(blas_chunk.blas);
+            destroy_buffer(blas_chunk.blas_buffer);
+            destroy_buffer(blas_chunk.geom_buffer);
+            destroy_buffer(blas_chunk.attr_buffer);
+            blas_chunk = {};
+        }
+    }
+    blas_buffer_pool.clear(destroy_buffer);
+    blas_scratch_buffer_pool.clear(destroy_buffer);
+    geom_buffer_pool.clear(destroy_buffer);
+    attr_buffer_pool.clear(destroy_buffer);
+    if (!blas_instances_buffer.is_empty()) {
+        destroy_buffer(blas_instances_buffer);
+    }
+    if (!tlas_scratch_buffer.is_empty()) {
+        destroy_buffer(tlas_scratch_buffer);
+    }
+    if (!buffers.tlas.is_empty()) {
+        untrack_gpu_tlas(*memory_ledger, buffers.tlas);
+        device.destroy_tlas(buffers.tlas);
     }
 }
 
 void VoxelWorld::record_frame(GpuContext &gpu_context, daxa::TaskBufferView task_gvox_model_buffer, VoxelParticles &particles) {
+    // The buffers are created by record_startup, but registered here, since the frame task graph is
+    // recorded again without the startup one.
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.chunk_updates.task_resource);
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.chunk_update_heap.task_resource);
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.voxel_globals.task_resource);
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.voxel_chunks.task_resource);
+    buffers.voxel_malloc.for_each_task_buffer([&gpu_context](auto &task_buffer) { gpu_context.frame_task_graph.use_persistent_buffer(task_buffer); });
+    gpu_context.frame_task_graph.use_persistent_tlas(buffers.task_tlas);
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.blas_geom_pointers.task_resource);
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.blas_attr_pointers.task_resource);
+    gpu_context.frame_task_graph.use_persistent_buffer(buffers.blas_transforms.task_resource);
+
     gpu_context.add(ComputeTask<VoxelWorldPerframeCompute::Task, VoxelWorldPerframeComputePush, NoTaskInfo>{
         .source = daxa::ShaderFile{"voxels/impl/perframe.comp.glsl"},
         .views = std::array{
@@ -918,6 +1259,20 @@ void VoxelWorld::record_frame(GpuContext &gpu_context, daxa::TaskBufferView task
         },
     });
 
+    gpu_context.add(ComputeTask<ChunkElectCompute::Task, ChunkElectComputePush, NoTaskInfo>{
+        .source = daxa::ShaderFile{"voxels/impl/voxel_world.comp.glsl"},
+        .views = std::array{
+            daxa::TaskViewVariant{std::pair{ChunkElectCompute::AT.voxel_globals, buffers.voxel_globals.task_resource}},
+            daxa::TaskViewVariant{std::pair{ChunkElectCompute::AT.voxel_chunks, buffers.voxel_chunks.task_resource}},
+        },
+        .callback_ = [](daxa::TaskInterface const &ti, daxa::ComputePipeline &pipeline, ChunkElectComputePush &push, NoTaskInfo const &) {
+            ti.recorder.set_pipeline(pipeline);
+            set_push_constant(ti, push);
+            auto const dispatch_size = CHUNKS_DISPATCH_SIZE;
+            ti.recorder.dispatch({dispatch_size, dispatch_size, dispatch_size});
+        },
+    });
+
     auto task_temp_voxel_chunks_buffer = gpu_context.frame_task_graph.create_transient_buffer({
         .size = sizeof(TempVoxelChunk) * MAX_CHUNK_UPDATES_PER_FRAME,
         .name = "temp_voxel_chunks_buffer",
@@ -33,6 +33,14 @@ struct PerChunkComputePush {
     DAXA_TH_BLOB(PerChunkCompute, uses)
 };
 
+DAXA_DECL_TASK_HEAD_BEGIN(ChunkElectCompute)
+DAXA_TH_BUFFER_PTR(COMPUTE_SHADER_READ_WRITE, daxa_RWBufferPtr(VoxelWorldGlobals), voxel_globals)
+DAXA_TH_BUFFER_PTR(COMPUTE_SHADER_READ_WRITE, daxa_RWBufferPtr(VoxelLeafChunk), voxel_chunks)
+DAXA_DECL_TASK_HEAD_END
+struct ChunkElectComputePush {
+    DAXA_TH_BLOB(ChunkElectCompute, uses)
+};
+
 DAXA_DECL_TASK_HEAD_BEGIN(ChunkEditCompute)
 DAXA_TH_BUFFER_PTR(COMPUTE_SHADER_READ, daxa_BufferPtr(GpuInput), gpu_input)
 DAXA_TH_BUFFER_PTR(COMPUTE_SHADER_READ, daxa_BufferPtr(GpuGvoxModel), gvox_model)
@@ -90,17 +98,24 @@ struct ChunkAllocComputePush {
 
 #if defined(__cplusplus)
 
-struct CpuPaletteChunk {
-    uint32_t has_air : 1 {};
-    uint32_t variant_n{};
-    uint32_t *blob_ptr{};
-};
+#include <optional>
+#include <span>
+#include <voxels/impl/acceleration_structure_tracker.hpp>
+#include <voxels/impl/palette_blob_allocator.hpp>
+#include <voxels/impl/palette_codec.hpp>
+#include <voxels/impl/voxel_occupancy.hpp>
+#include <voxels/impl/world_save.hpp>
+#include <utilities/thread_pool.hpp>
 
 struct BlasChunk {
     daxa::BlasId blas;
     daxa::BufferId blas_buffer;
     daxa::BufferId geom_buffer;
     daxa::BufferId attr_buffer;
+    // Sizes the pooled buffers above were acquired for.
+    size_t blas_buffer_size = 0;
+    size_t geom_buffer_size = 0;
+    size_t attr_buffer_size = 0;
     daxa::BlasBuildInfo blas_build_info;
     daxa_f32vec3 position;
     std::vector<BlasGeom> blas_geoms;
@@ -112,25 +127,87 @@ struct CpuVoxelChunk {
     BlasChunk blas_chunk;
 
     // TODO: Remove this
+    // Set while the chunk is in VoxelWorld::dirty_chunk_indices.
     bool needs_blas_rebuild = true;
+    // Set when the chunk was edited since it was last saved.
+    bool needs_save = false;
+    // Where the chunk in this slot is in the world, as of the update that filled it. The window
+    // scrolls before the GPU replaces the slots that left it, so this can't be told from the
+    // current player_unit_offset.
+    std::optional<glm::ivec3> world_chunk;
 };
 
+struct ReplayRecorder;
+
 struct VoxelWorld {
     VoxelWorldBuffers buffers;
     bool gpu_malloc_initialized = false;
     bool rt_initialized = false;
 
     std::vector<CpuVoxelChunk> voxel_chunks;
+    std::vector<uint32_t> dirty_chunk_indices;
+    PaletteBlobAllocator palette_blob_allocator;
+    // Solid voxels of voxel_chunks, for CPU-side collision and picking queries.
+    VoxelOccupancy occupancy;
     daxa::TaskBlas task_chunk_blases;
     TemporalBuffer staging_blas_geom_pointers;
     TemporalBuffer staging_blas_attr_pointers;
     TemporalBuffer staging_blas_transforms;
+    // Instances of the chunks that have a BLAS, by TlasInstanceTracker slot.
+    TlasInstanceTracker tlas_instance_tracker;
+    std::vector<daxa_BlasInstanceData> blas_instances;
+    daxa::BufferId blas_instances_buffer;
+    daxa::TaskBuffer task_blas_instances_buffer{{.name = "task_blas_instances_buffer"}};
+    daxa::BufferId tlas_scratch_buffer;
+    uint32_t tlas_instance_capacity = 0;
+    // Chunk offset the BLAS positions were last computed for.
+    std::optional<glm::ivec3> blas_chunk_shift;
+    SizeClassPool<daxa::BufferId> blas_buffer_pool;
+    SizeClassPool<daxa::BufferId> blas_scratch_buffer_pool;
+    SizeClassPool<daxa::BufferId> geom_buffer_pool;
+    SizeClassPool<daxa::BufferId> attr_buffer_pool;
+    // Where begin_frame stages the BLAS geometry and TLAS instance uploads. Has to be set before it
+    // is called.
+    GpuUploadRing *upload_ring = nullptr;
+    // What the BLAS buffers and the TLAS are tracked in. Has to be set before record_startup.
+    GpuMemoryLedger *memory_ledger = nullptr;
+    // When set, the chunk updates read back in begin_frame are recorded for replays.
+    ReplayRecorder *replay_recorder = nullptr;
+    // Set from the console, to compare against uploading only the TLAS instances that changed.
+    bool force_full_tlas_update = false;
 
     bool sample(daxa_f32vec3 pos, daxa_i32vec3 player_unit_offset);
     void init_gpu_malloc(GpuContext &gpu_context);
     void record_startup(GpuContext &gpu_context);
     void begin_frame(daxa::Device &device, GpuInput const &gpu_input, VoxelWorldOutput const &gpu_output);
+    // Only call this once the device is idle.
+    void destroy(daxa::Device &device);
+
+    // CPU-only halves of record_startup and begin_frame. These don't touch the device, so they can be
+    // driven headlessly.
+    // Sizes the chunks, their occupancy and their TLAS instance slots the first time. Recording the
+    // startup task graph again keeps them as they are.
+    void init_cpu_chunks();
+    // Empties every chunk, for when the startup task graph clears the world on the GPU.
+    void clear_cpu_chunks();
+    void mark_chunk_dirty(uint32_t chunk_index);
+    auto apply_chunk_updates(std::span<ChunkUpdate const> chunk_updates, uint32_t const *output_heap, daxa_i32vec3 player_unit_offset) -> uint32_t;
+    // Passing a null thread pool runs the extraction serially on the calling thread.
+    void build_dirty_chunk_bricks(daxa_i32vec3 player_unit_offset, ThreadPool *thread_pool);
+    // Leaves the chunks in the state the BLAS build would, without building anything.
+    void clear_dirty_chunks();
+    // Saves the chunks that were edited since the last save, or all of them, into the region files in
+    // `folder`. There's no way to load them back into the world yet, since chunks only get onto the
+    // GPU through the brushes.
+    auto save_world(std::filesystem::path const &folder, bool only_changed, ThreadPool *thread_pool) -> WorldSaveStats;
+    // Loads every chunk of the window back from `folder`, and returns how many differ from the
+    // current ones. Missing chunks don't count.
+    auto count_changed_saved_chunks(std::filesystem::path const &folder) -> uint32_t;
     void record_frame(GpuContext &gpu_context, daxa::TaskBufferView task_gvox_model_buffer, VoxelParticles &particles);
+
+    // The commands refer to this VoxelWorld, so remove them before it goes away.
+    void add_console_commands();
+    void remove_console_commands();
 };
 
 #endif
@@ -0,0 +1,188 @@
+#include <voxels/impl/voxel_world_test_helpers.hpp>
+#include <utilities/thread_pool.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+    struct ChunkBricks {
+        std::vector<BlasGeom> blas_geoms;
+        std::vector<VoxelBrickAttribs> attrib_bricks;
+    };
+
+    auto same_bricks(BlasChunk const &blas_chunk, ChunkBricks const &expected) -> bool {
+        return blas_chunk.blas_geoms.size() == expected.blas_geoms.size() &&
+               blas_chunk.attrib_bricks.size() == expected.attrib_bricks.size() &&
+               std::memcmp(blas_chunk.blas_geoms.data(), expected.blas_geoms.data(), expected.blas_geoms.size() * sizeof(BlasGeom)) == 0 &&
+               std::memcmp(blas_chunk.attrib_bricks.data(), expected.attrib_bricks.data(), expected.attrib_bricks.size() * sizeof(VoxelBrickAttribs)) == 0;
+    }
+
+    // Decodes the region a brick was built from voxel by voxel, and compares it with the brick.
+    auto check_brick(CpuVoxelChunk const &voxel_chunk, BlasGeom const &blas_geom, VoxelBrickAttribs const &attribs) -> std::string {
+        auto const brick_size = float(VOXEL_SIZE) * BLAS_BRICK_SIZE;
+        auto const palette_region_i =
+            static_cast<uint32_t>(blas_geom.aabb.minimum.x / brick_size + 0.5f) +
+            static_cast<uint32_t>(blas_geom.aabb.minimum.y / brick_size + 0.5f) * PALETTES_PER_CHUNK_AXIS +
+            static_cast<uint32_t>(blas_geom.aabb.minimum.z / brick_size + 0.5f) * PALETTES_PER_CHUNK_AXIS * PALETTES_PER_CHUNK_AXIS;
+        auto const &palette_chunk = voxel_chunk.palette_chunks[palette_region_i];
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+            auto const voxel = decode_palette_voxel(palette_chunk, voxel_i);
+            auto const is_solid = (voxel & 3) != 0;
+            if (attribs.packed_voxels[voxel_i].data != voxel || ((blas_geom.bitmask[voxel_i / 32] >> (voxel_i % 32)) & 1) != (is_solid ? 1u : 0u)) {
+                return fmt::format("voxel {} of region {} went into its brick wrong", voxel_i, palette_region_i);
+            }
+        }
+        return {};
+    }
+
+    // Builds the bricks of the same chunk updates serially and on the pool, which have to match
+    // exactly, and checks every brick against decoding its region voxel by voxel.
+    auto test_parallel_bricks_match_serial() -> std::string {
+        auto rng = std::mt19937{0};
+        auto pool = ThreadPool{};
+        pool.start(3);
+        auto voxel_world = std::make_unique<VoxelWorld>();
+        voxel_world->init_cpu_chunks();
+        // The first build covers every chunk, which are all empty.
+        voxel_world->build_dirty_chunk_bricks({}, &pool);
+        voxel_world->clear_dirty_chunks();
+
+        for (uint32_t frame_i = 0; frame_i < 3; ++frame_i) {
+            auto const updates = make_chunk_updates(rng, random_chunk_indices(rng, 60), 0.4f);
+            voxel_world->apply_chunk_updates(updates.chunk_updates, updates.heap.data(), {});
+            auto const &dirty_chunk_indices = voxel_world->dirty_chunk_indices;
+            auto const dirty_set = std::unordered_set<uint32_t>(dirty_chunk_indices.begin(), dirty_chunk_indices.end());
+            if (dirty_set.size() != dirty_chunk_indices.size()) {
+                return fmt::format("frame {}: a chunk is in the dirty list twice", frame_i);
+            }
+            for (auto const &chunk_update : updates.chunk_updates) {
+                if (!dirty_set.contains(chunk_update.info.chunk_index)) {
+                    return fmt::format("frame {}: updated chunk {} isn't dirty", frame_i, chunk_update.info.chunk_index);
+                }
+            }
+
+            voxel_world->build_dirty_chunk_bricks({}, nullptr);
+            auto serial_bricks = std::vector<ChunkBricks>{};
+            auto brick_n = size_t{0};
+            for (auto const chunk_i : dirty_chunk_indices) {
+                auto const &blas_chunk = voxel_world->voxel_chunks[chunk_i].blas_chunk;
+                serial_bricks.push_back({blas_chunk.blas_geoms, blas_chunk.attrib_bricks});
+                brick_n += blas_chunk.blas_geoms.size();
+            }
+            if (brick_n == 0) {
+                return fmt::format("frame {}: the updates didn't make any bricks", frame_i);
+            }
+
+            voxel_world->build_dirty_chunk_bricks({}, &pool);
+            for (size_t i = 0; i < dirty_chunk_indices.size(); ++i) {
+                auto const &voxel_chunk = voxel_world->voxel_chunks[dirty_chunk_indices[i]];
+                if (!same_bricks(voxel_chunk.blas_chunk, serial_bricks[i])) {
+                    return fmt::format("frame {}: the bricks of chunk {} differ between the serial and the parallel build", frame_i, dirty_chunk_indices[i]);
+                }
+                for (size_t brick_i = 0; brick_i < voxel_chunk.blas_chunk.blas_geoms.size(); ++brick_i) {
+                    if (auto error = check_brick(voxel_chunk, voxel_chunk.blas_chunk.blas_geoms[brick_i], voxel_chunk.blas_chunk.attrib_bricks[brick_i]); !error.empty()) {
+                        return fmt::format("frame {}, chunk {}: {}", frame_i, dirty_chunk_indices[i], error);
+                    }
+                }
+            }
+            voxel_world->clear_dirty_chunks();
+        }
+        return {};
+    }
+
+    // Recording the startup task graph again, like a resize does, keeps the chunks and their TLAS
+    // instances. Running it clears the chunks, and rebuilding them drops their bricks.
+    auto test_record_and_clear_startup() -> std::string {
+        auto rng = std::mt19937{1};
+        auto voxel_world = std::make_unique<VoxelWorld>();
+        voxel_world->init_cpu_chunks();
+        voxel_world->clear_dirty_chunks();
+        auto const updates = make_chunk_updates(rng, random_chunk_indices(rng, 60), 0.4f);
+        voxel_world->apply_chunk_updates(updates.chunk_updates, updates.heap.data(), {});
+        voxel_world->build_dirty_chunk_bricks({}, nullptr);
+        // What begin_frame does for the chunks that got a BLAS.
+        auto meshed_chunk_indices = std::vector<uint32_t>{};
+        for (auto const chunk_i : voxel_world->dirty_chunk_indices) {
+            if (!voxel_world->voxel_chunks[chunk_i].blas_chunk.blas_geoms.empty()) {
+                voxel_world->tlas_instance_tracker.insert(chunk_i);
+                meshed_chunk_indices.push_back(chunk_i);
+            }
+        }
+        voxel_world->clear_dirty_chunks();
+        if (meshed_chunk_indices.empty()) {
+            return "the updates didn't make any bricks";
+        }
+
+        voxel_world->init_cpu_chunks();
+        for (auto const chunk_i : meshed_chunk_indices) {
+            if (voxel_world->tlas_instance_tracker.slot_of(chunk_i) == TlasInstanceTracker::INVALID || voxel_world->voxel_chunks[chunk_i].blas_chunk.blas_geoms.empty()) {
+                return fmt::format("chunk {} lost its TLAS instance or its bricks to recording the startup again", chunk_i);
+            }
+        }
+        if (!voxel_world->dirty_chunk_indices.empty()) {
+            return "recording the startup again made chunks dirty";
+        }
+
+        voxel_world->clear_cpu_chunks();
+        if (voxel_world->dirty_chunk_indices.size() != voxel_world->voxel_chunks.size()) {
+            return fmt::format("clearing the chunks made {} of {} dirty", voxel_world->dirty_chunk_indices.size(), voxel_world->voxel_chunks.size());
+        }
+        voxel_world->build_dirty_chunk_bricks({}, nullptr);
+        for (auto const chunk_i : meshed_chunk_indices) {
+            auto const &voxel_chunk = voxel_world->voxel_chunks[chunk_i];
+            if (!voxel_chunk.blas_chunk.blas_geoms.empty() || voxel_chunk.palette_chunks[0].variant_n != 0 || voxel_chunk.needs_save) {
+                return fmt::format("chunk {} wasn't cleared", chunk_i);
+            }
+        }
+        return {};
+    }
+
+    // Only edits are saved, under where the chunk was when it was updated, even once the window has
+    // moved on without the GPU replacing the slot yet.
+    auto test_save_edits() -> std::string {
+        auto rng = std::mt19937{2};
+        auto voxel_world = std::make_unique<VoxelWorld>();
+        voxel_world->init_cpu_chunks();
+        auto chunk_indices = random_chunk_indices(rng, 40);
+        auto const generated = make_chunk_updates(rng, chunk_indices, 0.4f);
+        voxel_world->apply_chunk_updates(generated.chunk_updates, generated.heap.data(), {});
+        auto const edited_indices = std::span{chunk_indices}.first(10);
+        auto const edited = make_chunk_updates(rng, edited_indices, 0.4f, BRUSH_FLAGS_USER_BRUSH_A);
+        voxel_world->apply_chunk_updates(edited.chunk_updates, edited.heap.data(), {});
+
+        auto const folder = std::filesystem::path{".out/voxel_world_test/save_edits"};
+        std::filesystem::remove_all(folder);
+        // The player moved several chunks away since.
+        auto const moved_offset = daxa_i32vec3{5 << (6 + LOG2_VOXEL_SIZE), 0, -3 << (6 + LOG2_VOXEL_SIZE)};
+        voxel_world->apply_chunk_updates({}, nullptr, moved_offset);
+        auto const stats = voxel_world->save_world(folder, true, nullptr);
+        if (stats.written_chunk_n != edited_indices.size()) {
+            return fmt::format("saved {} chunks, but {} were edited", stats.written_chunk_n, edited_indices.size());
+        }
+        auto world_save = WorldSave{folder};
+        for (auto const &chunk_update : edited.chunk_updates) {
+            if (!world_save.has_chunk(std::bit_cast<glm::ivec3>(chunk_update.info.world_chunk))) {
+                return fmt::format("the edit of chunk {} wasn't saved where it was made", chunk_update.info.chunk_index);
+            }
+        }
+        if (voxel_world->count_changed_saved_chunks(folder) != 0 || voxel_world->save_world(folder, true, nullptr).written_chunk_n != 0) {
+            return "the saved edits differ from the world, or were saved again";
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"parallel bricks match the serial build", test_parallel_bricks_match_serial},
+        UnitTestCase{"recording the startup again, and clearing the chunks", test_record_and_clear_startup},
+        UnitTestCase{"saving edits", test_save_edits},
+    };
+    return run_unit_tests(cases);
+}
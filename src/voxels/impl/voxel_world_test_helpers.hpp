@@ -0,0 +1,65 @@
+#pragma once
+
+#include <voxels/impl/voxel_world.inl>
+#include <voxels/impl/palette_codec_test_helpers.hpp>
+#include <utilities/gpu/defs.glsl>
+
+#include <random>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+// Synthetic chunk updates for voxel_world_test.cpp and voxel_occupancy_test.cpp.
+
+// Laid out like the GPU's: palette headers that point into one heap of blobs, or hold the voxel
+// themselves for uniform regions.
+struct SyntheticChunkUpdates {
+    std::vector<ChunkUpdate> chunk_updates;
+    std::vector<uint32_t> heap;
+};
+
+inline auto random_chunk_indices(std::mt19937 &rng, uint32_t chunk_n) -> std::vector<uint32_t> {
+    auto result = std::unordered_set<uint32_t>{};
+    auto pick_chunk = std::uniform_int_distribution<uint32_t>{0, CHUNKS_PER_AXIS * CHUNKS_PER_AXIS * CHUNKS_PER_AXIS - 1};
+    while (result.size() < chunk_n) {
+        result.insert(pick_chunk(rng));
+    }
+    return {result.begin(), result.end()};
+}
+
+// Updates the chunks at `chunk_indices`, with `air_share` of their regions uniform air. The rest are
+// a tenth uniform solid, and otherwise compressed or raw regions with a quarter of their voxels air.
+// The low two bits of a voxel are its material type, and 0 is air. The chunks are placed in the
+// world as if the window had never moved.
+inline auto make_chunk_updates(std::mt19937 &rng, std::span<uint32_t const> chunk_indices, float air_share, uint32_t brush_flags = BRUSH_FLAGS_WORLD_BRUSH) -> SyntheticChunkUpdates {
+    auto result = SyntheticChunkUpdates{};
+    result.chunk_updates = std::vector<ChunkUpdate>(chunk_indices.size());
+    auto blob = std::vector<uint32_t>{};
+    auto chance = std::uniform_real_distribution<float>{0.0f, 1.0f};
+    for (size_t i = 0; i < chunk_indices.size(); ++i) {
+        auto &chunk_update = result.chunk_updates[i];
+        auto const chunk_index = static_cast<int32_t>(chunk_indices[i]);
+        chunk_update.info = {
+            .chunk_index = chunk_indices[i],
+            .flags = 1,
+            .world_chunk = {chunk_index % CHUNKS_PER_AXIS, chunk_index / CHUNKS_PER_AXIS % CHUNKS_PER_AXIS, chunk_index / CHUNKS_PER_AXIS / CHUNKS_PER_AXIS},
+            .brush_flags = brush_flags,
+        };
+        for (auto &palette_header : chunk_update.palette_headers) {
+            auto const roll = chance(rng);
+            if (roll < air_share) {
+                palette_header = {.variant_n = 1, .blob_ptr = 0};
+            } else if (roll < air_share + (1.0f - air_share) * 0.1f) {
+                palette_header = {.variant_n = 1, .blob_ptr = static_cast<uint32_t>(rng()) | 1u};
+            } else {
+                auto const is_raw = rng() % 4 == 0;
+                auto const variant_n = static_cast<uint32_t>(is_raw ? PALETTE_MAX_COMPRESSED_VARIANT_N + 1 + rng() % 100 : 2 + rng() % (PALETTE_MAX_COMPRESSED_VARIANT_N - 1));
+                auto const voxels = random_palette_region(rng, variant_n);
+                auto const palette_chunk = encode_palette_region(voxels, blob);
+                palette_header = {.variant_n = palette_chunk.variant_n, .blob_ptr = static_cast<uint32_t>(result.heap.size())};
+                result.heap.insert(result.heap.end(), blob.begin(), blob.end());
+            }
+        }
+    }
+    return result;
+}
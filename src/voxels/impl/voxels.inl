@@ -1,6 +1,7 @@
 #pragma once
 
 #include <voxels/impl/voxel_malloc.inl>
+#include <voxels/impl/chunk_update_priority.inl>
 #include <voxels/gvox_model.inl>
 #include <voxels/brushes.inl>
 
@@ -43,6 +44,12 @@ DAXA_DECL_BUFFER_PTR(daxa_BufferPtr(VoxelBrickAttribs))
 struct VoxelLeafChunk {
     daxa_u32 flags;
     daxa_u32 update_index;
+    // See chunk_update_priority.inl.
+    daxa_u32 update_request;
+    // Frames in a row the chunk requested an update without being elected.
+    daxa_u32 update_wait_n;
+    // frame_index + 1 of the last time the player edited the chunk, or 0.
+    daxa_u32 last_edit_frame;
     daxa_u32 uniformity_bits[3];
     // 8 bytes per 8x8x8
     VoxelMalloc_ChunkLocalPageSubAllocatorState sub_allocator_state;
@@ -89,12 +96,22 @@ struct VoxelWorldGlobals {
     daxa_u32 chunk_update_n; // Number of chunks to update
     daxa_i32vec3 offset;
     daxa_u32 chunk_update_heap_alloc_n;
+    // Summed cost and count of this frame's update requests, per priority bucket.
+    daxa_u32 update_request_costs[CHUNK_UPDATE_PRIORITY_BUCKET_N];
+    daxa_u32 update_request_ns[CHUNK_UPDATE_PRIORITY_BUCKET_N];
+    // Cost and update slots taken so far by the one bucket that only partly fits.
+    daxa_u32 cutoff_bucket_cost;
+    daxa_u32 cutoff_bucket_n;
 };
 DAXA_DECL_BUFFER_PTR(VoxelWorldGlobals)
 
 struct CpuChunkUpdateInfo {
     daxa_u32 chunk_index;
     daxa_u32 flags;
+    // Where the chunk is in the world, in chunks, as the brushes saw it.
+    daxa_i32vec3 world_chunk;
+    // BRUSH_FLAGS_* of the brushes that made the update.
+    daxa_u32 brush_flags;
 };
 struct ChunkUpdate {
     CpuChunkUpdateInfo info;
@@ -0,0 +1,431 @@
+#include "world_save.hpp"
+
+#include <utilities/log.hpp>
+#include <utilities/profiler.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <fmt/format.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace {
+    constexpr uint32_t WORLD_REGION_MAGIC = 0x52575647; // "GVWR"
+    // Bump when the region or chunk format changes.
+    constexpr uint32_t WORLD_REGION_VERSION = 1;
+    constexpr uint32_t HAS_AIR_BIT = 1u << 31;
+
+    enum struct ChunkCompression : uint32_t {
+        NONE,
+        DEFLATE,
+    };
+
+    struct RegionHeader {
+        uint32_t magic;
+        uint32_t version;
+        int32_t region_x;
+        int32_t region_y;
+        int32_t region_z;
+        uint32_t chunk_n;
+    };
+    struct RegionChunkEntry {
+        // From the start of the file. 0 means the region doesn't hold the chunk.
+        uint64_t offset;
+        uint32_t stored_size;
+        uint32_t raw_size;
+        // CRC-32 of the stored bytes, so that corruption is caught before inflating anything.
+        uint32_t checksum;
+        ChunkCompression compression;
+    };
+    using RegionTable = std::array<RegionChunkEntry, WORLD_REGION_CHUNK_N>;
+    constexpr size_t REGION_DATA_OFFSET = sizeof(RegionHeader) + sizeof(RegionTable);
+
+    auto floor_div(int32_t a, int32_t b) -> int32_t {
+        return a / b - ((a % b) < 0 ? 1 : 0);
+    }
+
+    auto region_path(std::filesystem::path const &folder, glm::ivec3 region_pos) -> std::filesystem::path {
+        return folder / fmt::format("r.{}.{}.{}.gvr", region_pos.x, region_pos.y, region_pos.z);
+    }
+
+    auto chunk_in_region_index(glm::ivec3 chunk_pos) -> uint32_t {
+        auto const region_pos = world_region_pos(chunk_pos);
+        auto const x = static_cast<uint32_t>(chunk_pos.x - region_pos.x * WORLD_REGION_SIZE);
+        auto const y = static_cast<uint32_t>(chunk_pos.y - region_pos.y * WORLD_REGION_SIZE);
+        auto const z = static_cast<uint32_t>(chunk_pos.z - region_pos.z * WORLD_REGION_SIZE);
+        return x + y * WORLD_REGION_SIZE + z * WORLD_REGION_SIZE * WORLD_REGION_SIZE;
+    }
+
+    auto chunk_checksum(std::span<uint8_t const> bytes) -> uint32_t {
+        return static_cast<uint32_t>(crc32(0, bytes.data(), static_cast<uInt>(bytes.size())));
+    }
+
+    // Number of u32s a palette region takes up in a serialized chunk.
+    auto serialized_region_size(uint32_t variant_n) -> uint32_t {
+        return std::max(palette_blob_size(variant_n), 1u);
+    }
+
+    void serialize_chunk(std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> palette_chunks, std::vector<uint32_t> &out) {
+        out.resize(PALETTES_PER_CHUNK);
+        for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+            auto const &palette_chunk = palette_chunks[region_i];
+            out[region_i] = palette_chunk.variant_n | (palette_chunk.has_air ? HAS_AIR_BIT : 0u);
+        }
+        for (auto const &palette_chunk : palette_chunks) {
+            auto const blob_size = palette_blob_size(palette_chunk.variant_n);
+            if (blob_size == 0) {
+                out.push_back(static_cast<uint32_t>(std::bit_cast<uint64_t>(palette_chunk.blob_ptr)));
+            } else {
+                out.insert(out.end(), palette_chunk.blob_ptr, palette_chunk.blob_ptr + blob_size);
+            }
+        }
+    }
+
+    auto deserialize_chunk(std::span<uint32_t const> words, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> bool {
+        if (words.size() < PALETTES_PER_CHUNK) {
+            return false;
+        }
+        auto expected_size = size_t{PALETTES_PER_CHUNK};
+        for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+            auto const variant_n = words[region_i] & ~HAS_AIR_BIT;
+            if (variant_n > PALETTE_REGION_TOTAL_SIZE) {
+                return false;
+            }
+            expected_size += serialized_region_size(variant_n);
+        }
+        if (words.size() != expected_size) {
+            return false;
+        }
+        auto data_offset = size_t{PALETTES_PER_CHUNK};
+        for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+            auto &palette_chunk = out[region_i];
+            allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+            palette_chunk.variant_n = words[region_i] & ~HAS_AIR_BIT;
+            palette_chunk.has_air = (words[region_i] & HAS_AIR_BIT) != 0 ? 1 : 0;
+            auto const blob_size = palette_blob_size(palette_chunk.variant_n);
+            if (blob_size == 0) {
+                palette_chunk.blob_ptr = std::bit_cast<uint32_t *>(size_t{words[data_offset]});
+            } else {
+                palette_chunk.blob_ptr = allocator.allocate(palette_chunk.variant_n);
+                std::memcpy(palette_chunk.blob_ptr, words.data() + data_offset, blob_size * sizeof(uint32_t));
+            }
+            data_offset += serialized_region_size(palette_chunk.variant_n);
+        }
+        return true;
+    }
+
+    // A zlib stream that's kept around for the thread, and reset between chunks.
+    template <int (*END)(z_streamp)>
+    struct ZlibStream {
+        z_stream stream{};
+        bool is_initialized = false;
+        int level = 0;
+
+        ZlibStream() = default;
+        ZlibStream(ZlibStream const &) = delete;
+        ZlibStream &operator=(ZlibStream const &) = delete;
+        ~ZlibStream() {
+            if (is_initialized) {
+                END(&stream);
+            }
+        }
+    };
+
+    auto read_chunk_entry(MappedFile const &file, glm::ivec3 chunk_pos) -> RegionChunkEntry {
+        auto entry = RegionChunkEntry{};
+        std::memcpy(&entry, file.data() + sizeof(RegionHeader) + chunk_in_region_index(chunk_pos) * sizeof(RegionChunkEntry), sizeof(entry));
+        return entry;
+    }
+} // namespace
+
+auto world_region_pos(glm::ivec3 chunk_pos) -> glm::ivec3 {
+    return glm::ivec3(floor_div(chunk_pos.x, WORLD_REGION_SIZE), floor_div(chunk_pos.y, WORLD_REGION_SIZE), floor_div(chunk_pos.z, WORLD_REGION_SIZE));
+}
+
+auto world_pos_key(glm::ivec3 pos) -> uint64_t {
+    auto const bits = [](int32_t v) { return static_cast<uint64_t>(static_cast<uint32_t>(v) & 0x1fffffu); };
+    return bits(pos.x) | (bits(pos.y) << 21) | (bits(pos.z) << 42);
+}
+
+auto store_world_chunk(std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> palette_chunks, int compression_level) -> WorldStoredChunk {
+    thread_local auto words = std::vector<uint32_t>{};
+    thread_local auto deflater = ZlibStream<deflateEnd>{};
+    serialize_chunk(palette_chunks, words);
+    auto const raw = std::span{reinterpret_cast<uint8_t const *>(words.data()), words.size() * sizeof(uint32_t)};
+    auto result = WorldStoredChunk{};
+    result.bytes.resize(deflateBound(nullptr, static_cast<uLong>(raw.size())));
+    // compress2() sets up a new stream every time, which costs more than deflating a small chunk.
+    auto &stream = deflater.stream;
+    if (!deflater.is_initialized || deflater.level != compression_level) {
+        if (deflater.is_initialized) {
+            deflateEnd(&stream);
+        }
+        stream = z_stream{};
+        deflater.is_initialized = deflateInit(&stream, compression_level) == Z_OK;
+        deflater.level = compression_level;
+    } else {
+        deflateReset(&stream);
+    }
+    stream.next_in = const_cast<Bytef *>(raw.data());
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = result.bytes.data();
+    stream.avail_out = static_cast<uInt>(result.bytes.size());
+    if (deflater.is_initialized && deflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out < raw.size()) {
+        result.bytes.resize(stream.total_out);
+        result.bytes.shrink_to_fit();
+        result.is_compressed = true;
+    } else {
+        result.bytes.assign(raw.begin(), raw.end());
+        result.is_compressed = false;
+    }
+    result.raw_size = static_cast<uint32_t>(raw.size());
+    result.checksum = chunk_checksum(result.bytes);
+    return result;
+}
+
+auto load_world_chunk(WorldStoredChunk const &stored, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> bool {
+    thread_local auto words = std::vector<uint32_t>{};
+    if (stored.raw_size % sizeof(uint32_t) != 0) {
+        return false;
+    }
+    words.resize(stored.raw_size / sizeof(uint32_t));
+    if (!stored.is_compressed) {
+        if (stored.bytes.size() != stored.raw_size) {
+            return false;
+        }
+        std::memcpy(words.data(), stored.bytes.data(), stored.bytes.size());
+    } else {
+        thread_local auto inflater = ZlibStream<inflateEnd>{};
+        auto &stream = inflater.stream;
+        if (!inflater.is_initialized) {
+            inflater.is_initialized = inflateInit(&stream) == Z_OK;
+        } else {
+            inflateReset(&stream);
+        }
+        stream.next_in = const_cast<Bytef *>(stored.bytes.data());
+        stream.avail_in = static_cast<uInt>(stored.bytes.size());
+        stream.next_out = reinterpret_cast<Bytef *>(words.data());
+        stream.avail_out = stored.raw_size;
+        if (!inflater.is_initialized || inflate(&stream, Z_FINISH) != Z_STREAM_END || stream.total_out != stored.raw_size) {
+            return false;
+        }
+    }
+    return deserialize_chunk(words, out, allocator);
+}
+
+auto WorldSave::region(glm::ivec3 region_pos) -> Region const & {
+    auto [iter, inserted] = regions.try_emplace(world_pos_key(region_pos));
+    auto &result = iter->second;
+    if (!inserted) {
+        return result;
+    }
+    auto const path = region_path(folder, region_pos);
+    auto ec = std::error_code{};
+    if (!std::filesystem::exists(path, ec)) {
+        return result;
+    }
+    result.is_present = true;
+    result.file = MappedFile(path);
+    auto const &file = result.file;
+    if (!file.is_open() || file.size() < REGION_DATA_OFFSET) {
+        log_warning("Ignoring the unreadable world region {}", path.string());
+        return result;
+    }
+    auto header = RegionHeader{};
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != WORLD_REGION_MAGIC || header.version != WORLD_REGION_VERSION ||
+        header.region_x != region_pos.x || header.region_y != region_pos.y || header.region_z != region_pos.z) {
+        log_warning("Ignoring the world region {}, which is from another version or region", path.string());
+        return result;
+    }
+    auto table = RegionTable{};
+    std::memcpy(table.data(), file.data() + sizeof(RegionHeader), sizeof(table));
+    for (auto const &entry : table) {
+        if (entry.offset == 0) {
+            continue;
+        }
+        if (entry.offset < REGION_DATA_OFFSET || entry.offset + entry.stored_size > file.size() ||
+            entry.raw_size % sizeof(uint32_t) != 0 || entry.compression > ChunkCompression::DEFLATE) {
+            log_warning("Ignoring the corrupt world region {}", path.string());
+            return result;
+        }
+    }
+    result.is_valid = true;
+    return result;
+}
+
+void WorldSave::close_regions() {
+    regions.clear();
+}
+
+auto WorldSave::has_chunk(glm::ivec3 chunk_pos) -> bool {
+    auto const &chunk_region = region(world_region_pos(chunk_pos));
+    return chunk_region.is_valid && read_chunk_entry(chunk_region.file, chunk_pos).offset != 0;
+}
+
+auto WorldSave::read_stored_chunk(glm::ivec3 chunk_pos, WorldStoredChunk &out) -> WorldChunkLoadStatus {
+    auto const &chunk_region = region(world_region_pos(chunk_pos));
+    if (!chunk_region.is_present) {
+        return WorldChunkLoadStatus::MISSING;
+    }
+    if (!chunk_region.is_valid) {
+        return WorldChunkLoadStatus::CORRUPT;
+    }
+    auto const entry = read_chunk_entry(chunk_region.file, chunk_pos);
+    if (entry.offset == 0) {
+        return WorldChunkLoadStatus::MISSING;
+    }
+    auto const stored = chunk_region.file.bytes().subspan(entry.offset, entry.stored_size);
+    if (chunk_checksum(stored) != entry.checksum) {
+        return WorldChunkLoadStatus::CORRUPT;
+    }
+    out.bytes.assign(stored.begin(), stored.end());
+    out.raw_size = entry.raw_size;
+    out.checksum = entry.checksum;
+    out.is_compressed = entry.compression == ChunkCompression::DEFLATE;
+    return WorldChunkLoadStatus::LOADED;
+}
+
+auto WorldSave::load_chunk(glm::ivec3 chunk_pos, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> WorldChunkLoadStatus {
+    PROFILE_ZONE("WorldSave::load_chunk");
+    auto const status = read_stored_chunk(chunk_pos, scratch);
+    if (status != WorldChunkLoadStatus::LOADED) {
+        return status;
+    }
+    return load_world_chunk(scratch, out, allocator) ? WorldChunkLoadStatus::LOADED : WorldChunkLoadStatus::CORRUPT;
+}
+
+auto WorldSave::save_chunks(std::span<WorldSaveChunk const> chunks, ThreadPool *thread_pool) -> WorldSaveStats {
+    PROFILE_ZONE("WorldSave::save_chunks");
+    auto stored_chunks = std::vector<WorldStoredChunk>(chunks.size());
+    {
+        PROFILE_ZONE("encode chunks");
+        auto const encode_range = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                stored_chunks[i] = store_world_chunk(chunks[i].palette_chunks, compression_level);
+            }
+        };
+        if (thread_pool != nullptr) {
+            thread_pool->parallel_for(chunks.size(), 1, encode_range);
+        } else {
+            encode_range(0, chunks.size());
+        }
+    }
+    auto refs = std::vector<WorldStoredChunkRef>(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        refs[i] = {.chunk_pos = chunks[i].chunk_pos, .chunk = &stored_chunks[i]};
+    }
+    return save_stored_chunks(refs);
+}
+
+auto WorldSave::save_stored_chunks(std::span<WorldStoredChunkRef const> chunks) -> WorldSaveStats {
+    auto stats = WorldSaveStats{};
+    if (chunks.empty()) {
+        return stats;
+    }
+
+    // Chunks of the same region end up next to each other. When a chunk is passed more than once,
+    // the last one wins.
+    auto order = std::vector<uint32_t>(chunks.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&chunks](uint32_t a, uint32_t b) {
+        return world_pos_key(world_region_pos(chunks[a].chunk_pos)) < world_pos_key(world_region_pos(chunks[b].chunk_pos));
+    });
+
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(folder, ec);
+
+    for (size_t group_begin = 0; group_begin < order.size();) {
+        auto const region_pos = world_region_pos(chunks[order[group_begin]].chunk_pos);
+        auto group_end = group_begin + 1;
+        while (group_end < order.size() && world_pos_key(world_region_pos(chunks[order[group_end]].chunk_pos)) == world_pos_key(region_pos)) {
+            ++group_end;
+        }
+        PROFILE_ZONE("write region");
+        ++stats.region_n;
+
+        auto table = RegionTable{};
+        auto sources = std::array<std::span<uint8_t const>, WORLD_REGION_CHUNK_N>{};
+        auto is_written = std::array<bool, WORLD_REGION_CHUNK_N>{};
+        if (auto const &old_region = region(region_pos); old_region.is_valid) {
+            std::memcpy(table.data(), old_region.file.data() + sizeof(RegionHeader), sizeof(table));
+            for (uint32_t i = 0; i < WORLD_REGION_CHUNK_N; ++i) {
+                if (table[i].offset != 0) {
+                    sources[i] = old_region.file.bytes().subspan(table[i].offset, table[i].stored_size);
+                }
+            }
+        }
+        for (auto i = group_begin; i < group_end; ++i) {
+            auto const &chunk = chunks[order[i]];
+            auto const in_region_i = chunk_in_region_index(chunk.chunk_pos);
+            table[in_region_i] = {
+                .offset = 0,
+                .stored_size = static_cast<uint32_t>(chunk.chunk->bytes.size()),
+                .raw_size = chunk.chunk->raw_size,
+                .checksum = chunk.chunk->checksum,
+                .compression = chunk.chunk->is_compressed ? ChunkCompression::DEFLATE : ChunkCompression::NONE,
+            };
+            sources[in_region_i] = chunk.chunk->bytes;
+            is_written[in_region_i] = true;
+        }
+
+        auto header = RegionHeader{
+            .magic = WORLD_REGION_MAGIC,
+            .version = WORLD_REGION_VERSION,
+            .region_x = region_pos.x,
+            .region_y = region_pos.y,
+            .region_z = region_pos.z,
+            .chunk_n = 0,
+        };
+        auto offset = uint64_t{REGION_DATA_OFFSET};
+        auto region_written_n = uint32_t{};
+        for (uint32_t i = 0; i < WORLD_REGION_CHUNK_N; ++i) {
+            if (sources[i].empty()) {
+                table[i] = {};
+                continue;
+            }
+            table[i].offset = offset;
+            offset += sources[i].size();
+            ++header.chunk_n;
+            if (is_written[i]) {
+                ++region_written_n;
+                stats.raw_bytes += table[i].raw_size;
+                stats.stored_bytes += table[i].stored_size;
+            }
+        }
+        stats.written_chunk_n += region_written_n;
+        stats.kept_chunk_n += header.chunk_n - region_written_n;
+
+        auto const path = region_path(folder, region_pos);
+        auto temp_path = path;
+        temp_path += ".tmp";
+        auto file_ok = false;
+        {
+            auto file = std::ofstream(temp_path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+            file.write(reinterpret_cast<char const *>(table.data()), sizeof(table));
+            for (auto const &source : sources) {
+                file.write(reinterpret_cast<char const *>(source.data()), static_cast<std::streamsize>(source.size()));
+            }
+            file_ok = file.good();
+        }
+        // The kept chunks were read from the mapping, and it has to go before the file can be
+        // replaced on every platform.
+        regions.erase(world_pos_key(region_pos));
+        if (file_ok) {
+            std::filesystem::rename(temp_path, path, ec);
+            file_ok = !ec;
+        }
+        if (!file_ok) {
+            std::filesystem::remove(temp_path, ec);
+            log_error("Failed to write the world region {}", path.string());
+            ++stats.failed_region_n;
+        }
+        group_begin = group_end;
+    }
+    return stats;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <voxels/impl/palette_blob_allocator.hpp>
+#include <utilities/mapped_file.hpp>
+
+struct ThreadPool;
+
+// On-disk format of saved worlds. Chunks are grouped into region files of WORLD_REGION_SIZE^3
+// chunks, named after the region's position. A region file starts with a header and a table of one
+// entry per chunk, followed by the chunks it holds. Each chunk is deflated and checksummed on its
+// own, so any chunk can be read straight out of the mapped file without touching the others.
+//
+// Chunks keep their palette form: a (variant_n | has_air << 31) word per palette region, followed by
+// the uniform voxel or the blob of every region, exactly as palette_codec.hpp lays them out.
+
+#define WORLD_REGION_SIZE 8
+#define WORLD_REGION_CHUNK_N (WORLD_REGION_SIZE * WORLD_REGION_SIZE * WORLD_REGION_SIZE)
+
+enum struct WorldChunkLoadStatus : uint8_t {
+    LOADED,
+    MISSING,
+    // The region file or the chunk failed validation. The chunk is treated as missing.
+    CORRUPT,
+};
+
+struct WorldSaveChunk {
+    glm::ivec3 chunk_pos;
+    std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> palette_chunks;
+};
+
+// A chunk in the form it's stored in: serialized, compressed unless that didn't help, and checksummed.
+struct WorldStoredChunk {
+    std::vector<uint8_t> bytes;
+    uint32_t raw_size = 0;
+    // CRC-32 of `bytes`.
+    uint32_t checksum = 0;
+    bool is_compressed = false;
+};
+struct WorldStoredChunkRef {
+    glm::ivec3 chunk_pos;
+    WorldStoredChunk const *chunk;
+};
+
+struct WorldSaveStats {
+    uint32_t region_n = 0;
+    uint32_t failed_region_n = 0;
+    // Chunks that were serialized and compressed.
+    uint32_t written_chunk_n = 0;
+    // Chunks carried over from the previous region files as they were.
+    uint32_t kept_chunk_n = 0;
+    // Serialized and compressed sizes of the written chunks.
+    uint64_t raw_bytes = 0;
+    uint64_t stored_bytes = 0;
+};
+
+struct WorldSave {
+    std::filesystem::path folder;
+    // zlib level. Saving happens while playing, so favor speed.
+    int compression_level = 1;
+
+    WorldSave() = default;
+    explicit WorldSave(std::filesystem::path a_folder) : folder{std::move(a_folder)} {}
+
+    // Writes `chunks` into their region files, each through a temporary file so that a crash never
+    // leaves a torn region behind. Chunks that the region files already held and that aren't in
+    // `chunks` are copied over without being decoded, so passing only the chunks that changed since
+    // the last save is enough. Passing a null thread pool compresses on the calling thread.
+    auto save_chunks(std::span<WorldSaveChunk const> chunks, ThreadPool *thread_pool) -> WorldSaveStats;
+    // The same, for chunks that are already in their stored form.
+    auto save_stored_chunks(std::span<WorldStoredChunkRef const> chunks) -> WorldSaveStats;
+
+    auto has_chunk(glm::ivec3 chunk_pos) -> bool;
+    // Copies the chunk out of its region file as it's stored, after checking its checksum.
+    auto read_stored_chunk(glm::ivec3 chunk_pos, WorldStoredChunk &out) -> WorldChunkLoadStatus;
+    // Frees what `out` held back to `allocator` and replaces it with the saved chunk, whose blobs are
+    // allocated from `allocator`. `out` is left alone unless the chunk is LOADED. `has_air` comes from
+    // the file, so it's whatever the saving side considered air.
+    auto load_chunk(glm::ivec3 chunk_pos, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> WorldChunkLoadStatus;
+
+    // Unmaps the region files that were opened for loading.
+    void close_regions();
+
+  private:
+    struct Region {
+        MappedFile file;
+        bool is_present = false;
+        bool is_valid = false;
+    };
+
+    std::unordered_map<uint64_t, Region> regions;
+    WorldStoredChunk scratch;
+
+    auto region(glm::ivec3 region_pos) -> Region const &;
+};
+
+auto world_region_pos(glm::ivec3 chunk_pos) -> glm::ivec3;
+// Packs a chunk or region position into a map key. Positions wrap around at +-2^20.
+auto world_pos_key(glm::ivec3 pos) -> uint64_t;
+
+auto store_world_chunk(std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> palette_chunks, int compression_level) -> WorldStoredChunk;
+// Frees what `out` held back to `allocator` and replaces it with the stored chunk. Returns false,
+// leaving `out` alone, if the chunk doesn't decode. Doesn't check the checksum.
+auto load_world_chunk(WorldStoredChunk const &stored, std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> out, PaletteBlobAllocator &allocator) -> bool;
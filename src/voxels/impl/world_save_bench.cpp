@@ -0,0 +1,87 @@
+#include <voxels/impl/world_save.hpp>
+#include <voxels/impl/world_save_test_helpers.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+
+// Saves, re-saves a part of, and loads back synthetic terrain chunks, and prints throughput and
+// compression ratio. Fails if the chunks didn't round trip.
+// Usage: gvox_engine_world_save_bench [chunk count]
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    auto mb_per_s(uint64_t byte_n, Clock::duration duration) -> double {
+        return static_cast<double>(byte_n) / 1'000'000.0 / std::chrono::duration<double>(duration).count();
+    }
+} // namespace
+
+auto main(int argc, char const *argv[]) -> int {
+    auto const chunk_n = benchmark_count_arg(std::span{argv, static_cast<size_t>(argc)}, 512);
+    auto const folder = std::filesystem::path{".out/world_save_bench"};
+    std::filesystem::remove_all(folder);
+
+    auto thread_pool = ThreadPool{};
+    thread_pool.start();
+    auto const chunks = generate_synthetic_world(chunk_n, 0, &thread_pool);
+    auto const save_chunks = to_world_save_chunks(chunks);
+
+    auto result = true;
+    auto raw_bytes = uint64_t{};
+    {
+        auto world_save = WorldSave{folder};
+        auto const t0 = Clock::now();
+        auto const stats = world_save.save_chunks(save_chunks, &thread_pool);
+        auto const t1 = Clock::now();
+        auto const stored_bytes = static_cast<double>(std::max(stats.stored_bytes, uint64_t{1}));
+        auto const dense_bytes = static_cast<double>(stats.written_chunk_n) * CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * sizeof(uint32_t);
+        fmt::print("Saved {} chunks into {} regions: {:.2f} MB serialized, {:.2f} MB stored ({:.2f}x smaller, {:.1f}x smaller than dense voxels), {:.0f} MB/s\n",
+                   stats.written_chunk_n, stats.region_n, static_cast<double>(stats.raw_bytes) / 1'000'000.0, static_cast<double>(stats.stored_bytes) / 1'000'000.0,
+                   static_cast<double>(stats.raw_bytes) / stored_bytes, dense_bytes / stored_bytes, mb_per_s(stats.raw_bytes, t1 - t0));
+        result = result && stats.failed_region_n == 0;
+        raw_bytes = stats.raw_bytes;
+
+        // An incremental save, as if every 8th chunk had been edited.
+        auto dirty_chunks = std::vector<WorldSaveChunk>{};
+        for (size_t i = 0; i < save_chunks.size(); i += 8) {
+            dirty_chunks.push_back(save_chunks[i]);
+        }
+        auto const t2 = Clock::now();
+        auto const dirty_stats = world_save.save_chunks(dirty_chunks, &thread_pool);
+        auto const t3 = Clock::now();
+        fmt::print("Saved {} dirty chunks incrementally, keeping {}: {:.2f} ms, {:.0f} MB/s of dirty chunks\n",
+                   dirty_stats.written_chunk_n, dirty_stats.kept_chunk_n, std::chrono::duration<double, std::milli>(t3 - t2).count(), mb_per_s(dirty_stats.raw_bytes, t3 - t2));
+        result = result && dirty_stats.failed_region_n == 0;
+    }
+
+    {
+        // Random access, with every region mapped fresh.
+        auto world_save = WorldSave{folder};
+        auto order = std::vector<uint32_t>(chunks.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::shuffle(order.begin(), order.end(), std::mt19937{0});
+        auto allocator = PaletteBlobAllocator{};
+        auto loaded = std::array<CpuPaletteChunk, PALETTES_PER_CHUNK>{};
+        auto load_duration = Clock::duration{};
+        for (auto chunk_i : order) {
+            auto const &chunk = *chunks[chunk_i];
+            auto const t0 = Clock::now();
+            auto const status = world_save.load_chunk(chunk.chunk_pos, loaded, allocator);
+            load_duration += Clock::now() - t0;
+            if (status != WorldChunkLoadStatus::LOADED || !same_world_chunk(loaded, chunk.palette_chunks)) {
+                fmt::print("Chunk ({}, {}, {}) didn't round trip through the world save\n", chunk.chunk_pos.x, chunk.chunk_pos.y, chunk.chunk_pos.z);
+                result = false;
+                break;
+            }
+        }
+        fmt::print("Loaded {} chunks in random order: {:.2f} ms, {:.0f} MB/s\n",
+                   chunks.size(), std::chrono::duration<double, std::milli>(load_duration).count(), mb_per_s(raw_bytes, load_duration));
+        free_world_chunk(loaded, allocator);
+    }
+
+    std::filesystem::remove_all(folder);
+    return result ? 0 : 1;
+}
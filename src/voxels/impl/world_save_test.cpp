@@ -0,0 +1,155 @@
+#include <voxels/impl/world_save.hpp>
+#include <voxels/impl/world_save_test_helpers.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <span>
+
+namespace {
+    auto fresh_folder(std::string_view name) -> std::filesystem::path {
+        auto const folder = std::filesystem::path{".out/world_save_test"} / name;
+        std::filesystem::remove_all(folder);
+        return folder;
+    }
+
+    // Loads every chunk of `expected` back, and compares it.
+    auto check_load(WorldSave &world_save, std::span<std::unique_ptr<SyntheticWorldChunk> const> expected) -> std::string {
+        auto allocator = PaletteBlobAllocator{};
+        auto loaded = std::array<CpuPaletteChunk, PALETTES_PER_CHUNK>{};
+        auto error = std::string{};
+        for (auto const &chunk : expected) {
+            auto const status = world_save.load_chunk(chunk->chunk_pos, loaded, allocator);
+            if (status != WorldChunkLoadStatus::LOADED || !same_world_chunk(loaded, chunk->palette_chunks)) {
+                error = fmt::format("chunk ({}, {}, {}) didn't round trip, status {}", chunk->chunk_pos.x, chunk->chunk_pos.y, chunk->chunk_pos.z, static_cast<int>(status));
+                break;
+            }
+        }
+        free_world_chunk(loaded, allocator);
+        return error;
+    }
+
+    auto test_store_chunk() -> std::string {
+        // Enough chunks for a painted and a noisy one, whose regions are stored raw.
+        auto const chunks = generate_synthetic_world(128, 3, nullptr);
+        auto allocator = PaletteBlobAllocator{};
+        auto loaded = std::array<CpuPaletteChunk, PALETTES_PER_CHUNK>{};
+        for (auto const &chunk : chunks) {
+            for (auto const compression_level : {0, 1}) {
+                auto const stored = store_world_chunk(chunk->palette_chunks, compression_level);
+                if (!load_world_chunk(stored, loaded, allocator) || !same_world_chunk(loaded, chunk->palette_chunks)) {
+                    return fmt::format("a chunk stored at level {} didn't load back", compression_level);
+                }
+            }
+        }
+        auto truncated = store_world_chunk(chunks[0]->palette_chunks, 1);
+        truncated.bytes.resize(truncated.bytes.size() / 2);
+        auto const before = loaded;
+        if (load_world_chunk(truncated, loaded, allocator) || loaded[0].blob_ptr != before[0].blob_ptr) {
+            return "a truncated chunk loaded";
+        }
+        free_world_chunk(loaded, allocator);
+        return {};
+    }
+
+    // Chunks spread over several regions, including ones at negative positions.
+    auto test_save_and_load() -> std::string {
+        auto const folder = fresh_folder("save_and_load");
+        auto const chunks = generate_synthetic_world(400, 1, nullptr);
+        auto const save_chunks = to_world_save_chunks(chunks);
+        {
+            auto world_save = WorldSave{folder};
+            auto const stats = world_save.save_chunks(save_chunks, nullptr);
+            if (stats.written_chunk_n != chunks.size() || stats.kept_chunk_n != 0 || stats.failed_region_n != 0 || stats.region_n < 4) {
+                return fmt::format("saving wrote {} chunks into {} regions, {} of which failed", stats.written_chunk_n, stats.region_n, stats.failed_region_n);
+            }
+        }
+        auto world_save = WorldSave{folder};
+        if (auto error = check_load(world_save, chunks); !error.empty()) {
+            return error;
+        }
+        auto allocator = PaletteBlobAllocator{};
+        auto loaded = std::array<CpuPaletteChunk, PALETTES_PER_CHUNK>{};
+        // Above the saved chunks, in a saved region, and far away, in a region that was never saved.
+        for (auto const chunk_pos : {glm::ivec3(0, 5, 0), glm::ivec3(1000, 0, -1000)}) {
+            if (world_save.has_chunk(chunk_pos) || world_save.load_chunk(chunk_pos, loaded, allocator) != WorldChunkLoadStatus::MISSING) {
+                return fmt::format("the chunk at ({}, {}, {}) isn't missing", chunk_pos.x, chunk_pos.y, chunk_pos.z);
+            }
+        }
+        return {};
+    }
+
+    // Saving only some chunks keeps the others in the region files as they were.
+    auto test_incremental_save() -> std::string {
+        auto const folder = fresh_folder("incremental_save");
+        auto chunks = generate_synthetic_world(128, 1, nullptr);
+        auto world_save = WorldSave{folder};
+        world_save.save_chunks(to_world_save_chunks(chunks), nullptr);
+
+        // Every 8th chunk changes, as if it had been edited.
+        auto edited = generate_synthetic_world(128, 2, nullptr);
+        auto dirty_chunks = std::vector<WorldSaveChunk>{};
+        for (size_t i = 0; i < chunks.size(); i += 8) {
+            chunks[i] = std::move(edited[i]);
+            dirty_chunks.push_back({.chunk_pos = chunks[i]->chunk_pos, .palette_chunks = chunks[i]->palette_chunks});
+        }
+        // Regions that are mapped for loading must not get in the way of replacing them.
+        auto stored = WorldStoredChunk{};
+        world_save.read_stored_chunk(chunks[1]->chunk_pos, stored);
+        auto const stats = world_save.save_chunks(dirty_chunks, nullptr);
+        if (stats.written_chunk_n != dirty_chunks.size() || stats.kept_chunk_n != chunks.size() - dirty_chunks.size() || stats.failed_region_n != 0) {
+            return fmt::format("the incremental save wrote {} and kept {} chunks", stats.written_chunk_n, stats.kept_chunk_n);
+        }
+        auto reopened = WorldSave{folder};
+        return check_load(reopened, chunks);
+    }
+
+    // A damaged chunk is refused, while the other chunks still load.
+    auto test_corrupt_chunk() -> std::string {
+        auto const folder = fresh_folder("corrupt_chunk");
+        auto const chunks = generate_synthetic_world(8, 1, nullptr);
+        auto stored = WorldStoredChunk{};
+        {
+            auto world_save = WorldSave{folder};
+            world_save.save_chunks(to_world_save_chunks(chunks), nullptr);
+            if (world_save.read_stored_chunk(chunks[0]->chunk_pos, stored) != WorldChunkLoadStatus::LOADED) {
+                return "the saved chunk couldn't be read";
+            }
+        }
+        // The chunks are stored as they are, so the first chunk's bytes can be found in its region file.
+        auto is_found = false;
+        for (auto const &entry : std::filesystem::directory_iterator{folder}) {
+            auto bytes = std::vector<char>(entry.file_size());
+            std::ifstream(entry.path(), std::ios::binary).read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            auto const chunk_begin = std::search(bytes.begin(), bytes.end(), stored.bytes.begin(), stored.bytes.end(), [](char a, uint8_t b) { return static_cast<uint8_t>(a) == b; });
+            if (chunk_begin != bytes.end()) {
+                auto &byte = *(chunk_begin + static_cast<std::ptrdiff_t>(stored.bytes.size() / 2));
+                byte = static_cast<char>(byte ^ 0x10);
+                std::ofstream(entry.path(), std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                is_found = true;
+                break;
+            }
+        }
+        if (!is_found) {
+            return "the stored chunk isn't in any region file";
+        }
+
+        auto world_save = WorldSave{folder};
+        auto allocator = PaletteBlobAllocator{};
+        auto loaded = std::array<CpuPaletteChunk, PALETTES_PER_CHUNK>{};
+        if (world_save.load_chunk(chunks[0]->chunk_pos, loaded, allocator) != WorldChunkLoadStatus::CORRUPT) {
+            return "a corrupted chunk went unnoticed";
+        }
+        return check_load(world_save, std::span{chunks}.subspan(1));
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"store and load a chunk", test_store_chunk},
+        UnitTestCase{"save and load", test_save_and_load},
+        UnitTestCase{"incremental save", test_incremental_save},
+        UnitTestCase{"corrupt chunk", test_corrupt_chunk},
+    };
+    return run_unit_tests(cases);
+}
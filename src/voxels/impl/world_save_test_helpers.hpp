@@ -0,0 +1,132 @@
+#pragma once
+
+#include <voxels/impl/world_save.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// Synthetic terrain chunks for world_save_test.cpp and world_save_bench.cpp.
+
+inline auto world_save_hash(uint32_t x) -> uint32_t {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Owns the blobs the palette chunks point into.
+struct SyntheticWorldChunk {
+    glm::ivec3 chunk_pos;
+    std::array<CpuPaletteChunk, PALETTES_PER_CHUNK> palette_chunks;
+    std::vector<std::vector<uint32_t>> blobs;
+};
+
+// Rolling hills of grass, dirt and speckled stone, over mostly empty sky. Every 16th chunk gets
+// painted with up to 64 colors, and every 64th with random ones, which makes raw regions.
+inline void generate_synthetic_world_chunk(SyntheticWorldChunk &chunk, uint32_t seed) {
+    auto const chunk_seed = world_save_hash(static_cast<uint32_t>(chunk.chunk_pos.x * 73 + chunk.chunk_pos.y * 389 + chunk.chunk_pos.z * 911) ^ seed);
+    auto const is_painted = chunk_seed % 16 == 1;
+    auto const is_noisy = chunk_seed % 64 == 0;
+    auto heights = std::array<int32_t, CHUNK_SIZE * CHUNK_SIZE>{};
+    for (int32_t zi = 0; zi < CHUNK_SIZE; ++zi) {
+        for (int32_t xi = 0; xi < CHUNK_SIZE; ++xi) {
+            auto const x = static_cast<float>(chunk.chunk_pos.x * CHUNK_SIZE + xi);
+            auto const z = static_cast<float>(chunk.chunk_pos.z * CHUNK_SIZE + zi);
+            heights[static_cast<size_t>(xi + zi * CHUNK_SIZE)] = 40 + static_cast<int32_t>(20.0f * std::sin(x * 0.021f + static_cast<float>(seed)) * std::cos(z * 0.017f));
+        }
+    }
+    auto voxels = PaletteRegionVoxels{};
+    chunk.blobs.resize(PALETTES_PER_CHUNK);
+    for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+        auto const region_x = region_i % PALETTES_PER_CHUNK_AXIS;
+        auto const region_y = (region_i / PALETTES_PER_CHUNK_AXIS) % PALETTES_PER_CHUNK_AXIS;
+        auto const region_z = region_i / PALETTES_PER_CHUNK_AXIS / PALETTES_PER_CHUNK_AXIS;
+        auto has_air = false;
+        for (uint32_t voxel_i = 0; voxel_i < PALETTE_REGION_TOTAL_SIZE; ++voxel_i) {
+            auto const xi = static_cast<int32_t>(region_x * PALETTE_REGION_SIZE + voxel_i % PALETTE_REGION_SIZE);
+            auto const yi = static_cast<int32_t>(region_y * PALETTE_REGION_SIZE + (voxel_i / PALETTE_REGION_SIZE) % PALETTE_REGION_SIZE);
+            auto const zi = static_cast<int32_t>(region_z * PALETTE_REGION_SIZE + voxel_i / PALETTE_REGION_SIZE / PALETTE_REGION_SIZE);
+            auto const depth = heights[static_cast<size_t>(xi + zi * CHUNK_SIZE)] - (chunk.chunk_pos.y * CHUNK_SIZE + yi);
+            auto const voxel_hash = world_save_hash(static_cast<uint32_t>(xi + yi * CHUNK_SIZE + zi * CHUNK_SIZE * CHUNK_SIZE) ^ chunk_seed);
+            auto voxel = uint32_t{};
+            if (depth < 0) {
+                voxel = 0;
+                has_air = true;
+            } else if (is_noisy) {
+                voxel = ((voxel_hash & 0xffffffu) << 8) | 1;
+            } else if (is_painted) {
+                voxel = ((0x3060c0u + (voxel_hash & 0x3fu) * 0x010203u) << 8) | 1;
+            } else if (depth < 1) {
+                voxel = (0x4a9f2du << 8) | 1;
+            } else if (depth < 4) {
+                voxel = (0x7a5230u << 8) | 1;
+            } else if (voxel_hash % 97 == 0) {
+                voxel = (0xc8b040u << 8) | 1;
+            } else {
+                voxel = ((0x707070u + (voxel_hash & 0x7u) * 0x010101u) << 8) | 1;
+            }
+            voxels[voxel_i] = voxel;
+        }
+        chunk.palette_chunks[region_i] = encode_palette_region(voxels, chunk.blobs[region_i]);
+        chunk.palette_chunks[region_i].has_air = has_air ? 1 : 0;
+    }
+}
+
+// Columns of two chunks, the ground and the sky above it, in a square around the origin.
+inline auto generate_synthetic_world(uint32_t chunk_n, uint32_t seed, ThreadPool *thread_pool) -> std::vector<std::unique_ptr<SyntheticWorldChunk>> {
+    auto const column_n = std::max((chunk_n + 1) / 2, 1u);
+    auto const side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(column_n))));
+    auto chunks = std::vector<std::unique_ptr<SyntheticWorldChunk>>(chunk_n);
+    auto const generate_range = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            chunks[i] = std::make_unique<SyntheticWorldChunk>();
+            auto const column_i = static_cast<uint32_t>(i / 2);
+            chunks[i]->chunk_pos = glm::ivec3(static_cast<int32_t>(column_i % side) - static_cast<int32_t>(side / 2), static_cast<int32_t>(i % 2), static_cast<int32_t>(column_i / side) - static_cast<int32_t>(side / 2));
+            generate_synthetic_world_chunk(*chunks[i], seed);
+        }
+    };
+    if (thread_pool != nullptr) {
+        thread_pool->parallel_for(chunks.size(), 1, generate_range);
+    } else {
+        generate_range(0, chunks.size());
+    }
+    return chunks;
+}
+
+inline auto to_world_save_chunks(std::vector<std::unique_ptr<SyntheticWorldChunk>> const &chunks) -> std::vector<WorldSaveChunk> {
+    auto result = std::vector<WorldSaveChunk>{};
+    result.reserve(chunks.size());
+    for (auto const &chunk : chunks) {
+        result.push_back({.chunk_pos = chunk->chunk_pos, .palette_chunks = chunk->palette_chunks});
+    }
+    return result;
+}
+
+inline auto same_world_chunk(std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> a, std::span<CpuPaletteChunk const, PALETTES_PER_CHUNK> b) -> bool {
+    auto a_voxels = PaletteRegionVoxels{};
+    auto b_voxels = PaletteRegionVoxels{};
+    for (uint32_t region_i = 0; region_i < PALETTES_PER_CHUNK; ++region_i) {
+        if (a[region_i].variant_n != b[region_i].variant_n || a[region_i].has_air != b[region_i].has_air) {
+            return false;
+        }
+        decode_palette_region(a[region_i], a_voxels);
+        decode_palette_region(b[region_i], b_voxels);
+        if (a_voxels != b_voxels) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void free_world_chunk(std::span<CpuPaletteChunk, PALETTES_PER_CHUNK> palette_chunks, PaletteBlobAllocator &allocator) {
+    for (auto &palette_chunk : palette_chunks) {
+        allocator.deallocate(palette_chunk.blob_ptr, palette_chunk.variant_n);
+        palette_chunk = {};
+    }
+}
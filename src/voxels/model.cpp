@@ -1,345 +1,470 @@
 #include "model.hpp"
 
 #include <utilities/mesh/mesh_model.hpp>
+#include <utilities/mesh/mesh_voxelizer.hpp>
+#include <utilities/mapped_file.hpp>
 
-#include <gvox/adapters/input/byte_buffer.h>
-#include <gvox/adapters/output/byte_buffer.h>
 #include <gvox/adapters/parse/voxlap.h>
 
 #include <voxels/gvox_model.inl>
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
-using namespace std::chrono_literals;
+#include <limits>
 
-void VoxelModelLoader::create(GpuContext &gpu_context) {
-    this->gpu_context = &gpu_context;
-    gvox_ctx = gvox_create_context();
-    gvox_model_buffer = this->gpu_context->device.create_buffer({
-        .size = offsetof(GpuGvoxModel, data),
-        .name = "gvox_model_buffer",
-    });
-    task_gvox_model_buffer.set_buffers({.buffers = std::array{gvox_model_buffer}});
-}
+namespace {
+    struct MappedFileInputState {
+        MappedFile const *file;
+        ModelLoadProgress *progress;
+        size_t read_end;
+    };
 
-void VoxelModelLoader::destroy() {
-    gvox_destroy_context(gvox_ctx);
-    if (!gvox_model_buffer.is_empty()) {
-        gpu_context->device.destroy_buffer(gvox_model_buffer);
+    struct VoxelizedMeshState {
+        VoxelizedMesh const *voxelized_mesh;
+        // The serializer walks the region in order, so most samples hit the same brick as the last one.
+        uint64_t cached_brick_key;
+        MeshVoxelBrick const *cached_brick;
+    };
+
+    void register_adapters(GvoxContext *gvox_ctx) {
+        // Reads straight out of a MappedFile, instead of from a copy of the whole file.
+        GvoxInputAdapterInfo mapped_file_adapter_info = {
+            .base_info = {
+                .name_str = "mapped_file",
+                .create = [](GvoxAdapterContext *ctx, void const *user_state_ptr) -> void {
+                    gvox_adapter_set_user_pointer(ctx, const_cast<void *>(user_state_ptr));
+                },
+                .destroy = [](GvoxAdapterContext *) -> void {},
+                .blit_begin = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {},
+                .blit_end = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) {},
+            },
+            .read = [](GvoxAdapterContext *ctx, size_t position, size_t size, void *data) {
+                auto &state = *static_cast<MappedFileInputState *>(gvox_adapter_get_user_pointer(ctx));
+                auto const &file = *state.file;
+                if (position > file.size() || size > file.size() - position) {
+                    gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INPUT_ADAPTER, "Tried reading past the end of the file");
+                    return;
+                }
+                if (state.progress->cancelled.load(std::memory_order_relaxed)) {
+                    // There's no way to stop a blit early, but failing every read makes parsers give up quickly.
+                    std::memset(data, 0, size);
+                    gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INPUT_ADAPTER, "Cancelled");
+                    return;
+                }
+                std::memcpy(data, file.data() + position, size);
+                state.read_end = std::max(state.read_end, position + size);
+                state.progress->stage_progress.store(static_cast<float>(state.read_end) / static_cast<float>(std::max(file.size(), size_t{1})), std::memory_order_relaxed);
+            },
+        };
+        // Hands the serialized model to a GvoxSlabWriter, instead of growing one byte buffer.
+        GvoxOutputAdapterInfo slab_writer_adapter_info = {
+            .base_info = {
+                .name_str = "slab_writer",
+                .create = [](GvoxAdapterContext *ctx, void const *user_state_ptr) -> void {
+                    gvox_adapter_set_user_pointer(ctx, const_cast<void *>(user_state_ptr));
+                },
+                .destroy = [](GvoxAdapterContext *) -> void {},
+                .blit_begin = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {},
+                .blit_end = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
+                    static_cast<GvoxSlabWriter *>(gvox_adapter_get_user_pointer(ctx))->flush();
+                },
+            },
+            .write = [](GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
+                auto &writer = *static_cast<GvoxSlabWriter *>(gvox_adapter_get_user_pointer(ctx));
+                writer.write(position, {static_cast<uint8_t const *>(data), size});
+            },
+            .reserve = [](GvoxAdapterContext *ctx, size_t size) {
+                auto &writer = *static_cast<GvoxSlabWriter *>(gvox_adapter_get_user_pointer(ctx));
+                if (writer.sink->reserve) {
+                    writer.sink->reserve(size);
+                }
+            },
+        };
+        GvoxParseAdapterInfo voxelized_mesh_adapter_info = {
+            .base_info = {
+                .name_str = "voxelized_mesh",
+                .create = [](GvoxAdapterContext *ctx, void const *user_state_ptr) -> void {
+                    gvox_adapter_set_user_pointer(ctx, const_cast<void *>(user_state_ptr));
+                },
+                .destroy = [](GvoxAdapterContext *) -> void {},
+                .blit_begin = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {},
+                .blit_end = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) {},
+            },
+            .query_details = []() -> GvoxParseAdapterDetails { return {.preferred_blit_mode = GVOX_BLIT_MODE_SERIALIZE_DRIVEN}; },
+            .query_parsable_range = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) -> GvoxRegionRange { return {{0, 0, 0}, {0, 0, 0}}; },
+            .sample_region = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegion const * /*unused*/, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
+                auto &state = *static_cast<VoxelizedMeshState *>(gvox_adapter_get_user_pointer(ctx));
+                auto const x = static_cast<uint32_t>(offset->x);
+                auto const y = static_cast<uint32_t>(offset->y);
+                auto const z = static_cast<uint32_t>(offset->z);
+                auto const brick_key = VoxelizedMesh::brick_key(x / MeshVoxelBrick::SIZE, y / MeshVoxelBrick::SIZE, z / MeshVoxelBrick::SIZE);
+                if (brick_key != state.cached_brick_key) {
+                    state.cached_brick_key = brick_key;
+                    state.cached_brick = state.voxelized_mesh->find_brick(x / MeshVoxelBrick::SIZE, y / MeshVoxelBrick::SIZE, z / MeshVoxelBrick::SIZE);
+                }
+                auto uint32_t_voxel = 0u;
+                if (state.cached_brick != nullptr) {
+                    auto const in_brick_i = (x % MeshVoxelBrick::SIZE) + (y % MeshVoxelBrick::SIZE) * MeshVoxelBrick::SIZE + (z % MeshVoxelBrick::SIZE) * MeshVoxelBrick::SIZE * MeshVoxelBrick::SIZE;
+                    uint32_t_voxel = state.cached_brick->voxels[in_brick_i];
+                }
+                switch (channel_id) {
+                case GVOX_CHANNEL_ID_COLOR: return {uint32_t_voxel, 1u};
+                default:
+                    gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "Tried sampling something other than color or normal");
+                    return {0u, 0u};
+                }
+                return {};
+            },
+            .query_region_flags = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) -> uint32_t { return 0; },
+            .load_region = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> GvoxRegion {
+                GvoxRegion const region = {.range = *range, .channels = channel_flags, .flags = 0u, .data = nullptr};
+                return region;
+            },
+            .unload_region = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegion * /*unused*/) {},
+            .parse_region = [](GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> void {
+                GvoxRegion const region = {.range = *range, .channels = channel_flags, .flags = 0u, .data = nullptr};
+                gvox_emit_region(blit_ctx, &region);
+            },
+        };
+        gvox_register_input_adapter(gvox_ctx, &mapped_file_adapter_info);
+        gvox_register_output_adapter(gvox_ctx, &slab_writer_adapter_info);
+        gvox_register_parse_adapter(gvox_ctx, &voxelized_mesh_adapter_info);
     }
-}
 
-auto VoxelModelLoader::voxelize_mesh_model() -> GvoxModelData {
-    MeshModel mesh_model;
-    ::open_mesh_model(gpu_context->device, mesh_model, gvox_model_path, "test");
-    if (mesh_model.meshes.size() == 0) {
-        debug_utils::Console::add_log("[error] Failed to load the mesh model");
-        should_upload_gvox_model = false;
-        return {};
+    auto load_gvox_data_from_parser(GvoxContext *gvox_ctx, GvoxAdapterContext *i_ctx, GvoxAdapterContext *p_ctx, GvoxRegionRange const *region_range, ModelLoadInfo const &info, GvoxModelSink &sink, ModelLoadProgress &progress) -> size_t {
+        auto slab_writer = GvoxSlabWriter{.sink = &sink, .slab_size = info.slab_size};
+        GvoxAdapterContext *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "slab_writer"), &slab_writer);
+        GvoxAdapterContext *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_palette"), nullptr);
+
+        gvox_blit_region(
+            i_ctx, o_ctx, p_ctx, s_ctx,
+            region_range,
+            // GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID | GVOX_CHANNEL_BIT_EMISSIVITY);
+            GVOX_CHANNEL_BIT_COLOR);
+
+        auto const was_cancelled = progress.cancelled.load();
+        auto succeeded = !was_cancelled;
+        GvoxResult res = gvox_get_result(gvox_ctx);
+        while (res != GVOX_RESULT_SUCCESS) {
+            if (!was_cancelled) {
+                size_t size = 0;
+                gvox_get_result_message(gvox_ctx, nullptr, &size);
+                char *str = new char[size + 1];
+                gvox_get_result_message(gvox_ctx, str, nullptr);
+                str[size] = '\0';
+                debug_utils::Console::add_log(fmt::format("ERROR loading model: {}", str));
+                delete[] str;
+            }
+            gvox_pop_result(gvox_ctx);
+            res = gvox_get_result(gvox_ctx);
+            succeeded = false;
+        }
+
+        gvox_destroy_adapter_context(o_ctx);
+        gvox_destroy_adapter_context(s_ctx);
+        // Whatever the serializer wrote last is still sitting in the slab.
+        slab_writer.flush();
+        return succeeded ? slab_writer.total_size : 0;
     }
 
-    auto mesh_gpu_input = MeshGpuInput{};
-    mesh_gpu_input.size = {768, 768, 768};
-    mesh_gpu_input.bound_min = mesh_model.bound_min;
-    mesh_gpu_input.bound_max = mesh_model.bound_max;
-
-    daxa::SamplerId texture_sampler = gpu_context->device.create_sampler({
-        .magnification_filter = daxa::Filter::LINEAR,
-        .minification_filter = daxa::Filter::LINEAR,
-        .address_mode_u = daxa::SamplerAddressMode::REPEAT,
-        .address_mode_v = daxa::SamplerAddressMode::REPEAT,
-        .address_mode_w = daxa::SamplerAddressMode::REPEAT,
-        .name = "texture_sampler",
-    });
-    daxa::BufferId mesh_gpu_input_buffer = gpu_context->device.create_buffer(daxa::BufferInfo{
-        .size = sizeof(MeshGpuInput),
-        .name = "mesh_gpu_input_buffer",
-    });
-    daxa::BufferId voxel_buffer = gpu_context->device.create_buffer(daxa::BufferInfo{
-        .size = sizeof(uint32_t) * mesh_gpu_input.size.x * mesh_gpu_input.size.y * mesh_gpu_input.size.z,
-        .name = "voxel_buffer",
-    });
-    daxa::BufferId staging_voxel_buffer = gpu_context->device.create_buffer({
-        .size = sizeof(uint32_t) * mesh_gpu_input.size.x * mesh_gpu_input.size.y * mesh_gpu_input.size.z,
-        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-        .name = "staging_voxel_buffer",
-    });
-    auto preprocess_pipeline = gpu_context->pipeline_manager->add_compute_pipeline({
-        .shader_info = {
-            .source = daxa::ShaderFile{"utilities/mesh/preprocess.comp.glsl"},
-        },
-        .push_constant_size = sizeof(MeshPreprocessPush),
-        .name = "preprocess_pipeline",
-    });
-    auto raster_pipeline = gpu_context->pipeline_manager->add_raster_pipeline({
-        .vertex_shader_info = daxa::ShaderCompileInfo{
-            .source = daxa::ShaderFile{"utilities/mesh/voxelize.raster.glsl"},
-            .compile_options = {.defines = {{"RASTER_VERT", "1"}}},
-        },
-        .fragment_shader_info = daxa::ShaderCompileInfo{
-            .source = daxa::ShaderFile{"utilities/mesh/voxelize.raster.glsl"},
-            .compile_options = {.defines = {{"RASTER_FRAG", "1"}}},
-        },
-        .raster = {
-            // .samples = 8,
-            .conservative_raster_info = daxa::ConservativeRasterInfo{
-                .mode = daxa::ConservativeRasterizationMode::OVERESTIMATE,
-                .size = 0.0f,
+    auto voxelize_mesh_model(GvoxContext *gvox_ctx, ModelLoadInfo const &info, GvoxModelSink &sink, ModelLoadProgress &progress) -> size_t {
+        progress.set_stage(ModelLoadStage::READ_FILE);
+        MeshModel mesh_model;
+        if (!::load_mesh_model(mesh_model, info.path, ThreadPool::s_instance) || mesh_model.meshes.size() == 0) {
+            debug_utils::Console::add_log("[error] Failed to load the mesh model");
+            return 0;
+        }
+        if (progress.cancelled.load()) {
+            return 0;
+        }
+
+        progress.set_stage(ModelLoadStage::VOXELIZE);
+        auto voxelizer_info = MeshVoxelizerInfo{
+            .resolution = info.mesh_voxelization_resolution,
+            .progress = &progress.stage_progress,
+            .cancelled = &progress.cancelled,
+        };
+        auto voxelized_mesh = voxelize_mesh(mesh_model, voxelizer_info, ThreadPool::s_instance);
+        if (progress.cancelled.load()) {
+            return 0;
+        }
+        if (voxelized_mesh.bricks.empty()) {
+            debug_utils::Console::add_log("[error] Failed to voxelize the mesh model");
+            return 0;
+        }
+
+        progress.set_stage(ModelLoadStage::SERIALIZE);
+        auto voxelized_mesh_state = VoxelizedMeshState{
+            .voxelized_mesh = &voxelized_mesh,
+            .cached_brick_key = std::numeric_limits<uint64_t>::max(),
+            .cached_brick = nullptr,
+        };
+        GvoxAdapterContext *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "voxelized_mesh"), &voxelized_mesh_state);
+        GvoxRegionRange region_range = {
+            .offset = {0, 0, 0},
+            .extent = {
+                voxelized_mesh.size.x,
+                voxelized_mesh.size.y,
+                voxelized_mesh.size.z,
             },
-        },
-        .push_constant_size = sizeof(MeshRasterPush),
-        .name = "raster_pipeline",
-    });
-    daxa::CommandSubmitInfo submit_info;
-    daxa::TaskGraph task_list = daxa::TaskGraph({
-        .device = gpu_context->device,
-        .name = "mesh voxel conv",
-    });
-    auto task_gpu_input_buffer = daxa::TaskBuffer(daxa::TaskBufferInfo{.initial_buffers = {.buffers = std::array{mesh_gpu_input_buffer}}, .name = "task_gpu_input_buffer"});
-    task_list.use_persistent_buffer(task_gpu_input_buffer);
-    auto task_vertex_buffer_ids = std::vector<daxa::BufferId>{};
-    auto task_image_ids = std::vector<daxa::ImageId>{};
-    for (auto const &mesh : mesh_model.meshes) {
-        task_vertex_buffer_ids.push_back(mesh.vertex_buffer);
-        task_image_ids.push_back(mesh.textures[0]->image_id);
-        // task_list.add_runtime_buffer(task_vertex_buffer, mesh.vertex_buffer);
-        // task_list.add_runtime_image(task_image_id, mesh.textures[0]->image_id);
+        };
+        auto result = load_gvox_data_from_parser(gvox_ctx, nullptr, p_ctx, &region_range, info, sink, progress);
+        gvox_destroy_adapter_context(p_ctx);
+        return result;
     }
-    auto task_vertex_buffer = daxa::TaskBuffer(daxa::TaskBufferInfo{.initial_buffers = {.buffers = task_vertex_buffer_ids}, .name = "task_vertex_buffer"});
-    auto task_image_id = daxa::TaskImage(daxa::TaskImageInfo{.initial_images = {.images = task_image_ids}, .name = "task_image_id"});
-    auto task_voxel_buffer = daxa::TaskBuffer(daxa::TaskBufferInfo{.initial_buffers = {.buffers = std::array{voxel_buffer}}, .name = "task_voxel_buffer"});
-    auto task_staging_voxel_buffer = daxa::TaskBuffer(daxa::TaskBufferInfo{.initial_buffers = {.buffers = std::array{staging_voxel_buffer}}, .name = "task_staging_voxel_buffer"});
-    task_list.use_persistent_buffer(task_vertex_buffer);
-    task_list.use_persistent_image(task_image_id);
-    task_list.use_persistent_buffer(task_voxel_buffer);
-    task_list.use_persistent_buffer(task_staging_voxel_buffer);
-    task_list.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_gpu_input_buffer),
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_vertex_buffer),
-        },
-        .task = [&](daxa::TaskInterface const &ti) {
-            {
-                auto staging_gpu_input_buffer = ti.device.create_buffer({
-                    .size = sizeof(MeshGpuInput),
-                    .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .name = "staging_gpu_input_buffer",
-                });
-                ti.recorder.destroy_buffer_deferred(staging_gpu_input_buffer);
-                auto *buffer_ptr = ti.device.get_host_address_as<MeshGpuInput>(staging_gpu_input_buffer).value();
-                *buffer_ptr = mesh_gpu_input;
-                ti.recorder.copy_buffer_to_buffer({
-                    .src_buffer = staging_gpu_input_buffer,
-                    .dst_buffer = mesh_gpu_input_buffer,
-                    .size = sizeof(MeshGpuInput),
-                });
+
+    auto load_gvox_data(GvoxContext *gvox_ctx, ModelLoadInfo const &info, GvoxModelSink &sink, ModelLoadProgress &progress) -> size_t {
+        void *i_config_ptr = nullptr;
+        auto voxlap_config = GvoxVoxlapParseAdapterConfig{
+            .size_x = 512,
+            .size_y = 512,
+            .size_z = 64,
+            .make_solid = 1,
+            .is_ace_of_spades = 1,
+        };
+        char const *gvox_model_type = "gvox_palette";
+        if (info.path.has_extension()) {
+            auto ext = info.path.extension();
+            if (ext == ".vox") {
+                gvox_model_type = "magicavoxel";
+            } else if (ext == ".rle") {
+                gvox_model_type = "gvox_run_length_encoding";
+            } else if (ext == ".oct") {
+                gvox_model_type = "gvox_octree";
+            } else if (ext == ".glp") {
+                gvox_model_type = "gvox_global_palette";
+            } else if (ext == ".brk") {
+                gvox_model_type = "gvox_brickmap";
+            } else if (ext == ".gvr") {
+                gvox_model_type = "gvox_raw";
+            } else if (ext == ".vxl") {
+                i_config_ptr = &voxlap_config;
+                gvox_model_type = "voxlap";
+            } else if (ext == ".gvox") {
+                gvox_model_type = "gvox_palette";
+            } else {
+                return voxelize_mesh_model(gvox_ctx, info, sink, progress);
             }
-            {
-                size_t vert_n = 0;
-                for (auto const &mesh : mesh_model.meshes) {
-                    vert_n += mesh.verts.size();
+        } else {
+            return voxelize_mesh_model(gvox_ctx, info, sink, progress);
+        }
+        progress.set_stage(ModelLoadStage::READ_FILE);
+        auto file = MappedFile(info.path);
+        if (!file.is_open()) {
+            debug_utils::Console::add_log("[error] Failed to load the model");
+            return 0;
+        }
+        file.advise_sequential();
+        // Parsing and serializing are interleaved inside the blit. The sink moves the stage on to
+        // SERIALIZE once output starts coming out.
+        progress.set_stage(ModelLoadStage::PARSE);
+        auto input_state = MappedFileInputState{.file = &file, .progress = &progress, .read_end = 0};
+        GvoxAdapterContext *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "mapped_file"), &input_state);
+        GvoxAdapterContext *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, gvox_model_type), i_config_ptr);
+        auto result = load_gvox_data_from_parser(gvox_ctx, i_ctx, p_ctx, nullptr, info, sink, progress);
+        gvox_destroy_adapter_context(i_ctx);
+        gvox_destroy_adapter_context(p_ctx);
+        return result;
+    }
+} // namespace
+
+void GvoxSlabWriter::write(size_t offset, std::span<uint8_t const> bytes) {
+    total_size = std::max(total_size, offset + bytes.size());
+    // Overwrites or extends the current slab, as long as it stays within one slab.
+    auto const slab_end = slab_offset + slab.size();
+    if (!slab.empty() && offset >= slab_offset && offset <= slab_end && offset + bytes.size() <= slab_offset + slab_size) {
+        auto const in_slab_offset = offset - slab_offset;
+        if (in_slab_offset + bytes.size() > slab.size()) {
+            slab.resize(in_slab_offset + bytes.size());
+        }
+        std::copy(bytes.begin(), bytes.end(), slab.begin() + static_cast<std::ptrdiff_t>(in_slab_offset));
+        return;
+    }
+    flush();
+    if (bytes.size() >= slab_size) {
+        for (size_t i = 0; i < bytes.size(); i += slab_size) {
+            sink->write(offset + i, bytes.subspan(i, std::min(slab_size, bytes.size() - i)));
+            ++flushed_slab_n;
+        }
+        return;
+    }
+    slab.reserve(slab_size);
+    slab_offset = offset;
+    slab.assign(bytes.begin(), bytes.end());
+}
+
+void GvoxSlabWriter::flush() {
+    if (slab.empty()) {
+        return;
+    }
+    sink->write(slab_offset, slab);
+    ++flushed_slab_n;
+    slab.clear();
+}
+
+auto to_string(ModelLoadStage stage) -> std::string_view {
+    switch (stage) {
+    case ModelLoadStage::QUEUED: return "Queued";
+    case ModelLoadStage::READ_FILE: return "Reading file";
+    case ModelLoadStage::PARSE: return "Parsing";
+    case ModelLoadStage::VOXELIZE: return "Voxelizing";
+    case ModelLoadStage::SERIALIZE: return "Serializing";
+    case ModelLoadStage::UPLOAD: return "Uploading";
+    case ModelLoadStage::DONE: return "Done";
+    case ModelLoadStage::FAILED: return "Failed";
+    case ModelLoadStage::CANCELLED: return "Cancelled";
+    }
+    return "";
+}
+
+auto load_gvox_model(ModelLoadInfo const &info, GvoxModelSink &sink, ModelLoadProgress &progress) -> size_t {
+    // A context per load, since a cancelled load keeps running alongside the one that replaced it.
+    auto *gvox_ctx = gvox_create_context();
+    register_adapters(gvox_ctx);
+    auto result = load_gvox_data(gvox_ctx, info, sink, progress);
+    gvox_destroy_context(gvox_ctx);
+    return result;
+}
+
+void AsyncModelLoad::start(ThreadPool *thread_pool, LoadFunction load) {
+    auto job_fn = [shared_state = state, load = std::move(load), can_stall = thread_pool != nullptr]() {
+        auto &progress = shared_state->progress;
+        auto sink = GvoxModelSink{
+            .reserve = [&shared_state](size_t size) {
+                auto lock = std::lock_guard{shared_state->mtx};
+                shared_state->reserved_size = std::max(shared_state->reserved_size, size);
+            },
+            .write = [&shared_state, &progress, can_stall](size_t offset, std::span<uint8_t const> bytes) {
+                if (progress.stage.load(std::memory_order_relaxed) == ModelLoadStage::PARSE) {
+                    progress.set_stage(ModelLoadStage::SERIALIZE);
                 }
-                auto staging_vertex_buffer = ti.device.create_buffer({
-                    .size = sizeof(MeshVertex) * vert_n,
-                    .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .name = "staging_vertex_buffer",
-                });
-                ti.recorder.destroy_buffer_deferred(staging_vertex_buffer);
-                auto *buffer_ptr = ti.device.get_host_address_as<MeshVertex>(staging_vertex_buffer).value();
-                size_t vert_offset = 0;
-                for (auto const &mesh : mesh_model.meshes) {
-                    std::memcpy(buffer_ptr + vert_offset, mesh.verts.data(), sizeof(MeshVertex) * mesh.verts.size());
-                    ti.recorder.copy_buffer_to_buffer({
-                        .src_buffer = staging_vertex_buffer,
-                        .dst_buffer = mesh.vertex_buffer,
-                        .src_offset = sizeof(MeshVertex) * vert_offset,
-                        .size = sizeof(MeshVertex) * mesh.verts.size(),
-                    });
-                    vert_offset += mesh.verts.size();
+                auto lock = std::unique_lock{shared_state->mtx};
+                if (can_stall) {
+                    shared_state->slab_polled.wait(lock, [&]() { return shared_state->pending_slabs.size() < MAX_PENDING_SLAB_N || progress.cancelled.load(); });
                 }
-            }
-        },
-        .name = "Input Transfer",
-    });
-    task_list.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_voxel_buffer),
-        },
-        .task = [&](daxa::TaskInterface const &ti) {
-            ti.recorder.clear_buffer({
-                .buffer = voxel_buffer,
-                .offset = 0,
-                .size = sizeof(uint32_t) * mesh_gpu_input.size.x * mesh_gpu_input.size.y * mesh_gpu_input.size.z,
-                .clear_value = {},
-            });
-        },
-        .name = "Clear Output",
-    });
-    task_list.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_gpu_input_buffer),
-            daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_vertex_buffer),
-        },
-        .task = [&](daxa::TaskInterface const &ti) {
-            for (auto const &mesh : mesh_model.meshes) {
-                if (!preprocess_pipeline.is_valid()) {
+                if (progress.cancelled.load()) {
                     return;
                 }
-                ti.recorder.set_pipeline(preprocess_pipeline.get());
-                set_push_constant(
-                    ti,
-                    MeshPreprocessPush{
-                        .modl_mat = mesh.modl_mat,
-                        .gpu_input = ti.device.get_device_address(mesh_gpu_input_buffer).value(),
-                        .vertex_buffer = ti.device.get_device_address(mesh.vertex_buffer).value(),
-                        .normal_buffer = ti.device.get_device_address(mesh.normal_buffer).value(),
-                        .triangle_count = static_cast<uint32_t>(mesh.verts.size() / 3),
-                    });
-                ti.recorder.dispatch({.x = static_cast<uint32_t>(mesh.verts.size() / 3)});
-            }
-        },
-        .name = "Preprocess Verts",
-    });
-    task_list.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::FRAGMENT_SHADER_READ, task_gpu_input_buffer),
-            daxa::inl_attachment(daxa::TaskBufferAccess::FRAGMENT_SHADER_READ, task_vertex_buffer),
-            daxa::inl_attachment(daxa::TaskBufferAccess::FRAGMENT_SHADER_WRITE, task_voxel_buffer),
-            daxa::inl_attachment(daxa::TaskImageAccess::FRAGMENT_SHADER_SAMPLED, daxa::ImageViewType::REGULAR_2D, task_image_id.view().view({.base_mip_level = 0, .level_count = 4})),
-        },
-        .task = [&](daxa::TaskInterface const &ti) {
-            auto renderpass_recorder = std::move(ti.recorder).begin_renderpass({.render_area = {.width = mesh_gpu_input.size.x, .height = mesh_gpu_input.size.y}});
-            if (!raster_pipeline.is_valid()) {
-                return;
-            }
-            renderpass_recorder.set_pipeline(raster_pipeline.get());
-            for (auto const &mesh : mesh_model.meshes) {
-                set_push_constant(
-                    ti, renderpass_recorder,
-                    MeshRasterPush{
-                        .gpu_input = ti.device.get_device_address(mesh_gpu_input_buffer).value(),
-                        .vertex_buffer = ti.device.get_device_address(mesh.vertex_buffer).value(),
-                        .normal_buffer = ti.device.get_device_address(mesh.normal_buffer).value(),
-                        .voxel_buffer = ti.device.get_device_address(voxel_buffer).value(),
-                        .texture_id = {.value = static_cast<uint32_t>(mesh.textures[0]->image_id.default_view().index)},
-                        .texture_sampler = texture_sampler,
-                    });
-                renderpass_recorder.draw({.vertex_count = static_cast<uint32_t>(mesh.verts.size())});
-            }
-            ti.recorder = std::move(renderpass_recorder).end_renderpass();
-        },
-        .name = "Raster to Voxels",
-    });
-    task_list.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, task_voxel_buffer),
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_staging_voxel_buffer),
-        },
-        .task = [&](daxa::TaskInterface const &ti) {
-            ti.recorder.copy_buffer_to_buffer({
-                .src_buffer = voxel_buffer,
-                .dst_buffer = staging_voxel_buffer,
-                .size = sizeof(uint32_t) * mesh_gpu_input.size.x * mesh_gpu_input.size.y * mesh_gpu_input.size.z,
-            });
-        },
-        .name = "Output Transfer",
-    });
-    task_list.submit({});
-    task_list.complete({});
-    task_list.execute({});
-    gpu_context->device.wait_idle();
-    auto cleanup = [&]() {
-        gpu_context->device.wait_idle();
-        gpu_context->device.destroy_buffer(mesh_gpu_input_buffer);
-        for (auto &mesh : mesh_model.meshes) {
-            gpu_context->device.destroy_buffer(mesh.vertex_buffer);
-            gpu_context->device.destroy_buffer(mesh.normal_buffer);
-        }
-        for (auto &[key, value] : mesh_model.textures) {
-            gpu_context->device.destroy_image(value->image_id);
-        }
-        gpu_context->device.destroy_buffer(voxel_buffer);
-        gpu_context->device.destroy_buffer(staging_voxel_buffer);
-        gpu_context->device.destroy_sampler(texture_sampler);
+                shared_state->pending_slabs.push_back({.offset = offset, .bytes = {bytes.begin(), bytes.end()}});
+                // The header is patched in last, so this goes by the furthest write.
+                shared_state->written_end = std::max(shared_state->written_end, offset + bytes.size());
+                if (shared_state->reserved_size != 0) {
+                    progress.stage_progress.store(std::min(1.0f, static_cast<float>(shared_state->written_end) / static_cast<float>(shared_state->reserved_size)), std::memory_order_relaxed);
+                }
+            },
+            .finish = {},
+            .cancel = {},
+        };
+        auto const model_size = load(sink, progress);
+        auto lock = std::lock_guard{shared_state->mtx};
+        // The stage is set before is_finished, so that poll() never sees a finished load in an earlier stage.
+        progress.set_stage(model_size != 0 ? ModelLoadStage::UPLOAD : ModelLoadStage::FAILED);
+        shared_state->model_size = model_size;
+        shared_state->is_finished = true;
     };
-    auto *buffer_ptr = gpu_context->device.get_host_address_as<uint32_t>(staging_voxel_buffer).value();
-    if (buffer_ptr == nullptr) {
-        cleanup();
-        debug_utils::Console::add_log("[error] Failed to voxelize the mesh model");
-        should_upload_gvox_model = false;
-        return {};
+    if (thread_pool != nullptr) {
+        job = thread_pool->enqueue(std::move(job_fn));
+    } else {
+        job_fn();
     }
+}
 
-    struct GpuOutputState {
-        uint32_t *buffer_ptr;
-        daxa_u32vec3 size;
-    };
+void AsyncModelLoad::cancel() {
+    state->progress.cancelled.store(true);
+    {
+        auto lock = std::lock_guard{state->mtx};
+        state->pending_slabs.clear();
+    }
+    state->slab_polled.notify_all();
+}
 
-    auto gpu_output_state = GpuOutputState{
-        .buffer_ptr = buffer_ptr,
-        .size = mesh_gpu_input.size,
-    };
+auto AsyncModelLoad::poll(GvoxModelSink &upload_sink) -> ModelLoadStage {
+    if (final_stage) {
+        return *final_stage;
+    }
+    if (state->progress.cancelled.load()) {
+        // The job no longer produces anything, and holds on to its own share of the state.
+        if (upload_sink.cancel) {
+            upload_sink.cancel();
+        }
+        final_stage = ModelLoadStage::CANCELLED;
+        return *final_stage;
+    }
 
-    GvoxParseAdapterInfo procedural_adapter_info = {
-        .base_info = {
-            .name_str = "gpu_result",
-            .create = [](GvoxAdapterContext *ctx, void const *user_state_ptr) -> void {
-                gvox_adapter_set_user_pointer(ctx, const_cast<void *>(user_state_ptr));
-            },
-            .destroy = [](GvoxAdapterContext *) -> void {},
-            .blit_begin = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {},
-            .blit_end = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) {},
-        },
-        .query_details = []() -> GvoxParseAdapterDetails { return {.preferred_blit_mode = GVOX_BLIT_MODE_SERIALIZE_DRIVEN}; },
-        .query_parsable_range = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) -> GvoxRegionRange { return {{0, 0, 0}, {0, 0, 0}}; },
-        .sample_region = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegion const * /*unused*/, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
-            auto &[buffer_ptr_, size] = *static_cast<GpuOutputState *>(gvox_adapter_get_user_pointer(ctx));
-            auto voxel_i = static_cast<size_t>(offset->x) + size.x * offset->y + size.x * size.y * offset->z;
-            auto uint32_t_voxel = buffer_ptr_[voxel_i];
-            // float r = static_cast<float>((uint32_t_voxel >> 0x00) & 0xff) / 255.0f;
-            // float g = static_cast<float>((uint32_t_voxel >> 0x08) & 0xff) / 255.0f;
-            // float b = static_cast<float>((uint32_t_voxel >> 0x10) & 0xff) / 255.0f;
-            // uint32_t const id = (uint32_t_voxel >> 0x18) & 0xff;
-            switch (channel_id) {
-            case GVOX_CHANNEL_ID_COLOR: return {uint32_t_voxel, 1u};
-            // case GVOX_CHANNEL_ID_NORMAL: return {0x0, 1u};
-            // case GVOX_CHANNEL_ID_MATERIAL_ID: return {id, 1u};
-            default:
-                gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "Tried sampling something other than color or normal");
-                return {0u, 0u};
-            }
-            return {};
-        },
-        .query_region_flags = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) -> uint32_t { return 0; },
-        .load_region = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> GvoxRegion {
-            GvoxRegion const region = {.range = *range, .channels = channel_flags, .flags = 0u, .data = nullptr};
-            return region;
-        },
-        .unload_region = [](GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegion * /*unused*/) {},
-        .parse_region = [](GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> void {
-            GvoxRegion const region = {.range = *range, .channels = channel_flags, .flags = 0u, .data = nullptr};
-            gvox_emit_region(blit_ctx, &region);
-        },
-    };
+    auto slab = std::optional<PendingSlab>{};
+    auto reserved_size = size_t{0};
+    auto is_finished = false;
+    auto model_size = size_t{0};
+    {
+        auto lock = std::lock_guard{state->mtx};
+        if (!state->pending_slabs.empty()) {
+            slab = std::move(state->pending_slabs.front());
+            state->pending_slabs.pop_front();
+        }
+        reserved_size = state->reserved_size;
+        // Only once the slabs the job left behind are all handed over.
+        is_finished = state->is_finished && state->pending_slabs.empty();
+        model_size = state->model_size;
+    }
+    state->slab_polled.notify_all();
 
-    static auto parse_adapter = gvox_register_parse_adapter(gvox_ctx, &procedural_adapter_info);
+    if (reserved_size != 0 && upload_sink.reserve) {
+        upload_sink.reserve(reserved_size);
+    }
+    if (slab) {
+        upload_sink.write(slab->offset, slab->bytes);
+    }
+    if (!is_finished) {
+        return stage();
+    }
 
-    GvoxAdapterContext *p_ctx = gvox_create_adapter_context(gvox_ctx, parse_adapter, &gpu_output_state);
-    GvoxRegionRange region_range = {
-        .offset = {0, 0, 0},
-        .extent = {
-            mesh_gpu_input.size.x,
-            mesh_gpu_input.size.y,
-            mesh_gpu_input.size.z,
-        },
-    };
-    auto result = load_gvox_data_from_parser(nullptr, p_ctx, &region_range);
-    gvox_destroy_adapter_context(p_ctx);
-    cleanup();
-    if (result.size == 0) {
-        should_upload_gvox_model = false;
+    if (model_size == 0) {
+        if (upload_sink.cancel) {
+            upload_sink.cancel();
+        }
+        final_stage = ModelLoadStage::FAILED;
+    } else {
+        if (upload_sink.finish) {
+            upload_sink.finish(model_size);
+        }
+        final_stage = ModelLoadStage::DONE;
+    }
+    state->progress.set_stage(*final_stage);
+    return *final_stage;
+}
+
+void VoxelModelLoader::create(GpuContext &gpu_context) {
+    this->gpu_context = &gpu_context;
+    gvox_model_buffer = this->gpu_context->device.create_buffer({
+        .size = offsetof(GpuGvoxModel, data),
+        .name = "gvox_model_buffer",
+    });
+    task_gvox_model_buffer.set_buffers({.buffers = std::array{gvox_model_buffer}});
+}
+
+void VoxelModelLoader::destroy() {
+    if (current_load) {
+        current_load->cancel();
+        cancelled_load_jobs.push_back(current_load->job);
+        current_load.reset();
+    }
+    // The jobs only touch their own state, but use the thread pool, which goes away after the app.
+    for (auto const &job : cancelled_load_jobs) {
+        ThreadPool::s_instance->wait(job);
+    }
+    cancelled_load_jobs.clear();
+    pending_model_copies.clear();
+    for (auto buffer : pending_model_buffer_destroys) {
+        gpu_context->device.destroy_buffer(buffer);
+    }
+    pending_model_buffer_destroys.clear();
+    if (!uploading_model_buffer.is_empty()) {
+        gpu_context->device.destroy_buffer(uploading_model_buffer);
+    }
+    if (!gvox_model_buffer.is_empty()) {
+        gpu_context->device.destroy_buffer(gvox_model_buffer);
     }
-    return result;
 }
 
 void VoxelModelLoader::update(AppUi &ui) {
@@ -348,199 +473,173 @@ void VoxelModelLoader::update(AppUi &ui) {
         ui.should_upload_gvox_model = false;
         gvox_model_path = ui.gvox_model_path;
     }
+
+    auto upload_sink = make_upload_sink();
     if (should_upload_gvox_model) {
-        if (false) {
-            // async model loading.. broken with mesh import
-            if (!model_is_loading) {
-                gvox_model_data_future = std::async(std::launch::async, &VoxelModelLoader::load_gvox_data, this);
-                model_is_loading = true;
-            }
-            if (model_is_loading && gvox_model_data_future.wait_for(0.01s) == std::future_status::ready) {
-                model_is_ready = true;
-                model_is_loading = false;
-                gvox_model_data = gvox_model_data_future.get();
-                prev_gvox_model_buffer = gvox_model_buffer;
-                gvox_model_buffer = gpu_context->device.create_buffer({
-                    .size = gvox_model_data.size,
-                    .name = "gvox_model_buffer",
-                });
-                task_gvox_model_buffer.set_buffers({.buffers = std::array{gvox_model_buffer}});
-            }
-        } else {
-            if (!model_is_loading) {
-                model_is_loading = true;
-            }
-            if (model_is_loading) {
-                model_is_loading = false;
-                gvox_model_data = load_gvox_data();
-                if (gvox_model_data.size != 0) {
-                    model_is_ready = true;
-                    prev_gvox_model_buffer = gvox_model_buffer;
-                    gvox_model_buffer = gpu_context->device.create_buffer({
-                        .size = gvox_model_data.size,
-                        .name = "gvox_model_buffer",
-                    });
-                    task_gvox_model_buffer.set_buffers({.buffers = std::array{gvox_model_buffer}});
-                }
-            }
+        should_upload_gvox_model = false;
+        if (current_load) {
+            // Picking another file replaces whatever was loading before.
+            current_load->cancel();
+            current_load->poll(upload_sink);
+            cancelled_load_jobs.push_back(current_load->job);
         }
+        std::erase_if(cancelled_load_jobs, [](JobHandle const &job) { return job.done(); });
+        current_load = std::make_unique<AsyncModelLoad>();
+        current_load->start(
+            ThreadPool::s_instance,
+            [info = ModelLoadInfo{
+                 .path = gvox_model_path,
+                 .mesh_voxelization_resolution = mesh_voxelization_resolution,
+                 .slab_size = upload_slab_size,
+             }](GvoxModelSink &sink, ModelLoadProgress &progress) {
+                return load_gvox_model(info, sink, progress);
+            });
+        model_is_loading = true;
     }
 
-    if (model_is_ready) {
-        upload_model();
+    if (!current_load) {
+        return;
     }
+    auto const stage = current_load->poll(upload_sink);
+    submit_model_copies();
+    switch (stage) {
+    case ModelLoadStage::DONE:
+    case ModelLoadStage::FAILED:
+    case ModelLoadStage::CANCELLED:
+        debug_utils::DebugDisplay::set_debug_string("Model Load", std::string{to_string(stage)});
+        model_is_loading = false;
+        if (stage == ModelLoadStage::DONE) {
+            // The new model is in gvox_model_buffer, so the world is regenerated from it next frame.
+            model_is_ready = true;
+        }
+        current_load.reset();
+        break;
+    default:
+        debug_utils::DebugDisplay::set_debug_string("Model Load", fmt::format("{} ({:.0f}%)", to_string(stage), current_load->stage_progress() * 100.0f));
+        break;
+    }
+}
+
+auto VoxelModelLoader::make_upload_sink() -> GvoxModelSink {
+    return {
+        .reserve = [this](size_t size) { ensure_uploading_buffer_size(size); },
+        .write = [this](size_t offset, std::span<uint8_t const> bytes) {
+            ensure_uploading_buffer_size(offset + bytes.size());
+            // Slabs are written from poll(), so the copies are submitted in the same frame.
+            auto const staging = gpu_context->upload_ring.allocate(bytes.size());
+            std::copy(bytes.begin(), bytes.end(), staging.host_ptr);
+            pending_model_copies.push_back({
+                .src_buffer = staging.buffer,
+                .dst_buffer = uploading_model_buffer,
+                .src_offset = staging.offset,
+                .dst_offset = offset,
+                .size = bytes.size(),
+            });
+        },
+        .finish = [this](size_t /*unused*/) {
+            submit_model_copies();
+            // The copies above were submitted to the same queue, so they're done by the time
+            // anything from the frame graph reads the new buffer.
+            auto prev_gvox_model_buffer = std::exchange(gvox_model_buffer, std::exchange(uploading_model_buffer, {}));
+            uploading_model_buffer_size = 0;
+            task_gvox_model_buffer.set_buffers({.buffers = std::array{gvox_model_buffer}});
+            auto temp_task_graph = daxa::TaskGraph({
+                .device = gpu_context->device,
+                .name = "temp_task_graph",
+            });
+            temp_task_graph.use_persistent_buffer(task_gvox_model_buffer);
+            temp_task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_gvox_model_buffer),
+                },
+                .task = [prev_gvox_model_buffer](daxa::TaskInterface const &ti) {
+                    if (!prev_gvox_model_buffer.is_empty()) {
+                        ti.recorder.destroy_buffer_deferred(prev_gvox_model_buffer);
+                    }
+                    ti.recorder.pipeline_barrier({
+                        .src_access = daxa::AccessConsts::TRANSFER_WRITE,
+                        .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
+                    });
+                },
+                .name = "swap_model",
+            });
+            temp_task_graph.submit({});
+            temp_task_graph.complete({});
+            temp_task_graph.execute({});
+            has_model = true;
+        },
+        .cancel = [this]() {
+            if (!uploading_model_buffer.is_empty()) {
+                pending_model_buffer_destroys.push_back(std::exchange(uploading_model_buffer, {}));
+                uploading_model_buffer_size = 0;
+            }
+            submit_model_copies();
+        },
+    };
 }
 
-void VoxelModelLoader::upload_model() {
+void VoxelModelLoader::ensure_uploading_buffer_size(size_t size) {
+    if (size <= uploading_model_buffer_size) {
+        return;
+    }
+    // Only happens after the first reserve when the serializer doesn't know the final size up
+    // front. The old contents are copied on the GPU, so growing doesn't cost any CPU memory.
+    auto const grown_size = std::max(size, uploading_model_buffer_size * 2);
+    auto grown_buffer = gpu_context->device.create_buffer({
+        .size = grown_size,
+        .name = "gvox_model_buffer",
+    });
+    if (!uploading_model_buffer.is_empty()) {
+        pending_model_copies.push_back({
+            .src_buffer = uploading_model_buffer,
+            .dst_buffer = grown_buffer,
+            .src_offset = 0,
+            .dst_offset = 0,
+            .size = uploading_model_buffer_size,
+        });
+        // Copies into the old buffer that are still pending were queued before this one, so they
+        // are carried over too.
+        pending_model_buffer_destroys.push_back(uploading_model_buffer);
+    }
+    uploading_model_buffer = grown_buffer;
+    uploading_model_buffer_size = grown_size;
+}
+
+void VoxelModelLoader::submit_model_copies() {
+    if (pending_model_copies.empty() && pending_model_buffer_destroys.empty()) {
+        return;
+    }
     auto temp_task_graph = daxa::TaskGraph({
         .device = gpu_context->device,
         .name = "temp_task_graph",
     });
-    temp_task_graph.use_persistent_buffer(task_gvox_model_buffer);
     temp_task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_gvox_model_buffer),
-        },
-        .task = [this](daxa::TaskInterface const &ti) {
-            if (!prev_gvox_model_buffer.is_empty()) {
-                ti.recorder.destroy_buffer_deferred(prev_gvox_model_buffer);
+        .attachments = {},
+        .task = [copies = std::move(pending_model_copies), destroys = std::move(pending_model_buffer_destroys)](daxa::TaskInterface const &ti) {
+            for (auto const &copy : copies) {
+                // Copies into the same buffer can overlap (the header is written last), so they have to stay in order.
+                ti.recorder.pipeline_barrier({
+                    .src_access = daxa::AccessConsts::TRANSFER_WRITE,
+                    .dst_access = daxa::AccessConsts::TRANSFER_READ_WRITE,
+                });
+                ti.recorder.copy_buffer_to_buffer({
+                    .src_buffer = copy.src_buffer,
+                    .dst_buffer = copy.dst_buffer,
+                    .src_offset = copy.src_offset,
+                    .dst_offset = copy.dst_offset,
+                    .size = copy.size,
+                });
             }
-            ti.recorder.pipeline_barrier({
-                .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
-            });
-            auto staging_gvox_model_buffer = ti.device.create_buffer({
-                .size = gvox_model_data.size,
-                .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                .name = "staging_gvox_model_buffer",
-            });
-            ti.recorder.destroy_buffer_deferred(staging_gvox_model_buffer);
-            char *buffer_ptr = ti.device.get_host_address_as<char>(staging_gvox_model_buffer).value();
-            std::copy(gvox_model_data.ptr, gvox_model_data.ptr + gvox_model_data.size, buffer_ptr);
-            if (gvox_model_data.ptr != nullptr) {
-                free(gvox_model_data.ptr);
+            // Deferred, so they only go once the GPU is done with the copies.
+            for (auto buffer : destroys) {
+                ti.recorder.destroy_buffer_deferred(buffer);
             }
-            ti.recorder.copy_buffer_to_buffer({
-                .src_buffer = staging_gvox_model_buffer,
-                .dst_buffer = gvox_model_buffer,
-                .size = gvox_model_data.size,
-            });
-            should_upload_gvox_model = false;
-            has_model = true;
         },
         .name = "upload_model",
     });
+    pending_model_copies.clear();
+    pending_model_buffer_destroys.clear();
     temp_task_graph.submit({});
     temp_task_graph.complete({});
     temp_task_graph.execute({});
-    model_is_ready = false;
-}
-
-auto VoxelModelLoader::load_gvox_data_from_parser(GvoxAdapterContext *i_ctx, GvoxAdapterContext *p_ctx, GvoxRegionRange const *region_range) -> GvoxModelData {
-    auto result = GvoxModelData{};
-    GvoxByteBufferOutputAdapterConfig o_config = {
-        .out_size = &result.size,
-        .out_byte_buffer_ptr = &result.ptr,
-        .allocate = nullptr,
-    };
-    GvoxAdapterContext *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
-    GvoxAdapterContext *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_palette"), nullptr);
-
-    {
-        // time_t start = clock();
-        gvox_blit_region(
-            i_ctx, o_ctx, p_ctx, s_ctx,
-            region_range,
-            // GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID | GVOX_CHANNEL_BIT_EMISSIVITY);
-            GVOX_CHANNEL_BIT_COLOR);
-        // time_t end = clock();
-        // double cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
-        // debug_utils::Console::add_log("{}s, new size: {} bytes", cpu_time_used, result.size);
-
-        GvoxResult res = gvox_get_result(gvox_ctx);
-        // int error_count = 0;
-        while (res != GVOX_RESULT_SUCCESS) {
-            size_t size = 0;
-            gvox_get_result_message(gvox_ctx, nullptr, &size);
-            char *str = new char[size + 1];
-            gvox_get_result_message(gvox_ctx, str, nullptr);
-            str[size] = '\0';
-            debug_utils::Console::add_log(fmt::format("ERROR loading model: {}", str));
-            gvox_pop_result(gvox_ctx);
-            delete[] str;
-            res = gvox_get_result(gvox_ctx);
-            // ++error_count;
-            return {};
-        }
-    }
-
-    gvox_destroy_adapter_context(o_ctx);
-    gvox_destroy_adapter_context(s_ctx);
-    return result;
-}
-
-auto VoxelModelLoader::load_gvox_data() -> GvoxModelData {
-    auto result = GvoxModelData{};
-    auto file = std::ifstream(gvox_model_path, std::ios::binary);
-    if (!file.is_open()) {
-        debug_utils::Console::add_log("[error] Failed to load the model");
-        should_upload_gvox_model = false;
-        return result;
-    }
-    file.seekg(0, std::ios_base::end);
-    auto temp_gvox_model_size = static_cast<uint32_t>(file.tellg());
-    auto temp_gvox_model = std::vector<uint8_t>{};
-    temp_gvox_model.resize(temp_gvox_model_size);
-    {
-        // time_t start = clock();
-        file.seekg(0, std::ios_base::beg);
-        file.read(reinterpret_cast<char *>(temp_gvox_model.data()), static_cast<std::streamsize>(temp_gvox_model_size));
-        file.close();
-        // time_t end = clock();
-        // double cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
-        // debug_utils::Console::add_log("(pulling file into memory: {}s)", cpu_time_used);
-    }
-    GvoxByteBufferInputAdapterConfig i_config = {
-        .data = temp_gvox_model.data(),
-        .size = temp_gvox_model_size,
-    };
-    void *i_config_ptr = nullptr;
-    auto voxlap_config = GvoxVoxlapParseAdapterConfig{
-        .size_x = 512,
-        .size_y = 512,
-        .size_z = 64,
-        .make_solid = 1,
-        .is_ace_of_spades = 1,
-    };
-    char const *gvox_model_type = "gvox_palette";
-    if (gvox_model_path.has_extension()) {
-        auto ext = gvox_model_path.extension();
-        if (ext == ".vox") {
-            gvox_model_type = "magicavoxel";
-        } else if (ext == ".rle") {
-            gvox_model_type = "gvox_run_length_encoding";
-        } else if (ext == ".oct") {
-            gvox_model_type = "gvox_octree";
-        } else if (ext == ".glp") {
-            gvox_model_type = "gvox_global_palette";
-        } else if (ext == ".brk") {
-            gvox_model_type = "gvox_brickmap";
-        } else if (ext == ".gvr") {
-            gvox_model_type = "gvox_raw";
-        } else if (ext == ".vxl") {
-            i_config_ptr = &voxlap_config;
-            gvox_model_type = "voxlap";
-        } else if (ext == ".gvox") {
-            gvox_model_type = "gvox_palette";
-        } else {
-            return voxelize_mesh_model();
-        }
-    } else {
-        return voxelize_mesh_model();
-    }
-    GvoxAdapterContext *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
-    GvoxAdapterContext *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, gvox_model_type), i_config_ptr);
-    result = load_gvox_data_from_parser(i_ctx, p_ctx, nullptr);
-    gvox_destroy_adapter_context(i_ctx);
-    gvox_destroy_adapter_context(p_ctx);
-    return result;
 }
@@ -3,35 +3,169 @@
 #include <core.inl>
 #include <gvox/gvox.h>
 #include <application/ui.hpp>
-#include <future>
+#include <utilities/thread_pool.hpp>
 
-struct GvoxModelData {
-    size_t size = 0;
-    uint8_t *ptr = nullptr;
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Receives the serialized model (laid out as GpuGvoxModel) as it is produced, so that it never has
+// to exist as one allocation on the CPU.
+struct GvoxModelSink {
+    // Called when the serializer knows the final size up front. Writes may still go past it.
+    std::function<void(size_t size)> reserve;
+    std::function<void(size_t offset, std::span<uint8_t const> bytes)> write;
+    // Only called by AsyncModelLoad, which calls all of these on the thread that polls it. Either
+    // one of them is called exactly once, as the last call.
+    std::function<void(size_t model_size)> finish;
+    std::function<void()> cancel;
+};
+
+// Gathers the serializer's writes into slabs of at most `slab_size` bytes before handing them to
+// the sink. Writes that are bigger than a slab are passed through in slab sized pieces, without
+// being copied.
+struct GvoxSlabWriter {
+    static constexpr size_t DEFAULT_SLAB_SIZE = size_t{32} << 20;
+
+    GvoxModelSink *sink;
+    size_t slab_size = DEFAULT_SLAB_SIZE;
+    std::vector<uint8_t> slab{};
+    size_t slab_offset = 0;
+    // One past the last byte written so far.
+    size_t total_size = 0;
+    size_t flushed_slab_n = 0;
+
+    void write(size_t offset, std::span<uint8_t const> bytes);
+    void flush();
+};
+
+enum struct ModelLoadStage : uint32_t {
+    QUEUED,
+    READ_FILE,
+    PARSE,
+    VOXELIZE,
+    SERIALIZE,
+    UPLOAD,
+    DONE,
+    FAILED,
+    CANCELLED,
+};
+
+auto to_string(ModelLoadStage stage) -> std::string_view;
+
+struct ModelLoadProgress {
+    std::atomic<ModelLoadStage> stage{ModelLoadStage::QUEUED};
+    // From 0 to 1, within the current stage.
+    std::atomic<float> stage_progress{0.0f};
+    std::atomic_bool cancelled{false};
+
+    void set_stage(ModelLoadStage new_stage) {
+        stage_progress.store(0.0f, std::memory_order_relaxed);
+        stage.store(new_stage, std::memory_order_release);
+    }
+};
+
+struct ModelLoadInfo {
+    std::filesystem::path path;
+    // Voxels along the longest side of an imported mesh.
+    uint32_t mesh_voxelization_resolution = 768;
+    size_t slab_size = GvoxSlabWriter::DEFAULT_SLAB_SIZE;
+};
+
+// Loads any supported model (a gvox readable file, or a mesh to voxelize) into `sink`. Returns the
+// size of the serialized model, which is 0 when loading failed or was cancelled. Only touches its
+// own gvox context, so any number of these can run at once.
+auto load_gvox_model(ModelLoadInfo const &info, GvoxModelSink &sink, ModelLoadProgress &progress) -> size_t;
+
+// One model load, running on the thread pool. The serialized model is handed back in slabs, which
+// are passed on to an upload sink in poll(), one per call, so the sink is only ever called from the
+// polling thread. The loading job stalls while MAX_PENDING_SLAB_N slabs wait to be polled, so the
+// slabs in flight take at most (MAX_PENDING_SLAB_N + 2) * slab_size bytes: the pending ones, the
+// one the job is filling, and the one being uploaded. This doesn't cover the gvox_palette
+// serializer, which still builds its output in one piece before writing it out.
+struct AsyncModelLoad {
+    using LoadFunction = std::function<size_t(GvoxModelSink &sink, ModelLoadProgress &progress)>;
+    static constexpr size_t MAX_PENDING_SLAB_N = 4;
+
+    struct PendingSlab {
+        size_t offset;
+        std::vector<uint8_t> bytes;
+    };
+    // Shared with the loading job, which can outlive this when it is cancelled.
+    struct SharedState {
+        ModelLoadProgress progress;
+        std::mutex mtx;
+        std::condition_variable slab_polled;
+        std::deque<PendingSlab> pending_slabs;
+        size_t reserved_size = 0;
+        size_t written_end = 0;
+        bool is_finished = false;
+        size_t model_size = 0;
+    };
+
+    std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+    JobHandle job;
+    // Set once the upload sink got its finish or cancel call. The job may still be running then.
+    std::optional<ModelLoadStage> final_stage;
+
+    // Runs `load` on `thread_pool`, or right away on the calling thread when it is null (in which
+    // case nothing ever stalls).
+    void start(ThreadPool *thread_pool, LoadFunction load);
+    void cancel();
+    // Hands the oldest slab that is ready to `upload_sink`, and calls finish or cancel once the
+    // load is over and every slab was handed over. Returns the stage the load is in afterwards.
+    auto poll(GvoxModelSink &upload_sink) -> ModelLoadStage;
+    auto stage() const -> ModelLoadStage { return state->progress.stage.load(std::memory_order_acquire); }
+    auto stage_progress() const -> float { return state->progress.stage_progress.load(std::memory_order_relaxed); }
 };
 
 struct VoxelModelLoader {
-    GvoxContext *gvox_ctx;
     GpuContext *gpu_context;
 
     bool has_model = false;
-    std::future<GvoxModelData> gvox_model_data_future;
-    GvoxModelData gvox_model_data;
     bool should_upload_gvox_model = false;
     bool model_is_loading = false;
+    // Set once a load is done, until the app has regenerated the world from the new model.
     bool model_is_ready = false;
     std::filesystem::path gvox_model_path{};
+    // Voxels along the longest side of an imported mesh.
+    uint32_t mesh_voxelization_resolution = 768;
+    // Upper bound on the size of each upload. update() uploads one slab a frame, so the staging
+    // memory in use is at most this times the frames in flight.
+    size_t upload_slab_size = GvoxSlabWriter::DEFAULT_SLAB_SIZE;
+
+    std::unique_ptr<AsyncModelLoad> current_load;
+    // Loads that were replaced by another one, but haven't noticed that yet.
+    std::vector<JobHandle> cancelled_load_jobs;
+    // The buffer being filled by the current load. Swapped in once it is complete.
+    daxa::BufferId uploading_model_buffer{};
+    size_t uploading_model_buffer_size = 0;
+    struct PendingModelCopy {
+        daxa::BufferId src_buffer;
+        daxa::BufferId dst_buffer;
+        size_t src_offset;
+        size_t dst_offset;
+        size_t size;
+    };
+    std::vector<PendingModelCopy> pending_model_copies;
+    std::vector<daxa::BufferId> pending_model_buffer_destroys;
 
     daxa::BufferId gvox_model_buffer;
-    daxa::BufferId prev_gvox_model_buffer{};
     daxa::TaskBuffer task_gvox_model_buffer{{.name = "task_gvox_model_buffer"}};
 
     void create(GpuContext &gpu_context);
     void destroy();
 
     void update(AppUi &ui);
-    void upload_model();
-    auto load_gvox_data_from_parser(GvoxAdapterContext *i_ctx, GvoxAdapterContext *p_ctx, GvoxRegionRange const *region_range) -> GvoxModelData;
-    auto load_gvox_data() -> GvoxModelData;
-    auto voxelize_mesh_model() -> GvoxModelData;
+
+    auto make_upload_sink() -> GvoxModelSink;
+    void ensure_uploading_buffer_size(size_t size);
+    void submit_model_copies();
 };
@@ -0,0 +1,99 @@
+#include <voxels/model.hpp>
+#include <utilities/log.hpp>
+#include <utilities/thread_pool.hpp>
+
+#include <FreeImage.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Loads a model into a sink that throws the data away, and prints the time and peak memory it
+// took. Drives the same AsyncModelLoad as the app does, polled once a millisecond like a fast
+// frame loop, but doesn't need a device.
+// Usage: gvox_engine_model_load_bench <model> [slab size in MiB]
+
+namespace {
+    auto peak_memory_usage() -> size_t {
+#if defined(_WIN32)
+        auto counters = PROCESS_MEMORY_COUNTERS{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize;
+#else
+        auto usage = rusage{};
+        getrusage(RUSAGE_SELF, &usage);
+        // In kilobytes on Linux.
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+} // namespace
+
+auto main(int argc, char const *argv[]) -> int {
+    using namespace std::chrono_literals;
+    if (argc < 2) {
+        fmt::print("Usage: gvox_engine_model_load_bench <model> [slab size in MiB]\n");
+        return 1;
+    }
+    auto const info = ModelLoadInfo{
+        .path = argv[1],
+        .slab_size = argc < 3 ? GvoxSlabWriter::DEFAULT_SLAB_SIZE : std::max(size_t{1}, static_cast<size_t>(std::strtoull(argv[2], nullptr, 10))) << 20,
+    };
+
+    auto logger = Logger{{make_stdout_log_sink()}};
+    auto thread_pool = ThreadPool{};
+    thread_pool.start();
+    FreeImage_Initialise();
+
+    auto written_bytes = size_t{0};
+    auto largest_write = size_t{0};
+    auto upload_sink = GvoxModelSink{
+        .reserve = {},
+        .write = [&](size_t /*unused*/, std::span<uint8_t const> bytes) {
+            written_bytes += bytes.size();
+            largest_write = std::max(largest_write, bytes.size());
+        },
+        .finish = {},
+        .cancel = {},
+    };
+    auto const peak_memory_before = peak_memory_usage();
+    auto const t0 = std::chrono::steady_clock::now();
+    auto load = AsyncModelLoad{};
+    load.start(&thread_pool, [&info](GvoxModelSink &sink, ModelLoadProgress &progress) {
+        return load_gvox_model(info, sink, progress);
+    });
+    auto stage = load.poll(upload_sink);
+    while (stage != ModelLoadStage::DONE && stage != ModelLoadStage::FAILED && stage != ModelLoadStage::CANCELLED) {
+        std::this_thread::sleep_for(1ms);
+        stage = load.poll(upload_sink);
+    }
+    auto const t1 = std::chrono::steady_clock::now();
+    auto const peak_memory_after = peak_memory_usage();
+    FreeImage_DeInitialise();
+
+    if (stage != ModelLoadStage::DONE) {
+        log_error("Failed to load '{}'", info.path.string());
+        return 1;
+    }
+    auto const file_size = std::filesystem::is_regular_file(info.path) ? std::filesystem::file_size(info.path) : 0;
+    fmt::print("Loaded '{}' ({:.2f} MB) into {:.2f} MB in {:.3f}s, in {} MiB slabs (largest {:.2f} MB), peak memory {:.2f} MB (+{:.2f} MB)\n",
+               info.path.string(),
+               static_cast<double>(file_size) / 1'000'000.0,
+               static_cast<double>(written_bytes) / 1'000'000.0,
+               std::chrono::duration<double>(t1 - t0).count(),
+               info.slab_size >> 20,
+               static_cast<double>(largest_write) / 1'000'000.0,
+               static_cast<double>(peak_memory_after) / 1'000'000.0,
+               static_cast<double>(peak_memory_after - peak_memory_before) / 1'000'000.0);
+    return 0;
+}
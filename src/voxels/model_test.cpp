@@ -0,0 +1,291 @@
+#include <voxels/model.hpp>
+#include <utilities/unit_test.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    using namespace std::chrono_literals;
+
+    // Collects what a sink receives into one buffer, like the upload does on the GPU.
+    struct CollectingSink {
+        std::vector<uint8_t> bytes;
+        size_t write_n = 0;
+        size_t largest_write = 0;
+        size_t finished_size = 0;
+        bool is_cancelled = false;
+
+        auto make_sink() -> GvoxModelSink {
+            return {
+                .reserve = {},
+                .write = [this](size_t offset, std::span<uint8_t const> data) {
+                    if (offset + data.size() > bytes.size()) {
+                        bytes.resize(offset + data.size());
+                    }
+                    std::copy(data.begin(), data.end(), bytes.begin() + static_cast<std::ptrdiff_t>(offset));
+                    ++write_n;
+                    largest_write = std::max(largest_write, data.size());
+                },
+                .finish = [this](size_t model_size) { finished_size = model_size; },
+                .cancel = [this]() { is_cancelled = true; },
+            };
+        }
+    };
+
+    // Writes in the pattern of the serializer: mostly small appends, some writes bigger than a
+    // slab, and the header patched in at the start last.
+    void write_model(GvoxSlabWriter &writer, std::vector<uint8_t> &expected, uint32_t seed) {
+        auto rng = std::mt19937{seed};
+        auto offset = size_t{64};
+        expected.assign(offset, 0);
+        for (uint32_t write_i = 0; write_i < 200; ++write_i) {
+            auto const size = write_i % 37 == 0 ? writer.slab_size * 2 + rng() % 100 : size_t{rng() % 300};
+            auto bytes = std::vector<uint8_t>(size);
+            for (auto &byte : bytes) {
+                byte = static_cast<uint8_t>(rng());
+            }
+            writer.write(offset, bytes);
+            expected.insert(expected.end(), bytes.begin(), bytes.end());
+            offset += size;
+        }
+        auto header = std::array<uint8_t, 64>{};
+        header.fill(0xab);
+        writer.write(0, header);
+        std::copy(header.begin(), header.end(), expected.begin());
+        writer.flush();
+    }
+
+    auto test_slab_writer() -> std::string {
+        auto collected = CollectingSink{};
+        auto sink = collected.make_sink();
+        auto writer = GvoxSlabWriter{.sink = &sink, .slab_size = 1024};
+        auto expected = std::vector<uint8_t>{};
+        write_model(writer, expected, 0);
+        if (writer.total_size != expected.size()) {
+            return fmt::format("the writer counted {} bytes, instead of {}", writer.total_size, expected.size());
+        }
+        if (collected.largest_write > writer.slab_size) {
+            return fmt::format("the sink got a write of {} bytes, with {} byte slabs", collected.largest_write, writer.slab_size);
+        }
+        if (collected.bytes != expected) {
+            return "the slabs don't add up to what was written";
+        }
+        return {};
+    }
+
+    // A load that produces slabs much faster than they are polled has to wait for the poller, and
+    // each poll hands over a single slab.
+    auto test_slabs_in_flight_are_bounded() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(2);
+        auto expected = std::vector<uint8_t>{};
+        auto load = AsyncModelLoad{};
+        load.start(&pool, [&expected](GvoxModelSink &sink, ModelLoadProgress & /*unused*/) {
+            auto writer = GvoxSlabWriter{.sink = &sink, .slab_size = 1024};
+            write_model(writer, expected, 1);
+            return writer.total_size;
+        });
+        auto collected = CollectingSink{};
+        auto upload_sink = collected.make_sink();
+        auto max_pending_n = size_t{0};
+        auto stage = ModelLoadStage::QUEUED;
+        for (uint32_t poll_i = 0; poll_i < 100000; ++poll_i) {
+            // Gives the job time to run into the limit.
+            std::this_thread::sleep_for(100us);
+            {
+                auto lock = std::lock_guard{load.state->mtx};
+                max_pending_n = std::max(max_pending_n, load.state->pending_slabs.size());
+            }
+            auto const write_n_before = collected.write_n;
+            stage = load.poll(upload_sink);
+            if (collected.write_n > write_n_before + 1) {
+                return fmt::format("one poll handed over {} slabs", collected.write_n - write_n_before);
+            }
+            if (stage == ModelLoadStage::DONE || stage == ModelLoadStage::FAILED || stage == ModelLoadStage::CANCELLED) {
+                break;
+            }
+        }
+        pool.wait(load.job);
+        if (stage != ModelLoadStage::DONE) {
+            return fmt::format("the load ended in '{}'", to_string(stage));
+        }
+        if (max_pending_n > AsyncModelLoad::MAX_PENDING_SLAB_N) {
+            return fmt::format("{} slabs were pending at once", max_pending_n);
+        }
+        if (collected.finished_size != expected.size() || collected.bytes != expected) {
+            return fmt::format("finished with {} of {} bytes, {}", collected.finished_size, expected.size(), collected.bytes == expected ? "which match" : "which differ");
+        }
+        return {};
+    }
+
+    auto is_over(ModelLoadStage stage) -> bool {
+        return stage == ModelLoadStage::DONE || stage == ModelLoadStage::FAILED || stage == ModelLoadStage::CANCELLED;
+    }
+
+    // Spins until `condition` holds, for at most a few seconds.
+    template <typename Condition>
+    auto wait_for(Condition const &condition) -> bool {
+        auto const deadline = std::chrono::steady_clock::now() + 5s;
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    // The load is held in each stage until the test saw it there, and the stage only ever moves
+    // forward.
+    auto test_stages_and_progress() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(2);
+        auto step = std::atomic_uint32_t{0};
+        auto expected = std::vector<uint8_t>{};
+        auto load = AsyncModelLoad{};
+        load.start(&pool, [&](GvoxModelSink &sink, ModelLoadProgress &progress) {
+            progress.set_stage(ModelLoadStage::READ_FILE);
+            wait_for([&]() { return step.load() >= 1; });
+            progress.set_stage(ModelLoadStage::PARSE);
+            wait_for([&]() { return step.load() >= 2; });
+            sink.reserve(size_t{64} << 10);
+            auto writer = GvoxSlabWriter{.sink = &sink, .slab_size = 1024};
+            write_model(writer, expected, 2);
+            return writer.total_size;
+        });
+        auto collected = CollectingSink{};
+        auto upload_sink = collected.make_sink();
+        for (auto const held_stage : {ModelLoadStage::READ_FILE, ModelLoadStage::PARSE}) {
+            if (!wait_for([&]() { return load.stage() == held_stage; })) {
+                return fmt::format("the load never got to '{}'", to_string(held_stage));
+            }
+            if (load.poll(upload_sink) != held_stage || collected.write_n != 0) {
+                return fmt::format("polling in '{}' moved the load on, or wrote something", to_string(held_stage));
+            }
+            step.fetch_add(1);
+        }
+        auto previous_stage = ModelLoadStage::PARSE;
+        auto previous_progress = 0.0f;
+        while (true) {
+            auto const stage = load.poll(upload_sink);
+            auto const progress = load.stage_progress();
+            if (stage < previous_stage) {
+                return fmt::format("the load went back from '{}' to '{}'", to_string(previous_stage), to_string(stage));
+            }
+            if (progress < 0.0f || progress > 1.0f || (stage == ModelLoadStage::SERIALIZE && stage == previous_stage && progress < previous_progress)) {
+                return fmt::format("the progress went from {} to {} in '{}'", previous_progress, progress, to_string(stage));
+            }
+            previous_stage = stage;
+            previous_progress = progress;
+            if (is_over(stage)) {
+                break;
+            }
+        }
+        pool.wait(load.job);
+        if (previous_stage != ModelLoadStage::DONE || collected.is_cancelled) {
+            return fmt::format("the load ended in '{}'", to_string(previous_stage));
+        }
+        if (collected.finished_size != expected.size() || collected.bytes != expected) {
+            return fmt::format("finished with {} of {} bytes, {}", collected.finished_size, expected.size(), collected.bytes == expected ? "which match" : "which differ");
+        }
+        if (load.poll(upload_sink) != ModelLoadStage::DONE) {
+            return "polling after the load was done changed its stage";
+        }
+        return {};
+    }
+
+    // Cancelling wakes a job that stalls on the slab limit, and the upload gets its cancel call
+    // instead of finish.
+    auto test_cancel_stalled_load() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(2);
+        auto load = AsyncModelLoad{};
+        load.start(&pool, [](GvoxModelSink &sink, ModelLoadProgress &progress) {
+            auto bytes = std::array<uint8_t, 256>{};
+            for (size_t offset = 0; !progress.cancelled.load(); offset += bytes.size()) {
+                sink.write(offset, bytes);
+            }
+            return size_t{0};
+        });
+        if (!wait_for([&]() { auto lock = std::lock_guard{load.state->mtx}; return load.state->pending_slabs.size() == AsyncModelLoad::MAX_PENDING_SLAB_N; })) {
+            return "the load never filled up the pending slabs";
+        }
+        load.cancel();
+        auto collected = CollectingSink{};
+        auto upload_sink = collected.make_sink();
+        if (auto const stage = load.poll(upload_sink); stage != ModelLoadStage::CANCELLED) {
+            return fmt::format("the cancelled load is in '{}'", to_string(stage));
+        }
+        if (!collected.is_cancelled || collected.finished_size != 0 || collected.write_n != 0) {
+            return fmt::format("the upload got {} writes, {} and {}", collected.write_n, collected.is_cancelled ? "cancel" : "no cancel", collected.finished_size != 0 ? "finish" : "no finish");
+        }
+        pool.wait(load.job);
+        return {};
+    }
+
+    auto test_failed_load() -> std::string {
+        auto pool = ThreadPool{};
+        pool.start(2);
+        auto load = AsyncModelLoad{};
+        load.start(&pool, [](GvoxModelSink &sink, ModelLoadProgress & /*unused*/) {
+            auto bytes = std::array<uint8_t, 16>{};
+            sink.write(0, bytes);
+            return size_t{0};
+        });
+        auto collected = CollectingSink{};
+        auto upload_sink = collected.make_sink();
+        auto stage = ModelLoadStage::QUEUED;
+        if (!wait_for([&]() { stage = load.poll(upload_sink); return is_over(stage); })) {
+            return "the load never ended";
+        }
+        pool.wait(load.job);
+        if (stage != ModelLoadStage::FAILED || !collected.is_cancelled || collected.finished_size != 0) {
+            return fmt::format("the failed load ended in '{}', with {}", to_string(stage), collected.is_cancelled ? "cancel" : "no cancel");
+        }
+        return {};
+    }
+
+    // Without a pool, the load runs inside start(), and its slabs still come out one per poll.
+    auto test_inline_load() -> std::string {
+        auto expected = std::vector<uint8_t>{};
+        auto load = AsyncModelLoad{};
+        load.start(nullptr, [&expected](GvoxModelSink &sink, ModelLoadProgress & /*unused*/) {
+            auto writer = GvoxSlabWriter{.sink = &sink, .slab_size = 4096};
+            write_model(writer, expected, 3);
+            return writer.total_size;
+        });
+        if (load.stage() != ModelLoadStage::UPLOAD) {
+            return fmt::format("the load is in '{}' after start()", to_string(load.stage()));
+        }
+        auto collected = CollectingSink{};
+        auto upload_sink = collected.make_sink();
+        auto poll_n = size_t{0};
+        for (auto stage = ModelLoadStage::UPLOAD; !is_over(stage); ++poll_n) {
+            stage = load.poll(upload_sink);
+        }
+        if (poll_n != collected.write_n) {
+            return fmt::format("{} slabs took {} polls", collected.write_n, poll_n);
+        }
+        if (collected.finished_size != expected.size() || collected.bytes != expected) {
+            return "the inline load uploaded the wrong bytes";
+        }
+        return {};
+    }
+} // namespace
+
+auto main() -> int {
+    auto const cases = std::array{
+        UnitTestCase{"slab writer", test_slab_writer},
+        UnitTestCase{"slabs in flight are bounded", test_slabs_in_flight_are_bounded},
+        UnitTestCase{"stages and progress", test_stages_and_progress},
+        UnitTestCase{"cancelling a stalled load", test_cancel_stalled_load},
+        UnitTestCase{"failed load", test_failed_load},
+        UnitTestCase{"load without a pool", test_inline_load},
+    };
+    return run_unit_tests(cases);
+}
@@ -102,6 +102,11 @@ struct VoxelParticles {
     void simulate(GpuContext &gpu_context, VoxelWorldBuffers &voxel_world_buffers) {
         gpu_context.frame_task_graph.use_persistent_buffer(global_state.task_resource);
         gpu_context.frame_task_graph.use_persistent_buffer(cube_index_buffer.task_resource);
+        auto const use_buffer = [&gpu_context](auto &task_buffer) { gpu_context.frame_task_graph.use_persistent_buffer(task_buffer); };
+        grass.grass_allocator.for_each_task_buffer(use_buffer);
+        flowers.flower_allocator.for_each_task_buffer(use_buffer);
+        tree_particles.tree_particle_allocator.for_each_task_buffer(use_buffer);
+        fire_particles.fire_particle_allocator.for_each_task_buffer(use_buffer);
 
         gpu_context.add(ComputeTask<VoxelParticlePerframeCompute::Task, VoxelParticlePerframeComputePush, NoTaskInfo>{
             .source = daxa::ShaderFile{"voxels/particles/perframe.comp.glsl"},
@@ -1,2 +1,6 @@
 
 #include <voxels/impl/voxel_world.cpp>
+#include <voxels/impl/voxel_occupancy.cpp>
+#include <voxels/impl/world_save.cpp>
+#include <voxels/impl/chunk_pager.cpp>
+#include <voxels/impl/chunk_update_scheduler.cpp>